@@ -0,0 +1,151 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include "bench_common.h"
+#include <mutex>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::bench)
+
+Scene* create_mesh_scene(const std::string& name, const std::vector<Vec3>& ps, const std::string& accel, const Json& accel_prop) {
+    // Mesh with flat vertices
+    Json mesh_prop{
+        {"ps", Json::array()},
+        {"ns", {0,0,1}},
+        {"ts", {0,0}},
+        {"fs", {{"p", Json::array()}, {"t", Json::array()}, {"n", Json::array()}}}
+    };
+    for (int i = 0; i < int(ps.size()); i++) {
+        mesh_prop["ps"].insert(mesh_prop["ps"].end(), { ps[i].x, ps[i].y, ps[i].z });
+        mesh_prop["fs"]["p"].push_back(i);
+        mesh_prop["fs"]["t"].push_back(0);
+        mesh_prop["fs"]["n"].push_back(0);
+    }
+    const auto* mesh = load<Mesh>(name + "_mesh", "mesh::raw", mesh_prop);
+    const auto* material = load<Material>(name + "_material", "material::diffuse", {
+        {"Kd", {1,1,1}}
+    });
+    const auto* accel_ = load<Accel>(name + "_accel", accel, accel_prop);
+    auto* scene = load<Scene>(name, "scene::default", {
+        {"accel", accel_->loc()}
+    });
+    scene->add_primitive({
+        {"mesh", mesh->loc()},
+        {"material", material->loc()}
+    });
+    scene->build();
+    return scene;
+}
+
+std::vector<Vec3> triangle_grid(int n) {
+    std::vector<Vec3> ps;
+    ps.reserve(size_t(n) * n * 6);
+    const auto d = 2_f / n;
+    for (int y = 0; y < n; y++) for (int x = 0; x < n; x++) {
+        const Vec3 p00(-1_f + d * x, -1_f + d * y, 0_f);
+        const Vec3 p10 = p00 + Vec3(d, 0_f, 0_f);
+        const Vec3 p01 = p00 + Vec3(0_f, d, 0_f);
+        const Vec3 p11 = p00 + Vec3(d, d, 0_f);
+        ps.insert(ps.end(), { p00, p10, p11, p00, p11, p01 });
+    }
+    return ps;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace {
+
+bool perf_counters_enabled = false;
+
+#if defined(__linux__)
+// Hardware events in the order of the reported counters
+struct PerfEvent {
+    const char* name;
+    unsigned long long config;
+};
+const PerfEvent PerfEvents[] = {
+    { "cycles", PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+    { "llc_misses", PERF_COUNT_HW_CACHE_MISSES },
+    { "branch_misses", PERF_COUNT_HW_BRANCH_MISSES },
+};
+#endif
+
+}
+
+void enable_perf_counters(bool enable) {
+    perf_counters_enabled = enable;
+}
+
+ScopedPerfCounters::ScopedPerfCounters(benchmark::State& state)
+    : state_(state)
+{
+    if (!perf_counters_enabled) {
+        return;
+    }
+    #if defined(__linux__)
+    // Open the events as a group so that they are scheduled together
+    for (const auto& e : PerfEvents) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = e.config;
+        attr.disabled = fds_.empty() ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        const int group = fds_.empty() ? -1 : fds_[0];
+        const int fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+        if (fd < 0) {
+            // Unavailable, e.g., by perf_event_paranoid or in a virtual machine
+            static std::once_flag warned;
+            std::call_once(warned, [] {
+                LM_WARN("Hardware performance counters are unavailable");
+            });
+            for (const int f : fds_) {
+                close(f);
+            }
+            fds_.clear();
+            return;
+        }
+        fds_.push_back(fd);
+    }
+    ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    #endif
+}
+
+ScopedPerfCounters::~ScopedPerfCounters() {
+    if (fds_.empty()) {
+        return;
+    }
+    #if defined(__linux__)
+    ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // Layout of PERF_FORMAT_GROUP: number of events followed by the values
+    constexpr int NumEvents = int(std::size(PerfEvents));
+    unsigned long long values[1 + NumEvents] = {};
+    const bool ok = read(fds_[0], values, sizeof(values)) == ssize_t(sizeof(values));
+    for (const int fd : fds_) {
+        close(fd);
+    }
+    if (!ok) {
+        return;
+    }
+    for (int i = 0; i < NumEvents; i++) {
+        state_.counters[PerfEvents[i].name] = benchmark::Counter(double(values[1 + i]), benchmark::Counter::kAvgIterations);
+    }
+    if (values[1] > 0) {
+        // Instructions per cycle. Averaged over the threads of the multithreaded benchmarks.
+        state_.counters["ipc"] = benchmark::Counter(double(values[2]) / double(values[1]), benchmark::Counter::kAvgThreads);
+    }
+    #endif
+}
+
+LM_NAMESPACE_END(LM_NAMESPACE::bench)
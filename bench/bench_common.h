@@ -0,0 +1,45 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include <lm/lm.h>
+#include <benchmark/benchmark.h>
+#include <filesystem>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::bench)
+
+// Create a scene from the given geometry without camera.
+// The scene contains a single diffuse primitive and the acceleration structure is built.
+Scene* create_mesh_scene(const std::string& name, const std::vector<Vec3>& ps, const std::string& accel, const Json& accel_prop = {});
+
+// Grid of triangles of size n x n in [-1,1]^2 on z=0 plane
+std::vector<Vec3> triangle_grid(int n);
+
+// Register macro benchmarks using the scenes in the given directory
+void register_macro_benchmarks(const std::string& scene_dir);
+
+// Enable the collection of the hardware performance counters by ScopedPerfCounters
+void enable_perf_counters(bool enable);
+
+// Hardware performance counters of the calling thread during the lifetime of the object.
+// When enabled, the counters (cycles, instructions, LLC misses, and branch misses)
+// are read with perf_event on Linux and reported as the counters of the benchmark
+// averaged over the iterations, along with the instructions per cycle.
+// The object is intended to be created right before the benchmark loop.
+// If the counters are disabled or unavailable, the object does nothing.
+class ScopedPerfCounters {
+private:
+    benchmark::State& state_;
+    std::vector<int> fds_;      // File descriptors of the events. Empty if inactive.
+
+public:
+    ScopedPerfCounters(benchmark::State& state);
+    ~ScopedPerfCounters();
+    ScopedPerfCounters(const ScopedPerfCounters&) = delete;
+    ScopedPerfCounters& operator=(const ScopedPerfCounters&) = delete;
+};
+
+LM_NAMESPACE_END(LM_NAMESPACE::bench)
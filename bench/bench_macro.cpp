@@ -0,0 +1,124 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include "bench_common.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::bench)
+
+namespace {
+
+// Scene for the macro benchmarks
+struct BenchScene {
+    std::string name;
+    std::string path;       // Relative to the scene directory
+    Vec3 eye;
+    Vec3 lookat;
+    Float vfov;
+};
+
+const std::vector<BenchScene> Scenes{
+    { "cornell_box_sphere", "cornell_box/CornellBox-Sphere.obj", Vec3(0,1,5), Vec3(0,1,0), 30_f },
+    { "fireplace_room", "fireplace_room/fireplace_room.obj", Vec3(5.101118,1.083746,-2.756308), Vec3(4.167568,1.078925,-2.397892), 43.001194_f },
+};
+
+// Load a scene without building the acceleration structure
+Scene* load_scene(const std::string& scene_dir, const BenchScene& s, const std::string& accel, const Json& accel_prop) {
+    const auto* camera = load<Camera>("bench_camera", "camera::pinhole", {
+        {"position", s.eye},
+        {"center", s.lookat},
+        {"up", {0,1,0}},
+        {"vfov", s.vfov},
+        {"aspect", 16_f / 9_f}
+    });
+    const auto* model = load<Model>("bench_model", "model::wavefrontobj", {
+        {"path", (std::filesystem::path(scene_dir) / s.path).string()}
+    });
+    const auto* accel_ = load<Accel>("bench_accel", accel, accel_prop);
+    auto* scene = load<Scene>("bench_scene", "scene::default", {
+        {"accel", accel_->loc()}
+    });
+    scene->add_primitive({
+        {"camera", camera->loc()}
+    });
+    scene->add_primitive({
+        {"model", model->loc()}
+    });
+    return scene;
+}
+
+// Report the statistics of the renderer as the counters
+void set_render_counters(benchmark::State& state, const Json& result) {
+    const auto it = result.find("ray_stats");
+    if (it == result.end()) {
+        return;
+    }
+    state.counters["mrays_per_sec"] = (*it)["mrays_per_sec"].get<double>();
+    state.counters["avg_path_length"] = (*it)["avg_path_length"].get<double>();
+}
+
+}
+
+// ------------------------------------------------------------------------------------------------
+
+void register_macro_benchmarks(const std::string& scene_dir) {
+    for (const auto& s : Scenes) {
+        if (!std::filesystem::exists(std::filesystem::path(scene_dir) / s.path)) {
+            LM_WARN("Skipping missing scene [name='{}', dir='{}']", s.name, scene_dir);
+            continue;
+        }
+
+        // Build of the acceleration structures
+        const std::vector<std::tuple<std::string, std::string, Json>> accels{
+            { "sahbvh", "accel::sahbvh", Json::object() },
+            { "sahbvh_binned", "accel::sahbvh", {{"builder", "binned"}} },
+        };
+        for (const auto& [label, accel, accel_prop] : accels) {
+            benchmark::RegisterBenchmark(("BM_Accel_Build/" + s.name + "/" + label).c_str(),
+                [scene_dir, s, accel = accel, accel_prop = accel_prop](benchmark::State& state) {
+                    auto* scene = load_scene(scene_dir, s, accel, accel_prop);
+                    const ScopedPerfCounters perf_counters(state);
+                    for (auto _ : state) {
+                        scene->build();
+                    }
+                })
+                ->Unit(benchmark::kMillisecond)
+                ->UseRealTime();
+        }
+
+        // Rendering with fixed number of samples per pixel
+        const std::vector<std::tuple<std::string, Json>> renderers{
+            { "renderer::pt", {{"spp", 4}, {"max_verts", 10}} },
+            { "renderer::bdpt", {{"spp", 1}, {"max_verts", 10}} },
+        };
+        for (const auto& [renderer, renderer_prop] : renderers) {
+            benchmark::RegisterBenchmark(("BM_Render/" + s.name + "/" + renderer).c_str(),
+                [scene_dir, s, renderer = renderer, renderer_prop = renderer_prop](benchmark::State& state) {
+                    auto* scene = load_scene(scene_dir, s, "accel::sahbvh", {});
+                    scene->build();
+                    auto* film = load<Film>("bench_film", "film::bitmap", {
+                        {"w", 640},
+                        {"h", 360}
+                    });
+                    auto prop = renderer_prop;
+                    prop["scene"] = scene->loc();
+                    prop["output"] = film->loc();
+                    prop["scheduler"] = "sample";
+                    prop["seed"] = 42;
+                    const auto* r = load<Renderer>("bench_renderer", renderer, prop);
+                    Json result;
+                    const ScopedPerfCounters perf_counters(state);
+                    for (auto _ : state) {
+                        result = r->render();
+                    }
+                    set_render_counters(state, result);
+                })
+                ->Unit(benchmark::kMillisecond)
+                ->UseRealTime()
+                ->Iterations(1);
+        }
+    }
+}
+
+LM_NAMESPACE_END(LM_NAMESPACE::bench)
@@ -0,0 +1,146 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include "bench_common.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::bench)
+
+// Ray-triangle intersection through the acceleration structure with a single triangle
+static void BM_Tri_Intersect(benchmark::State& state) {
+    const bool watertight = state.range(0) != 0;
+    const auto* scene = create_mesh_scene("bench_tri", { Vec3(-1,-1,0), Vec3(1,-1,0), Vec3(0,1,0) },
+        "accel::sahbvh", { {"watertight", watertight} });
+    const auto* accel = scene->accel();
+
+    // Rays towards the plane of the triangle, half of which miss the triangle
+    Rng rng(42);
+    std::vector<Ray> rays(1024);
+    for (auto& ray : rays) {
+        const Vec3 o(rng.u() * 4_f - 2_f, rng.u() * 4_f - 2_f, 1_f);
+        ray = { o, glm::normalize(Vec3(0_f, 0_f, -1_f) + Vec3(rng.u() - .5_f, rng.u() - .5_f, 0_f) * .1_f) };
+    }
+
+    size_t i = 0;
+    const ScopedPerfCounters perf_counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(accel->intersect(rays[i], Eps, Inf));
+        i = (i + 1) % rays.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Tri_Intersect)->ArgName("watertight")->Arg(0)->Arg(1);
+
+// ------------------------------------------------------------------------------------------------
+
+// Sampling from discrete distribution with binary search or alias method
+static void BM_Dist_Sample(benchmark::State& state) {
+    const int n = int(state.range(0));
+    const bool alias = state.range(1) != 0;
+    Rng rng(42);
+    Dist dist;
+    for (int i = 0; i < n; i++) {
+        dist.add(rng.u());
+    }
+    dist.norm();
+    if (alias) {
+        dist.init_alias();
+    }
+    const ScopedPerfCounters perf_counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(dist.sample(rng.u()));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Dist_Sample)->ArgNames({"n", "alias"})->ArgsProduct({ {16, 1024, 1<<20}, {0, 1} });
+
+// ------------------------------------------------------------------------------------------------
+
+// Random number generation
+static void BM_Rng_U(benchmark::State& state) {
+    Rng rng(42);
+    const ScopedPerfCounters perf_counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rng.u());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Rng_U);
+
+// ------------------------------------------------------------------------------------------------
+
+// Splatting to a film from multiple threads.
+// All threads splat to a small film so that they contend on the same pixels.
+static void BM_Film_SplatPixel(benchmark::State& state) {
+    static Film* film = nullptr;
+    constexpr int Size = 16;
+    if (state.thread_index() == 0) {
+        film = load<Film>("bench_film", "film::bitmap", {
+            {"w", Size},
+            {"h", Size},
+            {"splat_mode", state.range(0) == 0 ? "atomic" : "thread_local"}
+        });
+    }
+    Rng rng(state.thread_index());
+    const ScopedPerfCounters perf_counters(state);
+    for (auto _ : state) {
+        const int x = std::min(int(rng.u() * Size), Size - 1);
+        const int y = std::min(int(rng.u() * Size), Size - 1);
+        film->splat_pixel(x, y, Vec3(1_f));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Film_SplatPixel)->ArgName("thread_local")->Arg(0)->Arg(1)->ThreadRange(1, 64)->UseRealTime();
+
+// ------------------------------------------------------------------------------------------------
+
+// Distance sampling in a heterogeneous medium with a Gaussian density.
+// The rays pass through the center of the volume in random directions.
+static void BM_Medium_SampleDistance(benchmark::State& state) {
+    const auto* density = load<Volume>("bench_medium_density", "volume::gaussian", {
+        {"scalar", 10},
+        {"pos", {0,0,0}},
+        {"sigma", {.3,.3,.3}}
+    });
+    const auto* albedo = load<Volume>("bench_medium_albedo", "volume::constant", {
+        {"color", {.8,.8,.8}}
+    });
+    const auto* phase = load<Phase>("bench_medium_phase", "phase::isotropic", {});
+    const auto* medium = load<Medium>("bench_medium", "medium::heterogeneous", {
+        {"volume_density", density->loc()},
+        {"volume_albedo", albedo->loc()},
+        {"phase", phase->loc()}
+    });
+    Rng rng(42);
+    std::vector<Ray> rays(1024);
+    for (auto& ray : rays) {
+        const auto d = math::sample_uniform_sphere(Vec2(rng.u(), rng.u()));
+        ray = { -d * 2_f, d };
+    }
+    size_t i = 0;
+    const ScopedPerfCounters perf_counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(medium->sample_distance(rng, rays[i], 0_f, 4_f));
+        i = (i + 1) % rays.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Medium_SampleDistance);
+
+// ------------------------------------------------------------------------------------------------
+
+// Dispatch overhead of parallel loop with an empty body
+static void BM_Parallel_Foreach(benchmark::State& state) {
+    const long long n = state.range(0);
+    const ScopedPerfCounters perf_counters(state);
+    for (auto _ : state) {
+        parallel::foreach(n, [](long long index, int) {
+            benchmark::DoNotOptimize(index);
+        });
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Parallel_Foreach)->Arg(1)->Arg(1<<10)->Arg(1<<20)->UseRealTime();
+
+LM_NAMESPACE_END(LM_NAMESPACE::bench)
@@ -0,0 +1,66 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include "bench_common.h"
+
+/*
+    Benchmark suite of the framework.
+    The micro benchmarks run without any assets. The macro benchmarks are registered
+    only when the directory of the scenes is given by `--lm_scene_dir` option.
+    With `--lm_perf_counters` option, the benchmarks also report the hardware performance
+    counters on Linux (cycles, instructions, LLC misses, and branch misses per iteration).
+    The other options are passed to Google Benchmark, e.g., to write the results in JSON:
+
+    Example:
+    $ ./lm_bench --lm_scene_dir=./scenes --benchmark_out=result.json --benchmark_out_format=json
+    $ ./lm_bench --lm_perf_counters --benchmark_filter=BM_Film_SplatPixel
+*/
+int main(int argc, char** argv) {
+    // Extract the options of the suite
+    std::string scene_dir;
+    const std::string scene_dir_opt = "--lm_scene_dir=";
+    int n = 1;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg.compare(0, scene_dir_opt.size(), scene_dir_opt) == 0) {
+            scene_dir = arg.substr(scene_dir_opt.size());
+            continue;
+        }
+        if (arg == "--lm_perf_counters") {
+            lm::bench::enable_perf_counters(true);
+            continue;
+        }
+        argv[n++] = argv[i];
+    }
+    argc = n;
+
+    try {
+        lm::init();
+        lm::log::set_severity(lm::log::LogLevel::Warn);
+        lm::parallel::init(lm::parallel::DefaultType, {
+            {"num_threads", -1}
+        });
+
+        benchmark::Initialize(&argc, argv);
+        if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+            return 1;
+        }
+        // Record the floating point type so that the results of
+        // the builds with and without LM_USE_SINGLE_PRECISION can be compared
+        benchmark::AddCustomContext("lm_float", LM_SINGLE_PRECISION ? "float32" : "float64");
+        if (!scene_dir.empty()) {
+            lm::bench::register_macro_benchmarks(scene_dir);
+        }
+        benchmark::RunSpecifiedBenchmarks();
+
+        lm::shutdown();
+    }
+    catch (const std::exception& e) {
+        LM_ERROR("Runtime error: {}", e.what());
+        return 1;
+    }
+
+    return 0;
+}
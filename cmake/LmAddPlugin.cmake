@@ -19,6 +19,24 @@ function(lm_add_plugin)
         set(_INTERFACE_DEFINED 0)
     endif()
 
+    # Link the plugin statically into liblm if the plugin is listed in LM_STATIC_PLUGINS.
+    # The sources are compiled as a part of liblm and the components are registered
+    # on loading liblm, so the plugin is not loaded dynamically.
+    if (_ARG_NAME IN_LIST LM_STATIC_PLUGINS)
+        set(_SOURCES "")
+        foreach(_SOURCE ${_ARG_HEADERS} ${_ARG_SOURCES})
+            get_filename_component(_SOURCE "${_SOURCE}" ABSOLUTE)
+            list(APPEND _SOURCES "${_SOURCE}")
+        endforeach()
+        target_sources(liblm PRIVATE ${_SOURCES})
+        target_link_libraries(liblm PRIVATE ${_ARG_LIBRARIES})
+        if (_INTERFACE_DEFINED)
+            target_link_libraries(liblm PRIVATE ${_ARG_NAME}_interface)
+        endif()
+        set_property(GLOBAL APPEND PROPERTY LM_STATIC_PLUGIN_NAMES ${_ARG_NAME})
+        return()
+    endif()
+
     # MODULE library for the dynamic loaded library
     add_library(${_ARG_NAME} MODULE ${_ARG_HEADERS} ${_ARG_SOURCES})
     target_link_libraries(${_ARG_NAME}
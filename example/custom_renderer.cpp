@@ -27,8 +27,8 @@ public:
 
     virtual Json render() const override {
         const auto size = film_->size();
-        parallel::foreach(size.w*size.h, [&](long long index, int threadId) -> void {
-            thread_local Rng rng(rng_seed_ + threadId);
+        parallel::foreach(size.w*size.h, [&](long long index, int) -> void {
+            auto rng = Rng(rng_seed_).split(index, 0);
             const int x = int(index % size.w);
             const int y = int(index / size.w);
             const auto ray = path::primary_ray(scene_, {(x+.5_f)/size.w, (y+.5_f)/size.h});
@@ -63,7 +63,7 @@ def build_and_render(scene, accel_name):
 
 # + {"code_folding": []}
 # Accels and scenes
-accel_names = ['nanort', 'embree', 'embreeinstanced']
+accel_names = ['sahbvhinstanced', 'nanort', 'embree', 'embreeinstanced']
 scene_names = lmscene.scenes_small()
 
 
@@ -0,0 +1,114 @@
+# ---
+# jupyter:
+#   jupytext:
+#     formats: ipynb,py:light
+#     text_representation:
+#       extension: .py
+#       format_name: light
+#       format_version: '1.4'
+#       jupytext_version: 1.2.4
+#   kernelspec:
+#     display_name: Python 3
+#     language: python
+#     name: python3
+# ---
+
+# ## Distributed rendering
+#
+# This test checks the distributed rendering with local worker processes. First, a single worker renders a single task covering all samples. The round trip of the task and the serialized partial film must reproduce the image rendered in a single process with the same samples and seed. Then the coordinator partitions the samples into tasks and merges the partial films rendered by multiple workers. The result is compared with the image rendered in a single process with the same number of samples.
+
+import lmenv
+env = lmenv.load('.lmenv')
+
+import os
+import numpy as np
+import multiprocessing as mp
+# %matplotlib inline
+import matplotlib.pyplot as plt
+import lmscene
+import lightmetrica as lm
+
+# %load_ext lightmetrica_jupyter
+
+lm.init()
+lm.log.init('jupyter')
+lm.progress.init('jupyter')
+lm.info()
+
+address = ('localhost', 5000)
+scene_name = 'fireplace_room'
+spp = 64
+
+
+# Setup the scene and film in a process
+def setup():
+    accel = lm.load_accel('accel', 'sahbvh')
+    scene = lm.load_scene('scene', 'default', accel=accel)
+    lmscene.load(scene, env.scene_path, scene_name)
+    scene.build()
+    film = lm.load_film('film_output', 'bitmap', w=640, h=360)
+    return scene, film
+
+
+# Worker process rendering the tasks given by the coordinator
+def run_worker():
+    lm.init()
+    scene, film = setup()
+    def render(params):
+        renderer = lm.load_renderer('renderer', 'pt',
+            scene=scene.loc(),
+            output=film.loc(),
+            scheduler='sample',
+            max_verts=10,
+            **params)
+        result = renderer.render()
+        return film, result['processed']
+    lm.distributed.worker(address, render)
+
+
+scene, film = setup()
+
+# ### Single process
+
+renderer = lm.load_renderer('renderer', 'pt',
+    scene=scene.loc(),
+    output=film.loc(),
+    scheduler='sample',
+    max_verts=10,
+    spp=spp,
+    seed=0)
+renderer.render()
+img_single = np.copy(film.buffer())
+
+# ### Single worker round trip
+
+coord = lm.distributed.Coordinator(address)
+w = mp.Process(target=run_worker)
+w.start()
+processed = coord.render(film, lm.distributed.partition('spp', spp, 1))
+coord.close()
+w.join()
+img_roundtrip = np.copy(film.buffer())
+assert w.exitcode == 0
+assert np.allclose(img_single, img_roundtrip)
+
+# ### Distributed
+
+coord = lm.distributed.Coordinator(address)
+workers = [mp.Process(target=run_worker) for _ in range(2)]
+for w in workers:
+    w.start()
+processed = coord.render(film, lm.distributed.partition('spp', spp, 8))
+coord.close()
+for w in workers:
+    w.join()
+img_dist = np.copy(film.buffer())
+processed
+
+f = plt.figure(figsize=(15,15))
+ax = f.add_subplot(111)
+ax.imshow(np.clip(np.power(img_dist,1/2.2),0,1), origin='lower')
+plt.show()
+
+# RMSE against the single-process rendering
+np.sqrt(np.mean((img_single - img_dist) ** 2))
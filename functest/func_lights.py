@@ -120,3 +120,19 @@ lmscene.bunny_with_directional_light(scene, env.scene_path, mat_knob=mat.loc())
 scene.build()
 img = render(scene, 'pt')
 display_image(img)
+
+# ### Light selection
+#
+# `light_selection` parameter of `scene::default`. The strategies must converge to the same image.
+
+imgs = {}
+for light_selection in ['uniform', 'power', 'bvh']:
+    scene_ls = lm.load_scene('scene_ls', 'default', accel=accel, light_selection=light_selection)
+    lmscene.fireplace_room(scene_ls, env.scene_path)
+    scene_ls.build()
+    imgs[light_selection] = render(scene_ls, 'pt')
+    display_image(imgs[light_selection])
+
+for light_selection in ['power', 'bvh']:
+    rmse = np.sqrt(np.mean((imgs['uniform'] - imgs[light_selection])**2))
+    print('{}: rmse={}'.format(light_selection, rmse))
@@ -0,0 +1,77 @@
+# ---
+# jupyter:
+#   jupytext:
+#     formats: ipynb,py:light
+#     text_representation:
+#       extension: .py
+#       format_name: light
+#       format_version: '1.4'
+#       jupytext_version: 1.2.4
+#   kernelspec:
+#     display_name: Python 3
+#     language: python
+#     name: python3
+# ---
+
+# ## Progressive preview streaming
+#
+# This test checks the preview stream publishing the frames of a film during progressive rendering. The frames are collected in place of a transport like a websocket or a ZMQ socket, and decoded as a remote viewer would do. We check that the decoded frames reproduce the tonemapped snapshots and compare the sizes of the key frames and the delta frames.
+
+import lmenv
+env = lmenv.load('.lmenv')
+
+import numpy as np
+# %matplotlib inline
+import matplotlib.pyplot as plt
+import lightmetrica as lm
+# %load_ext lightmetrica_jupyter
+import lmscene
+
+lm.init()
+lm.log.init('jupyter')
+lm.progress.init('jupyter')
+lm.info()
+
+accel = lm.load_accel('accel', 'sahbvh')
+scene = lm.load_scene('scene', 'default', accel=accel)
+lmscene.load(scene, env.scene_path, 'fireplace_room')
+scene.build()
+film = lm.load_film('film_output', 'bitmap', w=1920, h=1080)
+
+# ### Render with the preview stream
+
+frames = []
+renderer = lm.load_renderer('renderer', 'pt',
+    scene=scene.loc(),
+    output=film.loc(),
+    max_verts=20,
+    scheduler='time',
+    render_time=10)
+stream = lm.preview.PreviewStream(film, frames.append, rate=5, downsample=4, keyframe_interval=10)
+with stream:
+    renderer.render()
+print('Sent frames: {}, dropped frames: {}'.format(stream.num_sent, stream.num_dropped))
+
+# ### Decode the frames
+
+decoder = lm.preview.PreviewDecoder()
+images = []
+for data in frames:
+    images.append(np.copy(decoder.decode(data)))
+kinds = [data[5] for data in frames]
+key_sizes = [len(data) for data in frames if data[5] == lm.preview.KeyFrame]
+delta_sizes = [len(data) for data in frames if data[5] == lm.preview.DeltaFrame]
+print('Key frames: {}, average size: {:.1f}KB'.format(len(key_sizes), np.mean(key_sizes) / 1024))
+if delta_sizes:
+    print('Delta frames: {}, average size: {:.1f}KB'.format(len(delta_sizes), np.mean(delta_sizes) / 1024))
+
+# The last frame is the last published snapshot
+expected = lm.preview.tonemap(film.snapshot(), downsample=4)
+print('Max difference of the last frame: {}'.format(np.abs(images[-1].astype(int) - expected.astype(int)).max()))
+
+f = plt.figure(figsize=(15,8))
+for i, j in enumerate(np.linspace(0, len(images)-1, 4).astype(int)):
+    ax = f.add_subplot(2, 2, i+1)
+    ax.imshow(images[j])
+    ax.set_title('Frame {} ({})'.format(j, 'key' if kinds[j] == lm.preview.KeyFrame else 'delta'))
+plt.show()
@@ -0,0 +1,86 @@
+# ---
+# jupyter:
+#   jupytext:
+#     formats: ipynb,py:light
+#     text_representation:
+#       extension: .py
+#       format_name: light
+#       format_version: '1.5'
+#       jupytext_version: 1.3.3
+#   kernelspec:
+#     display_name: Python 3
+#     language: python
+#     name: python3
+# ---
+
+# ## Samplers
+#
+# This test compares the convergence of the path tracer with the random and low-discrepancy samplers.
+
+import lmenv
+env = lmenv.load('.lmenv')
+
+import os
+import numpy as np
+# %matplotlib inline
+import matplotlib.pyplot as plt
+import lightmetrica as lm
+# %load_ext lightmetrica_jupyter
+import lmscene
+import util
+
+lm.init()
+lm.log.init('jupyter')
+lm.progress.init('jupyter')
+lm.info()
+lm.comp.load_plugin(os.path.join(env.bin_path, 'accel_embree'))
+if not lm.Release:
+    lm.parallel.init('openmp', num_threads=1)
+    lm.debug.attach_to_debugger()
+
+accel = lm.load_accel('accel', 'embree')
+scene = lm.load_scene('scene', 'default', accel=accel)
+lmscene.cornell_box_sphere(scene, env.scene_path)
+scene.build()
+film = lm.load_film('film_output', 'bitmap', w=320, h=180)
+
+
+def render(sampler, spp):
+    renderer = lm.load_renderer('renderer', 'pt',
+        scene=scene,
+        output=film,
+        max_verts=10,
+        scheduler='sample',
+        spp=spp,
+        sampler=sampler,
+        seed=42)
+    renderer.render()
+    return np.copy(film.buffer())
+
+
+# ### Reference
+
+ref = render('random', 4096)
+f = plt.figure(figsize=(10,10))
+ax = f.add_subplot(111)
+ax.imshow(np.clip(np.power(ref,1/2.2),0,1), origin='lower')
+plt.show()
+
+# ### Convergence
+
+samplers = ['random', 'sobol', 'halton']
+spps = [1, 2, 4, 8, 16, 32, 64, 128]
+errs = {}
+for sampler in samplers:
+    errs[sampler] = [util.rmse(ref, render(sampler, spp)) for spp in spps]
+
+f = plt.figure(figsize=(10,5))
+ax = f.add_subplot(111)
+for sampler in samplers:
+    ax.plot(spps, errs[sampler], label=sampler, marker='o')
+ax.set_xscale('log', basex=2)
+ax.set_yscale('log')
+ax.set_xlabel('spp')
+ax.set_ylabel('RMSE')
+ax.legend()
+plt.show()
@@ -82,6 +82,22 @@ ax = f.add_subplot(111)
 ax.imshow(np.clip(np.power(img2,1/2.2),0,1), origin='lower')
 plt.show()
 
+# ### w/ tile-based scheduler
+
+renderer = lm.load_renderer('renderer', 'pt',
+    **shared_renderer_params,
+    scheduler='tile',
+    spp=1,
+    tile_size=16,
+    order='hilbert')
+renderer.render()
+
+img3 = np.copy(film.buffer())
+f = plt.figure(figsize=(15,15))
+ax = f.add_subplot(111)
+ax.imshow(np.clip(np.power(img3,1/2.2),0,1), origin='lower')
+plt.show()
+
 # ### Diff
 
 from scipy.ndimage import gaussian_filter
@@ -0,0 +1,97 @@
+# ---
+# jupyter:
+#   jupytext:
+#     formats: ipynb,py:light
+#     text_representation:
+#       extension: .py
+#       format_name: light
+#       format_version: '1.4'
+#       jupytext_version: 1.2.4
+#   kernelspec:
+#     display_name: Python 3
+#     language: python
+#     name: python3
+# ---
+
+# ## Render server
+#
+# This test checks the render server keeping the scene resident across jobs. A server process loads and builds the scene once, and the client requests preview renders with different cameras. The latency of the jobs excludes the setup of the scene.
+
+import lmenv
+env = lmenv.load('.lmenv')
+
+import time
+import numpy as np
+import multiprocessing as mp
+# %matplotlib inline
+import matplotlib.pyplot as plt
+import lmscene
+import lightmetrica as lm
+
+# %load_ext lightmetrica_jupyter
+
+address = ('localhost', 5001)
+scene_name = 'fireplace_room'
+
+
+# Server process
+def run_server():
+    lm.init()
+    accel = lm.load_accel('accel', 'sahbvh')
+    scene = lm.load_scene('scene', 'default', accel=accel)
+    lmscene.load(scene, env.scene_path, scene_name)
+    scene.build()
+    server = lm.server.Server(address)
+    server.add_scene(scene_name, scene)
+    server.serve()
+
+
+server = mp.Process(target=run_server, daemon=True)
+server.start()
+
+# Wait for the server to set up the scene
+while True:
+    try:
+        client = lm.server.Client(address)
+        break
+    except ConnectionRefusedError:
+        time.sleep(1)
+client.scenes()
+
+# ### Preview renders with different cameras
+
+# Rotate the viewing direction of the original camera around the up vector
+position = np.array([5.101118, 1.083746, -2.756308])
+d = np.array([4.167568, 1.078925, -2.397892]) - position
+images = []
+for i in range(4):
+    theta = (i - 1.5) * np.pi / 12
+    c, s = np.cos(theta), np.sin(theta)
+    center = position + np.array([c*d[0] + s*d[2], d[1], -s*d[0] + c*d[2]])
+    img, result = client.render(scene_name, 'pt', w=320, h=180,
+        camera={
+            'position': position.tolist(),
+            'center': center.tolist(),
+            'up': [0, 1, 0],
+            'vfov': 43.001194
+        },
+        scheduler='sample', spp=4, max_verts=10)
+    images.append(img)
+    print('Job {} [elapsed={:.3f}s]'.format(i, result['elapsed']))
+
+f = plt.figure(figsize=(15,8))
+for i, img in enumerate(images):
+    ax = f.add_subplot(2, 2, i+1)
+    ax.imshow(np.clip(np.power(img,1/2.2),0,1), origin='lower')
+plt.show()
+
+# ### Original camera of the scene
+
+img, result = client.render(scene_name, 'pt', w=320, h=180, scheduler='sample', spp=4, max_verts=10)
+f = plt.figure(figsize=(8,8))
+ax = f.add_subplot(111)
+ax.imshow(np.clip(np.power(img,1/2.2),0,1), origin='lower')
+plt.show()
+
+client.close()
+server.terminate()
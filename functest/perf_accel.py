@@ -41,12 +41,20 @@ lm.info()
 lm.comp.load_plugin(os.path.join(env.bin_path, 'accel_nanort'))
 lm.comp.load_plugin(os.path.join(env.bin_path, 'accel_embree'))
 
-accel_names = [
-    'sahbvh',
-    'nanort',
-    'embree',
-    'embreeinstanced'
+# Accel configurations (label, accel name, properties)
+accel_configs = [
+    ('sahbvh', 'sahbvh', {}),
+    ('sahbvh_binned', 'sahbvh', {'builder': 'binned'}),
+    ('sahbvh_lbvh', 'sahbvh', {'builder': 'lbvh'}),
+    ('sahbvhprogressive', 'sahbvhprogressive', {}),
+    ('sahbvh4', 'sahbvh', {'width': 4}),
+    ('sahbvh8', 'sahbvh', {'width': 8}),
+    ('nanort', 'nanort', {}),
+    ('embree', 'embree', {}),
+    ('embreeinstanced', 'embreeinstanced', {}),
+    ('sahbvhinstanced', 'sahbvhinstanced', {})
 ]
+accel_names = [label for label, _, _ in accel_configs]
 scene_names = lmscene.scenes_small()
 
 # +
@@ -67,20 +75,53 @@ for scene_name in scene_names:
         'output': film.loc()
     })
         
-    for accel_name in accel_names:
-        accel = lm.load_accel('accel', accel_name, {})
+    for accel_label, accel_name, accel_params in accel_configs:
+        accel = lm.load_accel('accel', accel_name, accel_params)
         scene.set_accel(accel.loc())
         def build():
             scene.build()
         build_time = timeit.timeit(stmt=build, number=1)
-        build_time_df[accel_name][scene_name] = build_time
+        build_time_df[accel_label][scene_name] = build_time
 
         def render():
             renderer.render()
         render_time = timeit.timeit(stmt=render, number=1)
-        render_time_df[accel_name][scene_name] = render_time
+        render_time_df[accel_label][scene_name] = render_time
 # -
 
 build_time_df
 
 render_time_df
+
+# ### Quality of the structures
+#
+# We compare the statistics of the structures and the measured traversal costs per ray reported by `lm.accel.analyze`. The implementations not supporting the statistics show missing values.
+
+# +
+structure_metrics = ['sah_cost', 'nodes', 'leaves', 'max_depth', 'avg_leaf_size', 'memory']
+ray_metrics = ['time_per_ray', 'nodes_per_ray', 'triangles_per_ray']
+metrics = structure_metrics + [
+    '{}_{}'.format(ray_type, k) for ray_type in ['primary', 'secondary'] for k in ray_metrics]
+analysis_dfs = {}
+
+for scene_name in scene_names:
+    scene = lm.load_scene('scene', 'default', {})
+    lmscene.load(scene, env.scene_path, scene_name)
+    df = pd.DataFrame(columns=accel_names, index=metrics)
+    for accel_label, accel_name, accel_params in accel_configs:
+        accel = lm.load_accel('accel', accel_name, accel_params)
+        scene.set_accel(accel.loc())
+        scene.build()
+        report = lm.accel.analyze(scene)
+        structure = report['structure'] or {}
+        for k in structure_metrics:
+            df[accel_label][k] = structure.get(k)
+        for ray_type in ['primary', 'secondary']:
+            for k in ray_metrics:
+                df[accel_label]['{}_{}'.format(ray_type, k)] = report[ray_type][k]
+    analysis_dfs[scene_name] = df
+# -
+
+for scene_name in scene_names:
+    print(scene_name)
+    display(analysis_dfs[scene_name])
@@ -0,0 +1,130 @@
+# ---
+# jupyter:
+#   jupytext:
+#     formats: ipynb,py:light
+#     text_representation:
+#       extension: .py
+#       format_name: light
+#       format_version: '1.4'
+#       jupytext_version: 1.2.4
+#   kernelspec:
+#     display_name: Python 3
+#     language: python
+#     name: python3
+# ---
+
+# ## Equal-time convergence of renderers
+#
+# This test compares the renderers by the error against the reference images for the same rendering time, instead of the raw speed. Each renderer renders the scenes with `scheduler::spp::time` for increasing time budgets, and the RMSE and the relative MSE (relMSE) against the reference are measured. The efficiency is the inverse of the product of the relMSE and the time. The reference images are loaded from `reference_path` of `.lmenv` (default: `<scene_path>/reference`) as `<scene>.npy`. Missing references are rendered by `renderer::pt` with a long time budget and stored for the next runs. The curves are written to `convergence.json` and `convergence.csv` in the working directory.
+
+import lmenv
+env = lmenv.load('.lmenv')
+
+import os
+import json
+import pandas as pd
+import numpy as np
+# %matplotlib inline
+import matplotlib.pyplot as plt
+import lmscene
+import lightmetrica as lm
+
+# %load_ext lightmetrica_jupyter
+
+lm.init()
+lm.log.init('jupyter')
+lm.progress.init('jupyter')
+lm.info()
+
+lm.comp.load_plugin(os.path.join(env.bin_path, 'accel_embree'))
+
+# +
+# Renderer configurations (label, renderer name, properties)
+renderer_configs = [
+    ('pt', 'pt', {'sampling_mode': 'mis'}),
+    ('pt_ris', 'pt', {'sampling_mode': 'mis', 'ris_candidates': 8}),
+    ('pt_split', 'pt', {'sampling_mode': 'mis', 'split': 4}),
+    ('lt', 'lt', {}),
+    ('bdpt', 'bdpt', {}),
+    ('bdptopt', 'bdptopt', {}),
+]
+scene_names = ['cornell_box_sphere', 'fireplace_room']
+time_budgets = [1, 2, 4, 8, 16]
+reference_time = 600
+w = 640
+h = 360
+max_verts = 10
+
+reference_path = getattr(env, 'reference_path', os.path.join(env.scene_path, 'reference'))
+os.makedirs(reference_path, exist_ok=True)
+
+
+# -
+
+def render(scene, name, render_time, **kwargs):
+    film = lm.load_film('film', 'bitmap', w=w, h=h)
+    renderer = lm.load_renderer('renderer', name,
+        scene=scene,
+        output=film,
+        max_verts=max_verts,
+        scheduler='time',
+        render_time=render_time,
+        **kwargs)
+    out = renderer.render()
+    return np.copy(film.buffer()), out
+
+
+def rmse(ref, img):
+    return np.sqrt(np.mean((ref - img)**2))
+
+
+def relmse(ref, img, eps=1e-2):
+    return np.mean((ref - img)**2 / (ref**2 + eps))
+
+
+# +
+records = []
+for scene_name in scene_names:
+    accel = lm.load_accel('accel', 'embree')
+    scene = lm.load_scene('scene', 'default', accel=accel)
+    lmscene.load(scene, env.scene_path, scene_name)
+    scene.build()
+
+    # Reference image
+    ref_file = os.path.join(reference_path, scene_name + '.npy')
+    if os.path.exists(ref_file):
+        ref = np.load(ref_file)
+    else:
+        ref, _ = render(scene, 'pt', reference_time, sampling_mode='mis')
+        np.save(ref_file, ref)
+
+    # Errors for each time budget
+    for label, name, params in renderer_configs:
+        for render_time in time_budgets:
+            img, out = render(scene, name, render_time, **params)
+            e = relmse(ref, img)
+            records.append({
+                'scene': scene_name,
+                'renderer': label,
+                'time': render_time,
+                'processed': out.get('processed'),
+                'rmse': rmse(ref, img),
+                'relmse': e,
+                'efficiency': 1 / (e * render_time) if e > 0 else float('inf')
+            })
+
+df = pd.DataFrame(records)
+df.to_csv('convergence.csv', index=False)
+with open('convergence.json', 'w') as f:
+    json.dump(records, f, indent=2)
+df
+# -
+
+# relMSE against time for each scene
+for scene_name in scene_names:
+    ax = df[df.scene == scene_name].pivot(index='time', columns='renderer', values='relmse').plot(
+        logx=True, logy=True, marker='o', figsize=(10,5))
+    ax.set_title(scene_name)
+    ax.set_xlabel('time [s]')
+    ax.set_ylabel('relMSE')
+    plt.show()
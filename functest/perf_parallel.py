@@ -0,0 +1,61 @@
+# ---
+# jupyter:
+#   jupytext:
+#     formats: ipynb,py:light
+#     text_representation:
+#       extension: .py
+#       format_name: light
+#       format_version: '1.4'
+#       jupytext_version: 1.2.4
+#   kernelspec:
+#     display_name: Python 3
+#     language: python
+#     name: python3
+# ---
+
+# ## Performance testing of parallel dispatch
+#
+# This test measures the dispatch overhead per sample of ``parallel::openmp`` with various grain sizes. ``grain_size=0`` means the adaptive chunking. The samples execute a negligible amount of work so that the measured time is dominated by the dispatch overhead.
+
+import lmenv
+env = lmenv.load('.lmenv')
+
+import os
+import pandas as pd
+import numpy as np
+# %matplotlib inline
+import matplotlib.pyplot as plt
+import lightmetrica as lm
+
+# %load_ext lightmetrica_jupyter
+
+lm.init()
+lm.log.init('jupyter')
+lm.progress.init('jupyter')
+lm.info()
+
+lm.comp.load_plugin(os.path.join(env.bin_path, 'functest_renderer_dispatch'))
+
+grain_sizes = [1, 4, 16, 64, 256, 1024, 0]
+works = [0, 10, 100]
+num_samples = 1920*1080*4
+
+dispatch_time_df = pd.DataFrame(columns=works, index=grain_sizes)
+for grain_size in grain_sizes:
+    lm.parallel.init('openmp', grain_size=grain_size)
+    for work in works:
+        renderer = lm.load_renderer('renderer', 'dispatch',
+            num_samples=num_samples,
+            work=work)
+        # Warm up threads
+        renderer.render()
+        result = renderer.render()
+        dispatch_time_df[work][grain_size] = result['ns_per_sample']
+
+# Dispatch time per sample [ns]
+dispatch_time_df
+
+ax = dispatch_time_df.astype(float).plot(logy=True, marker='o', figsize=(10,5))
+ax.set_xlabel('grain size (0: adaptive)')
+ax.set_ylabel('time per sample [ns]')
+plt.show()
@@ -0,0 +1,95 @@
+# ---
+# jupyter:
+#   jupytext:
+#     formats: ipynb,py:light
+#     text_representation:
+#       extension: .py
+#       format_name: light
+#       format_version: '1.4'
+#       jupytext_version: 1.2.4
+#   kernelspec:
+#     display_name: Python 3
+#     language: python
+#     name: python3
+# ---
+
+# ## Thread scaling of rendering
+#
+# This test renders a fixed workload with increasing number of threads configured by `parallel::init` with `num_threads`, and reports the speedup and the parallel efficiency against the single-threaded run. If the framework is built with the profiler, the time of the instrumented stages summed over the threads is reported per thread count. `parallel_wait` is the wait of the threads at the end of the parallel loops (load imbalance), `log_wait` is the wait for the lock of the logger, and `splat` includes the atomic updates of the film. A stage growing with the number of threads points to the contention limiting the scaling.
+
+import lmenv
+env = lmenv.load('.lmenv')
+
+import os
+import multiprocessing
+import pandas as pd
+import numpy as np
+# %matplotlib inline
+import matplotlib.pyplot as plt
+import lmscene
+import lightmetrica as lm
+
+# %load_ext lightmetrica_jupyter
+
+lm.init()
+lm.log.init('jupyter')
+lm.progress.init('jupyter')
+lm.info()
+
+lm.comp.load_plugin(os.path.join(env.bin_path, 'accel_embree'))
+
+# +
+max_threads = multiprocessing.cpu_count()
+thread_counts = sorted(set([2**i for i in range(max_threads.bit_length()) if 2**i <= max_threads] + [max_threads]))
+scene_name = 'fireplace_room'
+renderer_name = 'pt'
+spp = 4
+
+accel = lm.load_accel('accel', 'embree')
+scene = lm.load_scene('scene', 'default', accel=accel)
+lmscene.load(scene, env.scene_path, scene_name)
+scene.build()
+film = lm.load_film('film_output', 'bitmap', w=1280, h=720)
+# -
+
+records = []
+profiles = {}
+for num_threads in thread_counts:
+    lm.parallel.init('openmp', num_threads=num_threads)
+    renderer = lm.load_renderer('renderer', renderer_name,
+        scene=scene,
+        output=film,
+        max_verts=10,
+        scheduler='sample',
+        spp=spp)
+    # Warm up the threads and the thread-local storage
+    renderer.render()
+    lm.profiler.reset()
+    result = renderer.render()
+    records.append({'threads': num_threads, 'time': result['elapsed']})
+    profiles[num_threads] = {stage: v['time'] for stage, v in result.get('profile', {}).items()}
+
+# Speedup and efficiency against the single-threaded run
+df = pd.DataFrame(records).set_index('threads')
+df['speedup'] = df['time'][thread_counts[0]] / df['time']
+df['efficiency'] = df['speedup'] / (df.index / thread_counts[0])
+df
+
+ax = df['speedup'].plot(logx=True, logy=True, marker='o', figsize=(10,5), label='measured')
+ax.plot(df.index, df.index / thread_counts[0], linestyle='--', label='linear')
+ax.set_xlabel('threads')
+ax.set_ylabel('speedup')
+ax.legend()
+plt.show()
+
+# Time of the instrumented stages summed over the threads [s].
+# Empty if the profiler is disabled.
+profile_df = pd.DataFrame(profiles).T
+profile_df
+
+# Stage time per thread [s]
+if not profile_df.empty:
+    ax = profile_df.div(profile_df.index, axis=0).plot(logx=True, marker='o', figsize=(10,5))
+    ax.set_xlabel('threads')
+    ax.set_ylabel('time per thread [s]')
+    plt.show()
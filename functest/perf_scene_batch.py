@@ -0,0 +1,109 @@
+# ---
+# jupyter:
+#   jupytext:
+#     formats: ipynb,py:light
+#     text_representation:
+#       extension: .py
+#       format_name: light
+#       format_version: '1.4'
+#       jupytext_version: 1.2.4
+#   kernelspec:
+#     display_name: Python 3
+#     language: python
+#     name: python3
+# ---
+
+# ## Batched scene construction
+#
+# This test measures the construction of a scene scattering many copies of a few meshes from Python. We compare the construction calling `create_primitive_node`, `create_group_node`, and `add_child` for each object, with the batched `add_transformed_primitives` taking the numpy array of the transforms and the indices of the assets. We check that both scenes give the same image.
+
+import lmenv
+env = lmenv.load('.lmenv')
+
+import time
+import numpy as np
+import pandas as pd
+# %matplotlib inline
+import matplotlib.pyplot as plt
+import lightmetrica as lm
+
+# %load_ext lightmetrica_jupyter
+
+lm.init()
+lm.log.init('jupyter')
+lm.progress.init('jupyter')
+lm.info()
+
+# +
+num_objects = 200000
+num_assets = 4
+
+# Quad meshes and materials shared by the objects
+meshes = [lm.load_mesh('mesh{}'.format(i), 'raw',
+    ps=[-.5,-.5,0, .5,-.5,0, .5,.5,0, -.5,.5,0],
+    ns=[0,0,1],
+    ts=[0,0, 1,0, 1,1, 0,1],
+    fs={'p': [0,1,2,0,2,3], 'n': [0,0,0,0,0,0], 't': [0,1,2,0,2,3]}) for i in range(num_assets)]
+materials = [lm.load_material('material{}'.format(i), 'diffuse',
+    Kd=[.2+.2*i, .8-.2*i, .5]) for i in range(num_assets)]
+camera = lm.load_camera('camera', 'pinhole',
+    position=[0,0,400], center=[0,0,0], up=[0,1,0], vfov=60, aspect=16/9)
+
+# Random transforms scattered on a plane
+rng = np.random.RandomState(0)
+ps = rng.uniform(-300, 300, (num_objects, 3))
+ps[:,2] = rng.uniform(-10, 10, num_objects)
+transforms = np.tile(np.eye(4), (num_objects, 1, 1))
+transforms[:,:3,3] = ps
+asset_indices = rng.randint(0, num_assets, num_objects).astype(np.int32)
+props = [{'mesh': meshes[i].loc(), 'material': materials[i].loc()} for i in range(num_assets)]
+# -
+
+def make_scene(name):
+    accel = lm.load_accel('accel_' + name, 'sahbvh')
+    scene = lm.load_scene('scene_' + name, 'default', accel=accel)
+    scene.add_primitive(camera=camera)
+    return scene
+
+# ### Per-object construction
+
+scene_per_call = make_scene('per_call')
+start = time.time()
+for i in range(num_objects):
+    p = scene_per_call.create_primitive_node(props[asset_indices[i]])
+    t = scene_per_call.create_group_node(transforms[i])
+    scene_per_call.add_child(t, p)
+    scene_per_call.add_child(scene_per_call.root_node(), t)
+elapsed_per_call = time.time() - start
+
+# ### Batched construction
+
+scene_batch = make_scene('batch')
+start = time.time()
+scene_batch.add_transformed_primitives(transforms, props, asset_indices)
+elapsed_batch = time.time() - start
+
+df = pd.DataFrame([
+    {'mode': 'per_call', 'elapsed': elapsed_per_call, 'num_nodes': scene_per_call.num_nodes()},
+    {'mode': 'batch', 'elapsed': elapsed_batch, 'num_nodes': scene_batch.num_nodes()}
+])
+df['speedup'] = df['elapsed'][0] / df['elapsed']
+df
+
+# ### Rendered images
+
+def render(name, scene):
+    scene.build()
+    film = lm.load_film('film_' + name, 'bitmap', w=960, h=540)
+    renderer = lm.load_renderer('renderer_' + name, 'raycast', scene=scene, output=film)
+    renderer.render()
+    return np.copy(film.buffer())
+
+img_per_call = render('per_call', scene_per_call)
+img_batch = render('batch', scene_batch)
+print('Max difference: {}'.format(np.abs(img_per_call - img_batch).max()))
+
+f = plt.figure(figsize=(15,8))
+ax = f.add_subplot(111)
+ax.imshow(np.clip(np.power(img_batch,1/2.2),0,1), origin='lower')
+plt.show()
@@ -0,0 +1,117 @@
+# ---
+# jupyter:
+#   jupytext:
+#     formats: ipynb,py:light
+#     text_representation:
+#       extension: .py
+#       format_name: light
+#       format_version: '1.4'
+#       jupytext_version: 1.2.4
+#   kernelspec:
+#     display_name: Python 3
+#     language: python
+#     name: python3
+# ---
+
+# ## Pipelined rendering of animation sequences
+#
+# This test renders a camera animation of a scene rebuilt for each frame, emulating the per-frame update of the assets and the acceleration structure. We compare the sequential loop calling the update, the rendering, and the image write one after another, with `lm.sequence.FrameSequence` overlapping the update of the next frame and the write of the previous frame with the rendering of the current frame. The throughput is reported in frames per second for each size of the thread budget of the side thread.
+
+import lmenv
+env = lmenv.load('.lmenv')
+
+import os
+import time
+import tempfile
+import multiprocessing
+import pandas as pd
+import numpy as np
+import lightmetrica as lm
+
+# %load_ext lightmetrica_jupyter
+
+lm.init()
+lm.log.init('jupyter')
+lm.progress.init('jupyter')
+lm.info()
+
+# +
+num_frames = 16
+side_thread_counts = [1, 2, 4]
+max_threads = multiprocessing.cpu_count()
+out_dir = tempfile.mkdtemp()
+
+model = lm.load_model('model_obj', 'wavefrontobj', {
+    'path': os.path.join(env.scene_path, 'fireplace_room/fireplace_room.obj')
+})
+position = np.array([5.101118, 1.083746, -2.756308])
+center = np.array([4.167568, 1.078925, -2.397892])
+
+def camera_params(frame):
+    # Rotate the viewing direction around the up vector
+    theta = (frame / num_frames - 0.5) * np.pi / 3
+    d = center - position
+    c, s = np.cos(theta), np.sin(theta)
+    return {
+        'position': position.tolist(),
+        'center': (position + np.array([c*d[0] + s*d[2], d[1], -s*d[0] + c*d[2]])).tolist(),
+        'up': [0,1,0],
+        'vfov': 43.001194,
+        'aspect': 16/9
+    }
+
+def make_slot(i):
+    camera = lm.load_camera('camera{}'.format(i), 'pinhole', camera_params(0))
+    accel = lm.load_accel('accel{}'.format(i), 'sahbvh')
+    scene = lm.load_scene('scene{}'.format(i), 'default', accel=accel)
+    scene.add_primitive({'camera': camera.loc()})
+    scene.add_primitive({'model': model.loc()})
+    film = lm.load_film('film{}'.format(i), 'bitmap', w=960, h=540)
+    renderer = lm.load_renderer('renderer{}'.format(i), 'pt',
+        scene=scene.loc(), output=film.loc(), scheduler='sample', spp=4, max_verts=10)
+    return {'camera': camera, 'scene': scene, 'film': film, 'renderer': renderer}
+
+def update(slot, frame):
+    # Rebuild the scene as an animation of the geometry would do
+    slot['camera'].construct(camera_params(frame))
+    slot['scene'].build()
+
+def render(slot, frame):
+    return slot['renderer'].render()
+
+def save(slot, frame):
+    slot['film'].save(os.path.join(out_dir, '{:04}.png'.format(frame)))
+
+slots = [make_slot(0), make_slot(1)]
+# -
+
+# ### Sequential rendering
+
+start = time.time()
+for frame in range(num_frames):
+    update(slots[0], frame)
+    render(slots[0], frame)
+    save(slots[0], frame)
+elapsed = time.time() - start
+records = [{'mode': 'sequential', 'side_threads': 0, 'elapsed': elapsed, 'fps': num_frames / elapsed, 'wait': 0}]
+
+# ### Pipelined rendering
+
+for side_threads in side_thread_counts:
+    if side_threads >= max_threads:
+        continue
+    seq = lm.sequence.FrameSequence(slots, update, render, save, side_threads=side_threads)
+    start = time.time()
+    stats = seq.run(num_frames)
+    elapsed = time.time() - start
+    records.append({
+        'mode': 'pipelined',
+        'side_threads': side_threads,
+        'elapsed': elapsed,
+        'fps': num_frames / elapsed,
+        'wait': sum(s['wait'] for s in stats)
+    })
+
+df = pd.DataFrame(records)
+df['speedup'] = df['fps'] / df['fps'][0]
+df
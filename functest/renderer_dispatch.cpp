@@ -0,0 +1,50 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <lm/lm.h>
+#include <lm/timer.h>
+#include <numeric>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+// Renderer to measure the dispatch overhead of parallel::foreach.
+// Each sample executes a small amount of work so that the measured time
+// is dominated by the dispatch cost of the parallel context.
+class Renderer_Dispatch final : public Renderer {
+private:
+    long long num_samples_;
+    int work_;
+
+public:
+    virtual void construct(const Json& prop) override {
+        num_samples_ = json::value<long long>(prop, "num_samples");
+        work_ = json::value<int>(prop, "work", 0);
+    }
+
+    virtual Json render() const override {
+        // Per-thread accumulator padded to avoid false sharing
+        struct alignas(64) Acc { unsigned long long v = 0; };
+        std::vector<Acc> acc(parallel::num_threads());
+        timer::ScopedTimer st;
+        parallel::foreach(num_samples_, [&](long long index, int threadid) {
+            auto v = (unsigned long long)(index);
+            for (int i = 0; i < work_; i++) {
+                v = v * 6364136223846793005ULL + 1442695040888963407ULL;
+            }
+            acc[threadid].v += v;
+        });
+        const auto elapsed = st.now();
+        const auto sum = std::accumulate(acc.begin(), acc.end(), 0ULL, [](auto s, const Acc& a) { return s + a.v; });
+        return {
+            {"elapsed", elapsed},
+            {"ns_per_sample", elapsed * 1e9 / num_samples_},
+            {"checksum", sum}
+        };
+    }
+};
+
+LM_COMP_REG_IMPL(Renderer_Dispatch, "renderer::dispatch");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -41,9 +41,18 @@ def run_functests(output_dir, lmenv_path):
         'func_materials',
         'func_lights',
         'func_renderers',
+        'func_distributed',
+        'func_server',
+        'func_preview',
+        'func_sampler',
         'perf_accel',
         'perf_obj_loader',
-        'perf_serial'
+        'perf_serial',
+        'perf_parallel',
+        'perf_convergence',
+        'perf_scaling',
+        'perf_sequence',
+        'perf_scene_batch'
     ]
 
     # Execute tests
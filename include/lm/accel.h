@@ -37,6 +37,70 @@ public:
     */
     virtual void build(const Scene& scene) = 0;
 
+    /*!
+        \brief Update acceleration structure.
+        \param scene Input scene.
+
+        \rst
+        Updates the acceleration structure after the transformations of the scene are modified.
+        Unlike :cpp:func:`lm::Accel::build`, implementations can reuse the topology of
+        the previously built structure, e.g., by refitting the bounds.
+        The structure of the scene graph and the meshes must not be changed since the last build.
+        The default implementation rebuilds the structure.
+        \endrst
+    */
+    virtual void update(const Scene& scene) {
+        build(scene);
+    }
+
+    /*!
+        \brief Save the built acceleration structure to a cache file.
+        \param path Path to the cache file.
+        \return False if the implementation does not support caching or the saving failed.
+
+        \rst
+        Implementations can provide a file format that can be loaded
+        without rebuilding the structure. See :cpp:func:`lm::Accel::load_cache`.
+        The default implementation does nothing and returns false.
+        \endrst
+    */
+    virtual bool save_cache(const std::string& path) const {
+        LM_UNUSED(path);
+        return false;
+    }
+
+    /*!
+        \brief Load the acceleration structure from a cache file.
+        \param path Path to the cache file.
+        \return False if the implementation does not support caching or the cache is not compatible.
+
+        \rst
+        Loads the structure saved by :cpp:func:`lm::Accel::save_cache`.
+        If the function returns false, the caller must build the structure with :cpp:func:`lm::Accel::build`.
+        The default implementation does nothing and returns false.
+        \endrst
+    */
+    virtual bool load_cache(const std::string& path) {
+        LM_UNUSED(path);
+        return false;
+    }
+
+    /*!
+        \brief Get the build settings identifying the cache.
+        \return String representation of the settings.
+
+        \rst
+        The scene includes the returned string in the key of the cache file,
+        so that the structures built with different settings, e.g., builders,
+        do not share the cache. Implementations supporting the cache should return
+        all settings affecting the built structure.
+        The default implementation returns an empty string.
+        \endrst
+    */
+    virtual std::string cache_settings() const {
+        return {};
+    }
+
     /*!
         \brief Hit result.
 
@@ -44,16 +108,33 @@ public:
         Shows information associated to the hit point of the ray.
         More additional information like surface positions can be obtained
         from querying appropriate data types from these information.
+        The global transformation of the intersected primitive is not stored in the record.
+        It is obtained from the instance index with :cpp:func:`lm::Accel::instance_transform`
+        only when it is needed, e.g., to compute the surface geometry for shading.
         \endrst
     */
     struct Hit {
         Float t;                    //!< Distance to the hit point.
         Vec2 uv;                    //!< Barycentric coordinates.
-        Transform global_transform;	//!< Global transformation.
+        int instance;               //!< Index of the instance of the primitive.
         int primitive;              //!< Primitive node index.
         int face;                   //!< Face index.
     };
 
+    /*!
+        \brief Get global transformation of an instance.
+        \param instance Index of the instance given by :cpp:member:`lm::Accel::Hit::instance`.
+        \return Global transformation of the instance.
+
+        \rst
+        An instance is an occurrence of a primitive in the scene graph
+        with the global transformation accumulated from the root of the scene graph.
+        The indices of the instances are specific to the acceleration structure
+        and are valid until the structure is rebuilt or updated.
+        \endrst
+    */
+    virtual Transform instance_transform(int instance) const = 0;
+
     /*!
         \brief Compute closest intersection point.
         \param ray Ray.
@@ -68,8 +149,252 @@ public:
         \endrst
     */
     virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const = 0;
+
+    /*!
+        \brief Check if the ray segment is occluded.
+        \param ray Ray.
+        \param tmin Lower valid range of the ray.
+        \param tmax Higher valid range of the ray.
+        \return True if any intersection is found in ``[tmin, tmax]``.
+
+        \rst
+        Unlike :cpp:func:`lm::Accel::intersect`, the function does not need to find
+        the closest intersection point, so implementations can terminate
+        the traversal on the first intersection found.
+        The default implementation calls :cpp:func:`lm::Accel::intersect`.
+        \endrst
+    */
+    virtual bool occluded(Ray ray, Float tmin, Float tmax) const {
+        return intersect(ray, tmin, tmax).has_value();
+    }
+
+    /*!
+        \brief Compute closest intersection points for multiple rays.
+        \param n Number of rays.
+        \param rays Array of rays of size ``n``.
+        \param tmin Lower valid range of the rays.
+        \param tmax Higher valid range of the rays.
+        \param hits Output array of hit results of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Accel::intersect`.
+        The ``i``-th element of ``hits`` is set to the result for ``rays[i]``.
+        Implementations can override the function to utilize packet or stream traversal.
+        The default implementation calls :cpp:func:`lm::Accel::intersect` for each ray.
+        \endrst
+    */
+    virtual void intersect_n(int n, const Ray* rays, Float tmin, Float tmax, std::optional<Hit>* hits) const {
+        for (int i = 0; i < n; i++) {
+            hits[i] = intersect(rays[i], tmin, tmax);
+        }
+    }
+
+    /*!
+        \brief Check if multiple ray segments are occluded.
+        \param n Number of rays.
+        \param rays Array of rays of size ``n``.
+        \param tmin Lower valid range of the rays.
+        \param tmax Array of higher valid ranges of the rays of size ``n``.
+        \param occluded Output array of occlusion results of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Accel::occluded`.
+        Unlike :cpp:func:`lm::Accel::intersect_n`, the upper bounds are given per ray
+        because the lengths of the shadow rays are usually different.
+        The default implementation calls :cpp:func:`lm::Accel::occluded` for each ray.
+        \endrst
+    */
+    virtual void occluded_n(int n, const Ray* rays, Float tmin, const Float* tmax, bool* occluded) const {
+        for (int i = 0; i < n; i++) {
+            occluded[i] = this->occluded(rays[i], tmin, tmax[i]);
+        }
+    }
+
+    /*!
+        \brief Function to test an intersection against the alpha mask.
+        \param primitive Primitive node index.
+        \param face Face index.
+        \param uv Barycentric coordinates.
+        \return True if the intersection is accepted.
+    */
+    using AlphaTestFunc = std::function<bool(int primitive, int face, Vec2 uv)>;
+
+    /*!
+        \brief Set alpha test resolved during traversal.
+        \param masked Flags of the primitive node indices with alpha masks.
+        \param alpha_test Alpha test function.
+        \return False if the implementation does not support alpha test.
+
+        \rst
+        After the function is called, the queries ignore the intersections with the primitives
+        flagged in ``masked`` for which ``alpha_test`` returns false,
+        and continue the traversal as if the triangles were not hit.
+        ``alpha_test`` is only called for the flagged primitives.
+        An empty ``masked`` disables the alpha test.
+        The scene calls the function after the structure is built, updated, or loaded.
+        If the function returns false, :cpp:class:`lm::Scene` resolves the alpha test
+        by repeating the queries from the rejected intersections.
+        The default implementation does nothing and returns false.
+        \endrst
+    */
+    virtual bool set_alpha_test(const std::vector<bool>& masked, const AlphaTestFunc& alpha_test) {
+        LM_UNUSED(masked, alpha_test);
+        return false;
+    }
+
+    /*!
+        \brief Traversal counts of queries.
+    */
+    struct TraversalCounts {
+        long long nodes = 0;        //!< Number of visited nodes.
+        long long triangles = 0;    //!< Number of tested triangles.
+    };
+
+    /*!
+        \brief Count the traversal steps of the closest intersection query.
+        \param ray Ray.
+        \param tmin Lower valid range of the ray.
+        \param tmax Higher valid range of the ray.
+        \param counts Counts accumulated by the query.
+        \return False if the implementation does not support counting.
+
+        \rst
+        Performs the same traversal as :cpp:func:`lm::Accel::intersect` and adds
+        the numbers of the visited nodes and the tested triangles to ``counts``.
+        The function is meant for the analysis of the structure
+        and can be slower than the regular query. See :cpp:func:`lm::accel::analyze`.
+        The default implementation returns false.
+        \endrst
+    */
+    virtual bool count_traversal(Ray ray, Float tmin, Float tmax, TraversalCounts& counts) const {
+        LM_UNUSED(ray, tmin, tmax, counts);
+        return false;
+    }
 };
 
+LM_NAMESPACE_BEGIN(accel)
+
+/*!
+    \brief Statistics of a bounding volume hierarchy.
+
+    \rst
+    Helper to collect the statistics of the structure of a bounding volume hierarchy.
+    Implementations visit the nodes of the built structure and report the result
+    with :cpp:func:`lm::Component::underlying_value` for ``structure`` query.
+    SAH cost is computed with unit costs for the traversal step and the triangle test.
+    \endrst
+*/
+class BVHStats {
+public:
+    //! Number of bins of the histogram of the leaf sizes.
+    static constexpr int HistogramBins = 17;
+
+private:
+    Float root_sa_;
+    Float sah_ = 0_f;
+    long long interior_ = 0;
+    long long leaves_ = 0;
+    long long triangles_ = 0;
+    long long leaf_depth_ = 0;
+    int max_depth_ = 0;
+    std::vector<long long> histogram_ = std::vector<long long>(HistogramBins, 0);
+
+public:
+    /*!
+        \brief Construct the statistics.
+        \param root Bound of the root node.
+    */
+    BVHStats(const Bound& root) : root_sa_(root.surface_area()) {}
+
+    /*!
+        \brief Add an interior node.
+        \param b Bound of the node.
+        \param depth Depth of the node. 0 for the root.
+    */
+    void add_interior(const Bound& b, int depth) {
+        interior_++;
+        max_depth_ = std::max(max_depth_, depth);
+        sah_ += relative_area(b);
+    }
+
+    /*!
+        \brief Add a leaf node.
+        \param b Bound of the node.
+        \param depth Depth of the node. 0 for the root.
+        \param triangles Number of triangles referenced from the leaf.
+    */
+    void add_leaf(const Bound& b, int depth, int triangles) {
+        leaves_++;
+        triangles_ += triangles;
+        leaf_depth_ += depth;
+        max_depth_ = std::max(max_depth_, depth);
+        histogram_[std::min(triangles, HistogramBins - 1)]++;
+        sah_ += relative_area(b) * Float(triangles);
+    }
+
+    /*!
+        \brief Convert the statistics to JSON.
+        \param memory Memory footprint of the structure in bytes.
+
+        \rst
+        ``leaf_histogram`` is an array whose ``i``-th element is the number of the leaves
+        with ``i`` triangles. The last element counts the leaves with
+        :cpp:var:`HistogramBins` - 1 or more triangles.
+        \endrst
+    */
+    Json to_json(size_t memory) const {
+        return {
+            {"sah_cost", sah_},
+            {"nodes", interior_ + leaves_},
+            {"interior_nodes", interior_},
+            {"leaves", leaves_},
+            {"max_depth", max_depth_},
+            {"avg_leaf_depth", leaves_ > 0 ? double(leaf_depth_) / double(leaves_) : 0.0},
+            {"avg_leaf_size", leaves_ > 0 ? double(triangles_) / double(leaves_) : 0.0},
+            {"leaf_histogram", histogram_},
+            {"memory", memory}
+        };
+    }
+
+private:
+    Float relative_area(const Bound& b) const {
+        return root_sa_ > 0_f ? b.surface_area() / root_sa_ : 0_f;
+    }
+};
+
+/*!
+    \brief Analyze the acceleration structure of a scene.
+    \param scene Scene with the built acceleration structure.
+    \param prop Properties for configuration.
+    \return Report of the analysis.
+
+    \rst
+    This function reports the statistics of the acceleration structure of the scene
+    to compare the implementations on the same scene.
+    The report contains the following entries.
+
+    - ``accel``: Name of the implementation.
+    - ``structure``: Statistics of the structure returned by
+      :cpp:func:`lm::Component::underlying_value` of the acceleration structure
+      with ``structure`` query, e.g., SAH cost, node and leaf counts,
+      histogram of the leaf sizes, depth, and memory footprint (see :cpp:class:`BVHStats`).
+      The entries depend on the implementation.
+    - ``primary`` and ``secondary``: Statistics of the primary rays generated
+      by the camera at random raster positions and of the secondary rays
+      sampled from the hit points of the primary rays with cosine-weighted directions.
+      Each contains the number of rays, the number of hits,
+      the measured average time per ray in seconds,
+      and the average numbers of visited nodes and tested triangles per ray
+      (null if :cpp:func:`lm::Accel::count_traversal` is not supported).
+
+    ``rays`` property specifies the number of primary rays (default: 16384)
+    and ``seed`` property specifies the seed of the random number generator (default: 42).
+    \endrst
+*/
+LM_PUBLIC_API Json analyze(const Scene& scene, const Json& prop = {});
+
+LM_NAMESPACE_END(accel)
+
 /*!
     @}
 */
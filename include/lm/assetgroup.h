@@ -54,6 +54,57 @@ public:
         \param path Path to the serialized asset.
     */
     virtual Component* load_serialized(const std::string& name, const std::string& path) = 0;
+
+    /*!
+        \brief Loads multiple assets.
+        \param assets Array of assets. Each element contains ``name``, ``impl_key``, and ``prop``
+                      corresponding to the arguments of :cpp:func:`lm::AssetGroup::load_asset`.
+        \return Pointers to the created assets in the given order. nullptr if failed.
+
+        \rst
+        The implementation can construct the independent assets in parallel.
+        The dependencies between the assets are given by the component locators
+        referring to the other assets in the same array,
+        in which case the referenced asset is constructed first.
+        The default implementation loads the assets one after another
+        with :cpp:func:`lm::AssetGroup::load_asset`.
+        \endrst
+    */
+    virtual std::vector<Component*> load_assets(const Json& assets) {
+        std::vector<Component*> ps;
+        for (const auto& a : assets) {
+            ps.push_back(load_asset(
+                a.at("name").get<std::string>(),
+                a.at("impl_key").get<std::string>(),
+                a.value("prop", Json::object())));
+        }
+        return ps;
+    }
+
+    /*!
+        \brief Get revision of the asset group.
+        \return Number of the replacements of the assets.
+
+        \rst
+        The revision is incremented each time :cpp:func:`lm::AssetGroup::load_asset`
+        replaces an asset already loaded.
+        Combined with :cpp:func:`lm::AssetGroup::replaced_since`, the components referring to the assets,
+        e.g., :cpp:class:`lm::Scene`, can track the edits of the assets.
+        \endrst
+    */
+    virtual int revision() const {
+        return 0;
+    }
+
+    /*!
+        \brief Get locators of the assets replaced after the revision.
+        \param revision Revision obtained by :cpp:func:`lm::AssetGroup::revision`.
+        \return Locators of the replaced assets in the order of the replacement.
+    */
+    virtual std::vector<std::string> replaced_since(int revision) const {
+        LM_UNUSED(revision);
+        return {};
+    }
 };
 
 /*!
@@ -162,7 +162,7 @@ struct Path {
     Vec2 raster_position(const Scene* scene) const {
         const auto* vE      = vertex_at(0, TransDir::EL);
         const auto* vE_next = vertex_at(1, TransDir::EL);
-        return *path::raster_position(scene, direction(vE, vE_next));
+        return *path::raster_position(scene, vE->sp.geom, direction(vE, vE_next));
     }
 
     /*!
@@ -379,6 +379,106 @@ struct Path {
         return f_prod_L * cst * f_prod_E;
     }
 
+    /*!
+        \brief Evaluate subpath PDF.
+        \param scene Scene.
+        \param l Number of vertices.
+        \param trans_dir Transport direction.
+
+        \rst
+        This function evaluates the product of the local PDFs of the first ``l`` vertices
+        counted from the endpoint according to the transport direction,
+        i.e., :math:`p_L(\bar{y})` when ``trans_dir`` is LE and
+        :math:`p_E(\bar{z})` when ``trans_dir`` is EL.
+        This function is only valid when the path is a fullpath.
+        \endrst
+    */
+    Float pdf_subpath(const Scene* scene, int l, TransDir trans_dir) const {
+        if (l == 0) {
+            return 1_f;
+        }
+
+        int i = 0;
+        Float p = 0_f;
+        const auto* v0 = vertex_at(0, trans_dir);
+        if (path::is_connectable_endpoint(scene, v0->sp)) {
+            const auto pA = path::pdf_position(scene, v0->sp);
+            const auto p_comp = path::pdf_component(scene, v0->sp, {}, v0->comp);
+            p = pA * p_comp;
+        }
+        else {
+            const auto* v1 = vertex_at(1, trans_dir);
+            const auto d01 = direction(v0, v1);
+            const auto p_ray = path::pdf_primary_ray(scene, v0->sp, d01, false);
+            const auto p_comp_v0 = path::pdf_component(scene, v0->sp, {}, v0->comp);
+            const auto p_comp_v1 = path::pdf_component(scene, v1->sp, -d01, v1->comp);
+            p = surface::convert_pdf_to_area(p_ray, v0->sp.geom, v1->sp.geom) * p_comp_v0 * p_comp_v1;
+            i++;
+        }
+
+        for (; i < l - 1; i++) {
+            const auto* v      = vertex_at(i,   trans_dir);
+            const auto* v_prev = vertex_at(i-1, trans_dir);
+            const auto* v_next = vertex_at(i+1, trans_dir);
+            const auto wi = direction(v, v_prev);
+            const auto wo = direction(v, v_next);
+            const auto p_comp = path::pdf_component(scene, v_next->sp, -wo, v_next->comp);
+            const auto p_projSA = path::pdf_direction(scene, v->sp, wi, wo, v->comp, false);
+            p *= (p_comp * surface::convert_pdf_to_area(p_projSA, v->sp.geom, v_next->sp.geom));
+        }
+        return p;
+    }
+
+    /*!
+        \brief Evaluate local PDFs of the vertices.
+        \param scene Scene.
+        \param trans_dir Transport direction.
+        \param pdfs Output array of size ``num_verts()``.
+
+        \rst
+        This function evaluates the local PDFs of all vertices counted from the endpoint
+        according to the transport direction, where ``pdfs[i]`` is the PDF of the ``i``-th vertex
+        given the preceding vertices including the probability to select the component.
+        The product of first ``l`` elements equals to :cpp:func:`lm::Path::pdf_subpath`
+        except for ``l = 1`` with a non-connectable endpoint,
+        because the PDF of the primary ray from the endpoint is assigned to the second vertex.
+        Such a subpath is not samplable (see :cpp:func:`lm::Path::is_samplable_bidir`).
+        This function is only valid when the path is a fullpath.
+        \endrst
+    */
+    void eval_local_pdfs(const Scene* scene, TransDir trans_dir, Float* pdfs) const {
+        const int n = num_verts();
+        int i = 0;
+        const auto* v0 = vertex_at(0, trans_dir);
+        if (path::is_connectable_endpoint(scene, v0->sp)) {
+            const auto pA = path::pdf_position(scene, v0->sp);
+            const auto p_comp = path::pdf_component(scene, v0->sp, {}, v0->comp);
+            pdfs[0] = pA * p_comp;
+        }
+        else {
+            pdfs[0] = path::pdf_component(scene, v0->sp, {}, v0->comp);
+            if (n > 1) {
+                const auto* v1 = vertex_at(1, trans_dir);
+                const auto d01 = direction(v0, v1);
+                const auto p_ray = path::pdf_primary_ray(scene, v0->sp, d01, false);
+                const auto p_comp_v1 = path::pdf_component(scene, v1->sp, -d01, v1->comp);
+                pdfs[1] = surface::convert_pdf_to_area(p_ray, v0->sp.geom, v1->sp.geom) * p_comp_v1;
+            }
+            i++;
+        }
+
+        for (; i < n - 1; i++) {
+            const auto* v      = vertex_at(i,   trans_dir);
+            const auto* v_prev = vertex_at(i-1, trans_dir);
+            const auto* v_next = vertex_at(i+1, trans_dir);
+            const auto wi = direction(v, v_prev);
+            const auto wo = direction(v, v_next);
+            const auto p_comp = path::pdf_component(scene, v_next->sp, -wo, v_next->comp);
+            const auto p_projSA = path::pdf_direction(scene, v->sp, wi, wo, v->comp, false);
+            pdfs[i+1] = p_comp * surface::convert_pdf_to_area(p_projSA, v->sp.geom, v_next->sp.geom);
+        }
+    }
+
     /*!
         \brief Evaluate bidirectional path PDF.
         \param scene Scene.
@@ -398,46 +498,9 @@ struct Path {
             return 0_f;
         }
         
-        // Compute a product of local PDFs
-        const auto pdf_subpath = [&](int l, TransDir trans_dir) -> Float {
-            if (l == 0) {
-                return 1_f;
-            }
-
-            int i = 0;
-            Float p = 0_f;
-            const auto* v0 = vertex_at(0, trans_dir);
-            if (path::is_connectable_endpoint(scene, v0->sp)) {
-                const auto pA = path::pdf_position(scene, v0->sp);
-                const auto p_comp = path::pdf_component(scene, v0->sp, {}, v0->comp);
-                p = pA * p_comp;
-            }
-            else {
-                const auto* v1 = vertex_at(1, trans_dir);
-                const auto d01 = direction(v0, v1);
-                const auto p_ray = path::pdf_primary_ray(scene, v0->sp, d01, false);
-                const auto p_comp_v0 = path::pdf_component(scene, v0->sp, {}, v0->comp);
-                const auto p_comp_v1 = path::pdf_component(scene, v1->sp, -d01, v1->comp);
-                p = surface::convert_pdf_to_area(p_ray, v0->sp.geom, v1->sp.geom) * p_comp_v0 * p_comp_v1;
-                i++;
-            }
-
-            for (; i < l - 1; i++) {
-                const auto* v      = vertex_at(i,   trans_dir);
-                const auto* v_prev = vertex_at(i-1, trans_dir);
-                const auto* v_next = vertex_at(i+1, trans_dir);
-                const auto wi = direction(v, v_prev);
-                const auto wo = direction(v, v_next);
-                const auto p_comp = path::pdf_component(scene, v_next->sp, -wo, v_next->comp);
-                const auto p_projSA = path::pdf_direction(scene, v->sp, wi, wo, v->comp, false);
-                p *= (p_comp * surface::convert_pdf_to_area(p_projSA, v->sp.geom, v_next->sp.geom));
-            }
-            return p;
-        };
-
         // Compute product of local PDFs for each subpath
-        const auto pL = pdf_subpath(s, TransDir::LE);
-        const auto pE = pdf_subpath(t, TransDir::EL);
+        const auto pL = pdf_subpath(scene, s, TransDir::LE);
+        const auto pE = pdf_subpath(scene, t, TransDir::EL);
 
         return pL * pE;
     }
@@ -450,18 +513,40 @@ struct Path {
         \rst
         This function evaluates the MIS weight via power heuristic.
         For detail, please refer to :ref:`path_sampling_mis_weight`.
+        The local PDFs of the vertices from both endpoints are evaluated once
+        with :cpp:func:`lm::Path::eval_local_pdfs` and the bidirectional path PDFs
+        of all strategies are computed from the prefix products of them.
+        Thus the cost is linear in the number of vertices,
+        instead of evaluating :cpp:func:`lm::Path::pdf_bidir` for each strategy.
         \endrst
     */
     Float eval_mis_weight(const Scene* scene, int s) const {
         const int n = num_verts();
-        const int t = n - s;
 
-        const auto ps = pdf_bidir(scene, s);
+        // Products of the local PDFs of the first k vertices from each endpoint
+        thread_local std::vector<Float> pdfs, pL, pE;
+        pdfs.resize(n);
+        pL.resize(n + 1);
+        pE.resize(n + 1);
+        const auto prefix_products = [&](TransDir trans_dir, std::vector<Float>& prod) {
+            eval_local_pdfs(scene, trans_dir, pdfs.data());
+            prod[0] = 1_f;
+            for (int i = 0; i < n; i++) {
+                prod[i+1] = prod[i] * pdfs[i];
+            }
+        };
+        prefix_products(TransDir::LE, pL);
+        prefix_products(TransDir::EL, pE);
+        const auto pdf = [&](int s2) -> Float {
+            return is_samplable_bidir(scene, s2) ? pL[s2] * pE[n-s2] : 0_f;
+        };
+
+        const auto ps = pdf(s);
         assert(ps > 0_f);
 
         Float inv_w = 0_f;
         for (int s2 = 0; s2 <= n; s2++) {
-            const auto pi = pdf_bidir(scene, s2);
+            const auto pi = pdf(s2);
             if (pi == 0_f) {
                 continue;
             }
@@ -570,38 +655,59 @@ static Path sample_subpath(Rng& rng, const Scene* scene, int max_verts, TransDir
 }
 
 /*!
-    \brief Connect two subapths and generate a full path.
+    \brief Sample a subpath into the given storage.
+    \param rng Random number generator.
+    \param path Subpath to be overwritten.
+    \param scene Scene.
+    \param max_verts Maximum number of vertices.
+    \param trans_dir Transport direction.
+
+    \rst
+    This function is the same as :cpp:func:`lm::path::sample_subpath`
+    except that the subpath is written to ``path``.
+    Since the storage of the vertices is reused,
+    renderers can avoid the allocation per sample by keeping ``path``
+    for each thread, e.g., with ``thread_local``.
+    \endrst
+*/
+static void sample_subpath(Rng& rng, Path& path, const Scene* scene, int max_verts, TransDir trans_dir) {
+    path.vs.clear();
+    sample_subpath_from_endpoint(rng, path, scene, max_verts, trans_dir);
+}
+
+/*!
+    \brief Connect two subapths into the given storage.
     \param scene Scene.
     \param subpathL Light subpath.
     \param subpathE Eye subpath.
     \param s Number of light subpath vertices to be used.
     \param t Number of eye subpath vertices to be used.
-    \return Connected fullpath. nullopt if failed.
+    \param path Fullpath to be overwritten.
+    \return False if the connection fails.
 
     \rst
-    This function takes light and subapth and connect them to compose a fullpath by the specified
-    number of vertices from the endpoints of each subpath.
-    The function returns nullopt if the connection fails.
-    For detail, please refer to :ref:`path_sampling_connecting_subpaths`.
+    This function is the same as :cpp:func:`lm::path::connect_subpaths`
+    except that the fullpath is written to ``path`` reusing its storage.
+    The content of ``path`` is unspecified if the connection fails.
     \endrst
 */
-static std::optional<Path> connect_subpaths(const Scene* scene, const Path& subpathL, const Path& subpathE, int s, int t) {
+static bool connect_subpaths(const Scene* scene, const Path& subpathL, const Path& subpathE, int s, int t, Path& path) {
     assert(s >= 0 && t >= 0);
     assert(!(s == 0 && t == 0));
 
     // Connect two subpaths
-    // Returns nullopt if the subpaths are not connectable.
-    Path path;
+    // Returns false if the subpaths are not connectable.
+    path.vs.clear();
     if (s == 0) {
         if (subpathE.subpath_vertex_at(t-1)->sp.geom.degenerated) {
-            return {};
+            return false;
         }
         // Reverse and copy subpathE 
         path.vs.insert(path.vs.end(), subpathE.vs.rend() - t, subpathE.vs.rend());
     }
     else if (t == 0) {
         if (subpathL.subpath_vertex_at(s-1)->sp.geom.degenerated) {
-            return {};
+            return false;
         }
         // Copy subpathL as it is
         path.vs.insert(path.vs.end(), subpathL.vs.begin(), subpathL.vs.begin() + s);
@@ -610,10 +716,10 @@ static std::optional<Path> connect_subpaths(const Scene* scene, const Path& subp
         const auto& vL = subpathL.vs[s - 1];
         const auto& vE = subpathE.vs[t - 1];
         if (vL.sp.geom.infinite || vE.sp.geom.infinite) {
-            return {};
+            return false;
         }
         if (!scene->visible(vL.sp, vE.sp)) {
-            return {};
+            return false;
         }
         path.vs.insert(path.vs.end(), subpathL.vs.begin(), subpathL.vs.begin() + s);
         path.vs.insert(path.vs.end(), subpathE.vs.rend() - t, subpathE.vs.rend());
@@ -624,17 +730,41 @@ static std::optional<Path> connect_subpaths(const Scene* scene, const Path& subp
     // That is scene.is_camera(vE) is always true.
     auto& vL = path.vs.front();
     if (!scene->is_light(vL.sp)) {
-        return {};
+        return false;
     }
     auto& vE = path.vs.back();
     if (!scene->is_camera(vE.sp)) {
-        return {};
+        return false;
     }
 
     // Update the endpoint types
     vL.sp = vL.sp.as_type(SceneInteraction::LightEndpoint);
     vE.sp = vE.sp.as_type(SceneInteraction::CameraEndpoint);
 
+    return true;
+}
+
+/*!
+    \brief Connect two subapths and generate a full path.
+    \param scene Scene.
+    \param subpathL Light subpath.
+    \param subpathE Eye subpath.
+    \param s Number of light subpath vertices to be used.
+    \param t Number of eye subpath vertices to be used.
+    \return Connected fullpath. nullopt if failed.
+
+    \rst
+    This function takes light and subapth and connect them to compose a fullpath by the specified
+    number of vertices from the endpoints of each subpath.
+    The function returns nullopt if the connection fails.
+    For detail, please refer to :ref:`path_sampling_connecting_subpaths`.
+    \endrst
+*/
+static std::optional<Path> connect_subpaths(const Scene* scene, const Path& subpathL, const Path& subpathE, int s, int t) {
+    Path path;
+    if (!connect_subpaths(scene, subpathL, subpathE, s, t, path)) {
+        return {};
+    }
     return path;
 }
 
@@ -68,6 +68,56 @@ public:
     */
     virtual Ray primary_ray(Vec2 rp) const = 0;
 
+    /*!
+        \brief Compute the ray cone of a primary ray.
+        \param rp Raster position.
+        \param pixel_size Size of a pixel in raster coordinates.
+        \return Ray cone of the primary ray generated by :cpp:func:`primary_ray`.
+
+        \rst
+        This function computes the footprint of the primary ray passing through a pixel,
+        which is used to select the resolution of the texture lookups.
+        The default implementation computes the cone by finite differences
+        of the primary rays of the adjacent pixels.
+        \endrst
+    */
+    virtual RayCone primary_ray_cone(Vec2 rp, Vec2 pixel_size) const {
+        const auto r = primary_ray(rp);
+        const auto rx = primary_ray(rp + Vec2(pixel_size.x, 0_f));
+        const auto ry = primary_ray(rp + Vec2(0_f, pixel_size.y));
+        const auto angle = [&](Vec3 d) -> Float {
+            return std::acos(glm::clamp(glm::dot(r.d, d), -1_f, 1_f));
+        };
+        return {
+            std::max(glm::length(rx.o - r.o), glm::length(ry.o - r.o)),
+            std::max(angle(rx.d), angle(ry.d))
+        };
+    }
+
+    /*!
+        \brief Generate primary rays for a batch of raster positions.
+        \param n Number of rays.
+        \param rps Raster positions.
+        \param ups Random numbers for the positions on the aperture.
+                   nullptr to generate the rays from the center of the aperture.
+        \param rays Generated rays.
+
+        \rst
+        This function generates the rays for many raster positions at once,
+        e.g., for a tile or a batch of paths of the wavefront renderer,
+        so that the virtual call and the setup of the camera basis are amortized over the batch.
+        If ``ups`` is given, cameras with a finite aperture sample the origins of the rays
+        in the same way as :cpp:func:`sample_ray`.
+        The default implementation calls :cpp:func:`primary_ray` for each raster position.
+        \endrst
+    */
+    virtual void primary_rays(int n, const Vec2* rps, const Vec2* ups, Ray* rays) const {
+        LM_UNUSED(ups);
+        for (int i = 0; i < n; i++) {
+            rays[i] = primary_ray(rps[i]);
+        }
+    }
+
     //! Result of primary ray sampling.
     struct RaySample {
         PointGeometry geom;     //!< Sampled point geometry.
@@ -77,7 +127,8 @@ public:
 
     //! Random number input for primary ray sampling.
     struct RaySampleU {
-        Vec2 ud;
+        Vec2 ud;    //!< For raster position.
+        Vec2 up;    //!< For position on the aperture.
     };
 
     /*!
@@ -207,6 +258,23 @@ public:
     */
     virtual std::optional<Vec2> raster_position(Vec3 wo) const = 0;
 
+    /*!
+        \brief Compute a raster position of a ray from a point on the sensor.
+        \param geom Point geometry on the sensor.
+        \param wo Primary ray direction.
+        \return Raster position.
+
+        \rst
+        Unlike :cpp:func:`raster_position`, this function takes the origin of the ray into account,
+        which is necessary for the cameras with a finite aperture.
+        The default implementation ignores the origin.
+        \endrst
+    */
+    virtual std::optional<Vec2> raster_position_from(const PointGeometry& geom, Vec3 wo) const {
+        LM_UNUSED(geom);
+        return raster_position(wo);
+    }
+
     /*!
         \brief Check if the sensor is connectable.
 
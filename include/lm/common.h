@@ -33,6 +33,13 @@
     #define LM_CONFIG_RELWITHDEBINFO 0
 #endif
 
+// Profiler flag
+#ifdef LM_USE_PROFILER
+    #define LM_PROFILER 1
+#else
+    #define LM_PROFILER 0
+#endif
+
 // ------------------------------------------------------------------------------------------------
 
 // Platform flag
@@ -261,6 +268,7 @@ class Light;              // light.h
 class Camera;             // camera.h
 class Medium;             // medium.h
 class Phase;              // phase.h
+class Sampler;            // sampler.h
 struct FilmBuffer;        // film.h
 class Film;
 class Model;              // model.h
@@ -275,9 +283,12 @@ LM_FORWARD_DECLARE_WITH_NAMESPACE(comp::detail, struct Access)
 
 // ------------------------------------------------------------------------------------------------
 
-// Default floating point type
+// Default floating point type.
+// Single precision is enabled by LM_USE_SINGLE_PRECISION option of CMake.
+#ifndef LM_SINGLE_PRECISION
 #define LM_SINGLE_PRECISION 0
-#define LM_DOUBLE_PRECISION 1
+#endif
+#define LM_DOUBLE_PRECISION (!LM_SINGLE_PRECISION)
 #if LM_SINGLE_PRECISION
 using Float = float;
 #elif LM_DOUBLE_PRECISION
@@ -10,8 +10,11 @@
 #include "jsontype.h"
 #include "serialtype.h"
 #include <any>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <optional>
 #include <functional>
 
@@ -105,9 +108,14 @@ private:
     //! Underlying reference to owner object (if any)
     std::any owner_ref_;
 
+    //! True if the state is modified since the last snapshot or checkpoint.
+    //! A new component is modified until the snapshot containing it is saved or loaded.
+    //! The flag is not a part of the state so it can be set from const functions.
+    mutable std::atomic<bool> dirty_ = true;
+
 public:
     Component() = default;
-    virtual ~Component() = default;
+    virtual ~Component();
     LM_DISABLE_COPY_AND_MOVE(Component)
 
 public:
@@ -196,6 +204,39 @@ public:
         return make_loc(loc(), child);
     }
 
+public:
+    /*!
+        \brief Mark the component as modified.
+
+        \rst
+        The components modified after the snapshot or the last checkpoint are
+        written by :cpp:func:`lm::save_checkpoint`. The functions modifying the state
+        after the construction must call this function, e.g., the films on the accumulation
+        and the scenes on the edits of the scene graph.
+        The function only writes the flag when it is not set,
+        so it is cheap enough to be called for each sample.
+        \endrst
+    */
+    void mark_dirty() const {
+        if (!dirty_.load(std::memory_order_relaxed)) {
+            dirty_.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    /*!
+        \brief Check if the component is modified.
+    */
+    bool dirty() const {
+        return dirty_.load(std::memory_order_relaxed);
+    }
+
+    /*!
+        \brief Clear the modified flag.
+    */
+    void clear_dirty() {
+        dirty_.store(false, std::memory_order_relaxed);
+    }
+
 public:
     /*!
         \brief Construct a component.
@@ -287,6 +328,21 @@ public:
         \endrst
     */
     virtual void* underlying_raw_pointer(const std::string& query = "") const { LM_UNUSED(query); return nullptr; }
+
+    /*!
+        \brief Get memory usage.
+        \return Memory owned by the component instance in bytes.
+
+        \rst
+        This function returns the size of the memory owned by the component instance,
+        e.g., the texels of a texture or the nodes of an acceleration structure.
+        The memory of the underlying components enumerated by
+        :cpp:func:`lm::Component::foreach_underlying` is not included.
+        Use :cpp:func:`lm::debug::memory_usage` to aggregate the memory usage of the assets.
+        The default implementation returns zero.
+        \endrst
+    */
+    virtual size_t memory_usage() const { return 0; }
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -432,6 +488,13 @@ LM_PUBLIC_API void unload_plugin(const std::string& path);
     \rst
     This functions loads all plugins inside the specified directory.
     If the loading fails, it generates an error message but ignored.
+
+    A plugin with the manifest ``<plugin>.manifest.json`` newer than the plugin
+    is not loaded immediately. The components listed in the manifest are registered instead,
+    and the plugin is loaded when one of the components is first created.
+    The manifest is written next to a plugin when the plugin is loaded by this function,
+    so the subsequent calls only load the plugins that are actually used.
+    The plugins whose components override the registered ones are always loaded.
     \endrst
 */
 LM_PUBLIC_API void load_plugin_directory(const std::string& directory);
@@ -473,6 +536,30 @@ LM_PUBLIC_API void register_root_comp(Component* p);
 LM_PUBLIC_API Component* get(const std::string& locator);
 //! \endcond
 
+/*!
+    \brief Invalidate the cache of the locators.
+
+    \rst
+    :cpp:func:`lm::comp::get` caches the components resolved by the locators.
+    The entries referring to a component are invalidated when the component is destroyed.
+    If the component tree is modified without destroying the components,
+    e.g., when an asset is replaced while the old instance is still alive,
+    the function must be called explicitly.
+    \endrst
+*/
+LM_PUBLIC_API void invalidate_locator_cache();
+
+/*!
+    \brief Invalidate the cached locators referring to a component.
+    \param p Component.
+
+    \rst
+    This function is called from the destructor of :cpp:class:`lm::Component`.
+    The function does nothing after the component context is destroyed.
+    \endrst
+*/
+LM_PUBLIC_API void invalidate_locator_cache(const Component* p);
+
 /*!
     @}
 */
@@ -555,6 +642,20 @@ visit(const Component::ComponentVisitor& visitor, Component::Ptr<T>& p) {
     visitor(temp, false);
 }
 
+/*!
+    \brief Size of the elements of the vectors.
+    \param vs Vectors.
+    \return Total size of the allocated elements in bytes.
+
+    \rst
+    This function is a helper to implement :cpp:func:`lm::Component::memory_usage`.
+    \endrst
+*/
+template <typename... Ts>
+size_t bytes_of(const std::vector<Ts>&... vs) {
+    return ((vs.capacity() * sizeof(Ts)) + ... + size_t(0));
+}
+
 /*!
     \brief Create component with specific interface type without calling construct function.
     \tparam InterfaceT Component interface type.
@@ -714,6 +815,101 @@ public:
 
 // ------------------------------------------------------------------------------------------------
 
+/*!
+    \brief Pool of the instances of a component implementation.
+    \tparam ImplType Type of component implementation.
+
+    \rst
+    This class is used internally by :c:func:`LM_COMP_REG_IMPL` macro
+    to allocate the instances of the component implementation.
+    The instances are placed in the blocks of growing sizes
+    and the slots of the released instances are reused by the later allocations.
+    Creating and releasing millions of small components, e.g., the materials of a large scene,
+    thus does not go through the general-purpose allocator for each instance,
+    and the instances of the same type are placed close in memory.
+    The blocks are kept for the reuse until the pool is destroyed.
+    If some instances are still alive at the destruction of the static objects,
+    the pool is intentionally leaked so that the instances can be released later.
+    \endrst
+*/
+template <typename ImplType>
+class InstancePool {
+private:
+    union Slot {
+        Slot* next;
+        alignas(ImplType) unsigned char storage[sizeof(ImplType)];
+    };
+    static constexpr size_t InitialBlockSize = 16;
+    static constexpr size_t MaxBlockSize = 4096;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Slot[]>> blocks_;
+    Slot* free_ = nullptr;                      // Head of the list of the free slots
+    size_t block_size_ = InitialBlockSize;      // Number of slots of the next block
+    long long live_ = 0;                        // Number of the live instances
+
+public:
+    static InstancePool& instance() {
+        static auto* pool = new InstancePool;
+        static const struct Reclaimer {
+            InstancePool* pool;
+            ~Reclaimer() {
+                if (pool->live_ == 0) {
+                    delete pool;
+                }
+            }
+        } reclaimer{ pool };
+        return *pool;
+    }
+
+    // Create an instance
+    ImplType* create() {
+        Slot* s;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!free_) {
+                grow();
+            }
+            s = free_;
+            free_ = s->next;
+            live_++;
+        }
+        try {
+            return new (s->storage) ImplType;
+        }
+        catch (...) {
+            release_slot(s);
+            throw;
+        }
+    }
+
+    // Destruct and release an instance
+    void release(Component* p) {
+        // Address of the most derived object, i.e., the slot
+        auto* s = static_cast<Slot*>(dynamic_cast<void*>(p));
+        p->~Component();
+        release_slot(s);
+    }
+
+private:
+    void release_slot(Slot* s) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        s->next = free_;
+        free_ = s;
+        live_--;
+    }
+
+    void grow() {
+        auto block = std::make_unique<Slot[]>(block_size_);
+        for (size_t i = 0; i < block_size_; i++) {
+            block[i].next = i + 1 < block_size_ ? &block[i + 1] : free_;
+        }
+        free_ = &block[0];
+        blocks_.push_back(std::move(block));
+        block_size_ = block_size_ * 2 < MaxBlockSize ? block_size_ * 2 : MaxBlockSize;
+    }
+};
+
 /*!
     \brief Registration entry for component implementation.
     \tparam ImplType Type of component implementation.
@@ -740,13 +936,15 @@ public:
         : key_(std::move(key))
         , alias_(std::move(alias))
     {
-        // Register factory function
+        // Register factory function.
+        // The instances are allocated from the pool of the implementation.
+        auto& pool = InstancePool<ImplType>::instance();
         reg(key_, alias_,
-            []() -> Component* {
-                return new ImplType;
+            [&pool]() -> Component* {
+                return pool.create();
             },
-            [](Component* p) {
-                LM_SAFE_DELETE(p);
+            [&pool](Component* p) {
+                pool.release(p);
             });
     }
     ~RegEntry() {
@@ -761,6 +959,12 @@ public:
 
 LM_NAMESPACE_END(detail)
 LM_NAMESPACE_END(comp)
+
+// Destroying a component invalidates the locators referring to it
+inline Component::~Component() {
+    comp::detail::invalidate_locator_cache(this);
+}
+
 LM_NAMESPACE_END(LM_NAMESPACE)
 
 // ------------------------------------------------------------------------------------------------
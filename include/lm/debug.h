@@ -55,6 +55,36 @@ LM_PUBLIC_API void attach_to_debugger();
 */
 LM_PUBLIC_API void print_asset_tree(bool visualize_weak_refs);
 
+/*!
+    \brief Get memory usage of the assets.
+    \param loc Locator of the root component.
+    \return Memory usage as a tree.
+
+    \rst
+    This function aggregates :cpp:func:`lm::Component::memory_usage`
+    of the component specified by ``loc`` and the underlying components owned by it.
+    The weak references are not counted.
+    The returned value is a tree of the components, where each node has
+    ``loc``, ``key``, ``self`` (bytes owned by the component), ``total``
+    (bytes including the owned underlying components), and ``children``.
+    The root node additionally has ``subsystems``, which maps the interface names
+    of the component keys (e.g., ``texture`` for ``texture::bitmap``) to the total bytes.
+    \endrst
+*/
+LM_PUBLIC_API Json memory_usage(const std::string& loc = "$.assets");
+
+/*!
+    \brief Prints memory usage of the assets.
+    \param loc Locator of the root component.
+
+    \rst
+    This function visualizes the tree returned by :cpp:func:`lm::debug::memory_usage`
+    in the same way as :cpp:func:`lm::debug::print_asset_tree`,
+    followed by the memory usage of each subsystem.
+    \endrst
+*/
+LM_PUBLIC_API void print_memory_usage(const std::string& loc = "$.assets");
+
 /*!
     @}
 */
@@ -0,0 +1,49 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include "component.h"
+#include "math.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*!
+    \addtogroup denoiser
+    @{
+*/
+
+/*!
+    \brief Denoiser.
+
+    \rst
+    This interface provides an abstraction of the denoisers
+    applied to the rendered images as a post process.
+    The denoisers can use the feature buffers recorded by the film as AOVs
+    (see :cpp:enum:`lm::FilmAOV`) to preserve the details of the image.
+    \endrst
+*/
+class Denoiser : public Component {
+public:
+    /*!
+        \brief Denoise an image.
+        \param w Width of the image.
+        \param h Height of the image.
+        \param color Noisy colors in row-major order.
+        \param albedo Albedos in row-major order. Empty if unavailable.
+        \param normal Shading normals in row-major order. Empty if unavailable.
+        \return Denoised colors in row-major order.
+    */
+    virtual std::vector<Vec3> denoise(int w, int h,
+        const std::vector<Vec3>& color,
+        const std::vector<Vec3>& albedo,
+        const std::vector<Vec3>& normal) const = 0;
+};
+
+/*!
+    @}
+*/
+
+LM_NAMESPACE_END(LM_NAMESPACE)
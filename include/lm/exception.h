@@ -26,6 +26,10 @@ LM_NAMESPACE_BEGIN(exception)
     This function initializes exception subsystem of the framework.
     The function is implicitly called by the framework
     so the user do not want to explicitly call this function.
+
+    ``fpex`` property enables the floating-point exceptions for debugging (Windows only).
+    The default value is ``true`` for debug builds and ``false`` otherwise.
+    If the exceptions are not enabled, :cpp:class:`ScopedDisableFPEx` costs nothing.
     \endrst
 */
 LM_PUBLIC_API void init(const Json& prop = {});
@@ -64,6 +68,23 @@ LM_PUBLIC_API void enable_fpex();
 */
 LM_PUBLIC_API void disable_fpex();
 
+/*!
+    \brief Check if floating point exceptions are enabled in the current thread.
+*/
+LM_PUBLIC_API bool fpex_enabled();
+
+/*!
+    \brief Initialize the exception state of the current thread.
+
+    \rst
+    The floating-point exceptions are the state of each thread.
+    This function enables the exceptions in the current thread
+    if the exceptions are enabled for debugging by :cpp:func:`init`.
+    The parallel contexts call this function once in each worker thread.
+    \endrst
+*/
+LM_PUBLIC_API void init_thread();
+
 /*!
     \brief Print stack trace.
 
@@ -82,6 +103,9 @@ LM_PUBLIC_API void stack_trace();
     A convenience class when you want to temporarily disable floating point exceptions.
     This class is useful when you want to use some external libraries that
     does not check strict floating point exceptions. 
+    The exceptions are disabled and enabled again only if they are enabled in the current thread,
+    so the class does not touch the floating-point environment
+    unless the exceptions are enabled for debugging.
     
     Example:
 
@@ -99,9 +123,12 @@ LM_PUBLIC_API void stack_trace();
     \endrst
 */
 class ScopedDisableFPEx {
+private:
+    bool enabled_;
+
 public:
-    ScopedDisableFPEx() { disable_fpex(); }
-    ~ScopedDisableFPEx() { enable_fpex(); }
+    ScopedDisableFPEx() : enabled_(fpex_enabled()) { if (enabled_) { disable_fpex(); } }
+    ~ScopedDisableFPEx() { if (enabled_) { enable_fpex(); } }
     LM_DISABLE_COPY_AND_MOVE(ScopedDisableFPEx)
 };
 
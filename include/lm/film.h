@@ -43,6 +43,22 @@ struct FilmBuffer {
     Float* data;    //!< Data.
 };
 
+/*!
+    \brief Auxiliary output variable (AOV) of the film.
+
+    \rst
+    AOVs are the per-pixel quantities recorded alongside the color,
+    e.g., the feature buffers of denoisers.
+    The renderers record the AOVs of the interactions found by the primary rays.
+    \endrst
+*/
+enum class FilmAOV {
+    Albedo,         //!< Reflectance at the primary hit point.
+    Normal,         //!< Shading normal at the primary hit point.
+    Depth,          //!< Distance to the primary hit point.
+    SampleCount,    //!< Number of samples of the pixel.
+};
+
 /*!
     \brief Film.
 
@@ -142,6 +158,150 @@ public:
     */
     virtual void clear() = 0;
 
+    /*!
+        \brief Merge the deferred splats into the pixels.
+
+        \rst
+        Films may defer the splats, e.g., in thread-local buffers,
+        and merge them when the pixels are read.
+        :cpp:func:`lm::Film::update_pixel` and :cpp:func:`lm::Film::set_pixel`
+        work on the merged pixels only, so a caller updating the pixels
+        after the splats must call this function beforehand.
+        This function must not be called concurrently with splatting.
+        The default implementation does nothing.
+        \endrst
+    */
+    virtual void merge_splats() {}
+
+    /*!
+        \brief Publish a snapshot of the film.
+        \param s Scale applied to the pixel values of the snapshot.
+
+        \rst
+        This function copies the current state of the film to the snapshot
+        which can be read by :cpp:func:`lm::Film::snapshot` at any time,
+        even from the other threads during rendering.
+        Progressive renderers call this function between passes
+        where no worker modifies the film.
+        The default implementation does nothing.
+        \endrst
+    */
+    virtual void publish(Float s) {
+        LM_UNUSED(s);
+    }
+
+    /*!
+        \brief Get the last published snapshot of the film.
+        \return Pixel values in row-major order. Empty if no snapshot is published.
+
+        \rst
+        Unlike :cpp:func:`lm::Film::buffer`, this function is safe to call during rendering.
+        \endrst
+    */
+    virtual std::vector<Vec3> snapshot() const {
+        return {};
+    }
+
+    /*!
+        \brief Get the last published snapshot of the film without copying.
+        \return Pixel values in row-major order. nullptr if no snapshot is published.
+
+        \rst
+        Same as :cpp:func:`lm::Film::snapshot` except that the snapshot is shared with the film.
+        The returned snapshot is immutable and remains valid after the next publication,
+        which replaces the snapshot of the film with a new one.
+        This is useful to reference the snapshot from external code, e.g., as a numpy array.
+        The default implementation wraps the copy obtained by :cpp:func:`lm::Film::snapshot`.
+        \endrst
+    */
+    virtual std::shared_ptr<const std::vector<Vec3>> shared_snapshot() const {
+        auto data = snapshot();
+        if (data.empty()) {
+            return {};
+        }
+        return std::make_shared<const std::vector<Vec3>>(std::move(data));
+    }
+
+    /*!
+        \brief Notify that the pixels in a region are finalized.
+        \param x0 Minimum x coordinate of the region.
+        \param y0 Minimum y coordinate of the region.
+        \param x1 Maximum x coordinate of the region (exclusive).
+        \param y1 Maximum y coordinate of the region (exclusive).
+
+        \rst
+        Schedulers processing the film region by region call this function
+        when all samples of the pixels in the region are processed.
+        Films can use this notification to release the memory of the region,
+        e.g., by streaming the finished pixels to a file.
+        The default implementation does nothing.
+        \endrst
+    */
+    virtual void finish_region(int x0, int y0, int x1, int y1) {
+        LM_UNUSED(x0, y0, x1, y1);
+    }
+
+    /*!
+        \brief Check if the film records any AOV.
+        \rst
+        Renderers use this function to skip the computation of the AOVs.
+        The default implementation returns false.
+        \endrst
+    */
+    virtual bool has_aovs() const {
+        return false;
+    }
+
+    /*!
+        \brief Check if the film records an AOV.
+        \param aov AOV.
+    */
+    virtual bool has_aov(FilmAOV aov) const {
+        LM_UNUSED(aov);
+        return false;
+    }
+
+    /*!
+        \brief Splat the value of an AOV by pixel coordinates.
+        \param x x coordinate of the film.
+        \param y y coordinate of the film.
+        \param aov AOV.
+        \param v Value. Scalar AOVs use the first component.
+        \rst
+        The values are averaged over the samples of the pixel,
+        counted by splatting :cpp:enumerator:`lm::FilmAOV::SampleCount`.
+        The function does nothing if the film does not record the AOV.
+        This function is thread-safe.
+        \endrst
+    */
+    virtual void splat_aov(int x, int y, FilmAOV aov, Vec3 v) {
+        LM_UNUSED(x, y, aov, v);
+    }
+
+    /*!
+        \brief Get the values of an AOV.
+        \param aov AOV.
+        \return Values in row-major order. Empty if the film does not record the AOV.
+        \rst
+        Scalar AOVs are replicated to all components.
+        \endrst
+    */
+    virtual std::vector<Vec3> aov(FilmAOV aov) const {
+        LM_UNUSED(aov);
+        return {};
+    }
+
+    /*!
+        \brief Save an AOV.
+        \param aov AOV.
+        \param outpath Output image path.
+        \return False if it fails to save the AOV.
+    */
+    virtual bool save_aov(FilmAOV aov, const std::string& outpath) const {
+        LM_UNUSED(aov, outpath);
+        return false;
+    }
+
 public:
     /*!
         \brief Get aspect ratio.
@@ -10,6 +10,7 @@
 #include "math.h"
 #include "exception.h"
 #include <sstream>
+#include <cstring>
 #include <array>
 
 // ------------------------------------------------------------------------------------------------
@@ -289,6 +290,94 @@ std::optional<T> value_or_none(const Json& j, const std::string& name) {
     return {};
 }
 
+/*!
+    \brief Check if JSON element is a binary buffer.
+    \param j Json object.
+
+    \rst
+    A binary buffer is a JSON object ``{"buffer": <binary>, "dtype": <type>, "shape": [...]}``
+    holding a copy of a contiguous array as a JSON binary value,
+    e.g., created by :func:`lightmetrica.buffer` from a numpy array.
+    The type is one of ``float32``, ``float64``, ``int32``, ``int64``, ``uint32``, and ``uint64``.
+    The buffers let the components read large arrays without creating a JSON element per number.
+    Since the JSON element owns the data, the properties can be kept after the call,
+    e.g., by the lazy construction of the assets.
+    A binary value can only be created by the Python binding, not by parsing a JSON text.
+    \endrst
+*/
+LM_INLINE bool is_buffer(const Json& j) {
+    if (!j.is_object()) {
+        return false;
+    }
+    const auto it = j.find("buffer");
+    return it != j.end() && it->is_binary();
+}
+
+/*!
+    \brief Append the numbers in JSON element to a vector.
+    \param j Json object.
+    \param out Vector to which the numbers are appended.
+
+    \rst
+    The element can be a number, a nested array of numbers, or a binary buffer.
+    Nested arrays, e.g., the rows of a numpy array of shape :math:`(n,3)`, are flattened.
+    A binary buffer is read directly from the memory referred by the buffer.
+    \endrst
+*/
+template <typename T>
+void flatten(const Json& j, std::vector<T>& out) {
+    if (is_buffer(j)) {
+        const auto& data = j.at("buffer").get_binary();
+        const auto dtype = j.at("dtype").get<std::string>();
+        size_t n = 1;
+        for (const auto& d : j.at("shape")) {
+            n *= d.get<size_t>();
+        }
+        const auto append = [&](auto type) {
+            using S = decltype(type);
+            if (data.size() != n * sizeof(S)) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument,
+                    "Inconsistent buffer size [dtype='{}', elements={}, bytes={}]", dtype, n, data.size());
+            }
+            out.reserve(out.size() + n);
+            for (size_t i = 0; i < n; i++) {
+                S v;
+                std::memcpy(&v, data.data() + i * sizeof(S), sizeof(S));
+                out.push_back(static_cast<T>(v));
+            }
+        };
+        if (dtype == "float32") {
+            append(float{});
+        }
+        else if (dtype == "float64") {
+            append(double{});
+        }
+        else if (dtype == "int32") {
+            append(std::int32_t{});
+        }
+        else if (dtype == "int64") {
+            append(std::int64_t{});
+        }
+        else if (dtype == "uint32") {
+            append(std::uint32_t{});
+        }
+        else if (dtype == "uint64") {
+            append(std::uint64_t{});
+        }
+        else {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Unsupported buffer type [dtype='{}']", dtype);
+        }
+        return;
+    }
+    if (!j.is_array()) {
+        out.push_back(j.get<T>());
+        return;
+    }
+    for (const auto& e : j) {
+        flatten(e, out);
+    }
+}
+
 /*!
     @}
 */
@@ -35,6 +35,33 @@ public:
         LM_UNUSED(bound);
     }
 
+    /*!
+        \brief Compute the power of the light.
+        \param transform Transformation of the light source.
+        \return Luminance of the emitted power.
+
+        \rst
+        The power is used as the importance of the light when the scene selects a light.
+        The value need not be exact.
+        Infinite lights compute the power incident to the scene bound
+        given by :cpp:func:`set_scene_bound`.
+        \endrst
+    */
+    virtual Float power(const Transform& transform) const {
+        LM_UNUSED(transform);
+        return 1_f;
+    }
+
+    /*!
+        \brief Compute the bound of the light.
+        \param transform Transformation of the light source.
+        \return Bound of the light in world coordinates. ``nullopt`` if the light is not bounded.
+    */
+    virtual std::optional<Bound> bound(const Transform& transform) const {
+        LM_UNUSED(transform);
+        return {};
+    }
+
     // --------------------------------------------------------------------------------------------
 
     //! Result of primary ray sampling.
@@ -42,6 +69,7 @@ public:
         PointGeometry geom;   //!< Sampled geometry information.
         Vec3 wo;              //!< Sampled direction.
         Vec3 weight;          //!< Contribution divided by probability.
+        Float pdf = 0_f;      //!< Evaluated pdf in projected solid angle measure. Zero if not available.
     };
 
     //! Random number input for primary ray sampling.
@@ -17,10 +17,15 @@
 #include "progresscontext.h"
 #include "exception.h"
 #include "scheduler.h"
+#include "sampler.h"
 #include "debug.h"
+#include "profiler.h"
+#include "trace.h"
+#include "tracecontext.h"
 #include "parallel.h"
 #include "parallelcontext.h"
 #include "math.h"
+#include "spectrum.h"
 #include "mesh.h"
 #include "camera.h"
 #include "texture.h"
@@ -36,4 +41,6 @@
 #include "model.h"
 #include "objloader.h"
 #include "renderer.h"
+#include "denoiser.h"
+#include "roulette.h"
 #include "assetgroup.h"
\ No newline at end of file
@@ -140,6 +140,36 @@ public:
     */
     virtual Vec3 eval(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) const = 0;
 
+    //! Result of BSDF evaluation with PDF.
+    struct DirectionEval {
+        Vec3 f;         //!< Evaluated BSDF.
+        Float pdf;      //!< PDF in projected solid angle measure.
+    };
+
+    /*!
+        \brief Evaluate BSDF and pdf.
+        \param geom Point geometry.
+        \param wi Incident ray direction.
+        \param wo Outgoing ray direction.
+        \param comp Component index.
+        \param trans_dir Transport direction.
+        \param eval_delta If true, evaluate delta function.
+
+        \rst
+        This function evaluates :cpp:func:`lm::Material::eval` and :cpp:func:`lm::Material::pdf_direction`
+        for the same pair of directions at once, used for instance to compute MIS weights.
+        Materials sharing the intermediate values of both functions, e.g., the mixture materials
+        or the materials with textures, can override this function to avoid the duplicated computation.
+        The default implementation calls both functions.
+        \endrst
+    */
+    virtual DirectionEval eval_with_pdf(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) const {
+        return {
+            eval(geom, wi, wo, comp, trans_dir, eval_delta),
+            pdf_direction(geom, wi, wo, comp, eval_delta)
+        };
+    }
+
     /*!
         \brief Check if BSDF contains delta component.
         \param comp Component index.
@@ -151,6 +181,44 @@ public:
     */
     virtual bool is_specular_component(int comp) const = 0;
 
+    /*!
+        \brief Check if the component is dispersive.
+        \param comp Component index.
+
+        \rst
+        This function evaluates true if the sampled direction of the component
+        depends on the wavelength, e.g., the refraction with the wavelength-dependent index of refraction.
+        Spectral renderers use :cpp:func:`lm::Material::sample_direction_spectral` for the component
+        and keep only the wavelength used for the sampling.
+        The default implementation returns false.
+        \endrst
+    */
+    virtual bool is_dispersive_component(int comp) const {
+        LM_UNUSED(comp);
+        return false;
+    }
+
+    /*!
+        \brief Direction sampling for a wavelength.
+        \param u Random number input.
+        \param geom Point geometry.
+        \param wi Incident direction.
+        \param comp Component index.
+        \param trans_dir Transport direction.
+        \param lambda Wavelength in nm.
+        \return Sampled direction with associated information. nullopt for invalid sample.
+
+        \rst
+        Spectral version of :cpp:func:`lm::Material::sample_direction`.
+        The weight of the sample is the contribution for the wavelength ``lambda`` divided by PDF.
+        The default implementation ignores the wavelength and calls :cpp:func:`lm::Material::sample_direction`.
+        \endrst
+    */
+    virtual std::optional<DirectionSample> sample_direction_spectral(const DirectionSampleU& u, const PointGeometry& geom, Vec3 wi, int comp, TransDir trans_dir, Float lambda) const {
+        LM_UNUSED(lambda);
+        return sample_direction(u, geom, wi, comp, trans_dir);
+    }
+
     /*!
         \brief Evaluate reflectance.
         \param geom Point geometry.
@@ -160,8 +228,118 @@ public:
         \endrst
     */
     virtual Vec3 reflectance(const PointGeometry& geom) const = 0;
+
+    /*!
+        \brief Get alpha mask resolved by ray intersection.
+        \return Alpha mask texture. nullptr if the material has no such mask.
+
+        \rst
+        If the function returns a texture, the surfaces with the material are treated as cutouts:
+        the intersections where the alpha value of the texture is less than
+        the ``alpha_cutoff`` of the scene are ignored by the ray queries of :cpp:class:`lm::Scene`,
+        and the material itself must treat the surfaces as opaque.
+        This avoids to continue the paths through the transparent parts of the surfaces.
+        The default implementation returns nullptr.
+        \endrst
+    */
+    virtual const Texture* alpha_mask() const { return nullptr; }
+
+    // --------------------------------------------------------------------------------------------
+
+    /*!
+        \brief Component sampling for multiple points.
+        \param n Number of points.
+        \param u Array of random number inputs of size ``n``.
+        \param geom Array of point geometries of size ``n``.
+        \param wi Array of incident directions of size ``n``.
+        \param out Output array of sampled components of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Material::sample_component`.
+        Renderers grouping the points by materials can call this function once per group
+        instead of dispatching the single-point function for each point.
+        The default implementation calls :cpp:func:`lm::Material::sample_component` for each point.
+        Implementations can use :c:macro:`LM_MATERIAL_BATCH_IMPL` to define the batched functions
+        without the virtual dispatch per point.
+        \endrst
+    */
+    virtual void sample_component_n(int n, const ComponentSampleU* u, const PointGeometry* geom, const Vec3* wi, ComponentSample* out) const {
+        for (int i = 0; i < n; i++) {
+            out[i] = sample_component(u[i], geom[i], wi[i]);
+        }
+    }
+
+    /*!
+        \brief Direction sampling for multiple points.
+        \param n Number of points.
+        \param u Array of random number inputs of size ``n``.
+        \param geom Array of point geometries of size ``n``.
+        \param wi Array of incident directions of size ``n``.
+        \param comp Array of component indices of size ``n``.
+        \param trans_dir Transport direction.
+        \param out Output array of sampled directions of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Material::sample_direction`.
+        The default implementation calls :cpp:func:`lm::Material::sample_direction` for each point.
+        \endrst
+    */
+    virtual void sample_direction_n(int n, const DirectionSampleU* u, const PointGeometry* geom, const Vec3* wi, const int* comp, TransDir trans_dir, std::optional<DirectionSample>* out) const {
+        for (int i = 0; i < n; i++) {
+            out[i] = sample_direction(u[i], geom[i], wi[i], comp[i], trans_dir);
+        }
+    }
+
+    /*!
+        \brief Evaluate BSDF for multiple points.
+        \param n Number of points.
+        \param geom Array of point geometries of size ``n``.
+        \param wi Array of incident ray directions of size ``n``.
+        \param wo Array of outgoing ray directions of size ``n``.
+        \param comp Array of component indices of size ``n``.
+        \param trans_dir Transport direction.
+        \param eval_delta If true, evaluate delta function.
+        \param out Output array of evaluated BSDFs of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Material::eval`.
+        The default implementation calls :cpp:func:`lm::Material::eval` for each point.
+        \endrst
+    */
+    virtual void eval_n(int n, const PointGeometry* geom, const Vec3* wi, const Vec3* wo, const int* comp, TransDir trans_dir, bool eval_delta, Vec3* out) const {
+        for (int i = 0; i < n; i++) {
+            out[i] = eval(geom[i], wi[i], wo[i], comp[i], trans_dir, eval_delta);
+        }
+    }
 };
 
+/*!
+    \brief Implement batched functions of the material.
+
+    \rst
+    Put this macro in the definition of a ``final`` material class to override
+    the batched functions, e.g., :cpp:func:`lm::Material::sample_direction_n`.
+    Since the class is final, the calls to the single-point functions in the loops
+    are resolved statically and can be inlined.
+    \endrst
+*/
+#define LM_MATERIAL_BATCH_IMPL() \
+    virtual void sample_component_n(int n, const ComponentSampleU* u, const PointGeometry* geom, const Vec3* wi, ComponentSample* out) const override { \
+        for (int i = 0; i < n; i++) { \
+            out[i] = sample_component(u[i], geom[i], wi[i]); \
+        } \
+    } \
+    virtual void sample_direction_n(int n, const DirectionSampleU* u, const PointGeometry* geom, const Vec3* wi, const int* comp, TransDir trans_dir, std::optional<DirectionSample>* out) const override { \
+        for (int i = 0; i < n; i++) { \
+            out[i] = sample_direction(u[i], geom[i], wi[i], comp[i], trans_dir); \
+        } \
+    } \
+    virtual void eval_n(int n, const PointGeometry* geom, const Vec3* wi, const Vec3* wo, const int* comp, TransDir trans_dir, bool eval_delta, Vec3* out) const override { \
+        for (int i = 0; i < n; i++) { \
+            out[i] = eval(geom[i], wi[i], wo[i], comp[i], trans_dir, eval_delta); \
+        } \
+    }
+
 /*!
     @}
 */
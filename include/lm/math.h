@@ -22,6 +22,8 @@
 #include <tuple>
 #include <optional>
 #include <random>
+#include <cstdint>
+#include <limits>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -76,6 +78,30 @@ struct Ray {
     //! \endcond
 };
 
+/*!
+    \brief Ray cone.
+
+    \rst
+    This structure approximates the footprint of a ray with a cone [Akenine-Moller et al. 2019].
+    The cone is described by the width at the origin of the ray and the spread angle.
+    The footprint is used to select the resolution of the texture lookups.
+    \endrst
+*/
+struct RayCone {
+    Float width = 0_f;      //!< Width of the cone at the origin of the ray.
+    Float spread = 0_f;     //!< Spread angle of the cone in radians.
+
+    //! Width of the cone at the distance ``t`` from the origin.
+    Float width_at(Float t) const {
+        return width + spread * t;
+    }
+
+    //! Cone of the ray starting at the distance ``t`` from the origin with the same spread angle.
+    RayCone propagate(Float t) const {
+        return { width_at(t), spread };
+    }
+};
+
 /*!
     \brief Axis-aligned bounding box
 */
@@ -201,22 +227,77 @@ struct SphereBound {
 
 LM_NAMESPACE_BEGIN(detail)
 
+// Permuted congruential generator (PCG32) [O'Neill 2014].
+// The generator holds 128 bits of state and supports O(1) creation of
+// independent streams, which makes it possible to assign a stream to each sample.
 class RngImplBase {
 private:
-    std::mt19937 eng_;
-    std::uniform_real_distribution<double> dist_;  // Always use double
-    std::uniform_int_distribution<int> dist_int_;
+    static constexpr uint64_t Mult = 6364136223846793005ULL;
+    uint64_t state_;    // Current state
+    uint64_t inc_;      // Stream selector. Must be odd.
 
 protected:
     RngImplBase() {
-        // Initialize eng_ with random_device
-        eng_.seed(std::random_device{}());
+        // Initialize with random_device
+        std::random_device rd;
+        init(((uint64_t)(rd()) << 32) | rd(), 0);
     }
     RngImplBase(int seed) {
-        eng_.seed(seed);
+        init((uint64_t)(seed), 0);
+    }
+    RngImplBase(uint64_t seed, uint64_t stream) {
+        init(seed, stream);
+    }
+
+    void init(uint64_t seed, uint64_t stream) {
+        state_ = 0;
+        inc_ = (stream << 1) | 1;
+        next32();
+        state_ += seed;
+        next32();
+    }
+
+    // Generate 32-bit unsigned integer
+    uint32_t next32() {
+        const auto old = state_;
+        state_ = old * Mult + inc_;
+        const auto xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+        const auto rot = (uint32_t)(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1) & 31));
+    }
+
+    // Mix bits of a 64-bit integer (SplitMix64 finalizer)
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // Seed and stream of the split generator
+    std::pair<uint64_t, uint64_t> split_key(long long a, long long b) const {
+        const auto key = mix(state_ ^ mix(inc_ ^ mix((uint64_t)(a) ^ mix((uint64_t)(b)))));
+        return { key, mix(key) };
+    }
+
+    // Generate uniform random number in [0,1) with 53 bits of precision
+    double u() {
+        const auto a = (uint64_t)(next32()) >> 6;
+        const auto b = (uint64_t)(next32()) >> 5;
+        return double((a << 27) | b) * 0x1p-53;
     }
-    double u() { return dist_(eng_); }
-    int u_int() { return dist_int_(eng_); }
+
+    // Generate uniform random integer in [0,INT_MAX]
+    int u_int() {
+        return int(next32() >> 1);
+    }
+
+public:
+    //! \cond
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(state_, inc_);
+    }
+    //! \endcond
 };
 
 template <typename F>
@@ -227,9 +308,15 @@ class RngImpl<double> : public RngImplBase {
 public:
     RngImpl() = default;
     RngImpl(int seed) : RngImplBase(seed) {}
+    RngImpl(uint64_t seed, uint64_t stream) : RngImplBase(seed, stream) {}
     using RngImplBase::u;
     using RngImplBase::u_int;
 
+    RngImpl split(long long a, long long b) const {
+        const auto [seed, stream] = split_key(a, b);
+        return RngImpl(seed, stream);
+    }
+
     template <typename T>
     T next() {
         T us;
@@ -246,28 +333,30 @@ class RngImpl<float> : public RngImplBase {
 public:
     RngImpl() = default;
     RngImpl(int seed) : RngImplBase(seed) {}
+    RngImpl(uint64_t seed, uint64_t stream) : RngImplBase(seed, stream) {}
 
-    /*
-        According to the C++ standard std::uniform_real_distribution::operator()
-        always returns non-inclusive range. For instance, in our case u()
-        should return values in [0,1). Yet due to the rounding issue
-        the function might return exact value of 1.f when std::uniform_real_distribution is
-        specialized for float. To avoid this problem, we generate
-        the number with double then round it toward negative infinity
-        rather than generating the number with float directly.
-        cf. https://stackoverflow.com/questions/25668600/is-1-0-a-valid-output-from-stdgenerate-canonical
-    */
+    RngImpl split(long long a, long long b) const {
+        const auto [seed, stream] = split_key(a, b);
+        return RngImpl(seed, stream);
+    }
+
+    // Using upper 24 bits guarantees the result is exactly representable
+    // and thus is always less than 1.
     float u() {
-        const double rd = RngImplBase::u();
-        float rf = static_cast<float>(rd);
-        if (rf > rd) {
-            rf = std::nextafter(rf, -std::numeric_limits<float>::infinity());
-        }
-        assert(rf < 1.f);
-        return rf;
+        return float(next32() >> 8) * 0x1p-24f;
     }
 
     using RngImplBase::u_int;
+
+    template <typename T>
+    T next() {
+        T us;
+        const int N = sizeof(T) / sizeof(float);
+        for (int i = 0; i < N; i++) {
+            *(reinterpret_cast<float*>(&us) + i) = u();
+        }
+        return us;
+    }
 };
 
 LM_NAMESPACE_END(detail)
@@ -294,6 +383,13 @@ LM_NAMESPACE_END(detail)
     .. cpp:function:: Float u()
 
        Generate an uniform random number in [0,1).
+
+    .. cpp:function:: Rng split(long long a, long long b) const
+
+       Create an independent generator for a pair of indices, e.g., pixel and sample indices.
+       The function does not modify the state of the generator. Assigning a split generator
+       to each sample makes the result deterministic regardless of the number of threads
+       or the order of the execution.
     \endrst
 */
 using Rng = detail::RngImpl<Float>;
@@ -306,23 +402,41 @@ using Rng = detail::RngImpl<Float>;
 
 /*!
     \brief 1d discrete distribution.
+
+    \rst
+    By default, the sampling performs the binary search over the CDF.
+    Calling :cpp:func:`lm::Dist::init_alias` after the normalization
+    enables the alias method [Walker 1977], which samples in constant time.
+    \endrst
 */
 struct Dist {
     std::vector<Float> c{ 0_f }; // CDF
+    std::vector<Float> q;        // Probabilities to select the bin itself in alias table
+    std::vector<int> a;          // Aliases of the bins in alias table
 
     //! \cond
     template <typename Archive>
     void serialize(Archive& ar) {
-        ar(c);
+        ar(c, q, a);
     }
     //! \endcond
 
+    /*!
+        \brief Get memory usage.
+        \return Size of the tables in bytes.
+    */
+    size_t memory_usage() const {
+        return c.capacity() * sizeof(Float) + q.capacity() * sizeof(Float) + a.capacity() * sizeof(int);
+    }
+
     /*!
         \brief Clear internal state.
     */
     void clear() {
         c.clear();
         c.push_back(0_f);
+        q.clear();
+        a.clear();
     }
 
     /*!
@@ -358,37 +472,109 @@ struct Dist {
         \return Sampled index.
     */
     int sample(Float u) const {
+        if (!a.empty()) {
+            // Alias method
+            const int n = int(a.size());
+            const int i = std::clamp(int(u * n), 0, n - 1);
+            return u * n - i < q[i] ? i : a[i];
+        }
         const auto it = std::upper_bound(c.begin(), c.end(), u);
         return std::clamp(int(std::distance(c.begin(), it)) - 1, 0, int(c.size()) - 2);
     }
+
+    /*!
+        \brief Build alias table.
+
+        \rst
+        This function must be called after :cpp:func:`lm::Dist::norm`.
+        The mapping from the random number to the sampled index is not monotonic,
+        but the distribution of the sampled indices is unchanged.
+        \endrst
+    */
+    void init_alias() {
+        // Vose's method
+        const int n = int(c.size()) - 1;
+        q.assign(n, 1_f);
+        a.resize(n);
+        std::vector<Float> p(n);
+        std::vector<int> small;
+        std::vector<int> large;
+        for (int i = 0; i < n; i++) {
+            a[i] = i;
+            p[i] = pmf(i) * n;
+            (p[i] < 1_f ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            const int s = small.back(); small.pop_back();
+            const int l = large.back(); large.pop_back();
+            q[s] = p[s];
+            a[s] = l;
+            p[l] = (p[l] + p[s]) - 1_f;
+            (p[l] < 1_f ? small : large).push_back(l);
+        }
+        // Remaining bins are selected with probability one,
+        // which also absorbs the numerical errors.
+    }
 };
 
 // ------------------------------------------------------------------------------------------------
 
 /*!
     \brief 2d discrete distribution.
+
+    \rst
+    By default, the sampling selects a row from the marginal distribution
+    and a column from the conditional distribution of the row.
+    With the alias method, the distribution holds an alias table of the joint distribution
+    so that a sample costs a single constant-time lookup.
+    \endrst
 */
 struct Dist2 {
     std::vector<Dist> ds;   // Conditional distribution correspoinding to a row
     Dist m;                 // Marginal distribution
+    Dist j;                 // Joint distribution with alias table. Only used with alias method.
     int w, h;               // Size of the distribution
 
     //! \cond
     template <typename Archive>
     void serialize(Archive& ar) {
-        ar(ds, m, w, h);
+        ar(ds, m, j, w, h);
     }
     //! \endcond
 
+    /*!
+        \brief Get memory usage.
+        \return Size of the tables in bytes.
+    */
+    size_t memory_usage() const {
+        size_t bytes = ds.capacity() * sizeof(Dist) + m.memory_usage() + j.memory_usage();
+        for (const auto& d : ds) {
+            bytes += d.memory_usage();
+        }
+        return bytes;
+    }
+
     /*!
         \brief Add values to the distribution.
         \param v Values to be added.
         \param cols Number of columns.
         \param rows Number of rows.
+        \param alias Use alias method for sampling.
     */
-    void init(const std::vector<Float>& v, int cols, int rows) {
+    void init(const std::vector<Float>& v, int cols, int rows, bool alias = false) {
         w = cols;
         h = rows;
+        ds.clear();
+        m.clear();
+        j.clear();
+        if (alias) {
+            for (int i = 0; i < w * h; i++) {
+                j.add(v[i]);
+            }
+            j.norm();
+            j.init_alias();
+            return;
+        }
         ds.assign(h, {});
         for (int i = 0; i < h; i++) {
             auto& d = ds[i];
@@ -409,6 +595,10 @@ struct Dist2 {
     */
     Float pdf(Float u, Float v) const {
         const int y = std::min(int(v * h), h - 1);
+        if (!j.a.empty()) {
+            const int x = std::min(int(u * w), w - 1);
+            return j.pmf(y * w + x) * w * h;
+        }
         return m.pmf(y) * ds[y].pmf(int(u * w)) * w * h;
     }
 
@@ -418,6 +608,10 @@ struct Dist2 {
         \return Sampled position.
     */
     Vec2 sample(Vec4 u) const {
+        if (!j.a.empty()) {
+            const int i = j.sample(u[0]);
+            return Vec2((i % w + u[2]) / w, (i / w + u[3]) / h);
+        }
         const int y = m.sample(u[0]);
         const int x = ds[y].sample(u[1]);
         return Vec2((x + u[2]) / w, (y + u[3]) / h);
@@ -463,6 +657,27 @@ static bool is_zero(VecT v) {
     return glm::all(glm::equal(v, VecT(0_f)));
 }
 
+/*!
+    \brief Lower bound of the ray distance robust to the rounding error of the origin.
+    \param o Origin of the ray.
+    \param tmin Requested lower bound of the valid range of the ray.
+    \return Lower bound of the valid range of the ray.
+
+    \rst
+    The position of a surface point computed in floating-point arithmetic
+    contains the rounding error proportional to the magnitude of the coordinates.
+    This function enlarges ``tmin`` to a conservative bound of the error,
+    so that the ray spawned from the surface point does not intersect the same surface again.
+    The bound is negligible in double precision. In single precision it exceeds :cpp:var:`lm::Eps`
+    for the points with coordinates larger than about a hundred.
+    \endrst
+*/
+static Float robust_tmin(Vec3 o, Float tmin) {
+    // Bound of a few ulps of the largest coordinate with a margin for the error of the intersection test
+    constexpr Float Scale = 64_f * std::numeric_limits<Float>::epsilon();
+    return std::max(tmin, glm::compMax(glm::abs(o)) * Scale);
+}
+
 /*!
     \brief Square root handling possible negative input due to the rounding error.
     \param v Value.
@@ -481,6 +696,15 @@ static Float sq(Float v) {
     return v * v;
 }
 
+/*!
+    \brief Compute luminance.
+    \param v Color in linear sRGB.
+    \return Luminance of the color.
+*/
+static Float luminance(Vec3 v) {
+    return glm::dot(v, Vec3(.2126_f, .7152_f, .0722_f));
+}
+
 /*!
     \brief Reflected direction.
     \param w Incident direction.
@@ -67,6 +67,44 @@ public:
         \return PHase function.
     */
     virtual const Phase* phase() const = 0;
+
+    //! Coefficients of homogeneous medium.
+    struct HomogeneousCoeffs {
+        Float density;  //!< Extinction coefficient.
+        Vec3 albedo;    //!< Albedo.
+    };
+
+    /*!
+        \brief Get coefficients of the medium if the medium is homogeneous.
+        \return Coefficients of the medium. nullopt if the medium is not homogeneous.
+
+        \rst
+        Inside the bound of a homogeneous medium, the transmittance and the probability density
+        of the distance sampled by :cpp:func:`lm::Medium::sample_distance` have analytic forms,
+        which the renderers can use to combine other distance sampling techniques.
+        The default implementation returns nullopt.
+        \endrst
+    */
+    virtual std::optional<HomogeneousCoeffs> homogeneous_coeffs() const {
+        return {};
+    }
+
+    /*!
+        \brief Get bound of the medium.
+        \return Bound of the medium in world space.
+
+        \rst
+        The scene uses the bound to find the media overlapping a ray
+        with :cpp:func:`lm::Scene::traverse_media`.
+        The default implementation returns the infinite bound.
+        \endrst
+    */
+    virtual Bound bound() const {
+        Bound b;
+        b.min = Vec3(-Inf);
+        b.max = Vec3(Inf);
+        return b;
+    }
 };
 
 /*!
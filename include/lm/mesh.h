@@ -7,6 +7,9 @@
 
 #include "component.h"
 #include "math.h"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -98,8 +101,122 @@ public:
         \brief Get number of triangles.
     */
     virtual int num_triangles() const = 0;
+
+    /*!
+        \brief Vertex position and index buffers of the mesh.
+
+        \rst
+        Represents the buffers of the mesh owned by the mesh,
+        used as a return type of :cpp:func:`lm::Mesh::buffer` function.
+        The position index of ``i``-th vertex of ``face`` is ``indices[(3*face+i)*index_stride]``.
+        \endrst
+    */
+    struct Buffer {
+        const Vec3* ps = nullptr;       //!< Vertex positions.
+        int num_positions = 0;          //!< Number of vertex positions.
+        const int* indices = nullptr;   //!< Position indices.
+        int index_stride = 1;           //!< Stride between the position indices in number of ints.
+    };
+
+    /*!
+        \brief Get vertex position and index buffers.
+        \return Buffers if the mesh holds indexed positions. nullopt otherwise.
+
+        \rst
+        The acceleration structures can use this function to refer to the shared vertex positions
+        instead of copying the vertices of each triangle via :cpp:func:`lm::Mesh::foreach_triangle`.
+        The buffers are valid while the mesh is alive.
+        \endrst
+    */
+    virtual std::optional<Buffer> buffer() const { return {}; }
+
+    /*!
+        \brief Callback function for processing a chunk of triangles.
+        \param face Face index of the first triangle in the chunk.
+        \param num_faces Number of triangles in the chunk.
+        \param ps Vertex positions of the triangles.
+                  ``ps[3*i+j]`` is the ``j``-th vertex of the triangle with face index ``face+i``.
+    */
+    using ProcessTrianglePositionsFunc = std::function<void(int face, int num_faces, const Vec3* ps)>;
+
+    /*!
+        \brief Iterate vertex positions of the triangles in chunks.
+        \param process_triangles Callback function to process a chunk of triangles.
+
+        \rst
+        This function enumerates the vertex positions of all triangles inside the mesh.
+        Unlike :cpp:func:`lm::Mesh::foreach_triangle`, the callback function is called
+        once for a chunk of consecutive triangles and only the positions are passed,
+        which is suitable for extracting the geometry of large meshes,
+        e.g., for building acceleration structures.
+        The default implementation gathers the positions from :cpp:func:`lm::Mesh::buffer` if available.
+        \endrst
+    */
+    virtual void foreach_triangle_positions(const ProcessTrianglePositionsFunc& process_triangles) const {
+        constexpr int ChunkSize = 1024;
+        std::vector<Vec3> ps;
+        ps.reserve(3 * ChunkSize);
+        if (const auto buf = buffer(); buf) {
+            const int n = num_triangles();
+            for (int s = 0; s < n; s += ChunkSize) {
+                const int e = std::min(n, s + ChunkSize);
+                ps.clear();
+                for (size_t i = 3 * size_t(s); i < 3 * size_t(e); i++) {
+                    ps.push_back(buf->ps[buf->indices[i * buf->index_stride]]);
+                }
+                process_triangles(s, e - s, ps.data());
+            }
+            return;
+        }
+        int s = 0;
+        foreach_triangle([&](int face, const Tri& tri) {
+            if (ps.empty()) {
+                s = face;
+            }
+            ps.insert(ps.end(), { tri.p1.p, tri.p2.p, tri.p3.p });
+            if (int(ps.size()) == 3 * ChunkSize) {
+                process_triangles(s, ChunkSize, ps.data());
+                ps.clear();
+            }
+        });
+        if (!ps.empty()) {
+            process_triangles(s, int(ps.size()) / 3, ps.data());
+        }
+    }
 };
 
+LM_NAMESPACE_BEGIN(mesh)
+
+/*!
+    \brief Compact the positions referenced by the faces of a mesh.
+    \param buf Buffers of the mesh.
+    \param num_triangles Number of triangles.
+    \param vertices Indices of the referenced positions in ``buf.ps``.
+    \param faces Triangles as indices to ``vertices``.
+
+    \rst
+    A buffer can contain positions not referenced by the mesh,
+    e.g., a mesh of ``model::wavefrontobj`` shares the positions of the model.
+    This function collects the positions used by the mesh
+    so that the acceleration structures can store only one copy per position.
+    \endrst
+*/
+static void compact_buffer(const Mesh::Buffer& buf, int num_triangles, std::vector<int>& vertices, std::vector<unsigned int>& faces) {
+    vertices.clear();
+    faces.resize(size_t(num_triangles) * 3);
+    std::unordered_map<int, unsigned int> remap;
+    for (size_t i = 0; i < faces.size(); i++) {
+        const int p = buf.indices[i * buf.index_stride];
+        auto [it, inserted] = remap.emplace(p, (unsigned int)(vertices.size()));
+        if (inserted) {
+            vertices.push_back(p);
+        }
+        faces[i] = it->second;
+    }
+}
+
+LM_NAMESPACE_END(mesh)
+
 /*!
     @}
 */
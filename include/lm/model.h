@@ -78,6 +78,22 @@ public:
 		\endrst
     */
     virtual void foreach_node(const VisitNodeFuncType& visit) const = 0;
+
+    /*!
+        \brief Check if the model shares meshes between instances.
+        \return True if the scene graph of the model contains instance groups.
+
+        \rst
+        The primitives enumerated by :cpp:func:`lm::Model::create_primitives` have no transformation,
+        so they cannot represent the meshes shared by multiple instances.
+        If this function returns true, :cpp:class:`lm::Scene` copies the scene graph
+        of the model with :cpp:func:`lm::Model::foreach_node` instead,
+        so that the shared meshes are handled by the instanced acceleration structure.
+        \endrst
+    */
+    virtual bool has_instances() const {
+        return false;
+    }
 };
 
 /*!
@@ -38,6 +38,10 @@ struct OBJMeshFaceIndex {
     int t = -1;         //!< Index of texture coordinates.
     int n = -1;         //!< Index of normal.
 
+    //! \cond
+    using BlobSerializable = void;
+    //! \endcond
+
     template <typename Archive>
     void serialize(Archive& ar) {
         ar(p, t, n);
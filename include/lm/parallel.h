@@ -7,6 +7,10 @@
 
 #include "common.h"
 #include "jsontype.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <exception>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 LM_NAMESPACE_BEGIN(parallel)
@@ -49,12 +53,318 @@ LM_PUBLIC_API void shutdown();
 */
 LM_PUBLIC_API int num_threads();
 
+/*!
+    \brief Set the thread budget of the parallel loops started from the current thread.
+    \param n Maximum number of threads. Zero or negative to use all threads.
+    \return Previous thread budget.
+
+    \rst
+    The budget is kept per calling thread, so that independent render jobs
+    running concurrently on different threads of the process can share the cores,
+    where each job runs its parallel loops with at most ``n`` threads.
+    The thread indices given to the loops are in ``0 ... n-1``,
+    so the buffers sized by :cpp:func:`lm::parallel::num_threads` are still valid.
+    Each job can be cancelled independently with :cpp:class:`lm::parallel::CancelToken`,
+    whereas :cpp:func:`lm::parallel::cancel` and the progress reports are process-wide
+    and thus shared by the concurrent jobs.
+    Use :cpp:class:`lm::parallel::ScopedThreadBudget` to set the budget for a scope.
+    \endrst
+*/
+LM_PUBLIC_API int set_thread_budget(int n);
+
+/*!
+    \brief Get the thread budget of the current thread.
+    \return Number of threads used by the parallel loops started from the current thread.
+*/
+LM_PUBLIC_API int thread_budget();
+
+/*!
+    \brief Scoped thread budget.
+
+    \rst
+    Sets the thread budget of the current thread by :cpp:func:`lm::parallel::set_thread_budget`
+    and restores the previous budget at the end of the scope.
+
+    .. code-block:: cpp
+
+        std::thread job([&]() {
+            parallel::ScopedThreadBudget budget(8);
+            renderer->render();
+        });
+    \endrst
+*/
+class ScopedThreadBudget {
+private:
+    int prev_;
+
+public:
+    ScopedThreadBudget(int n) : prev_(set_thread_budget(n)) {}
+    ~ScopedThreadBudget() { set_thread_budget(prev_); }
+    LM_DISABLE_COPY_AND_MOVE(ScopedThreadBudget)
+};
+
 /*!
     \brief Check if current thread is the main thread.
     \return `true` if the current thread is the main thread, `false` otherwise.
 */
 LM_PUBLIC_API bool main_thread();
 
+/*!
+    \brief Get number of NUMA nodes.
+    \return Number of NUMA nodes. 1 if the system is not NUMA.
+*/
+LM_PUBLIC_API int num_numa_nodes();
+
+/*!
+    \brief Pin current thread to a NUMA node.
+    \param threadid Thread index. The thread is pinned to the node ``threadid % num_numa_nodes()``.
+*/
+LM_PUBLIC_API void bind_to_numa_node(int threadid);
+
+/*!
+    \brief Interleave memory region across NUMA nodes.
+    \param p Pointer to the memory region.
+    \param size Size of the memory region in bytes.
+
+    \rst
+    The function distributes the pages of the region across the NUMA nodes
+    so that the threads pinned to different nodes share the memory bandwidth evenly.
+    The function is effective only when the ``numa`` option of the parallel context is enabled
+    and the system is NUMA. Otherwise the function does nothing.
+    Currently the function is only supported on Linux.
+    \endrst
+*/
+LM_PUBLIC_API void interleave_memory(void* p, size_t size);
+
+/*!
+    \brief Request cancellation of parallel loops.
+
+    \rst
+    The function requests cooperative cancellation of the running and subsequent
+    :cpp:func:`lm::parallel::foreach`. The parallel loops stop dispatching the remaining samples
+    and return after the samples being processed are finished.
+    The function is thread-safe and can be called from any thread, e.g., from the UI thread
+    of an interactive application. The request is kept until
+    :cpp:func:`lm::parallel::reset_cancel` is called.
+    \endrst
+*/
+LM_PUBLIC_API void cancel();
+
+/*!
+    \brief Check if cancellation is requested.
+    \return `true` if cancellation is requested.
+
+    \rst
+    The function also returns ``true`` if the cancel token of the current thread
+    set by :cpp:func:`lm::parallel::set_cancel_token` is cancelled,
+    so that the schedulers stop the job of the token.
+    \endrst
+*/
+LM_PUBLIC_API bool cancelled();
+
+/*!
+    \brief Check if cancellation is requested by :cpp:func:`lm::parallel::cancel`.
+    \return `true` if cancellation is requested.
+
+    \rst
+    Unlike :cpp:func:`lm::parallel::cancelled`, the function ignores the cancel token of the current thread.
+    The implementations of :cpp:class:`lm::parallel::ParallelContext` use this function
+    with the token given to the loop, since a thread might process the loops of the other jobs.
+    \endrst
+*/
+LM_PUBLIC_API bool cancel_requested();
+
+/*!
+    \brief Clear the cancellation request.
+
+    \rst
+    The request is cleared only by the caller of :cpp:func:`lm::parallel::cancel`.
+    The renderers and the schedulers do not clear the request,
+    so call this function before starting the next job.
+    \endrst
+*/
+LM_PUBLIC_API void reset_cancel();
+
+/*!
+    \brief Enable or disable the cancellation of the parallel loops started from the current thread.
+    \param enabled ``false`` to disable the cancellation.
+    \return Previous state.
+
+    \rst
+    The loops started while the cancellation is disabled process all the samples
+    regardless of :cpp:func:`lm::parallel::cancel` and the cancel tokens.
+    Use :cpp:class:`lm::parallel::ScopedDisableCancel` to disable the cancellation for a scope.
+    \endrst
+*/
+LM_PUBLIC_API bool set_cancel_enabled(bool enabled);
+
+/*!
+    \brief Check if the parallel loops started from the current thread can be cancelled.
+    \return ``false`` if the cancellation is disabled.
+*/
+LM_PUBLIC_API bool cancel_enabled();
+
+/*!
+    \brief Scoped disabling of the cancellation.
+
+    \rst
+    The parallel loops that must process all the samples even after a job is cancelled,
+    e.g., the normalization of the film by the processed samples, are run in this scope.
+    \endrst
+*/
+class ScopedDisableCancel {
+private:
+    bool prev_;
+
+public:
+    ScopedDisableCancel() : prev_(set_cancel_enabled(false)) {}
+    ~ScopedDisableCancel() { set_cancel_enabled(prev_); }
+    LM_DISABLE_COPY_AND_MOVE(ScopedDisableCancel)
+};
+
+/*!
+    \brief Token for the cooperative cancellation of a job.
+
+    \rst
+    Unlike :cpp:func:`lm::parallel::cancel`, a token cancels only the parallel loops
+    given the token, so that one of the concurrent jobs can be stopped independently.
+    The token is cancelled by :cpp:func:`lm::parallel::CancelToken::cancel` from any thread,
+    or when the deadline set by :cpp:func:`lm::parallel::CancelToken::set_deadline` is passed.
+    Once cancelled, the workers of the loops stop taking new samples
+    and the loops return as soon as the samples being processed are finished.
+    The token is given to :cpp:func:`lm::parallel::foreach` explicitly,
+    or set to the calling thread with :cpp:func:`lm::parallel::set_cancel_token`
+    to be used by all the loops started from the thread, e.g., inside :cpp:func:`lm::render`.
+    A token constructed with a parent token is also cancelled when the parent is cancelled,
+    so that a part of a job, e.g., a pass of a scheduler, can be stopped without stopping the job.
+    \endrst
+*/
+class CancelToken {
+private:
+    using Clock = std::chrono::steady_clock;
+    CancelToken* parent_ = nullptr;             // Parent token. nullptr if not set.
+    std::atomic<bool> cancelled_ = false;
+    std::atomic<Clock::rep> deadline_ = 0;      // Deadline in the ticks of Clock. 0 if not set.
+
+public:
+    CancelToken() = default;
+    LM_DISABLE_COPY_AND_MOVE(CancelToken)
+
+    /*!
+        \brief Construct a token cancelled with the parent token.
+        \param parent Parent token. The token must outlive this token. ``nullptr`` for no parent.
+    */
+    explicit CancelToken(CancelToken* parent) : parent_(parent) {}
+
+public:
+    //! Request cancellation.
+    void cancel() {
+        cancelled_ = true;
+    }
+
+    //! Clear the cancellation request and the deadline.
+    void reset() {
+        cancelled_ = false;
+        deadline_ = 0;
+    }
+
+    /*!
+        \brief Set the deadline.
+        \param seconds Time from now in seconds.
+    */
+    void set_deadline(double seconds) {
+        const auto d = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        const auto t = (Clock::now() + d).time_since_epoch().count();
+        deadline_ = t != 0 ? t : 1;
+    }
+
+    /*!
+        \brief Check if cancellation is requested.
+        \return `true` if the token is cancelled or the deadline is passed.
+
+        \rst
+        The function reads the clock only if the deadline is set.
+        \endrst
+    */
+    bool cancelled() {
+        if (cancelled_.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (parent_ && parent_->cancelled()) {
+            cancelled_ = true;
+            return true;
+        }
+        const auto d = deadline_.load(std::memory_order_relaxed);
+        if (d != 0 && Clock::now().time_since_epoch().count() >= d) {
+            cancelled_ = true;
+            return true;
+        }
+        return false;
+    }
+
+    /*!
+        \brief Check if cancellation is requested without checking the deadline.
+        \return `true` if the token is cancelled.
+
+        \rst
+        This function is cheap enough to be checked for every sample.
+        The loops check the deadline with :cpp:func:`lm::parallel::CancelToken::cancelled`
+        less frequently, e.g., for every chunk of the samples.
+        \endrst
+    */
+    bool cancel_requested() const {
+        return cancelled_.load(std::memory_order_relaxed) || (parent_ && parent_->cancel_requested());
+    }
+};
+
+/*!
+    \brief Set the cancel token of the current thread.
+    \param token Cancel token. Specify ``nullptr`` to unset the token.
+    \return Previous cancel token.
+
+    \rst
+    The parallel loops started from the current thread without an explicit token
+    use this token. The token must be alive while it is set.
+    Use :cpp:class:`lm::parallel::ScopedCancelToken` to set the token for a scope.
+    \endrst
+*/
+LM_PUBLIC_API CancelToken* set_cancel_token(CancelToken* token);
+
+/*!
+    \brief Get the cancel token of the current thread.
+    \return Cancel token. ``nullptr`` if not set.
+*/
+LM_PUBLIC_API CancelToken* cancel_token();
+
+/*!
+    \brief Scoped cancel token.
+
+    \rst
+    Sets the cancel token of the current thread by :cpp:func:`lm::parallel::set_cancel_token`
+    and restores the previous token at the end of the scope.
+
+    .. code-block:: cpp
+
+        parallel::CancelToken token;
+        std::thread job([&]() {
+            parallel::ScopedCancelToken scope(&token);
+            renderer->render();
+        });
+        ...
+        token.cancel();
+        job.join();
+    \endrst
+*/
+class ScopedCancelToken {
+private:
+    CancelToken* prev_;
+
+public:
+    ScopedCancelToken(CancelToken* token) : prev_(set_cancel_token(token)) {}
+    ~ScopedCancelToken() { set_cancel_token(prev_); }
+    LM_DISABLE_COPY_AND_MOVE(ScopedCancelToken)
+};
+
 /*!
     \brief Callback function for parallel process.
     \param index Index of iteration.
@@ -73,12 +383,29 @@ using ProgressUpdateFunc = std::function<void(long long processed)>;
     \param num_samples Total number of samples.
     \param process_func Callback function called for each iteration.
     \param progress_func Callback function called for each progress update.
+    \param token Cancel token. If ``nullptr``, the loop is cancelled only by :cpp:func:`lm::parallel::cancel`.
 
     \rst
     We provide an abstraction for the parallel loop specifialized for rendering purpose.
+    The loop stops taking new samples when :cpp:func:`lm::parallel::cancel` is called,
+    when ``token`` is cancelled, or when one of the iterations throws an exception.
     \endrst
 */
-LM_PUBLIC_API void foreach(long long num_samples, const ParallelProcessFunc& process_func, const ProgressUpdateFunc& progress_func);
+LM_PUBLIC_API void foreach(long long num_samples, const ParallelProcessFunc& process_func, const ProgressUpdateFunc& progress_func, CancelToken* token);
+
+/*!
+    \brief Parallel for loop.
+    \param num_samples Total number of samples.
+    \param process_func Callback function called for each iteration.
+    \param progress_func Callback function called for each progress update.
+
+    \rst
+    The loop uses the cancel token of the current thread (see :cpp:func:`lm::parallel::set_cancel_token`).
+    \endrst
+*/
+LM_INLINE void foreach(long long num_samples, const ParallelProcessFunc& process_func, const ProgressUpdateFunc& progress_func) {
+    foreach(num_samples, process_func, progress_func, cancel_token());
+}
 
 /*!
     \brief Parallel for loop.
@@ -89,6 +416,124 @@ LM_INLINE void foreach(long long num_samples, const ParallelProcessFunc& process
     foreach(num_samples, process_func, [](long long) {});
 }
 
+
+// ------------------------------------------------------------------------------------------------
+
+/*!
+    \brief Callback function for a task.
+*/
+using TaskFunc = std::function<void()>;
+
+/*!
+    \brief Callback function to run a worker of the task pool on an external executor.
+    \param worker Function to be executed on a thread owned by the executor.
+*/
+using ExecutorFunc = std::function<void(const TaskFunc& worker)>;
+
+/*!
+    \brief Set external executor for the workers of the task pool.
+    \param executor Executor function. Specify ``nullptr`` to use the internal threads.
+
+    \rst
+    By default the task pool creates ``num_threads()-1`` background threads.
+    If the host application already owns a thread pool, the application can supply
+    the workers by this function to avoid conflicting worker teams.
+    When the task pool starts, ``executor`` is called once for each worker
+    with a function that must be run on a thread of the executor.
+    The function processes the tasks until the task pool is stopped
+    by :cpp:func:`lm::parallel::shutdown` or the next call of this function,
+    so the executor must be able to run ``num_threads()-1`` long-running jobs concurrently.
+    \endrst
+*/
+LM_PUBLIC_API void set_executor(const ExecutorFunc& executor);
+
+/*!
+    \brief Group of tasks for recursive task parallelism.
+
+    \rst
+    A task group tracks tasks spawned by :cpp:func:`lm::parallel::TaskGroup::run`
+    into the work-stealing task pool of the parallel subsystem.
+    Unlike :cpp:func:`lm::parallel::foreach`, a task can spawn further tasks,
+    which makes the group suitable for divide-and-conquer algorithms
+    like the construction of acceleration structures.
+    Each worker thread owns a double-ended queue where spawned tasks are pushed,
+    and idle workers steal tasks from the other queues.
+    :cpp:func:`lm::parallel::TaskGroup::wait` blocks until all the tasks in the group
+    are finished, while the waiting thread also processes pending tasks.
+    If a task throws an exception, the exception is rethrown by ``wait()``.
+
+    .. code-block:: cpp
+
+        parallel::TaskGroup g;
+        std::function<void(int, int)> f = [&](int s, int e) {
+            if (e - s < 2) { ...; return; }
+            const int m = (s + e) / 2;
+            g.run([&, s, m]() { f(s, m); });
+            f(m, e);
+        };
+        g.run([&]() { f(0, n); });
+        g.wait();
+    \endrst
+*/
+class TaskGroup {
+private:
+    std::atomic<long long> pending_ = 0;    // Number of unfinished tasks
+    std::exception_ptr exp_;                // Captured exception
+    std::mutex exp_lock_;                   // Lock for exp_
+
+    friend struct TaskGroupAccess;
+
+public:
+    TaskGroup() = default;
+    ~TaskGroup() {
+        // Tasks must not outlive the group
+        try { wait(); } catch (...) {}
+    }
+    LM_DISABLE_COPY_AND_MOVE(TaskGroup)
+
+public:
+    /*!
+        \brief Spawn a task into the group.
+        \param func Task function.
+    */
+    void run(const TaskFunc& func);
+
+    /*!
+        \brief Wait for all tasks in the group.
+    */
+    void wait();
+};
+
+//! \cond
+struct TaskGroupAccess {
+    static std::atomic<long long>& pending(TaskGroup& g) { return g.pending_; }
+    static void capture(TaskGroup& g, std::exception_ptr exp) {
+        std::unique_lock<std::mutex> lock(g.exp_lock_);
+        g.exp_ = exp;
+    }
+    static std::exception_ptr take(TaskGroup& g) {
+        std::unique_lock<std::mutex> lock(g.exp_lock_);
+        auto exp = g.exp_;
+        g.exp_ = nullptr;
+        return exp;
+    }
+};
+
+LM_PUBLIC_API void spawn_task(TaskGroup& group, const TaskFunc& func);
+LM_PUBLIC_API void wait_tasks(TaskGroup& group);
+//! \endcond
+
+inline void TaskGroup::run(const TaskFunc& func) {
+    spawn_task(*this, func);
+}
+
+inline void TaskGroup::wait() {
+    wait_tasks(*this);
+    if (auto exp = TaskGroupAccess::take(*this); exp) {
+        std::rethrow_exception(exp);
+    }
+}
+
 /*!
     @}
 */
@@ -29,7 +29,28 @@ class ParallelContext : public Component {
 public:
     virtual int num_threads() const = 0;
     virtual bool main_thread() const = 0;
-    virtual void foreach(long long numSamples, const ParallelProcessFunc& processFunc, const ProgressUpdateFunc& progressFunc) const = 0;
+
+    /*!
+        \brief Parallel for loop.
+
+        \rst
+        The implementation must stop taking new samples promptly
+        when :cpp:func:`lm::parallel::cancel_requested` returns ``true``,
+        when ``token`` is cancelled if it is not ``nullptr``, or when an iteration throws.
+        The cancel token of the calling thread is given as ``token`` by :cpp:func:`lm::parallel::foreach`,
+        so the implementation must not check the token of the thread processing the samples.
+        If :cpp:func:`lm::parallel::cancel_enabled` returns ``false`` for the calling thread,
+        the implementation must process all the samples.
+        The implementation should process the samples with at most
+        :cpp:func:`lm::parallel::thread_budget` threads of the calling thread.
+        \endrst
+    */
+    virtual void foreach(long long numSamples, const ParallelProcessFunc& processFunc, const ProgressUpdateFunc& progressFunc, CancelToken* token) const = 0;
+
+    /*!
+        \brief Check if NUMA-aware thread pinning and memory placement is enabled.
+    */
+    virtual bool numa() const { return false; }
 };
 
 /*!
@@ -11,6 +11,7 @@
 #include "material.h"
 #include "medium.h"
 #include "phase.h"
+#include "film.h"
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 LM_NAMESPACE_BEGIN(path)
@@ -28,6 +29,7 @@ struct RaySample {
     Vec3 wo;                //!< Sampled direction.
     Vec3 weight;            //!< Contribution divided by probability.
     bool specular;          //!< Sampled from specular distribution.
+    Float pdf = 0_f;        //!< PDF of the sampled ray if available. Zero otherwise.
 
     /*!
         \brief Get a ray from the sample.
@@ -58,6 +60,24 @@ static Ray primary_ray(const Scene* scene, Vec2 rp) {
     return camera->primary_ray(rp);
 }
 
+/*!
+    \brief Generate primary rays for a batch of raster positions.
+    \param scene Scene.
+    \param n Number of rays.
+    \param rps Raster positions in [0,1]^2.
+    \param ups Random numbers for the positions on the aperture. nullptr for the center of the aperture.
+    \param rays Generated primary rays.
+
+    \rst
+    This function is the batched version of :cpp:func:`lm::path::primary_ray`.
+    See :cpp:func:`lm::Camera::primary_rays` for detail.
+    \endrst
+*/
+static void primary_rays(const Scene* scene, int n, const Vec2* rps, const Vec2* ups, Ray* rays) {
+    const auto* camera = scene->node_at(scene->camera_node()).primitive.camera;
+    camera->primary_rays(n, rps, ups, rays);
+}
+
 //! Random number input for ray sampling.
 struct RaySampleU {
     Vec2 up;    // For position
@@ -85,7 +105,7 @@ struct RaySampleU {
 static std::optional<RaySample> sample_primary_ray(const RaySampleU& u, const Scene* scene, TransDir trans_dir) {
     if (trans_dir == TransDir::EL) {
         const auto* camera = scene->node_at(scene->camera_node()).primitive.camera;
-        const auto s = camera->sample_ray({u.ud});
+        const auto s = camera->sample_ray({u.ud, u.up});
         if (!s) {
             return {};
         }
@@ -376,6 +396,7 @@ struct DirectionSampleU {
     \endrst
 */
 static std::optional<DirectionSample> sample_direction(const DirectionSampleU& u, const Scene* scene, const SceneInteraction& sp, Vec3 wi, int comp, TransDir trans_dir) {
+    LM_PROFILE_SCOPE(SampleDirection);
     const auto& primitive = scene->node_at(sp.primitive).primitive;
     if (sp.is_type(SceneInteraction::CameraEndpoint)) {
         const auto s = primitive.camera->sample_direction({ u.ud }, sp.geom);
@@ -439,6 +460,39 @@ static std::optional<DirectionSample> sample_direction(Rng& rng, const Scene* sc
     return sample_direction(rng.next<DirectionSampleU>(), scene, sp, wi, comp, trans_dir);
 }
 
+/*!
+    \brief Direction sampling for a wavelength.
+    \param u Random number input.
+    \param scene Scene.
+    \param sp Scene interaction.
+    \param wi Incident direction.
+    \param comp Component index.
+    \param trans_dir Transport direction.
+    \param lambda Wavelength in nm.
+
+    \rst
+    Spectral version of :cpp:func:`lm::path::sample_direction`.
+    The wavelength is only used by the surface interactions
+    via :cpp:func:`lm::Material::sample_direction_spectral`.
+    \endrst
+*/
+static std::optional<DirectionSample> sample_direction_spectral(const DirectionSampleU& u, const Scene* scene, const SceneInteraction& sp, Vec3 wi, int comp, TransDir trans_dir, Float lambda) {
+    if (!sp.is_type(SceneInteraction::SurfaceInteraction)) {
+        return sample_direction(u, scene, sp, wi, comp, trans_dir);
+    }
+    LM_PROFILE_SCOPE(SampleDirection);
+    const auto& primitive = scene->node_at(sp.primitive).primitive;
+    const auto s = primitive.material->sample_direction_spectral({u.ud,u.udc}, sp.geom, wi, comp, static_cast<Material::TransDir>(trans_dir), lambda);
+    if (!s) {
+        return {};
+    }
+    const auto sn_corr = surface::shading_normal_correction(sp.geom, wi, s->wo, trans_dir);
+    return DirectionSample{
+        s->wo,
+        s->weight * sn_corr
+    };
+}
+
 /*!
     \brief Evaluate pdf for direction sampling.
     \param scene Scene.
@@ -493,7 +547,7 @@ static Float pdf_direction(const Scene* scene, const SceneInteraction& sp, Vec3
 static std::optional<RaySample> sample_direct(const RaySampleU& u, const Scene* scene, const SceneInteraction& sp, TransDir trans_dir) {
     if (trans_dir == TransDir::EL) {
         const auto& primitive = scene->node_at(scene->camera_node()).primitive;
-        const auto s = primitive.camera->sample_direct({u.ud}, sp.geom);
+        const auto s = primitive.camera->sample_direct({u.ud, u.up}, sp.geom);
         if (!s) {
             return {};
         }
@@ -508,7 +562,7 @@ static std::optional<RaySample> sample_direct(const RaySampleU& u, const Scene*
     }
     else if (trans_dir == TransDir::LE) {
         // Sample a light
-        const auto [light_index, p_sel] = scene->sample_light_selection(u.upc[0]);
+        const auto [light_index, p_sel] = scene->sample_light_selection(sp.geom, u.upc[0]);
 
         // Sample a position on the light
         const auto light_primitive_index = scene->light_primitive_index_at(light_index);
@@ -523,7 +577,9 @@ static std::optional<RaySample> sample_direct(const RaySampleU& u, const Scene*
                 s->geom
             ),
             s->wo,
-            s->weight / p_sel
+            s->weight / p_sel,
+            false,
+            s->pdf * p_sel
         };
     }
     LM_UNREACHABLE_RETURN();
@@ -573,7 +629,7 @@ static Float pdf_direct(const Scene* scene, const SceneInteraction& sp, const Sc
     else if (sp_endpoint.is_type(SceneInteraction::LightEndpoint)) {
         const int light_index = scene->light_index_at(sp_endpoint.primitive);
         const auto light_primitive_index = scene->light_primitive_index_at(light_index);
-        const auto pL_sel = scene->pdf_light_selection(light_index);
+        const auto pL_sel = scene->pdf_light_selection(sp.geom, light_index);
         const auto pL_pos = primitive.light->pdf_direct(
             sp.geom, sp_endpoint.geom, light_primitive_index.global_transform, wo, eval_delta);
         return pL_sel * pL_pos;
@@ -592,6 +648,7 @@ static Float pdf_direct(const Scene* scene, const SceneInteraction& sp, const Sc
 struct DistanceSample {
     SceneInteraction sp;    //!< Sampled interaction point.
     Vec3 weight;            //!< Contribution divided by probability.
+    Float dist = Inf;       //!< Distance to the next surface along the ray.
 };
 
 /*!
@@ -608,21 +665,51 @@ struct DistanceSample {
     \endrst
 */
 static std::optional<DistanceSample> sample_distance(Rng& rng, const Scene* scene, const SceneInteraction& sp, Vec3 wo) {
-    // Intersection to next surface
-    const auto hit = scene->intersect({ sp.geom.p, wo }, Eps, Inf);
-    const auto dist = hit && !hit->geom.infinite ? glm::length(hit->geom.p - sp.geom.p) : Inf;
-
-    // Sample a distance
-    const auto* medium = scene->node_at(scene->medium_node()).primitive.medium;
-    const auto ds = medium->sample_distance(rng, { sp.geom.p, wo }, 0_f, dist);
-    if (ds && ds->medium) {
+    // Intersection to next surface.
+    // The surface geometry is computed only if the surface interaction is sampled.
+    const auto hit = scene->intersect_hit({ sp.geom.p, wo }, Eps, Inf);
+    const auto dist = hit && !hit->infinite() ? hit->t : Inf;
+
+    // Sample a distance in each medium overlapping the ray segment.
+    // The closest scattering event among the media is the scattering event
+    // of the superposition of the media. Since the media are visited in the order of
+    // the distances to their bounds, we can skip the media beyond the closest event.
+    const Ray ray{ sp.geom.p, wo };
+    std::optional<Medium::DistanceSample> ds;
+    int medium_index = -1;
+    Float t_scatter = dist;
+    Vec3 weight(1_f);
+    {
+        LM_PROFILE_SCOPE(SampleDistance);
+        scene->traverse_media(ray, 0_f, dist, [&](int index, Float t0, Float t1) -> bool {
+            if (t0 >= t_scatter) {
+                return false;
+            }
+            const auto* medium = scene->node_at(index).primitive.medium;
+            const auto s = medium->sample_distance(rng, ray, t0, std::min(t1, t_scatter));
+            if (!s) {
+                return true;
+            }
+            if (s->medium) {
+                ds = s;
+                medium_index = index;
+                t_scatter = glm::dot(s->p - ray.o, ray.d);
+            }
+            else {
+                weight *= s->weight;
+            }
+            return true;
+        });
+    }
+    if (ds) {
         // Medium interaction
         return DistanceSample{
             SceneInteraction::make_medium_interaction(
-                scene->medium_node(),
+                medium_index,
                 PointGeometry::make_degenerated(ds->p)
             ),
-            ds->weight
+            ds->weight,
+            dist
         };
     }
     else {
@@ -631,8 +718,9 @@ static std::optional<DistanceSample> sample_distance(Rng& rng, const Scene* scen
             return {};
         }
         return DistanceSample{
-            *hit,
-            ds ? ds->weight : Vec3(1_f)
+            scene->interaction(ray, *hit),
+            weight,
+            dist
         };
     }
 }
@@ -656,8 +744,7 @@ static Vec3 eval_transmittance(Rng& rng, const Scene* scene, const SceneInteract
     if (!scene->visible(sp1, sp2)) {
         return Vec3(0_f);
     }
-    const int medium_index = scene->medium_node();
-    if (medium_index == -1) {
+    if (scene->medium_node() == -1) {
         return Vec3(1_f);
     }
         
@@ -670,8 +757,15 @@ static Vec3 eval_transmittance(Rng& rng, const Scene* scene, const SceneInteract
         ? glm::normalize(sp2.geom.p - sp1.geom.p)
         : -sp2.geom.wo;
 
-    const auto* medium = scene->node_at(medium_index).primitive.medium;
-    return medium->eval_transmittance(rng, { sp1.geom.p, wo }, 0_f, dist);
+    // Product of the transmittances of the media overlapping the segment
+    const Ray ray{ sp1.geom.p, wo };
+    Vec3 Tr(1_f);
+    scene->traverse_media(ray, 0_f, dist, [&](int index, Float t0, Float t1) -> bool {
+        const auto* medium = scene->node_at(index).primitive.medium;
+        Tr *= medium->eval_transmittance(rng, ray, t0, t1);
+        return !math::is_zero(Tr);
+    });
+    return Tr;
 }
 
 #pragma endregion
@@ -703,6 +797,24 @@ static bool is_specular_component(const Scene* scene, const SceneInteraction& sp
     return false;
 }
 
+/*!
+    \brief Check if the scene intersection is dispersive.
+    \param scene Scene.
+    \param sp Scene interaction.
+    \param comp Component index.
+
+    \rst
+    This function checks if the direction sampled at the interaction depends on the wavelength.
+    See :cpp:func:`lm::Material::is_dispersive_component`.
+    \endrst
+*/
+static bool is_dispersive_component(const Scene* scene, const SceneInteraction& sp, int comp) {
+    if (!sp.is_type(SceneInteraction::SurfaceInteraction)) {
+        return false;
+    }
+    return scene->node_at(sp.primitive).primitive.material->is_dispersive_component(comp);
+}
+
 /*!
     \brief Check if the endpoint is connectable.
     \param scene Scene.
@@ -735,6 +847,41 @@ static std::optional<Vec2> raster_position(const Scene* scene, Vec3 wo) {
     return camera->raster_position(wo);
 }
 
+/*!
+    \brief Compute a raster position of a ray from a point on the camera.
+    \param scene Scene.
+    \param geom Point geometry on the camera.
+    \param wo Primary ray direction.
+    \return Raster position.
+
+    \rst
+    Use this version when the origin of the primary ray is known,
+    for instance to support cameras with a finite aperture.
+    \endrst
+*/
+static std::optional<Vec2> raster_position(const Scene* scene, const PointGeometry& geom, Vec3 wo) {
+    const auto* camera = scene->node_at(scene->camera_node()).primitive.camera;
+    return camera->raster_position_from(geom, wo);
+}
+
+/*!
+    \brief Compute the ray cone of a primary ray.
+    \param scene Scene.
+    \param rp Raster position.
+    \param pixel_size Size of a pixel in raster coordinates.
+    \return Ray cone of the primary ray.
+
+    \rst
+    The cone is used to compute the footprint of the ray with :cpp:func:`lm::Scene::intersect_cone`.
+    The cone of the subsequent rays can be obtained with :cpp:func:`lm::RayCone::propagate`
+    by the distance to each vertex.
+    \endrst
+*/
+static RayCone primary_ray_cone(const Scene* scene, Vec2 rp, Vec2 pixel_size) {
+    const auto* camera = scene->node_at(scene->camera_node()).primitive.camera;
+    return camera->primary_ray_cone(rp, pixel_size);
+}
+
 /*!
     \brief Evaluate directional components.
     \param scene Scene.
@@ -774,6 +921,46 @@ static Vec3 eval_contrb_direction(const Scene* scene, const SceneInteraction& sp
     LM_UNREACHABLE_RETURN();
 }
 
+//! Result of the evaluation of directional components with PDF.
+struct DirectionEval {
+    Vec3 contrb;    //!< Evaluated contribution.
+    Float pdf;      //!< PDF in projected solid angle measure.
+};
+
+/*!
+    \brief Evaluate directional components and pdf.
+    \param scene Scene.
+    \param sp Scene interaction.
+    \param wi Incident ray direction.
+    \param wo Outgoing ray direction.
+    \param comp Component index.
+    \param trans_dir Transport direction.
+    \param eval_delta If true, evaluate delta function.
+    \return Evaluated contribution and pdf.
+
+    \rst
+    The function evaluates :cpp:func:`lm::path::eval_contrb_direction` and
+    :cpp:func:`lm::path::pdf_direction` at once.
+    For surface interactions, the function uses :cpp:func:`lm::Material::eval_with_pdf`
+    so that the materials can share the computation of both values.
+    This is useful when both values are necessary, e.g., to compute MIS weights.
+    \endrst
+*/
+static DirectionEval eval_contrb_pdf_direction(const Scene* scene, const SceneInteraction& sp, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) {
+    if (sp.is_type(SceneInteraction::SurfaceInteraction)) {
+        const auto* material = scene->node_at(sp.primitive).primitive.material;
+        const auto r = material->eval_with_pdf(sp.geom, wi, wo, comp, (Material::TransDir)(trans_dir), eval_delta);
+        return {
+            r.f * surface::shading_normal_correction(sp.geom, wi, wo, trans_dir),
+            r.pdf
+        };
+    }
+    return {
+        eval_contrb_direction(scene, sp, wi, wo, comp, trans_dir, eval_delta),
+        pdf_direction(scene, sp, wi, wo, comp, eval_delta)
+    };
+}
+
 /*!
     \brief Evaluate reflectance (if available).
     \param scene Scene.
@@ -793,6 +980,39 @@ static std::optional<Vec3> reflectance(const Scene* scene, const SceneInteractio
     return primitive.material->reflectance(sp.geom);
 }
 
+/*!
+    \brief Splat AOVs of a primary ray.
+    \param scene Scene.
+    \param film Film.
+    \param raster_pos Raster position of the primary ray.
+    \param p Origin of the primary ray.
+    \param hit Scene interaction found by the primary ray. nullptr if the ray escapes the scene.
+
+    \rst
+    Renderers call this function once per sample with the interaction
+    they already found by the primary ray, so that no additional ray is cast for the AOVs.
+    The albedo and the normal are recorded only for surface interactions.
+    The sample is counted even if the ray escapes the scene.
+    \endrst
+*/
+static void splat_aovs(const Scene* scene, Film* film, Vec2 raster_pos, Vec3 p, const SceneInteraction* hit) {
+    const auto rp = film->raster_to_pixel(raster_pos);
+    film->splat_aov(rp.x, rp.y, FilmAOV::SampleCount, Vec3(1_f));
+    if (!hit || hit->geom.infinite) {
+        return;
+    }
+    film->splat_aov(rp.x, rp.y, FilmAOV::Depth, Vec3(glm::distance(p, hit->geom.p)));
+    if (!hit->is_type(SceneInteraction::SurfaceInteraction)) {
+        return;
+    }
+    film->splat_aov(rp.x, rp.y, FilmAOV::Normal, hit->geom.n);
+    if (film->has_aov(FilmAOV::Albedo)) {
+        if (const auto R = reflectance(scene, *hit); R) {
+            film->splat_aov(rp.x, rp.y, FilmAOV::Albedo, *R);
+        }
+    }
+}
+
 #pragma endregion
 
 /*!
@@ -57,8 +57,94 @@ public:
         \return Evaluated value.
     */
     virtual Vec3 eval(const PointGeometry& geom, Vec3 wi, Vec3 wo) const = 0;
+
+    /*!
+        \brief Direction sampling for multiple points.
+        \param n Number of points.
+        \param u Array of random number inputs of size ``n``.
+        \param geom Array of point geometries of size ``n``.
+        \param wi Array of incident ray directions of size ``n``.
+        \param out Output array of sampled directions of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Phase::sample_direction`.
+        The default implementation calls :cpp:func:`lm::Phase::sample_direction` for each point.
+        Implementations can use :c:macro:`LM_PHASE_BATCH_IMPL` to define the batched functions
+        without the virtual dispatch per point.
+        \endrst
+    */
+    virtual void sample_direction_n(int n, const DirectionSampleU* u, const PointGeometry* geom, const Vec3* wi, std::optional<DirectionSample>* out) const {
+        for (int i = 0; i < n; i++) {
+            out[i] = sample_direction(u[i], geom[i], wi[i]);
+        }
+    }
+
+    /*!
+        \brief Evaluate pdf in solid angle measure for multiple points.
+        \param n Number of points.
+        \param geom Array of point geometries of size ``n``.
+        \param wi Array of incident ray directions of size ``n``.
+        \param wo Array of outgoing ray directions of size ``n``.
+        \param out Output array of evaluated pdfs of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Phase::pdf_direction`.
+        The default implementation calls :cpp:func:`lm::Phase::pdf_direction` for each point.
+        \endrst
+    */
+    virtual void pdf_direction_n(int n, const PointGeometry* geom, const Vec3* wi, const Vec3* wo, Float* out) const {
+        for (int i = 0; i < n; i++) {
+            out[i] = pdf_direction(geom[i], wi[i], wo[i]);
+        }
+    }
+
+    /*!
+        \brief Evaluate the phase function for multiple points.
+        \param n Number of points.
+        \param geom Array of point geometries of size ``n``.
+        \param wi Array of incident ray directions of size ``n``.
+        \param wo Array of outgoing ray directions of size ``n``.
+        \param out Output array of evaluated values of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Phase::eval`.
+        The default implementation calls :cpp:func:`lm::Phase::eval` for each point.
+        \endrst
+    */
+    virtual void eval_n(int n, const PointGeometry* geom, const Vec3* wi, const Vec3* wo, Vec3* out) const {
+        for (int i = 0; i < n; i++) {
+            out[i] = eval(geom[i], wi[i], wo[i]);
+        }
+    }
 };
 
+/*!
+    \brief Implement batched functions of the phase function.
+
+    \rst
+    Put this macro in the definition of a ``final`` phase function class to override
+    the batched functions, e.g., :cpp:func:`lm::Phase::eval_n`.
+    Since the class is final, the calls to the single-point functions in the loops
+    are resolved statically and can be inlined and vectorized.
+    \endrst
+*/
+#define LM_PHASE_BATCH_IMPL() \
+    virtual void sample_direction_n(int n, const DirectionSampleU* u, const PointGeometry* geom, const Vec3* wi, std::optional<DirectionSample>* out) const override { \
+        for (int i = 0; i < n; i++) { \
+            out[i] = sample_direction(u[i], geom[i], wi[i]); \
+        } \
+    } \
+    virtual void pdf_direction_n(int n, const PointGeometry* geom, const Vec3* wi, const Vec3* wo, Float* out) const override { \
+        for (int i = 0; i < n; i++) { \
+            out[i] = pdf_direction(geom[i], wi[i], wo[i]); \
+        } \
+    } \
+    virtual void eval_n(int n, const PointGeometry* geom, const Vec3* wi, const Vec3* wo, Vec3* out) const override { \
+        for (int i = 0; i < n; i++) { \
+            out[i] = eval(geom[i], wi[i], wo[i]); \
+        } \
+    }
+
 /*!
     @}
 */
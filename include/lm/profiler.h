@@ -0,0 +1,142 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include "component.h"
+#include <chrono>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+LM_NAMESPACE_BEGIN(profiler)
+
+/*!
+    \addtogroup profiler
+    @{
+*/
+
+/*!
+    \brief Instrumented stages.
+
+    \rst
+    Each stage holds the number of calls and the accumulated elapsed time.
+    \endrst
+*/
+enum class Stage {
+    Intersect,          //!< Ray-scene intersection.
+    Visible,            //!< Visibility check between two points.
+    AccelBuild,         //!< Build of the acceleration structure.
+    SampleDistance,     //!< Distance sampling in participating media.
+    SampleDirection,    //!< Direction sampling at scene interactions.
+    Splat,              //!< Splat to the film.
+    LogWait,            //!< Wait for the lock of the logger.
+    ParallelWait,       //!< Wait of the threads for the end of the parallel loop.
+    Count,
+};
+
+/*!
+    \brief Record a call of the stage.
+    \param stage Stage.
+    \param elapsed Elapsed time in nanoseconds.
+    \param count Number of processed queries.
+
+    \rst
+    The statistics are recorded to the thread-local storage without synchronization
+    and aggregated in :cpp:func:`lm::profiler::stats`.
+    \endrst
+*/
+LM_PUBLIC_API void add(Stage stage, long long elapsed, long long count = 1);
+
+/*!
+    \brief Reset the recorded statistics.
+*/
+LM_PUBLIC_API void reset();
+
+/*!
+    \brief Get the aggregated statistics.
+
+    \rst
+    This function returns a Json object keyed by the name of the stage.
+    Each entry contains the number of calls (``count``)
+    and the accumulated time summed over the threads in seconds (``time``).
+    Stages without any calls are omitted.
+    The statistics are accumulated from the start of the process
+    or the last call of :cpp:func:`lm::profiler::reset`,
+    so the build of the scene is included in the result of the following render.
+    \endrst
+*/
+LM_PUBLIC_API Json stats();
+
+/*!
+    \brief Attach the aggregated statistics to the result of a renderer.
+    \param result Result of the renderer.
+
+    \rst
+    The statistics are stored in ``profile`` entry.
+    If the profiler is disabled, the function returns the result as it is.
+    \endrst
+*/
+static Json attach_stats(Json result) {
+    #if LM_PROFILER
+    result["profile"] = stats();
+    #endif
+    return result;
+}
+
+/*!
+    \brief Scoped timer of a stage.
+
+    \rst
+    This class records the elapsed time from the construction to the destruction.
+    Use via ``LM_PROFILE_SCOPE`` macro so that the instrumentation is compiled out
+    when the profiler is disabled.
+    \endrst
+*/
+class ScopedTimer {
+private:
+    Stage stage_;
+    long long count_;
+    std::chrono::steady_clock::time_point start_;
+
+public:
+    ScopedTimer(Stage stage, long long count = 1)
+        : stage_(stage)
+        , count_(count)
+        , start_(std::chrono::steady_clock::now())
+    {}
+
+    ~ScopedTimer() {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+        add(stage_, elapsed, count_);
+    }
+
+    LM_DISABLE_COPY_AND_MOVE(ScopedTimer)
+};
+
+/*!
+    @}
+*/
+
+LM_NAMESPACE_END(profiler)
+LM_NAMESPACE_END(LM_NAMESPACE)
+
+/*!
+    \brief Time the current scope as the stage.
+    \param ... Stage name in lm::profiler::Stage, optionally followed by the number of queries.
+    \ingroup profiler
+*/
+#if LM_PROFILER
+#if LM_COMPILER_MSVC
+#define LM_PROFILE_SCOPE(stage, ...) \
+    LM_NAMESPACE::profiler::ScopedTimer LM_TOKENPASTE2(profiler_scoped_timer_, __LINE__)( \
+        LM_NAMESPACE::profiler::Stage::stage, __VA_ARGS__)
+#else
+#define LM_PROFILE_SCOPE(stage, ...) \
+    LM_NAMESPACE::profiler::ScopedTimer LM_TOKENPASTE2(profiler_scoped_timer_, __LINE__)( \
+        LM_NAMESPACE::profiler::Stage::stage, ## __VA_ARGS__)
+#endif
+#else
+#define LM_PROFILE_SCOPE(stage, ...)
+#endif
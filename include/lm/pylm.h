@@ -45,6 +45,21 @@ public:
         else if (isinstance<str>(src)) {
             value = src.cast<std::string>();
         }
+        else if (hasattr(src, "__lm_buffer__")) {
+            // Binary buffer created by lm.buffer(), see lm::json::is_buffer().
+            // The data is copied so that the property owns the buffer.
+            auto a = reinterpret_borrow<array>(src.attr("array"));
+            const auto* p = static_cast<const std::uint8_t*>(a.data());
+            auto shape = lm::Json(value_t::array);
+            for (ssize_t i = 0; i < a.ndim(); i++) {
+                shape.push_back(a.shape(i));
+            }
+            value = {
+                {"buffer", lm::Json::binary(std::vector<std::uint8_t>(p, p + a.nbytes()))},
+                {"dtype", a.dtype().attr("name").cast<std::string>()},
+                {"shape", shape}
+            };
+        }
         else if (isinstance<dict>(src)) {
             auto d = reinterpret_borrow<dict>(src);
             value = lm::Json(value_t::object);
@@ -59,6 +74,24 @@ public:
                     cast_op<lm::Json&&>(std::move(vconv)));
             }
         }
+        else if (isinstance<array>(src)) {
+            // Convert numpy array directly from the underlying buffer
+            // without creating Python objects for the elements
+            auto a = reinterpret_borrow<array>(src);
+            const auto kind = a.dtype().kind();
+            if (kind == 'f') {
+                value = from_ndarray<double>(a);
+            }
+            else if (kind == 'i' || kind == 'u') {
+                value = from_ndarray<long long>(a);
+            }
+            else if (kind == 'b') {
+                value = from_ndarray<bool>(a);
+            }
+            else {
+                return false;
+            }
+        }
         else if (isinstance<sequence>(src)) {
             auto s = reinterpret_borrow<sequence>(src);
             value = lm::Json(value_t::array);
@@ -141,6 +174,10 @@ public:
                 }
                 return l.release();
             }
+            case value_t::binary: {
+                const auto& b = src.get_binary();
+                return bytes(reinterpret_cast<const char*>(b.data()), b.size()).release();
+            }
             case value_t::discarded: {
                 LM_UNREACHABLE();
                 break;
@@ -151,6 +188,34 @@ public:
     }
 
 private:
+    // Convert numpy array to nested arrays with the same shape
+    template <typename T>
+    static lm::Json from_ndarray(const array& src) {
+        const auto a = array_t<T, array::c_style | array::forcecast>::ensure(src);
+        const T* data = a.data();
+        const auto ndim = a.ndim();
+        if (ndim == 0) {
+            return lm::Json(data[0]);
+        }
+        const std::function<lm::Json(ssize_t, ssize_t)> convert = [&](ssize_t dim, ssize_t offset) -> lm::Json {
+            auto j = lm::Json(nlohmann::detail::value_t::array);
+            const auto n = a.shape(dim);
+            j.get_ref<lm::Json::array_t&>().reserve(n);
+            if (dim == ndim - 1) {
+                for (ssize_t i = 0; i < n; i++) {
+                    j.push_back(data[offset + i]);
+                }
+                return j;
+            }
+            const auto stride = a.strides(dim) / ssize_t(sizeof(T));
+            for (ssize_t i = 0; i < n; i++) {
+                j.push_back(convert(dim + 1, offset + i * stride));
+            }
+            return j;
+        };
+        return convert(0, 0);
+    }
+
     template <typename U>
     static handle cast_to_python_object(const lm::Json& src, return_value_policy policy, handle&& parent) {
         auto p = return_value_policy_override<U>::policy(policy);
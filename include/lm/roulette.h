@@ -0,0 +1,81 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include "component.h"
+#include "math.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*!
+    \addtogroup roulette
+    @{
+*/
+
+/*!
+    \brief Termination policy of the paths.
+
+    \rst
+    This interface provides an abstraction of the Russian roulette and splitting
+    applied by the renderers when they extend a path.
+    The policy decides the expected number of continuations of the path
+    from the throughput of the path and the number of vertices.
+    A value less than one means the path is terminated with the probability ``1-q``.
+    A value larger than one requests splitting of the path into ``q`` paths in expectation.
+    Renderers not supporting splitting clamp the value to one,
+    e.g., with :cpp:func:`lm::roulette::survive`.
+    \endrst
+*/
+class Roulette : public Component {
+public:
+    /*!
+        \brief Compute expected number of continuations of the path.
+        \param throughput Throughput of the path, i.e., the contribution divided by the PDF.
+        \param num_verts Number of vertices of the path.
+        \return Expected number of continuations.
+    */
+    virtual Float continuation(Vec3 throughput, int num_verts) const = 0;
+};
+
+LM_NAMESPACE_BEGIN(roulette)
+
+/*!
+    \brief Apply Russian roulette to the path.
+    \param roulette Termination policy.
+    \param u Uniform random number in [0,1).
+    \param throughput Throughput of the path. Reweighted if the path survives.
+    \param num_verts Number of vertices of the path.
+    \return False if the path is terminated.
+
+    \rst
+    This function applies the termination policy without splitting.
+    The path is always terminated if the throughput is zero.
+    If the path survives, the throughput is divided by the probability of the survival.
+    \endrst
+*/
+static bool survive(const Roulette* roulette, Float u, Vec3& throughput, int num_verts) {
+    if (math::is_zero(throughput)) {
+        // Path carrying no energy would not contribute anymore
+        return false;
+    }
+    const auto q = glm::min(1_f, roulette->continuation(throughput, num_verts));
+    if (q >= 1_f) {
+        return true;
+    }
+    if (u >= q) {
+        return false;
+    }
+    throughput /= q;
+    return true;
+}
+
+LM_NAMESPACE_END(roulette)
+
+/*!
+    @}
+*/
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,141 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include "component.h"
+#include "math.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*!
+    \addtogroup sampler
+    @{
+*/
+
+/*!
+    \brief Sampler.
+
+    \rst
+    This interface provides an abstraction of the uniform random numbers consumed by the renderers.
+    A sample number is a deterministic function of the pixel index, the sample index,
+    and the dimension, so that the result does not depend on the order of evaluation
+    nor on the number of threads. Low-discrepancy samplers distribute the sample numbers
+    of the same pixel and of the same dimension more evenly than independent random numbers.
+    Renderers usually consume the sample numbers through :cpp:class:`lm::SampleStream`.
+    \endrst
+*/
+class Sampler : public Component {
+public:
+    /*!
+        \brief Generate a sample number.
+        \param pixel_index Pixel index.
+        \param sample_index Pixel sample index.
+        \param dim Dimension of the sample number.
+        \return Generated sample number in [0,1).
+    */
+    virtual Float u(long long pixel_index, long long sample_index, int dim) const = 0;
+};
+
+/*!
+    \brief Stream of sample numbers of a sample.
+
+    \rst
+    This class provides the same interface as :cpp:class:`lm::Rng`
+    for the sample numbers generated by a sampler.
+    Each call consumes the next dimension of the sample.
+    \endrst
+*/
+class SampleStream {
+private:
+    const Sampler* sampler_;    // Underlying sampler
+    long long pixel_index_;     // Pixel index
+    long long sample_index_;    // Pixel sample index
+    int dim_ = 0;               // Next dimension
+
+public:
+    /*!
+        \brief Construct the stream of a sample.
+        \param sampler Sampler.
+        \param pixel_index Pixel index.
+        \param sample_index Pixel sample index.
+    */
+    SampleStream(const Sampler* sampler, long long pixel_index, long long sample_index)
+        : sampler_(sampler)
+        , pixel_index_(pixel_index)
+        , sample_index_(sample_index)
+    {}
+
+    /*!
+        \brief Generate a sample number of the next dimension.
+        \return Generated sample number in [0,1).
+    */
+    Float u() {
+        return sampler_->u(pixel_index_, sample_index_, dim_++);
+    }
+
+    /*!
+        \brief Generate sample numbers packed in a structure.
+
+        \rst
+        ``T`` must be a structure only containing floating point values,
+        e.g., :cpp:class:`lm::path::PositionSampleU`.
+        \endrst
+    */
+    template <typename T>
+    T next() {
+        T us;
+        const int N = sizeof(T) / sizeof(Float);
+        for (int i = 0; i < N; i++) {
+            *(reinterpret_cast<Float*>(&us) + i) = u();
+        }
+        return us;
+    }
+};
+
+LM_NAMESPACE_BEGIN(sampler)
+
+/*!
+    \brief Hash of the sample coordinates.
+    \param seed Seed.
+    \param a First coordinate.
+    \param b Second coordinate.
+    \param c Third coordinate.
+    \return Hash value.
+
+    \rst
+    Samplers use this function to decorrelate the sequences of pixels and dimensions.
+    \endrst
+*/
+static uint64_t hash(uint64_t seed, uint64_t a, uint64_t b, uint64_t c) {
+    // SplitMix64 finalizer
+    const auto mix = [](uint64_t z) -> uint64_t {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    };
+    return mix(seed ^ mix(a ^ mix(b ^ mix(c))));
+}
+
+/*!
+    \brief Convert a hash value to a uniform number in [0,1).
+    \param h Hash value.
+    \return Uniform number.
+*/
+static Float to_unit(uint64_t h) {
+    #if LM_SINGLE_PRECISION
+    return Float(h >> 40) * 0x1p-24f;
+    #else
+    return Float(h >> 11) * 0x1p-53;
+    #endif
+}
+
+LM_NAMESPACE_END(sampler)
+
+/*!
+    @}
+*/
+
+LM_NAMESPACE_END(LM_NAMESPACE)
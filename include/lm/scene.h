@@ -9,6 +9,9 @@
 #include "math.h"
 #include "surface.h"
 #include "scenenode.h"
+#include "mesh.h"
+#include "profiler.h"
+#include <future>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -17,6 +20,27 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
     @{
 */
 
+/*!
+    \brief Kinds of the changes of the scene.
+
+    \rst
+    The flags classify the edits of the scene since the last build
+    used by :cpp:func:`lm::Scene::commit_changes` to rerun only the affected build stages.
+    \endrst
+*/
+struct SceneChange {
+    enum Type {
+        None      = 0,
+        Geometry  = 1<<0,   //!< Scene graph or meshes. Requires rebuilding the acceleration structure.
+        Transform = 1<<1,   //!< Transformations of the group nodes. Requires updating the acceleration structure.
+        Light     = 1<<2,   //!< Emitters. Requires the structures for light selection.
+        Material  = 1<<3,   //!< Materials or textures.
+        Camera    = 1<<4,   //!< Camera.
+        Medium    = 1<<5,   //!< Participating media.
+        All       = Geometry | Transform | Light | Material | Camera | Medium
+    };
+};
+
 /*!
     \brief Scene.
 
@@ -155,6 +179,69 @@ public:
         add_child(root_node(), t);
     }
 
+    /*!
+        \brief Create group nodes in a batch.
+        \param n Number of nodes.
+        \param transforms Local transforms of the nodes.
+        \return Index of the first created node.
+
+        \rst
+        This function is the batched version of :cpp:func:`lm::Scene::create_group_node`.
+        The created nodes have consecutive indices starting from the returned index.
+        This function returns -1 if ``n`` is zero.
+        \endrst
+    */
+    virtual int create_group_nodes(int n, const Mat4* transforms) {
+        int first = -1;
+        for (int i = 0; i < n; i++) {
+            const int index = create_group_node(transforms[i]);
+            if (i == 0) {
+                first = index;
+            }
+        }
+        return first;
+    }
+
+    /*!
+        \brief Add child nodes in a batch.
+        \param parent Parent node index.
+        \param n Number of child nodes.
+        \param children Child node indices being added.
+
+        \rst
+        This function is the batched version of :cpp:func:`lm::Scene::add_child`.
+        \endrst
+    */
+    virtual void add_children(int parent, int n, const int* children) {
+        for (int i = 0; i < n; i++) {
+            add_child(parent, children[i]);
+        }
+    }
+
+    /*!
+        \brief Create primitives with transforms and add to the scene in a batch.
+        \param props Properties of the primitives.
+        \param n Number of primitives.
+        \param transforms Transformation matrices of the primitives.
+        \param prop_indices Indices of ``props`` used by the primitives.
+
+        \rst
+        This function is the batched version of :cpp:func:`lm::Scene::add_transformed_primitive`.
+        The ``i``-th primitive is created as ``add_transformed_primitive(transforms[i], props[prop_indices[i]])``.
+        Each element of ``props`` is resolved once irrespective of the number of primitives using it,
+        which makes this function suitable to scatter many copies of a few assets.
+        \endrst
+    */
+    virtual void add_transformed_primitives(const std::vector<Json>& props, int n, const Mat4* transforms, const int* prop_indices) {
+        for (int i = 0; i < n; i++) {
+            if (prop_indices[i] < 0 || prop_indices[i] >= int(props.size())) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument,
+                    "Invalid property index [index='{}', num_props='{}']", prop_indices[i], props.size());
+            }
+            add_transformed_primitive(transforms[i], props[prop_indices[i]]);
+        }
+    }
+
     /*!
         \brief Callback function to traverse the scene nodes.
         \param node Current node.
@@ -221,12 +308,64 @@ public:
 	*/
 	virtual int camera_node() const = 0;
 
+    /*!
+        \brief Select the camera used for rendering.
+        \param node_index Index of a primitive node containing a camera.
+
+        \rst
+        A scene can contain multiple camera primitives, e.g., for rendering multiple views.
+        By default the camera added last is used. This function selects the camera
+        returned by :cpp:func:`lm::Scene::camera_node` among them.
+        Cameras are evaluated on rendering, so the scene needs not to be rebuilt.
+        \endrst
+    */
+    virtual void set_camera_node(int node_index) {
+        LM_UNUSED(node_index);
+        LM_THROW_EXCEPTION_DEFAULT(Error::Unsupported);
+    }
+
     /*!
         \brief Get medium node index.
         \return Medium node index. -1 if no medium is found in the scene.
+
+        \rst
+        If the scene contains multiple media, this function returns the first one.
+        Use :cpp:func:`lm::Scene::traverse_media` to find the media along a ray.
+        \endrst
     */
     virtual int medium_node() const = 0;
 
+    /*!
+        \brief Callback function for the traversal of media.
+        \param medium_node Medium node index.
+        \param t0 Distance where the ray enters the bound of the medium.
+        \param t1 Distance where the ray exits the bound of the medium.
+        \return False to stop the traversal.
+    */
+    using MediumFunc = std::function<bool(int medium_node, Float t0, Float t1)>;
+
+    /*!
+        \brief Traverse the media overlapping a ray segment.
+        \param ray Ray.
+        \param tmin Lower bound of the valid range of the ray.
+        \param tmax Upper bound of the valid range of the ray.
+        \param func Callback function called for each medium.
+
+        \rst
+        This function calls ``func`` for each medium whose bound overlaps the ray segment,
+        in the increasing order of the distances where the ray enters the bounds.
+        The given range is clipped to the segment.
+        The default implementation visits :cpp:func:`lm::Scene::medium_node` with the segment.
+        \endrst
+    */
+    virtual void traverse_media(Ray ray, Float tmin, Float tmax, const MediumFunc& func) const {
+        LM_UNUSED(ray);
+        const int index = medium_node();
+        if (index >= 0) {
+            func(index, tmin, tmax);
+        }
+    }
+
 	/*!
 		\brief Get environment map node index.
         \return Environment light node index. -1 if no environment light is found in the scene.
@@ -272,7 +411,9 @@ public:
 	}
 
 	//! Throws an exception if there is no accel created for the scene.
+	//! Waits for the build started by :cpp:func:`build_async` if any.
 	void require_accel() const {
+		wait_build();
 		if (accel()) {
 			return;
 		}
@@ -290,9 +431,13 @@ public:
 		- :cpp:func:`require_camera`
 		- :cpp:func:`require_light`
 		- :cpp:func:`require_accel`
+
+		The function waits for the build started by :cpp:func:`build_async` if any,
+		so the renderers wait for the build implicitly.
 		\endrst
 	*/
 	void require_renderable() const {
+		wait_build();
 		require_primitive();
 		require_camera();
 		require_light();
@@ -317,6 +462,102 @@ public:
     //! Build acceleration structure.
     virtual void build() = 0;
 
+    /*!
+        \brief Build acceleration structure in background.
+        \return Future of the build.
+
+        \rst
+        This function starts :cpp:func:`lm::Scene::build` on a background thread and returns immediately,
+        so that the caller can continue to load the other assets, e.g., the textures or the films.
+        Until the build finishes, the scene must not be modified nor queried
+        except by the functions waiting for the build:
+        :cpp:func:`lm::Scene::wait_build`, :cpp:func:`lm::Scene::require_accel`,
+        :cpp:func:`lm::Scene::require_renderable`, and the functions building or resetting the scene.
+        The renderers wait for the build implicitly by :cpp:func:`lm::Scene::require_renderable`.
+        The exception thrown by the build is rethrown by the returned future and by the first wait of the scene.
+        The default implementation builds the scene synchronously.
+        \endrst
+    */
+    virtual std::shared_future<void> build_async() {
+        std::promise<void> p;
+        try {
+            build();
+            p.set_value();
+        }
+        catch (...) {
+            p.set_exception(std::current_exception());
+        }
+        return p.get_future().share();
+    }
+
+    /*!
+        \brief Wait for the build started by :cpp:func:`lm::Scene::build_async`.
+
+        \rst
+        The function returns immediately if no build is running.
+        If the build failed, the function rethrows the exception.
+        \endrst
+    */
+    virtual void wait_build() const {}
+
+    /*!
+        \brief Update acceleration structure.
+
+        \rst
+        Updates the acceleration structure after modifying the transformations of the group nodes.
+        The function utilizes :cpp:func:`lm::Accel::update`, which is usually faster than rebuilding.
+        The default implementation rebuilds the structure.
+        \endrst
+    */
+    virtual void update() {
+        build();
+    }
+
+    /*!
+        \brief Set transformation of a group node.
+        \param node_index Index of the group node.
+        \param transform Local transformation of the node.
+
+        \rst
+        The change is recorded as :cpp:enumerator:`lm::SceneChange::Transform`
+        and applied by :cpp:func:`lm::Scene::commit_changes` or :cpp:func:`lm::Scene::update`.
+        \endrst
+    */
+    virtual void set_transform(int node_index, Mat4 transform) {
+        LM_UNUSED(node_index, transform);
+        LM_THROW_EXCEPTION_DEFAULT(Error::Unsupported);
+    }
+
+    /*!
+        \brief Notify changes of the scene.
+        \param changes Kinds of the changes specified by the combination of :cpp:enum:`lm::SceneChange::Type`.
+
+        \rst
+        The edits of the scene graph and the replacements of the assets
+        via :cpp:func:`lm::AssetGroup::load_asset` are tracked automatically.
+        Use this function to notify the other changes, e.g., the modification of an asset from Python.
+        \endrst
+    */
+    virtual void notify_changes(int changes) {
+        LM_UNUSED(changes);
+    }
+
+    /*!
+        \brief Apply the changes of the scene.
+
+        \rst
+        Reruns the build stages affected by the changes since the last build.
+        The changes of the geometries rebuild the whole scene with :cpp:func:`lm::Scene::build`,
+        the changes of the transformations update the acceleration structure with :cpp:func:`lm::Scene::update`.
+        Otherwise the acceleration structure is kept and, e.g., the changes of the emitters
+        only rebuild the structures for light selection.
+        The default implementation rebuilds the scene.
+        \endrst
+    */
+    virtual void commit_changes() {
+        build();
+    }
+
     /*!
         \brief Compute closest intersection point.
         \param ray Ray.
@@ -330,10 +571,169 @@ public:
         Note that if the scene contains environment light, this function returns scene intersection structure
         indicating the intersection with infinite point.
         This can be examined by checking :cpp:member:`PointGeometry::infinite` being ``true``.
+        ``tmin`` is enlarged by :cpp:func:`lm::math::robust_tmin` to avoid the self-intersection
+        due to the rounding error of the origin.
         \endrst
     */
     virtual std::optional<SceneInteraction> intersect(Ray ray, Float tmin = Eps, Float tmax = Inf) const = 0;
 
+    /*!
+        \brief Lightweight record of the closest intersection.
+
+        \rst
+        Unlike :cpp:class:`lm::SceneInteraction`, the record does not contain
+        the interpolated geometry of the surface, which is computed on demand
+        with :cpp:func:`lm::Scene::interaction`.
+        \endrst
+    */
+    struct Hit {
+        Float t;                    //!< Distance to the hit point. Inf for the environment light.
+        Vec2 uv;                    //!< Barycentric coordinates.
+        int instance;               //!< Instance index given by the acceleration structure. -1 for the environment light.
+        int primitive;              //!< Primitive node index.
+        int face;                   //!< Face index. -1 for the environment light.
+
+        //! Check if the hit is the environment light.
+        bool infinite() const {
+            return face < 0;
+        }
+    };
+
+    /*!
+        \brief Compute closest intersection without the surface geometry.
+        \param ray Ray.
+        \param tmin Lower bound of the valid range of the ray.
+        \param tmax Upper bound of the valid range of the ray.
+
+        \rst
+        This function finds the same intersection as :cpp:func:`lm::Scene::intersect`
+        but skips the interpolation of the surface geometry.
+        This is useful when the caller only needs the distance or the primitive of the hit,
+        e.g., to find the distance to the next surface for the tracking in media.
+        The scene interaction can be constructed later with :cpp:func:`lm::Scene::interaction`.
+        The default implementation queries the underlying acceleration structure.
+        \endrst
+    */
+    virtual std::optional<Hit> intersect_hit(Ray ray, Float tmin = Eps, Float tmax = Inf) const {
+        const auto hit = accel()->intersect(ray, math::robust_tmin(ray.o, tmin), tmax);
+        if (hit) {
+            return Hit{ hit->t, hit->uv, hit->instance, hit->primitive, hit->face };
+        }
+        if (tmax < Inf || env_light_node() < 0) {
+            return {};
+        }
+        return Hit{ Inf, {}, -1, env_light_node(), -1 };
+    }
+
+    /*!
+        \brief Construct scene interaction from the intersection.
+        \param ray Ray used to compute the intersection.
+        \param hit Intersection computed by :cpp:func:`lm::Scene::intersect_hit`.
+        \return Scene interaction of the intersection.
+
+        \rst
+        This function interpolates the geometry of the surface at the intersection.
+        The result is same as the scene interaction returned by :cpp:func:`lm::Scene::intersect`.
+        \endrst
+    */
+    virtual SceneInteraction interaction(Ray ray, const Hit& hit) const {
+        if (hit.infinite()) {
+            return SceneInteraction::make_light_endpoint(hit.primitive, PointGeometry::make_infinite(-ray.d));
+        }
+        const auto p = node_at(hit.primitive).primitive.mesh->surface_point(hit.face, hit.uv);
+        const auto global_transform = accel()->instance_transform(hit.instance);
+        return SceneInteraction::make_surface_interaction(
+            hit.primitive,
+            PointGeometry::make_on_surface(
+                global_transform.M * Vec4(p.p, 1_f),
+                glm::normalize(global_transform.normal_M * p.n),
+                glm::normalize(global_transform.normal_M * p.gn),
+                p.t
+            )
+        );
+    }
+
+    /*!
+        \brief Compute closest intersection point with the ray footprint.
+        \param ray Ray.
+        \param cone Ray cone approximating the footprint of the ray.
+        \param tmin Lower bound of the valid range of the ray.
+        \param tmax Upper bound of the valid range of the ray.
+
+        \rst
+        This function is same as :cpp:func:`lm::Scene::intersect` except that
+        :cpp:member:`PointGeometry::footprint` of the intersected surface point is computed
+        from the width of the cone at the intersection, the projection to the surface,
+        and the ratio of the areas of the triangle in the texture and world space.
+        The default implementation ignores the cone.
+        \endrst
+    */
+    virtual std::optional<SceneInteraction> intersect_cone(Ray ray, RayCone cone, Float tmin = Eps, Float tmax = Inf) const {
+        LM_UNUSED(cone);
+        return intersect(ray, tmin, tmax);
+    }
+
+    /*!
+        \brief Compute closest intersection points for multiple rays.
+        \param n Number of rays.
+        \param rays Array of rays of size ``n``.
+        \param tmin Lower bound of the valid range of the rays.
+        \param tmax Upper bound of the valid range of the rays.
+        \param sps Output array of scene interactions of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Scene::intersect`.
+        The function utilizes :cpp:func:`lm::Accel::intersect_n` of the underlying acceleration structure.
+        Since the rays share ``tmin``, it is enlarged by the largest bound of the rays.
+        \endrst
+    */
+    virtual void intersect_n(int n, const Ray* rays, Float tmin, Float tmax, std::optional<SceneInteraction>* sps) const {
+        for (int i = 0; i < n; i++) {
+            sps[i] = intersect(rays[i], tmin, tmax);
+        }
+    }
+
+    /*!
+        \brief Check if the ray segment is occluded by the primitives in the scene.
+        \param ray Ray.
+        \param tmin Lower bound of the valid range of the ray.
+        \param tmax Upper bound of the valid range of the ray.
+        \return True if the ray segment intersects with any primitive.
+
+        \rst
+        Unlike :cpp:func:`lm::Scene::intersect`, environment light is not considered
+        and no scene interaction is constructed. The function utilizes
+        :cpp:func:`lm::Accel::occluded` of the underlying acceleration structure.
+        As with :cpp:func:`lm::Scene::intersect`, ``tmin`` is enlarged by :cpp:func:`lm::math::robust_tmin`.
+        \endrst
+    */
+    virtual bool occluded(Ray ray, Float tmin = Eps, Float tmax = Inf) const {
+        LM_PROFILE_SCOPE(Visible);
+        return accel()->occluded(ray, math::robust_tmin(ray.o, tmin), tmax);
+    }
+
+    /*!
+        \brief Check if multiple ray segments are occluded by the primitives in the scene.
+        \param n Number of rays.
+        \param rays Array of rays of size ``n``.
+        \param tmin Lower bound of the valid range of the rays.
+        \param tmax Array of upper bounds of the valid ranges of the rays of size ``n``.
+        \param occluded Output array of occlusion results of size ``n``.
+
+        \rst
+        Batched version of :cpp:func:`lm::Scene::occluded`.
+        The function utilizes :cpp:func:`lm::Accel::occluded_n` of the underlying acceleration structure.
+        Since the rays share ``tmin``, it is enlarged by the largest bound of the rays.
+        \endrst
+    */
+    virtual void occluded_n(int n, const Ray* rays, Float tmin, const Float* tmax, bool* occluded) const {
+        LM_PROFILE_SCOPE(Visible, n);
+        for (int i = 0; i < n; i++) {
+            tmin = math::robust_tmin(rays[i].o, tmin);
+        }
+        accel()->occluded_n(n, rays, tmin, tmax, occluded);
+    }
+
     /*!
         \brief Check if two surface points are mutually visible.
         \param sp1 Scene interaction of the first point.
@@ -350,10 +750,10 @@ public:
                 ? Inf - 1_f
                 : [&]() {
                     const auto d = glm::distance(sp1.geom.p, sp2.geom.p);
-                    return d * (1_f - Eps);
+                    return d - math::robust_tmin(sp2.geom.p, d * Eps);
                 }();
             // Exclude environent light from intersection test with tmax < Inf
-            return !intersect(Ray{sp1.geom.p, wo}, Eps, tmax);
+            return !occluded(Ray{sp1.geom.p, wo}, Eps, tmax);
         };
         if (sp1.geom.infinite) {
             return visible_(sp2, sp1);
@@ -414,6 +814,35 @@ public:
     */
     virtual Float pdf_light_selection(int light_index) const = 0;
 
+    /*!
+        \brief Light sampling given a shading point.
+        \param geom Point geometry of the shading point.
+        \param u Random number input in [0,1].
+        \return Sampled light index.
+
+        \rst
+        This function selects a light for the direct endpoint sampling from the shading point.
+        The implementation can use the shading point to select the lights
+        that are more likely to contribute, e.g., with a light BVH.
+        The default implementation ignores the shading point.
+        \endrst
+    */
+    virtual LightSelectionSample sample_light_selection(const PointGeometry& geom, Float u) const {
+        LM_UNUSED(geom);
+        return sample_light_selection(u);
+    }
+
+    /*!
+        \brief Evaluate the PDF for light sampling given a shading point.
+        \param geom Point geometry of the shading point.
+        \param light_index Sampled light index.
+        \return Evaluated PDF.
+    */
+    virtual Float pdf_light_selection(const PointGeometry& geom, int light_index) const {
+        LM_UNUSED(geom);
+        return pdf_light_selection(light_index);
+    }
+
     //! Get primitive node index from light index.
     virtual LightPrimitiveIndex light_primitive_index_at(int light_index) const = 0;
 
@@ -39,6 +39,72 @@ public:
         \return Processed samples per pixel.
     */
     virtual long long run(const ProcessFunc& process) const = 0;
+
+    /*!
+        \brief Callback function called at the end of each pass.
+        \param processed Processed samples per pixel or processed samples so far.
+    */
+    using PassFunc = std::function<void(long long processed)>;
+
+    /*!
+        \brief Dispatch scheduler with pass callback.
+        \param process Callback function for parallel loop.
+        \param pass_func Callback function called at the end of each pass.
+        \return Processed samples per pixel.
+
+        \rst
+        Progressive schedulers process the samples in multiple passes.
+        ``pass_func`` is called from the calling thread between the passes,
+        where no worker touches the film. This is the point where the renderer
+        can take a consistent snapshot of the film, e.g., with :cpp:func:`lm::Film::publish`.
+        The schedulers also stop at the end of the pass if the cancellation is requested
+        by :cpp:func:`lm::parallel::cancel`. In this case the sample-based schedulers return
+        the number of samples of the finished passes, and keep the progress
+        so that the run can be continued from the last checkpoint.
+        The default implementation dispatches :cpp:func:`run` as a single pass.
+        \endrst
+    */
+    virtual long long run(const ProcessFunc& process, const PassFunc& pass_func) const {
+        const auto processed = run(process);
+        pass_func(processed);
+        return processed;
+    }
+
+    /*!
+        \brief Check if the scheduler continues an unfinished run.
+        \return True if the next run continues from the restored progress.
+
+        \rst
+        Progressive schedulers record the progress at the end of each pass
+        and save it with the state, e.g., in a checkpoint written by :cpp:func:`lm::save_checkpoint`.
+        When the state is restored from such a checkpoint, the next run continues
+        from the last finished pass with the same sample indices as the uninterrupted run.
+        In this case the renderer must keep the film, which holds the contributions of the finished passes.
+        The returned number of processed samples includes the samples of the finished passes.
+        The default implementation returns false.
+        \endrst
+    */
+    virtual bool resuming() const {
+        return false;
+    }
+
+    /*!
+        \brief Check if the renderer must keep the current film.
+        \return True if the renderer must not clear the film before the run.
+
+        \rst
+        The film must be kept if the run continues from the restored progress
+        (see :cpp:func:`resuming`), or if the scheduler renders only a region of the film
+        and merges the result into the existing contents of the film.
+        In the latter case the scheduler clears the rendered pixels by itself
+        and prescales the other pixels so that they are restored
+        by the normalization of the film by the returned number of samples.
+        The default implementation returns :cpp:func:`resuming`.
+        \endrst
+    */
+    virtual bool keep_film() const {
+        return resuming();
+    }
 };
 
 /*!
@@ -16,6 +16,50 @@
 #include <cereal/types/unordered_map.hpp>
 #include <atomic>
 #include <fstream>
+#include <sstream>
+
+// ------------------------------------------------------------------------------------------------
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+LM_NAMESPACE_BEGIN(serial)
+
+/*!
+    \addtogroup serial
+    @{
+*/
+
+/*!
+    \brief Check if the array of the type can be stored as a blob of a snapshot.
+
+    \rst
+    The array of the type is written to and read from a snapshot as raw bytes.
+    Arithmetic types, vectors, and matrices are supported by default.
+    The user-defined type can opt in by defining a member type ``BlobSerializable``.
+    The type must be trivially copyable and must not contain pointers.
+    \endrst
+*/
+template <typename T, typename = void>
+struct is_blob_serializable : std::bool_constant<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>> {};
+
+//! \cond
+template <int N, typename T, glm::qualifier Q>
+struct is_blob_serializable<glm::vec<N, T, Q>> : is_blob_serializable<T> {};
+
+template <int C, int R, typename T, glm::qualifier Q>
+struct is_blob_serializable<glm::mat<C, R, T, Q>> : is_blob_serializable<T> {};
+
+template <typename T>
+struct is_blob_serializable<T, std::void_t<typename T::BlobSerializable>> : std::true_type {
+    static_assert(std::is_trivially_copyable_v<T>, "Blob serializable type must be trivially copyable");
+};
+//! \endcond
+
+/*!
+    @}
+*/
+
+LM_NAMESPACE_END(serial)
+LM_NAMESPACE_END(LM_NAMESPACE)
 
 // ------------------------------------------------------------------------------------------------
 
@@ -55,6 +99,99 @@ void load(Archive& ar, std::optional<T>& optional) {
 
 // ------------------------------------------------------------------------------------------------
 
+/*
+    Save function specialized for std::vector<> of the blob serializable types.
+    The format is same as the default one if blobs are disabled.
+    Otherwise a flag tells if the array is stored as a blob followed by the offset of the blob.
+    In the native mode the elements are written as a single block.
+*/
+template <typename T, typename A>
+std::enable_if_t<lm::serial::is_blob_serializable<T>::value, void>
+save(lm::OutputArchive& ar, const std::vector<T, A>& v) {
+    ar(make_size_tag(static_cast<size_type>(v.size())));
+    const auto size = v.size() * sizeof(T);
+    if (ar.use_blobs()) {
+        const std::uint8_t in_blob = size >= lm::OutputArchive::BlobThreshold ? 1 : 0;
+        ar(CEREAL_NVP_("in_blob", in_blob));
+        if (in_blob) {
+            const std::uint64_t offset = ar.add_blob(v.data(), size);
+            ar(CEREAL_NVP_("offset", offset));
+            return;
+        }
+    }
+    if constexpr (std::is_arithmetic_v<T>) {
+        ar(binary_data(v.data(), size));
+    }
+    else if (ar.native()) {
+        ar.template saveBinary<1>(v.data(), size);
+    }
+    else {
+        for (const auto& e : v) {
+            ar(e);
+        }
+    }
+}
+
+/*
+    Read the reference to the array stored as a blob.
+    Returns nullptr if the array is stored in the stream.
+*/
+template <typename T>
+const T* load_blob(lm::InputArchive& ar, size_type n) {
+    if (!ar.use_blobs()) {
+        return nullptr;
+    }
+    std::uint8_t in_blob;
+    ar(CEREAL_NVP_("in_blob", in_blob));
+    if (!in_blob) {
+        return nullptr;
+    }
+    std::uint64_t offset;
+    ar(CEREAL_NVP_("offset", offset));
+    const auto* p = ar.blob(offset, n * sizeof(T));
+    if (!p || offset % alignof(T) != 0) {
+        LM_THROW_EXCEPTION(lm::Error::IOError,
+            "Invalid blob reference [offset='{}', size='{}']", offset, n * sizeof(T));
+    }
+    return reinterpret_cast<const T*>(p);
+}
+
+/*
+    Load the elements of the array stored in the stream.
+*/
+template <typename T, typename A>
+void load_elements(lm::InputArchive& ar, std::vector<T, A>& v, size_type n) {
+    v.resize(static_cast<std::size_t>(n));
+    if constexpr (std::is_arithmetic_v<T>) {
+        ar(binary_data(v.data(), v.size() * sizeof(T)));
+    }
+    else if (ar.native()) {
+        ar.template loadBinary<1>(v.data(), v.size() * sizeof(T));
+    }
+    else {
+        for (auto& e : v) {
+            ar(e);
+        }
+    }
+}
+
+/*
+    Load function specialized for std::vector<> of the blob serializable types.
+*/
+template <typename T, typename A>
+std::enable_if_t<lm::serial::is_blob_serializable<T>::value, void>
+load(lm::InputArchive& ar, std::vector<T, A>& v) {
+    size_type n;
+    ar(make_size_tag(n));
+    if (const auto* p = load_blob<T>(ar, n); p) {
+        v.assign(p, p + n);
+        return;
+    }
+    load_elements(ar, v, n);
+}
+
+// ------------------------------------------------------------------------------------------------
+
 /*
     Serialize function specialized for glm::vec<>.
 */
@@ -319,6 +456,99 @@ LM_NAMESPACE_END(cereal)
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 LM_NAMESPACE_BEGIN(serial)
 
+//! \cond
+LM_NAMESPACE_BEGIN(detail)
+
+// Check if the child assets contains external reference out of the subtree.
+template <typename T>
+void check_subtree(T* comp, const std::string& root_loc) {
+
+    // If the subtree contains the external reference, generate an error.
+    const Component::ComponentVisitor visitor = [&](Component*& visiting_comp, bool weak) {
+        if (!visiting_comp) {
+            return;
+        }
+        if (weak) {
+            // Check if the weak reference is referring to an asset in the subtree
+            // by checking if the locator starts with root_loc.
+            const auto loc = visiting_comp->loc();
+            if (loc.rfind(root_loc, 0) != 0) {
+                LM_THROW_EXCEPTION(Error::Unsupported,
+                    "Unserializable asset. Subtree contains a reference to the outer asset. [loc='{}']", loc);
+            }
+            return;
+        }
+        visiting_comp->foreach_underlying(visitor);
+    };
+    comp->foreach_underlying(visitor);
+
+}
+
+// Load a component from the archive
+template <typename T>
+void load_comp(InputArchive& ar, Component::Ptr<T>& comp) {
+    // Deserialize the asset
+    ar(comp);
+
+    // Recover all weak references (if any)
+    ar.foreach_weakptr([](std::uintptr_t address, const std::string& loc) {
+        Component** weakptr = (Component**)address;
+        *weakptr = lm::comp::get<Component>(loc);
+    });
+}
+
+// Regions of a memory-mapped snapshot
+struct Snapshot {
+    const char* stream;                 // Serialized stream
+    std::uint64_t stream_size;
+    const char* blobs;                  // Blob region
+    std::uint64_t blobs_size;
+    bool native;                        // True if the stream is written in the native mode
+    std::shared_ptr<const void> owner;  // Keeps the mapping alive
+};
+
+// Start writing a snapshot. The blobs are written to the stream after this call.
+LM_PUBLIC_API void begin_snapshot(std::ostream& os);
+
+// Finish writing a snapshot by appending the serialized stream
+LM_PUBLIC_API void end_snapshot(std::ostream& os, const std::string& stream, std::uint64_t blobs_size);
+
+// Map a snapshot file. Returns nullopt if the file is not a snapshot.
+// The compressed snapshot is decompressed to the memory.
+LM_PUBLIC_API std::optional<Snapshot> map_snapshot(const std::string& path);
+
+// Decompressed content of a file
+struct Content {
+    const char* data;                   // Content aligned to the page boundary
+    std::uint64_t size;
+    std::shared_ptr<const void> owner;  // Keeps the content alive
+};
+
+// Write the content to a file compressed by chunks of fixed size in parallel.
+// Throws Error::Unsupported if the library is built without LM_USE_ZSTD.
+LM_PUBLIC_API void save_compressed(const std::string& path, const std::string& content, int level);
+
+// Load a file written by save_compressed(). Returns nullopt if the file is not compressed.
+LM_PUBLIC_API std::optional<Content> load_compressed(const std::string& path);
+
+// True if the library is built with the support of the compression
+LM_PUBLIC_API bool compression_supported();
+
+// Clear the modified flags of the component and its descendants
+LM_PUBLIC_API void clear_dirty(Component* root);
+
+// Read-only stream buffer referring to a memory region
+class MemoryStreamBuf : public std::streambuf {
+public:
+    MemoryStreamBuf(const char* data, std::size_t size) {
+        char* p = const_cast<char*>(data);
+        setg(p, p, p + size);
+    }
+};
+
+LM_NAMESPACE_END(detail)
+//! \endcond
+
 /*!
     \addtogroup serial
     @{
@@ -337,15 +567,8 @@ std::enable_if_t<
     void
 >
 load_comp(std::istream& stream, Component::Ptr<T>& comp, const std::string& root_loc) {
-    // Deserialize the asset
     InputArchive ar(stream, root_loc);
-    ar(comp);
-
-    // Recover all weak references (if any)
-    ar.foreach_weakptr([](std::uintptr_t address, const std::string& loc) {
-        Component** weakptr = (Component**)address;
-        *weakptr = lm::comp::get<Component>(loc);
-    });
+    detail::load_comp(ar, comp);
 }
 
 /*!
@@ -361,25 +584,7 @@ std::enable_if_t<
     void
 >
 save_comp_owned(std::ostream& stream, T* comp, const std::string& root_loc) {
-    // Check if the child assets contains external reference out of the subtree.
-    // If the subtree contains the external reference, generate an error.
-    const Component::ComponentVisitor visitor = [&](Component*& visiting_comp, bool weak) {
-        if (!visiting_comp) {
-            return;
-        }
-        if (weak) {
-            // Check if the weak reference is referring to an asset in the subtree
-            // by checking if the locator starts with root_loc.
-            const auto loc = visiting_comp->loc();
-            if (loc.rfind(root_loc, 0) != 0) {
-                LM_THROW_EXCEPTION(Error::Unsupported,
-                    "Unserializable asset. Subtree contains a reference to the outer asset. [loc='{}']", loc);
-            }
-            return;
-        }
-        visiting_comp->foreach_underlying(visitor);
-    };
-    comp->foreach_underlying(visitor);
+    detail::check_subtree(comp, root_loc);
 
     // Serialize the asset
     OutputArchive ar(stream, comp->loc());
@@ -402,6 +607,168 @@ save_comp(std::ostream& stream, Component::Ptr<T>& comp, const std::string& root
     save_comp_owned(stream, comp.get(), root_loc);
 }
 
+/*!
+    \brief Save a component to a snapshot file.
+    \tparam T Component type.
+    \param path Output path.
+    \param comp Component instance.
+    \param root_loc Locator of comp.
+    \param compression Compression level of zstd. 0 disables the compression.
+
+    \rst
+    A snapshot consists of the blob region aligned to the page boundary
+    followed by the serialized stream of the components.
+    Large arrays of the types satisfying :cpp:class:`lm::serial::is_blob_serializable`
+    are stored in the blob region as raw bytes, so that they are loaded without parsing
+    from the memory-mapped file, or referred directly by the components supporting it.
+    The stream is written in the native mode of :cpp:class:`lm::OutputArchive`,
+    where the arrays smaller than the blobs are also written as single blocks.
+    Thus, unlike the stream written by :cpp:func:`lm::serial::save_comp`,
+    the snapshot is not portable across the platforms
+    with different endianness or layouts of the types.
+
+    If ``compression`` is positive, the snapshot is compressed with zstd
+    by the chunks of fixed size in parallel, which requires the build with ``LM_USE_ZSTD``.
+    The compressed snapshot is decompressed to the memory on loading
+    instead of being memory-mapped, so the pages are not shared between the processes.
+    \endrst
+*/
+template <typename T>
+std::enable_if_t<
+    std::is_base_of_v<Component, T>,
+    void
+>
+save_snapshot(const std::string& path, Component::Ptr<T>& comp, const std::string& root_loc, int compression = 0) {
+    detail::check_subtree(comp.get(), root_loc);
+    const auto write = [&](std::ostream& os) {
+        detail::begin_snapshot(os);
+        std::ostringstream stream;
+        OutputArchive ar(stream, comp->loc(), &os);
+        ar.set_native(true);
+        cereal::save_owned(ar, comp.get());
+        detail::end_snapshot(os, stream.str(), ar.blobs_size());
+    };
+    if (compression > 0) {
+        std::ostringstream image;
+        write(image);
+        detail::save_compressed(path, image.str(), compression);
+    }
+    else {
+        std::ofstream os(path, std::ios::out | std::ios::binary);
+        if (!os) {
+            LM_THROW_EXCEPTION(Error::IOError, "Failed to open snapshot [path='{}']", path);
+        }
+        write(os);
+    }
+    detail::clear_dirty(comp.get());
+}
+
+/*!
+    \brief Load a component from a snapshot file.
+    \tparam T Component type.
+    \param path Input path.
+    \param comp Component instance.
+    \param root_loc Locator of comp.
+
+    \rst
+    The file is memory-mapped and the blobs are read from the mapped region.
+    The mapping is kept alive as long as a component refers to it.
+    The components supporting it, e.g., the acceleration structures and the meshes,
+    refer to the blobs without copy. Since the file is mapped read-only and shared,
+    the processes on the same node loading the same snapshot, e.g., one process per NUMA node,
+    share the physical pages of these arrays through the page cache.
+    Place the snapshot in a memory-backed file system such as ``/dev/shm``
+    to keep the pages resident as POSIX shared memory.
+    If the file is not a snapshot, it is loaded as the stream written by
+    :cpp:func:`lm::serial::save_comp`.
+    \endrst
+*/
+template <typename T>
+std::enable_if_t<
+    std::is_base_of_v<Component, T>,
+    void
+>
+load_snapshot(const std::string& path, Component::Ptr<T>& comp, const std::string& root_loc) {
+    const auto snapshot = detail::map_snapshot(path);
+    if (!snapshot) {
+        std::ifstream is(path, std::ios::in | std::ios::binary);
+        load_comp(is, comp, root_loc);
+    }
+    else {
+        detail::MemoryStreamBuf buf(snapshot->stream, snapshot->stream_size);
+        std::istream is(&buf);
+        InputArchive ar(is, root_loc);
+        ar.set_blobs(snapshot->blobs, snapshot->blobs_size, snapshot->owner);
+        ar.set_native(snapshot->native);
+        detail::load_comp(ar, comp);
+    }
+    detail::clear_dirty(comp.get());
+}
+
+/*!
+    \brief Save the components modified after the snapshot or the last checkpoint.
+    \param stream Output stream.
+    \param root Root component.
+    \param info Additional information to be saved, e.g., the number of processed samples.
+
+    \rst
+    The function writes the components in the subtree of ``root`` marked by
+    :cpp:func:`lm::Component::mark_dirty` and clears the flags.
+    The components are marked when they are created, and when their state is modified,
+    e.g., the films on the accumulation, or the scenes and the asset groups on the edits.
+    Thus the components not contained in the snapshot are also written.
+    The descendants of a modified component are written together with it.
+    The checkpoint is applied to the state restored from the snapshot
+    with :cpp:func:`lm::serial::load_checkpoint`.
+    The function must be called when no thread modifies the components,
+    e.g., between the passes of the scheduler.
+    \endrst
+*/
+LM_PUBLIC_API void save_checkpoint(std::ostream& stream, Component* root, const Json& info);
+
+/*!
+    \brief Load a checkpoint.
+    \param stream Input stream.
+    \param root Root component.
+    \return Additional information given to :cpp:func:`lm::serial::save_checkpoint`.
+
+    \rst
+    The components in the checkpoint must exist in the subtree of ``root``
+    with the same implementations, that is, the state must be restored
+    from the snapshot the checkpoint is based on.
+    \endrst
+*/
+LM_PUBLIC_API Json load_checkpoint(std::istream& stream, Component* root);
+
+/*!
+    \brief Load an array referring to the blob of a snapshot if possible.
+    \param ar Input archive.
+    \param v Array.
+    \param n Number of the loaded elements.
+    \return Pointer to the loaded elements.
+
+    \rst
+    This function loads the array written as ``std::vector<T>``.
+    If the array is stored as a blob of the snapshot, this function returns the pointer
+    to the memory-mapped blob without copy, keeping ``v`` empty.
+    In this case, the component must keep :cpp:func:`lm::InputArchive::blobs_owner`
+    while it refers to the blob. Otherwise the array is loaded to ``v``.
+    \endrst
+*/
+template <typename T, typename A>
+std::enable_if_t<is_blob_serializable<T>::value, const T*>
+load_view(InputArchive& ar, std::vector<T, A>& v, std::size_t& n) {
+    cereal::size_type size;
+    ar(cereal::make_size_tag(size));
+    n = static_cast<std::size_t>(size);
+    if (const auto* p = cereal::load_blob<T>(ar, size); p) {
+        v.clear();
+        return p;
+    }
+    cereal::load_elements(ar, v, size);
+    return v.data();
+}
+
 /*!
     @}
 */
@@ -7,6 +7,7 @@
 
 #include "common.h"
 #include <cereal/archives/portable_binary.hpp>
+#include <memory>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -21,33 +22,99 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
     \rst
     We use cereal's portal binary archive as a default output archive type.
     This type is used as an argument type of :cpp:func:`lm::Component::save` function.
+
+    If the stream for blobs is given, large arrays of the types satisfying
+    :cpp:class:`lm::serial::is_blob_serializable` are written to the stream for blobs
+    as raw bytes, and the archive only records the offsets to the arrays.
+
+    In the native mode enabled by :cpp:func:`lm::OutputArchive::set_native`,
+    the values are written in the byte order of the host without conversion,
+    and the arrays of the blob serializable types are written as single blocks
+    instead of element by element. The stream written in the native mode
+    must be read in the native mode on the platform with the same layouts of the types.
     \endrst
 */
 class OutputArchive final : public cereal::OutputArchive<OutputArchive, cereal::AllowEmptyClassElision> {
+public:
+    //! Minimum size of an array in bytes stored as a blob
+    static constexpr std::size_t BlobThreshold = 64 * 1024;
+
+    //! Alignment of the blobs
+    static constexpr std::uint64_t BlobAlignment = 64;
+
 private:
     // Locator of the root component
     std::string root_loc_;
     cereal::PortableBinaryOutputArchive archive_; 
 
+    // Stream for blobs. nullptr if disabled.
+    std::ostream* blobs_ = nullptr;
+    std::uint64_t blobs_size_ = 0;
+
+    // Underlying stream written directly in the native mode
+    std::ostream* stream_;
+    bool native_ = false;
+
 public:
     OutputArchive(std::ostream& stream)
         : OutputArchive(stream, "")
     {}
 
-    OutputArchive(std::ostream& stream, const std::string& root_loc)
+    OutputArchive(std::ostream& stream, const std::string& root_loc, std::ostream* blobs = nullptr)
         : cereal::OutputArchive<OutputArchive, cereal::AllowEmptyClassElision>(this)
         , archive_(stream)
         , root_loc_(root_loc)
+        , blobs_(blobs)
+        , stream_(&stream)
     {}
 
     template <std::size_t DataSize> inline
     void saveBinary(const void* data, std::size_t size) {
+        if (native_) {
+            const auto written = stream_->rdbuf()->sputn(reinterpret_cast<const char*>(data), std::streamsize(size));
+            if (written != std::streamsize(size)) {
+                throw cereal::Exception("Failed to write " + std::to_string(size) + " bytes to output stream! Wrote " + std::to_string(written));
+            }
+            return;
+        }
         archive_.saveBinary<DataSize>(data, size);
     }
 
     std::string root_loc() const {
         return root_loc_;
     }
+
+public:
+    // Check if large arrays are stored as blobs
+    bool use_blobs() const {
+        return blobs_ != nullptr;
+    }
+
+    // Write an array as a blob. Returns the offset in the blob region.
+    std::uint64_t add_blob(const void* data, std::size_t size) {
+        static const char zeros[BlobAlignment] = {};
+        const auto offset = (blobs_size_ + BlobAlignment - 1) / BlobAlignment * BlobAlignment;
+        blobs_->write(zeros, std::streamsize(offset - blobs_size_));
+        blobs_->write(reinterpret_cast<const char*>(data), std::streamsize(size));
+        blobs_size_ = offset + size;
+        return offset;
+    }
+
+    // Size of the blob region in bytes
+    std::uint64_t blobs_size() const {
+        return blobs_size_;
+    }
+
+public:
+    // Enable or disable the native mode for the values written after this call
+    void set_native(bool native) {
+        native_ = native;
+    }
+
+    // Check if the values are written in the native mode
+    bool native() const {
+        return native_;
+    }
 };
 
 /*!
@@ -71,6 +138,16 @@ private:
     };
     std::vector<WeakptrAddressLocPair> weakptr_loc_pairs_;
 
+    // Region of the blobs
+    bool use_blobs_ = false;
+    const char* blobs_ = nullptr;
+    std::uint64_t blobs_size_ = 0;
+    std::shared_ptr<const void> blobs_owner_;
+
+    // Underlying stream read directly in the native mode
+    std::istream* stream_;
+    bool native_ = false;
+
 public:
     InputArchive(std::istream& stream)
         : InputArchive(stream, "")
@@ -80,10 +157,18 @@ public:
         : cereal::InputArchive<InputArchive, cereal::AllowEmptyClassElision>(this)
         , archive_(stream)
         , root_loc_(root_loc)
+        , stream_(&stream)
     {}
 
     template <std::size_t DataSize> inline
     void loadBinary(void* const data, std::size_t size) {
+        if (native_) {
+            const auto read = stream_->rdbuf()->sgetn(reinterpret_cast<char*>(data), std::streamsize(size));
+            if (read != std::streamsize(size)) {
+                throw cereal::Exception("Failed to read " + std::to_string(size) + " bytes from input stream! Read " + std::to_string(read));
+            }
+            return;
+        }
         archive_.loadBinary<DataSize>(data, size);
     }
 
@@ -105,6 +190,46 @@ public:
             func(p.address, p.loc);
         }
     }
+
+public:
+    // Enable blobs with the region. The region is kept alive by the owner.
+    void set_blobs(const char* data, std::uint64_t size, std::shared_ptr<const void> owner) {
+        use_blobs_ = true;
+        blobs_ = data;
+        blobs_size_ = size;
+        blobs_owner_ = std::move(owner);
+    }
+
+    // Check if large arrays are stored as blobs
+    bool use_blobs() const {
+        return use_blobs_;
+    }
+
+    // Get pointer to the blob. Returns nullptr if the range is invalid.
+    const char* blob(std::uint64_t offset, std::uint64_t size) const {
+        if (offset > blobs_size_ || size > blobs_size_ - offset) {
+            return nullptr;
+        }
+        return blobs_ + offset;
+    }
+
+    // Owner of the blob region.
+    // Keep the pointer to refer to the blobs after the archive is destroyed.
+    const std::shared_ptr<const void>& blobs_owner() const {
+        return blobs_owner_;
+    }
+
+public:
+    // Enable or disable the native mode for the values read after this call.
+    // The mode must match the one used to write the values.
+    void set_native(bool native) {
+        native_ = native;
+    }
+
+    // Check if the values are read in the native mode
+    bool native() const {
+        return native_;
+    }
 };
 
 /*!
@@ -0,0 +1,134 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include "math.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+LM_NAMESPACE_BEGIN(spectrum)
+
+/*!
+    \addtogroup spectrum
+    @{
+*/
+
+//! Lower bound of the visible wavelengths in nm.
+constexpr Float LambdaMin = 380_f;
+
+//! Upper bound of the visible wavelengths in nm.
+constexpr Float LambdaMax = 720_f;
+
+//! Number of wavelengths transported per path.
+constexpr int NumWavelengths = 4;
+
+/*!
+    \brief Convert a wavelength to the RGB response.
+    \param lambda Wavelength in nm.
+    \return Linear sRGB response of the wavelength.
+
+    \rst
+    This function evaluates the CIE 1931 color matching functions with the multi-lobe
+    analytic approximation [Wyman et al. 2013] and converts them to the linear sRGB color space.
+    The response is normalized so that the average over the wavelengths uniformly distributed
+    in [:cpp:var:`lm::spectrum::LambdaMin`, :cpp:var:`lm::spectrum::LambdaMax`] is one for each channel.
+    That is, a path carrying the RGB throughput independent of the wavelength
+    gives the same contribution as RGB rendering in expectation.
+    The response can be negative outside of the gamut of the sRGB color space.
+    \endrst
+*/
+static Vec3 wavelength_to_rgb(Float lambda) {
+    const auto xyz_to_rgb = [](Float lambda) -> Vec3 {
+        const auto g = [lambda](Float mu, Float s1, Float s2) -> Float {
+            const auto t = (lambda - mu) / (lambda < mu ? s1 : s2);
+            return std::exp(-.5_f * t * t);
+        };
+        const auto x = 1.056_f*g(599.8_f, 37.9_f, 31.0_f) + .362_f*g(442.0_f, 16.0_f, 26.7_f) - .065_f*g(501.1_f, 20.4_f, 26.2_f);
+        const auto y = .821_f*g(568.8_f, 46.9_f, 40.5_f) + .286_f*g(530.9_f, 16.3_f, 31.1_f);
+        const auto z = 1.217_f*g(437.0_f, 11.8_f, 36.0_f) + .681_f*g(459.0_f, 26.0_f, 13.8_f);
+        return Vec3(
+             3.2404542_f*x - 1.5371385_f*y - .4985314_f*z,
+            -.9692660_f*x  + 1.8760108_f*y + .0415560_f*z,
+             .0556434_f*x  - .2040259_f*y  + 1.0572252_f*z);
+    };
+
+    // Average response over the visible wavelengths, computed once
+    static const Vec3 norm = [&]() -> Vec3 {
+        constexpr int N = 1024;
+        Vec3 sum(0_f);
+        for (int i = 0; i < N; i++) {
+            sum += xyz_to_rgb(LambdaMin + (LambdaMax - LambdaMin) * (i + .5_f) / N);
+        }
+        return sum / Float(N);
+    }();
+
+    return xyz_to_rgb(lambda) / norm;
+}
+
+/*!
+    \brief Wavelengths transported by a path.
+
+    \rst
+    This structure represents the wavelengths sampled with hero wavelength sampling [Wilkie et al. 2014].
+    The first wavelength is the hero wavelength and the others are placed
+    at the equal intervals in the visible range.
+    Each wavelength is uniformly distributed in the visible range,
+    so the average of the RGB responses of the wavelengths is an unbiased estimate of the color.
+    When the path is scattered by a dispersive material depending on the hero wavelength,
+    the secondary wavelengths are terminated with :cpp:func:`lm::spectrum::Wavelengths::terminate_secondary`,
+    after which the path only carries the hero wavelength.
+    \endrst
+*/
+struct Wavelengths {
+    Float lambda[NumWavelengths];   //!< Wavelengths in nm. lambda[0] is the hero wavelength.
+    bool hero_only = false;         //!< True if the secondary wavelengths are terminated.
+
+    /*!
+        \brief Sample wavelengths.
+        \param u Uniform random number in [0,1).
+        \return Sampled wavelengths.
+    */
+    static Wavelengths sample(Float u) {
+        Wavelengths w;
+        const auto range = LambdaMax - LambdaMin;
+        for (int i = 0; i < NumWavelengths; i++) {
+            const auto v = u + Float(i) / NumWavelengths;
+            w.lambda[i] = LambdaMin + range * (v - std::floor(v));
+        }
+        return w;
+    }
+
+    //! Get hero wavelength.
+    Float hero() const {
+        return lambda[0];
+    }
+
+    //! Terminate secondary wavelengths.
+    void terminate_secondary() {
+        hero_only = true;
+    }
+
+    /*!
+        \brief Weight converting the contribution of the path to RGB.
+        \return RGB weight multiplied to the contribution.
+    */
+    Vec3 weight() const {
+        if (hero_only) {
+            return wavelength_to_rgb(lambda[0]);
+        }
+        Vec3 w(0_f);
+        for (int i = 0; i < NumWavelengths; i++) {
+            w += wavelength_to_rgb(lambda[i]);
+        }
+        return w / Float(NumWavelengths);
+    }
+};
+
+/*!
+    @}
+*/
+
+LM_NAMESPACE_END(spectrum)
+LM_NAMESPACE_END(LM_NAMESPACE)
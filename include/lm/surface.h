@@ -60,6 +60,7 @@ struct PointGeometry {
     Vec3 u, v;              //!< Orthogonal tangent vectors.
     Mat3 to_world;          //!< Matrix to convert to world coordinates.
     Mat3 to_local;          //!< Matrix to convert to local shading coordinates.
+    Float footprint = 0_f;  //!< Width of the ray footprint in texture coordinates. Zero if unknown.
 
     /*!
         \brief Make degenerated point.
@@ -74,6 +74,43 @@ public:
     */
     virtual Vec3 eval(Vec2 t) const = 0;
 
+    /*!
+        \brief Evaluate color component of the texture for a batch of texture coordinates.
+        \param n Number of texture coordinates.
+        \param t Texture coordinates.
+        \param out Evaluated colors.
+
+        \rst
+        This function evaluates the colors of multiple texture coordinates at once.
+        The implementation with a large overhead per call, e.g., a texture implemented in Python,
+        can amortize the overhead over the batch.
+        The default implementation calls :cpp:func:`lm::Texture::eval` for each texture coordinates.
+        \endrst
+    */
+    virtual void eval_batch(int n, const Vec2* t, Vec3* out) const {
+        for (int i = 0; i < n; i++) {
+            out[i] = eval(t[i]);
+        }
+    }
+
+    /*!
+        \brief Evaluate color component of the texture filtered by the footprint.
+        \param t Texture coordinates.
+        \param footprint Width of the footprint in texture coordinates.
+
+        \rst
+        This function evaluates color of the texture averaged over the footprint
+        around the texture coordinates, e.g., given by :cpp:member:`lm::PointGeometry::footprint`.
+        The implementation can use a prefiltered lower-resolution texture
+        to reduce the memory traffic of the lookups.
+        The default implementation ignores the footprint and calls :cpp:func:`lm::Texture::eval`.
+        \endrst
+    */
+    virtual Vec3 eval_filtered(Vec2 t, Float footprint) const {
+        LM_UNUSED(footprint);
+        return eval(t);
+    }
+
     /*!
         \brief Evaluate color component of the texture by pixel coordinates.
         \param x x coordinate of the texture.
@@ -0,0 +1,101 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include "component.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+LM_NAMESPACE_BEGIN(trace)
+
+/*!
+    \addtogroup trace
+    @{
+*/
+
+//! Default tracing backend type
+constexpr const char* DefaultType = "chrome";
+
+/*!
+    \brief Initialize tracing context.
+    \param type Type of tracing backend.
+    \param prop Properties for configuration.
+
+    \rst
+    Unlike the other subsystems, tracing is not initialized by :cpp:func:`lm::init`
+    and the events are ignored until this function is called.
+    The recorded events are written when the context is shut down,
+    e.g., by :cpp:func:`lm::shutdown`.
+    \endrst
+*/
+LM_PUBLIC_API void init(const std::string& type = DefaultType, const Json& prop = {});
+
+/*!
+    \brief Shutdown tracing context.
+*/
+LM_PUBLIC_API void shutdown();
+
+/*!
+    \brief Check if tracing is enabled.
+*/
+LM_PUBLIC_API bool enabled();
+
+/*!
+    \brief Begin an event in the current thread.
+    \param name Name of the event.
+
+    \rst
+    The events of a thread must be nested, i.e.,
+    :cpp:func:`lm::trace::end` ends the event begun most recently in the thread.
+    You may use :class:`ScopedEvent` class to record an event inside a scope.
+    \endrst
+*/
+LM_PUBLIC_API void begin(const std::string& name);
+
+/*!
+    \brief End the event begun most recently in the current thread.
+*/
+LM_PUBLIC_API void end();
+
+/*!
+    \brief Scoped guard of an event.
+
+    \rst
+    Convenience class to record an event inside a scope.
+    Use via ``LM_TRACE_SCOPE`` macro.
+    \endrst
+*/
+class ScopedEvent {
+private:
+    bool enabled_;
+
+public:
+    ScopedEvent(const std::string& name) : enabled_(enabled()) {
+        if (enabled_) {
+            begin(name);
+        }
+    }
+    ~ScopedEvent() {
+        if (enabled_) {
+            end();
+        }
+    }
+    LM_DISABLE_COPY_AND_MOVE(ScopedEvent)
+};
+
+/*!
+    @}
+*/
+
+LM_NAMESPACE_END(trace)
+LM_NAMESPACE_END(LM_NAMESPACE)
+
+/*!
+    \brief Record an event of the current scope.
+    \param name Name of the event.
+    \ingroup trace
+*/
+#define LM_TRACE_SCOPE(name) \
+    LM_NAMESPACE::trace::ScopedEvent LM_TOKENPASTE2(trace_scoped_event_, __LINE__)(name)
@@ -0,0 +1,39 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include "trace.h"
+#include "component.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+LM_NAMESPACE_BEGIN(trace)
+
+/*!
+    \addtogroup trace
+    @{
+*/
+
+/*!
+    \brief Tracing context.
+
+    \rst
+    You may implement this interface to implement user-specific tracing backend.
+    Each virtual function corresponds to API call with a free function
+    inside ``trace`` namespace. The functions can be called concurrently from multiple threads.
+    \endrst
+*/
+class TraceContext : public Component {
+public:
+    virtual void begin(const std::string& name) = 0;
+    virtual void end() = 0;
+};
+
+/*!
+    @}
+*/
+
+LM_NAMESPACE_END(trace)
+LM_NAMESPACE_END(LM_NAMESPACE)
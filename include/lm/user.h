@@ -29,6 +29,8 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
     the internal subsystems of the framework.
     This function initializes some subsystems with default types.
     If you want to configure the subsystem, you want to call each ``init()`` function afterwards.
+    If ``lazy_assets`` is true, the construction of the assets is deferred
+    until they are first referenced (see ``asset_group::default``).
     \endrst
 */
 LM_PUBLIC_API void init(const Json& prop = {});
@@ -66,15 +68,57 @@ LM_PUBLIC_API AssetGroup* assets();
 /*!
     \brief Save internal state to a file.
     \param path Output path.
+    \param compression Compression level of zstd. 0 disables the compression.
+
+    \rst
+    The state is saved as a snapshot. See :cpp:func:`lm::serial::save_snapshot`.
+    \endrst
 */
-LM_PUBLIC_API void save_state_to_file(const std::string& path);
+LM_PUBLIC_API void save_state_to_file(const std::string& path, int compression = 0);
 
 /*!
     \brief Load internal state from a file.
     \param path Input path.
+
+    \rst
+    See :cpp:func:`lm::serial::load_snapshot`.
+    \endrst
 */
 LM_PUBLIC_API void load_state_from_file(const std::string& path);
 
+/*!
+    \brief Save the modified state to a checkpoint file.
+    \param path Output path.
+    \param info Additional information, e.g., the number of processed samples.
+    \param compression Compression level of zstd. 0 disables the compression.
+
+    \rst
+    The function only writes the assets modified after the last call of
+    :cpp:func:`lm::save_state_to_file`, :cpp:func:`lm::load_state_from_file`, or this function.
+    These include the films and the schedulers updated by the rendering,
+    the assets loaded or replaced, and the edited scenes.
+    The other modifications of the assets, e.g., from Python, must be notified by
+    :cpp:func:`lm::Scene::notify_changes`, which marks all the assets to be written.
+    If the base state is not saved, all the assets are written. To resume the rendering,
+    load the base state with :cpp:func:`lm::load_state_from_file`,
+    apply the checkpoints with :cpp:func:`lm::load_checkpoint` in order,
+    and call :cpp:func:`lm::render` again. The progressive schedulers continue the
+    unfinished run from the last finished pass (see :cpp:func:`lm::scheduler::Scheduler::resuming`).
+    The schedulers can also write the checkpoints at the end of the passes
+    with ``checkpoint``, ``checkpoint_interval``, and ``checkpoint_compression`` properties.
+    See :cpp:func:`lm::serial::save_checkpoint` for detail.
+    The compressed checkpoint is detected on loading by :cpp:func:`lm::load_checkpoint`.
+    \endrst
+*/
+LM_PUBLIC_API void save_checkpoint(const std::string& path, const Json& info = {}, int compression = 0);
+
+/*!
+    \brief Load a checkpoint file.
+    \param path Input path.
+    \return Additional information given to :cpp:func:`lm::save_checkpoint`.
+*/
+LM_PUBLIC_API Json load_checkpoint(const std::string& path);
+
 /*!
     \brief Load an asset with given type.
     \tparam T Component interface type.
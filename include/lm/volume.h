@@ -40,6 +40,23 @@ public:
     */
     virtual Float max_scalar() const = 0;
 
+    /*!
+        \brief Evaluate maximum scalar value inside a region.
+        \param b Region in volume coordinates.
+        \return Upper bound of the scalar values inside the region.
+
+        \rst
+        The value is used as the local majorant of the volume, e.g., by :cpp:class:`lm::MajorantGrid`.
+        The value must not be smaller than the actual maximum inside the region,
+        but a tighter bound makes the tracking faster.
+        The default implementation returns :cpp:func:`lm::Volume::max_scalar`.
+        \endrst
+    */
+    virtual Float max_scalar_in(const Bound& b) const {
+        LM_UNUSED(b);
+        return max_scalar();
+    }
+
     /*!
         \brief Evaluate scalar value.
         \param p Position in volume coordinates.
@@ -50,6 +67,24 @@ public:
         LM_THROW_EXCEPTION_DEFAULT(Error::Unimplemented);
     }
 
+    /*!
+        \brief Evaluate scalar values at multiple positions.
+        \param ps Positions in volume coordinates.
+        \param n Number of positions.
+        \param out Evaluated scalar values. The array must contain ``n`` elements.
+
+        \rst
+        The default implementation calls :cpp:func:`lm::Volume::eval_scalar` for each position.
+        The volumes can override this function to evaluate the positions in a batch
+        without the overhead of the virtual function calls.
+        \endrst
+    */
+    virtual void eval_scalar_n(const Vec3* ps, int n, Float* out) const {
+        for (int i = 0; i < n; i++) {
+            out[i] = eval_scalar(ps[i]);
+        }
+    }
+
     // --------------------------------------------------------------------------------------------
 
     /*!
@@ -94,6 +129,261 @@ public:
         LM_UNUSED(ray, tmin, tmax, march_step, raymarch_func);
         LM_THROW_EXCEPTION_DEFAULT(Error::Unimplemented);
     }
+
+    /*!
+        \brief Callback function called for each voxel visited by the ray.
+        \param t0 Distance from the ray origin where the ray enters the voxel.
+        \param t1 Distance from the ray origin where the ray exits the voxel.
+        \retval true Continue traversal.
+        \retval false Abort traversal.
+    */
+    using VoxelFunc = std::function<bool(Float t0, Float t1)>;
+
+    /*!
+        \brief Check if the volume supports voxel traversal.
+        \return True if :cpp:func:`lm::Volume::traverse_voxels` is available.
+    */
+    virtual bool has_voxels() const {
+        return false;
+    }
+
+    /*!
+        \brief Traverse the voxels of the volume along with the ray.
+        \param ray Ray.
+        \param tmin Lower bound of the valid range of the ray.
+        \param tmax Upper bound of the valid range of the ray.
+        \param func Callback function called for each voxel in the order along the ray.
+
+        \rst
+        Unlike :cpp:func:`lm::Volume::march`, this function visits each voxel
+        intersected by the ray exactly once, where the segment of the ray passed to the callback
+        is the intersection between the ray and the voxel.
+        The voxels are the cells where the scalar values are interpolated from the same data.
+        The implementation can skip the regions where the scalar value is known to be zero,
+        so the callback is not necessarily called for the consecutive segments.
+        \endrst
+    */
+    virtual void traverse_voxels(Ray ray, Float tmin, Float tmax, const VoxelFunc& func) const {
+        LM_UNUSED(ray, tmin, tmax, func);
+        LM_THROW_EXCEPTION_DEFAULT(Error::Unimplemented);
+    }
+};
+
+/*!
+    \brief Callback function called for each cell of a grid visited by the ray.
+    \param cell Index of the cell.
+    \param t0 Start of the segment inside the cell.
+    \param t1 End of the segment inside the cell.
+    \retval true Continue traversal.
+    \retval false Abort traversal.
+*/
+using GridTraverseFunc = std::function<bool(glm::ivec3 cell, Float t0, Float t1)>;
+
+/*!
+    \brief Traverse the cells of a uniform grid along the ray.
+    \param ray Ray.
+    \param tmin Lower bound of the valid range of the ray. Must be inside the bound of the grid.
+    \param tmax Upper bound of the valid range of the ray. Must be inside the bound of the grid.
+    \param bound Bound of the grid.
+    \param res Number of cells along each axis.
+    \param func Callback function called for each cell in the order along the ray.
+    \return False if the traversal is aborted by the callback.
+
+    \rst
+    This function traverses the cells with 3D-DDA [Amanatides and Woo 1987].
+    \endrst
+*/
+static bool traverse_grid(Ray ray, Float tmin, Float tmax, const Bound& bound, glm::ivec3 res, const GridTraverseFunc& func) {
+    const auto cell_size = (bound.max - bound.min) / Vec3(res);
+    const auto p = ray.o + ray.d * tmin;
+    glm::ivec3 cell;
+    int step[3];
+    Float t_next[3];
+    Float t_delta[3];
+    for (int i = 0; i < 3; i++) {
+        cell[i] = glm::clamp(int((p[i] - bound.min[i]) / cell_size[i]), 0, res[i] - 1);
+        if (ray.d[i] == 0_f) {
+            step[i] = 0;
+            t_next[i] = Inf;
+            t_delta[i] = Inf;
+            continue;
+        }
+        step[i] = ray.d[i] > 0_f ? 1 : -1;
+        const auto boundary = bound.min[i] + (cell[i] + (step[i] > 0 ? 1 : 0)) * cell_size[i];
+        t_next[i] = (boundary - ray.o[i]) / ray.d[i];
+        t_delta[i] = cell_size[i] / std::abs(ray.d[i]);
+    }
+
+    Float t = tmin;
+    while (t < tmax) {
+        const int axis = t_next[0] < t_next[1]
+            ? (t_next[0] < t_next[2] ? 0 : 2)
+            : (t_next[1] < t_next[2] ? 1 : 2);
+        const auto t1 = std::min(t_next[axis], tmax);
+        if (t1 > t && !func(cell, t, t1)) {
+            return false;
+        }
+        t = t1;
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= res[axis]) {
+            return true;
+        }
+        t_next[axis] += t_delta[axis];
+    }
+    return true;
+}
+
+/*!
+    \brief Grid of local majorants of a volume.
+
+    \rst
+    This class partitions the bound of a volume into a uniform grid
+    and holds the maximum scalar value inside each cell computed by :cpp:func:`lm::Volume::max_scalar_in`.
+    Tracking algorithms can use the piecewise constant majorants
+    along a ray instead of the global maximum, which saves most tentative collisions in sparse volumes.
+    Optionally the grid also holds the control densities of the cells built by
+    :cpp:func:`lm::MajorantGrid::build_controls`, which are used by the estimators
+    with control variates, e.g., residual ratio tracking.
+    \endrst
+*/
+class MajorantGrid {
+private:
+    Bound bound_;               // Bound of the grid
+    int res_ = 0;               // Number of cells along each axis
+    std::vector<Float> cells_;      // Majorants of the cells
+    std::vector<Float> controls_;   // Control densities of the cells. Empty if not built.
+
+public:
+    //! \cond
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(bound_, res_, cells_, controls_);
+    }
+    //! \endcond
+
+    /*!
+        \brief Build the grid.
+        \param volume Volume.
+        \param res Number of cells along each axis.
+    */
+    void build(const Volume* volume, int res) {
+        bound_ = volume->bound();
+        res_ = res;
+        cells_.assign(res * res * res, 0_f);
+        const auto cell_size = (bound_.max - bound_.min) / Float(res);
+        for (int z = 0; z < res; z++) {
+            for (int y = 0; y < res; y++) {
+                for (int x = 0; x < res; x++) {
+                    Bound b;
+                    b.min = bound_.min + Vec3(x, y, z) * cell_size;
+                    b.max = b.min + cell_size;
+                    cells_[(z * res + y) * res + x] = volume->max_scalar_in(b);
+                }
+            }
+        }
+        controls_.clear();
+    }
+
+    /*!
+        \brief Build the control densities of the cells.
+        \param volume Volume used to build the grid.
+        \param samples Number of the samples along each axis of a cell.
+
+        \rst
+        The control density of a cell is the average of the densities
+        evaluated at :math:`\mathrm{samples}^3` points placed regularly inside the cell,
+        clamped into the range between zero and the majorant of the cell.
+        This function must be called after :cpp:func:`lm::MajorantGrid::build`.
+        \endrst
+    */
+    void build_controls(const Volume* volume, int samples) {
+        controls_.assign(cells_.size(), 0_f);
+        const auto cell_size = (bound_.max - bound_.min) / Float(res_);
+        std::vector<Vec3> ps(size_t(samples) * samples * samples);
+        std::vector<Float> ds(ps.size());
+        for (int z = 0; z < res_; z++) {
+            for (int y = 0; y < res_; y++) {
+                for (int x = 0; x < res_; x++) {
+                    const int i = (z * res_ + y) * res_ + x;
+                    if (cells_[i] == 0_f) {
+                        continue;
+                    }
+                    const auto min = bound_.min + Vec3(x, y, z) * cell_size;
+                    for (int j = 0; j < int(ps.size()); j++) {
+                        const auto p = (Vec3(j % samples, (j / samples) % samples, j / (samples * samples)) + .5_f) / Float(samples);
+                        ps[j] = min + p * cell_size;
+                    }
+                    volume->eval_scalar_n(ps.data(), int(ps.size()), ds.data());
+                    Float sum = 0_f;
+                    for (auto d : ds) {
+                        sum += d;
+                    }
+                    controls_[i] = glm::clamp(sum / Float(ds.size()), 0_f, cells_[i]);
+                }
+            }
+        }
+    }
+
+    //! Check if the control densities are built.
+    bool has_controls() const {
+        return !controls_.empty();
+    }
+
+    /*!
+        \brief Callback function called for each segment of the ray.
+        \param t0 Start of the segment.
+        \param t1 End of the segment.
+        \param majorant Majorant of the segment.
+        \retval true Continue traversal.
+        \retval false Abort traversal.
+    */
+    using TraverseFunc = std::function<bool(Float t0, Float t1, Float majorant)>;
+
+    /*!
+        \brief Traverse the cells along the ray.
+        \param ray Ray.
+        \param tmin Lower bound of the valid range of the ray. Must be inside the bound of the grid.
+        \param tmax Upper bound of the valid range of the ray. Must be inside the bound of the grid.
+        \param func Callback function called for each cell in the order along the ray.
+
+        \rst
+        This function traverses the cells with :cpp:func:`lm::traverse_grid`.
+        \endrst
+    */
+    void traverse(Ray ray, Float tmin, Float tmax, const TraverseFunc& func) const {
+        traverse_grid(ray, tmin, tmax, bound_, glm::ivec3(res_), [&](glm::ivec3 cell, Float t0, Float t1) -> bool {
+            return func(t0, t1, cells_[(cell.z * res_ + cell.y) * res_ + cell.x]);
+        });
+    }
+
+    /*!
+        \brief Callback function called for each segment of the ray with the control density.
+        \param t0 Start of the segment.
+        \param t1 End of the segment.
+        \param majorant Majorant of the segment.
+        \param control Control density of the segment.
+        \retval true Continue traversal.
+        \retval false Abort traversal.
+    */
+    using TraverseControlFunc = std::function<bool(Float t0, Float t1, Float majorant, Float control)>;
+
+    /*!
+        \brief Traverse the cells along the ray with the control densities.
+        \param ray Ray.
+        \param tmin Lower bound of the valid range of the ray. Must be inside the bound of the grid.
+        \param tmax Upper bound of the valid range of the ray. Must be inside the bound of the grid.
+        \param func Callback function called for each cell in the order along the ray.
+
+        \rst
+        The control densities must be built with :cpp:func:`lm::MajorantGrid::build_controls`.
+        \endrst
+    */
+    void traverse_controls(Ray ray, Float tmin, Float tmax, const TraverseControlFunc& func) const {
+        traverse_grid(ray, tmin, tmax, bound_, glm::ivec3(res_), [&](glm::ivec3 cell, Float t0, Float t1) -> bool {
+            const int i = (cell.z * res_ + cell.y) * res_ + cell.x;
+            return func(t0, t1, cells_[i], controls_[i]);
+        });
+    }
 };
 
 /*!
@@ -25,10 +25,36 @@ def array(*args, **kwargs):
     kwargs.setdefault('dtype', np.float32)
     return np.array(*args, **kwargs)
 
+class Buffer:
+    """Binary buffer wrapping a numpy array, see :func:`buffer`"""
+    __lm_buffer__ = True
+    def __init__(self, a):
+        self.array = a
+
+def buffer(a):
+    """Pass a numpy array to the framework as a binary buffer.
+
+    The underlying memory of the array is copied into the properties as a single binary value,
+    so that large arrays, e.g., the vertices of a mesh for ``mesh::raw``,
+    are read without converting each number to a JSON element.
+    The array is converted to a contiguous array if necessary.
+
+    Example::
+
+        mesh = lm.load_mesh('mesh', 'raw',
+            ps=lm.buffer(vs), ns=lm.buffer(ns), ts=lm.buffer(ts),
+            fs={'p': lm.buffer(fs), 't': lm.buffer(fs), 'n': lm.buffer(fs)})
+    """
+    return Buffer(np.ascontiguousarray(a))
+
 def registered_components():
     """Get a list of registered components"""
     comps = []
     def print_name(name):
         comps.append(name)
     comp.foreachRegistered(print_name)
-    return comps
\ No newline at end of file
+    return comps
+from . import distributed
+from . import server
+from . import preview
+from . import sequence
@@ -0,0 +1,207 @@
+"""Distributed rendering with mergeable partial films
+
+A coordinator partitions the sample space into tasks and dispatches them
+to worker processes connected via TCP. Each worker renders a task with
+its own copy of the scene and sends back the partial film serialized
+with ``Component.save()``. Since ``Film.save()`` saves the film as an
+image, the worker calls ``Component.save()`` explicitly on the film.
+The coordinator merges the partial films weighted by the number of
+processed samples. If a worker fails or times out, the task assigned to
+the worker is reissued to the other workers.
+
+Example::
+
+    # Coordinator
+    coord = lm.distributed.Coordinator(('0.0.0.0', 5000))
+    tasks = lm.distributed.partition('spp', 1024, 64)
+    coord.render(film, tasks)
+    coord.close()
+
+    # Worker
+    def render(params):
+        renderer = lm.load_renderer('renderer', 'pt', scene=scene.loc(), output=film.loc(), **params)
+        result = renderer.render()
+        return film, result['processed']
+    lm.distributed.worker(('coordinator-host', 5000), render)
+"""
+
+import queue
+import threading
+from multiprocessing.connection import Listener, Client
+
+try:
+    from pylm import load_film, Component
+except:
+    from .pylm import load_film, Component
+
+DefaultAuthKey = b'lightmetrica'
+
+
+def partition(key, total, num_tasks, seed=0):
+    """Partition the sample space into tasks.
+
+    Args:
+        key (str): Name of the renderer parameter specifying the number of samples,
+                   e.g., ``spp`` or ``num_samples``.
+        total (int): Total number of samples.
+        num_tasks (int): Number of tasks.
+        seed (int): Base seed. Each task is given a different seed.
+
+    Returns:
+        List of renderer parameters for each task.
+    """
+    num_tasks = max(1, min(num_tasks, total))
+    tasks = []
+    for i in range(num_tasks):
+        n = total // num_tasks + (1 if i < total % num_tasks else 0)
+        tasks.append({key: n, 'seed': seed + i})
+    return tasks
+
+
+class Coordinator:
+    """Coordinator of distributed rendering.
+
+    Args:
+        address (tuple): Address to listen to.
+        authkey (bytes): Authentication key shared with workers.
+        timeout (float): Timeout in seconds for a task. ``None`` to wait indefinitely.
+    """
+
+    def __init__(self, address, authkey=DefaultAuthKey, timeout=None):
+        self.listener = Listener(address, authkey=authkey)
+        self.timeout = timeout
+        self.conns = queue.Queue()
+        self.accepted = []
+        self.lock = threading.Lock()
+        self.closed = False
+        threading.Thread(target=self._accept, daemon=True).start()
+
+    def _accept(self):
+        while not self.closed:
+            try:
+                conn = self.listener.accept()
+            except Exception:
+                continue
+            with self.lock:
+                # All connections are recorded so that close() reaches every worker
+                self.accepted.append(conn)
+                if self.closed:
+                    self._exit(conn)
+                    continue
+            self.conns.put(conn)
+
+    @staticmethod
+    def _exit(conn):
+        # Stop the worker connected with conn
+        try:
+            if not conn.closed:
+                conn.send(('exit',))
+                conn.close()
+        except Exception:
+            pass
+
+    def render(self, film, tasks):
+        """Render the tasks with the connected workers.
+
+        The partial films are merged into ``film`` as they arrive,
+        so ``film`` always holds the estimate normalized by the samples merged so far.
+
+        Args:
+            film (lm.Film): Output film, which must be ``film::bitmap``.
+            tasks (list): Renderer parameters for each task, e.g., by :func:`partition`.
+
+        Returns:
+            Total number of processed samples.
+        """
+        size = film.size()
+        partial = load_film('film_distributed_partial', 'bitmap', w=size.w, h=size.h)
+        film.clear()
+
+        pending = queue.Queue()
+        for i, task in enumerate(tasks):
+            pending.put((i, task))
+        remaining = [len(tasks)]
+        processed = [0]
+        lock = threading.Lock()
+        finished = threading.Event()
+        if not tasks:
+            finished.set()
+
+        def merge(n, data):
+            # film <- (film * processed + partial * n) / (processed + n)
+            with lock:
+                partial.load(data)
+                partial.rescale(n)
+                film.rescale(processed[0])
+                film.accum(partial)
+                processed[0] += n
+                film.rescale(1 / processed[0])
+                remaining[0] -= 1
+                if remaining[0] == 0:
+                    finished.set()
+
+        def serve(conn):
+            while not finished.is_set():
+                try:
+                    index, task = pending.get(timeout=0.1)
+                except queue.Empty:
+                    continue
+                try:
+                    conn.send(('task', index, task))
+                    if not conn.poll(self.timeout):
+                        raise TimeoutError()
+                    _, _, n, data = conn.recv()
+                except Exception:
+                    # Reissue the task to other workers and drop the connection
+                    pending.put((index, task))
+                    conn.close()
+                    return
+                merge(n, data)
+            self.conns.put(conn)
+
+        # Dispatch tasks to the workers connected so far and connected later
+        threads = []
+        while not finished.is_set():
+            try:
+                conn = self.conns.get(timeout=0.1)
+            except queue.Empty:
+                continue
+            t = threading.Thread(target=serve, args=(conn,), daemon=True)
+            t.start()
+            threads.append(t)
+
+        # Wait for the connections to be returned to the queue
+        for t in threads:
+            t.join()
+        return processed[0]
+
+    def close(self):
+        """Stop the workers and close the coordinator."""
+        with self.lock:
+            self.closed = True
+            conns = list(self.accepted)
+        for conn in conns:
+            self._exit(conn)
+        self.listener.close()
+
+
+def worker(address, render_func, authkey=DefaultAuthKey):
+    """Run a worker of distributed rendering.
+
+    Args:
+        address (tuple): Address of the coordinator.
+        render_func (function): Function to render a task.
+            The function takes the renderer parameters of the task and
+            returns a tuple of the rendered film and the number of processed samples.
+        authkey (bytes): Authentication key shared with the coordinator.
+    """
+    conn = Client(address, authkey=authkey)
+    while True:
+        msg = conn.recv()
+        if msg[0] == 'exit':
+            break
+        _, index, task = msg
+        film, processed = render_func(task)
+        # Film.save() saves an image, so the serialization of Component is called explicitly
+        conn.send(('result', index, processed, Component.save(film)))
+    conn.close()
@@ -0,0 +1,214 @@
+"""Progressive preview streaming of films
+
+A preview stream watches the snapshots of a film published by the progressive renderers
+(see :cpp:func:`lm::Film::publish`) and sends the compact preview frames
+to a viewer, e.g., a Jupyter notebook, or a remote viewer via a websocket or a ZMQ socket.
+The snapshots are read with :cpp:func:`lm::Film::snapshot`, which does not lock the film,
+so the render workers are not stalled by the preview.
+
+The frames are processed on a background thread at a configurable rate.
+Each frame is downsampled by a box filter, tonemapped to 8-bit sRGB-like values
+with the exposure and the gamma, and encoded either as a key frame
+or as a delta frame, which is the difference from the previously sent frame
+compressed with zlib. Since the successive snapshots of a progressive rendering
+differ slightly, the delta frames are much smaller than the key frames.
+The encoded frames are sent by another background thread through a bounded queue.
+If the transport cannot keep up, the newest frame is dropped
+and the next frame is encoded against the last frame in the queue,
+so a slow viewer never blocks the encoder nor the renderer.
+
+Example::
+
+    import zmq
+    socket = zmq.Context().socket(zmq.PUB)
+    socket.bind('tcp://*:5556')
+    with lm.preview.PreviewStream(film, socket.send, rate=10, downsample=2):
+        renderer.render()
+
+    # Viewer
+    decoder = lm.preview.PreviewDecoder()
+    img = decoder.decode(socket.recv())   # (h,w,3) uint8 array, top row first
+"""
+
+import queue
+import struct
+import threading
+import zlib
+import numpy as np
+
+# Header of a frame: magic, version, type, width, height, sequence number
+_Magic = b'LMPV'
+_Version = 1
+_Header = struct.Struct('<4sBBHHI')
+KeyFrame = 0
+DeltaFrame = 1
+
+
+def tonemap(img, downsample=1, exposure=1.0, gamma=2.2):
+    """Convert a film snapshot to a preview image.
+
+    Args:
+        img (numpy.ndarray): Pixel values of shape ``(h,w,3)`` with the bottom row first.
+        downsample (int): Downsampling factor of the box filter.
+        exposure (float): Scale applied to the pixel values.
+        gamma (float): Gamma of the tonemapping.
+
+    Returns:
+        numpy.ndarray: Preview image of shape ``(h/downsample,w/downsample,3)``
+        of ``uint8`` with the top row first.
+    """
+    h, w, _ = img.shape
+    k = max(int(downsample), 1)
+    hk, wk = h // k, w // k
+    x = np.asarray(img[:hk*k, :wk*k], dtype=np.float32)
+    if k > 1:
+        x = x.reshape(hk, k, wk, k, 3).mean(axis=(1, 3))
+    x = np.power(np.clip(x * exposure, 0, 1), 1 / gamma)
+    return np.ascontiguousarray(np.flip((x * 255 + 0.5).astype(np.uint8), axis=0))
+
+
+def encode(frame, seq, prev=None, level=1):
+    """Encode a preview image into a frame.
+
+    Args:
+        frame (numpy.ndarray): Preview image of ``uint8``.
+        seq (int): Sequence number of the frame.
+        prev (numpy.ndarray): Previous preview image the delta is computed against.
+            ``None`` to encode a key frame.
+        level (int): Compression level of zlib.
+
+    Returns:
+        bytes: Encoded frame.
+    """
+    h, w, _ = frame.shape
+    if prev is None or prev.shape != frame.shape:
+        kind, payload = KeyFrame, frame
+    else:
+        # The difference wraps around in uint8
+        kind, payload = DeltaFrame, frame - prev
+    header = _Header.pack(_Magic, _Version, kind, w, h, seq & 0xffffffff)
+    return header + zlib.compress(payload.tobytes(), level)
+
+
+class PreviewDecoder:
+    """Decoder of the frames sent by :class:`PreviewStream`."""
+
+    def __init__(self):
+        self.frame = None
+        self.seq = None
+
+    def decode(self, data):
+        """Decode a frame.
+
+        Args:
+            data (bytes): Encoded frame.
+
+        Returns:
+            numpy.ndarray: Preview image of shape ``(h,w,3)`` of ``uint8``,
+            or ``None`` if a delta frame is received before any key frame.
+        """
+        magic, version, kind, w, h, seq = _Header.unpack_from(data)
+        if magic != _Magic or version != _Version:
+            raise ValueError('Invalid preview frame')
+        payload = np.frombuffer(zlib.decompress(data[_Header.size:]), dtype=np.uint8).reshape(h, w, 3)
+        if kind == KeyFrame:
+            self.frame = payload.copy()
+        elif self.frame is None or self.frame.shape != payload.shape:
+            return None
+        else:
+            self.frame = self.frame + payload
+        self.seq = seq
+        return self.frame
+
+
+class PreviewStream:
+    """Stream the preview frames of a film on background threads.
+
+    Args:
+        film (lm.Film): Film to be previewed.
+        send (callable): Function sending an encoded frame of ``bytes``,
+            e.g., ``socket.send`` of a ZMQ socket or ``send_bytes`` of a websocket.
+            The function is called on the sender thread.
+        rate (float): Maximum number of frames per second.
+        downsample (int): Downsampling factor of the frames.
+        exposure (float): Scale applied to the pixel values.
+        gamma (float): Gamma of the tonemapping.
+        keyframe_interval (int): Number of frames between the key frames.
+            The key frames let the viewers join the stream at any time.
+        queue_size (int): Maximum number of frames waiting for the transport.
+        level (int): Compression level of zlib.
+    """
+
+    def __init__(self, film, send, rate=10, downsample=1, exposure=1.0, gamma=2.2,
+                 keyframe_interval=30, queue_size=2, level=1):
+        self.film = film
+        self.send = send
+        self.interval = 1 / rate
+        self.downsample = downsample
+        self.exposure = exposure
+        self.gamma = gamma
+        self.keyframe_interval = keyframe_interval
+        self.level = level
+        self.frames = queue.Queue(maxsize=queue_size)
+        self.stopped = threading.Event()
+        self.threads = []
+        self.num_sent = 0
+        self.num_dropped = 0
+
+    def _encode_loop(self):
+        prev = None
+        last = None
+        seq = 0
+        address = lambda a: a.__array_interface__['data'][0]
+        while True:
+            stopping = self.stopped.wait(self.interval)
+            # Skip if the film has not published a new snapshot since the last frame.
+            # The last snapshot is kept alive so that its address is not reused.
+            img = self.film.snapshot()
+            if img is not None and (last is None or address(img) != address(last)):
+                last = img
+                frame = tonemap(img, self.downsample, self.exposure, self.gamma)
+                key = prev is None or seq % self.keyframe_interval == 0
+                data = encode(frame, seq, None if key else prev, self.level)
+                try:
+                    self.frames.put_nowait(data)
+                    prev = frame
+                    seq += 1
+                except queue.Full:
+                    # Drop the frame. The next frame is encoded against the last queued one.
+                    self.num_dropped += 1
+            if stopping:
+                break
+        self.frames.put(None)
+
+    def _send_loop(self):
+        while True:
+            data = self.frames.get()
+            if data is None:
+                break
+            self.send(data)
+            self.num_sent += 1
+
+    def start(self):
+        """Start streaming."""
+        self.stopped.clear()
+        self.threads = [
+            threading.Thread(target=self._encode_loop, daemon=True),
+            threading.Thread(target=self._send_loop, daemon=True)
+        ]
+        for t in self.threads:
+            t.start()
+        return self
+
+    def stop(self):
+        """Stop streaming after sending the frame of the last snapshot."""
+        self.stopped.set()
+        for t in self.threads:
+            t.join()
+        self.threads = []
+
+    def __enter__(self):
+        return self.start()
+
+    def __exit__(self, *args):
+        self.stop()
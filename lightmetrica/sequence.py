@@ -0,0 +1,124 @@
+"""Pipelined rendering of animation sequences
+
+Rendering an animation frame by frame leaves the cores idle while the assets are updated,
+the scene is built, and the image is written. :class:`FrameSequence` overlaps these steps
+with the rendering: while frame N is rendered, a side thread writes the image of frame N-1
+and updates the scene to frame N+1, including the build or the refit
+of the acceleration structure.
+
+The pipeline alternates two slots, each of which holds the assets of a frame in flight,
+typically a scene with its own acceleration structure, a film, and a renderer.
+The assets not changed by the animation, e.g., the meshes of the static objects
+and the materials, can be shared by the slots.
+The side thread runs its parallel loops with a budget of ``side_threads`` threads
+(see :cpp:func:`lm::parallel::set_thread_budget`) and the renderer uses the remaining threads.
+
+Example::
+
+    def make_slot(i):
+        accel = lm.load_accel('accel{}'.format(i), 'sahbvh')
+        scene = lm.load_scene('scene{}'.format(i), 'default', accel=accel)
+        film = lm.load_film('film{}'.format(i), 'bitmap', w=1920, h=1080)
+        renderer = lm.load_renderer('renderer{}'.format(i), 'pt',
+            scene=scene.loc(), output=film.loc(), scheduler='sample', spp=64)
+        return {'scene': scene, 'film': film, 'renderer': renderer}
+
+    def update(slot, frame):
+        slot['scene'].set_transform(node, transform_at(frame))
+        slot['scene'].update()
+
+    seq = lm.sequence.FrameSequence([make_slot(0), make_slot(1)],
+        update=update,
+        render=lambda slot, frame: slot['renderer'].render(),
+        save=lambda slot, frame: slot['film'].save('out/{:04}.png'.format(frame)),
+        side_threads=4)
+    stats = seq.run(2000)
+"""
+
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+try:
+    from pylm import parallel
+except:
+    from .pylm import parallel
+
+
+class FrameSequence:
+    """Pipeline rendering a sequence of frames.
+
+    Args:
+        slots (list): Two objects holding the assets of a frame in flight.
+            The objects are passed to the callbacks as they are.
+        update (callable): ``update(slot, frame)`` updates and builds the scene of the slot
+            to the frame. The function must not modify the assets used by the other slot.
+        render (callable): ``render(slot, frame)`` renders the frame with the assets of the slot
+            and returns the result of the renderer.
+        save (callable): ``save(slot, frame)`` writes the rendered image of the frame.
+        side_threads (int): Thread budget of the side thread.
+    """
+
+    def __init__(self, slots, update, render, save, side_threads=1):
+        if len(slots) != 2:
+            raise ValueError('FrameSequence requires two slots')
+        self.slots = slots
+        self.update = update
+        self.render = render
+        self.save = save
+        self.side_threads = side_threads
+
+    def _side(self, save_frame, update_frame):
+        start = time.time()
+        if save_frame is not None:
+            self.save(self.slots[save_frame % 2], save_frame)
+        if update_frame is not None:
+            self.update(self.slots[update_frame % 2], update_frame)
+        return time.time() - start
+
+    def run(self, num_frames, first_frame=0):
+        """Render the frames.
+
+        Args:
+            num_frames (int): Number of frames.
+            first_frame (int): Index of the first frame.
+
+        Returns:
+            List of the statistics of the frames. Each element contains ``result`` of the renderer,
+            ``render`` (time of the rendering), ``side`` (time of the side thread),
+            and ``wait`` (time the renderer waited for the side thread) in seconds.
+        """
+        if num_frames <= 0:
+            return []
+        frames = range(first_frame, first_frame + num_frames)
+        stats = []
+
+        # The first frame is prepared with all threads
+        self.update(self.slots[frames[0] % 2], frames[0])
+
+        main_threads = max(parallel.num_threads() - self.side_threads, 1)
+        prev_budget = parallel.set_thread_budget(main_threads)
+        try:
+            with ThreadPoolExecutor(max_workers=1,
+                    initializer=parallel.set_thread_budget, initargs=(self.side_threads,)) as side:
+                for i, frame in enumerate(frames):
+                    # Write the previous frame and update the scene of the next frame
+                    # with the other slot, while rendering the current frame
+                    save_frame = frames[i-1] if i > 0 else None
+                    update_frame = frames[i+1] if i + 1 < len(frames) else None
+                    job = side.submit(self._side, save_frame, update_frame)
+                    start = time.time()
+                    result = self.render(self.slots[frame % 2], frame)
+                    render_time = time.time() - start
+                    side_time = job.result()
+                    stats.append({
+                        'result': result,
+                        'render': render_time,
+                        'side': side_time,
+                        'wait': time.time() - start - render_time
+                    })
+        finally:
+            parallel.set_thread_budget(prev_budget)
+
+        # Write the last frame
+        self.save(self.slots[frames[-1] % 2], frames[-1])
+        return stats
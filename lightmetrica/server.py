@@ -0,0 +1,209 @@
+"""Render server keeping scenes resident across jobs
+
+A long-lived server process holds the scenes loaded and built once,
+and renders the jobs requested by clients connected via TCP.
+Each job specifies the scene, the camera, the renderer, and its parameters,
+so the setup of the framework, the loading of the assets, and the construction
+of the acceleration structures are not repeated for each job.
+
+The jobs from the clients are accepted concurrently and executed one at a time
+against the shared scenes, using all threads of the framework for each job.
+The scenes are not modified by the jobs except for the camera,
+which is reconstructed for each job and restored when a job does not specify it.
+
+Example::
+
+    # Server
+    scene = ...
+    scene.build()
+    server = lm.server.Server(('0.0.0.0', 5001))
+    server.add_scene('fireplace_room', scene)
+    server.serve()
+
+    # Client
+    client = lm.server.Client(('server-host', 5001))
+    img, result = client.render('fireplace_room', 'pt', w=640, h=360,
+        camera={'position': [5,5,5], 'center': [0,0,0], 'up': [0,1,0], 'vfov': 30},
+        scheduler='sample', spp=4, max_verts=10)
+    client.close()
+"""
+
+import queue
+import threading
+import time
+import numpy as np
+from multiprocessing.connection import Listener, Client as _Client
+
+try:
+    from pylm import load_film, load_renderer, SceneChange
+except:
+    from .pylm import load_film, load_renderer, SceneChange
+
+DefaultAuthKey = b'lightmetrica'
+
+
+class Server:
+    """Render server.
+
+    Args:
+        address (tuple): Address to listen to.
+        authkey (bytes): Authentication key shared with clients.
+    """
+
+    def __init__(self, address, authkey=DefaultAuthKey):
+        self.listener = Listener(address, authkey=authkey)
+        self.scenes = {}
+        self.cameras = {}
+        self.films = {}
+        self.jobs = queue.Queue()
+        self.closed = False
+
+    def add_scene(self, name, scene):
+        """Register a scene to be rendered by the jobs.
+
+        The scene must be built before the registration.
+        The current state of the camera of the scene is used
+        for the jobs not specifying the camera.
+
+        Args:
+            name (str): Name of the scene used by the clients.
+            scene (lm.Scene): Scene.
+        """
+        scene.require_renderable()
+        self.scenes[name] = scene
+        self.cameras[name] = scene.camera().save()
+
+    def _film(self, w, h):
+        # Films are reused for the jobs with the same size
+        key = (w, h)
+        if key not in self.films:
+            self.films[key] = load_film('film_server_{}x{}'.format(w, h), 'bitmap', w=w, h=h)
+        return self.films[key]
+
+    def _render(self, request):
+        scene = self.scenes[request['scene']]
+        w, h = request['w'], request['h']
+
+        # Camera of the job
+        camera = scene.camera()
+        if request.get('camera') is None:
+            camera.load(self.cameras[request['scene']])
+        else:
+            camera_params = dict(request['camera'])
+            camera_params.setdefault('aspect', w / h)
+            camera.construct(camera_params)
+        scene.notify_changes(SceneChange.Camera)
+        scene.commit_changes()
+
+        # Render
+        film = self._film(w, h)
+        renderer = load_renderer('renderer_server', request['renderer'],
+            scene=scene.loc(),
+            output=film.loc(),
+            **request.get('params', {}))
+        start = time.time()
+        result = renderer.render()
+        result['elapsed'] = time.time() - start
+        return np.copy(film.buffer()), result
+
+    def _serve_client(self, conn):
+        try:
+            while not self.closed:
+                msg = conn.recv()
+                if msg[0] == 'exit':
+                    break
+                elif msg[0] == 'scenes':
+                    conn.send(('scenes', list(self.scenes.keys())))
+                elif msg[0] == 'render':
+                    # Jobs are executed by the serving thread in the order of the requests
+                    done = queue.Queue()
+                    self.jobs.put((msg[1], done))
+                    conn.send(done.get())
+        except Exception:
+            pass
+        conn.close()
+
+    def _accept(self):
+        while not self.closed:
+            try:
+                conn = self.listener.accept()
+            except Exception:
+                continue
+            threading.Thread(target=self._serve_client, args=(conn,), daemon=True).start()
+
+    def serve(self):
+        """Serve the jobs until :func:`close` is called.
+
+        The function must be called from the thread where the scenes are set up.
+        """
+        threading.Thread(target=self._accept, daemon=True).start()
+        while not self.closed:
+            try:
+                request, done = self.jobs.get(timeout=0.1)
+            except queue.Empty:
+                continue
+            try:
+                img, result = self._render(request)
+                done.put(('result', img, result))
+            except Exception as e:
+                done.put(('error', str(e)))
+
+    def close(self):
+        """Stop serving the jobs and close the server."""
+        self.closed = True
+        self.listener.close()
+
+
+class Client:
+    """Client of the render server.
+
+    Args:
+        address (tuple): Address of the server.
+        authkey (bytes): Authentication key shared with the server.
+    """
+
+    def __init__(self, address, authkey=DefaultAuthKey):
+        self.conn = _Client(address, authkey=authkey)
+
+    def scenes(self):
+        """Get the names of the scenes registered in the server."""
+        self.conn.send(('scenes',))
+        return self.conn.recv()[1]
+
+    def render(self, scene, renderer, w, h, camera=None, **params):
+        """Render a job with the server.
+
+        Args:
+            scene (str): Name of the scene.
+            renderer (str): Name of the renderer, e.g., ``pt``.
+            w (int): Width of the image.
+            h (int): Height of the image.
+            camera (dict): Parameters of the camera of the scene, e.g., ``position``, ``center``,
+                ``up``, and ``vfov`` for ``camera::pinhole``. ``aspect`` defaults to the one of the image.
+                ``None`` to use the original camera of the scene.
+            params: Parameters of the renderer, e.g., ``scheduler`` and ``spp``.
+
+        Returns:
+            Tuple of the rendered image as a numpy array of shape ``(h,w,3)``
+            and the result of the renderer with the elapsed time of the rendering.
+        """
+        self.conn.send(('render', {
+            'scene': scene,
+            'renderer': renderer,
+            'w': w,
+            'h': h,
+            'camera': camera,
+            'params': params
+        }))
+        msg = self.conn.recv()
+        if msg[0] == 'error':
+            raise RuntimeError(msg[1])
+        return msg[1], msg[2]
+
+    def close(self):
+        """Close the connection to the server."""
+        try:
+            self.conn.send(('exit',))
+        except Exception:
+            pass
+        self.conn.close()
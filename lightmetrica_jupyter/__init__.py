@@ -28,6 +28,43 @@ def skip_if_not(line, cell=None):
         return
     get_ipython().ex(cell)
 
+def preview(film, size=None, **kwargs):
+    """Show the progressive preview of a film in the notebook.
+
+    The preview is updated on a background thread during rendering
+    using :class:`lightmetrica.preview.PreviewStream`.
+    The frames are decoded in the notebook in the same way as a remote viewer.
+
+    Args:
+        film (lm.Film): Film to be previewed.
+        size (tuple): Size of the displayed image in pixels. ``None`` to use the size of the frames.
+        kwargs: Parameters of :class:`lightmetrica.preview.PreviewStream`, e.g., ``rate`` and ``downsample``.
+
+    Returns:
+        lightmetrica.preview.PreviewStream: Started stream. Call ``stop()`` after rendering.
+
+    Example::
+
+        stream = lmj.preview(film, rate=5, downsample=2)
+        renderer.render()
+        stream.stop()
+    """
+    import io
+    import ipywidgets
+    widget = ipywidgets.Image(format='png')
+    if size is not None:
+        widget.width, widget.height = size
+    display(widget)
+    decoder = lm.preview.PreviewDecoder()
+    def send(data):
+        img = decoder.decode(data)
+        if img is None:
+            return
+        buf = io.BytesIO()
+        plt.imsave(buf, img, format='png')
+        widget.value = buf.getvalue()
+    return lm.preview.PreviewStream(film, send, **kwargs).start()
+
 def load_ipython_extension(ip):
     """Register as IPython extension"""
     # Register line magic functions
@@ -30,6 +30,7 @@ namespace fs = std::filesystem;
 #include <variant>
 #include <type_traits>
 #include <queue>
+#include <array>
 
 #define WIN32_LEAN_AND_MEAN
 #include <fmt/format.h>
@@ -27,6 +27,24 @@ struct FlattenedPrimitiveNode {
 .. function:: accel::embree
 
    Acceleration structure with Embree library.
+
+   Embree does not expose the nodes of the structure.
+   The statistics of the structure (``structure`` query of :cpp:func:`lm::Component::underlying_value`)
+   only contain the memory allocated by the device,
+   and :cpp:func:`lm::Accel::count_traversal` is not supported.
+
+   The alpha test (:cpp:func:`lm::Accel::set_alpha_test`) is implemented with
+   the intersection and occlusion filter functions of the geometries of the masked primitives.
+
+   :param str preset: ``auto`` to choose the build quality (``LOW``, ``MEDIUM``, or ``HIGH``)
+                      and the ``compact`` and ``robust`` scene flags from the number of triangles,
+                      the expected ray budget, and the memory limit on each build.
+                      The choice and the estimated build and trace time are logged.
+                      The other build parameters are used as they are.
+   :param float ray_budget: Expected number of traced rays, e.g., spp x pixels x path length.
+                            Used by ``auto`` preset. Default is 1e8.
+   :param float memory_limit: Memory limit of the structure in MB used by ``auto`` preset.
+                              0 for no limit. Default is 0.
 \endrst
 */
 class Accel_Embree final : public Accel {
@@ -35,13 +53,17 @@ private:
     RTCScene scene_ = nullptr;
     RTCBuildArguments settings_;
     RTCSceneFlags sf_;
+    EmbreeAutoPreset auto_;                     // Parameters of the auto preset
     std::vector<FlattenedPrimitiveNode> flattened_nodes_;
+    std::atomic<long long> memory_ = 0;         // Memory allocated by the device in bytes
+    AlphaTestFunc alpha_test_;                  // Alpha test function
 
 public:
 
      virtual void construct(const Json& prop) override {
         settings_ = prop;
         sf_ = prop;
+        auto_ = EmbreeAutoPreset::from_prop(prop);
 
         //check actual values used for building
         Json j;
@@ -56,6 +78,10 @@ public:
         device_ = rtcNewDevice("");
         handle_embree_error(nullptr, rtcGetDeviceError(device_));
         rtcSetDeviceErrorFunction(device_, handle_embree_error, nullptr);
+        rtcSetDeviceMemoryMonitorFunction(device_, [](void* ptr, ssize_t bytes, bool) -> bool {
+            *static_cast<std::atomic<long long>*>(ptr) += (long long)(bytes);
+            return true;
+        }, &memory_);
     }
 
     ~Accel_Embree() {
@@ -83,6 +109,17 @@ public:
         reset();
         scene_ = rtcNewScene(device_);
 
+        // Choose the build quality and the scene flags from the number of triangles
+        if (auto_.enabled) {
+            long long num_triangles = 0;
+            scene.traverse_primitive_nodes([&](const SceneNode& node, Mat4) {
+                if (node.type == SceneNodeType::Primitive && node.primitive.mesh) {
+                    num_triangles += node.primitive.mesh->num_triangles();
+                }
+            });
+            configure_auto(auto_, num_triangles, settings_, sf_);
+        }
+
         rtcSetSceneFlags(scene_, sf_);
         rtcSetSceneBuildQuality(scene_, settings_.buildQuality);
 
@@ -101,20 +138,10 @@ public:
             flattened_nodes_.push_back({ Transform(global_transform), node.index });
             // Create triangle mesh
             auto geom = rtcNewGeometry(device_, RTC_GEOMETRY_TYPE_TRIANGLE);
-            const int num_triangles = node.primitive.mesh->num_triangles();
-            auto* vs = (glm::vec3*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, sizeof(glm::vec3), num_triangles*3);
-            auto* fs = (glm::uvec3*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, sizeof(glm::uvec3), num_triangles);
-            node.primitive.mesh->foreach_triangle([&](int face, const Mesh::Tri& tri) {
-                const auto p1 = global_transform * Vec4(tri.p1.p, 1_f);
-                const auto p2 = global_transform * Vec4(tri.p2.p, 1_f);
-                const auto p3 = global_transform * Vec4(tri.p3.p, 1_f);
-                vs[3*face  ] = glm::vec3(p1);
-                vs[3*face+1] = glm::vec3(p2);
-                vs[3*face+2] = glm::vec3(p3);
-                fs[face][0] = 3*face;
-                fs[face][1] = 3*face+1;
-                fs[face][2] = 3*face+2;
-            });
+            if (auto_.enabled) {
+                rtcSetGeometryBuildQuality(geom, settings_.buildQuality);
+            }
+            setup_geometry_buffers(geom, *node.primitive.mesh, global_transform);
             rtcCommitGeometry(geom);
             rtcAttachGeometryByID(scene_, geom, flatten_node_index);
             rtcReleaseGeometry(geom);
@@ -124,6 +151,90 @@ public:
         rtcCommitScene(scene_);
     }
 
+    virtual void update(const Scene& scene) override {
+        exception::ScopedDisableFPEx guard_;
+        if (!scene_) {
+            build(scene);
+            return;
+        }
+
+        // Update the vertices of the geometries with new global transforms
+        LM_INFO("Updating geometries");
+        int num_primitives = 0;
+        bool changed = false;
+        scene.traverse_primitive_nodes([&](const SceneNode& node, Mat4 global_transform) {
+            if (changed || node.type != SceneNodeType::Primitive || !node.primitive.mesh) {
+                return;
+            }
+            const int flatten_node_index = num_primitives++;
+            if (flatten_node_index >= int(flattened_nodes_.size()) || flattened_nodes_[flatten_node_index].primitive != node.index) {
+                changed = true;
+                return;
+            }
+            flattened_nodes_[flatten_node_index].global_transform = Transform(global_transform);
+            auto geom = rtcGetGeometry(scene_, flatten_node_index);
+            update_geometry_vertices(geom, *node.primitive.mesh, global_transform);
+            rtcUpdateGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0);
+            rtcSetGeometryBuildQuality(geom, RTC_BUILD_QUALITY_REFIT);
+            rtcCommitGeometry(geom);
+        });
+        if (changed || num_primitives != int(flattened_nodes_.size())) {
+            LM_INFO("Scene topology is changed. Rebuilding.");
+            build(scene);
+            return;
+        }
+
+        LM_INFO("Committing");
+        rtcCommitScene(scene_);
+    }
+
+    virtual bool set_alpha_test(const std::vector<bool>& masked, const AlphaTestFunc& alpha_test) override {
+        exception::ScopedDisableFPEx guard_;
+        if (!scene_) {
+            return true;
+        }
+        alpha_test_ = alpha_test;
+        for (int i = 0; i < int(flattened_nodes_.size()); i++) {
+            const int primitive = flattened_nodes_[i].primitive;
+            const bool m = primitive < int(masked.size()) && masked[primitive];
+            auto geom = rtcGetGeometry(scene_, i);
+            rtcSetGeometryUserData(geom, this);
+            rtcSetGeometryIntersectFilterFunction(geom, m ? alpha_filter : nullptr);
+            rtcSetGeometryOccludedFilterFunction(geom, m ? alpha_filter : nullptr);
+            rtcCommitGeometry(geom);
+        }
+        rtcCommitScene(scene_);
+        return true;
+    }
+
+private:
+    // Filter function rejecting the hits by the alpha test
+    static void alpha_filter(const RTCFilterFunctionNArguments* args) {
+        const auto* self = static_cast<const Accel_Embree*>(args->geometryUserPtr);
+        for (unsigned int i = 0; i < args->N; i++) {
+            if (args->valid[i] != -1) {
+                continue;
+            }
+            const auto& fn = self->flattened_nodes_[RTCHitN_geomID(args->hit, args->N, i)];
+            const int face = int(RTCHitN_primID(args->hit, args->N, i));
+            const Vec2 uv(Float(RTCHitN_u(args->hit, args->N, i)), Float(RTCHitN_v(args->hit, args->N, i)));
+            if (!self->alpha_test_(fn.primitive, face, uv)) {
+                args->valid[i] = 0;
+            }
+        }
+    }
+
+public:
+    virtual Json underlying_value(const std::string& query) const override {
+        if (query != "structure") {
+            return {};
+        }
+        return {
+            {"memory", memory_.load()},
+            {"primitives", flattened_nodes_.size()}
+        };
+    }
+
     virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
         exception::ScopedDisableFPEx guard_;
 
@@ -157,11 +268,136 @@ public:
         return Hit{
             Float(rayhit.ray.tfar),
             Vec2(Float(rayhit.hit.u), Float(rayhit.hit.v)),
-            fn.global_transform,
+            int(rayhit.hit.geomID),
             fn.primitive,
             int(rayhit.hit.primID)
         };
     }
+
+    virtual Transform instance_transform(int instance) const override {
+        return flattened_nodes_.at(instance).global_transform;
+    }
+
+    virtual bool occluded(Ray ray, Float tmin, Float tmax) const override {
+        exception::ScopedDisableFPEx guard_;
+
+        RTCIntersectContext context;
+        rtcInitIntersectContext(&context);
+
+        // Setup ray
+        RTCRay r;
+        r.org_x = float(ray.o.x);
+        r.org_y = float(ray.o.y);
+        r.org_z = float(ray.o.z);
+        r.tnear = float(tmin);
+        r.dir_x = float(ray.d.x);
+        r.dir_y = float(ray.d.y);
+        r.dir_z = float(ray.d.z);
+        r.time = 0.f;
+        r.tfar = float(tmax);
+        r.mask = 0xFFFFFFFF;
+        r.id = 0;
+        r.flags = 0;
+
+        // Occlusion query. tfar is set to -inf if any hit is found.
+        rtcOccluded1(scene_, &context, &r);
+        return r.tfar < 0.f;
+    }
+
+    virtual void intersect_n(int n, const Ray* rays, Float tmin, Float tmax, std::optional<Hit>* hits) const override {
+        exception::ScopedDisableFPEx guard_;
+
+        RTCIntersectContext context;
+        rtcInitIntersectContext(&context);
+
+        // Process the rays with packets of 16 rays
+        constexpr int PacketSize = 16;
+        for (int offset = 0; offset < n; offset += PacketSize) {
+            const int m = std::min(PacketSize, n - offset);
+
+            // Setup rays
+            alignas(64) int valid[PacketSize];
+            alignas(64) RTCRayHit16 rayhit;
+            for (int j = 0; j < PacketSize; j++) {
+                valid[j] = j < m ? -1 : 0;
+                const auto& ray = rays[offset + (j < m ? j : 0)];
+                rayhit.ray.org_x[j] = float(ray.o.x);
+                rayhit.ray.org_y[j] = float(ray.o.y);
+                rayhit.ray.org_z[j] = float(ray.o.z);
+                rayhit.ray.tnear[j] = float(tmin);
+                rayhit.ray.dir_x[j] = float(ray.d.x);
+                rayhit.ray.dir_y[j] = float(ray.d.y);
+                rayhit.ray.dir_z[j] = float(ray.d.z);
+                rayhit.ray.time[j] = 0.f;
+                rayhit.ray.tfar[j] = float(tmax);
+                rayhit.ray.mask[j] = 0xFFFFFFFF;
+                rayhit.ray.id[j] = j;
+                rayhit.ray.flags[j] = 0;
+                rayhit.hit.primID[j] = RTC_INVALID_GEOMETRY_ID;
+                rayhit.hit.geomID[j] = RTC_INVALID_GEOMETRY_ID;
+                rayhit.hit.instID[0][j] = RTC_INVALID_GEOMETRY_ID;
+            }
+
+            // Intersection query
+            rtcIntersect16(valid, scene_, &context, &rayhit);
+
+            // Store hit information
+            for (int j = 0; j < m; j++) {
+                if (rayhit.hit.geomID[j] == RTC_INVALID_GEOMETRY_ID) {
+                    hits[offset + j] = {};
+                    continue;
+                }
+                const auto& fn = flattened_nodes_.at(rayhit.hit.geomID[j]);
+                hits[offset + j] = Hit{
+                    Float(rayhit.ray.tfar[j]),
+                    Vec2(Float(rayhit.hit.u[j]), Float(rayhit.hit.v[j])),
+                    int(rayhit.hit.geomID[j]),
+                    fn.primitive,
+                    int(rayhit.hit.primID[j])
+                };
+            }
+        }
+    }
+
+    virtual void occluded_n(int n, const Ray* rays, Float tmin, const Float* tmax, bool* occluded) const override {
+        exception::ScopedDisableFPEx guard_;
+
+        RTCIntersectContext context;
+        rtcInitIntersectContext(&context);
+
+        // Process the rays with packets of 16 rays
+        constexpr int PacketSize = 16;
+        for (int offset = 0; offset < n; offset += PacketSize) {
+            const int m = std::min(PacketSize, n - offset);
+
+            // Setup rays
+            alignas(64) int valid[PacketSize];
+            alignas(64) RTCRay16 r;
+            for (int j = 0; j < PacketSize; j++) {
+                valid[j] = j < m ? -1 : 0;
+                const int k = offset + (j < m ? j : 0);
+                const auto& ray = rays[k];
+                r.org_x[j] = float(ray.o.x);
+                r.org_y[j] = float(ray.o.y);
+                r.org_z[j] = float(ray.o.z);
+                r.tnear[j] = float(tmin);
+                r.dir_x[j] = float(ray.d.x);
+                r.dir_y[j] = float(ray.d.y);
+                r.dir_z[j] = float(ray.d.z);
+                r.time[j] = 0.f;
+                r.tfar[j] = float(tmax[k]);
+                r.mask[j] = 0xFFFFFFFF;
+                r.id[j] = j;
+                r.flags[j] = 0;
+            }
+
+            // Occlusion query. tfar is set to -inf if any hit is found.
+            rtcOccluded16(valid, scene_, &context, &r);
+            for (int j = 0; j < m; j++) {
+                occluded[offset + j] = r.tfar[j] < 0.f;
+            }
+        }
+    }
 };
 
 LM_COMP_REG_IMPL(Accel_Embree, "accel::embree");
@@ -21,7 +21,7 @@ enum class FlattenedSceneNodeType {
 struct FlattenedSceneNode {
     FlattenedSceneNodeType type;    // Type
     int index;                      // Index of flattened node
-    Transform global_transform;     // Global transform of the flattened node
+    Transform global_transform;     // Transform of the flattened node in the flattened scene
     int node_index;                 // Index of (unflattened) scene node
     int flattened_scene_index;      // Index of flattened scene only used for InstancedScene type
 };
@@ -32,19 +32,39 @@ using FlattenedScene = std::vector<FlattenedSceneNode>;
 
 // ------------------------------------------------------------------------------------------------
 
+/*
+\rst
+.. function:: accel::embreeinstanced
+
+   Acceleration structure with Embree library supporting instancing.
+
+   Each instance group is mapped to an Embree scene shared among the instances of the group.
+   The instance groups nested in other instance groups are mapped to
+   the instances of the scenes in the scene of the parent group (multi-level instancing),
+   up to ``RTC_MAX_INSTANCE_LEVEL_COUNT`` levels the Embree library is built with.
+   The instance groups nested deeper than the limit are flattened into the scene of the parent group.
+   The parameters are the same as ``accel::embree``.
+   The ``auto`` preset is chosen from the number of the unique triangles.
+\endrst
+*/
 class Accel_Embree_Instanced final : public Accel {
 private:
     RTCDevice device_ = nullptr;
     RTCScene scene_ = nullptr;
+    std::vector<RTCScene> scenes_;                     // Embree scenes of the flattened scenes (index 0: root)
     RTCBuildArguments settings_;
     RTCSceneFlags sf_;
+    EmbreeAutoPreset auto_;                            // Parameters of the auto preset
     std::vector<FlattenedScene> flattened_scenes_;    // Flattened scenes (index 0: root)
+    std::vector<int> order_;                           // Flattened scene indices with nested scenes first
+    std::vector<std::vector<int>> bases_;              // Instance index of the first primitive of the nodes in each flattened scene
 
 public:
     
      virtual void construct(const Json& prop) override {        
         settings_ = prop;
         sf_ = prop;
+        auto_ = EmbreeAutoPreset::from_prop(prop);
         
         //check actual values used for building
         Json j;
@@ -63,9 +83,7 @@ public:
     }
 
     ~Accel_Embree_Instanced() {
-        if (scene_) {
-            rtcReleaseScene(scene_);
-        }
+        reset();
         if (device_) {
             rtcReleaseDevice(device_);
         }
@@ -73,104 +91,73 @@ public:
 
 private:
     void reset() {
-        if (scene_) {
-            rtcReleaseScene(scene_);
-            scene_ = nullptr;
+        for (auto rtcscene : scenes_) {
+            rtcReleaseScene(rtcscene);
         }
+        scenes_.clear();
+        scene_ = nullptr;
         flattened_scenes_.clear();
+        order_.clear();
+        bases_.clear();
+    }
+
+    // Number the primitives of the flattened scenes consecutively.
+    // An instance index is the sum of the bases of the nodes along the path of the instances
+    // from the root scene to the primitive.
+    void update_instance_bases() {
+        const int n = int(flattened_scenes_.size());
+        bases_.assign(n, {});
+        std::vector<long long> counts(n, 0);
+        for (int i : order_) {
+            long long count = 0;
+            for (const auto& fn : flattened_scenes_[i]) {
+                bases_[i].push_back(int(count));
+                count += fn.type == FlattenedSceneNodeType::InstancedScene ? counts[fn.flattened_scene_index] : 1;
+            }
+            if (count > std::numeric_limits<int>::max()) {
+                LM_THROW_EXCEPTION(Error::Unsupported,
+                    "Number of instanced primitives exceeds the limit [count={}]", count);
+            }
+            counts[i] = count;
+        }
     }
 
 public:
     virtual void build(const Scene& scene) override {
-        using namespace std::placeholders;
         exception::ScopedDisableFPEx guard_;
         reset();
 
         // ----------------------------------------------------------------------------------------
 
-        // Flatten the scene with single-level instance group
+        // Flatten the scene with multi-level instance groups
         LM_INFO("Flattening scene");
-		// Node index -> flattened scene index
-        std::unordered_map<int, int> node_to_flattened_scene_map;
-        using VisitSceneNodeFunc = std::function<void(const SceneNode, Mat4, int, bool)>;
-        VisitSceneNodeFunc visit_scene_node = [&](const SceneNode& node, Mat4 global_transform, int flattened_scene_index, bool ignoreInstanceGroup) {
-            // Primitive node type
-            if (node.type == SceneNodeType::Primitive) {
-                // Record flatten primitive
-                auto& flattened_scene = flattened_scenes_.at(flattened_scene_index);
-                const int flattened_node_index = int(flattened_scene.size());
-                flattened_scene.push_back({
-                    FlattenedSceneNodeType::Primitive,
-                    flattened_node_index,
-                    Transform(global_transform),
-                    node.index
-                });
-
-                return;
-            }
-
-            // ------------------------------------------------------------------------------------
-
-            // Group node type
-            if (node.type == SceneNodeType::Group) {
-                // Apply local transform
-                Mat4 M = global_transform;
-                if (node.group.local_transform) {
-                    M *= *node.group.local_transform;
-                }
-
-                // Instance group
-                if (!ignoreInstanceGroup && node.group.instanced) {
-                    // Get index of child flattened scene
-                    int child_flattened_scene_index = -1;
-                    if (auto it = node_to_flattened_scene_map.find(node.index); it != node_to_flattened_scene_map.end()) {
-                        // Get recorded flattened scene index
-                        child_flattened_scene_index = it->second;
+        flattened_scenes_ = flatten_scene(scene, order_);
+        update_instance_bases();
+
+        // Choose the build quality and the scene flags from the number of unique triangles
+        if (auto_.enabled) {
+            long long num_triangles = 0;
+            for (const auto& fscene : flattened_scenes_) {
+                for (const auto& fnode : fscene) {
+                    if (fnode.type != FlattenedSceneNodeType::Primitive) {
+                        continue;
                     }
-                    else {
-                        // Create a new flattened scene if not available
-                        child_flattened_scene_index = int(flattened_scenes_.size());
-                        node_to_flattened_scene_map[node.index] = child_flattened_scene_index;
-                        flattened_scenes_.emplace_back();
-                        scene.visit_node(node.index, std::bind(visit_scene_node, _1, Mat4(1_f), child_flattened_scene_index, true));
+                    if (const auto* mesh = scene.node_at(fnode.node_index).primitive.mesh; mesh) {
+                        num_triangles += mesh->num_triangles();
                     }
-
-                    // Add flattened node
-                    auto& flattened_scene = flattened_scenes_.at(flattened_scene_index);
-                    const int flattened_node_index = int(flattened_scene.size());
-                    flattened_scene.push_back({
-                        FlattenedSceneNodeType::InstancedScene,
-                        flattened_node_index,
-                        Transform(global_transform),
-                        node.index,
-                        child_flattened_scene_index
-                    });
-
-                    return;
-                }
-
-                // Normal group
-                for (int child : node.group.children) {
-                    scene.visit_node(child, std::bind(visit_scene_node, _1, M, flattened_scene_index, ignoreInstanceGroup));
                 }
-
-                return;
             }
-
-            // ------------------------------------------------------------------------------------
-
-            LM_UNREACHABLE();
-        };
-        flattened_scenes_.emplace_back();
-        scene.visit_node(0, std::bind(visit_scene_node, _1, Mat4(1_f), 0, false));
+            configure_auto(auto_, num_triangles, settings_, sf_);
+        }
 
         // ----------------------------------------------------------------------------------------
 
-        // Traverse the flattened scene and create embree scene
-        // Process from backward because the instanced scene must be created prior to the scene.
+        // Traverse the flattened scenes and create embree scenes.
+        // The instanced scenes are created prior to the scenes instancing them.
         LM_INFO("Building");
-        std::vector<RTCScene> rtcscenes(flattened_scenes_.size());
-        for (int i = int(flattened_scenes_.size())-1; i >= 0; i--) {
+        auto& rtcscenes = scenes_;
+        rtcscenes.assign(flattened_scenes_.size(), nullptr);
+        for (int i : order_) {
             const auto& fscene = flattened_scenes_.at(i);
 
             // Create a new embree scene
@@ -192,20 +179,10 @@ public:
 
                     // Create embree's triangle mesh
                     auto geom = rtcNewGeometry(device_, RTC_GEOMETRY_TYPE_TRIANGLE);
-                    const int num_triangles = node.primitive.mesh->num_triangles();
-                    auto* vs = (glm::vec3*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, sizeof(glm::vec3), num_triangles * 3);
-                    auto* fs = (glm::uvec3*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, sizeof(glm::uvec3), num_triangles);
-                    node.primitive.mesh->foreach_triangle([&](int face, const Mesh::Tri& tri) {
-                        const auto p1 = fnode.global_transform.M * Vec4(tri.p1.p, 1_f);
-                        const auto p2 = fnode.global_transform.M * Vec4(tri.p2.p, 1_f);
-                        const auto p3 = fnode.global_transform.M * Vec4(tri.p3.p, 1_f);
-                        vs[3 * face] = glm::vec3(p1);
-                        vs[3 * face + 1] = glm::vec3(p2);
-                        vs[3 * face + 2] = glm::vec3(p3);
-                        fs[face][0] = 3 * face;
-                        fs[face][1] = 3 * face + 1;
-                        fs[face][2] = 3 * face + 2;
-                    });
+                    if (auto_.enabled) {
+                        rtcSetGeometryBuildQuality(geom, settings_.buildQuality);
+                    }
+                    setup_geometry_buffers(geom, *node.primitive.mesh, fnode.global_transform.M);
                     rtcCommitGeometry(geom);
                     rtcAttachGeometryByID(rtcscene, geom, fnode.index);
                     rtcReleaseGeometry(geom);
@@ -213,9 +190,6 @@ public:
 
                 // Instanced scene
                 else if (fnode.type == FlattenedSceneNodeType::InstancedScene) {
-                    // Index must to be zero
-                    assert(i == 0);
-
                     // Create instanced geometry
                     auto inst = rtcNewGeometry(device_, RTC_GEOMETRY_TYPE_INSTANCE);
                     rtcSetGeometryInstancedScene(inst, rtcscenes.at(fnode.flattened_scene_index));
@@ -235,6 +209,217 @@ public:
         scene_ = rtcscenes[0];
     }
 
+private:
+    // Flatten the scene with multi-level instance groups.
+    // Each instance group is flattened into a scene containing the primitives
+    // and the instances of the nested instance groups.
+    // The indices of the flattened scenes are stored in order in a way that
+    // the nested scenes come before the scenes instancing them.
+    std::vector<FlattenedScene> flatten_scene(const Scene& scene, std::vector<int>& order) const {
+        using namespace std::placeholders;
+        std::vector<FlattenedScene> flattened_scenes;
+        order.clear();
+        // (Node index, instance level) -> flattened scene index.
+        // A group instanced at different levels is flattened separately
+        // because the levels nested inside the group depend on the level of the group.
+        constexpr int MaxLevels = RTC_MAX_INSTANCE_LEVEL_COUNT;
+        std::unordered_map<long long, int> node_to_flattened_scene_map;
+        std::unordered_set<int> active_groups;      // Instance groups being visited
+        bool flattened_nested = false;
+        using VisitSceneNodeFunc = std::function<void(const SceneNode&, Mat4, int, int)>;
+        VisitSceneNodeFunc visit_scene_node = [&](const SceneNode& node, Mat4 global_transform, int flattened_scene_index, int level) {
+            // Primitive node type
+            if (node.type == SceneNodeType::Primitive) {
+                // Record flatten primitive
+                auto& flattened_scene = flattened_scenes.at(flattened_scene_index);
+                const int flattened_node_index = int(flattened_scene.size());
+                flattened_scene.push_back({
+                    FlattenedSceneNodeType::Primitive,
+                    flattened_node_index,
+                    Transform(global_transform),
+                    node.index,
+                    -1
+                });
+
+                return;
+            }
+
+            // ------------------------------------------------------------------------------------
+
+            // Group node type
+            if (node.type == SceneNodeType::Group) {
+                // Local transform
+                const Mat4 L = node.group.local_transform ? *node.group.local_transform : Mat4(1_f);
+
+                // Instance group
+                if (node.group.instanced) {
+                    if (active_groups.count(node.index) > 0) {
+                        LM_THROW_EXCEPTION(Error::InvalidArgument,
+                            "Instance group contains itself [node={}]", node.index);
+                    }
+
+                    if (level < MaxLevels) {
+                        // Get index of child flattened scene
+                        int child_flattened_scene_index = -1;
+                        const long long key = (long long)(node.index) * (MaxLevels + 1) + (level + 1);
+                        if (auto it = node_to_flattened_scene_map.find(key); it != node_to_flattened_scene_map.end()) {
+                            // Get recorded flattened scene index
+                            child_flattened_scene_index = it->second;
+                        }
+                        else {
+                            // Create a new flattened scene if not available
+                            child_flattened_scene_index = int(flattened_scenes.size());
+                            node_to_flattened_scene_map[key] = child_flattened_scene_index;
+                            flattened_scenes.emplace_back();
+                            active_groups.insert(node.index);
+                            for (int child : node.group.children) {
+                                scene.visit_node(child, std::bind(visit_scene_node, _1, L, child_flattened_scene_index, level + 1));
+                            }
+                            active_groups.erase(node.index);
+                            order.push_back(child_flattened_scene_index);
+                        }
+
+                        // Add flattened node
+                        auto& flattened_scene = flattened_scenes.at(flattened_scene_index);
+                        const int flattened_node_index = int(flattened_scene.size());
+                        flattened_scene.push_back({
+                            FlattenedSceneNodeType::InstancedScene,
+                            flattened_node_index,
+                            Transform(global_transform),
+                            node.index,
+                            child_flattened_scene_index
+                        });
+
+                        return;
+                    }
+
+                    // Flatten the instance group into the current scene
+                    // if the level exceeds the limit of Embree
+                    flattened_nested = true;
+                    active_groups.insert(node.index);
+                    for (int child : node.group.children) {
+                        scene.visit_node(child, std::bind(visit_scene_node, _1, global_transform * L, flattened_scene_index, level));
+                    }
+                    active_groups.erase(node.index);
+                    return;
+                }
+
+                // Normal group
+                for (int child : node.group.children) {
+                    scene.visit_node(child, std::bind(visit_scene_node, _1, global_transform * L, flattened_scene_index, level));
+                }
+
+                return;
+            }
+
+            // ------------------------------------------------------------------------------------
+
+            LM_UNREACHABLE();
+        };
+        flattened_scenes.emplace_back();
+        scene.visit_node(0, std::bind(visit_scene_node, _1, Mat4(1_f), 0, 0));
+        order.push_back(0);
+        if (flattened_nested) {
+            LM_WARN("Instance groups nested deeper than RTC_MAX_INSTANCE_LEVEL_COUNT are flattened "
+                "[RTC_MAX_INSTANCE_LEVEL_COUNT={}]", MaxLevels);
+        }
+        return flattened_scenes;
+    }
+
+    // Check if two flattened scenes share the same structure.
+    // The transforms of the nodes are not compared.
+    static bool same_structure(const std::vector<FlattenedScene>& a, const std::vector<FlattenedScene>& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (a[i].size() != b[i].size()) {
+                return false;
+            }
+            for (size_t j = 0; j < a[i].size(); j++) {
+                const auto& n1 = a[i][j];
+                const auto& n2 = b[i][j];
+                if (n1.type != n2.type || n1.node_index != n2.node_index || n1.flattened_scene_index != n2.flattened_scene_index) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+public:
+    virtual void update(const Scene& scene) override {
+        exception::ScopedDisableFPEx guard_;
+        if (!scene_) {
+            build(scene);
+            return;
+        }
+
+        // Rebuild if the structure of the scene is changed
+        LM_INFO("Flattening scene");
+        std::vector<int> order;
+        auto flattened_scenes = flatten_scene(scene, order);
+        if (!same_structure(flattened_scenes, flattened_scenes_)) {
+            LM_INFO("Scene topology is changed. Rebuilding.");
+            build(scene);
+            return;
+        }
+
+        // Update the nodes whose transforms are changed, from the nested scenes to the root scene.
+        // The instances of the updated scenes are recommitted
+        // because the bounds of the instanced scenes are changed.
+        LM_INFO("Updating scenes");
+        std::vector<bool> changed(flattened_scenes.size(), false);
+        for (int i : order_) {
+            for (const auto& fnode : flattened_scenes[i]) {
+                const auto& prev = flattened_scenes_[i][fnode.index];
+                RTCGeometry geom = nullptr;
+                if (fnode.type == FlattenedSceneNodeType::Primitive) {
+                    const auto& node = scene.node_at(fnode.node_index);
+                    if (!node.primitive.mesh || fnode.global_transform.M == prev.global_transform.M) {
+                        continue;
+                    }
+                    geom = rtcGetGeometry(scenes_[i], fnode.index);
+                    update_geometry_vertices(geom, *node.primitive.mesh, fnode.global_transform.M);
+                    rtcUpdateGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0);
+                    rtcSetGeometryBuildQuality(geom, RTC_BUILD_QUALITY_REFIT);
+                }
+                else if (fnode.type == FlattenedSceneNodeType::InstancedScene) {
+                    if (fnode.global_transform.M == prev.global_transform.M && !changed[fnode.flattened_scene_index]) {
+                        continue;
+                    }
+                    geom = rtcGetGeometry(scenes_[i], fnode.index);
+                    glm::mat4 M(fnode.global_transform.M);
+                    rtcSetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, &M[0].x);
+                }
+                rtcCommitGeometry(geom);
+                changed[i] = true;
+            }
+            if (changed[i]) {
+                rtcCommitScene(scenes_[i]);
+            }
+        }
+        flattened_scenes_ = std::move(flattened_scenes);
+        update_instance_bases();
+    }
+
+    // Accumulate the transforms of the instances containing the primitive from the root scene
+    virtual Transform instance_transform(int instance) const override {
+        Mat4 M(1_f);
+        int i = 0;
+        while (true) {
+            const auto& bases = bases_.at(i);
+            const int j = int(std::upper_bound(bases.begin(), bases.end(), instance) - bases.begin()) - 1;
+            const auto& fn = flattened_scenes_.at(i).at(j);
+            instance -= bases[j];
+            M *= fn.global_transform.M;
+            if (fn.type == FlattenedSceneNodeType::Primitive) {
+                return Transform(M);
+            }
+            i = fn.flattened_scene_index;
+        }
+    }
+
     virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
         exception::ScopedDisableFPEx guard_;
 
@@ -256,7 +441,9 @@ public:
         rayhit.ray.tfar = float(tmax);
         rayhit.hit.primID = RTC_INVALID_GEOMETRY_ID;
         rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
-        rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+        for (int l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT; l++) {
+            rayhit.hit.instID[l] = RTC_INVALID_GEOMETRY_ID;
+        }
 
         // ----------------------------------------------------------------------------------------
 
@@ -269,30 +456,153 @@ public:
 
         // ----------------------------------------------------------------------------------------
 
-        // Get global transform and (unflattened) node index
-        // corresponding to the intersected (instanced) geometry
-        const auto [M, node_index] = [&]() -> std::tuple<Mat4, int> {
-            const auto instID = rayhit.hit.instID[0];
-            if (instID != RTC_INVALID_GEOMETRY_ID) {
-                const auto& fn1 = flattened_scenes_.at(0).at(instID);
-                const auto& fn2 = flattened_scenes_.at(fn1.flattened_scene_index).at(rayhit.hit.geomID);
-                return { fn1.global_transform.M * fn2.global_transform.M, fn2.node_index };
+        // Store hit information
+        return make_hit(
+            rayhit.hit.instID, rayhit.hit.geomID, rayhit.hit.primID,
+            rayhit.ray.tfar, rayhit.hit.u, rayhit.hit.v);
+    }
+
+    virtual bool occluded(Ray ray, Float tmin, Float tmax) const override {
+        exception::ScopedDisableFPEx guard_;
+
+        RTCIntersectContext context;
+        rtcInitIntersectContext(&context);
+
+        // Setup ray
+        RTCRay r;
+        r.org_x = float(ray.o.x);
+        r.org_y = float(ray.o.y);
+        r.org_z = float(ray.o.z);
+        r.tnear = float(tmin);
+        r.dir_x = float(ray.d.x);
+        r.dir_y = float(ray.d.y);
+        r.dir_z = float(ray.d.z);
+        r.time = 0.f;
+        r.tfar = float(tmax);
+        r.mask = 0xFFFFFFFF;
+        r.id = 0;
+        r.flags = 0;
+
+        // Occlusion query. tfar is set to -inf if any hit is found.
+        rtcOccluded1(scene_, &context, &r);
+        return r.tfar < 0.f;
+    }
+
+    virtual void intersect_n(int n, const Ray* rays, Float tmin, Float tmax, std::optional<Hit>* hits) const override {
+        exception::ScopedDisableFPEx guard_;
+
+        RTCIntersectContext context;
+        rtcInitIntersectContext(&context);
+
+        // Process the rays with packets of 16 rays
+        constexpr int PacketSize = 16;
+        for (int offset = 0; offset < n; offset += PacketSize) {
+            const int m = std::min(PacketSize, n - offset);
+
+            // Setup rays
+            alignas(64) int valid[PacketSize];
+            alignas(64) RTCRayHit16 rayhit;
+            for (int j = 0; j < PacketSize; j++) {
+                valid[j] = j < m ? -1 : 0;
+                const auto& ray = rays[offset + (j < m ? j : 0)];
+                rayhit.ray.org_x[j] = float(ray.o.x);
+                rayhit.ray.org_y[j] = float(ray.o.y);
+                rayhit.ray.org_z[j] = float(ray.o.z);
+                rayhit.ray.tnear[j] = float(tmin);
+                rayhit.ray.dir_x[j] = float(ray.d.x);
+                rayhit.ray.dir_y[j] = float(ray.d.y);
+                rayhit.ray.dir_z[j] = float(ray.d.z);
+                rayhit.ray.time[j] = 0.f;
+                rayhit.ray.tfar[j] = float(tmax);
+                rayhit.ray.mask[j] = 0xFFFFFFFF;
+                rayhit.ray.id[j] = j;
+                rayhit.ray.flags[j] = 0;
+                rayhit.hit.primID[j] = RTC_INVALID_GEOMETRY_ID;
+                rayhit.hit.geomID[j] = RTC_INVALID_GEOMETRY_ID;
+                for (int l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT; l++) {
+                    rayhit.hit.instID[l][j] = RTC_INVALID_GEOMETRY_ID;
+                }
             }
-            else {
-                const auto& fn = flattened_scenes_.at(0).at(rayhit.hit.geomID);
-                return { fn.global_transform.M, fn.node_index };
+
+            // Intersection query
+            rtcIntersect16(valid, scene_, &context, &rayhit);
+
+            // Store hit information
+            for (int j = 0; j < m; j++) {
+                if (rayhit.hit.geomID[j] == RTC_INVALID_GEOMETRY_ID) {
+                    hits[offset + j] = {};
+                    continue;
+                }
+                unsigned int instIDs[RTC_MAX_INSTANCE_LEVEL_COUNT];
+                for (int l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT; l++) {
+                    instIDs[l] = rayhit.hit.instID[l][j];
+                }
+                hits[offset + j] = make_hit(
+                    instIDs, rayhit.hit.geomID[j], rayhit.hit.primID[j],
+                    rayhit.ray.tfar[j], rayhit.hit.u[j], rayhit.hit.v[j]);
             }
-        }();
+        }
+    }
 
-        // ----------------------------------------------------------------------------------------
+    virtual void occluded_n(int n, const Ray* rays, Float tmin, const Float* tmax, bool* occluded) const override {
+        exception::ScopedDisableFPEx guard_;
 
-        // Store hit information
+        RTCIntersectContext context;
+        rtcInitIntersectContext(&context);
+
+        // Process the rays with packets of 16 rays
+        constexpr int PacketSize = 16;
+        for (int offset = 0; offset < n; offset += PacketSize) {
+            const int m = std::min(PacketSize, n - offset);
+
+            // Setup rays
+            alignas(64) int valid[PacketSize];
+            alignas(64) RTCRay16 r;
+            for (int j = 0; j < PacketSize; j++) {
+                valid[j] = j < m ? -1 : 0;
+                const int k = offset + (j < m ? j : 0);
+                const auto& ray = rays[k];
+                r.org_x[j] = float(ray.o.x);
+                r.org_y[j] = float(ray.o.y);
+                r.org_z[j] = float(ray.o.z);
+                r.tnear[j] = float(tmin);
+                r.dir_x[j] = float(ray.d.x);
+                r.dir_y[j] = float(ray.d.y);
+                r.dir_z[j] = float(ray.d.z);
+                r.time[j] = 0.f;
+                r.tfar[j] = float(tmax[k]);
+                r.mask[j] = 0xFFFFFFFF;
+                r.id[j] = j;
+                r.flags[j] = 0;
+            }
+
+            // Occlusion query. tfar is set to -inf if any hit is found.
+            rtcOccluded16(valid, scene_, &context, &r);
+            for (int j = 0; j < m; j++) {
+                occluded[offset + j] = r.tfar[j] < 0.f;
+            }
+        }
+    }
+
+private:
+    // Create hit information from the result of Embree's intersection query.
+    // instIDs are the geometry IDs of the instances from the root scene to the intersected geometry.
+    Hit make_hit(const unsigned int* instIDs, unsigned int geomID, unsigned int primID, float t, float u, float v) const {
+        // Get instance index and (unflattened) node index
+        // corresponding to the intersected (instanced) geometry
+        int i = 0;
+        int instance = 0;
+        for (int l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT && instIDs[l] != RTC_INVALID_GEOMETRY_ID; l++) {
+            instance += bases_[i][instIDs[l]];
+            i = flattened_scenes_[i][instIDs[l]].flattened_scene_index;
+        }
+        instance += bases_[i][geomID];
         return Hit{
-            Float(rayhit.ray.tfar),
-            Vec2(Float(rayhit.hit.u), Float(rayhit.hit.v)),
-            Transform(M),
-            node_index,
-            int(rayhit.hit.primID)
+            Float(t),
+            Vec2(Float(u), Float(v)),
+            instance,
+            flattened_scenes_[i][geomID].node_index,
+            int(primID)
         };
     }
 };
@@ -7,6 +7,8 @@
 
 #include <lm/logger.h>
 #include <lm/json.h>
+#include <lm/mesh.h>
+#include <lm/parallel.h>
 #pragma warning(push)
 #pragma warning(disable:4324)   // structure was padded due to alignment specifier
 #include <embree3/rtcore.h>
@@ -39,6 +41,55 @@ static void handle_embree_error(void*, RTCError code, const char* str = nullptr)
 }
 
 
+// Setup vertex and index buffers of an Embree triangle geometry.
+// If the mesh provides the shared position buffer, each position is stored once.
+// Otherwise three vertices are stored for each triangle.
+static void setup_geometry_buffers(RTCGeometry geom, const Mesh& mesh, const Mat4& M) {
+    const int num_triangles = mesh.num_triangles();
+    if (const auto buf = mesh.buffer(); buf) {
+        std::vector<int> vertices;
+        std::vector<unsigned int> faces;
+        mesh::compact_buffer(*buf, num_triangles, vertices, faces);
+        auto* vs = (glm::vec3*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, sizeof(glm::vec3), vertices.size());
+        auto* fs = (unsigned int*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, sizeof(glm::uvec3), num_triangles);
+        for (size_t i = 0; i < vertices.size(); i++) {
+            vs[i] = glm::vec3(M * Vec4(buf->ps[vertices[i]], 1_f));
+        }
+        std::copy(faces.begin(), faces.end(), fs);
+        return;
+    }
+    auto* vs = (glm::vec3*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, sizeof(glm::vec3), num_triangles * 3);
+    auto* fs = (glm::uvec3*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, sizeof(glm::uvec3), num_triangles);
+    mesh.foreach_triangle([&](int face, const Mesh::Tri& tri) {
+        vs[3 * face] = glm::vec3(M * Vec4(tri.p1.p, 1_f));
+        vs[3 * face + 1] = glm::vec3(M * Vec4(tri.p2.p, 1_f));
+        vs[3 * face + 2] = glm::vec3(M * Vec4(tri.p3.p, 1_f));
+        fs[face][0] = 3 * face;
+        fs[face][1] = 3 * face + 1;
+        fs[face][2] = 3 * face + 2;
+    });
+}
+
+// Update vertex buffer of an Embree triangle geometry created by setup_geometry_buffers()
+static void update_geometry_vertices(RTCGeometry geom, const Mesh& mesh, const Mat4& M) {
+    auto* vs = (glm::vec3*)rtcGetGeometryBufferData(geom, RTC_BUFFER_TYPE_VERTEX, 0);
+    if (const auto buf = mesh.buffer(); buf) {
+        std::vector<int> vertices;
+        std::vector<unsigned int> faces;
+        mesh::compact_buffer(*buf, mesh.num_triangles(), vertices, faces);
+        for (size_t i = 0; i < vertices.size(); i++) {
+            vs[i] = glm::vec3(M * Vec4(buf->ps[vertices[i]], 1_f));
+        }
+        return;
+    }
+    mesh.foreach_triangle([&](int face, const Mesh::Tri& tri) {
+        vs[3 * face] = glm::vec3(M * Vec4(tri.p1.p, 1_f));
+        vs[3 * face + 1] = glm::vec3(M * Vec4(tri.p2.p, 1_f));
+        vs[3 * face + 2] = glm::vec3(M * Vec4(tri.p3.p, 1_f));
+    });
+}
+
+
 inline std::string RTCtoStr(const RTCBuildArguments& rtc, const RTCSceneFlags& sf)
 {
         std::string str = fmt::format(
@@ -49,19 +100,112 @@ inline std::string RTCtoStr(const RTCBuildArguments& rtc, const RTCSceneFlags& s
         "minLeafSize:\t{}\n"
         "maxLeafSize:\t{}\n"
         "traversalCost:\t{}\n"
-        "intersectionCost:\t{}\n",
+        "intersectionCost:\t{}\n"
         "dynamic:\t{}\n"
         "compact:\t{}\n"
         "robust:\t{}\n"
         "filter:\t{}\n",
-        rtc.buildQuality, rtc.maxBranchingFactor, rtc.maxDepth, rtc.sahBlockSize, rtc.minLeafSize,
+        int(rtc.buildQuality), rtc.maxBranchingFactor, rtc.maxDepth, rtc.sahBlockSize, rtc.minLeafSize,
         rtc.maxLeafSize, rtc.traversalCost, rtc.intersectionCost,
-        sf & (1<<0),sf &(1<<1),sf&(1<<2),sf&(1<<3));
+        bool(sf & (1<<0)), bool(sf & (1<<1)), bool(sf & (1<<2)), bool(sf & (1<<3)));
         
        
         
         return str;
     }
+
+// Parameters of the "auto" preset.
+// With preset="auto", the build quality and the compact and robust scene flags
+// are chosen by configure_auto() from the size of the scene.
+struct EmbreeAutoPreset {
+    bool enabled = false;       // True if the preset is used
+    double ray_budget = 1e8;    // Expected number of traced rays, e.g., spp x pixels x path length
+    double memory_limit = 0;    // Memory limit of the structure in bytes. 0 for no limit.
+
+    static EmbreeAutoPreset from_prop(const Json& prop) {
+        EmbreeAutoPreset p;
+        const auto preset = json::value<std::string>(prop, "preset", "");
+        if (!preset.empty() && preset != "auto") {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid preset [preset='{}']", preset);
+        }
+        p.enabled = preset == "auto";
+        p.ray_budget = json::value<double>(prop, "ray_budget", 1e8);
+        p.memory_limit = json::value<double>(prop, "memory_limit", 0.0) * 1024.0 * 1024.0;
+        return p;
+    }
+};
+
+// Choose the build quality and the scene flags for the "auto" preset.
+// Each combination of the build quality (LOW/MEDIUM/HIGH) and the compact layout
+// gets estimates of the build time, the trace time for the ray budget, and the memory,
+// and the fastest one within the memory limit is selected.
+// The costs are rough per-triangle and per-ray estimates only meant to compare the options.
+// The robust mode is enabled when the scene receives many rays per triangle,
+// where the cracks between the triangles become visible and the slowdown is amortized.
+static void configure_auto(const EmbreeAutoPreset& preset, long long num_triangles, RTCBuildArguments& rtc, RTCSceneFlags& sf) {
+    struct Option {
+        RTCBuildQuality quality;
+        bool compact;
+    };
+    const double n = double(std::max(1LL, num_triangles));
+    const double depth = std::max(1.0, std::log2(n));
+    const double threads = double(parallel::num_threads());
+    const auto build_time = [&](const Option& o) {
+        // Morton builder for LOW, binned SAH for MEDIUM, and SAH with spatial splits for HIGH
+        const double t = o.quality == RTC_BUILD_QUALITY_LOW ? 30e-9
+                       : o.quality == RTC_BUILD_QUALITY_MEDIUM ? 100e-9 : 300e-9;
+        return n * t * (o.compact ? 1.1 : 1.0) / threads;
+    };
+    const auto trace_time = [&](const Option& o) {
+        const double quality = o.quality == RTC_BUILD_QUALITY_LOW ? 1.35
+                             : o.quality == RTC_BUILD_QUALITY_MEDIUM ? 1.0 : 0.9;
+        return preset.ray_budget * depth * 5e-9 * quality * (o.compact ? 1.1 : 1.0) / threads;
+    };
+    const auto memory = [&](const Option& o) {
+        // Spatial splits duplicate the references to the triangles
+        const double m = n * (o.compact ? 45.0 : 80.0);
+        return o.quality == RTC_BUILD_QUALITY_HIGH ? m * 1.3 : m;
+    };
+
+    // Select the fastest option within the memory limit,
+    // or the option with the least memory if none fits
+    const Option options[] = {
+        { RTC_BUILD_QUALITY_LOW, false },
+        { RTC_BUILD_QUALITY_MEDIUM, false },
+        { RTC_BUILD_QUALITY_HIGH, false },
+        { RTC_BUILD_QUALITY_LOW, true },
+        { RTC_BUILD_QUALITY_MEDIUM, true },
+        { RTC_BUILD_QUALITY_HIGH, true },
+    };
+    const auto fits = [&](const Option& o) {
+        return preset.memory_limit <= 0 || memory(o) <= preset.memory_limit;
+    };
+    const Option* best = &options[0];
+    for (const auto& o : options) {
+        if (fits(o) && (!fits(*best) || build_time(o) + trace_time(o) < build_time(*best) + trace_time(*best))) {
+            best = &o;
+        }
+        else if (!fits(o) && !fits(*best) && memory(o) < memory(*best)) {
+            best = &o;
+        }
+    }
+    const bool robust = preset.ray_budget / n >= 100.0;
+
+    // Apply the selected options
+    rtc.buildQuality = best->quality;
+    int flags = int(sf) & ~int(RTC_SCENE_FLAG_COMPACT | RTC_SCENE_FLAG_ROBUST);
+    if (best->compact) {
+        flags |= RTC_SCENE_FLAG_COMPACT;
+    }
+    if (robust) {
+        flags |= RTC_SCENE_FLAG_ROBUST;
+    }
+    sf = RTCSceneFlags(flags);
+    LM_INFO("Auto preset [triangles={}, ray_budget={:.3g}, estimated_build='{:.3f}s', "
+        "estimated_trace='{:.3f}s', estimated_memory='{:.2f}MB']",
+        num_triangles, preset.ray_budget, build_time(*best), trace_time(*best), memory(*best) / 1024.0 / 1024.0);
+    LM_INFO(RTCtoStr(rtc, sf));
+}
 LM_NAMESPACE_END(LM_NAMESPACE)
 
 LM_NAMESPACE_BEGIN(nlohmann)
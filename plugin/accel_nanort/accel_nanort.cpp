@@ -12,9 +12,153 @@
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
+namespace {
+
+// Triangle intersector for occlusion query.
+// NanoRT does not provide any-hit traversal, so we skip all triangle tests
+// after the first hit. The remaining nodes are culled by the hit distance.
+template <typename T>
+class OcclusionIntersector : public nanort::TriangleIntersector<T> {
+private:
+    mutable bool found_ = false;
+
+public:
+    using nanort::TriangleIntersector<T>::TriangleIntersector;
+
+    bool Intersect(T* t_inout, const unsigned int prim_index) const {
+        if (found_) {
+            return false;
+        }
+        found_ = nanort::TriangleIntersector<T>::Intersect(t_inout, prim_index);
+        return found_;
+    }
+};
+
+// Combined mesh and acceleration structure with positions of type T
+template <typename T>
+struct Geometry {
+    std::vector<T> vs;              // Positions
+    std::vector<unsigned int> fs;   // Position indices of triangles
+    nanort::BVHAccel<T> accel;
+
+    void clear() {
+        vs.clear();
+        fs.clear();
+    }
+
+    void add_vertex(Vec4 p) {
+        vs.insert(vs.end(), { T(p.x), T(p.y), T(p.z) });
+    }
+
+    unsigned int num_vertices() const {
+        return (unsigned int)(vs.size() / 3);
+    }
+
+    void build() {
+        nanort::BVHBuildOptions<T> options;
+        nanort::TriangleMesh<T> mesh(vs.data(), fs.data(), sizeof(T) * 3);
+        nanort::TriangleSAHPred<T> pred(vs.data(), fs.data(), sizeof(T) * 3);
+        accel.Build((unsigned int)(fs.size() / 3), mesh, pred, options);
+    }
+
+    static nanort::Ray<T> make_ray(Ray ray, Float tmin, Float tmax) {
+        nanort::Ray<T> r;
+        r.org[0] = T(ray.o[0]);
+        r.org[1] = T(ray.o[1]);
+        r.org[2] = T(ray.o[2]);
+        r.dir[0] = T(ray.d[0]);
+        r.dir[1] = T(ray.d[1]);
+        r.dir[2] = T(ray.d[2]);
+        r.min_t = T(tmin);
+        r.max_t = T(tmax);
+        return r;
+    }
+
+    template <typename Intersector>
+    bool traverse(Ray ray, Float tmin, Float tmax, nanort::TriangleIntersection<T>& isect) const {
+        Intersector intersector(vs.data(), fs.data(), sizeof(T) * 3);
+        return accel.Traverse(make_ray(ray, tmin, tmax), intersector, &isect);
+    }
+
+    static Bound node_bound(const nanort::BVHNode<T>& n) {
+        Bound b;
+        b = merge(b, Vec3(Float(n.bmin[0]), Float(n.bmin[1]), Float(n.bmin[2])));
+        b = merge(b, Vec3(Float(n.bmax[0]), Float(n.bmax[1]), Float(n.bmax[2])));
+        return b;
+    }
+
+    // Traverses the nodes in the same order as nanort and counts the steps.
+    // NanoRT does not provide the counts, so the traversal loop is replicated here.
+    void count_traversal(Ray ray, Float tmin, Float tmax, Accel::TraversalCounts& counts) const {
+        const auto& nodes = accel.GetNodes();
+        const auto& indices = accel.GetIndices();
+        if (nodes.empty()) {
+            return;
+        }
+        nanort::TriangleIntersector<T> intersector(vs.data(), fs.data(), sizeof(T) * 3);
+        intersector.PrepareTraversal(make_ray(ray, tmin, tmax), nanort::BVHTraceOptions());
+        Float hit_t = tmax;
+        std::vector<unsigned int> stack{ 0 };
+        while (!stack.empty()) {
+            const auto& n = nodes[stack.back()];
+            stack.pop_back();
+            counts.nodes++;
+            if (!node_bound(n).isect(ray, tmin, hit_t)) {
+                continue;
+            }
+            if (n.flag == 0) {
+                // Visit nearer child first
+                const int first = ray.d[n.axis] < 0 ? 1 : 0;
+                stack.push_back(n.data[1 - first]);
+                stack.push_back(n.data[first]);
+                continue;
+            }
+            for (unsigned int i = 0; i < n.data[0]; i++) {
+                counts.triangles++;
+                const auto prim = indices[n.data[1] + i];
+                T t = T(hit_t);
+                if (intersector.Intersect(&t, prim)) {
+                    intersector.Update(t, prim);
+                    hit_t = Float(t);
+                }
+            }
+        }
+    }
+
+    // Collects the statistics of the structure
+    Json structure() const {
+        const auto& nodes = accel.GetNodes();
+        if (nodes.empty()) {
+            return accel::BVHStats(Bound()).to_json(size());
+        }
+        accel::BVHStats stats(node_bound(nodes[0]));
+        std::function<void(unsigned int, int)> visit = [&](unsigned int ni, int depth) {
+            const auto& n = nodes[ni];
+            if (n.flag != 0) {
+                stats.add_leaf(node_bound(n), depth, int(n.data[0]));
+                return;
+            }
+            stats.add_interior(node_bound(n), depth);
+            visit(n.data[0], depth + 1);
+            visit(n.data[1], depth + 1);
+        };
+        visit(0, 0);
+        return stats.to_json(size()
+            + nodes.size() * sizeof(nanort::BVHNode<T>)
+            + accel.GetIndices().size() * sizeof(unsigned int));
+    }
+
+    size_t size() const {
+        return vs.size() * sizeof(T) + fs.size() * sizeof(unsigned int);
+    }
+};
+
+}
+
 struct FlattenedPrimitiveNode {
     Transform global_transform;  // Global transform of the primitive
     int primitive;              // Primitive node index
+    unsigned int offset;        // Index of the first triangle of the primitive
 };
 
 /*
@@ -22,23 +166,95 @@ struct FlattenedPrimitiveNode {
 .. function:: accel::nanort
 
    Acceleration structure with nanort library.
+
+   :param bool compact: Store the positions in single precision
+                        when ``Float`` is double. Roughly halves the memory
+                        of the combined mesh at the cost of the precision of the intersection.
+                        No effect in single-precision builds. Default: ``false``.
 \endrst
 */
 class Accel_NanoRT final : public Accel {
 private:
-    std::vector<Float> vs_;
-    std::vector<unsigned int> fs_;
-    nanort::BVHAccel<Float> accel_;
-    std::vector<std::tuple<int, int>> flatten_node_and_face_per_triangle_;
+    bool compact_ = false;
+    Geometry<Float> geom_;                                // Geometry in Float precision
+    Geometry<float> geom_compact_;                        // Geometry in single precision (compact)
+    std::vector<unsigned int> node_per_triangle_;         // Flattened node index per triangle
     std::vector<FlattenedPrimitiveNode> flattened_nodes_;
 
 public:
+    virtual void construct(const Json& prop) override {
+        compact_ = json::value<bool>(prop, "compact", false) && !std::is_same_v<Float, float>;
+    }
+
     virtual void build(const Scene& scene) override {
         // Make a combined mesh
         LM_INFO("Flattening scene");
-        vs_.clear();
-        fs_.clear();
-        flatten_node_and_face_per_triangle_.clear();
+        if (compact_) {
+            geom_.clear();
+            flatten(scene, geom_compact_);
+        }
+        else {
+            geom_compact_.clear();
+            flatten(scene, geom_);
+        }
+
+        // Build acceleration structure
+        LM_INFO("Building");
+        if (compact_) {
+            geom_compact_.build();
+        }
+        else {
+            geom_.build();
+        }
+        const auto size = (compact_ ? geom_compact_.size() : geom_.size())
+            + node_per_triangle_.size() * sizeof(unsigned int);
+        LM_INFO("Combined mesh [triangles={}, size='{:.2f}MB']",
+            node_per_triangle_.size(), double(size) / 1024.0 / 1024.0);
+    }
+    
+    virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
+        exception::ScopedDisableFPEx guard_;
+        return compact_ ? intersect(geom_compact_, ray, tmin, tmax) : intersect(geom_, ray, tmin, tmax);
+    }
+
+    virtual Transform instance_transform(int instance) const override {
+        return flattened_nodes_.at(instance).global_transform;
+    }
+
+    virtual bool occluded(Ray ray, Float tmin, Float tmax) const override {
+        exception::ScopedDisableFPEx guard_;
+        return compact_ ? occluded(geom_compact_, ray, tmin, tmax) : occluded(geom_, ray, tmin, tmax);
+    }
+
+    virtual bool count_traversal(Ray ray, Float tmin, Float tmax, TraversalCounts& counts) const override {
+        exception::ScopedDisableFPEx guard_;
+        if (compact_) {
+            geom_compact_.count_traversal(ray, tmin, tmax, counts);
+        }
+        else {
+            geom_.count_traversal(ray, tmin, tmax, counts);
+        }
+        return true;
+    }
+
+    virtual Json underlying_value(const std::string& query) const override {
+        if (query != "structure") {
+            return {};
+        }
+        auto j = compact_ ? geom_compact_.structure() : geom_.structure();
+        j["memory"] = j["memory"].get<size_t>()
+            + node_per_triangle_.size() * sizeof(unsigned int)
+            + flattened_nodes_.size() * sizeof(FlattenedPrimitiveNode);
+        j["triangles"] = node_per_triangle_.size();
+        j["compact"] = compact_;
+        return j;
+    }
+
+private:
+    template <typename T>
+    void flatten(const Scene& scene, Geometry<T>& geom) {
+        geom.clear();
+        node_per_triangle_.clear();
         flattened_nodes_.clear();
         scene.traverse_primitive_nodes([&](const SceneNode& node, Mat4 global_transform) {
             if (node.type != SceneNodeType::Primitive) {
@@ -49,51 +265,52 @@ public:
             }
 
             // Record flattened primitive
-            const int flatten_node_index = int(flattened_nodes_.size());
-            flattened_nodes_.push_back({ Transform(global_transform), node.index });
+            const auto flatten_node_index = (unsigned int)(flattened_nodes_.size());
+            flattened_nodes_.push_back({ Transform(global_transform), node.index, (unsigned int)(node_per_triangle_.size()) });
 
             // Triangles
-            node.primitive.mesh->foreach_triangle([&](int face, const Mesh::Tri& tri) {
-                const auto p1 = global_transform * Vec4(tri.p1.p, 1_f);
-                const auto p2 = global_transform * Vec4(tri.p2.p, 1_f);
-                const auto p3 = global_transform * Vec4(tri.p3.p, 1_f);
-                vs_.insert(vs_.end(), { p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, p3.x, p3.y, p3.z });
-                auto s = (unsigned int)(fs_.size());
-                fs_.insert(fs_.end(), { s, s+1, s+2 });
-                flatten_node_and_face_per_triangle_.push_back({ flatten_node_index, face });
+            // Store each position once if the mesh provides the shared position buffer
+            const int num_triangles = node.primitive.mesh->num_triangles();
+            node_per_triangle_.insert(node_per_triangle_.end(), num_triangles, flatten_node_index);
+            if (const auto buf = node.primitive.mesh->buffer(); buf) {
+                std::vector<int> vertices;
+                std::vector<unsigned int> faces;
+                mesh::compact_buffer(*buf, num_triangles, vertices, faces);
+                const auto s = geom.num_vertices();
+                for (int i : vertices) {
+                    geom.add_vertex(global_transform * Vec4(buf->ps[i], 1_f));
+                }
+                for (auto i : faces) {
+                    geom.fs.push_back(s + i);
+                }
+                return;
+            }
+            node.primitive.mesh->foreach_triangle([&](int, const Mesh::Tri& tri) {
+                const auto s = geom.num_vertices();
+                geom.add_vertex(global_transform * Vec4(tri.p1.p, 1_f));
+                geom.add_vertex(global_transform * Vec4(tri.p2.p, 1_f));
+                geom.add_vertex(global_transform * Vec4(tri.p3.p, 1_f));
+                geom.fs.insert(geom.fs.end(), { s, s+1, s+2 });
             });
         });
-
-        // Build acceleration structure
-        LM_INFO("Building");
-        nanort::BVHBuildOptions<Float> options;
-        nanort::TriangleMesh<Float> mesh(vs_.data(), fs_.data(), sizeof(Float) * 3);
-        nanort::TriangleSAHPred<Float> pred(vs_.data(), fs_.data(), sizeof(Float) * 3);
-        accel_.Build((unsigned int)(fs_.size() / 3), mesh, pred, options);
     }
-    
-    virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
-        exception::ScopedDisableFPEx guard_;
 
-        nanort::Ray<Float> r;
-        r.org[0] = ray.o[0];
-        r.org[1] = ray.o[1];
-        r.org[2] = ray.o[2];
-        r.dir[0] = ray.d[0];
-        r.dir[1] = ray.d[1];
-        r.dir[2] = ray.d[2];
-        r.min_t = tmin;
-        r.max_t = tmax;
-        
-        nanort::TriangleIntersector<Float> intersector(vs_.data(), fs_.data(), sizeof(Float) * 3);
-        nanort::TriangleIntersection<Float> isect;
-        if (!accel_.Traverse(r, intersector, &isect)) {
+    template <typename T>
+    std::optional<Hit> intersect(const Geometry<T>& geom, Ray ray, Float tmin, Float tmax) const {
+        nanort::TriangleIntersection<T> isect;
+        if (!geom.template traverse<nanort::TriangleIntersector<T>>(ray, tmin, tmax, isect)) {
             return {};
         }
-        
-        const auto [node, face] = flatten_node_and_face_per_triangle_.at(isect.prim_id);
-        const auto& fn = flattened_nodes_.at(node);
-        return Hit{ isect.t, Vec2(isect.u, isect.v), fn.global_transform, fn.primitive, face };
+        const int instance = int(node_per_triangle_.at(isect.prim_id));
+        const auto& fn = flattened_nodes_.at(instance);
+        const int face = int(isect.prim_id - fn.offset);
+        return Hit{ Float(isect.t), Vec2(Float(isect.u), Float(isect.v)), instance, fn.primitive, face };
+    }
+
+    template <typename T>
+    bool occluded(const Geometry<T>& geom, Ray ray, Float tmin, Float tmax) const {
+        nanort::TriangleIntersection<T> isect;
+        return geom.template traverse<OcclusionIntersector<T>>(ray, tmin, tmax, isect);
     }
 };
 
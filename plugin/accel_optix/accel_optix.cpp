@@ -0,0 +1,583 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <lm/accel.h>
+#include <lm/scene.h>
+#include <lm/mesh.h>
+#include <lm/logger.h>
+#include <lm/json.h>
+#include <lm/exception.h>
+#include <cuda_runtime.h>
+#include <optix.h>
+#include <optix_stubs.h>
+#include <optix_function_table_definition.h>
+#include "optix_params.h"
+#include "optix_programs_ptx.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+namespace {
+
+void check_cuda(cudaError_t code, const char* call) {
+    if (code == cudaSuccess) {
+        return;
+    }
+    LM_ERROR("CUDA error [call='{}', error='{}']", call, cudaGetErrorString(code));
+    LM_THROW_EXCEPTION(Error::None, cudaGetErrorName(code));
+}
+
+void check_optix(OptixResult code, const char* call) {
+    if (code == OPTIX_SUCCESS) {
+        return;
+    }
+    LM_ERROR("OptiX error [call='{}', error='{}']", call, optixGetErrorString(code));
+    LM_THROW_EXCEPTION(Error::None, optixGetErrorName(code));
+}
+
+#define LM_CUDA_CHECK(call) check_cuda(call, #call)
+#define LM_OPTIX_CHECK(call) check_optix(call, #call)
+
+// Buffer on the device memory
+class DeviceBuffer {
+private:
+    CUdeviceptr ptr_ = 0;
+    size_t size_ = 0;
+
+public:
+    DeviceBuffer() = default;
+    ~DeviceBuffer() {
+        free();
+    }
+
+    DeviceBuffer(const DeviceBuffer&) = delete;
+    DeviceBuffer& operator=(const DeviceBuffer&) = delete;
+    DeviceBuffer(DeviceBuffer&& o) noexcept : ptr_(o.ptr_), size_(o.size_) {
+        o.ptr_ = 0;
+        o.size_ = 0;
+    }
+    DeviceBuffer& operator=(DeviceBuffer&& o) noexcept {
+        std::swap(ptr_, o.ptr_);
+        std::swap(size_, o.size_);
+        return *this;
+    }
+
+    CUdeviceptr ptr() const { return ptr_; }
+    size_t size() const { return size_; }
+
+    // Allocate the buffer. The contents are discarded.
+    void alloc(size_t size) {
+        free();
+        LM_CUDA_CHECK(cudaMalloc((void**)&ptr_, size));
+        size_ = size;
+    }
+
+    // Allocate the buffer if its size is smaller than the given size
+    void reserve(size_t size) {
+        if (size_ < size) {
+            alloc(size);
+        }
+    }
+
+    void upload(const void* data, size_t size) {
+        alloc(size);
+        LM_CUDA_CHECK(cudaMemcpy((void*)ptr_, data, size, cudaMemcpyHostToDevice));
+    }
+
+    void free() {
+        if (ptr_) {
+            cudaFree((void*)ptr_);
+            ptr_ = 0;
+            size_ = 0;
+        }
+    }
+};
+
+// Geometry acceleration structure of a mesh in its local coordinates.
+// The structure is shared by the instances of the mesh.
+struct Gas {
+    DeviceBuffer buffer;
+    OptixTraversableHandle handle = 0;
+};
+
+// Resources to process a batch of the queries.
+// The rays and the results are transferred from and to the pinned host memory.
+struct Batch {
+    cudaStream_t stream = nullptr;
+    size_t capacity = 0;                // Number of rays that can be stored
+    RayData* rays = nullptr;            // Pinned host memory of the rays
+    HitData* hits = nullptr;            // Pinned host memory of the hits
+    unsigned int* occluded = nullptr;   // Pinned host memory of the occlusion flags
+    DeviceBuffer d_rays;
+    DeviceBuffer d_hits;
+    DeviceBuffer d_occluded;
+    DeviceBuffer d_params;
+
+    Batch() {
+        LM_CUDA_CHECK(cudaStreamCreate(&stream));
+        d_params.alloc(sizeof(LaunchParams));
+    }
+
+    ~Batch() {
+        free_host();
+        cudaStreamDestroy(stream);
+    }
+
+    LM_DISABLE_COPY_AND_MOVE(Batch)
+
+    void reserve(size_t n) {
+        if (n <= capacity) {
+            return;
+        }
+        capacity = std::max(n, 2 * capacity);
+        free_host();
+        LM_CUDA_CHECK(cudaMallocHost((void**)&rays, capacity * sizeof(RayData)));
+        LM_CUDA_CHECK(cudaMallocHost((void**)&hits, capacity * sizeof(HitData)));
+        LM_CUDA_CHECK(cudaMallocHost((void**)&occluded, capacity * sizeof(unsigned int)));
+        d_rays.alloc(capacity * sizeof(RayData));
+        d_hits.alloc(capacity * sizeof(HitData));
+        d_occluded.alloc(capacity * sizeof(unsigned int));
+    }
+
+private:
+    void free_host() {
+        if (rays) cudaFreeHost(rays);
+        if (hits) cudaFreeHost(hits);
+        if (occluded) cudaFreeHost(occluded);
+        rays = nullptr;
+        hits = nullptr;
+        occluded = nullptr;
+    }
+};
+
+// Shader binding table record without data
+struct alignas(OPTIX_SBT_RECORD_ALIGNMENT) SbtRecord {
+    char header[OPTIX_SBT_RECORD_HEADER_SIZE];
+};
+
+struct FlattenedPrimitiveNode {
+    Transform global_transform; // Global transform of the primitive
+    int primitive;              // Primitive node index
+};
+
+}
+
+// ------------------------------------------------------------------------------------------------
+
+/*
+\rst
+.. function:: accel::optix
+
+   Acceleration structure with NVIDIA OptiX.
+
+   :param int device: CUDA device index. Default value: 0.
+
+   The acceleration structures are built and traversed on the GPU.
+   A geometry acceleration structure (GAS) is built once for each mesh in its local coordinates
+   and the primitives are referenced from an instance acceleration structure (IAS)
+   with their global transforms. :cpp:func:`lm::Accel::update` only rebuilds the IAS,
+   so the meshes are assumed to be unchanged between the updates.
+
+   The implementation is designed for the batched queries,
+   e.g., :cpp:func:`lm::Accel::intersect_n` and :cpp:func:`lm::Accel::occluded_n`
+   requested by the wavefront renderers.
+   The rays and the results are transferred through pinned host buffers
+   and each batch is processed by a single launch.
+   The queries from multiple threads are processed concurrently in separate CUDA streams.
+   The single-ray queries are processed as batches of size one,
+   which is correct but does not amortize the transfer.
+   The rays are traced in single precision.
+\endrst
+*/
+class Accel_OptiX final : public Accel {
+private:
+    int device_ = 0;
+    OptixDeviceContext context_ = nullptr;
+    OptixModule module_ = nullptr;
+    OptixProgramGroup raygen_group_ = nullptr;
+    OptixProgramGroup miss_group_ = nullptr;
+    OptixProgramGroup hit_group_ = nullptr;
+    OptixPipeline pipeline_ = nullptr;
+    DeviceBuffer sbt_records_;
+    OptixShaderBindingTable sbt_{};
+
+    std::unordered_map<const Mesh*, Gas> gases_;        // GAS for each mesh
+    DeviceBuffer ias_buffer_;                           // Buffer of the IAS
+    OptixTraversableHandle ias_ = 0;                    // Handle of the IAS
+    std::vector<FlattenedPrimitiveNode> flattened_nodes_;
+
+    mutable std::mutex batches_mutex_;
+    mutable std::vector<std::unique_ptr<Batch>> batches_;   // Idle batches
+
+public:
+    ~Accel_OptiX() {
+        batches_.clear();
+        gases_.clear();
+        ias_buffer_.free();
+        sbt_records_.free();
+        if (pipeline_) optixPipelineDestroy(pipeline_);
+        if (raygen_group_) optixProgramGroupDestroy(raygen_group_);
+        if (miss_group_) optixProgramGroupDestroy(miss_group_);
+        if (hit_group_) optixProgramGroupDestroy(hit_group_);
+        if (module_) optixModuleDestroy(module_);
+        if (context_) optixDeviceContextDestroy(context_);
+    }
+
+    virtual void construct(const Json& prop) override {
+        device_ = json::value<int>(prop, "device", 0);
+
+        // Initialize CUDA and OptiX
+        LM_CUDA_CHECK(cudaSetDevice(device_));
+        LM_CUDA_CHECK(cudaFree(nullptr));
+        LM_OPTIX_CHECK(optixInit());
+        OptixDeviceContextOptions context_options{};
+        context_options.logCallbackFunction = [](unsigned int level, const char* tag, const char* message, void*) {
+            if (level <= 2) {
+                LM_ERROR("OptiX [tag='{}'] {}", tag, message);
+            }
+            else if (level == 3) {
+                LM_WARN("OptiX [tag='{}'] {}", tag, message);
+            }
+        };
+        context_options.logCallbackLevel = 3;
+        LM_OPTIX_CHECK(optixDeviceContextCreate(nullptr, &context_options, &context_));
+
+        // Module of the device programs
+        OptixModuleCompileOptions module_options{};
+        module_options.maxRegisterCount = OPTIX_COMPILE_DEFAULT_MAX_REGISTER_COUNT;
+        OptixPipelineCompileOptions pipeline_options{};
+        pipeline_options.traversableGraphFlags = OPTIX_TRAVERSABLE_GRAPH_FLAG_ALLOW_SINGLE_LEVEL_INSTANCING;
+        pipeline_options.numPayloadValues = 5;
+        pipeline_options.numAttributeValues = 2;
+        pipeline_options.exceptionFlags = OPTIX_EXCEPTION_FLAG_NONE;
+        pipeline_options.pipelineLaunchParamsVariableName = "params";
+        #if OPTIX_VERSION >= 70100
+        pipeline_options.usesPrimitiveTypeFlags = OPTIX_PRIMITIVE_TYPE_FLAGS_TRIANGLE;
+        #endif
+        char log[2048];
+        size_t log_size = sizeof(log);
+        #if OPTIX_VERSION >= 70700
+        LM_OPTIX_CHECK(optixModuleCreate(context_, &module_options, &pipeline_options,
+            optix_programs_ptx, strlen(optix_programs_ptx), log, &log_size, &module_));
+        #else
+        LM_OPTIX_CHECK(optixModuleCreateFromPTX(context_, &module_options, &pipeline_options,
+            optix_programs_ptx, strlen(optix_programs_ptx), log, &log_size, &module_));
+        #endif
+
+        // Program groups
+        OptixProgramGroupOptions group_options{};
+        OptixProgramGroupDesc raygen_desc{};
+        raygen_desc.kind = OPTIX_PROGRAM_GROUP_KIND_RAYGEN;
+        raygen_desc.raygen.module = module_;
+        raygen_desc.raygen.entryFunctionName = "__raygen__trace";
+        log_size = sizeof(log);
+        LM_OPTIX_CHECK(optixProgramGroupCreate(context_, &raygen_desc, 1, &group_options, log, &log_size, &raygen_group_));
+        OptixProgramGroupDesc miss_desc{};
+        miss_desc.kind = OPTIX_PROGRAM_GROUP_KIND_MISS;
+        miss_desc.miss.module = module_;
+        miss_desc.miss.entryFunctionName = "__miss__miss";
+        log_size = sizeof(log);
+        LM_OPTIX_CHECK(optixProgramGroupCreate(context_, &miss_desc, 1, &group_options, log, &log_size, &miss_group_));
+        OptixProgramGroupDesc hit_desc{};
+        hit_desc.kind = OPTIX_PROGRAM_GROUP_KIND_HITGROUP;
+        hit_desc.hitgroup.moduleCH = module_;
+        hit_desc.hitgroup.entryFunctionNameCH = "__closesthit__closest";
+        log_size = sizeof(log);
+        LM_OPTIX_CHECK(optixProgramGroupCreate(context_, &hit_desc, 1, &group_options, log, &log_size, &hit_group_));
+
+        // Pipeline
+        const OptixProgramGroup groups[] = { raygen_group_, miss_group_, hit_group_ };
+        OptixPipelineLinkOptions link_options{};
+        link_options.maxTraceDepth = 1;
+        log_size = sizeof(log);
+        LM_OPTIX_CHECK(optixPipelineCreate(context_, &pipeline_options, &link_options,
+            groups, 3, log, &log_size, &pipeline_));
+
+        // Shader binding table with a record for each program group
+        SbtRecord records[3];
+        for (int i = 0; i < 3; i++) {
+            LM_OPTIX_CHECK(optixSbtRecordPackHeader(groups[i], &records[i]));
+        }
+        sbt_records_.upload(records, sizeof(records));
+        sbt_.raygenRecord = sbt_records_.ptr();
+        sbt_.missRecordBase = sbt_records_.ptr() + sizeof(SbtRecord);
+        sbt_.missRecordStrideInBytes = sizeof(SbtRecord);
+        sbt_.missRecordCount = 1;
+        sbt_.hitgroupRecordBase = sbt_records_.ptr() + 2 * sizeof(SbtRecord);
+        sbt_.hitgroupRecordStrideInBytes = sizeof(SbtRecord);
+        sbt_.hitgroupRecordCount = 1;
+    }
+
+private:
+    // Build an acceleration structure and compact it
+    OptixTraversableHandle build_accel(const OptixBuildInput& input, DeviceBuffer& output) {
+        OptixAccelBuildOptions options{};
+        options.buildFlags = OPTIX_BUILD_FLAG_ALLOW_COMPACTION | OPTIX_BUILD_FLAG_PREFER_FAST_TRACE;
+        options.operation = OPTIX_BUILD_OPERATION_BUILD;
+        OptixAccelBufferSizes sizes;
+        LM_OPTIX_CHECK(optixAccelComputeMemoryUsage(context_, &options, &input, 1, &sizes));
+
+        DeviceBuffer temp;
+        DeviceBuffer uncompacted;
+        DeviceBuffer compacted_size;
+        temp.alloc(sizes.tempSizeInBytes);
+        uncompacted.alloc(sizes.outputSizeInBytes);
+        compacted_size.alloc(sizeof(size_t));
+        OptixAccelEmitDesc emit{};
+        emit.type = OPTIX_PROPERTY_TYPE_COMPACTED_SIZE;
+        emit.result = compacted_size.ptr();
+        OptixTraversableHandle handle = 0;
+        LM_OPTIX_CHECK(optixAccelBuild(context_, nullptr, &options, &input, 1,
+            temp.ptr(), temp.size(), uncompacted.ptr(), uncompacted.size(), &handle, &emit, 1));
+        LM_CUDA_CHECK(cudaDeviceSynchronize());
+
+        size_t size;
+        LM_CUDA_CHECK(cudaMemcpy(&size, (void*)compacted_size.ptr(), sizeof(size_t), cudaMemcpyDeviceToHost));
+        if (size >= uncompacted.size()) {
+            output = std::move(uncompacted);
+            return handle;
+        }
+        output.alloc(size);
+        LM_OPTIX_CHECK(optixAccelCompact(context_, nullptr, handle, output.ptr(), size, &handle));
+        LM_CUDA_CHECK(cudaDeviceSynchronize());
+        return handle;
+    }
+
+    // Build GAS of a mesh.
+    // If the mesh provides the shared position buffer, each position is stored once.
+    // Otherwise three vertices are stored for each triangle.
+    Gas build_gas(const Mesh& mesh) {
+        const int num_triangles = mesh.num_triangles();
+        std::vector<glm::vec3> vs;
+        std::vector<unsigned int> fs;
+        if (const auto buf = mesh.buffer(); buf) {
+            std::vector<int> vertices;
+            mesh::compact_buffer(*buf, num_triangles, vertices, fs);
+            vs.reserve(vertices.size());
+            for (const int i : vertices) {
+                vs.push_back(glm::vec3(buf->ps[i]));
+            }
+        }
+        else {
+            vs.resize(size_t(num_triangles) * 3);
+            fs.resize(size_t(num_triangles) * 3);
+            mesh.foreach_triangle([&](int face, const Mesh::Tri& tri) {
+                vs[3 * face] = glm::vec3(tri.p1.p);
+                vs[3 * face + 1] = glm::vec3(tri.p2.p);
+                vs[3 * face + 2] = glm::vec3(tri.p3.p);
+                for (int i = 0; i < 3; i++) {
+                    fs[3 * face + i] = 3 * face + i;
+                }
+            });
+        }
+
+        // The buffers are only needed while building
+        DeviceBuffer d_vs;
+        DeviceBuffer d_fs;
+        d_vs.upload(vs.data(), vs.size() * sizeof(glm::vec3));
+        d_fs.upload(fs.data(), fs.size() * sizeof(unsigned int));
+        const auto d_vs_ptr = d_vs.ptr();
+        const unsigned int flags = OPTIX_GEOMETRY_FLAG_DISABLE_ANYHIT;
+
+        OptixBuildInput input{};
+        input.type = OPTIX_BUILD_INPUT_TYPE_TRIANGLES;
+        auto& ta = input.triangleArray;
+        ta.vertexFormat = OPTIX_VERTEX_FORMAT_FLOAT3;
+        ta.vertexStrideInBytes = sizeof(glm::vec3);
+        ta.numVertices = (unsigned int)(vs.size());
+        ta.vertexBuffers = &d_vs_ptr;
+        ta.indexFormat = OPTIX_INDICES_FORMAT_UNSIGNED_INT3;
+        ta.indexStrideInBytes = 3 * sizeof(unsigned int);
+        ta.numIndexTriplets = (unsigned int)(num_triangles);
+        ta.indexBuffer = d_fs.ptr();
+        ta.flags = &flags;
+        ta.numSbtRecords = 1;
+
+        Gas gas;
+        gas.handle = build_accel(input, gas.buffer);
+        return gas;
+    }
+
+    // Build IAS referencing GAS of the meshes with the global transforms.
+    // GAS is built only for the meshes not built yet.
+    void build_instances(const Scene& scene) {
+        flattened_nodes_.clear();
+        std::vector<OptixInstance> instances;
+        scene.traverse_primitive_nodes([&](const SceneNode& node, Mat4 global_transform) {
+            if (node.type != SceneNodeType::Primitive || !node.primitive.mesh) {
+                return;
+            }
+            auto it = gases_.find(node.primitive.mesh);
+            if (it == gases_.end()) {
+                it = gases_.emplace(node.primitive.mesh, build_gas(*node.primitive.mesh)).first;
+            }
+
+            // Instance with row-major 3x4 transform
+            OptixInstance instance{};
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++) {
+                    instance.transform[4 * r + c] = float(global_transform[c][r]);
+                }
+            }
+            instance.instanceId = (unsigned int)(flattened_nodes_.size());
+            instance.visibilityMask = 255;
+            instance.sbtOffset = 0;
+            instance.flags = OPTIX_INSTANCE_FLAG_DISABLE_ANYHIT;
+            instance.traversableHandle = it->second.handle;
+            instances.push_back(instance);
+            flattened_nodes_.push_back({ Transform(global_transform), node.index });
+        });
+
+        ias_ = 0;
+        ias_buffer_.free();
+        if (instances.empty()) {
+            return;
+        }
+        DeviceBuffer d_instances;
+        d_instances.upload(instances.data(), instances.size() * sizeof(OptixInstance));
+        OptixBuildInput input{};
+        input.type = OPTIX_BUILD_INPUT_TYPE_INSTANCES;
+        input.instanceArray.instances = d_instances.ptr();
+        input.instanceArray.numInstances = (unsigned int)(instances.size());
+        ias_ = build_accel(input, ias_buffer_);
+    }
+
+    // Launch the queries of a batch.
+    // The rays must be written to batch.rays in advance.
+    void launch(Batch& batch, int n, bool occlusion) const {
+        LM_CUDA_CHECK(cudaMemcpyAsync((void*)batch.d_rays.ptr(), batch.rays,
+            n * sizeof(RayData), cudaMemcpyHostToDevice, batch.stream));
+        LaunchParams params;
+        params.handle = ias_;
+        params.rays = (const RayData*)batch.d_rays.ptr();
+        params.hits = (HitData*)batch.d_hits.ptr();
+        params.occluded = (unsigned int*)batch.d_occluded.ptr();
+        params.occlusion = occlusion ? 1 : 0;
+        LM_CUDA_CHECK(cudaMemcpyAsync((void*)batch.d_params.ptr(), &params,
+            sizeof(LaunchParams), cudaMemcpyHostToDevice, batch.stream));
+        LM_OPTIX_CHECK(optixLaunch(pipeline_, batch.stream, batch.d_params.ptr(),
+            sizeof(LaunchParams), &sbt_, (unsigned int)(n), 1, 1));
+        if (occlusion) {
+            LM_CUDA_CHECK(cudaMemcpyAsync(batch.occluded, (void*)batch.d_occluded.ptr(),
+                n * sizeof(unsigned int), cudaMemcpyDeviceToHost, batch.stream));
+        }
+        else {
+            LM_CUDA_CHECK(cudaMemcpyAsync(batch.hits, (void*)batch.d_hits.ptr(),
+                n * sizeof(HitData), cudaMemcpyDeviceToHost, batch.stream));
+        }
+        LM_CUDA_CHECK(cudaStreamSynchronize(batch.stream));
+    }
+
+    // Run func with an idle batch having the capacity of n rays
+    template <typename Func>
+    void with_batch(int n, Func&& func) const {
+        std::unique_ptr<Batch> batch;
+        {
+            std::unique_lock<std::mutex> lock(batches_mutex_);
+            if (!batches_.empty()) {
+                batch = std::move(batches_.back());
+                batches_.pop_back();
+            }
+        }
+        if (!batch) {
+            LM_CUDA_CHECK(cudaSetDevice(device_));
+            batch = std::make_unique<Batch>();
+        }
+        batch->reserve(n);
+        func(*batch);
+        std::unique_lock<std::mutex> lock(batches_mutex_);
+        batches_.push_back(std::move(batch));
+    }
+
+    static RayData make_ray(Ray ray, Float tmin, Float tmax) {
+        return {
+            float(ray.o.x), float(ray.o.y), float(ray.o.z), float(tmin),
+            float(ray.d.x), float(ray.d.y), float(ray.d.z), float(tmax)
+        };
+    }
+
+public:
+    virtual void build(const Scene& scene) override {
+        LM_CUDA_CHECK(cudaSetDevice(device_));
+        gases_.clear();
+        LM_INFO("Building");
+        build_instances(scene);
+    }
+
+    virtual void update(const Scene& scene) override {
+        LM_CUDA_CHECK(cudaSetDevice(device_));
+        LM_INFO("Updating instances");
+        build_instances(scene);
+    }
+
+    virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
+        std::optional<Hit> hit;
+        intersect_n(1, &ray, tmin, tmax, &hit);
+        return hit;
+    }
+
+    virtual Transform instance_transform(int instance) const override {
+        return flattened_nodes_.at(instance).global_transform;
+    }
+
+    virtual bool occluded(Ray ray, Float tmin, Float tmax) const override {
+        bool result;
+        occluded_n(1, &ray, tmin, &tmax, &result);
+        return result;
+    }
+
+    virtual void intersect_n(int n, const Ray* rays, Float tmin, Float tmax, std::optional<Hit>* hits) const override {
+        if (n == 0) {
+            return;
+        }
+        if (!ias_) {
+            std::fill(hits, hits + n, std::nullopt);
+            return;
+        }
+        with_batch(n, [&](Batch& batch) {
+            for (int i = 0; i < n; i++) {
+                batch.rays[i] = make_ray(rays[i], tmin, tmax);
+            }
+            launch(batch, n, false);
+            for (int i = 0; i < n; i++) {
+                const auto& h = batch.hits[i];
+                if (h.instance == InvalidInstance) {
+                    hits[i] = {};
+                    continue;
+                }
+                const auto& fn = flattened_nodes_[h.instance];
+                hits[i] = Hit{
+                    Float(h.t),
+                    Vec2(Float(h.u), Float(h.v)),
+                    int(h.instance),
+                    fn.primitive,
+                    int(h.face)
+                };
+            }
+        });
+    }
+
+    virtual void occluded_n(int n, const Ray* rays, Float tmin, const Float* tmax, bool* occluded) const override {
+        if (n == 0) {
+            return;
+        }
+        if (!ias_) {
+            std::fill(occluded, occluded + n, false);
+            return;
+        }
+        with_batch(n, [&](Batch& batch) {
+            for (int i = 0; i < n; i++) {
+                batch.rays[i] = make_ray(rays[i], tmin, tmax[i]);
+            }
+            launch(batch, n, true);
+            for (int i = 0; i < n; i++) {
+                occluded[i] = batch.occluded[i] != 0;
+            }
+        });
+    }
+};
+
+LM_COMP_REG_IMPL(Accel_OptiX, "accel::optix");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,13 @@
+#
+#   Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+#   Distributed under MIT license. See LICENSE file for details.
+#
+
+# Embed a PTX file into a header as a null-terminated char array.
+# Usage: cmake -DINPUT=<ptx> -DOUTPUT=<header> -DNAME=<variable> -P embed_ptx.cmake
+file(READ "${INPUT}" _HEX HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," _ARRAY "${_HEX}")
+file(WRITE "${OUTPUT}"
+    "// Generated from ${INPUT}. Do not edit.\n"
+    "#pragma once\n"
+    "static const char ${NAME}[] = { ${_ARRAY} 0x00 };\n")
@@ -0,0 +1,39 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+// Data shared by the host and the device programs of accel::optix.
+// The header is compiled by nvcc, so it must not include the framework headers.
+
+#include <optix_types.h>
+
+// Ray in the world space
+struct RayData {
+    float ox, oy, oz;   // Origin
+    float tmin;         // Lower bound of the valid range
+    float dx, dy, dz;   // Direction
+    float tmax;         // Upper bound of the valid range
+};
+
+// Hit information of the closest intersection
+struct HitData {
+    float t;                // Distance to the hit point
+    float u, v;             // Barycentric coordinates
+    unsigned int instance;  // Instance index. InvalidInstance if no hit.
+    unsigned int face;      // Face index
+};
+
+// Instance index indicating no hit
+const unsigned int InvalidInstance = ~0u;
+
+// Launch parameters
+struct LaunchParams {
+    OptixTraversableHandle handle;  // Instance acceleration structure
+    const RayData* rays;            // Rays to be traced
+    HitData* hits;                  // Output hits. Used if occlusion = 0.
+    unsigned int* occluded;         // Output occlusion flags. Used if occlusion = 1.
+    int occlusion;                  // 1 for the occlusion queries
+};
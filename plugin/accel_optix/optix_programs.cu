@@ -0,0 +1,56 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <optix.h>
+#include "optix_params.h"
+
+extern "C" {
+__constant__ LaunchParams params;
+}
+
+// One thread traces one ray of the batch
+extern "C" __global__ void __raygen__trace() {
+    const unsigned int i = optixGetLaunchIndex().x;
+    const RayData r = params.rays[i];
+    const float3 o = make_float3(r.ox, r.oy, r.oz);
+    const float3 d = make_float3(r.dx, r.dy, r.dz);
+
+    if (params.occlusion) {
+        // Miss program clears the flag
+        unsigned int occluded = 1;
+        optixTrace(params.handle, o, d, r.tmin, r.tmax, 0.f, OptixVisibilityMask(255),
+            OPTIX_RAY_FLAG_DISABLE_ANYHIT | OPTIX_RAY_FLAG_TERMINATE_ON_FIRST_HIT | OPTIX_RAY_FLAG_DISABLE_CLOSESTHIT,
+            0, 1, 0, occluded);
+        params.occluded[i] = occluded;
+        return;
+    }
+
+    unsigned int t = 0, u = 0, v = 0, instance = InvalidInstance, face = 0;
+    optixTrace(params.handle, o, d, r.tmin, r.tmax, 0.f, OptixVisibilityMask(255),
+        OPTIX_RAY_FLAG_DISABLE_ANYHIT,
+        0, 1, 0, t, u, v, instance, face);
+    HitData hit;
+    hit.t = __uint_as_float(t);
+    hit.u = __uint_as_float(u);
+    hit.v = __uint_as_float(v);
+    hit.instance = instance;
+    hit.face = face;
+    params.hits[i] = hit;
+}
+
+extern "C" __global__ void __miss__miss() {
+    // The first payload is the occlusion flag for the occlusion queries.
+    // For the closest hit queries, the distance is ignored since the instance is invalid.
+    optixSetPayload_0(0u);
+}
+
+extern "C" __global__ void __closesthit__closest() {
+    const float2 b = optixGetTriangleBarycentrics();
+    optixSetPayload_0(__float_as_uint(optixGetRayTmax()));
+    optixSetPayload_1(__float_as_uint(b.x));
+    optixSetPayload_2(__float_as_uint(b.y));
+    optixSetPayload_3(optixGetInstanceId());
+    optixSetPayload_4(optixGetPrimitiveIndex());
+}
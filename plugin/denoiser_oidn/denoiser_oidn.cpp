@@ -0,0 +1,94 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <lm/core.h>
+#include <lm/denoiser.h>
+#include <OpenImageDenoise/oidn.hpp>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: denoiser::oidn
+
+    Denoiser using Intel Open Image Denoise.
+
+    :param bool hdr: True if the color is high dynamic range. Default value: true.
+
+    This denoiser executes the ``RT`` filter of Open Image Denoise.
+    The albedo and the normal are used as auxiliary features if available.
+    Since Open Image Denoise requires the albedo to use the normal,
+    the normal is ignored if the albedo is unavailable.
+\endrst
+*/
+class Denoiser_OIDN final : public Denoiser {
+private:
+    bool hdr_;
+    mutable oidn::DeviceRef device_;    // Created on first use
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(hdr_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        hdr_ = json::value<bool>(prop, "hdr", true);
+    }
+
+    virtual std::vector<Vec3> denoise(int w, int h,
+        const std::vector<Vec3>& color,
+        const std::vector<Vec3>& albedo,
+        const std::vector<Vec3>& normal) const override
+    {
+        if (!device_) {
+            device_ = oidn::newDevice();
+            device_.commit();
+        }
+
+        // Open Image Denoise requires single precision images
+        const auto to_float = [](const std::vector<Vec3>& vs) {
+            std::vector<float> fs(vs.size() * 3);
+            for (size_t i = 0; i < vs.size(); i++) {
+                for (int j = 0; j < 3; j++) {
+                    fs[3*i+j] = float(vs[i][j]);
+                }
+            }
+            return fs;
+        };
+        auto color_f = to_float(color);
+        auto albedo_f = to_float(albedo);
+        auto normal_f = to_float(normal);
+        std::vector<float> output_f(color_f.size());
+
+        // Execute filter
+        auto filter = device_.newFilter("RT");
+        filter.setImage("color", color_f.data(), oidn::Format::Float3, w, h);
+        if (!albedo.empty()) {
+            filter.setImage("albedo", albedo_f.data(), oidn::Format::Float3, w, h);
+            if (!normal.empty()) {
+                filter.setImage("normal", normal_f.data(), oidn::Format::Float3, w, h);
+            }
+        }
+        filter.setImage("output", output_f.data(), oidn::Format::Float3, w, h);
+        filter.set("hdr", hdr_);
+        filter.commit();
+        filter.execute();
+        const char* message;
+        if (device_.getError(message) != oidn::Error::None) {
+            LM_THROW_EXCEPTION(Error::FailedToRender, "Failed to denoise [message='{}']", message);
+        }
+
+        std::vector<Vec3> output(color.size());
+        for (size_t i = 0; i < output.size(); i++) {
+            output[i] = Vec3(output_f[3*i], output_f[3*i+1], output_f[3*i+2]);
+        }
+        return output;
+    }
+};
+
+LM_COMP_REG_IMPL(Denoiser_OIDN, "denoiser::oidn");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
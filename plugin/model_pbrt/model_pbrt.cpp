@@ -1,4 +1,11 @@
 #include <lm/lm.h>
+#ifdef __GNUC__
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#else
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
 #pragma warning(push)
 #pragma warning(disable:4244)
 #undef _CRT_SECURE_NO_WARNINGS
@@ -32,6 +39,72 @@ Mat4 convertPbrtXfm(const pbrt::affine3f& v) {
     return transM * rotM;
 }
 
+// Hash of the triangle mesh invariant to translation.
+// The positions relative to the first vertex and the other attributes are quantized by the tolerance.
+std::uint64_t geometry_hash(const pbrt::TriangleMesh& mesh, Float tol) {
+    std::uint64_t h = 14695981039346656037ull;
+    const auto add = [&](long long v) {
+        for (int i = 0; i < 8; i++) {
+            h ^= (v >> (8*i)) & 0xff;
+            h *= 1099511628211ull;
+        }
+    };
+    const auto quantize = [&](float v) {
+        add((long long)(std::floor(v / tol)));
+    };
+    add((long long)(mesh.vertex.size()));
+    add((long long)(mesh.index.size()));
+    add((long long)(mesh.normal.size()));
+    add((long long)(mesh.texcoord.size()));
+    if (mesh.vertex.empty()) {
+        return h;
+    }
+    const auto p0 = mesh.vertex[0];
+    for (const auto& p : mesh.vertex) {
+        quantize(p.x - p0.x); quantize(p.y - p0.y); quantize(p.z - p0.z);
+    }
+    for (const auto& n : mesh.normal) {
+        quantize(n.x); quantize(n.y); quantize(n.z);
+    }
+    for (const auto& t : mesh.texcoord) {
+        quantize(t.x); quantize(t.y);
+    }
+    for (const auto& i : mesh.index) {
+        add(i.x); add(i.y); add(i.z);
+    }
+    return h;
+}
+
+// Check if the triangle meshes are the same up to translation
+bool same_geometry(const pbrt::TriangleMesh& a, const pbrt::TriangleMesh& b, Float tol) {
+    if (a.vertex.size() != b.vertex.size() || a.index.size() != b.index.size() ||
+        a.normal.size() != b.normal.size() || a.texcoord.size() != b.texcoord.size() || a.vertex.empty()) {
+        return false;
+    }
+    const auto offset = convert_pbrt_vec3(a.vertex[0]) - convert_pbrt_vec3(b.vertex[0]);
+    for (size_t i = 0; i < a.vertex.size(); i++) {
+        if (glm::compMax(glm::abs(convert_pbrt_vec3(a.vertex[i]) - offset - convert_pbrt_vec3(b.vertex[i]))) > tol) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a.normal.size(); i++) {
+        if (glm::compMax(glm::abs(convert_pbrt_vec3(a.normal[i]) - convert_pbrt_vec3(b.normal[i]))) > tol) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a.texcoord.size(); i++) {
+        if (glm::compMax(glm::abs(convertPbrtVec2(a.texcoord[i]) - convertPbrtVec2(b.texcoord[i]))) > tol) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a.index.size(); i++) {
+        if (a.index[i].x != b.index[i].x || a.index[i].y != b.index[i].y || a.index[i].z != b.index[i].z) {
+            return false;
+        }
+    }
+    return true;
+}
+
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -40,6 +113,11 @@ class Mesh_PBRT : public Mesh {
 private:
     pbrt::TriangleMesh* pbrt_mesh_;
 
+public:
+    const pbrt::TriangleMesh* pbrt_mesh() const {
+        return pbrt_mesh_;
+    }
+
 public:
     virtual void construct(const Json& prop) override {
         pbrt_mesh_ = prop["mesh_"].get<pbrt::TriangleMesh*>();
@@ -107,13 +185,32 @@ LM_COMP_REG_IMPL(Mesh_PBRT, "mesh::pbrt");
 
 // ------------------------------------------------------------------------------------------------
 
+// Model of PBRT scene.
+// The path can be either a PBRT scene file or a binary scene file of pbrtParser (.pbf),
+// which loads much faster because the vertex attributes are stored as bulk arrays
+// instead of being parsed from the text or the PLY files.
+// With pbf_cache parameter, the scene is loaded from the given .pbf file if it exists,
+// otherwise the PBRT scene is imported and saved to the file for the next load.
+// With dedup parameter, the shapes with the same geometry up to translation are detected
+// by the hash of the vertex attributes and share the mesh in an instance group.
+// The hashes are computed in parallel before the scene graph is constructed.
+// dedup_tolerance (default 1e-4) specifies the tolerance of the vertex attributes.
+// The shapes in the PBRT instances are not deduplicated because the instances are not nested.
+// The model is deferred as a whole by the lazy asset group (see asset_group::default),
+// but the meshes, camera, and material inside the model are created eagerly.
+// They are owned by the model and referenced from the scene nodes by raw pointers,
+// which are not resolved by the locators and thus never trigger the deferred construction.
+// The construction of the meshes is cheap anyway because they only refer to the geometry
+// already loaded by the parser, and every mesh is referenced by a node of the scene graph.
+// The model creates no textures since the PBRT materials are not converted yet.
 class Model_PBRT : public Model {
 private:
     pbrt::Scene::SP pbrt_scene_;		// Scene of PBRT parser
-    std::vector<Ptr<Mesh>> meshes_;		// Underlying meshes
+    std::vector<Ptr<Mesh_PBRT>> meshes_;	// Underlying meshes
     Ptr<Camera> camera_;				// Underlying camera
     Ptr<Material> defaultMaterial_;		// Default material (TODO: replace after material support)
     std::vector<SceneNode> nodes_;		// Scene nodes
+    bool has_instances_ = false;		// True if the scene graph contains instance groups
     
 public:
     Model_PBRT() {
@@ -125,7 +222,26 @@ public:
     virtual void construct(const Json& prop) override {
         // Load PBRT scene
         const std::string path = json::value<std::string>(prop, "path");
-        pbrt_scene_ = pbrt::importPBRT(path);
+        const auto pbf_cache = json::value<std::string>(prop, "pbf_cache", "");
+        try {
+            if (!pbf_cache.empty() && fs::exists(pbf_cache)) {
+                LM_INFO("Loading cached PBRT scene [path='{}']", pbf_cache);
+                pbrt_scene_ = pbrt::Scene::loadFrom(pbf_cache);
+            }
+            else if (fs::path(path).extension() == ".pbf") {
+                pbrt_scene_ = pbrt::Scene::loadFrom(path);
+            }
+            else {
+                pbrt_scene_ = pbrt::importPBRT(path);
+                if (pbrt_scene_ && !pbf_cache.empty()) {
+                    LM_INFO("Saving PBRT scene cache [path='{}']", pbf_cache);
+                    pbrt_scene_->saveTo(pbf_cache);
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            LM_THROW_EXCEPTION(Error::IOError, "Failed to load PBRT scene [path='{}', error='{}']", path, e.what());
+        }
         if (!pbrt_scene_) {
             LM_THROW_EXCEPTION(Error::IOError, "Failed to load PBRT scene [path='{}']", path);
         }
@@ -165,6 +281,36 @@ public:
 
         // Load meshes
         int meshCount = 0;
+        const bool dedup = json::value<bool>(prop, "dedup", false);
+        const auto dedup_tol = json::value<Float>(prop, "dedup_tolerance", 1e-4_f);
+        struct SharedMesh {
+            int mesh;           // Index of the mesh
+            int node;           // Index of the node of the first shape
+            int instance_group; // Index of the instance group, or -1 if not shared yet
+        };
+        std::unordered_multimap<std::uint64_t, SharedMesh> shared;    // Geometry hash -> shared mesh
+
+        // Compute the geometry hashes of the shareable shapes in parallel.
+        // Only the shapes directly under the world are shared (see the comment of the class).
+        std::unordered_map<const pbrt::TriangleMesh*, std::uint64_t> hashes;
+        if (dedup) {
+            std::vector<const pbrt::TriangleMesh*> ms;
+            for (const auto& shape : pbrt_scene_->world->shapes) {
+                const auto* mesh = dynamic_cast<const pbrt::TriangleMesh*>(shape.get());
+                if (mesh && !mesh->vertex.empty()) {
+                    ms.push_back(mesh);
+                }
+            }
+            std::vector<std::uint64_t> hs(ms.size());
+            parallel::foreach((long long)(ms.size()), [&](long long index, int) {
+                hs[index] = geometry_hash(*ms[index], dedup_tol);
+            }, [](long long) {});
+            hashes.reserve(ms.size());
+            for (size_t i = 0; i < ms.size(); i++) {
+                hashes.emplace(ms[i], hs[i]);
+            }
+        }
+        int instance_depth = 0;
         std::unordered_map<std::string, int> visited;	// Name of PBRT object -> node index
         using VisitObjectFunc = std::function<void(int, pbrt::Object::SP, const pbrt::affine3f&)>;
         const VisitObjectFunc visit_object = [&](int parent, pbrt::Object::SP pbrt_object, const pbrt::affine3f& instance_xfm) {
@@ -172,16 +318,57 @@ public:
             if (!pbrt_object->shapes.empty()) {
                 // For each shape in the pbrt object
                 for (auto& shape : pbrt_object->shapes) {
-                    // Create a mesh
                     auto mesh = std::dynamic_pointer_cast<pbrt::TriangleMesh>(shape);
                     if (!mesh) {
                         continue;
                     }
-                    auto lmMesh = lm::comp::create<Mesh>("mesh::pbrt", make_loc(std::to_string(meshCount++)), {
+
+                    // Share the mesh with the same geometry
+                    const bool shareable = dedup && instance_depth == 0 && !mesh->vertex.empty();
+                    std::uint64_t hash = 0;
+                    if (shareable) {
+                        const auto it_hash = hashes.find(mesh.get());
+                        hash = it_hash != hashes.end() ? it_hash->second : geometry_hash(*mesh, dedup_tol);
+                        const auto [begin, end] = shared.equal_range(hash);
+                        auto it = begin;
+                        while (it != end && !same_geometry(*mesh, *meshes_[it->second.mesh]->pbrt_mesh(), dedup_tol)) {
+                            ++it;
+                        }
+                        if (it != end) {
+                            auto& sm = it->second;
+                            if (sm.instance_group < 0) {
+                                // Move the primitive of the first shape into the instance group
+                                sm.instance_group = int(nodes_.size());
+                                nodes_.push_back(SceneNode::make_group(sm.instance_group, true, Mat4(1_f)));
+                                const int index = int(nodes_.size());
+                                nodes_.push_back(SceneNode::make_primitive(
+                                    index, meshes_[sm.mesh].get(), defaultMaterial_.get(), nullptr, nullptr, nullptr));
+                                nodes_[sm.instance_group].group.children.push_back(index);
+                                nodes_[sm.node] = SceneNode::make_group(sm.node, false, Mat4(1_f));
+                                nodes_[sm.node].group.children.push_back(sm.instance_group);
+                                has_instances_ = true;
+                            }
+
+                            // Transform group referring the instance group
+                            const auto offset = convert_pbrt_vec3(mesh->vertex[0])
+                                - convert_pbrt_vec3(meshes_[sm.mesh]->pbrt_mesh()->vertex[0]);
+                            const int index = int(nodes_.size());
+                            nodes_.push_back(SceneNode::make_group(index, false, glm::translate(offset)));
+                            nodes_[index].group.children.push_back(sm.instance_group);
+                            nodes_[parent].group.children.push_back(index);
+                            continue;
+                        }
+                    }
+
+                    // Create a mesh
+                    auto lmMesh = lm::comp::create<Mesh_PBRT>("mesh::pbrt", make_loc(std::to_string(meshCount++)), {
                         {"mesh_", mesh.get()}
                     });
                     assert(lmMesh);
                     meshes_.push_back(std::move(lmMesh));
+                    if (shareable) {
+                        shared.emplace(hash, SharedMesh{ int(meshes_.size()) - 1, int(nodes_.size()), -1 });
+                    }
 
                     // Create a scene node
                     const int index = int(nodes_.size());
@@ -210,13 +397,12 @@ public:
                         false,
                         convertPbrtXfm(global_xfm)
                     ));
-                    auto& transformGroup = nodes_.back();
                     nodes_[parent].group.children.push_back(transform_group_index);
 
                     // If we already created the instance group, use it
                     const auto it = visited.find(inst->object->name);
                     if (it != visited.end()) {
-                        transformGroup.group.children.push_back(it->second);
+                        nodes_[transform_group_index].group.children.push_back(it->second);
                     }
                     // Otherwise, recursively process the child node
                     else {
@@ -227,7 +413,11 @@ public:
                             true,
                             Mat4(1_f)
                         ));
+                        nodes_[transform_group_index].group.children.push_back(instance_group_node_index);
+                        has_instances_ = true;
+                        instance_depth++;
 						visit_object(instance_group_node_index, inst->object, global_xfm);
+                        instance_depth--;
                         visited[inst->object->name] = instance_group_node_index;
                     }
                 }
@@ -247,6 +437,10 @@ public:
             visit(node);
         }
     }
+
+    virtual bool has_instances() const override {
+        return has_instances_;
+    }
 };
 
 LM_COMP_REG_IMPL(Model_PBRT, "model::pbrt");
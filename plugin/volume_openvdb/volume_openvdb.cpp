@@ -6,15 +6,71 @@
 #include <lm/volume.h>
 #include <lm/core.h>
 #include <vdbloader.h>
+#include <atomic>
+#include <bitset>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
+/*
+\rst
+.. function:: volume::openvdb_scalar
+
+    Scalar volume loaded from OpenVDB file.
+
+    :param str path: Path to the OpenVDB file.
+    :param float scale: Scale multiplied to the density. Default value: 1.
+    :param float voxel_size: Voxel size of the grid in world space.
+                             If specified, the local maximum densities are computed by
+                             evaluating the density at the voxels inside the region.
+                             Otherwise the local majorants are the global maximum density.
+                             The voxels are also used by the traversal with :cpp:func:`lm::Volume::traverse_voxels`,
+                             which skips the blocks of :math:`8^3` voxels where the density is zero.
+    :param bool cache_voxels: Cache the densities at the voxels looked up by each thread.
+                              Requires ``voxel_size``. Default value: false.
+
+    Each density lookup of vdbloader traverses the tree of the grid from the root.
+    With ``cache_voxels``, the densities at the voxels are fetched from vdbloader
+    on the first access and kept in a small per-thread cache of the blocks of :math:`8^3` voxels,
+    and the density at a point is trilinearly interpolated from the cached voxels.
+    The spatially coherent lookups, e.g., of the distance tracking in dense media,
+    then mostly hit the cache.
+    The voxels are assumed to be placed at the multiples of ``voxel_size``
+    and interpolated trilinearly by vdbloader.
+\endrst
+*/
 class Volume_OpenVDBScalar : public Volume {
 private:
+    // Cache of the densities at the voxels looked up by a thread.
+    // The voxels are grouped into the blocks of BlockSize^3 voxels
+    // and the cache keeps a fixed number of blocks in a direct-mapped table.
+    struct VoxelCache {
+        static constexpr int NumBlocks = 64;
+        static constexpr int VoxelsPerBlock = 8 * 8 * 8;
+        struct Block {
+            long long owner = -1;                   // Identifier of the volume owning the block
+            glm::ivec3 coord{};                     // Block coordinates
+            float values[VoxelsPerBlock];           // Densities at the voxels
+            std::bitset<VoxelsPerBlock> valid;      // True if the density is fetched
+        };
+        std::vector<Block> blocks = std::vector<Block>(NumBlocks);
+    };
+
+
     VDBLoaderContext context_;
     Float scale_;
     Bound bound_;
     Float max_scalar_;
+    std::optional<Float> voxel_size_;
+
+    // Blocks of voxels for the traversal
+    static constexpr int BlockSize = 8;
+    Bound grid_bound_;                  // Bound of the voxels aligned to the blocks
+    glm::ivec3 block_dimension_{};      // Number of blocks along each axis
+    std::vector<bool> block_empty_;     // True if the density inside the block is zero
+
+    // Voxel cache
+    bool cache_voxels_ = false;
+    long long cache_id_;                // Identifier of the volume distinguishing the cached blocks
 
 public:
     Volume_OpenVDBScalar() {
@@ -31,6 +87,8 @@ public:
             LM_ERROR("vdbloader error: {} [type='{}']", message, errStr);
         });
         context_ = vdbloaderCreateContext();
+        static std::atomic<long long> next_cache_id(0);
+        cache_id_ = next_cache_id++;
     }
 
     ~Volume_OpenVDBScalar() {
@@ -56,6 +114,18 @@ public:
 
         // Maximum density
         max_scalar_ = vbdloaderGetMaxScalar(context_) * scale_;
+
+        // Voxel size for the local maximum densities
+        voxel_size_ = json::value_or_none<Float>(prop, "voxel_size");
+        if (voxel_size_) {
+            build_blocks();
+        }
+
+        // Voxel cache
+        cache_voxels_ = json::value<bool>(prop, "cache_voxels", false);
+        if (cache_voxels_ && !voxel_size_) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "cache_voxels requires voxel_size");
+        }
     }
 
     virtual Bound bound() const override {
@@ -66,15 +136,53 @@ public:
         return max_scalar_;
     }
 
+    virtual Float max_scalar_in(const Bound& b) const override {
+        if (!voxel_size_) {
+            return max_scalar_;
+        }
+
+        // Evaluate the voxels covering the region extended by a voxel,
+        // which are the voxels used by the interpolation inside the region
+        const auto s = *voxel_size_;
+        const auto lo = glm::floor(b.min / s) - 1_f;
+        const auto hi = glm::ceil(b.max / s) + 1_f;
+        Float m = 0_f;
+        for (auto z = lo.z; z <= hi.z; z += 1_f) {
+            for (auto y = lo.y; y <= hi.y; y += 1_f) {
+                for (auto x = lo.x; x <= hi.x; x += 1_f) {
+                    m = std::max(m, Float(vbdloaderEvalScalar(context_, VDBLoaderFloat3{ x * s, y * s, z * s })));
+                }
+            }
+        }
+        return std::min(m * scale_, max_scalar_);
+    }
+
     virtual bool has_scalar() const override {
         return true;
     }
 
     virtual Float eval_scalar(Vec3 p) const override {
+        if (cache_voxels_) {
+            return eval_cached(voxel_cache(), p) * scale_;
+        }
         const auto d = vbdloaderEvalScalar(context_, VDBLoaderFloat3{ p.x, p.y, p.z });
         return d * scale_;
     }
 
+    virtual void eval_scalar_n(const Vec3* ps, int n, Float* out) const override {
+        if (cache_voxels_) {
+            auto& cache = voxel_cache();
+            for (int i = 0; i < n; i++) {
+                out[i] = eval_cached(cache, ps[i]) * scale_;
+            }
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            const auto& p = ps[i];
+            out[i] = vbdloaderEvalScalar(context_, VDBLoaderFloat3{ p.x, p.y, p.z }) * scale_;
+        }
+    }
+
     virtual bool has_color() const override {
         return false;
     }
@@ -93,6 +201,109 @@ public:
                 return raymarchFunc(t);
             });
     }
+
+    virtual bool has_voxels() const override {
+        return bool(voxel_size_);
+    }
+
+    virtual void traverse_voxels(Ray ray, Float tmin, Float tmax, const VoxelFunc& func) const override {
+        if (!voxel_size_) {
+            LM_THROW_EXCEPTION(Error::Uninitialized, "Voxel traversal requires voxel_size");
+        }
+        if (!grid_bound_.isect_range(ray, tmin, tmax)) {
+            return;
+        }
+
+        // Traverse the blocks first and then the voxels inside the non-empty blocks
+        const auto block_size = *voxel_size_ * Float(BlockSize);
+        traverse_grid(ray, tmin, tmax, grid_bound_, block_dimension_, [&](glm::ivec3 b, Float t0, Float t1) -> bool {
+            if (block_empty_[block_index(b)]) {
+                return true;
+            }
+            const auto min = grid_bound_.min + block_size * Vec3(b);
+            return traverse_grid(ray, t0, t1, { min, min + block_size }, glm::ivec3(BlockSize), [&](glm::ivec3, Float t0, Float t1) -> bool {
+                return func(t0, t1);
+            });
+        });
+    }
+
+private:
+    // Voxel cache of the current thread
+    static VoxelCache& voxel_cache() {
+        thread_local VoxelCache cache;
+        return cache;
+    }
+
+    // Density at the voxel through the cache
+    Float cached_voxel(VoxelCache& cache, glm::ivec3 c) const {
+        // Block containing the voxel
+        const auto floor_div = [](int x) { return x >= 0 ? x / BlockSize : -((-x - 1) / BlockSize) - 1; };
+        const glm::ivec3 b(floor_div(c.x), floor_div(c.y), floor_div(c.z));
+        const auto l = c - b * BlockSize;
+        const auto h = unsigned(b.x) * 73856093u ^ unsigned(b.y) * 19349663u ^ unsigned(b.z) * 83492791u;
+        auto& block = cache.blocks[h % VoxelCache::NumBlocks];
+        if (block.owner != cache_id_ || block.coord != b) {
+            block.owner = cache_id_;
+            block.coord = b;
+            block.valid.reset();
+        }
+
+        // Fetch the density on the first access
+        const int i = (l.z * BlockSize + l.y) * BlockSize + l.x;
+        if (!block.valid[i]) {
+            const auto s = *voxel_size_;
+            block.values[i] = float(vbdloaderEvalScalar(context_,
+                VDBLoaderFloat3{ Float(c.x) * s, Float(c.y) * s, Float(c.z) * s }));
+            block.valid.set(i);
+        }
+        return Float(block.values[i]);
+    }
+
+    // Trilinear interpolation of the cached voxels
+    Float eval_cached(VoxelCache& cache, Vec3 p) const {
+        const auto q = p / *voxel_size_;
+        const auto f = glm::floor(q);
+        const auto w = q - f;
+        const glm::ivec3 c(f);
+        Float v[8];
+        for (int i = 0; i < 8; i++) {
+            v[i] = cached_voxel(cache, c + glm::ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        }
+        const auto x0 = glm::mix(v[0], v[1], w.x);
+        const auto x1 = glm::mix(v[2], v[3], w.x);
+        const auto x2 = glm::mix(v[4], v[5], w.x);
+        const auto x3 = glm::mix(v[6], v[7], w.x);
+        return glm::mix(glm::mix(x0, x1, w.y), glm::mix(x2, x3, w.y), w.z);
+    }
+
+    int block_index(glm::ivec3 b) const {
+        return (b.z * block_dimension_.y + b.y) * block_dimension_.x + b.x;
+    }
+
+    // Find the blocks of voxels where the density is zero
+    void build_blocks() {
+        const auto block_size = *voxel_size_ * Float(BlockSize);
+        grid_bound_.min = glm::floor(bound_.min / block_size) * block_size;
+        block_dimension_ = glm::max(glm::ivec3(glm::ceil((bound_.max - grid_bound_.min) / block_size)), glm::ivec3(1));
+        grid_bound_.max = grid_bound_.min + block_size * Vec3(block_dimension_);
+        block_empty_.assign(size_t(block_dimension_.x) * block_dimension_.y * block_dimension_.z, false);
+        int num_empty = 0;
+        for (int z = 0; z < block_dimension_.z; z++) {
+            for (int y = 0; y < block_dimension_.y; y++) {
+                for (int x = 0; x < block_dimension_.x; x++) {
+                    const glm::ivec3 b(x, y, z);
+                    Bound bb;
+                    bb.min = grid_bound_.min + block_size * Vec3(b);
+                    bb.max = bb.min + block_size;
+                    if (max_scalar_in(bb) == 0_f) {
+                        block_empty_[block_index(b)] = true;
+                        num_empty++;
+                    }
+                }
+            }
+        }
+        LM_INFO("Found {} empty blocks of {} blocks", num_empty, block_empty_.size());
+    }
 };
 
 LM_COMP_REG_IMPL(Volume_OpenVDBScalar, "volume::openvdb_scalar");
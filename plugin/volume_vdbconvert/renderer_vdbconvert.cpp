@@ -23,6 +23,7 @@ private:
     const Volume* volume_;
     Float march_step_;
     Float march_step_shadow_;
+    bool dda_;       // Traverse the voxels instead of the fixed steps if available.
     Vec3 light_dir_;
     Vec3 Le_;
     Vec3 muA_;       // Maximum absorption coefficient.
@@ -38,6 +39,7 @@ public:
         volume_ = json::comp_ref<Volume>(prop, "volume");
         march_step_ = json::value<Float>(prop, "march_step", .5_f);
         march_step_shadow_ = json::value<Float>(prop, "march_step_shadow", 1_f);
+        dda_ = json::value<bool>(prop, "dda", true) && volume_->has_voxels();
         light_dir_ = glm::normalize(json::value<Vec3>(prop, "light_dir", Vec3(1_f)));
         Le_ = json::value<Vec3>(prop, "Le", Vec3(1_f));
         muA_ = json::value<Vec3>(prop, "muA", Vec3(.1_f));
@@ -69,22 +71,22 @@ public:
             // Ray marching
             Vec3 L(0_f);
             Vec3 Tr(1_f);
-            volume_->march(ray, Eps, Inf, march_step_, [&](Float t) {
+            march(ray, march_step_, [&](Float t, Float dt) {
                 // Compute transmittance
                 const auto p = ray.o + ray.d * t;
                 const auto density = volume_->eval_scalar(p);
                 const auto muT = muT_ * density;
-                const auto T = glm::exp(-muT * march_step_);
+                const auto T = glm::exp(-muT * dt);
 
                 // Estimate transmittance along with the shadow ray
                 // Assume there's no occlusions in the scene
                 Ray shadow_ray{ p, light_dir_ };
                 Vec3 Tr_shadow(1_f);
-                volume_->march(shadow_ray, Eps, Inf, march_step_shadow_, [&](Float t_shadow) {
+                march(shadow_ray, march_step_shadow_, [&](Float t_shadow, Float dt_shadow) {
                     const auto p_shadow = shadow_ray.o + shadow_ray.d * t_shadow;
                     const auto density_shadow = volume_->eval_scalar(p_shadow);
                     const auto muT_shadow = muT_ * density_shadow;
-                    const auto T_shadow = glm::exp(-muT_shadow * march_step_shadow_);
+                    const auto T_shadow = glm::exp(-muT_shadow * dt_shadow);
                     Tr_shadow *= T_shadow;
                     if (glm::length2(Tr_shadow) < cutoff_) {
                         return false;
@@ -109,6 +111,22 @@ public:
 
         return { {"elapsed", st.now()} };
     }
+
+private:
+    // March the volume along with the ray.
+    // func is called with the sampled distance and the length of the segment represented by the sample.
+    // With voxel traversal, each voxel is sampled once at the middle of the segment inside the voxel.
+    void march(Ray ray, Float march_step, const std::function<bool(Float t, Float dt)>& func) const {
+        if (dda_) {
+            volume_->traverse_voxels(ray, Eps, Inf, [&](Float t0, Float t1) {
+                return func((t0 + t1) * .5_f, t1 - t0);
+            });
+            return;
+        }
+        volume_->march(ray, Eps, Inf, march_step, [&](Float t) {
+            return func(t, march_step);
+        });
+    }
 };
 
 LM_COMP_REG_IMPL(Renderer_OpenVDBRenderExampleConvert, "renderer::openvdb_render_example_convert");
@@ -6,7 +6,17 @@
 #include <lm/volume.h>
 #include <lm/core.h>
 #include <vdbloader.h>
+#include <lm/parallel.h>
 #include <fstream>
+#include <vector>
+#include <algorithm>
+#ifdef __GNUC__
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#else
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -16,13 +26,47 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
 using Vec3i = glm::tvec3<int>;
 
+/*
+\rst
+.. function:: volume::vdb_convert
+
+    Scalar volume converted from OpenVDB file.
+
+    :param str path: Path to the OpenVDB file (``.vdb``) or the converted file (``.cvdb``).
+    :param float scale: Scale multiplied to the density. Default value: 1.
+    :param float step_size: Voxel size of the converted grid. Default value: 0.1.
+    :param bool quantize: Store the densities in 16 bits. Default value: false.
+
+    The converted grid is stored in sparse bricks of :math:`8^3` voxels.
+    The bricks whose voxels are all zero are not stored.
+    With ``quantize`` enabled, each voxel is quantized to 16 bits relative to the maximum of the brick.
+    The maximum densities of the bricks are also used as the local majorants.
+    The traversal of the voxels with :cpp:func:`lm::Volume::traverse_voxels` skips the empty bricks.
+
+    An OpenVDB file is converted to the bricks in parallel, where each task samples a slab of bricks.
+    The result is cached in the converted file (``.cvdb``) and the meta file (``.json``) next to the OpenVDB file
+    in the brick layout, so the later loads of the same file with the same ``step_size``
+    read the bricks directly without the conversion.
+    The cache is invalidated when the OpenVDB file is newer than the converted file.
+    The converted files in the dense layout written by the older versions can still be loaded.
+\endrst
+*/
 class Volume_VdbConvertScalar : public Volume {
 private:
+    // Number of voxels along each axis of a brick
+    static constexpr int BrickSize = 8;
+    static constexpr int BrickVoxels = BrickSize * BrickSize * BrickSize;
+
     Bound bound_;
     Float max_scalar_{};
-    float* volume_;
     Vec3i dimension_{};
     Float scale_;
+    Vec3i brick_dimension_{};               // Number of bricks along each axis
+    std::vector<int> brick_indices_;        // Index of the data of the bricks. -1 if the brick is empty.
+    std::vector<float> brick_max_;          // Maximum density of the bricks
+    bool quantize_ = false;                 // True if the densities are quantized to 16 bits
+    std::vector<float> data_;               // Voxels of non-empty bricks
+    std::vector<uint16_t> data_quantized_;  // Quantized voxels of non-empty bricks
 
     std::string getAbsolutePath(std::string filename)
     {
@@ -64,12 +108,7 @@ private:
     }
 
 public:
-    Volume_VdbConvertScalar() : volume_(nullptr) {
-    }
-
-    ~Volume_VdbConvertScalar() {
-        delete volume_;
-    }
+    Volume_VdbConvertScalar() = default;
 
 private:
     bool convert(const std::string& path, const Json& prop) {
@@ -151,6 +190,69 @@ private:
 
         LM_INFO("Step Counts: {}, {}, {}", x_steps, y_steps, z_steps);
 
+        // Sample the grid into the bricks in parallel.
+        // Each task samples a slab of bricks along z and keeps only the non-empty bricks,
+        // so the dense grid is never stored in memory.
+        bound_ = bound;
+        dimension_ = Vec3i(x_steps, y_steps, z_steps);
+        max_scalar_ = max_scalar;
+        brick_dimension_ = (dimension_ + BrickSize - 1) / BrickSize;
+        struct Slab {
+            std::vector<int> bricks;    // Brick indices of the non-empty bricks in the slab
+            std::vector<float> max;     // Maximum densities of the non-empty bricks
+            std::vector<float> data;    // Voxels of the non-empty bricks
+        };
+        std::vector<Slab> slabs(brick_dimension_.z);
+        parallel::foreach(brick_dimension_.z, [&](long long index, int) {
+            const int bz = int(index);
+            auto& slab = slabs[bz];
+            std::vector<float> brick(BrickVoxels);
+            for (int by = 0; by < brick_dimension_.y; by++) {
+                for (int bx = 0; bx < brick_dimension_.x; bx++) {
+                    float m = 0.0f;
+                    for (int z = 0; z < BrickSize; z++) {
+                        for (int y = 0; y < BrickSize; y++) {
+                            for (int x = 0; x < BrickSize; x++) {
+                                const Vec3i g(bx * BrickSize + x, by * BrickSize + y, bz * BrickSize + z);
+                                const bool inside = g.x < dimension_.x && g.y < dimension_.y && g.z < dimension_.z;
+                                const float v = inside
+                                    ? float(vbdloaderEvalScalar(context, VDBLoaderFloat3{
+                                        bound.min.x + g.x * step_size,
+                                        bound.min.y + g.y * step_size,
+                                        bound.min.z + g.z * step_size }))
+                                    : 0.0f;
+                                brick[(z * BrickSize + y) * BrickSize + x] = v;
+                                m = std::max(m, v);
+                            }
+                        }
+                    }
+                    if (m == 0.0f) {
+                        continue;
+                    }
+                    slab.bricks.push_back(brick_index(bx, by, bz));
+                    slab.max.push_back(m);
+                    slab.data.insert(slab.data.end(), brick.begin(), brick.end());
+                }
+            }
+        }, [](long long) {});
+        vdbloaderReleaseContext(context);
+
+        // Gather the bricks in the order of the slabs
+        brick_indices_.assign(size_t(brick_dimension_.x) * brick_dimension_.y * brick_dimension_.z, -1);
+        brick_max_.assign(brick_indices_.size(), 0.0f);
+        data_.clear();
+        int num_bricks = 0;
+        for (auto& slab : slabs) {
+            for (size_t i = 0; i < slab.bricks.size(); i++) {
+                brick_indices_[slab.bricks[i]] = num_bricks++;
+                brick_max_[slab.bricks[i]] = slab.max[i];
+            }
+            data_.insert(data_.end(), slab.data.begin(), slab.data.end());
+            slab = {};
+        }
+        LM_INFO("Converted {} of {} bricks", num_bricks, brick_indices_.size());
+
+        // Save the meta file and the bricks
         Json json;
         Json jsonBound;
         Json jsonBoundMin;
@@ -171,34 +273,159 @@ private:
         json.emplace("dimension", jsonDimension);
         json.emplace("step_size", step_size);
         json.emplace("max_scalar", max_scalar);
+        json.emplace("layout", "bricks");
+        json.emplace("num_bricks", num_bricks);
 
         std::ofstream meta_file_stream(new_path_meta, std::ios::out);
         meta_file_stream << json.dump(4);
         meta_file_stream.close();
 
         std::ofstream converted_file_stream(new_path, std::ios::out | std::ios::binary);
-        for(int z = 0; z < z_steps; z++) {
-            for (int y = 0; y < y_steps; y++) {
-                for (int x = 0; x < x_steps; x++) {
-                    float value = float(vbdloaderEvalScalar(context, VDBLoaderFloat3{bound.min.x + x * step_size, bound.min.y + y * step_size, bound.min.z + z * step_size}));
-                    converted_file_stream.write(reinterpret_cast<char*>(&value), sizeof(float));
-                }
-            }
-        }
+        converted_file_stream.write(reinterpret_cast<const char*>(brick_indices_.data()), sizeof(int) * brick_indices_.size());
+        converted_file_stream.write(reinterpret_cast<const char*>(brick_max_.data()), sizeof(float) * brick_max_.size());
+        converted_file_stream.write(reinterpret_cast<const char*>(data_.data()), sizeof(float) * data_.size());
         converted_file_stream.close();
-        vdbloaderReleaseContext(context);
 
         return true;
     }
 
+    // Check if the converted files of the OpenVDB file can be used
+    bool converted_valid(const std::string& path, const std::string& path_converted, const std::string& path_meta, Float step_size) const {
+        if (!fs::exists(path_converted) || !fs::exists(path_meta)) {
+            return false;
+        }
+        if (fs::last_write_time(path_converted) < fs::last_write_time(path)) {
+            return false;
+        }
+        std::ifstream meta_stream(path_meta);
+        const auto meta = Json::parse(meta_stream, nullptr, false);
+        return !meta.is_discarded()
+            && json::value<std::string>(meta, "layout", "dense") == "bricks"
+            && json::value<Float>(meta, "step_size", 0_f) == step_size;
+    }
+
+    // Read the bricks saved by convert()
+    void read_bricks(std::ifstream& stream, int num_bricks) {
+        brick_dimension_ = (dimension_ + BrickSize - 1) / BrickSize;
+        brick_indices_.resize(size_t(brick_dimension_.x) * brick_dimension_.y * brick_dimension_.z);
+        brick_max_.resize(brick_indices_.size());
+        data_.resize(size_t(num_bricks) * BrickVoxels);
+        stream.read(reinterpret_cast<char*>(brick_indices_.data()), sizeof(int) * brick_indices_.size());
+        stream.read(reinterpret_cast<char*>(brick_max_.data()), sizeof(float) * brick_max_.size());
+        stream.read(reinterpret_cast<char*>(data_.data()), sizeof(float) * data_.size());
+        if (!stream) {
+            LM_THROW_EXCEPTION(Error::IOError, "Failed to read the converted volume");
+        }
+        LM_INFO("Loaded {} of {} bricks", num_bricks, brick_indices_.size());
+    }
+
+    // Quantize the voxels of the bricks to 16 bits
+    void quantize_bricks() {
+        data_quantized_.resize(data_.size());
+        parallel::foreach((long long)(brick_indices_.size()), [&](long long b, int) {
+            const int data_index = brick_indices_[b];
+            if (data_index < 0) {
+                return;
+            }
+            const float m = brick_max_[b];
+            for (int i = 0; i < BrickVoxels; i++) {
+                const size_t j = size_t(data_index) * BrickVoxels + i;
+                data_quantized_[j] = uint16_t(std::round(std::max(data_[j], 0.0f) / m * 65535.0f));
+            }
+        }, [](long long) {});
+        data_.clear();
+        data_.shrink_to_fit();
+    }
+
     float eval_scalar(int x, int y, int z) const {
         // first check if in bound. If out of bound --> Zero Density
         if (x < 0 || y < 0 || z < 0
             || x >= dimension_.x || y >= dimension_.y || z >= dimension_.z) {
             return 0.0f;
         }
-        // otherwise read from float array with data
-        return volume_[z * dimension_.x * dimension_.y + y * dimension_.x + x];
+        // Find the brick containing the voxel
+        const int b = brick_index(x / BrickSize, y / BrickSize, z / BrickSize);
+        const int data_index = brick_indices_[b];
+        if (data_index < 0) {
+            return 0.0f;
+        }
+        const int i = data_index * BrickVoxels
+            + ((z % BrickSize) * BrickSize + (y % BrickSize)) * BrickSize + (x % BrickSize);
+        if (quantize_) {
+            return float(data_quantized_[i]) * (brick_max_[b] / 65535.0f);
+        }
+        return data_[i];
+    }
+
+    int brick_index(int bx, int by, int bz) const {
+        return (bz * brick_dimension_.y + by) * brick_dimension_.x + bx;
+    }
+
+    // True if the interpolated densities inside the brick are all zero.
+    // The interpolation inside the brick also refers to the voxels of the next bricks.
+    bool brick_region_empty(Vec3i b) const {
+        const auto hi = glm::min(b + 1, brick_dimension_ - 1);
+        for (int z = b.z; z <= hi.z; z++) {
+            for (int y = b.y; y <= hi.y; y++) {
+                for (int x = b.x; x <= hi.x; x++) {
+                    if (brick_indices_[brick_index(x, y, z)] >= 0) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Read the dense grid written by the older versions and store the non-empty bricks.
+    // The grid is read by the slab of bricks to limit the memory footprint.
+    void load_bricks(std::ifstream& stream) {
+        brick_dimension_ = (dimension_ + BrickSize - 1) / BrickSize;
+        brick_indices_.assign(brick_dimension_.x * brick_dimension_.y * brick_dimension_.z, -1);
+        brick_max_.assign(brick_indices_.size(), 0.0f);
+        data_.clear();
+        data_quantized_.clear();
+
+        const size_t slice_size = size_t(dimension_.x) * dimension_.y;
+        std::vector<float> slab(slice_size * BrickSize);
+        std::vector<float> brick(BrickVoxels);
+        int num_bricks = 0;
+        for (int bz = 0; bz < brick_dimension_.z; bz++) {
+            const int nz = std::min(BrickSize, dimension_.z - bz * BrickSize);
+            std::fill(slab.begin(), slab.end(), 0.0f);
+            stream.read(reinterpret_cast<char*>(slab.data()), sizeof(float) * slice_size * nz);
+            for (int by = 0; by < brick_dimension_.y; by++) {
+                for (int bx = 0; bx < brick_dimension_.x; bx++) {
+                    // Gather the voxels of the brick
+                    float m = 0.0f;
+                    for (int z = 0; z < BrickSize; z++) {
+                        for (int y = 0; y < BrickSize; y++) {
+                            for (int x = 0; x < BrickSize; x++) {
+                                const int gx = bx * BrickSize + x;
+                                const int gy = by * BrickSize + y;
+                                const bool inside = z < nz && gx < dimension_.x && gy < dimension_.y;
+                                const float v = inside ? slab[z * slice_size + size_t(gy) * dimension_.x + gx] : 0.0f;
+                                brick[(z * BrickSize + y) * BrickSize + x] = v;
+                                m = std::max(m, v);
+                            }
+                        }
+                    }
+
+                    // Skip empty brick
+                    if (m == 0.0f) {
+                        continue;
+                    }
+
+                    // Store the brick
+                    const int b = brick_index(bx, by, bz);
+                    brick_indices_[b] = num_bricks++;
+                    brick_max_[b] = m;
+                    data_.insert(data_.end(), brick.begin(), brick.end());
+                }
+            }
+        }
+
+        LM_INFO("Stored {} of {} bricks", num_bricks, brick_indices_.size());
     }
 
     float lerp(int x1, int y1, int z1, int x2, int y2, int z2, float t) const {
@@ -209,14 +436,40 @@ private:
         return a + t * (b - a);
     }
 
+    // Trilinear interpolation of the grid without scaling
+    float eval_trilinear(Vec3 p) const {
+        // Compute uv in bound
+        Vec3 p_boundSpace = (p - bound_.min) / (bound_.max - bound_.min);
+        // scale to address in volume array
+        p_boundSpace *= dimension_;
+
+        // aligned cube around our position p
+        const Vec3i lowerLeft = { int(std::floor(p_boundSpace.x)), int(std::floor(p_boundSpace.y)), int(std::floor(p_boundSpace.z)) };
+        const Vec3i upperRight = lowerLeft + Vec3i(1);
+        // factor for trilinear interpolation
+        const Vec3 t = p_boundSpace - Vec3(lowerLeft);
+        
+        // first interpolate on x-axis, then y-axis, z-axis
+        const float x00 = lerp(lowerLeft.x, lowerLeft.y, lowerLeft.z, upperRight.x, lowerLeft.y, lowerLeft.z, float(t.x));
+        const float x01 = lerp(lowerLeft.x, lowerLeft.y, upperRight.z, upperRight.x, lowerLeft.y, upperRight.z, float(t.x));
+        const float x10 = lerp(lowerLeft.x, upperRight.y, lowerLeft.z, upperRight.x, upperRight.y, lowerLeft.z, float(t.x));
+        const float x11 = lerp(lowerLeft.x, upperRight.y, upperRight.z, upperRight.x, upperRight.y, upperRight.z, float(t.x));
+        // now y-axis
+        const float y0 = lerp(x00, x10, float(t.y));
+        const float y1 = lerp(x01, x11, float(t.y));
+        // final interpolation
+        return lerp(y0, y1, float(t.z));
+    }
+
 public:
     virtual void construct(const Json& prop) override {
+        scale_ = json::value<Float>(prop, "scale", 1_f);
+        quantize_ = json::value<bool>(prop, "quantize", false);
+
         // Load VDB file
         std::string path_base;
         const auto path = json::value<std::string>(prop, "path");
         if (endsWith(path, ".vdb")) {
-            LM_INFO("Attempting old vdb load");
-            convert(path, prop);
             path_base = path.substr(0, path.find(VDB_ENDING));
         } else {
             path_base = path.substr(0, path.find(NEW_ENDING));
@@ -224,36 +477,52 @@ public:
         std::string path_converted = path_base + NEW_ENDING;
         std::string path_meta = path_base + META_ENDING;
 
-        scale_ = json::value<Float>(prop, "scale", 1_f);
-
-        std::ifstream meta_stream(path_meta);
-        Json meta = Json::parse(meta_stream);
-        const auto step_size = json::value<Float>(meta, "step_size");
-        const auto dimension = json::value<Json>(meta, "dimension");
-        dimension_ = Vec3i(json::value<int>(dimension, "x"), json::value<int>(dimension, "y"), json::value<int>(dimension, "z"));
-        Json bound = json::value<Json>(meta, "bound");
-        Json boundMin = json::value<Json>(bound, "min");
-        Json boundMax = json::value<Json>(bound, "max");
-        bound_.min = Vec3(json::value<Float>(boundMin, "x"), json::value<Float>(boundMin, "y"), json::value<Float>(boundMin, "z"));
-        bound_.max = Vec3(json::value<Float>(boundMax, "x"), json::value<Float>(boundMax, "y"), json::value<Float>(boundMax, "z"));
-        max_scalar_ = json::value<Float>(meta, "max_scalar") * scale_;
-
-        LM_INFO("Loaded Converted Volume File");
-        LM_INFO("Extended Bound of Volume adapted to step_size: [{}, {}, {}] to [{}, {}, {}].",
-            bound_.min.x,
-            bound_.min.y,
-            bound_.min.z,
-            bound_.max.x,
-            bound_.max.y,
-            bound_.max.z);
-        LM_INFO("Step Counts: {}, {}, {}", dimension_.x, dimension_.y, dimension_.z);
+        if (endsWith(path, ".vdb") && !converted_valid(path, path_converted, path_meta, json::value<Float>(prop, "step_size", .1_f))) {
+            // Convert the OpenVDB file. The bricks are kept in memory.
+            LM_INFO("Converting OpenVDB file [path='{}']", path);
+            convert(path, prop);
+        }
+        else {
+            // Load the converted file
+            std::ifstream meta_stream(path_meta);
+            Json meta = Json::parse(meta_stream);
+            const auto dimension = json::value<Json>(meta, "dimension");
+            dimension_ = Vec3i(json::value<int>(dimension, "x"), json::value<int>(dimension, "y"), json::value<int>(dimension, "z"));
+            Json bound = json::value<Json>(meta, "bound");
+            Json boundMin = json::value<Json>(bound, "min");
+            Json boundMax = json::value<Json>(bound, "max");
+            bound_.min = Vec3(json::value<Float>(boundMin, "x"), json::value<Float>(boundMin, "y"), json::value<Float>(boundMin, "z"));
+            bound_.max = Vec3(json::value<Float>(boundMax, "x"), json::value<Float>(boundMax, "y"), json::value<Float>(boundMax, "z"));
+            max_scalar_ = json::value<Float>(meta, "max_scalar");
+
+            LM_INFO("Loaded Converted Volume File");
+            LM_INFO("Extended Bound of Volume adapted to step_size: [{}, {}, {}] to [{}, {}, {}].",
+                bound_.min.x,
+                bound_.min.y,
+                bound_.min.z,
+                bound_.max.x,
+                bound_.max.y,
+                bound_.max.z);
+            LM_INFO("Step Counts: {}, {}, {}", dimension_.x, dimension_.y, dimension_.z);
+
+            // Load the grid into sparse bricks
+            std::ifstream vdb_stream(path_converted, std::ios::in | std::ios::binary);
+            if (json::value<std::string>(meta, "layout", "dense") == "bricks") {
+                read_bricks(vdb_stream, json::value<int>(meta, "num_bricks"));
+            }
+            else {
+                load_bricks(vdb_stream);
+            }
+        }
+        max_scalar_ *= scale_;
         LM_INFO("Max Scalar: {}", max_scalar_);
+        if (quantize_) {
+            quantize_bricks();
+        }
+    }
 
-        // create large enough buffer
-        auto volume_size = dimension_.x * dimension_.y * dimension_.z;
-        volume_ = new float[volume_size];
-        std::ifstream vdb_stream(path_converted, std::ios::in | std::ios::binary);
-        vdb_stream.read(reinterpret_cast<char*>(volume_), sizeof(float) * volume_size);
+    virtual size_t memory_usage() const override {
+        return comp::bytes_of(brick_indices_, brick_max_, data_, data_quantized_);
     }
 
     virtual Bound bound() const override {
@@ -264,34 +533,35 @@ public:
         return max_scalar_;
     }
 
+    virtual Float max_scalar_in(const Bound& b) const override {
+        // Maximum of the bricks containing the voxels used by the trilinear interpolation inside the region
+        const Vec3 lo = (b.min - bound_.min) / (bound_.max - bound_.min) * Vec3(dimension_);
+        const Vec3 hi = (b.max - bound_.min) / (bound_.max - bound_.min) * Vec3(dimension_);
+        const Vec3i lo_i = glm::clamp(Vec3i(glm::floor(lo)), Vec3i(0), dimension_ - 1) / BrickSize;
+        const Vec3i hi_i = glm::clamp(Vec3i(glm::floor(hi)) + 1, Vec3i(0), dimension_ - 1) / BrickSize;
+        float m = 0.0f;
+        for (int z = lo_i.z; z <= hi_i.z; z++) {
+            for (int y = lo_i.y; y <= hi_i.y; y++) {
+                for (int x = lo_i.x; x <= hi_i.x; x++) {
+                    m = std::max(m, brick_max_[brick_index(x, y, z)]);
+                }
+            }
+        }
+        return scale_ * m;
+    }
+
     virtual bool has_scalar() const override {
         return true;
     }
 
     virtual Float eval_scalar(Vec3 p) const override {
-        // Compute uv in bound
-        Vec3 p_boundSpace = (p - bound_.min) / (bound_.max - bound_.min);
-        // scale to address in volume array
-        p_boundSpace *= dimension_;
-
-        // aligned cube around our position p
-        const Vec3i lowerLeft = { int(std::floor(p_boundSpace.x)), int(std::floor(p_boundSpace.y)), int(std::floor(p_boundSpace.z)) };
-        const Vec3i upperRight = lowerLeft + Vec3i(1);
-        // factor for trilinear interpolation
-        const Vec3 t = p_boundSpace - Vec3(lowerLeft);
-        
-        // first interpolate on x-axis, then y-axis, z-axis
-        const float x00 = lerp(lowerLeft.x, lowerLeft.y, lowerLeft.z, upperRight.x, lowerLeft.y, lowerLeft.z, float(t.x));
-        const float x01 = lerp(lowerLeft.x, lowerLeft.y, upperRight.z, upperRight.x, lowerLeft.y, upperRight.z, float(t.x));
-        const float x10 = lerp(lowerLeft.x, upperRight.y, lowerLeft.z, upperRight.x, upperRight.y, lowerLeft.z, float(t.x));
-        const float x11 = lerp(lowerLeft.x, upperRight.y, upperRight.z, upperRight.x, upperRight.y, upperRight.z, float(t.x));
-        // now y-axis
-        const float y0 = lerp(x00, x10, float(t.y));
-        const float y1 = lerp(x01, x11, float(t.y));
-        // final interpolation
-        float z = lerp(y0, y1, float(t.z));
+        return scale_ * eval_trilinear(p);
+    }
 
-        return scale_ * z;
+    virtual void eval_scalar_n(const Vec3* ps, int n, Float* out) const override {
+        for (int i = 0; i < n; i++) {
+            out[i] = scale_ * eval_trilinear(ps[i]);
+        }
     }
 
     virtual bool has_color() const override {
@@ -301,6 +571,30 @@ public:
     virtual void march(Ray, Float, Float, Float, const RaymarchFunc&) const override {
         LM_ERROR("Not impleneted!");
     }
+
+    virtual bool has_voxels() const override {
+        return true;
+    }
+
+    virtual void traverse_voxels(Ray ray, Float tmin, Float tmax, const VoxelFunc& func) const override {
+        if (!bound_.isect_range(ray, tmin, tmax)) {
+            return;
+        }
+
+        // Traverse the bricks first and then the voxels inside the non-empty bricks
+        const auto voxel_size = (bound_.max - bound_.min) / Vec3(dimension_);
+        const auto brick_size = voxel_size * Float(BrickSize);
+        const Bound brick_bound{ bound_.min, bound_.min + brick_size * Vec3(brick_dimension_) };
+        traverse_grid(ray, tmin, tmax, brick_bound, brick_dimension_, [&](Vec3i b, Float t0, Float t1) -> bool {
+            if (brick_region_empty(b)) {
+                return true;
+            }
+            const auto min = bound_.min + brick_size * Vec3(b);
+            return traverse_grid(ray, t0, t1, { min, min + brick_size }, Vec3i(BrickSize), [&](Vec3i, Float t0, Float t1) -> bool {
+                return func(t0, t1);
+            });
+        });
+    }
 };
 
 #undef META_ENDING
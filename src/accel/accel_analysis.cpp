@@ -0,0 +1,91 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/accel.h>
+#include <lm/scene.h>
+#include <lm/path.h>
+#include <lm/timer.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::accel)
+
+namespace {
+
+// Measure the time and the traversal counts of the closest intersection queries
+Json ray_stats(const Accel& accel, const std::vector<Ray>& rays) {
+    const auto tmin = [](const Ray& r) {
+        return math::robust_tmin(r.o, Eps);
+    };
+
+    // Time of the regular queries
+    long long hits = 0;
+    timer::ScopedTimer st;
+    for (const auto& r : rays) {
+        if (accel.intersect(r, tmin(r), Inf)) {
+            hits++;
+        }
+    }
+    const auto elapsed = st.now();
+
+    // Traversal counts
+    Accel::TraversalCounts counts;
+    bool supported = !rays.empty();
+    for (const auto& r : rays) {
+        if (!accel.count_traversal(r, tmin(r), Inf, counts)) {
+            supported = false;
+            break;
+        }
+    }
+
+    const auto n = double(std::max<size_t>(rays.size(), 1));
+    return {
+        {"rays", rays.size()},
+        {"hits", hits},
+        {"time_per_ray", elapsed / n},
+        {"nodes_per_ray", supported ? Json(double(counts.nodes) / n) : Json()},
+        {"triangles_per_ray", supported ? Json(double(counts.triangles) / n) : Json()}
+    };
+}
+
+}
+
+LM_PUBLIC_API Json analyze(const Scene& scene, const Json& prop) {
+    scene.require_camera();
+    scene.require_accel();
+    const auto* accel = scene.accel();
+    const int num_rays = json::value<int>(prop, "rays", 1 << 14);
+    Rng rng(json::value<int>(prop, "seed", 42));
+
+    // Primary rays at random raster positions
+    std::vector<Ray> primary(num_rays);
+    for (auto& r : primary) {
+        r = path::primary_ray(&scene, rng.next<Vec2>());
+    }
+
+    // Secondary rays from the hit points of the primary rays
+    std::vector<Ray> secondary;
+    for (const auto& r : primary) {
+        const auto sp = scene.intersect(r);
+        if (!sp || sp->geom.infinite) {
+            continue;
+        }
+        const auto n = glm::dot(sp->geom.gn, r.d) < 0_f ? sp->geom.gn : -sp->geom.gn;
+        const auto [u, v] = math::orthonormal_basis(n);
+        const auto d = math::sample_cosine_weighted(rng.next<Vec2>());
+        secondary.push_back({ sp->geom.p, u * d.x + v * d.y + n * d.z });
+    }
+
+    LM_INFO("Analyzing acceleration structure [name='{}', primary={}, secondary={}]",
+        accel->name(), primary.size(), secondary.size());
+    return {
+        {"accel", accel->key()},
+        {"structure", accel->underlying_value("structure")},
+        {"primary", ray_stats(*accel, primary)},
+        {"secondary", ray_stats(*accel, secondary)}
+    };
+}
+
+LM_NAMESPACE_END(LM_NAMESPACE::accel)
@@ -8,15 +8,52 @@
 #include <lm/accel.h>
 #include <lm/scene.h>
 #include <lm/mesh.h>
+#include <lm/timer.h>
+#include <lm/parallel.h>
+#include "mappedfile.h"
+#include "arrayview.h"
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LM_SAHBVH_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LM_SAHBVH_NEON 1
+#endif
+#if LM_PLATFORM_LINUX
+#include <sys/mman.h>
+#endif
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
 namespace {
 
+// Primitive node referred from the structure
+struct PrimitiveRef {
+    int node_index;         // Primitive node index
+    Mat4 global_transform;  // Global transform of the primitive
+};
+
+// Collect primitive nodes with meshes in the scene
+std::vector<PrimitiveRef> collect_primitives(const Scene& scene) {
+    std::vector<PrimitiveRef> prims;
+    scene.traverse_primitive_nodes([&](const SceneNode& node, Mat4 global_transform) {
+        if (node.type != SceneNodeType::Primitive) {
+            return;
+        }
+        if (!node.primitive.mesh) {
+            return;
+        }
+        prims.push_back({ node.index, global_transform });
+    });
+    return prims;
+}
+
 struct FlattenedPrimitiveNode {
     Transform global_transform;	// Global transform of the primitive
     int primitive;              // Primitive node index
 
+    using BlobSerializable = void;
+
     template <typename Archive>
     void serialize(Archive& ar) {
         ar(global_transform, primitive);
@@ -31,6 +68,8 @@ struct Tri {
     int flattened_node; // Index of flattened primitive associated to the triangle
     int face;           // Face index of the mesh associated to the triangle
 
+    using BlobSerializable = void;
+
     template <typename Archive>
     void serialize(Archive& ar) {
         ar(p1, e1, e2, b, c, flattened_node, face);
@@ -75,19 +114,451 @@ struct Tri {
     }
 };
 
-// BVH node
+// BVH node used in the construction
 struct Node {
     Bound b;        // Bound of the node
     bool leaf = 0;  // True if the node is leaf
     int s, e;       // Range of triangle indices (valid only in leaf nodes)
     int c1, c2;     // Index to the child nodes
+    int axis = 0;   // Split axis
+    int ps, pc;     // Range of triangle packs (valid only in leaf nodes)
+};
+
+// Triangle reference used in the construction with spatial splits.
+// A triangle straddling a spatial split is referenced from both sides
+// with the bounds clipped by the split plane.
+struct Ref {
+    Bound b;    // Bound of the referenced part of the triangle
+    int tri;    // Triangle index
+};
+
+// SoA batch of triangles stored in leaves.
+// Triangles in a batch are tested at once by the lane-parallel kernels below.
+// Unused lanes contain degenerate triangles which never intersect.
+constexpr int TriPackSize = 4;
+struct TriPack {
+    Float p1[3][TriPackSize];   // First vertices
+    Float p2[3][TriPackSize];   // Second vertices
+    Float p3[3][TriPackSize];   // Third vertices
+    int index[TriPackSize];     // Index to indices_. -1 for unused lanes.
+
+    using BlobSerializable = void;
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(p1, p2, p3, index);
+    }
+};
+
+// SoA batch of triangles in the compressed layout.
+// The vertices are stored in single precision and the triangles refer to
+// the faces of the meshes instead of the copied triangles.
+struct CompressedTriPack {
+    float p1[3][TriPackSize];           // First vertices
+    float p2[3][TriPackSize];           // Second vertices
+    float p3[3][TriPackSize];           // Third vertices
+    int flattened_node[TriPackSize];    // Index of flattened primitive. -1 for unused lanes.
+    int face[TriPackSize];              // Face index of the mesh
+
+    using BlobSerializable = void;
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(p1, p2, p3, flattened_node, face);
+    }
+};
+
+// True if the lane of the pack contains a triangle
+inline bool lane_used(const TriPack& p, int j) {
+    return p.index[j] >= 0;
+}
+inline bool lane_used(const CompressedTriPack& p, int j) {
+    return p.flattened_node[j] >= 0;
+}
+
+// Ray with precomputed data for the triangle kernels
+struct PackRay {
+    Ray r;
+    int kx, ky, kz;     // Axis permutation for watertight test
+    Float sx, sy, sz;   // Shear constants for watertight test
+
+    PackRay(Ray r) : r(r) {
+        // Largest component of the direction is mapped to z axis
+        const auto ad = glm::abs(r.d);
+        kz = ad.x > ad.y ? (ad.x > ad.z ? 0 : 2) : (ad.y > ad.z ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        if (r.d[kz] < 0_f) {
+            // Preserve winding direction
+            std::swap(kx, ky);
+        }
+        sx = r.d[kx] / r.d[kz];
+        sy = r.d[ky] / r.d[kz];
+        sz = 1_f / r.d[kz];
+    }
+};
+
+// Checks intersection between a ray and the triangles in a pack.
+// Uses Möller-Trumbore test [Möller & Trumbore 1997] or
+// watertight test [Woop et al. 2013] according to Watertight.
+// Returns the lane of the closest hit accepted by accept(lane, u, v) or -1 if no hit is found.
+template <bool Watertight, typename Pack, typename Accept>
+int intersect_pack(const Pack& p, const PackRay& pr, Float tl, Float th, Tri::Hit& hit, Accept&& accept) {
+    const auto& r = pr.r;
+    Float ts[TriPackSize], us[TriPackSize], vs[TriPackSize];
+    bool valid[TriPackSize];
+    for (int j = 0; j < TriPackSize; j++) {
+        if constexpr (Watertight) {
+            // Vertices relative to the ray origin
+            const Float ax = p.p1[pr.kx][j] - r.o[pr.kx], ay = p.p1[pr.ky][j] - r.o[pr.ky], az = p.p1[pr.kz][j] - r.o[pr.kz];
+            const Float bx = p.p2[pr.kx][j] - r.o[pr.kx], by = p.p2[pr.ky][j] - r.o[pr.ky], bz = p.p2[pr.kz][j] - r.o[pr.kz];
+            const Float cx = p.p3[pr.kx][j] - r.o[pr.kx], cy = p.p3[pr.ky][j] - r.o[pr.ky], cz = p.p3[pr.kz][j] - r.o[pr.kz];
+            // Shear and scale the vertices
+            const Float Ax = ax - pr.sx * az, Ay = ay - pr.sy * az;
+            const Float Bx = bx - pr.sx * bz, By = by - pr.sy * bz;
+            const Float Cx = cx - pr.sx * cz, Cy = cy - pr.sy * cz;
+            // Scaled barycentric coordinates
+            const Float U = Cx * By - Cy * Bx;
+            const Float V = Ax * Cy - Ay * Cx;
+            const Float W = Bx * Ay - By * Ax;
+            const Float det = U + V + W;
+            const Float T = U * (pr.sz * az) + V * (pr.sz * bz) + W * (pr.sz * cz);
+            const Float t = T / det;
+            valid[j] = !((U < 0_f || V < 0_f || W < 0_f) && (U > 0_f || V > 0_f || W > 0_f))
+                && det != 0_f && tl <= t && t <= th;
+            ts[j] = t;
+            us[j] = V / det;
+            vs[j] = W / det;
+        }
+        else {
+            const Float e1[3] = { p.p2[0][j] - p.p1[0][j], p.p2[1][j] - p.p1[1][j], p.p2[2][j] - p.p1[2][j] };
+            const Float e2[3] = { p.p3[0][j] - p.p1[0][j], p.p3[1][j] - p.p1[1][j], p.p3[2][j] - p.p1[2][j] };
+            const Float tv[3] = { r.o.x - p.p1[0][j], r.o.y - p.p1[1][j], r.o.z - p.p1[2][j] };
+            const Float pv[3] = { r.d.y * e2[2] - r.d.z * e2[1], r.d.z * e2[0] - r.d.x * e2[2], r.d.x * e2[1] - r.d.y * e2[0] };
+            const Float qv[3] = { tv[1] * e1[2] - tv[2] * e1[1], tv[2] * e1[0] - tv[0] * e1[2], tv[0] * e1[1] - tv[1] * e1[0] };
+            const Float d = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+            const Float ad = std::abs(d);
+            const Float sgn = d < 0_f ? -1_f : 1_f;
+            const Float u = (tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2]) * sgn;
+            const Float v = (r.d.x * qv[0] + r.d.y * qv[1] + r.d.z * qv[2]) * sgn;
+            const Float t = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) / d;
+            valid[j] = ad >= 1e-8_f && u >= 0_f && v >= 0_f && u + v <= ad && tl <= t && t <= th;
+            ts[j] = t;
+            us[j] = u / ad;
+            vs[j] = v / ad;
+        }
+    }
+
+    // Select the closest hit
+    int lane = -1;
+    for (int j = 0; j < TriPackSize; j++) {
+        if (valid[j] && lane_used(p, j) && ts[j] <= th && accept(j, us[j], vs[j])) {
+            th = ts[j];
+            lane = j;
+        }
+    }
+    if (lane >= 0) {
+        hit = { ts[lane], us[lane], vs[lane] };
+    }
+    return lane;
+}
+
+// Counters of the traversal steps.
+// NoCounter is optimized out in the regular queries.
+struct NoCounter {
+    void node() {}
+    template <typename Pack>
+    void pack(const Pack&) {}
+};
+struct StepCounter {
+    Accel::TraversalCounts& counts;
+    void node() {
+        counts.nodes++;
+    }
+    template <typename Pack>
+    void pack(const Pack& p) {
+        for (int j = 0; j < TriPackSize; j++) {
+            counts.triangles += lane_used(p, j) ? 1 : 0;
+        }
+    }
+};
+
+// Request the transparent huge pages for the memory region if supported,
+// which reduces the TLB misses of the traversal on the large arrays.
+// Only the 2MB pages fully inside of the region are advised.
+void advise_huge_pages(void* p, size_t size) {
+    #if LM_PLATFORM_LINUX && defined(MADV_HUGEPAGE)
+    constexpr uintptr_t HugePageSize = 2 << 20;
+    const auto b = ((uintptr_t)(p) + HugePageSize - 1) & ~(HugePageSize - 1);
+    const auto e = ((uintptr_t)(p) + size) & ~(HugePageSize - 1);
+    if (b < e) {
+        madvise((void*)(b), e - b, MADV_HUGEPAGE);
+    }
+    #else
+    LM_UNUSED(p, size);
+    #endif
+}
+
+// Flattened BVH node.
+// Nodes are stored in depth-first order so that the first child
+// of an interior node is always placed next to the node.
+struct FlatNode {
+    float min[3];           // Minimum coordinates of the bound
+    float max[3];           // Maximum coordinates of the bound
+    int offset;             // Leaf: start index of the triangle packs, Interior: index of the second child
+    std::uint32_t count:30; // Number of triangle packs (0 for interior nodes)
+    std::uint32_t axis:2;   // Split axis
+
+    using BlobSerializable = void;
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        std::uint32_t count_ = count;
+        std::uint32_t axis_ = axis;
+        ar(min, max, offset, count_, axis_);
+        count = count_;
+        axis = axis_;
+    }
+
+    // Checks intersection with a ray using precomputed inverse of the direction
+    bool isect(const Ray& r, const Vec3& inv_d, Float tmin, Float tmax) const {
+        for (int i = 0; i < 3; i++) {
+            auto t1 = (Float(min[i]) - r.o[i]) * inv_d[i];
+            auto t2 = (Float(max[i]) - r.o[i]) * inv_d[i];
+            if (inv_d[i] < 0) {
+                std::swap(t1, t2);
+            }
+            tmin = glm::max(t1, tmin);
+            tmax = glm::min(t2, tmax);
+            if (tmax < tmin) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+static_assert(sizeof(FlatNode) == 32, "Invalid size of FlatNode");
+
+// Wide BVH node with W children.
+// Child bounds are stored in SoA layout so that the slab tests for
+// all children can be performed at once with SIMD instructions.
+template <int W>
+struct WideNode {
+    static_assert(W % 4 == 0, "Width of WideNode must be multiple of 4");
+    alignas(16) float min[3][W];    // Minimum coordinates of the child bounds
+    alignas(16) float max[3][W];    // Maximum coordinates of the child bounds
+    int child[W];                   // Leaf: start index of the triangle packs, Interior: index of the child node, Empty: -1
+    int count[W];                   // Number of triangle packs (0 for interior nodes)
+
+    static constexpr int Width = W;
+
+    using BlobSerializable = void;
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(min, max, child, count);
+    }
+};
+
+// Wide BVH node with the child bounds quantized to 8 bits relative to the bound of the node.
+// The quantized bounds are conservative, that is, they always contain the original bounds.
+template <int W>
+struct QuantizedWideNode {
+    static_assert(W % 4 == 0, "Width of QuantizedWideNode must be multiple of 4");
+    float origin[3];                // Minimum coordinates of the bound of the node
+    float scale[3];                 // Size of a quantization step
+    std::uint8_t qmin[3][W];        // Quantized minimum coordinates of the child bounds
+    std::uint8_t qmax[3][W];        // Quantized maximum coordinates of the child bounds
+    int child[W];                   // Leaf: start index of the triangle packs, Interior: index of the child node, Empty: -1
+    int count[W];                   // Number of triangle packs (0 for interior nodes)
+
+    static constexpr int Width = W;
+
+    using BlobSerializable = void;
 
     template <typename Archive>
     void serialize(Archive& ar) {
-        ar(b, leaf, s, e, c1, c2);
+        ar(origin, scale, qmin, qmax, child, count);
+    }
+
+    // Coordinate of the quantized value along the axis
+    float dequantize(int i, int q) const {
+        return origin[i] + float(q) * scale[i];
+    }
+
+    // Quantize the child bounds of a wide node
+    static QuantizedWideNode quantize(const WideNode<W>& n) {
+        QuantizedWideNode qn{};
+        for (int i = 0; i < 3; i++) {
+            float mi = std::numeric_limits<float>::infinity();
+            float ma = -std::numeric_limits<float>::infinity();
+            for (int j = 0; j < W; j++) {
+                if (n.child[j] >= 0) {
+                    mi = std::min(mi, n.min[i][j]);
+                    ma = std::max(ma, n.max[i][j]);
+                }
+            }
+            qn.origin[i] = mi;
+            qn.scale[i] = (ma - mi) / 255.f;
+            // Enlarge the step until the quantized range covers the bound.
+            // The step grows geometrically since the origin can be much larger than the step.
+            while (qn.dequantize(i, 255) < ma) {
+                qn.scale[i] = std::max(std::nextafter(qn.scale[i], std::numeric_limits<float>::infinity()), qn.scale[i] * (1.f + 1.f / 128.f));
+            }
+            for (int j = 0; j < W; j++) {
+                if (n.child[j] < 0) {
+                    continue;
+                }
+                const auto q = [&](float v) {
+                    return qn.scale[i] > 0.f ? glm::clamp(int((v - mi) / qn.scale[i]), 0, 255) : 0;
+                };
+                int q0 = q(n.min[i][j]);
+                while (q0 > 0 && qn.dequantize(i, q0) > n.min[i][j]) {
+                    q0--;
+                }
+                int q1 = q(n.max[i][j]);
+                while (q1 < 255 && qn.dequantize(i, q1) < n.max[i][j]) {
+                    q1++;
+                }
+                qn.qmin[i][j] = std::uint8_t(q0);
+                qn.qmax[i][j] = std::uint8_t(q1);
+            }
+        }
+        for (int j = 0; j < W; j++) {
+            qn.child[j] = n.child[j];
+            qn.count[j] = n.count[j];
+        }
+        return qn;
+    }
+};
+
+// Bound of a child of a wide node
+template <int W>
+Bound child_bound(const WideNode<W>& n, int j) {
+    Bound b;
+    b.min = Vec3(n.min[0][j], n.min[1][j], n.min[2][j]);
+    b.max = Vec3(n.max[0][j], n.max[1][j], n.max[2][j]);
+    return b;
+}
+template <int W>
+Bound child_bound(const QuantizedWideNode<W>& n, int j) {
+    Bound b;
+    for (int i = 0; i < 3; i++) {
+        b.min[i] = n.dequantize(i, n.qmin[i][j]);
+        b.max[i] = n.dequantize(i, n.qmax[i][j]);
+    }
+    return b;
+}
+
+// Ray in single precision used for the slab tests of wide nodes
+struct WideRay {
+    alignas(16) float o[3];
+    alignas(16) float inv_d[3];
+};
+
+// Checks intersection between a ray and the child bounds of a wide node.
+// Returns a bit mask of the intersected children and writes entry distances to ts.
+// tmax is slightly enlarged to compensate the rounding error of the slab test in single precision.
+template <int W>
+int isect_children(const float (&mn)[3][W], const float (&mx)[3][W], const WideRay& r, float tmin, float tmax, float* ts) {
+    constexpr float Robust = 1.0000004f;
+    int mask = 0;
+    for (int k = 0; k < W; k += 4) {
+        #if LM_SAHBVH_SSE
+        __m128 t0 = _mm_set1_ps(tmin);
+        __m128 t1 = _mm_set1_ps(tmax);
+        for (int i = 0; i < 3; i++) {
+            const __m128 o = _mm_set1_ps(r.o[i]);
+            const __m128 id = _mm_set1_ps(r.inv_d[i]);
+            const __m128 ta = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&mn[i][k]), o), id);
+            const __m128 tb = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&mx[i][k]), o), id);
+            t0 = _mm_max_ps(t0, _mm_min_ps(ta, tb));
+            t1 = _mm_min_ps(t1, _mm_max_ps(ta, tb));
+        }
+        _mm_storeu_ps(&ts[k], t0);
+        mask |= _mm_movemask_ps(_mm_cmple_ps(t0, _mm_mul_ps(t1, _mm_set1_ps(Robust)))) << k;
+        #elif LM_SAHBVH_NEON
+        float32x4_t t0 = vdupq_n_f32(tmin);
+        float32x4_t t1 = vdupq_n_f32(tmax);
+        for (int i = 0; i < 3; i++) {
+            const float32x4_t o = vdupq_n_f32(r.o[i]);
+            const float32x4_t id = vdupq_n_f32(r.inv_d[i]);
+            const float32x4_t ta = vmulq_f32(vsubq_f32(vld1q_f32(&mn[i][k]), o), id);
+            const float32x4_t tb = vmulq_f32(vsubq_f32(vld1q_f32(&mx[i][k]), o), id);
+            t0 = vmaxq_f32(t0, vminq_f32(ta, tb));
+            t1 = vminq_f32(t1, vmaxq_f32(ta, tb));
+        }
+        vst1q_f32(&ts[k], t0);
+        std::uint32_t m[4];
+        vst1q_u32(m, vcleq_f32(t0, vmulq_f32(t1, vdupq_n_f32(Robust))));
+        for (int j = 0; j < 4; j++) {
+            mask |= (m[j] ? 1 : 0) << (k + j);
+        }
+        #else
+        for (int j = k; j < k + 4; j++) {
+            float t0 = tmin;
+            float t1 = tmax;
+            for (int i = 0; i < 3; i++) {
+                const float ta = (mn[i][j] - r.o[i]) * r.inv_d[i];
+                const float tb = (mx[i][j] - r.o[i]) * r.inv_d[i];
+                t0 = std::max(t0, std::min(ta, tb));
+                t1 = std::min(t1, std::max(ta, tb));
+            }
+            ts[j] = t0;
+            mask |= (t0 <= t1 * Robust ? 1 : 0) << j;
+        }
+        #endif
+    }
+    return mask;
+}
+
+// Checks intersection between a ray and the child bounds of a wide node
+template <int W>
+int isect_node(const WideNode<W>& n, const WideRay& r, float tmin, float tmax, float* ts) {
+    return isect_children<W>(n.min, n.max, r, tmin, tmax, ts);
+}
+template <int W>
+int isect_node(const QuantizedWideNode<W>& n, const WideRay& r, float tmin, float tmax, float* ts) {
+    alignas(16) float mn[3][W];
+    alignas(16) float mx[3][W];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < W; j++) {
+            mn[i][j] = n.dequantize(i, n.qmin[i][j]);
+            mx[i][j] = n.dequantize(i, n.qmax[i][j]);
+        }
     }
+    return isect_children<W>(mn, mx, r, tmin, tmax, ts);
+}
+
+// Header of the cache file.
+// Arrays are stored after the header with the offsets aligned to CacheAlignment
+// so that they can be directly referred from the memory-mapped file.
+constexpr char CacheMagic[8] = { 'L', 'M', 'S', 'A', 'H', 'B', 'V', 'H' };
+constexpr std::uint32_t CacheVersion = 2;
+constexpr std::uint64_t CacheAlignment = 64;
+constexpr int CacheNumArrays = 10;
+struct CacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t float_size;           // sizeof(Float)
+    std::int32_t width;
+    std::int32_t watertight;
+    std::int32_t compressed;
+    std::uint64_t offsets[CacheNumArrays];
+    std::uint64_t counts[CacheNumArrays];
+    std::uint64_t element_sizes[CacheNumArrays];
 };
 
+// Round a value to float toward negative or positive infinity
+float round_down(Float v) {
+    auto f = float(v);
+    return Float(f) > v ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+float round_up(Float v) {
+    auto f = float(v);
+    return Float(f) < v ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -98,207 +569,2837 @@ struct Node {
 
    Bounding volume hierarchy with surface area heuristics.
    
+   :param str builder: Builder type (``sweep``, ``binned``, ``sbvh``, ``lbvh``, or ``auto``).
+                        Default is ``sweep``.
+   :param int bins: Number of centroid bins per axis used by ``binned`` and ``sbvh`` builders. Default is 32.
+   :param float alpha: Overlap threshold of ``sbvh`` builder.
+                       Spatial splits are tried when the surface area of the overlap of the children
+                       of the object split relative to the root exceeds this value. Default is 1e-5.
+   :param float max_duplicates: Maximum number of triangle references duplicated by ``sbvh`` builder
+                                relative to the number of triangles. Default is 0.5.
+   :param float ray_budget: Expected number of traced rays, e.g., spp x pixels x path length.
+                            Used by ``auto`` builder. Default is 1e8.
+   :param float memory_limit: Memory limit of the structure in MB used by ``auto`` builder.
+                              0 for no limit. Default is 0.
+   :param bool watertight: Uses watertight ray-triangle intersection [Woop2013]_. Default is ``false``.
+   :param int width: Branching factor of the BVH used for traversal (``2``, ``4``, or ``8``). Default is 2.
+   :param bool report_traversal: Measures traversal performance of the flattened layout
+                                 against the binary layout after the build. Default is ``false``.
+   :param bool compressed: Uses the compressed layout for huge scenes. Default is ``false``.
+   :param str layout: Order of the wide nodes (``depth_first`` or ``treelet``). Default is ``depth_first``.
+   :param bool huge_pages: Requests transparent huge pages for the node and triangle arrays. Default is ``false``.
+
    Features
 
-   - Parallel construction.
-   - Split axis is determined by longest axis.
+   - Parallel construction with work-stealing task parallelism.
    - Split position is determined by minimum SAH cost.
-   - Uses full-sort of underlying geometries.
-   - Uses triangle intersection by Möller and Trumbore [Möller1997]_.
+   - ``sweep`` builder uses full-sort of underlying geometries along each axis.
+   - ``binned`` builder evaluates SAH over fixed-count centroid bins [Wald2007]_.
+   - ``sbvh`` builder additionally considers spatial splits [Stich2009]_,
+     which clip the triangles at the split plane and reference the straddling triangles from both children.
+     This reduces the overlap of the nodes for long, thin triangles at the cost of duplicated references.
+     Refitting a structure built with ``sbvh`` uses the unclipped bounds of the triangles.
+   - ``lbvh`` builder sorts the triangles along the Morton curve of the centroids
+     with a parallel radix sort and splits the nodes at the highest differing bit of the codes [Lauterbach2009]_.
+     The build is several times faster than the SAH builders, at the cost of the traversal performance.
+   - ``auto`` chooses the builder, the number of bins, and the width (unless specified)
+     from the number of triangles, the expected ray budget, and the memory limit,
+     minimizing the estimated sum of the build and trace time.
+     The choice and the estimates are logged.
+   - The depth of the binary tree is limited to 64. A node whose subtree could exceed the limit
+     is split at the median of the centroids instead of by SAH,
+     which bounds the recursion of the build and the stacks of the traversal for degenerate inputs.
+   - Nodes are flattened into 32-byte nodes in depth-first order after the build.
+   - Traversal visits nearer child first according to the split axis.
+   - Occlusion query terminates the traversal on the first hit.
+   - Supports refitting of the bounds when only the transformations are updated.
+   - Built structure can be cached in a file (see ``accel_cache_dir`` of ``scene::default``).
+     The cache is memory-mapped on load without deserialization.
+   - With ``width`` of 4 or 8, the binary tree is collapsed into a wide BVH
+     and all child bounds are tested at once with SSE or NEON instructions.
+   - Triangles in leaves are stored as SoA batches of 4 triangles and tested at once.
+   - Uses triangle intersection by Möller and Trumbore [Möller1997]_
+     or watertight intersection by Woop et al. [Woop2013]_.
+   - With ``compressed`` enabled, the structure is converted to the compressed layout after the build.
+     The child bounds of the wide nodes are quantized to 8 bits relative to the bound of the node,
+     and the triangle packs store the vertices in single precision and refer to the faces of the meshes.
+     The copied triangles with their bounds and centroids are released after the build.
+     The quantized bounds are conservative, so the traversal visits a few more nodes in exchange for
+     the smaller nodes. In double precision builds the vertices lose precision.
+     The compressed layout requires a wide BVH, so ``width`` of 2 is promoted to 4.
+     Refitting is not supported and the structure is rebuilt on update.
+   - With ``layout`` of ``treelet``, the wide nodes are reordered after the build into page-sized treelets.
+     A treelet is grown from its root by repeatedly adding the interior child with the largest surface area,
+     that is, the child most likely visited according to the SAH probability,
+     and the nodes of a treelet are stored contiguously in the order of the addition.
+     The remaining children become the roots of the next treelets.
+     Thus the traversal of a ray touches fewer pages, which reduces the TLB and cache misses
+     when the nodes exceed the last-level cache.
+     The binary layout (``width`` of 2) already places the first child next to the parent
+     and keeps the depth-first order.
+   - With ``huge_pages`` enabled, the arrays used by the traversal are advised to use
+     the transparent huge pages on Linux after the build.
+   - Supports the alpha test (:cpp:func:`lm::Accel::set_alpha_test`).
+     The triangles of the masked primitives rejected by the test are skipped in the leaves,
+     so that the traversal continues without restarting the query.
 
    .. [Möller1997] T. Möller & B. Trumbore.
                    Fast, Minimum Storage Ray-Triangle Intersection.
                    Journal of Graphics Tools. 2(1):21--28. 1997.
+   .. [Woop2013] S. Woop, C. Benthin, & I. Wald.
+                 Watertight Ray/Triangle Intersection.
+                 Journal of Computer Graphics Techniques. 2(1):65--82. 2013.
+   .. [Wald2007] I. Wald.
+                 On fast Construction of SAH-based Bounding Volume Hierarchies.
+                 IEEE Symposium on Interactive Ray Tracing. 2007.
+   .. [Stich2009] M. Stich, H. Friedrich, & A. Dietrich.
+                  Spatial Splits in Bounding Volume Hierarchies.
+                  High-Performance Graphics. 2009.
+   .. [Lauterbach2009] C. Lauterbach, M. Garland, S. Sengupta, D. Luebke, & D. Manocha.
+                       Fast BVH Construction on GPUs.
+                       Computer Graphics Forum. 28(2):375--384. 2009.
+
+.. function:: accel::sahbvhinstanced
+
+   Multi-level bounding volume hierarchy supporting instancing.
+
+   Each instance group, including the instance groups nested in other instance groups,
+   is mapped to a level of the hierarchy shared among the instances of the group.
+   A level consists of a bottom-level structure ``accel::sahbvh`` for the primitives in the group
+   and the instances of the nested instance groups.
+   Primitives not in instance groups are stored in the root level.
+   The structure of each level is built over the bounds of the instances in the level.
+   Thus the memory cost is proportional to the number of unique geometries and instances
+   regardless of the depth of the nesting.
+   The parameters are the same as ``accel::sahbvh`` and used for the bottom-level structures.
+
+.. function:: accel::sahbvhprogressive
+
+   Bounding volume hierarchy built progressively from a fast structure to a high-quality structure.
+
+   The build first constructs ``accel::sahbvh`` with ``lbvh`` builder and returns immediately,
+   so that the rendering can start with the fast structure.
+   The structure with the specified builder is built in a background thread afterwards
+   and swapped in atomically when it is ready.
+   The queries running at the time of the swap finish with the previous structure,
+   so the swap can happen at any point, e.g., between the passes of the scheduler.
+   The fast structure is released at the next build or update.
+   The parameters are the same as ``accel::sahbvh``, where ``builder`` is the builder of the
+   background build. Default is ``binned``. ``compressed`` is not supported.
+   Updates, caches, and serialization wait for the background build to finish.
 \endrst
 */
 class Accel_SAHBVH final : public Accel {
 private:
-    std::vector<Node> nodes_;                             // Nodes
+    friend class Accel_SAHBVH_Progressive;
+
+private:
+    enum class Builder {
+        Sweep,
+        Binned,
+        Spatial,
+        Linear,
+    };
+
+private:
+    Builder builder_ = Builder::Sweep;                    // Builder type
+    int num_bins_ = 32;                                   // Number of bins for binned builder
+    Float alpha_ = 1e-5_f;                                // Overlap threshold to try spatial splits
+    double max_duplicates_ = .5;                          // Maximum duplicated references relative to the triangles
+    bool report_traversal_ = false;                       // Report traversal performance after build
+    int width_ = 2;                                       // Branching factor of the BVH
+    bool auto_ = false;                                   // Choose the configuration before the build
+    bool auto_width_ = false;                             // Choose the width in the auto configuration
+    double ray_budget_ = 1e8;                             // Expected number of rays for auto configuration
+    double memory_limit_ = 0;                             // Memory limit in bytes for auto configuration
+    bool watertight_ = false;                             // Use watertight triangle intersection
+    bool compressed_ = false;                             // Use the compressed layout
+    bool treelet_ = false;                                // Reorder the wide nodes into treelets
+    bool huge_pages_ = false;                             // Use huge pages for the traversal arrays
+    std::vector<FlatNode> nodes_;                         // Flattened nodes (width=2)
+    std::vector<WideNode<4>> nodes4_;                     // Wide nodes (width=4)
+    std::vector<WideNode<8>> nodes8_;                     // Wide nodes (width=8)
     std::vector<Tri> trs_;                                // Triangles
+    std::vector<TriPack> packs_;                          // Triangle packs referenced from leaves
     std::vector<int> indices_;                            // Triangle indices
     std::vector<FlattenedPrimitiveNode> flattened_nodes_; // Flattened scene graph
+    std::vector<QuantizedWideNode<4>> qnodes4_;           // Quantized wide nodes (compressed, width=4)
+    std::vector<QuantizedWideNode<8>> qnodes8_;           // Quantized wide nodes (compressed, width=8)
+    std::vector<CompressedTriPack> cpacks_;               // Compressed triangle packs (compressed)
+
+    // Views of the arrays used for traversal.
+    // The views refer either to the arrays above or to the memory-mapped cache file or snapshot.
+    struct Views {
+        ArrayView<FlatNode> nodes;
+        ArrayView<WideNode<4>> nodes4;
+        ArrayView<WideNode<8>> nodes8;
+        ArrayView<Tri> trs;
+        ArrayView<TriPack> packs;
+        ArrayView<int> indices;
+        ArrayView<FlattenedPrimitiveNode> flattened_nodes;
+        ArrayView<QuantizedWideNode<4>> qnodes4;
+        ArrayView<QuantizedWideNode<8>> qnodes8;
+        ArrayView<CompressedTriPack> cpacks;
+    } views_;
+    std::shared_ptr<const void> mapped_;                  // Memory-mapped cache file or snapshot
+    std::vector<char> alpha_masked_;                      // True if the flattened node has alpha mask. Empty if none.
+    AlphaTestFunc alpha_test_;                            // Alpha test function
     
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(nodes_, trs_, indices_, flattened_nodes_);
+        materialize();
+        ar(width_, watertight_, compressed_);
+        if constexpr (std::is_same_v<Archive, InputArchive>) {
+            if (ar.use_blobs()) {
+                load_views(ar);
+                return;
+            }
+        }
+        ar(nodes_, nodes4_, nodes8_, trs_, packs_, indices_, flattened_nodes_, qnodes4_, qnodes8_, cpacks_);
+        update_views();
     }
 
 public:
+    virtual void construct(const Json& prop) override {
+        const auto builder = json::value<std::string>(prop, "builder", "sweep");
+        if (builder == "sweep") {
+            builder_ = Builder::Sweep;
+        }
+        else if (builder == "binned") {
+            builder_ = Builder::Binned;
+        }
+        else if (builder == "sbvh") {
+            builder_ = Builder::Spatial;
+        }
+        else if (builder == "lbvh") {
+            builder_ = Builder::Linear;
+        }
+        else if (builder == "auto") {
+            builder_ = Builder::Binned;
+            auto_ = true;
+        }
+        else {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid builder [builder='{}']", builder);
+        }
+        num_bins_ = json::value<int>(prop, "bins", 32);
+        if (num_bins_ < 2) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Number of bins must be >= 2 [bins='{}']", num_bins_);
+        }
+        alpha_ = json::value<Float>(prop, "alpha", 1e-5_f);
+        max_duplicates_ = json::value<double>(prop, "max_duplicates", .5);
+        if (max_duplicates_ < 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Maximum duplicates must be >= 0 [max_duplicates='{}']", max_duplicates_);
+        }
+        report_traversal_ = json::value<bool>(prop, "report_traversal", false);
+        watertight_ = json::value<bool>(prop, "watertight", false);
+        width_ = json::value<int>(prop, "width", 2);
+        if (width_ != 2 && width_ != 4 && width_ != 8) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Width must be 2, 4, or 8 [width='{}']", width_);
+        }
+        auto_width_ = auto_ && prop.find("width") == prop.end();
+        compressed_ = json::value<bool>(prop, "compressed", false);
+        const auto layout = json::value<std::string>(prop, "layout", "depth_first");
+        if (layout != "depth_first" && layout != "treelet") {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid layout [layout='{}']", layout);
+        }
+        treelet_ = layout == "treelet";
+        huge_pages_ = json::value<bool>(prop, "huge_pages", false);
+        ray_budget_ = json::value<double>(prop, "ray_budget", 1e8);
+        memory_limit_ = json::value<double>(prop, "memory_limit", 0.0) * 1024.0 * 1024.0;
+    }
+
     virtual void build(const Scene& scene) override {
-        // Flatten the scene graph and setup triangle list
-        LM_INFO("Flattening scene");
-        trs_.clear();
-        flattened_nodes_.clear();
-        scene.traverse_primitive_nodes([&](const SceneNode& node, Mat4 global_transform) {
-            if (node.type != SceneNodeType::Primitive) {
-                return;
-            }
-            if (!node.primitive.mesh) {
-                return;
+        build_primitives(scene, collect_primitives(scene));
+    }
+
+    virtual void update(const Scene& scene) override {
+        update_primitives(scene, collect_primitives(scene));
+    }
+
+    // The builder and the width chosen by the auto configuration depend on the scene,
+    // so the settings before the configuration are used
+    virtual std::string cache_settings() const override {
+        return fmt::format("builder={},width={},bins={},alpha={},max_duplicates={},watertight={},compressed={},treelet={},ray_budget={},memory_limit={}",
+            auto_ ? "auto" : builder_name(),
+            auto_width_ ? 0 : width_,
+            num_bins_, alpha_, max_duplicates_, watertight_, compressed_, treelet_,
+            auto_ ? ray_budget_ : 0.0, auto_ ? memory_limit_ : 0.0);
+    }
+
+private:
+    const char* builder_name() const {
+        switch (builder_) {
+            case Builder::Sweep:  return "sweep";
+            case Builder::Binned: return "binned";
+            case Builder::Linear: return "lbvh";
+            default:              return "sbvh";
+        }
+    }
+
+    // Choose the builder and the width minimizing the estimated build and trace time
+    // within the memory limit. The costs are rough per-operation estimates
+    // only meant to compare the options relative to each other.
+    void configure_auto(int nt) {
+        struct Option {
+            Builder builder;
+            int bins;
+            int width;
+        };
+        const double n = nt;
+        const double depth = std::max(1.0, std::log2(n));
+        const double threads = parallel::num_threads();
+        const auto build_time = [&](const Option& o) {
+            // Sweep builder sorts the triangles along three axes in each level
+            return o.builder == Builder::Sweep
+                ? n * depth * depth * 3.0 * 2e-9 / threads
+                : n * depth * (4e-9 + o.bins * 0.1e-9) / threads;
+        };
+        const auto trace_time = [&](const Option& o) {
+            // SAH quality degrades with fewer candidate split positions.
+            // Wide nodes test the child bounds at once and reduce the number of visits.
+            const double quality = o.builder == Builder::Sweep ? 1.0 : 1.0 + 1.0 / o.bins;
+            const double wide = o.width == 8 ? 2.2 : o.width == 4 ? 1.8 : 1.0;
+            return ray_budget_ * depth * quality / wide * 4e-9 / threads;
+        };
+        const auto memory = [&](const Option& o) {
+            // Triangles, indices, packs, and binary nodes during the build
+            double m = n * (sizeof(Tri) + sizeof(int) + 2 * sizeof(Node)) + 2 * n / TriPackSize * sizeof(TriPack);
+            if (o.builder == Builder::Sweep) {
+                // Temporary arrays of the prefix costs at the root
+                m += 2 * n * sizeof(Float);
             }
+            m += o.width == 8 ? 2 * n / 7 * sizeof(WideNode<8>)
+               : o.width == 4 ? 2 * n / 3 * sizeof(WideNode<4>)
+               : 2 * n * sizeof(FlatNode);
+            return m;
+        };
 
-            // Record flattened primitive
-            const int flattened_node_index = int(flattened_nodes_.size());
-            flattened_nodes_.push_back({ Transform(global_transform), node.index });
+        // Candidates
+        std::vector<Option> options;
+        for (int width : auto_width_ ? std::vector<int>{ 2, 4, 8 } : std::vector<int>{ width_ }) {
+            options.push_back({ Builder::Sweep, 0, width });
+            options.push_back({ Builder::Binned, 32, width });
+            options.push_back({ Builder::Binned, 16, width });
+        }
 
-            // Record triangles
-            node.primitive.mesh->foreach_triangle([&](int face, const Mesh::Tri& tri) {
-                const auto p1 = global_transform * Vec4(tri.p1.p, 1_f);
-                const auto p2 = global_transform * Vec4(tri.p2.p, 1_f);
-                const auto p3 = global_transform * Vec4(tri.p3.p, 1_f);
-                trs_.emplace_back(p1, p2, p3, flattened_node_index, face);
-            });
-        });
+        // Select the fastest option within the memory limit,
+        // or the option with the least memory if none fits.
+        const Option* best = nullptr;
+        for (const auto& o : options) {
+            const bool fits = memory_limit_ <= 0 || memory(o) <= memory_limit_;
+            if (!best) {
+                best = &o;
+                continue;
+            }
+            const bool best_fits = memory_limit_ <= 0 || memory(*best) <= memory_limit_;
+            if (fits && (!best_fits || build_time(o) + trace_time(o) < build_time(*best) + trace_time(*best))) {
+                best = &o;
+            }
+            else if (!fits && !best_fits && memory(o) < memory(*best)) {
+                best = &o;
+            }
+        }
+        builder_ = best->builder;
+        if (best->builder == Builder::Binned) {
+            num_bins_ = best->bins;
+        }
+        width_ = best->width;
+        LM_INFO("Auto configuration [builder='{}', bins={}, width={}, triangles={}, ray_budget={:.3g}, "
+            "estimated_build='{:.3f}s', estimated_trace='{:.3f}s', estimated_memory='{:.2f}MB']",
+            builder_name(), num_bins_, width_, nt, ray_budget_,
+            build_time(*best), trace_time(*best), memory(*best) / 1024.0 / 1024.0);
+    }
 
-        // --------------------------------------------------------------------
+public:
+    // Build the structure for the given primitives
+    void build_primitives(const Scene& scene, const std::vector<PrimitiveRef>& prims) {
+        mapped_.reset();
+
+        // Flatten the scene graph and setup triangle list
+        LM_INFO("Flattening scene");
+        const auto vs = flatten_primitives(scene, prims);
+        build_triangles(vs);
+    }
 
+private:
+    // Build the structure for the flattened triangles.
+    // vs are the vertices of the triangles in the world coordinates.
+    void build_triangles(const std::vector<std::array<Vec3, 3>>& vs) {
         const int nt = int(trs_.size()); // Number of triangles
-        struct Entry {
-            int index;
-            int start;
-            int end;
-        };
-        std::queue<Entry> q;            // Queue for traversal (node index, start, end)
-        q.push({0, 0, nt});             // Initialize the queue with root node
-        nodes_.assign(2*nt-1, {});      // Maximum number of nodes: 2*nt-1
-        indices_.assign(nt, 0);
-        std::iota(indices_.begin(), indices_.end(), 0);
-        std::mutex mu;                  // For concurrent queue
-        std::condition_variable cv;     // For concurrent queue
-        std::atomic<int> pr = 0;        // Processed triangles
-        std::atomic<int> nn = 1;        // Number of current nodes
-        bool done = 0;                  // True if the build process is done
-
-        auto process = [&]() {
-            while (!done) {
-                // Each step construct a node for the triangles ranges in [s,e)
-                auto [ni, s, e] = [&]() -> Entry {
-                    std::unique_lock<std::mutex> lk(mu);
-                    if (!done && q.empty()) {
-                        cv.wait(lk, [&]() { return done || !q.empty(); });
+        if (nt == 0) {
+            LM_INFO("No triangles");
+            indices_.clear();
+            packs_.clear();
+            nodes_.clear();
+            nodes4_.clear();
+            nodes8_.clear();
+            qnodes4_.clear();
+            qnodes8_.clear();
+            cpacks_.clear();
+            update_views();
+            return;
+        }
+        if (auto_) {
+            configure_auto(nt);
+        }
+        if (compressed_ && width_ == 2) {
+            LM_INFO("Compressed layout requires wide nodes. Using width=4.");
+            width_ = 4;
+        }
+        LM_INFO("Building [builder='{}']", builder_name());
+        timer::ScopedTimer st;
+        std::vector<Node> nodes;
+        if (builder_ == Builder::Spatial) {
+            build_spatial(nodes, vs);
+        }
+        else if (builder_ == Builder::Linear) {
+            build_linear(nodes);
+        }
+        else {
+            build_object(nodes);
+        }
+        LM_INFO("Finished building [builder='{}', triangles={}, references={}, nodes={}, elapsed='{:.3f}s']",
+            builder_name(), nt, indices_.size(), nodes.size(), st.now());
+
+        const auto to_mb = [](size_t bytes) { return double(bytes) / 1024.0 / 1024.0; };
+
+        // Pack the triangles in the leaves
+        packs_.clear();
+        for (auto& n : nodes) {
+            if (!n.leaf) {
+                continue;
+            }
+            n.ps = int(packs_.size());
+            for (int i = n.s; i < n.e; i += TriPackSize) {
+                TriPack p{};
+                for (int j = 0; j < TriPackSize; j++) {
+                    p.index[j] = -1;
+                    if (i + j >= n.e) {
+                        continue;
                     }
-                    if (done) {
-                        return {};
+                    const auto& v = vs[indices_[i + j]];
+                    for (int k = 0; k < 3; k++) {
+                        p.p1[k][j] = v[0][k];
+                        p.p2[k][j] = v[1][k];
+                        p.p3[k][j] = v[2][k];
                     }
-                    auto v = q.front();
-                    q.pop();
-                    return v;
-                }();
-                if (done) {
-                    break;
+                    p.index[j] = i + j;
                 }
+                packs_.push_back(p);
+            }
+            n.pc = int(packs_.size()) - n.ps;
+        }
+        LM_INFO("Packed triangles [packs={}, size='{:.2f}MB']", packs_.size(), to_mb(packs_.size() * sizeof(TriPack)));
 
-                // Calculate the bound for the node
-                Node& n = nodes_[ni];
-                for (int i = s; i < e; i++) {
-                    n.b = merge(n.b, trs_[indices_[i]].b);
-                }
+        nodes_.clear();
+        nodes4_.clear();
+        nodes8_.clear();
+        if (width_ == 4) {
+            collapse(nodes, nodes4_);
+            LM_INFO("Collapsed nodes [width=4, binary='{:.2f}MB', wide='{:.2f}MB', wide_nodes={}]",
+                to_mb(nodes.size() * sizeof(Node)), to_mb(nodes4_.size() * sizeof(WideNode<4>)), nodes4_.size());
+        }
+        else if (width_ == 8) {
+            collapse(nodes, nodes8_);
+            LM_INFO("Collapsed nodes [width=8, binary='{:.2f}MB', wide='{:.2f}MB', wide_nodes={}]",
+                to_mb(nodes.size() * sizeof(Node)), to_mb(nodes8_.size() * sizeof(WideNode<8>)), nodes8_.size());
+        }
+        else {
+            flatten(nodes);
+            LM_INFO("Flattened nodes [binary='{:.2f}MB', flattened='{:.2f}MB']",
+                to_mb(nodes.size() * sizeof(Node)), to_mb(nodes_.size() * sizeof(FlatNode)));
+        }
 
-                // Function to sort the triangles according to the given axis
-                auto st = [&, s = s, e = e](int ax) {
-                    auto cmp = [&](int i1, int i2) {
-                        return trs_[i1].c[ax] < trs_[i2].c[ax];
-                    };
-                    std::sort(&indices_[s], &indices_[e-1]+1, cmp);
-                };
+        // Reorder the wide nodes into treelets
+        if (treelet_) {
+            if (width_ == 4) {
+                reorder_treelets(nodes4_);
+            }
+            else if (width_ == 8) {
+                reorder_treelets(nodes8_);
+            }
+        }
 
-                // Function to create a leaf node
-                auto make_leaf = [&, s = s, e = e]() {
-                    n.leaf = 1;
-                    n.s = s;
-                    n.e = e;
-                    pr += e - s;
-                    if (pr == int(trs_.size())) {
-                        std::unique_lock<std::mutex> lk(mu);
-                        done = 1;
-                        cv.notify_all();
-                    }
-                };
+        // Convert to the compressed layout
+        qnodes4_.clear();
+        qnodes8_.clear();
+        cpacks_.clear();
+        if (compressed_) {
+            compress();
+        }
 
-                // Create a leaf node if the number of triangle is 1
-                if (e - s < 2) {
-                    make_leaf();
-                    continue;
-                }
+        // Spread the arrays touched by the traversal across NUMA nodes
+        interleave_arrays();
+        update_views();
 
-                // Selects a split axis and position according to SAH
-                Float b = Inf;
-                int bi = -1, ba = -1;
-                for (int a = 0; a < 3; a++) {
-                    thread_local std::vector<Float> l(nt+1), r(nt+1);
-                    st(a);
-                    Bound bl, br;
-                    for (int i = 0; i <= e - s; i++) {
-                        int j = e - s - i;
-                        l[i] = bl.surface_area() * i;
-                        r[j] = br.surface_area() * i;
-                        bl = i < e - s ? merge(bl, trs_[indices_[s+i]].b) : bl;
-                        br = j > 0 ? merge(br, trs_[indices_[s+j-1]].b) : br;
-                    }
-                    for (int i = 1; i < e - s; i++) {
-                        const auto c = 1_f + (l[i]+r[i])/n.b.surface_area();
-                        if (c < b) {
-                            b = c;
-                            bi = i;
-                            ba = a;
-                        }
-                    }
-                }
-                if (b > e - s) {
-                    make_leaf();
+        // Measure traversal performance against the binary layout.
+        // The binary layout refers to the triangles released by the compression.
+        if (report_traversal_) {
+            if (compressed_) {
+                LM_WARN("Traversal report is not supported by the compressed layout");
+            }
+            else {
+                report_traversal(nodes);
+            }
+        }
+    };
+
+public:
+    // Update the structure for the given primitives by refitting
+    void update_primitives(const Scene& scene, const std::vector<PrimitiveRef>& prims) {
+        materialize();
+
+        // The compressed layout keeps no triangles to refit
+        if (compressed_) {
+            LM_INFO("Refitting is not supported by the compressed layout. Rebuilding.");
+            build_primitives(scene, prims);
+            return;
+        }
+
+        // Rebuild if the topology of the scene is changed
+        const auto num_triangles = trs_.size();
+        const auto num_flattened_nodes = flattened_nodes_.size();
+        const auto vs = flatten_primitives(scene, prims);
+        if (trs_.size() != num_triangles || flattened_nodes_.size() != num_flattened_nodes || indices_.size() < num_triangles) {
+            LM_INFO("Scene topology is changed. Rebuilding.");
+            build_primitives(scene, prims);
+            return;
+        }
+        if (num_triangles == 0) {
+            return;
+        }
+
+        // Update vertices of the triangle packs
+        timer::ScopedTimer st;
+        for (auto& p : packs_) {
+            for (int j = 0; j < TriPackSize; j++) {
+                if (p.index[j] < 0) {
                     continue;
                 }
-                st(ba);
-                int m = s + bi;
-                std::unique_lock<std::mutex> lk(mu);
-                q.push({n.c1 = nn++, s, m});
-                q.push({n.c2 = nn++, m, e});
-                cv.notify_one();
+                const auto& v = vs[indices_[p.index[j]]];
+                for (int k = 0; k < 3; k++) {
+                    p.p1[k][j] = v[0][k];
+                    p.p2[k][j] = v[1][k];
+                    p.p3[k][j] = v[2][k];
+                }
             }
-        };
-        LM_INFO("Building");
-        std::vector<std::thread> ths(std::thread::hardware_concurrency());
-        for (auto& th : ths) {
-            th = std::thread(process);
         }
-        for (auto& th : ths) {
-            th.join();
+
+        // Refit the bounds in bottom-up order.
+        // In both layouts the child nodes are always placed after their parents.
+        if (width_ == 4) {
+            refit_wide(nodes4_);
         }
-    };
+        else if (width_ == 8) {
+            refit_wide(nodes8_);
+        }
+        else {
+            refit_flat();
+        }
+        update_views();
+        LM_INFO("Refitted [triangles={}, elapsed='{:.3f}s']", trs_.size(), st.now());
+    }
 
-    virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
-        exception::ScopedDisableFPEx guard_;  // Disable floating point exceptions
-        std::optional<Tri::Hit> mh, h;
-        int mi = -1;
-        int s[99]{};
-        int si = 0;
-        while (si >= 0) {
-            auto& n = nodes_.at(s[si--]);
-            if (!n.b.isect(ray, tmin, tmax)) {
-                continue;
+    // Number of triangles in the structure
+    int num_triangles() const {
+        if (compressed_) {
+            return compressed_references();
+        }
+        return int(views_.trs.size());
+    }
+
+    // Bound of the structure
+    Bound bound() const {
+        Bound b;
+        if (empty()) {
+            return b;
+        }
+        const auto merge_root = [&](const auto& nodes) {
+            const auto& n = nodes[0];
+            for (int j = 0; j < std::decay_t<decltype(n)>::Width; j++) {
+                if (n.child[j] >= 0) {
+                    b = merge(b, child_bound(n, j));
+                }
             }
-            if (!n.leaf) {
-                s[++si] = n.c1;
-                s[++si] = n.c2;
-                continue;
+        };
+        if (compressed_) {
+            if (width_ == 4) {
+                merge_root(views_.qnodes4);
             }
-            for (int i = n.s; i < n.e; i++) {
-                if (h = trs_[indices_[i]].intersect(ray, tmin, tmax)) {
-                    mh = h;
-                    tmax = h->t;
-                    mi = i;
-                }
+            else {
+                merge_root(views_.qnodes8);
             }
         }
-        if (!mh) {
-            return {};
+        else if (width_ == 4) {
+            merge_root(views_.nodes4);
+        }
+        else if (width_ == 8) {
+            merge_root(views_.nodes8);
         }
-        const auto& tr = trs_.at(indices_.at(mi));
-        const auto& fn = flattened_nodes_.at(tr.flattened_node);
-        return Hit{ tmax, Vec2(mh->u, mh->v), fn.global_transform, fn.primitive, tr.face };
+        else {
+            const auto& n = views_.nodes[0];
+            b = merge(b, Vec3(n.min[0], n.min[1], n.min[2]));
+            b = merge(b, Vec3(n.max[0], n.max[1], n.max[2]));
+        }
+        return b;
     }
-};
+
+    virtual bool save_cache(const std::string& path) const override {
+        // Data of the arrays in the order of CacheHeader
+        const std::array<std::tuple<const void*, size_t, size_t>, CacheNumArrays> arrays = {{
+            { views_.nodes.p, views_.nodes.n, sizeof(FlatNode) },
+            { views_.nodes4.p, views_.nodes4.n, sizeof(WideNode<4>) },
+            { views_.nodes8.p, views_.nodes8.n, sizeof(WideNode<8>) },
+            { views_.trs.p, views_.trs.n, sizeof(Tri) },
+            { views_.packs.p, views_.packs.n, sizeof(TriPack) },
+            { views_.indices.p, views_.indices.n, sizeof(int) },
+            { views_.flattened_nodes.p, views_.flattened_nodes.n, sizeof(FlattenedPrimitiveNode) },
+            { views_.qnodes4.p, views_.qnodes4.n, sizeof(QuantizedWideNode<4>) },
+            { views_.qnodes8.p, views_.qnodes8.n, sizeof(QuantizedWideNode<8>) },
+            { views_.cpacks.p, views_.cpacks.n, sizeof(CompressedTriPack) },
+        }};
+        CacheHeader h{};
+        std::copy(std::begin(CacheMagic), std::end(CacheMagic), h.magic);
+        h.version = CacheVersion;
+        h.float_size = sizeof(Float);
+        h.width = width_;
+        h.watertight = watertight_;
+        h.compressed = compressed_;
+        const auto align = [](std::uint64_t v) { return (v + CacheAlignment - 1) / CacheAlignment * CacheAlignment; };
+        std::uint64_t offset = align(sizeof(CacheHeader));
+        for (int i = 0; i < CacheNumArrays; i++) {
+            const auto [p, n, size] = arrays[i];
+            h.offsets[i] = offset;
+            h.counts[i] = n;
+            h.element_sizes[i] = size;
+            offset = align(offset + n * size);
+        }
+
+        // Write to a temporary file and rename it
+        // so that concurrent jobs never see a partially written cache
+        const auto temp_path = path + fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        {
+            std::ofstream out(temp_path, std::ios::out | std::ios::binary);
+            if (!out) {
+                LM_WARN("Failed to open cache file [path='{}']", temp_path);
+                return false;
+            }
+            const auto pad = [&](std::uint64_t to) {
+                static const char zeros[CacheAlignment] = {};
+                const auto cur = std::uint64_t(out.tellp());
+                out.write(zeros, std::streamsize(to - cur));
+            };
+            out.write(reinterpret_cast<const char*>(&h), sizeof(CacheHeader));
+            for (int i = 0; i < CacheNumArrays; i++) {
+                const auto [p, n, size] = arrays[i];
+                pad(h.offsets[i]);
+                out.write(reinterpret_cast<const char*>(p), std::streamsize(n * size));
+            }
+            if (!out) {
+                LM_WARN("Failed to write cache file [path='{}']", temp_path);
+                return false;
+            }
+        }
+        std::error_code ec;
+        fs::rename(temp_path, path, ec);
+        if (ec) {
+            fs::remove(temp_path, ec);
+            return false;
+        }
+        return true;
+    }
+
+    virtual bool load_cache(const std::string& path) override {
+        auto mapped = std::make_unique<MappedFile>();
+        if (!mapped->open(path) || mapped->size() < sizeof(CacheHeader)) {
+            return false;
+        }
+        CacheHeader h;
+        std::memcpy(&h, mapped->data(), sizeof(CacheHeader));
+        if (!std::equal(std::begin(CacheMagic), std::end(CacheMagic), h.magic)
+            || h.version != CacheVersion
+            || h.float_size != sizeof(Float)
+            || h.width != width_
+            || h.watertight != int(watertight_)
+            || h.compressed != int(compressed_)) {
+            return false;
+        }
+        const std::array<size_t, CacheNumArrays> element_sizes = {
+            sizeof(FlatNode), sizeof(WideNode<4>), sizeof(WideNode<8>), sizeof(Tri),
+            sizeof(TriPack), sizeof(int), sizeof(FlattenedPrimitiveNode),
+            sizeof(QuantizedWideNode<4>), sizeof(QuantizedWideNode<8>), sizeof(CompressedTriPack)
+        };
+        for (int i = 0; i < CacheNumArrays; i++) {
+            if (h.element_sizes[i] != element_sizes[i]
+                || h.offsets[i] % CacheAlignment != 0
+                || h.offsets[i] + h.counts[i] * h.element_sizes[i] > mapped->size()) {
+                return false;
+            }
+        }
+
+        // Refer to the arrays in the mapped region
+        const auto view = [&](auto& v, int i) {
+            using T = std::remove_cv_t<std::remove_pointer_t<decltype(v.p)>>;
+            v = { reinterpret_cast<const T*>(mapped->data() + h.offsets[i]), size_t(h.counts[i]) };
+        };
+        nodes_.clear();
+        nodes4_.clear();
+        nodes8_.clear();
+        trs_.clear();
+        packs_.clear();
+        indices_.clear();
+        flattened_nodes_.clear();
+        qnodes4_.clear();
+        qnodes8_.clear();
+        cpacks_.clear();
+        view(views_.nodes, 0);
+        view(views_.nodes4, 1);
+        view(views_.nodes8, 2);
+        view(views_.trs, 3);
+        view(views_.packs, 4);
+        view(views_.indices, 5);
+        view(views_.flattened_nodes, 6);
+        view(views_.qnodes4, 7);
+        view(views_.qnodes8, 8);
+        view(views_.cpacks, 9);
+        LM_INFO("Mapped cache [size='{:.2f}MB']", double(mapped->size()) / 1024.0 / 1024.0);
+        mapped_ = std::move(mapped);
+        return true;
+    }
+
+private:
+    // Flatten the primitives and setup triangle list.
+    // Returns the vertices of the triangles.
+    // The triangles are written in parallel into the presized arrays
+    // using the offsets of the primitives computed by the prefix sum of the triangle counts.
+    std::vector<std::array<Vec3, 3>> flatten_primitives(const Scene& scene, const std::vector<PrimitiveRef>& prims) {
+        // Record flattened primitives and compute the offsets of the triangles
+        flattened_nodes_.clear();
+        std::vector<size_t> offsets(prims.size() + 1, 0);
+        for (size_t i = 0; i < prims.size(); i++) {
+            const auto& node = scene.node_at(prims[i].node_index);
+            flattened_nodes_.push_back({ Transform(prims[i].global_transform), node.index });
+            offsets[i + 1] = offsets[i] + size_t(node.primitive.mesh->num_triangles());
+        }
+
+        // Work items. A mesh with position buffer is split into chunks
+        // so that a large mesh is processed by multiple threads.
+        constexpr int FlattenChunkSize = 1 << 16;
+        struct WorkItem {
+            int prim;   // Index of the primitive
+            int s, e;   // Range of faces. e<0 to process all faces without position buffer.
+        };
+        std::vector<WorkItem> items;
+        for (int i = 0; i < int(prims.size()); i++) {
+            const auto* mesh = scene.node_at(prims[i].node_index).primitive.mesh;
+            const int n = mesh->num_triangles();
+            if (!mesh->buffer()) {
+                items.push_back({ i, 0, -1 });
+                continue;
+            }
+            for (int s = 0; s < n; s += FlattenChunkSize) {
+                items.push_back({ i, s, std::min(n, s + FlattenChunkSize) });
+            }
+        }
+
+        // Transform and write triangles
+        trs_.resize(offsets.back());
+        std::vector<std::array<Vec3, 3>> vs(offsets.back());
+        parallel::foreach((long long)(items.size()), [&](long long index, int) {
+            const auto& item = items[index];
+            const auto& M = prims[item.prim].global_transform;
+            const size_t offset = offsets[item.prim];
+            const auto write = [&](int face, Vec3 p1, Vec3 p2, Vec3 p3) {
+                p1 = Vec3(M * Vec4(p1, 1_f));
+                p2 = Vec3(M * Vec4(p2, 1_f));
+                p3 = Vec3(M * Vec4(p3, 1_f));
+                trs_[offset + face] = Tri(p1, p2, p3, item.prim, face);
+                vs[offset + face] = { p1, p2, p3 };
+            };
+            const auto* mesh = scene.node_at(prims[item.prim].node_index).primitive.mesh;
+            if (item.e < 0) {
+                mesh->foreach_triangle_positions([&](int face, int num_faces, const Vec3* ps) {
+                    for (int i = 0; i < num_faces; i++) {
+                        write(face + i, ps[3*i], ps[3*i+1], ps[3*i+2]);
+                    }
+                });
+                return;
+            }
+            const auto buf = *mesh->buffer();
+            const auto at = [&](size_t i) { return buf.ps[buf.indices[i * buf.index_stride]]; };
+            for (int face = item.s; face < item.e; face++) {
+                write(face, at(3*size_t(face)), at(3*size_t(face)+1), at(3*size_t(face)+2));
+            }
+        });
+        return vs;
+    }
+
+    // Bound of the triangle packs in [s,e)
+    Bound pack_bound(int s, int e) const {
+        Bound b;
+        for (int i = s; i < e; i++) {
+            const auto& p = packs_[i];
+            for (int j = 0; j < TriPackSize; j++) {
+                if (p.index[j] < 0) {
+                    continue;
+                }
+                b = merge(b, trs_[indices_[p.index[j]]].b);
+            }
+        }
+        return b;
+    }
+
+    // Refit the flattened binary nodes
+    void refit_flat() {
+        std::vector<Bound> bs(nodes_.size());
+        for (int fi = int(nodes_.size()) - 1; fi >= 0; fi--) {
+            auto& n = nodes_[fi];
+            bs[fi] = n.count > 0
+                ? pack_bound(n.offset, n.offset + int(n.count))
+                : merge(bs[fi + 1], bs[n.offset]);
+            for (int i = 0; i < 3; i++) {
+                n.min[i] = round_down(bs[fi].min[i]);
+                n.max[i] = round_up(bs[fi].max[i]);
+            }
+        }
+    }
+
+    // Refit the wide nodes
+    template <int W>
+    void refit_wide(std::vector<WideNode<W>>& nodes) {
+        std::vector<Bound> bs(nodes.size());
+        for (int wi = int(nodes.size()) - 1; wi >= 0; wi--) {
+            auto& n = nodes[wi];
+            for (int j = 0; j < W; j++) {
+                if (n.child[j] < 0) {
+                    continue;
+                }
+                const auto b = n.count[j] > 0
+                    ? pack_bound(n.child[j], n.child[j] + n.count[j])
+                    : bs[n.child[j]];
+                for (int i = 0; i < 3; i++) {
+                    n.min[i][j] = round_down(b.min[i]);
+                    n.max[i][j] = round_up(b.max[i]);
+                }
+                bs[wi] = merge(bs[wi], b);
+            }
+        }
+    }
+
+    // Refer to the arrays owned by the instance
+    void update_views() {
+        if (mapped_) {
+            return;
+        }
+        views_.nodes = nodes_;
+        views_.nodes4 = nodes4_;
+        views_.nodes8 = nodes8_;
+        views_.trs = trs_;
+        views_.packs = packs_;
+        views_.indices = indices_;
+        views_.flattened_nodes = flattened_nodes_;
+        views_.qnodes4 = qnodes4_;
+        views_.qnodes8 = qnodes8_;
+        views_.cpacks = cpacks_;
+    }
+
+    // Interleave the traversal arrays across NUMA nodes if enabled
+    void interleave_arrays() {
+        const auto interleave = [](auto& v) {
+            parallel::interleave_memory(v.data(), v.size() * sizeof(v[0]));
+        };
+        interleave(nodes_);
+        interleave(nodes4_);
+        interleave(nodes8_);
+        interleave(packs_);
+        interleave(indices_);
+        interleave(qnodes4_);
+        interleave(qnodes8_);
+        interleave(cpacks_);
+        if (huge_pages_) {
+            const auto advise = [](auto& v) {
+                advise_huge_pages(v.data(), v.size() * sizeof(v[0]));
+            };
+            advise(nodes_);
+            advise(nodes4_);
+            advise(nodes8_);
+            advise(packs_);
+            advise(indices_);
+            advise(qnodes4_);
+            advise(qnodes8_);
+            advise(cpacks_);
+        }
+    }
+
+    // Load the arrays from the snapshot.
+    // The large arrays refer to the memory-mapped snapshot without copy.
+    void load_views(InputArchive& ar) {
+        const auto load = [&](auto& v, auto& view) {
+            size_t n;
+            const auto* p = serial::load_view(ar, v, n);
+            view = { p, n };
+        };
+        load(nodes_, views_.nodes);
+        load(nodes4_, views_.nodes4);
+        load(nodes8_, views_.nodes8);
+        load(trs_, views_.trs);
+        load(packs_, views_.packs);
+        load(indices_, views_.indices);
+        load(flattened_nodes_, views_.flattened_nodes);
+        load(qnodes4_, views_.qnodes4);
+        load(qnodes8_, views_.qnodes8);
+        load(cpacks_, views_.cpacks);
+        mapped_ = ar.blobs_owner();
+    }
+
+    // Copy the memory-mapped arrays to the instance
+    void materialize() {
+        if (!mapped_) {
+            return;
+        }
+        nodes_ = views_.nodes.copy();
+        nodes4_ = views_.nodes4.copy();
+        nodes8_ = views_.nodes8.copy();
+        trs_ = views_.trs.copy();
+        packs_ = views_.packs.copy();
+        indices_ = views_.indices.copy();
+        flattened_nodes_ = views_.flattened_nodes.copy();
+        qnodes4_ = views_.qnodes4.copy();
+        qnodes8_ = views_.qnodes8.copy();
+        cpacks_ = views_.cpacks.copy();
+        mapped_.reset();
+        update_views();
+    }
+
+private:
+    // True if the structure contains no triangles
+    bool empty() const {
+        return compressed_ ? views_.cpacks.size() == 0 : views_.indices.size() == 0;
+    }
+
+    // Number of triangle references in the compressed packs
+    int compressed_references() const {
+        int n = 0;
+        for (size_t i = 0; i < views_.cpacks.size(); i++) {
+            for (int j = 0; j < TriPackSize; j++) {
+                n += lane_used(views_.cpacks[i], j) ? 1 : 0;
+            }
+        }
+        return n;
+    }
+
+    // Converts the wide nodes and the triangle packs to the compressed layout
+    // and releases the full precision arrays
+    void compress() {
+        const auto to_mb = [](size_t bytes) { return double(bytes) / 1024.0 / 1024.0; };
+        const auto before = trs_.size() * sizeof(Tri) + indices_.size() * sizeof(int) + packs_.size() * sizeof(TriPack)
+            + nodes4_.size() * sizeof(WideNode<4>) + nodes8_.size() * sizeof(WideNode<8>);
+
+        // Triangle packs referring to the faces
+        cpacks_.resize(packs_.size());
+        parallel::foreach((long long)(packs_.size()), [&](long long i, int) {
+            const auto& p = packs_[i];
+            auto& cp = cpacks_[i];
+            for (int j = 0; j < TriPackSize; j++) {
+                for (int k = 0; k < 3; k++) {
+                    cp.p1[k][j] = float(p.p1[k][j]);
+                    cp.p2[k][j] = float(p.p2[k][j]);
+                    cp.p3[k][j] = float(p.p3[k][j]);
+                }
+                if (p.index[j] < 0) {
+                    cp.flattened_node[j] = -1;
+                    cp.face[j] = -1;
+                    continue;
+                }
+                const auto& tr = trs_[indices_[p.index[j]]];
+                cp.flattened_node[j] = tr.flattened_node;
+                cp.face[j] = tr.face;
+            }
+        });
+
+        // Quantized nodes
+        const auto quantize = [](const auto& nodes, auto& qnodes) {
+            qnodes.resize(nodes.size());
+            parallel::foreach((long long)(nodes.size()), [&](long long i, int) {
+                qnodes[i] = std::decay_t<decltype(qnodes[0])>::quantize(nodes[i]);
+            });
+        };
+        if (width_ == 4) {
+            quantize(nodes4_, qnodes4_);
+        }
+        else {
+            quantize(nodes8_, qnodes8_);
+        }
+
+        // Release the full precision arrays
+        const auto release = [](auto& v) {
+            v.clear();
+            v.shrink_to_fit();
+        };
+        release(trs_);
+        release(indices_);
+        release(packs_);
+        release(nodes4_);
+        release(nodes8_);
+
+        const auto after = cpacks_.size() * sizeof(CompressedTriPack)
+            + qnodes4_.size() * sizeof(QuantizedWideNode<4>) + qnodes8_.size() * sizeof(QuantizedWideNode<8>);
+        LM_INFO("Compressed [width={}, before='{:.2f}MB', after='{:.2f}MB']", width_, to_mb(before), to_mb(after));
+    }
+
+    // Flattens the binary nodes in depth-first order
+    void flatten(const std::vector<Node>& nodes) {
+        nodes_.reserve(nodes.size());
+        std::function<int(int)> visit = [&](int ni) -> int {
+            const auto& n = nodes[ni];
+            const int fi = int(nodes_.size());
+            nodes_.emplace_back();
+            for (int i = 0; i < 3; i++) {
+                nodes_[fi].min[i] = round_down(n.b.min[i]);
+                nodes_[fi].max[i] = round_up(n.b.max[i]);
+            }
+            if (n.leaf) {
+                nodes_[fi].offset = n.ps;
+                nodes_[fi].count = n.pc;
+                nodes_[fi].axis = 0;
+            }
+            else {
+                visit(n.c1);
+                const int second = visit(n.c2);
+                nodes_[fi].offset = second;
+                nodes_[fi].count = 0;
+                nodes_[fi].axis = n.axis;
+            }
+            return fi;
+        };
+        visit(0);
+    }
+
+    // Reorders the wide nodes into page-sized treelets grown along the SAH probability.
+    // The root stays at index 0 and the children are always placed after their parents.
+    template <int W>
+    static void reorder_treelets(std::vector<WideNode<W>>& wide) {
+        if (wide.empty()) {
+            return;
+        }
+        constexpr int PageSize = 4096;
+        constexpr int TreeletSize = std::max(1, PageSize / int(sizeof(WideNode<W>)));
+        const auto area = [&](int wi, int j) -> float {
+            const auto& n = wide[wi];
+            const float dx = n.max[0][j] - n.min[0][j];
+            const float dy = n.max[1][j] - n.min[1][j];
+            const float dz = n.max[2][j] - n.min[2][j];
+            return dx * dy + dy * dz + dz * dx;
+        };
+
+        // Order of the nodes in the new layout
+        std::vector<int> order;
+        order.reserve(wide.size());
+        std::deque<int> roots{ 0 };
+        using Candidate = std::pair<float, int>;    // Surface area and index of the node
+        while (!roots.empty()) {
+            std::priority_queue<Candidate> frontier;
+            frontier.push({ 0.f, roots.front() });
+            roots.pop_front();
+            for (int k = 0; k < TreeletSize && !frontier.empty(); k++) {
+                const int wi = frontier.top().second;
+                frontier.pop();
+                order.push_back(wi);
+                for (int j = 0; j < W; j++) {
+                    if (wide[wi].child[j] >= 0 && wide[wi].count[j] == 0) {
+                        frontier.push({ area(wi, j), wide[wi].child[j] });
+                    }
+                }
+            }
+            // The remaining candidates become the roots of the next treelets
+            while (!frontier.empty()) {
+                roots.push_back(frontier.top().second);
+                frontier.pop();
+            }
+        }
+
+        // Remap the indices of the interior children
+        std::vector<int> remap(wide.size());
+        for (int i = 0; i < int(order.size()); i++) {
+            remap[order[i]] = i;
+        }
+        std::vector<WideNode<W>> reordered(wide.size());
+        for (int i = 0; i < int(order.size()); i++) {
+            auto n = wide[order[i]];
+            for (int j = 0; j < W; j++) {
+                if (n.child[j] >= 0 && n.count[j] == 0) {
+                    n.child[j] = remap[n.child[j]];
+                }
+            }
+            reordered[i] = n;
+        }
+        wide.swap(reordered);
+        LM_INFO("Reordered nodes into treelets [width={}, nodes_per_treelet={}]", W, TreeletSize);
+    }
+
+    // Collapses the binary nodes into W-wide nodes.
+    // Each wide node adopts the children of a binary node and repeatedly
+    // opens the interior child with the largest surface area until W children are gathered.
+    template <int W>
+    static void collapse(const std::vector<Node>& nodes, std::vector<WideNode<W>>& wide) {
+        std::function<int(int)> visit = [&](int ni) -> int {
+            std::vector<int> cs;
+            const auto& n = nodes[ni];
+            if (n.leaf) {
+                cs.push_back(ni);
+            }
+            else {
+                cs.push_back(n.c1);
+                cs.push_back(n.c2);
+            }
+            while (int(cs.size()) < W) {
+                int bi = -1;
+                Float ba = -1_f;
+                for (int i = 0; i < int(cs.size()); i++) {
+                    const auto& c = nodes[cs[i]];
+                    if (!c.leaf && c.b.surface_area() > ba) {
+                        ba = c.b.surface_area();
+                        bi = i;
+                    }
+                }
+                if (bi < 0) {
+                    break;
+                }
+                const auto& c = nodes[cs[bi]];
+                cs[bi] = c.c1;
+                cs.push_back(c.c2);
+            }
+
+            // Empty lanes never intersect
+            const int wi = int(wide.size());
+            wide.emplace_back();
+            for (int j = 0; j < W; j++) {
+                for (int i = 0; i < 3; i++) {
+                    wide[wi].min[i][j] = std::numeric_limits<float>::infinity();
+                    wide[wi].max[i][j] = -std::numeric_limits<float>::infinity();
+                }
+                wide[wi].child[j] = -1;
+                wide[wi].count[j] = 0;
+            }
+            for (int j = 0; j < int(cs.size()); j++) {
+                const auto& c = nodes[cs[j]];
+                const int child = c.leaf ? c.ps : visit(cs[j]);
+                auto& w = wide[wi];
+                for (int i = 0; i < 3; i++) {
+                    w.min[i][j] = round_down(c.b.min[i]);
+                    w.max[i][j] = round_up(c.b.max[i]);
+                }
+                w.child[j] = child;
+                w.count[j] = c.leaf ? c.pc : 0;
+            }
+            return wi;
+        };
+        visit(0);
+    }
+
+    // Minimum number of triangles of the subtree processed by a separate task
+    static constexpr int MinSpawnTriangles = 1024;
+
+    // Maximum depth of the binary nodes.
+    // The SAH splits can be arbitrarily unbalanced, e.g., for many overlapping triangles,
+    // which would exhaust the call stack of the build and the fixed-size stacks of the traversal.
+    // A node whose subtree could exceed the depth with balanced splits is split at the median instead,
+    // so that the leaves are at most MaxBuildDepth deep.
+    static constexpr int MaxBuildDepth = 64;
+
+    // Smallest l such that 2^l >= n
+    static int ceil_log2(int n) {
+        int l = 0;
+        while ((1ll << l) < n) {
+            l++;
+        }
+        return l;
+    }
+
+    // True if the node must be split at the median to bound the depth
+    static bool force_median(int depth, int count) {
+        return depth + ceil_log2(count) >= MaxBuildDepth;
+    }
+
+    // Splits the triangles in [s,e) at the median of the centroids along the longest axis of the centroid bound.
+    // Returns the split position and the axis.
+    std::tuple<int, int> split_median(int s, int e) {
+        Bound cb;
+        for (int i = s; i < e; i++) {
+            cb = merge(cb, trs_[indices_[i]].c);
+        }
+        const auto d = cb.max - cb.min;
+        const int axis = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+        const int m = (s + e) / 2;
+        std::nth_element(indices_.begin() + s, indices_.begin() + m, indices_.begin() + e, [&](int i1, int i2) {
+            return trs_[i1].c[axis] < trs_[i2].c[axis];
+        });
+        return { m, axis };
+    }
+
+    // Builds the binary nodes by object splits of the triangles
+    void build_object(std::vector<Node>& nodes) {
+        const int nt = int(trs_.size());
+        nodes.assign(2*nt-1, {}); // Maximum number of nodes: 2*nt-1
+        indices_.assign(nt, 0);
+        std::iota(indices_.begin(), indices_.end(), 0);
+        std::atomic<int> nn = 1;        // Number of current nodes
+
+        // Each task constructs a node for the triangles ranges in [s,e)
+        // and recursively spawns the tasks for the child nodes.
+        // Small subtrees are processed within the same task to reduce the spawn overhead.
+        parallel::TaskGroup tg;
+        std::function<void(int, int, int, int)> process = [&](int ni, int s, int e, int depth) {
+            // Calculate the bound for the node
+            Node& n = nodes[ni];
+            for (int i = s; i < e; i++) {
+                n.b = merge(n.b, trs_[indices_[i]].b);
+            }
+
+            // Function to create a leaf node
+            const auto make_leaf = [&]() {
+                n.leaf = 1;
+                n.s = s;
+                n.e = e;
+            };
+
+            // Create a leaf node if the number of triangle is 1
+            if (e - s < 2) {
+                make_leaf();
+                return;
+            }
+
+            // Selects a split axis and position according to SAH,
+            // or at the median if the depth would exceed the limit
+            int m, axis;
+            if (force_median(depth, e - s)) {
+                std::tie(m, axis) = split_median(s, e);
+            }
+            else {
+                const auto [b, m_, axis_] = builder_ == Builder::Sweep
+                    ? split_sweep(n, s, e)
+                    : split_binned(n, s, e);
+                if (b > e - s) {
+                    make_leaf();
+                    return;
+                }
+                m = m_;
+                axis = axis_;
+            }
+            n.axis = axis;
+            const int c1 = n.c1 = nn++;
+            const int c2 = n.c2 = nn++;
+            if (e - s >= MinSpawnTriangles) {
+                tg.run([&process, c1, s, m, depth]() { process(c1, s, m, depth + 1); });
+            }
+            else {
+                process(c1, s, m, depth + 1);
+            }
+            process(c2, m, e, depth + 1);
+        };
+        tg.run([&]() { process(0, 0, nt, 0); });
+        tg.wait();
+        nodes.resize(nn);
+    }
+
+    // Process the range [0,n) split into the chunks by the tasks
+    template <typename Func>
+    static void foreach_chunk(int n, int num_chunks, const Func& func) {
+        parallel::TaskGroup tg;
+        for (int c = 0; c < num_chunks; c++) {
+            const int s = int((long long)(n) * c / num_chunks);
+            const int e = int((long long)(n) * (c + 1) / num_chunks);
+            tg.run([&func, c, s, e]() { func(c, s, e); });
+        }
+        tg.wait();
+    }
+
+    // Maximum number of triangles in a leaf of the linear builder
+    static constexpr int MaxLinearLeafTriangles = TriPackSize;
+
+    // Builds the binary nodes by splitting the triangles sorted along the Morton curve [Lauterbach2009].
+    // The triangles are sorted by the Morton codes of the centroids with the parallel radix sort,
+    // and the nodes are split at the highest bit differing in the codes of the triangles in the node.
+    void build_linear(std::vector<Node>& nodes) {
+        const int nt = int(trs_.size());
+        const int num_chunks = std::clamp(nt / MinSpawnTriangles, 1, 4 * parallel::num_threads());
+
+        // Bound of the centroids
+        std::vector<Bound> chunk_bounds(num_chunks);
+        foreach_chunk(nt, num_chunks, [&](int c, int s, int e) {
+            for (int i = s; i < e; i++) {
+                chunk_bounds[c] = merge(chunk_bounds[c], trs_[i].c);
+            }
+        });
+        Bound cb;
+        for (const auto& b : chunk_bounds) {
+            cb = merge(cb, b);
+        }
+
+        // Morton codes of the centroids quantized to 10 bits per axis.
+        // The bits of the axes are interleaved in the order of x, y, z from the highest bit.
+        const auto expand_bits = [](std::uint32_t v) {
+            v = (v * 0x00010001u) & 0xFF0000FFu;
+            v = (v * 0x00000101u) & 0x0F00F00Fu;
+            v = (v * 0x00000011u) & 0xC30C30C3u;
+            v = (v * 0x00000005u) & 0x49249249u;
+            return v;
+        };
+        std::vector<std::uint32_t> codes(nt);
+        foreach_chunk(nt, num_chunks, [&](int, int s, int e) {
+            const auto extent = cb.max - cb.min;
+            for (int i = s; i < e; i++) {
+                std::uint32_t q[3];
+                for (int k = 0; k < 3; k++) {
+                    const auto t = extent[k] > 0_f ? (trs_[i].c[k] - cb.min[k]) / extent[k] : 0_f;
+                    q[k] = std::uint32_t(std::clamp(t * 1024_f, 0_f, 1023_f));
+                }
+                codes[i] = (expand_bits(q[0]) << 2) | (expand_bits(q[1]) << 1) | expand_bits(q[2]);
+            }
+        });
+
+        // Sort the triangle indices by the codes with the LSD radix sort of 8-bit digits.
+        // Each pass counts the digits per chunk and scatters the chunks in order, so the sort is stable.
+        constexpr int RadixBits = 8;
+        constexpr int NumBuckets = 1 << RadixBits;
+        indices_.assign(nt, 0);
+        std::iota(indices_.begin(), indices_.end(), 0);
+        std::vector<int> temp_indices(nt);
+        std::vector<std::uint32_t> temp_codes(nt);
+        std::vector<int> counts(size_t(num_chunks) * NumBuckets);
+        for (int shift = 0; shift < 30; shift += RadixBits) {
+            std::fill(counts.begin(), counts.end(), 0);
+            foreach_chunk(nt, num_chunks, [&](int c, int s, int e) {
+                for (int i = s; i < e; i++) {
+                    counts[size_t(c) * NumBuckets + ((codes[i] >> shift) & (NumBuckets - 1))]++;
+                }
+            });
+            int offset = 0;
+            for (int d = 0; d < NumBuckets; d++) {
+                for (int c = 0; c < num_chunks; c++) {
+                    const int count = counts[size_t(c) * NumBuckets + d];
+                    counts[size_t(c) * NumBuckets + d] = offset;
+                    offset += count;
+                }
+            }
+            foreach_chunk(nt, num_chunks, [&](int c, int s, int e) {
+                for (int i = s; i < e; i++) {
+                    const int j = counts[size_t(c) * NumBuckets + ((codes[i] >> shift) & (NumBuckets - 1))]++;
+                    temp_indices[j] = indices_[i];
+                    temp_codes[j] = codes[i];
+                }
+            });
+            std::swap(indices_, temp_indices);
+            std::swap(codes, temp_codes);
+        }
+
+        // Split the sorted triangles top-down.
+        // Each split at a differing bit lowers the highest differing bit of the node,
+        // and the nodes with the same codes are split at the middle,
+        // so the depth is bounded by the 30 bits of the codes plus log2 of the number of triangles.
+        nodes.assign(2*nt-1, {});
+        std::atomic<int> nn = 1;
+        parallel::TaskGroup tg;
+        std::function<void(int, int, int)> process = [&](int ni, int s, int e) {
+            Node& n = nodes[ni];
+            for (int i = s; i < e; i++) {
+                n.b = merge(n.b, trs_[indices_[i]].b);
+            }
+            if (e - s <= MaxLinearLeafTriangles) {
+                n.leaf = 1;
+                n.s = s;
+                n.e = e;
+                return;
+            }
+
+            // Split at the first triangle with the highest differing bit set.
+            // The triangles with the same codes are split at the middle.
+            int m = (s + e) / 2;
+            const auto d = n.b.max - n.b.min;
+            n.axis = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+            const auto diff = codes[s] ^ codes[e - 1];
+            if (diff != 0) {
+                int bit = 0;
+                while (diff >> (bit + 1)) {
+                    bit++;
+                }
+                const auto mask = std::uint32_t(1) << bit;
+                m = int(std::partition_point(codes.begin() + s, codes.begin() + e,
+                    [mask](std::uint32_t code) { return (code & mask) == 0; }) - codes.begin());
+                n.axis = 2 - bit % 3;
+            }
+            const int c1 = n.c1 = nn++;
+            const int c2 = n.c2 = nn++;
+            if (e - s >= MinSpawnTriangles) {
+                tg.run([&process, c1, s, m]() { process(c1, s, m); });
+            }
+            else {
+                process(c1, s, m);
+            }
+            process(c2, m, e);
+        };
+        tg.run([&]() { process(0, 0, nt); });
+        tg.wait();
+        nodes.resize(nn);
+    }
+
+    // Builds the binary nodes by object splits and spatial splits of the triangle references [Stich2009].
+    // The references are held by the tasks and written to indices_ when the leaves are created.
+    void build_spatial(std::vector<Node>& nodes, const std::vector<std::array<Vec3, 3>>& vs) {
+        const int nt = int(trs_.size());
+        const int max_refs = int(std::min<double>(nt * (1.0 + max_duplicates_), std::numeric_limits<int>::max() / 2));
+        nodes.assign(2*max_refs-1, {});         // Each leaf holds at least one reference
+        indices_.assign(max_refs, 0);
+        std::atomic<int> nn = 1;                // Number of current nodes
+        std::atomic<int> nr = nt;               // Number of references including reserved duplicates
+        std::atomic<int> nw = 0;                // Number of references written to the leaves
+
+        // Initial references and the surface area of the root
+        std::vector<Ref> root(nt);
+        Bound rb;
+        for (int i = 0; i < nt; i++) {
+            root[i] = { trs_[i].b, i };
+            rb = merge(rb, trs_[i].b);
+        }
+        const auto root_sa = rb.surface_area();
+
+        // Each task constructs a node for the given references.
+        // Spatial splits are only tried when the children of the best object split overlap.
+        constexpr int MaxSpatialDepth = 64;
+        parallel::TaskGroup tg;
+        std::function<void(int, std::vector<Ref>, int)> process = [&](int ni, std::vector<Ref> refs, int depth) {
+            // Calculate the bound for the node
+            Node& n = nodes[ni];
+            for (const auto& r : refs) {
+                n.b = merge(n.b, r.b);
+            }
+            const int count = int(refs.size());
+
+            // Function to create a leaf node
+            const auto make_leaf = [&]() {
+                n.leaf = 1;
+                n.s = nw.fetch_add(count);
+                n.e = n.s + count;
+                for (int i = 0; i < count; i++) {
+                    indices_[n.s + i] = refs[i].tri;
+                }
+            };
+
+            // Create a leaf node if the number of references is 1
+            if (count < 2) {
+                make_leaf();
+                return;
+            }
+
+            // Split the references at the median of the centroids if the depth would exceed the limit
+            const auto spawn = [&](std::vector<Ref>&& left, std::vector<Ref>&& right, int axis) {
+                n.axis = axis;
+                const int c1 = n.c1 = nn++;
+                const int c2 = n.c2 = nn++;
+                if (count >= MinSpawnTriangles) {
+                    tg.run([&process, c1, l = std::move(left), depth]() mutable { process(c1, std::move(l), depth + 1); });
+                }
+                else {
+                    process(c1, std::move(left), depth + 1);
+                }
+                process(c2, std::move(right), depth + 1);
+            };
+            if (force_median(depth, count)) {
+                Bound cb;
+                for (const auto& r : refs) {
+                    cb = merge(cb, r.b.center());
+                }
+                const auto d = cb.max - cb.min;
+                const int axis = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+                const auto mid = refs.begin() + count / 2;
+                std::nth_element(refs.begin(), mid, refs.end(), [&](const Ref& r1, const Ref& r2) {
+                    return r1.b.center()[axis] < r2.b.center()[axis];
+                });
+                std::vector<Ref> left(refs.begin(), mid);
+                std::vector<Ref> right(mid, refs.end());
+                refs.clear();
+                refs.shrink_to_fit();
+                spawn(std::move(left), std::move(right), axis);
+                return;
+            }
+
+            // Find the best object split and spatial split
+            const auto os = split_object_refs(n, refs);
+            const bool overlapped = os.overlap / root_sa > alpha_;
+            const auto ss = depth < MaxSpatialDepth && overlapped
+                ? split_spatial(n, refs, vs)
+                : SpatialSplit{ Inf, -1, 0_f };
+
+            // Partition the references
+            std::vector<Ref> left, right;
+            int axis = -1;
+            if (ss.cost < os.cost && ss.cost <= count) {
+                // Reserve the duplicated references within the limit
+                const int d = int(std::count_if(refs.begin(), refs.end(), [&](const Ref& r) {
+                    return r.b.min[ss.axis] < ss.pos && ss.pos < r.b.max[ss.axis];
+                }));
+                if (nr.fetch_add(d) + d <= max_refs) {
+                    for (const auto& r : refs) {
+                        if (r.b.max[ss.axis] <= ss.pos) {
+                            left.push_back(r);
+                        }
+                        else if (r.b.min[ss.axis] >= ss.pos) {
+                            right.push_back(r);
+                        }
+                        else {
+                            left.push_back({ clip(r, vs[r.tri], ss.axis, r.b.min[ss.axis], ss.pos), r.tri });
+                            right.push_back({ clip(r, vs[r.tri], ss.axis, ss.pos, r.b.max[ss.axis]), r.tri });
+                        }
+                    }
+                    axis = ss.axis;
+                }
+                if (axis < 0 || left.empty() || right.empty()) {
+                    // Fall back to the object split
+                    nr -= d;
+                    left.clear();
+                    right.clear();
+                    axis = -1;
+                }
+            }
+            if (axis < 0) {
+                if (os.cost > count) {
+                    make_leaf();
+                    return;
+                }
+                const auto it = std::partition(refs.begin(), refs.end(), [&](const Ref& r) {
+                    return os.bin_index(r) < os.k;
+                });
+                left.assign(refs.begin(), it);
+                right.assign(it, refs.end());
+                axis = os.axis;
+            }
+            refs.clear();
+            refs.shrink_to_fit();
+            spawn(std::move(left), std::move(right), axis);
+        };
+        tg.run([&]() { process(0, std::move(root), 0); });
+        tg.wait();
+        nodes.resize(nn);
+        indices_.resize(nw);
+    }
+
+    // Result of split search
+    struct Split {
+        Float cost;     // SAH cost of the split
+        int mid;        // Split position in indices_
+        int axis;       // Split axis
+    };
+
+    // Result of object split search over the references
+    struct ObjectSplit {
+        Float cost;     // SAH cost of the split
+        Float overlap;  // Surface area of the overlap of the children
+        int axis;       // Split axis
+        int k;          // References in the bins [0,k) go to the left child
+        Bound cb;       // Bound of the centroids
+        int bins;       // Number of bins
+
+        // Bin index of a reference along the split axis
+        int bin_index(const Ref& r) const {
+            const auto ext = cb.max[axis] - cb.min[axis];
+            const int i = int(Float(bins) * (r.b.center()[axis] - cb.min[axis]) / ext);
+            return glm::clamp(i, 0, bins-1);
+        }
+    };
+
+    // Finds the object split by evaluating SAH over fixed-count centroid bins of the references
+    ObjectSplit split_object_refs(const Node& n, const std::vector<Ref>& refs) const {
+        ObjectSplit split{ Inf, 0_f, -1, -1, {}, num_bins_ };
+        for (const auto& r : refs) {
+            split.cb = merge(split.cb, r.b.center());
+        }
+
+        struct Bin {
+            Bound b;
+            int n = 0;
+        };
+        const int K = num_bins_;
+        const int count = int(refs.size());
+        thread_local std::vector<Bin> bins;
+        thread_local std::vector<Bound> rbs;
+        for (int a = 0; a < 3; a++) {
+            // Skip the axis if all the centroids are on the same plane
+            if (split.cb.max[a] <= split.cb.min[a]) {
+                continue;
+            }
+            ObjectSplit candidate = split;
+            candidate.axis = a;
+
+            // Accumulate references into the bins
+            bins.assign(K, {});
+            for (const auto& r : refs) {
+                auto& bin = bins[candidate.bin_index(r)];
+                bin.b = merge(bin.b, r.b);
+                bin.n++;
+            }
+
+            // Sweep from right to compute bounds of the right partitions
+            // rbs[k]: bound of the right partition for the split between bin k-1 and k
+            rbs.assign(K, {});
+            for (int k = K-1; k > 0; k--) {
+                rbs[k] = merge(k < K-1 ? rbs[k+1] : Bound(), bins[k].b);
+            }
+
+            // Sweep from left and evaluate SAH
+            Bound bl;
+            int nl = 0;
+            for (int k = 1; k < K; k++) {
+                bl = merge(bl, bins[k-1].b);
+                nl += bins[k-1].n;
+                if (nl == 0 || nl == count) {
+                    continue;
+                }
+                const auto& br = rbs[k];
+                const auto c = 1_f + (bl.surface_area()*nl + br.surface_area()*(count-nl))/n.b.surface_area();
+                if (c < split.cost) {
+                    split = candidate;
+                    split.cost = c;
+                    split.k = k;
+                    split.overlap = overlap_area(bl, br);
+                }
+            }
+        }
+        if (split.axis < 0) {
+            // No object split is possible, e.g., all the centroids are the same
+            split.overlap = Inf;
+        }
+        return split;
+    }
+
+    // Result of spatial split search
+    struct SpatialSplit {
+        Float cost;     // SAH cost of the split
+        int axis;       // Split axis
+        Float pos;      // Position of the split plane
+    };
+
+    // Finds the spatial split by evaluating SAH over fixed-count bins of the node bound.
+    // The references are clipped to the bins they overlap.
+    SpatialSplit split_spatial(const Node& n, const std::vector<Ref>& refs, const std::vector<std::array<Vec3, 3>>& vs) const {
+        struct Bin {
+            Bound b;
+            int enter = 0;  // Number of references starting in the bin
+            int exit = 0;   // Number of references ending in the bin
+        };
+        const int K = num_bins_;
+        thread_local std::vector<Bin> bins;
+        thread_local std::vector<Float> r;
+        SpatialSplit split{ Inf, -1, 0_f };
+        for (int a = 0; a < 3; a++) {
+            const auto lo = n.b.min[a];
+            const auto ext = n.b.max[a] - lo;
+            if (ext <= 0_f) {
+                continue;
+            }
+            const auto bin_index = [&](Float x) -> int {
+                return glm::clamp(int(Float(K) * (x - lo) / ext), 0, K-1);
+            };
+            const auto plane = [&](int k) -> Float {
+                return lo + ext * Float(k) / Float(K);
+            };
+
+            // Clip the references to the bins
+            bins.assign(K, {});
+            for (const auto& ref : refs) {
+                const int k0 = bin_index(ref.b.min[a]);
+                const int k1 = bin_index(ref.b.max[a]);
+                if (k0 == k1) {
+                    bins[k0].b = merge(bins[k0].b, ref.b);
+                }
+                else {
+                    for (int k = k0; k <= k1; k++) {
+                        const auto cb = clip(ref, vs[ref.tri], a,
+                            std::max(plane(k), ref.b.min[a]), std::min(plane(k+1), ref.b.max[a]));
+                        bins[k].b = merge(bins[k].b, cb);
+                    }
+                }
+                bins[k0].enter++;
+                bins[k1].exit++;
+            }
+
+            // Sweep from right to compute costs of the right partitions
+            // r[k]: cost of the right partition for the split between bin k-1 and k
+            r.assign(K, 0_f);
+            {
+                Bound br;
+                int nr = 0;
+                for (int k = K-1; k > 0; k--) {
+                    br = merge(br, bins[k].b);
+                    nr += bins[k].exit;
+                    r[k] = nr > 0 ? br.surface_area() * nr : 0_f;
+                }
+            }
+
+            // Sweep from left and evaluate SAH
+            Bound bl;
+            int nl = 0;
+            int nr = int(refs.size());
+            for (int k = 1; k < K; k++) {
+                bl = merge(bl, bins[k-1].b);
+                nl += bins[k-1].enter;
+                nr -= bins[k-1].exit;
+                if (nl == 0 || nr == 0) {
+                    continue;
+                }
+                const auto c = 1_f + (bl.surface_area()*nl + r[k])/n.b.surface_area();
+                if (c < split.cost) {
+                    split = { c, a, plane(k) };
+                }
+            }
+        }
+        return split;
+    }
+
+    // Bound of the triangle clipped by the slab [lo,hi] along the axis and by the bound of the reference
+    static Bound clip(const Ref& r, const std::array<Vec3, 3>& v, int a, Float lo, Float hi) {
+        Bound b;
+        for (int i = 0; i < 3; i++) {
+            const auto& p = v[i];
+            const auto& q = v[(i+1)%3];
+            if (lo <= p[a] && p[a] <= hi) {
+                b = merge(b, p);
+            }
+            // Intersections of the edge with the planes of the slab
+            for (const Float x : { lo, hi }) {
+                if ((p[a] < x && x < q[a]) || (q[a] < x && x < p[a])) {
+                    auto c = glm::mix(p, q, (x - p[a]) / (q[a] - p[a]));
+                    c[a] = x;
+                    b = merge(b, c);
+                }
+            }
+        }
+        return intersection(b, r.b);
+    }
+
+    // Surface area of the overlap of two bounds
+    static Float overlap_area(const Bound& b1, const Bound& b2) {
+        const auto b = intersection(b1, b2);
+        return b.min.x <= b.max.x ? b.surface_area() : 0_f;
+    }
+
+    // Intersection of two bounds. The result is empty if the bounds do not overlap.
+    static Bound intersection(const Bound& b1, const Bound& b2) {
+        Bound b;
+        for (int i = 0; i < 3; i++) {
+            b.min[i] = std::max(b1.min[i], b2.min[i]);
+            b.max[i] = std::min(b1.max[i], b2.max[i]);
+            if (b.min[i] > b.max[i]) {
+                return {};
+            }
+        }
+        return b;
+    }
+
+    // Finds the split with full-sort of the triangles along each axis
+    Split split_sweep(const Node& n, int s, int e) {
+        // Function to sort the triangles according to the given axis
+        const auto st = [&](int ax) {
+            auto cmp = [&](int i1, int i2) {
+                return trs_[i1].c[ax] < trs_[i2].c[ax];
+            };
+            std::sort(&indices_[s], &indices_[e-1]+1, cmp);
+        };
+
+        Float b = Inf;
+        int bi = -1, ba = -1;
+        for (int a = 0; a < 3; a++) {
+            thread_local std::vector<Float> l, r;
+            l.resize(e-s+1);
+            r.resize(e-s+1);
+            st(a);
+            Bound bl, br;
+            for (int i = 0; i <= e - s; i++) {
+                int j = e - s - i;
+                l[i] = bl.surface_area() * i;
+                r[j] = br.surface_area() * i;
+                bl = i < e - s ? merge(bl, trs_[indices_[s+i]].b) : bl;
+                br = j > 0 ? merge(br, trs_[indices_[s+j-1]].b) : br;
+            }
+            for (int i = 1; i < e - s; i++) {
+                const auto c = 1_f + (l[i]+r[i])/n.b.surface_area();
+                if (c < b) {
+                    b = c;
+                    bi = i;
+                    ba = a;
+                }
+            }
+        }
+        if (b > e - s) {
+            return { b, -1, -1 };
+        }
+        st(ba);
+        return { b, s + bi, ba };
+    }
+
+    // Finds the split by evaluating SAH over fixed-count centroid bins
+    Split split_binned(const Node& n, int s, int e) {
+        // Bound of the centroids
+        Bound cb;
+        for (int i = s; i < e; i++) {
+            cb = merge(cb, trs_[indices_[i]].c);
+        }
+
+        // Bin index of a triangle along the axis
+        const int K = num_bins_;
+        const auto bin_index = [&](int i, int a) -> int {
+            const auto ext = cb.max[a] - cb.min[a];
+            const int k = int(Float(K) * (trs_[i].c[a] - cb.min[a]) / ext);
+            return glm::clamp(k, 0, K-1);
+        };
+
+        struct Bin {
+            Bound b;
+            int n = 0;
+        };
+        thread_local std::vector<Bin> bins;
+        thread_local std::vector<Float> r;
+        Float b = Inf;
+        int bk = -1, ba = -1;
+        for (int a = 0; a < 3; a++) {
+            // Skip the axis if all the centroids are on the same plane
+            if (cb.max[a] <= cb.min[a]) {
+                continue;
+            }
+
+            // Accumulate triangles into the bins
+            bins.assign(K, {});
+            for (int i = s; i < e; i++) {
+                const int ti = indices_[i];
+                auto& bin = bins[bin_index(ti, a)];
+                bin.b = merge(bin.b, trs_[ti].b);
+                bin.n++;
+            }
+
+            // Sweep from right to compute costs of the right partitions
+            // r[k]: cost of the right partition for the split between bin k-1 and k
+            r.assign(K, 0_f);
+            {
+                Bound br;
+                int nr = 0;
+                for (int k = K-1; k > 0; k--) {
+                    br = merge(br, bins[k].b);
+                    nr += bins[k].n;
+                    r[k] = nr > 0 ? br.surface_area() * nr : 0_f;
+                }
+            }
+
+            // Sweep from left and evaluate SAH
+            Bound bl;
+            int nl = 0;
+            for (int k = 1; k < K; k++) {
+                bl = merge(bl, bins[k-1].b);
+                nl += bins[k-1].n;
+                if (nl == 0 || nl == e - s) {
+                    continue;
+                }
+                const auto c = 1_f + (bl.surface_area()*nl + r[k])/n.b.surface_area();
+                if (c < b) {
+                    b = c;
+                    bk = k;
+                    ba = a;
+                }
+            }
+        }
+        if (b > e - s) {
+            return { b, -1, -1 };
+        }
+
+        // Partition the triangles according to the selected bin
+        const auto it = std::partition(&indices_[s], &indices_[e-1]+1, [&](int i) {
+            return bin_index(i, ba) < bk;
+        });
+        return { b, int(it - &indices_[0]), ba };
+    }
+
+    // Measures traversal time with random rays for the binary and current layouts
+    void report_traversal(const std::vector<Node>& nodes) const {
+        exception::ScopedDisableFPEx guard_;
+        const auto& root = nodes.at(0).b;
+        const int N = 1 << 16;
+        Rng rng(42);
+        std::vector<Ray> rays(N);
+        for (auto& r : rays) {
+            const auto u = rng.next<Vec3>();
+            r.o = root.min + (root.max - root.min) * u;
+            r.d = math::sample_uniform_sphere(rng.next<Vec2>());
+        }
+
+        // Binary layout
+        Float checksum_binary = 0_f;
+        timer::ScopedTimer st_binary;
+        for (const auto& ray : rays) {
+            Float tmax = Inf;
+            int s[99]{};
+            int si = 0;
+            while (si >= 0) {
+                const auto& n = nodes[s[si--]];
+                if (!n.b.isect(ray, Eps, tmax)) {
+                    continue;
+                }
+                if (!n.leaf) {
+                    s[++si] = n.c1;
+                    s[++si] = n.c2;
+                    continue;
+                }
+                for (int i = n.s; i < n.e; i++) {
+                    if (const auto h = trs_[indices_[i]].intersect(ray, Eps, tmax); h) {
+                        tmax = h->t;
+                    }
+                }
+            }
+            checksum_binary += tmax;
+        }
+        const auto elapsed_binary = st_binary.now();
+
+        // Current layout
+        Float checksum_flat = 0_f;
+        timer::ScopedTimer st_flat;
+        for (const auto& ray : rays) {
+            const auto h = intersect(ray, Eps, Inf);
+            checksum_flat += h ? h->t : Inf;
+        }
+        const auto elapsed_flat = st_flat.now();
+
+        LM_INFO("Traversal [rays={}, width={}, binary='{:.3f}s', current='{:.3f}s', speedup='{:.2f}x', consistent={}]",
+            N, width_, elapsed_binary, elapsed_flat, elapsed_binary / elapsed_flat,
+            glm::abs(checksum_binary - checksum_flat) < Eps * N);
+    }
+
+    // Result of the traversal
+    struct TraversalResult {
+        int index = -1;     // Index to indices_ of the hit triangle, or pack*TriPackSize+lane
+                            // for the compressed layout. -1 if no hit.
+        Tri::Hit hit;       // Hit information of the triangle
+    };
+
+    // Alpha test of the triangle in the lane of the pack
+    template <typename Pack>
+    bool accept_alpha(const Pack& p, int j, Float u, Float v) const {
+        if (alpha_masked_.empty()) {
+            return true;
+        }
+        int fn, face;
+        if constexpr (std::is_same_v<Pack, TriPack>) {
+            const auto& tr = views_.trs[views_.indices[p.index[j]]];
+            fn = tr.flattened_node;
+            face = tr.face;
+        }
+        else {
+            fn = p.flattened_node[j];
+            face = p.face[j];
+        }
+        return !alpha_masked_[fn] || alpha_test_(views_.flattened_nodes[fn].primitive, face, Vec2(u, v));
+    }
+
+    // Tests the triangle packs in [s,e) and updates the closest hit.
+    // Returns true if the traversal can be terminated.
+    template <bool AnyHit, bool Watertight, typename Pack, typename Counter>
+    bool intersect_triangles(const ArrayView<Pack>& packs, const PackRay& pr, Float tmin, Float& tmax, int s, int e, TraversalResult& result, Counter counter) const {
+        for (int i = s; i < e; i++) {
+            const auto& p = packs[i];
+            counter.pack(p);
+            Tri::Hit h;
+            const int lane = intersect_pack<Watertight>(p, pr, tmin, tmax, h, [&](int j, Float u, Float v) {
+                return accept_alpha(p, j, u, v);
+            });
+            if (lane < 0) {
+                continue;
+            }
+            if constexpr (std::is_same_v<Pack, TriPack>) {
+                result = { p.index[lane], h };
+            }
+            else {
+                result = { i * TriPackSize + lane, h };
+            }
+            tmax = h.t;
+            if constexpr (AnyHit) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Traverses the wide nodes, either full precision or quantized
+    template <bool AnyHit, bool Watertight, typename WNode, typename Pack, typename Counter>
+    TraversalResult traverse_wide(const ArrayView<WNode>& nodes, const ArrayView<Pack>& packs, Ray ray, Float tmin, Float tmax, Counter counter) const {
+        constexpr int W = WNode::Width;
+        exception::ScopedDisableFPEx guard_;  // Disable floating point exceptions
+        const PackRay pr(ray);
+        WideRay wr;
+        for (int i = 0; i < 3; i++) {
+            wr.o[i] = float(ray.o[i]);
+            wr.inv_d[i] = float(1_f / ray.d[i]);
+        }
+        TraversalResult result;
+        int s[64 * W];
+        int si = 0;
+        s[si++] = 0;
+        while (si > 0) {
+            const auto& n = nodes[s[--si]];
+            counter.node();
+            alignas(16) float ts[W];
+            const int mask = isect_node(n, wr, float(tmin), float(tmax), ts);
+            if (mask == 0) {
+                continue;
+            }
+
+            // Process leaves immediately and sort interior children by entry distance
+            int cs[W];
+            float ct[W];
+            int nc = 0;
+            for (int j = 0; j < W; j++) {
+                if (!(mask & (1 << j)) || n.child[j] < 0) {
+                    continue;
+                }
+                if (n.count[j] > 0) {
+                    if (intersect_triangles<AnyHit, Watertight>(packs, pr, tmin, tmax, n.child[j], n.child[j] + n.count[j], result, counter)) {
+                        return result;
+                    }
+                    continue;
+                }
+                // Insertion sort in descending order of the distance
+                int k = nc++;
+                while (k > 0 && ct[k-1] < ts[j]) {
+                    cs[k] = cs[k-1];
+                    ct[k] = ct[k-1];
+                    k--;
+                }
+                cs[k] = n.child[j];
+                ct[k] = ts[j];
+            }
+
+            // Push farther children first so that nearer ones are visited first
+            for (int k = 0; k < nc; k++) {
+                s[si++] = cs[k];
+            }
+        }
+        return result;
+    }
+
+    // Traverses the flattened binary nodes
+    template <bool AnyHit, bool Watertight, typename Counter>
+    TraversalResult traverse_flat(Ray ray, Float tmin, Float tmax, Counter counter) const {
+        exception::ScopedDisableFPEx guard_;  // Disable floating point exceptions
+        const PackRay pr(ray);
+        const Vec3 inv_d = 1_f / ray.d;
+        const bool neg[3] = { inv_d.x < 0, inv_d.y < 0, inv_d.z < 0 };
+        TraversalResult result;
+        int s[128];
+        int si = 0;
+        int ni = 0;
+        while (true) {
+            const auto& n = views_.nodes[ni];
+            counter.node();
+            if (n.isect(ray, inv_d, tmin, tmax)) {
+                if (n.count == 0) {
+                    // Visit nearer child first
+                    if (neg[n.axis]) {
+                        s[si++] = ni + 1;
+                        ni = n.offset;
+                    }
+                    else {
+                        s[si++] = n.offset;
+                        ni = ni + 1;
+                    }
+                    continue;
+                }
+                if (intersect_triangles<AnyHit, Watertight>(views_.packs, pr, tmin, tmax, n.offset, n.offset + int(n.count), result, counter)) {
+                    return result;
+                }
+            }
+            if (si == 0) {
+                break;
+            }
+            ni = s[--si];
+        }
+        return result;
+    }
+
+    // Traverses the nodes of the current layout
+    template <bool AnyHit, bool Watertight, typename Counter>
+    TraversalResult traverse_layout(Ray ray, Float tmin, Float tmax, Counter counter) const {
+        if (compressed_) {
+            return width_ == 4
+                ? traverse_wide<AnyHit, Watertight>(views_.qnodes4, views_.cpacks, ray, tmin, tmax, counter)
+                : traverse_wide<AnyHit, Watertight>(views_.qnodes8, views_.cpacks, ray, tmin, tmax, counter);
+        }
+        if (width_ == 4) {
+            return traverse_wide<AnyHit, Watertight>(views_.nodes4, views_.packs, ray, tmin, tmax, counter);
+        }
+        if (width_ == 8) {
+            return traverse_wide<AnyHit, Watertight>(views_.nodes8, views_.packs, ray, tmin, tmax, counter);
+        }
+        return traverse_flat<AnyHit, Watertight>(ray, tmin, tmax, counter);
+    }
+
+    template <bool AnyHit, typename Counter = NoCounter>
+    TraversalResult traverse(Ray ray, Float tmin, Float tmax, Counter counter = {}) const {
+        if (empty()) {
+            return {};
+        }
+        return watertight_
+            ? traverse_layout<AnyHit, true>(ray, tmin, tmax, counter)
+            : traverse_layout<AnyHit, false>(ray, tmin, tmax, counter);
+    }
+
+    // Collect the statistics of the structure of the current layout
+    Json structure() const {
+        const auto leaf_triangles = [&](int s, int c) {
+            Accel::TraversalCounts counts;
+            StepCounter counter{ counts };
+            for (int i = s; i < s + c; i++) {
+                if (compressed_) {
+                    counter.pack(views_.cpacks[i]);
+                }
+                else {
+                    counter.pack(views_.packs[i]);
+                }
+            }
+            return int(counts.triangles);
+        };
+
+        accel::BVHStats stats(bound());
+        size_t memory = 0;
+        if (!empty()) {
+            if (width_ == 4 || width_ == 8) {
+                const auto visit_wide = [&](const auto& nodes) {
+                    constexpr int W = std::decay_t<decltype(nodes[0])>::Width;
+                    std::function<void(int, int)> visit = [&](int ni, int depth) {
+                        const auto& n = nodes[ni];
+                        for (int j = 0; j < W; j++) {
+                            if (n.child[j] < 0) {
+                                continue;
+                            }
+                            const auto b = child_bound(n, j);
+                            if (n.count[j] > 0) {
+                                stats.add_leaf(b, depth + 1, leaf_triangles(n.child[j], n.count[j]));
+                            }
+                            else {
+                                stats.add_interior(b, depth + 1);
+                                visit(n.child[j], depth + 1);
+                            }
+                        }
+                    };
+                    stats.add_interior(bound(), 0);
+                    visit(0, 0);
+                    memory += nodes.size() * sizeof(nodes[0]);
+                };
+                if (compressed_) {
+                    if (width_ == 4) {
+                        visit_wide(views_.qnodes4);
+                    }
+                    else {
+                        visit_wide(views_.qnodes8);
+                    }
+                }
+                else if (width_ == 4) {
+                    visit_wide(views_.nodes4);
+                }
+                else {
+                    visit_wide(views_.nodes8);
+                }
+            }
+            else {
+                std::function<void(int, int)> visit = [&](int ni, int depth) {
+                    const auto& n = views_.nodes[ni];
+                    Bound b;
+                    b = merge(b, Vec3(n.min[0], n.min[1], n.min[2]));
+                    b = merge(b, Vec3(n.max[0], n.max[1], n.max[2]));
+                    if (n.count > 0) {
+                        stats.add_leaf(b, depth, leaf_triangles(n.offset, int(n.count)));
+                        return;
+                    }
+                    stats.add_interior(b, depth);
+                    visit(ni + 1, depth + 1);
+                    visit(n.offset, depth + 1);
+                };
+                visit(0, 0);
+                memory += views_.nodes.size() * sizeof(FlatNode);
+            }
+        }
+        memory += views_.trs.size() * sizeof(Tri)
+            + views_.packs.size() * sizeof(TriPack)
+            + views_.indices.size() * sizeof(int)
+            + views_.flattened_nodes.size() * sizeof(FlattenedPrimitiveNode)
+            + views_.cpacks.size() * sizeof(CompressedTriPack);
+
+        auto j = stats.to_json(memory);
+        j["width"] = width_;
+        j["compressed"] = compressed_;
+        if (compressed_) {
+            j["references"] = compressed_references();
+        }
+        else {
+            j["triangles"] = views_.trs.size();
+            j["references"] = views_.indices.size();
+        }
+        return j;
+    }
+
+public:
+    virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
+        const auto result = traverse<false>(ray, tmin, tmax);
+        if (result.index < 0) {
+            return {};
+        }
+        if (compressed_) {
+            const auto& p = views_.cpacks[result.index / TriPackSize];
+            const int lane = result.index % TriPackSize;
+            const auto& fn = views_.flattened_nodes[p.flattened_node[lane]];
+            return Hit{ result.hit.t, Vec2(result.hit.u, result.hit.v), p.flattened_node[lane], fn.primitive, p.face[lane] };
+        }
+        const auto& tr = views_.trs[views_.indices[result.index]];
+        const auto& fn = views_.flattened_nodes[tr.flattened_node];
+        return Hit{ result.hit.t, Vec2(result.hit.u, result.hit.v), tr.flattened_node, fn.primitive, tr.face };
+    }
+
+    // The instances are the flattened primitive nodes
+    virtual Transform instance_transform(int instance) const override {
+        return views_.flattened_nodes[instance].global_transform;
+    }
+
+    // Number of the instances
+    int num_instances() const {
+        return int(views_.flattened_nodes.size());
+    }
+
+    virtual bool occluded(Ray ray, Float tmin, Float tmax) const override {
+        return traverse<true>(ray, tmin, tmax).index >= 0;
+    }
+
+    virtual bool count_traversal(Ray ray, Float tmin, Float tmax, TraversalCounts& counts) const override {
+        traverse<false>(ray, tmin, tmax, StepCounter{ counts });
+        return true;
+    }
+
+    virtual bool set_alpha_test(const std::vector<bool>& masked, const AlphaTestFunc& alpha_test) override {
+        alpha_masked_.clear();
+        alpha_test_ = {};
+        bool any = false;
+        std::vector<char> flags(views_.flattened_nodes.size(), 0);
+        for (size_t i = 0; i < flags.size(); i++) {
+            const int primitive = views_.flattened_nodes[i].primitive;
+            flags[i] = primitive < int(masked.size()) && masked[primitive];
+            any |= bool(flags[i]);
+        }
+        if (any) {
+            alpha_masked_ = std::move(flags);
+            alpha_test_ = alpha_test;
+        }
+        return true;
+    }
+
+    virtual Json underlying_value(const std::string& query) const override {
+        if (query == "structure") {
+            return structure();
+        }
+        return {};
+    }
+
+    // Arrays referred by the views, including the memory-mapped arrays
+    virtual size_t memory_usage() const override {
+        const auto bytes = [](const auto& view) {
+            return view.size() * sizeof(view[0]);
+        };
+        return bytes(views_.nodes) + bytes(views_.nodes4) + bytes(views_.nodes8)
+            + bytes(views_.trs) + bytes(views_.packs) + bytes(views_.indices)
+            + bytes(views_.flattened_nodes) + bytes(views_.qnodes4) + bytes(views_.qnodes8)
+            + bytes(views_.cpacks);
+    }
+};
 
 LM_COMP_REG_IMPL(Accel_SAHBVH, "accel::sahbvh");
 
+// ------------------------------------------------------------------------------------------------
+
+// Progressive BVH. See the document of accel::sahbvhprogressive.
+class Accel_SAHBVH_Progressive final : public Accel {
+private:
+    Json prop_;                                         // Properties of the structures
+    std::unique_ptr<Accel_SAHBVH> fast_;                // Structure built by the linear builder
+    std::unique_ptr<Accel_SAHBVH> quality_;             // Structure built in the background
+    std::atomic<const Accel_SAHBVH*> active_{nullptr};  // Structure used by the queries
+    mutable std::thread thread_;                        // Thread of the background build
+    mutable std::mutex mutex_;                          // Guards the alpha test against the swap
+    std::optional<std::tuple<std::vector<bool>, AlphaTestFunc>> alpha_test_;    // Alpha test applied to the structures
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        wait();
+        fast_.reset();
+        if (!quality_) {
+            quality_ = std::make_unique<Accel_SAHBVH>();
+        }
+        quality_->serialize_(ar);
+        active_.store(quality_.get(), std::memory_order_release);
+    }
+
+public:
+    virtual ~Accel_SAHBVH_Progressive() {
+        wait();
+    }
+
+    virtual void construct(const Json& prop) override {
+        prop_ = prop;
+        if (json::value<bool>(prop, "compressed", false)) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Compressed layout is not supported by the progressive build");
+        }
+        // Check validity of the parameters
+        Accel_SAHBVH().construct(quality_prop());
+    }
+
+private:
+    // Properties of the background build
+    Json quality_prop() const {
+        auto prop = prop_;
+        prop["builder"] = json::value<std::string>(prop_, "builder", "binned");
+        return prop;
+    }
+
+    // Wait for the background build
+    void wait() const {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    const Accel_SAHBVH* active() const {
+        return active_.load(std::memory_order_acquire);
+    }
+
+public:
+    virtual void build(const Scene& scene) override {
+        wait();
+        active_.store(nullptr, std::memory_order_release);
+        const auto prims = collect_primitives(scene);
+
+        // Build the fast structure
+        auto fast_prop = prop_;
+        fast_prop["builder"] = "lbvh";
+        fast_prop["report_traversal"] = false;
+        fast_ = std::make_unique<Accel_SAHBVH>();
+        fast_->construct(fast_prop);
+        LM_INFO("Flattening scene");
+        auto vs = std::make_shared<std::vector<std::array<Vec3, 3>>>(fast_->flatten_primitives(scene, prims));
+        fast_->build_triangles(*vs);
+
+        // Start the background build sharing the flattened triangles
+        quality_ = std::make_unique<Accel_SAHBVH>();
+        quality_->construct(quality_prop());
+        quality_->trs_ = fast_->trs_;
+        quality_->flattened_nodes_ = fast_->flattened_nodes_;
+        apply_alpha_test(*fast_);
+        active_.store(fast_.get(), std::memory_order_release);
+        thread_ = std::thread([this, vs]() {
+            try {
+                exception::ScopedDisableFPEx guard_;
+                timer::ScopedTimer st;
+                quality_->build_triangles(*vs);
+                std::unique_lock<std::mutex> lock(mutex_);
+                apply_alpha_test(*quality_);
+                active_.store(quality_.get(), std::memory_order_release);
+                LM_INFO("Swapped in background structure [elapsed='{:.3f}s']", st.now());
+            }
+            catch (const std::exception& e) {
+                LM_WARN("Background build failed. Using the fast structure [error='{}']", e.what());
+            }
+        });
+    }
+
+    virtual void update(const Scene& scene) override {
+        wait();
+        if (!active()) {
+            build(scene);
+            return;
+        }
+        if (active() == quality_.get()) {
+            fast_.reset();
+            quality_->update(scene);
+        }
+        else {
+            fast_->update(scene);
+        }
+    }
+
+    virtual bool save_cache(const std::string& path) const override {
+        wait();
+        return active() && active()->save_cache(path);
+    }
+
+    virtual std::string cache_settings() const override {
+        // The cache holds the structure of the quality build
+        Accel_SAHBVH accel;
+        accel.construct(quality_prop());
+        return accel.cache_settings();
+    }
+
+    virtual bool load_cache(const std::string& path) override {
+        wait();
+        auto accel = std::make_unique<Accel_SAHBVH>();
+        accel->construct(quality_prop());
+        if (!accel->load_cache(path)) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        quality_ = std::move(accel);
+        apply_alpha_test(*quality_);
+        active_.store(quality_.get(), std::memory_order_release);
+        fast_.reset();
+        return true;
+    }
+
+private:
+    void apply_alpha_test(Accel_SAHBVH& accel) const {
+        if (alpha_test_) {
+            const auto& [masked, alpha_test] = *alpha_test_;
+            accel.set_alpha_test(masked, alpha_test);
+        }
+    }
+
+public:
+    virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
+        const auto* accel = active();
+        return accel ? accel->intersect(ray, tmin, tmax) : std::nullopt;
+    }
+
+    virtual Transform instance_transform(int instance) const override {
+        return active()->instance_transform(instance);
+    }
+
+    virtual bool occluded(Ray ray, Float tmin, Float tmax) const override {
+        const auto* accel = active();
+        return accel && accel->occluded(ray, tmin, tmax);
+    }
+
+    virtual bool count_traversal(Ray ray, Float tmin, Float tmax, TraversalCounts& counts) const override {
+        const auto* accel = active();
+        return accel && accel->count_traversal(ray, tmin, tmax, counts);
+    }
+
+    // The alpha test is applied to the background structure before the swap
+    virtual bool set_alpha_test(const std::vector<bool>& masked, const AlphaTestFunc& alpha_test) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        alpha_test_ = { masked, alpha_test };
+        if (fast_) {
+            apply_alpha_test(*fast_);
+        }
+        if (quality_ && active() == quality_.get()) {
+            apply_alpha_test(*quality_);
+        }
+        return true;
+    }
+
+    virtual Json underlying_value(const std::string& query) const override {
+        const auto* accel = active();
+        return accel ? accel->underlying_value(query) : Json{};
+    }
+
+    // Both structures are counted while the background build is running
+    virtual size_t memory_usage() const override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const auto* accel = active();
+        size_t bytes = fast_ ? fast_->memory_usage() : 0;
+        if (quality_ && accel == quality_.get()) {
+            bytes += quality_->memory_usage();
+        }
+        return bytes;
+    }
+};
+
+LM_COMP_REG_IMPL(Accel_SAHBVH_Progressive, "accel::sahbvhprogressive");
+
+// ------------------------------------------------------------------------------------------------
+
+namespace {
+
+// Instance in a level of the hierarchy.
+// An instance refers to either a bottom-level structure or a nested level.
+struct Instance {
+    Mat4 M;         // Transform of the instance
+    Mat4 inv_M;     // Inverse of M
+    bool identity;  // True if M is identity
+    int blas;       // Index of bottom-level structure. -1 if the instance refers to a level.
+    int level;      // Index of the nested level. -1 if the instance refers to a bottom-level structure.
+    int base;       // Index of the first flattened primitive of the instance in the level
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(M, inv_M, identity, blas, level, base);
+    }
+};
+
+// Node of the top-level structure of a level
+struct TopNode {
+    Bound b;        // Bound of the node
+    int s, e;       // Range of instance indices (valid only in leaf nodes)
+    int c1 = -1;    // Index to the child nodes. -1 for leaf nodes.
+    int c2 = -1;
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(b, s, e, c1, c2);
+    }
+};
+
+// Level of the instance hierarchy corresponding to an instance group.
+// Level 0 is the root of the scene.
+struct Level {
+    std::vector<Instance> instances;    // Instances
+    std::vector<TopNode> top;           // Nodes of the structure over the instances
+    std::vector<int> indices;           // Instance indices
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(instances, top, indices);
+    }
+};
+
+}
+
+// Multi-level BVH. See the document of accel::sahbvh.
+class Accel_SAHBVH_Instanced final : public Accel {
+private:
+    Json prop_;                                         // Properties for bottom-level structures
+    std::vector<std::unique_ptr<Accel_SAHBVH>> blas_;   // Bottom-level structures. Index: level index.
+    std::vector<Level> levels_;                         // Levels of the instance hierarchy
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        int n = int(blas_.size());
+        ar(n, levels_);
+        blas_.resize(n);
+        for (auto& blas : blas_) {
+            if (!blas) {
+                blas = std::make_unique<Accel_SAHBVH>();
+            }
+            blas->serialize_(ar);
+        }
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        prop_ = prop;
+        // Check validity of the parameters
+        Accel_SAHBVH().construct(prop_);
+    }
+
+    virtual void build(const Scene& scene) override {
+        exception::ScopedDisableFPEx guard_;
+
+        // Flatten the scene into levels. Each instance group is mapped to a level
+        // containing the primitives in the group and the instances of the nested instance groups.
+        // The primitives in the normal groups are flattened into the level of the closest instance group.
+        LM_INFO("Flattening scene");
+        std::vector<std::vector<PrimitiveRef>> scenes(1);                   // Primitives of the levels
+        std::vector<std::vector<std::tuple<Mat4, int>>> child_levels(1);    // Nested levels of the levels
+        std::vector<int> order;                                             // Levels in post-order
+        std::unordered_map<int, int> group_to_level;
+        std::vector<bool> in_progress(1, true);
+        using VisitFunc = std::function<void(const SceneNode&, Mat4, int)>;
+        VisitFunc visit = [&](const SceneNode& node, Mat4 global_transform, int level) {
+            if (node.type == SceneNodeType::Primitive) {
+                if (node.primitive.mesh) {
+                    scenes[level].push_back({ node.index, global_transform });
+                }
+                return;
+            }
+            if (node.type == SceneNodeType::Group) {
+                if (node.group.instanced) {
+                    // Create a level for the instance group if not available
+                    int child_level = -1;
+                    if (auto it = group_to_level.find(node.index); it != group_to_level.end()) {
+                        child_level = it->second;
+                        if (in_progress[child_level]) {
+                            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                                "Instance group contains itself [node={}]", node.index);
+                        }
+                    }
+                    else {
+                        child_level = int(scenes.size());
+                        group_to_level[node.index] = child_level;
+                        scenes.emplace_back();
+                        child_levels.emplace_back();
+                        in_progress.push_back(true);
+                        for (int child : node.group.children) {
+                            scene.visit_node(child, [&](const SceneNode& child_node) {
+                                visit(child_node, Mat4(1_f), child_level);
+                            });
+                        }
+                        in_progress[child_level] = false;
+                        order.push_back(child_level);
+                    }
+                    child_levels[level].push_back({ global_transform, child_level });
+                    return;
+                }
+
+                // Normal group
+                Mat4 M = global_transform;
+                if (node.group.local_transform) {
+                    M *= *node.group.local_transform;
+                }
+                for (int child : node.group.children) {
+                    scene.visit_node(child, [&](const SceneNode& child_node) {
+                        visit(child_node, M, level);
+                    });
+                }
+                return;
+            }
+            LM_UNREACHABLE();
+        };
+        scene.visit_node(0, [&](const SceneNode& node) {
+            visit(node, Mat4(1_f), 0);
+        });
+        order.push_back(0);
+
+        // Build bottom-level structures
+        blas_.clear();
+        long long num_unique_triangles = 0;
+        for (int i = 0; i < int(scenes.size()); i++) {
+            LM_INFO("Building bottom-level structure [index={}, primitives={}]", i, scenes[i].size());
+            LM_INDENT();
+            auto blas = std::make_unique<Accel_SAHBVH>();
+            blas->construct(prop_);
+            blas->build_primitives(scene, scenes[i]);
+            num_unique_triangles += blas->num_triangles();
+            blas_.push_back(std::move(blas));
+        }
+
+        // Create instances and build the structure of each level from the innermost ones.
+        // The primitives in the level are handled as an instance with identity transform.
+        // Empty levels are not instanced.
+        // The flattened primitives of the instances are numbered consecutively in each level,
+        // which gives the instance indices of the hits without storing the flattened scene.
+        levels_.assign(scenes.size(), {});
+        std::vector<long long> num_level_triangles(scenes.size(), 0);
+        std::vector<int> num_level_primitives(scenes.size(), 0);
+        long long num_instances = 0;
+        for (int l : order) {
+            auto& level = levels_[l];
+            if (blas_[l]->num_triangles() > 0) {
+                level.instances.push_back({ Mat4(1_f), Mat4(1_f), true, l, -1, 0 });
+                num_level_triangles[l] += blas_[l]->num_triangles();
+                num_level_primitives[l] += blas_[l]->num_instances();
+            }
+            for (const auto& [M, child] : child_levels[l]) {
+                if (levels_[child].instances.empty()) {
+                    continue;
+                }
+                level.instances.push_back({ M, glm::inverse(M), false, -1, child, num_level_primitives[l] });
+                num_level_triangles[l] += num_level_triangles[child];
+                num_level_primitives[l] += num_level_primitives[child];
+            }
+            num_instances += (long long)(level.instances.size());
+            build_top(level);
+        }
+
+        LM_INFO("Finished building [levels={}, instances={}, unique_triangles={}, instanced_triangles={}]",
+            levels_.size(), num_instances, num_unique_triangles, num_level_triangles[0]);
+    }
+
+private:
+    // Bound of a level in its local coordinates
+    Bound level_bound(int l) const {
+        const auto& top = levels_[l].top;
+        return top.empty() ? Bound() : top[0].b;
+    }
+
+    // Bound of an instance in the coordinates of the level containing the instance
+    Bound instance_bound(const Instance& inst) const {
+        const auto b = inst.level < 0 ? blas_[inst.blas]->bound() : level_bound(inst.level);
+        if (inst.identity) {
+            return b;
+        }
+        Bound wb;
+        for (int i = 0; i < 8; i++) {
+            const Vec3 p(
+                (i & 1) ? b.max.x : b.min.x,
+                (i & 2) ? b.max.y : b.min.y,
+                (i & 4) ? b.max.z : b.min.z);
+            wb = merge(wb, Vec3(inst.M * Vec4(p, 1_f)));
+        }
+        return wb;
+    }
+
+    // Build the structure of a level by splitting at the median of the centroids along the largest axis.
+    // The nested levels must be built beforehand.
+    void build_top(Level& level) const {
+        auto& top = level.top;
+        auto& indices = level.indices;
+        top.clear();
+        const int ni = int(level.instances.size());
+        indices.assign(ni, 0);
+        std::iota(indices.begin(), indices.end(), 0);
+        if (ni == 0) {
+            return;
+        }
+        std::vector<Bound> bs(ni);
+        for (int i = 0; i < ni; i++) {
+            bs[i] = instance_bound(level.instances[i]);
+        }
+        std::function<int(int, int)> process = [&](int s, int e) -> int {
+            const int index = int(top.size());
+            top.emplace_back();
+            Bound b, cb;
+            for (int i = s; i < e; i++) {
+                b = merge(b, bs[indices[i]]);
+                cb = merge(cb, bs[indices[i]].center());
+            }
+            top[index].b = b;
+            top[index].s = s;
+            top[index].e = e;
+            if (e - s <= 2) {
+                return index;
+            }
+            const auto d = cb.max - cb.min;
+            const int axis = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+            const int mid = (s + e) / 2;
+            std::nth_element(&indices[s], &indices[mid], &indices[e-1]+1, [&](int i1, int i2) {
+                return bs[i1].center()[axis] < bs[i2].center()[axis];
+            });
+            const int c1 = process(s, mid);
+            const int c2 = process(mid, e);
+            top[index].c1 = c1;
+            top[index].c2 = c2;
+            return index;
+        };
+        process(0, ni);
+    }
+
+    // Traverse the structure of a level.
+    // Calls the function for the instances intersecting with the ray.
+    // The function can shrink tmax and returns true to terminate the traversal.
+    template <typename InstanceFunc>
+    void traverse_top(const Level& level, Ray ray, Float tmin, Float tmax, const InstanceFunc& func) const {
+        if (level.top.empty()) {
+            return;
+        }
+        int s[128];
+        int si = 0;
+        s[si++] = 0;
+        while (si > 0) {
+            const auto& n = level.top[s[--si]];
+            if (!n.b.isect(ray, tmin, tmax)) {
+                continue;
+            }
+            if (n.c1 >= 0) {
+                s[si++] = n.c1;
+                s[si++] = n.c2;
+                continue;
+            }
+            for (int i = n.s; i < n.e; i++) {
+                if (func(level.instances[level.indices[i]], tmax)) {
+                    return;
+                }
+            }
+        }
+    }
+
+    // Transform the ray to the local coordinates of the instance
+    static Ray local_ray(const Instance& inst, Ray ray) {
+        if (inst.identity) {
+            return ray;
+        }
+        return { Vec3(inst.inv_M * Vec4(ray.o, 1_f)), Vec3(inst.inv_M * Vec4(ray.d, 0_f)) };
+    }
+
+    // Intersection with the level in its local coordinates.
+    // The distance is preserved in the nested levels because the direction is not normalized.
+    std::optional<Hit> intersect_level(int l, Ray ray, Float tmin, Float tmax) const {
+        std::optional<Hit> hit;
+        const Instance* hit_inst = nullptr;
+        traverse_top(levels_[l], ray, tmin, tmax, [&](const Instance& inst, Float& tmax_) -> bool {
+            const auto r = local_ray(inst, ray);
+            const auto h = inst.level < 0
+                ? blas_[inst.blas]->intersect(r, tmin, tmax_)
+                : intersect_level(inst.level, r, tmin, tmax_);
+            if (h) {
+                hit = h;
+                hit_inst = &inst;
+                tmax_ = h->t;
+            }
+            return false;
+        });
+        if (hit) {
+            hit->instance += hit_inst->base;
+        }
+        return hit;
+    }
+
+    // Occlusion with the level in its local coordinates
+    bool occluded_level(int l, Ray ray, Float tmin, Float tmax) const {
+        bool occluded = false;
+        traverse_top(levels_[l], ray, tmin, tmax, [&](const Instance& inst, Float&) -> bool {
+            const auto r = local_ray(inst, ray);
+            occluded = inst.level < 0
+                ? blas_[inst.blas]->occluded(r, tmin, tmax)
+                : occluded_level(inst.level, r, tmin, tmax);
+            return occluded;
+        });
+        return occluded;
+    }
+
+public:
+    virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
+        exception::ScopedDisableFPEx guard_;
+        if (levels_.empty()) {
+            return {};
+        }
+        return intersect_level(0, ray, tmin, tmax);
+    }
+
+    virtual bool occluded(Ray ray, Float tmin, Float tmax) const override {
+        exception::ScopedDisableFPEx guard_;
+        if (levels_.empty()) {
+            return false;
+        }
+        return occluded_level(0, ray, tmin, tmax);
+    }
+
+    // Accumulate the transforms of the instances containing the flattened primitive from the root level
+    virtual Transform instance_transform(int instance) const override {
+        Mat4 M(1_f);
+        int l = 0;
+        while (true) {
+            const auto& instances = levels_[l].instances;
+            const auto it = std::upper_bound(instances.begin(), instances.end(), instance,
+                [](int i, const Instance& inst) { return i < inst.base; });
+            const auto& inst = *std::prev(it);
+            instance -= inst.base;
+            if (!inst.identity) {
+                M *= inst.M;
+            }
+            if (inst.level < 0) {
+                return Transform(M * blas_[inst.blas]->instance_transform(instance).M);
+            }
+            l = inst.level;
+        }
+    }
+
+    virtual bool set_alpha_test(const std::vector<bool>& masked, const AlphaTestFunc& alpha_test) override {
+        for (auto& blas : blas_) {
+            blas->set_alpha_test(masked, alpha_test);
+        }
+        return true;
+    }
+
+    // The bottom-level structures are not exposed as underlying components
+    virtual size_t memory_usage() const override {
+        auto bytes = comp::bytes_of(levels_);
+        for (const auto& level : levels_) {
+            bytes += comp::bytes_of(level.instances, level.top, level.indices);
+        }
+        for (const auto& blas : blas_) {
+            bytes += blas->memory_usage();
+        }
+        return bytes;
+    }
+};
+
+LM_COMP_REG_IMPL(Accel_SAHBVH_Instanced, "accel::sahbvhinstanced");
+
 LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,98 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include <lm/core.h>
+#include <lm/serial.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+// Read-only view of an array stored in a vector or a memory-mapped file
+template <typename T>
+struct ArrayView {
+    const T* p = nullptr;
+    size_t n = 0;
+
+    ArrayView() = default;
+    ArrayView(const std::vector<T>& v) : p(v.data()), n(v.size()) {}
+    ArrayView(const T* p, size_t n) : p(p), n(n) {}
+    const T& operator[](size_t i) const { return p[i]; }
+    size_t size() const { return n; }
+    std::vector<T> copy() const { return std::vector<T>(p, p + n); }
+};
+
+// Read-only array loaded from a snapshot without copy.
+// The elements refer either to the owned vector or to the blob of the memory-mapped snapshot,
+// so that the processes loading the same snapshot file share the physical pages of the array.
+// The array is serialized in the same format as std::vector<T>.
+template <typename T>
+class SharedArray {
+private:
+    std::vector<T> v_;                      // Owned elements. Empty if the array refers to a blob.
+    ArrayView<T> view_;                     // Elements
+    std::shared_ptr<const void> mapped_;    // Memory-mapped snapshot
+
+public:
+    SharedArray() = default;
+    SharedArray(std::vector<T>&& v) : v_(std::move(v)), view_(v_) {}
+    SharedArray(const SharedArray& o) : v_(o.view_.copy()), view_(v_) {}
+    SharedArray(SharedArray&& o) noexcept = default;
+    SharedArray& operator=(const SharedArray& o) {
+        if (this != &o) {
+            v_ = o.view_.copy();
+            view_ = v_;
+            mapped_.reset();
+        }
+        return *this;
+    }
+    SharedArray& operator=(SharedArray&& o) noexcept = default;
+    SharedArray& operator=(std::vector<T>&& v) {
+        v_ = std::move(v);
+        view_ = v_;
+        mapped_.reset();
+        return *this;
+    }
+
+public:
+    template <typename Archive>
+    void save(Archive& ar) const {
+        if (mapped_) {
+            ar(view_.copy());
+        }
+        else {
+            ar(v_);
+        }
+    }
+
+    template <typename Archive>
+    void load(Archive& ar) {
+        mapped_.reset();
+        if constexpr (std::is_same_v<Archive, InputArchive>) {
+            if (ar.use_blobs()) {
+                size_t n;
+                const auto* p = serial::load_view(ar, v_, n);
+                view_ = { p, n };
+                if (v_.empty() && n > 0) {
+                    mapped_ = ar.blobs_owner();
+                }
+                return;
+            }
+        }
+        ar(v_);
+        view_ = v_;
+    }
+
+public:
+    const T& operator[](size_t i) const { return view_[i]; }
+    const T* data() const { return view_.p; }
+    size_t size() const { return view_.n; }
+    bool empty() const { return view_.n == 0; }
+
+    // Owned elements, used to measure the memory owned by the process
+    const std::vector<T>& owned() const { return v_; }
+};
+
+LM_NAMESPACE_END(LM_NAMESPACE)
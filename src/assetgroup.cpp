@@ -6,22 +6,64 @@
 #include <pch.h>
 #include <lm/core.h>
 #include <lm/assetgroup.h>
+#include <lm/parallel.h>
+#include <lm/trace.h>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
+/*
+\rst
+.. function:: asset_group::default
+
+    Default asset group.
+
+    :param bool lazy: Defer the construction of the assets until the first access. Default value: false.
+
+    With ``lazy`` enabled, :cpp:func:`lm::AssetGroup::load_asset` only creates the instance
+    and the asset is constructed when it is first resolved by the locator,
+    e.g., when it is referenced by other assets or the scene via :cpp:func:`lm::json::comp_ref`.
+    The assets never referenced, e.g., unused level-of-detail variants, are never loaded.
+    The pending assets are constructed before the group is serialized.
+    Note that the pointer returned by :cpp:func:`lm::AssetGroup::load_asset`
+    refers to the instance not yet constructed.
+    Use :cpp:func:`lm::comp::get` with the locator to access the asset directly.
+    The construction is not thread-safe, thus the assets must be resolved
+    from a single thread, which is the case for the scene setup.
+    The components created inside an asset, e.g., the meshes of ``model::wavefrontobj``
+    and ``model::pbrt``, are constructed with the asset because the scene nodes
+    refer to them directly instead of by the locators.
+\endrst
+*/
 class AssetGroup_ final : public AssetGroup {
 private:
     std::vector<Ptr<Component>> assets_;
     std::unordered_map<std::string, int> asset_index_map_;
+    bool lazy_ = false;
+
+    // Properties of the assets whose construction is deferred. Index: asset index.
+    mutable std::unordered_map<int, Json> pending_;
+
+    // Locators of the replaced assets. The size is the revision of the group.
+    std::vector<std::string> replaced_;
 
 public:
-    LM_SERIALIZE_IMPL(ar) {
-        ar(asset_index_map_, assets_);
+    virtual void load(InputArchive& ar) override {
+        ar(asset_index_map_, assets_, lazy_);
+    }
+
+    virtual void save(OutputArchive& ar) override {
+        // Pending assets have no state to be serialized
+        construct_pending();
+        ar(asset_index_map_, assets_, lazy_);
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visitor) override {
-        for (auto& asset : assets_) {
-            comp::visit(visitor, asset);
+        for (int i = 0; i < int(assets_.size()); i++) {
+            // Pending assets have no reference to other components
+            if (pending_.find(i) != pending_.end()) {
+                continue;
+            }
+            comp::visit(visitor, assets_[i]);
         }
     }
 
@@ -31,9 +73,14 @@ public:
             LM_ERROR("Invalid asset name [name='{}']", name);
             return nullptr;
         }
+        construct_pending(name, it->second);
         return assets_.at(it->second).get();
     }
 
+    virtual void construct(const Json& prop) override {
+        lazy_ = json::value<bool>(prop, "lazy", false);
+    }
+
 private:
     bool valid_asset_name(const std::string& name) const {
         std::regex regex(R"x([:\w_-]+)x");
@@ -41,10 +88,35 @@ private:
         return std::regex_match(name, match, regex);
     }
 
+    // Construct the asset if the construction is deferred
+    void construct_pending(const std::string& name, int index) const {
+        auto it = pending_.find(index);
+        if (it == pending_.end()) {
+            return;
+        }
+        LM_INFO("Constructing deferred asset [name='{}']", name);
+        LM_INDENT();
+        mark_dirty();
+        LM_TRACE_SCOPE("load_asset " + name);
+        // Remove from the pending list before construction
+        // because the asset might be accessed by underlying() while initialization.
+        const auto prop = std::move(it->second);
+        pending_.erase(it);
+        assets_[index]->construct(prop);
+    }
+
+    // Construct all pending assets
+    void construct_pending() const {
+        for (const auto& [name, index] : asset_index_map_) {
+            construct_pending(name, index);
+        }
+    }
+
 public:
     virtual Component* load_asset(const std::string& name, const std::string& impl_key, const Json& prop) override {
         LM_INFO("Loading asset [name='{}']", name);
         LM_INDENT();
+        LM_TRACE_SCOPE("load_asset " + name);
 
         // Check if asset name is valid
         if (!valid_asset_name(name)) {
@@ -65,6 +137,7 @@ public:
             LM_ERROR("Failed to create an asset [name='{}', key='{}']", name, impl_key);
             return nullptr;
         }
+        mark_dirty();
 
         // Register created asset
         // Note that the registration must happen before construct() because
@@ -77,12 +150,17 @@ public:
             auto old = std::move(assets_[it->second]);
 
             // Replace the existing instance
+            pending_.erase(it->second);
             assets_[it->second] = std::move(p);
             asset = assets_[it->second].get();
 
+            // The cached locators still refer to the old instance
+            comp::detail::invalidate_locator_cache();
+
             // Initialize the asset
             // This might cause an exception
             asset->construct(prop);
+            replaced_.push_back(asset->loc());
 
             // Notify to update the weak references in the object tree
             const Component::ComponentVisitor visitor = [&](Component*& comp, bool weak) {
@@ -104,20 +182,174 @@ public:
         }
         else {
             // Register as a new asset
-            asset_index_map_[name] = int(assets_.size());
+            const int index = int(assets_.size());
+            asset_index_map_[name] = index;
             assets_.push_back(std::move(p));
             asset = assets_.back().get();
 
-            // Initialize the asset
-            asset->construct(prop);
+            // Initialize the asset, or defer it until the first access.
+            // A replaced asset is always constructed immediately
+            // since the weak references to the asset are resolved soon after.
+            if (lazy_) {
+                pending_[index] = prop;
+            }
+            else {
+                asset->construct(prop);
+            }
         }
 
         return asset;
     }
 
+    virtual std::vector<Component*> load_assets(const Json& assets) override {
+        LM_INFO("Loading assets [count={}]", assets.size());
+        LM_INDENT();
+        LM_TRACE_SCOPE("load_assets");
+
+        // Deferred or replaced assets are loaded one after another.
+        // Replacing an asset updates the references in the whole object tree,
+        // which can not be done concurrently.
+        const bool sequential = lazy_ || std::any_of(assets.begin(), assets.end(), [&](const Json& a) {
+            return asset_index_map_.find(a.at("name").get<std::string>()) != asset_index_map_.end();
+        });
+        if (sequential) {
+            return AssetGroup::load_assets(assets);
+        }
+
+        // Create and register the instances in the calling thread.
+        // The construction of an asset can refer to the others by underlying(),
+        // so all assets must be registered before the construction.
+        struct Node {
+            std::string name;
+            Json prop;
+            Component* asset = nullptr;
+            int level = -1;             // Construction order. -1 if not visited yet.
+            std::vector<int> deps;      // Indices of the referenced assets in the array
+        };
+        const int n = int(assets.size());
+        std::vector<Node> nodes(n);
+        std::unordered_map<std::string, int> node_index_map;
+        for (int i = 0; i < n; i++) {
+            const auto& a = assets[i];
+            auto& node = nodes[i];
+            node.name = a.at("name").get<std::string>();
+            node.prop = a.value("prop", Json::object());
+            if (!valid_asset_name(node.name) || node_index_map.find(node.name) != node_index_map.end()) {
+                LM_ERROR("Invalid asset name [name='{}']", node.name);
+                continue;
+            }
+            const auto impl_key = a.at("impl_key").get<std::string>();
+            auto p = comp::create_without_construct<Component>(impl_key, make_loc(loc(), node.name));
+            if (!p) {
+                LM_ERROR("Failed to create an asset [name='{}', key='{}']", node.name, impl_key);
+                continue;
+            }
+            node_index_map[node.name] = i;
+            asset_index_map_[node.name] = int(assets_.size());
+            assets_.push_back(std::move(p));
+            node.asset = assets_.back().get();
+        }
+
+        // Collect the dependencies from the locators in the properties
+        // referring to the assets in the array (or their underlying components)
+        const auto prefix = loc() + ".";
+        for (auto& node : nodes) {
+            std::function<void(const Json&)> collect = [&](const Json& j) {
+                if (j.is_structured()) {
+                    for (const auto& e : j) {
+                        collect(e);
+                    }
+                    return;
+                }
+                if (!j.is_string()) {
+                    return;
+                }
+                const auto& s = j.get_ref<const std::string&>();
+                if (s.rfind(prefix, 0) != 0) {
+                    return;
+                }
+                const auto name = s.substr(prefix.size(), s.find('.', prefix.size()) - prefix.size());
+                if (auto it = node_index_map.find(name); it != node_index_map.end() && nodes[it->second].name != node.name) {
+                    node.deps.push_back(it->second);
+                }
+            };
+            collect(node.prop);
+        }
+
+        // Assign the construction levels so that an asset is constructed
+        // after all assets it refers to. The assets in the same level are independent.
+        int num_levels = 0;
+        std::function<int(int)> level = [&](int i) -> int {
+            auto& node = nodes[i];
+            if (node.level == -2) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument,
+                    "Cyclic reference between assets [name='{}']", node.name);
+            }
+            if (node.level >= 0) {
+                return node.level;
+            }
+            node.level = -2;
+            int l = 0;
+            for (int d : node.deps) {
+                l = std::max(l, level(d) + 1);
+            }
+            node.level = l;
+            num_levels = std::max(num_levels, l + 1);
+            return l;
+        };
+        for (int i = 0; i < n; i++) {
+            level(i);
+        }
+
+        // Construct the assets of each level in parallel
+        for (int l = 0; l < num_levels; l++) {
+            std::vector<int> indices;
+            for (int i = 0; i < n; i++) {
+                if (nodes[i].asset && nodes[i].level == l) {
+                    indices.push_back(i);
+                }
+            }
+            // Exceptions must not escape from the parallel loop
+            std::vector<std::exception_ptr> errors(indices.size());
+            parallel::foreach((long long)(indices.size()), [&](long long index, int) {
+                const auto& node = nodes[indices[index]];
+                try {
+                    LM_TRACE_SCOPE("load_asset " + node.name);
+                    node.asset->construct(node.prop);
+                }
+                catch (...) {
+                    errors[index] = std::current_exception();
+                }
+            }, [](long long) {});
+            for (const auto& e : errors) {
+                if (e) {
+                    std::rethrow_exception(e);
+                }
+            }
+        }
+
+        std::vector<Component*> ps;
+        for (const auto& node : nodes) {
+            ps.push_back(node.asset);
+        }
+        return ps;
+    }
+
+    virtual int revision() const override {
+        return int(replaced_.size());
+    }
+
+    virtual std::vector<std::string> replaced_since(int revision) const override {
+        if (revision < 0 || revision >= int(replaced_.size())) {
+            return {};
+        }
+        return { replaced_.begin() + revision, replaced_.end() };
+    }
+
     virtual Component* load_serialized(const std::string& name, const std::string& path) override {
         LM_INFO("Loading serialized asset [name='{}']", name);
         LM_INDENT();
+        LM_TRACE_SCOPE("load_serialized " + name);
 
         if (asset_index_map_.find(name) != asset_index_map_.end()) {
             LM_THROW_EXCEPTION(Error::InvalidArgument,
@@ -127,6 +359,7 @@ public:
         // Register the asset
         // This must happen before deserialization because
         // the loading process might refer to the underlying component via locator.
+        mark_dirty();
         asset_index_map_[name] = int(assets_.size());
         assets_.emplace_back();
      
@@ -57,9 +57,12 @@ private:
 
     Float aspect_;      // Aspect raio (height / width)
 
+    Vec3 s0_;           // Unnormalized direction to the raster position (0,0)
+    Vec3 sx_, sy_;      // Changes of the unnormalized direction per unit raster position
+
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(position_, center_, up_, u_, v_, w_, vfov_, tf_, aspect_);
+        ar(position_, center_, up_, u_, v_, w_, vfov_, tf_, aspect_, s0_, sx_, sy_);
     }
 
 public:
@@ -94,9 +97,17 @@ public:
         vfov_ = json::value<Float>(prop, "vfov");        // Vertical FoV
         tf_ = tan(vfov_ * Pi / 180_f * .5_f);            // Precompute half of screen height
         aspect_ = json::value<Float>(prop, "aspect");
+        update_screen();
     }
 
 private:
+    // Precompute the directions to the screen in world space
+    void update_screen() {
+        sx_ = u_ * (2_f * aspect_ * tf_);
+        sy_ = v_ * (2_f * tf_);
+        s0_ = -w_ - u_ * (aspect_ * tf_) - v_ * tf_;
+    }
+
     // Compute Jacobian
     // TODO. Add derivation in documentataion
     Float J(Vec3 wo) const {
@@ -110,7 +121,9 @@ private:
 
 public:
     virtual void set_aspect_ratio(Float aspect) override {
+        mark_dirty();
         aspect_ = aspect;
+        update_screen();
     }
 
     // --------------------------------------------------------------------------------------------
@@ -126,9 +139,21 @@ public:
     // --------------------------------------------------------------------------------------------
 
     virtual Ray primary_ray(Vec2 rp) const override {
+        return { position_, glm::normalize(s0_ + sx_ * rp.x + sy_ * rp.y) };
+    }
+
+    virtual void primary_rays(int n, const Vec2* rps, const Vec2*, Ray* rays) const override {
+        for (int i = 0; i < n; i++) {
+            rays[i] = { position_, glm::normalize(s0_ + sx_ * rps[i].x + sy_ * rps[i].y) };
+        }
+    }
+
+    virtual RayCone primary_ray_cone(Vec2 rp, Vec2 pixel_size) const override {
+        // Pixel size on the screen at 1 unit forward divided by the distance to the pixel
         rp = 2_f*rp - 1_f;
-        const auto d = glm::normalize(Vec3(aspect_*tf_*rp.x, tf_*rp.y, -1_f));
-        return { position_, u_*d.x + v_ * d.y + w_ * d.z };
+        const auto d = Vec3(aspect_*tf_*rp.x, tf_*rp.y, -1_f);
+        const auto s = 2_f*tf_*std::max(aspect_*pixel_size.x, pixel_size.y);
+        return { 0_f, s / glm::length(d) };
     }
 
     virtual std::optional<RaySample> sample_ray(const RaySampleU& u) const override {
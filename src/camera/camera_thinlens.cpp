@@ -0,0 +1,286 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/camera.h>
+#include <lm/film.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: camera::thinlens
+
+   Thin lens camera.
+
+   :param vec3 position: Position of the center of the lens.
+   :param vec3 center: Look-at position.
+   :param vec3 up: Up vector.
+   :param float vfov: Vertical field of view.
+   :param aspect: Aspect ratio (height / width).
+   :param float lens_radius: Radius of the lens. Default is 0.
+   :param float focus_distance: Distance from the lens to the plane in focus.
+                                Default is the distance between ``position`` and ``center``.
+
+   This component implements the thin lens model, which reproduces depth of field.
+   The configuration of the camera is the same as ``camera::pinhole``.
+   The origins of the primary rays are uniformly sampled on the disk of the lens
+   perpendicular to the viewing direction,
+   and the rays of a raster position converge at the point on the plane in focus
+   where the ray of the pinhole camera for the raster position reaches.
+   With ``lens_radius`` of 0, the camera is equivalent to ``camera::pinhole``.
+
+   :cpp:func:`lm::Camera::primary_ray` generates the ray from the center of the lens.
+   Since a point on the lens is not reachable by the rays from the scene,
+   the camera is not connectable with a finite ``lens_radius``,
+   that is, the light tracing strategies connecting to the camera are disabled.
+\endrst
+*/
+class Camera_Thinlens final : public Camera {
+private:
+    Vec3 position_;         // Position of the center of the lens
+    Vec3 center_;           // Lookat position
+    Vec3 up_;               // Up vector
+
+    Vec3 u_, v_, w_;        // Basis for camera coordinates
+    Float vfov_;            // Vertical field of view
+    Float tf_;              // Half of the screen height at 1 unit forward from the position
+    Float aspect_;          // Aspect raio (height / width)
+    Float lens_radius_;     // Radius of the lens
+    Float focus_distance_;  // Distance to the plane in focus
+
+    Vec3 s0_;               // Unnormalized direction to the raster position (0,0) at 1 unit forward
+    Vec3 sx_, sy_;          // Changes of the unnormalized direction per unit raster position
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(position_, center_, up_, u_, v_, w_, vfov_, tf_, aspect_, lens_radius_, focus_distance_, s0_, sx_, sy_);
+    }
+
+public:
+    virtual Json underlying_value(const std::string&) const override {
+        return {
+            {"eye", position_},
+            {"center", center_},
+            {"up", up_},
+            {"vfov", vfov_},
+            {"aspect", aspect_},
+            {"lens_radius", lens_radius_},
+            {"focus_distance", focus_distance_}
+        };
+    }
+
+    virtual void construct(const Json& prop) override {
+        position_ = json::value<Vec3>(prop, "position");
+        center_ = json::value<Vec3>(prop, "center");
+        up_ = json::value<Vec3>(prop, "up");
+        w_ = glm::normalize(position_ - center_);
+        u_ = glm::normalize(glm::cross(up_, w_));
+        v_ = cross(w_, u_);
+        vfov_ = json::value<Float>(prop, "vfov");
+        tf_ = tan(vfov_ * Pi / 180_f * .5_f);
+        aspect_ = json::value<Float>(prop, "aspect");
+        lens_radius_ = json::value<Float>(prop, "lens_radius", 0_f);
+        focus_distance_ = json::value<Float>(prop, "focus_distance", glm::length(position_ - center_));
+        if (lens_radius_ < 0_f || focus_distance_ <= 0_f) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid lens configuration [lens_radius='{}', focus_distance='{}']", lens_radius_, focus_distance_);
+        }
+        update_screen();
+    }
+
+private:
+    // Precompute the directions to the screen in world space
+    void update_screen() {
+        sx_ = u_ * (2_f * aspect_ * tf_);
+        sy_ = v_ * (2_f * tf_);
+        s0_ = -w_ - u_ * (aspect_ * tf_) - v_ * tf_;
+    }
+
+    // Sample a position on the lens
+    Vec3 lens_position(Vec2 up) const {
+        const auto l = math::sample_uniform_disk(up) * lens_radius_;
+        return position_ + u_ * l.x + v_ * l.y;
+    }
+
+    // Point in focus corresponding to the raster position
+    Vec3 focus_point(Vec2 rp) const {
+        return position_ + (s0_ + sx_ * rp.x + sy_ * rp.y) * focus_distance_;
+    }
+
+    // Compute Jacobian.
+    // The density of the directions from any point on the lens is the same as the pinhole camera
+    // because the rays converge at the points on the plane in focus.
+    Float J(Vec3 wo) const {
+        const Float cos_theta = -glm::dot(wo, w_);
+        const Float inv_cos_theta = 1_f / cos_theta;
+        const Float A = tf_ * tf_ * aspect_ * 4_f;
+        return inv_cos_theta * inv_cos_theta * inv_cos_theta / A;
+    }
+
+public:
+    virtual void set_aspect_ratio(Float aspect) override {
+        mark_dirty();
+        aspect_ = aspect;
+        update_screen();
+    }
+
+    // --------------------------------------------------------------------------------------------
+
+    virtual Mat4 view_matrix() const override {
+        return glm::lookAt(position_, position_ - w_, up_);
+    }
+
+    virtual Mat4 projection_matrix() const override {
+        return glm::perspective(glm::radians(vfov_), aspect_, 0.01_f, 10000_f);
+    }
+
+    // --------------------------------------------------------------------------------------------
+
+    virtual Ray primary_ray(Vec2 rp) const override {
+        return { position_, glm::normalize(s0_ + sx_ * rp.x + sy_ * rp.y) };
+    }
+
+    virtual void primary_rays(int n, const Vec2* rps, const Vec2* ups, Ray* rays) const override {
+        if (!ups || lens_radius_ == 0_f) {
+            for (int i = 0; i < n; i++) {
+                rays[i] = { position_, glm::normalize(s0_ + sx_ * rps[i].x + sy_ * rps[i].y) };
+            }
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            const auto o = lens_position(ups[i]);
+            rays[i] = { o, glm::normalize(focus_point(rps[i]) - o) };
+        }
+    }
+
+    virtual RayCone primary_ray_cone(Vec2 rp, Vec2 pixel_size) const override {
+        // Pixel size on the screen at 1 unit forward divided by the distance to the pixel
+        const auto d = s0_ + sx_ * rp.x + sy_ * rp.y;
+        const auto s = 2_f*tf_*std::max(aspect_*pixel_size.x, pixel_size.y);
+        return { 0_f, s / glm::length(d) };
+    }
+
+    virtual std::optional<RaySample> sample_ray(const RaySampleU& u) const override {
+        const auto o = lens_position(u.up);
+        return RaySample{
+            PointGeometry::make_degenerated(o),
+            glm::normalize(focus_point(u.ud) - o),
+            Vec3(1_f)
+        };
+    }
+
+    virtual Float pdf_ray(const PointGeometry& geom, Vec3 wo) const override {
+        const auto pD = pdf_direction(geom, wo);
+        const auto pA = pdf_position(geom);
+        return pD * pA;
+    }
+
+    // --------------------------------------------------------------------------------------------
+
+    virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& u, const PointGeometry& geom) const override {
+        return DirectionSample{
+            glm::normalize(focus_point(u.ud) - geom.p),
+            Vec3(1_f)
+        };
+    }
+
+    virtual Float pdf_direction(const PointGeometry& geom, Vec3 wo) const override {
+        // Given directions is not samplable if raster position is not in [0,1]^2
+        if (!raster_position_from(geom, wo)) {
+            return 0_f;
+        }
+        return J(wo);
+    }
+
+    virtual std::optional<PositionSample> sample_position(const PositionSampleU& u) const override {
+        return PositionSample{
+            PointGeometry::make_degenerated(lens_position(u.udp)),
+            Vec3(1_f)
+        };
+    }
+
+    virtual Float pdf_position(const PointGeometry&) const override {
+        return lens_radius_ > 0_f ? 1_f / (Pi * lens_radius_ * lens_radius_) : 1_f;
+    }
+
+    // --------------------------------------------------------------------------------------------
+
+    virtual std::optional<RaySample> sample_direct(const RaySampleU&, const PointGeometry& geom) const override {
+        if (geom.infinite || lens_radius_ > 0_f) {
+            // Direct connection from the infinitely-distant point or to the lens
+            return {};
+        }
+        const auto geomE = PointGeometry::make_degenerated(position_);
+        const auto wo = glm::normalize(geom.p - position_);
+        const auto We = Vec3(J(wo));
+        const auto p = pdf_direct(geom, geomE, wo);
+        if (p == 0_f) {
+            return {};
+        }
+        return RaySample{
+            geomE,
+            wo,
+            We / p
+        };
+    }
+
+    virtual Float pdf_direct(const PointGeometry& geom, const PointGeometry& geomE, Vec3) const override {
+        if (geom.infinite || lens_radius_ > 0_f) {
+            return 0_f;
+        }
+        const auto G = surface::geometry_term(geom, geomE);
+        return G == 0_f ? 0_f : 1_f / G;
+    }
+
+    // --------------------------------------------------------------------------------------------
+
+    virtual std::optional<Vec2> raster_position(Vec3 wo) const override {
+        // Convert to camera space
+        const auto to_eye = glm::transpose(Mat3(u_, v_, w_));
+        const auto wo_eye = to_eye * wo;
+        if (wo_eye.z >= 0) {
+            // wo is directed to the opposition direction
+            return {};
+        }
+
+        // Calculate raster position
+        const auto rp = Vec2(
+            -wo_eye.x / wo_eye.z / tf_ / aspect_,
+            -wo_eye.y / wo_eye.z / tf_) * .5_f + .5_f;
+        if (rp.x < 0_f || rp.x > 1_f || rp.y < 0_f || rp.y > 1_f) {
+            // wo is not in the view frustum
+            return {};
+        }
+
+        return rp;
+    }
+
+    virtual std::optional<Vec2> raster_position_from(const PointGeometry& geom, Vec3 wo) const override {
+        // Point on the plane in focus seen from the center of the lens
+        const auto cos_theta = -glm::dot(wo, w_);
+        if (cos_theta <= 0_f) {
+            return {};
+        }
+        const auto q = geom.p + wo * (focus_distance_ / cos_theta);
+        return raster_position(q - position_);
+    }
+
+    virtual bool is_connectable(const PointGeometry&) const override {
+        return lens_radius_ == 0_f;
+    }
+
+    virtual Vec3 eval(Vec3 wo) const override {
+        if (!raster_position(wo)) {
+            return Vec3(0_f);
+        }
+        return Vec3(J(wo));
+    }
+};
+
+LM_COMP_REG_IMPL(Camera_Thinlens, "camera::thinlens");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -6,6 +6,8 @@
 #include <pch.h>
 #include <lm/component.h>
 #include <lm/logger.h>
+#include <lm/json.h>
+#include <staticplugins.h>
 
 #if LM_PLATFORM_WINDOWS
 #include <Windows.h>
@@ -144,15 +146,53 @@ private:
     // Loaded plugins
     std::unordered_map<std::string, std::unique_ptr<SharedLibrary>> plugins_;
 
+    // Components of the plugins not loaded yet, registered by the manifests
+    struct LazyEntry {
+        std::string path;   // Path to the plugin
+        bool alias;         // True if the entry is an alias
+    };
+    std::unordered_map<std::string, LazyEntry> lazy_;   // Key or alias -> Entry
+
+    // Components registered while loading a plugin to write the manifest
+    std::vector<std::pair<std::string, std::string>>* recording_ = nullptr;
+
+    // Plugins linked statically into liblm.
+    // The components of the plugins are registered on loading liblm.
+    const std::unordered_set<std::string> static_plugins_{ LM_STATIC_PLUGINS };
+
     // Root component
     Component* root_ = nullptr;
 
+    // Cache of the components resolved by the locators.
+    // The entries are added for each prefix of the resolved locators,
+    // so that resolving a new locator only requires to query its last element.
+    // The entries referring to each component are recorded to invalidate them on destruction.
+    std::mutex cache_mutex_;
+    std::unordered_map<std::string, Component*> cache_;
+    std::unordered_map<const Component*, std::vector<std::string>> cache_refs_;
+
+    // True while the context is alive.
+    // Components might be destroyed after the context, e.g., by the destructors of other static objects.
+    static inline std::atomic<bool> alive_{ false };
+
+    ComponentContext() {
+        alive_ = true;
+    }
+
+    ~ComponentContext() {
+        alive_ = false;
+    }
+
 public:
     static ComponentContext& instance() {
         static ComponentContext instance;
         return instance;
     }
 
+    static bool alive() {
+        return alive_;
+    }
+
 private:
     // Get plugin path according to the current configuration
     fs::path plugin_path(const std::string& p) const {
@@ -164,6 +204,11 @@ private:
         return path;
     }
 
+    // Check if the plugin is linked statically
+    bool is_static_plugin(const std::string& p) const {
+        return static_plugins_.find(fs::path(p).filename().string()) != static_plugins_.end();
+    }
+
 public:
     Component* create_comp(const std::string& key_) {
         // Find alias first
@@ -181,6 +226,12 @@ public:
         // Find registered component
         auto it = func_map_.find(key);
         if (it == func_map_.end()) {
+            // Load the plugin containing the component on first use
+            if (auto lazy_it = lazy_.find(key_); lazy_it != lazy_.end()) {
+                const auto path = lazy_it->second.path;
+                load_plugin(path);
+                return create_comp(key_);
+            }
             LM_ERROR("Missing component [key='{}']. Check if", key);
             LM_ERROR("- Key is wrong");
             LM_ERROR("- Component with the key is not registered");
@@ -207,6 +258,9 @@ public:
         if (!alias.empty()) {
             func_alias_map_[alias] = key;
         }
+        if (recording_) {
+            recording_->push_back({ key, alias });
+        }
     }
 
     void unreg(const std::string& key, const std::string& alias) {
@@ -217,6 +271,13 @@ public:
     }
 
     void load_plugin(const std::string& p) {
+        // Static plugins are already available
+        if (is_static_plugin(p)) {
+            LM_INFO("Plugin is linked statically [name='{}']", fs::path(p).filename().string());
+            return;
+        }
+        remove_lazy(p);
+
         // Path and filename
         const auto path = plugin_path(p);
         const auto filename = path.filename().string();
@@ -249,6 +310,11 @@ public:
     }
 
     void unload_plugin(const std::string& p) {
+        // Static plugins cannot be unloaded
+        if (is_static_plugin(p)) {
+            return;
+        }
+
         const auto path = plugin_path(p);
         const auto filename = path.filename().string();
         
@@ -295,21 +361,119 @@ public:
             if (!std::regex_match(filename.c_str(), match, pluginNameExp)) {
                 continue;
             }
-            load_plugin(it->path().stem().string().c_str());
+            load_plugin_with_manifest(it->path());
         }
     }
 
+private:
+    // Path to the manifest of a plugin
+    fs::path manifest_path(const fs::path& library) const {
+        auto path = library;
+        return path.replace_extension(".manifest.json");
+    }
+
+    // Unregister the components of the plugin registered by the manifest
+    void remove_lazy(const std::string& path) {
+        for (auto it = lazy_.begin(); it != lazy_.end();) {
+            it = it->second.path == path ? lazy_.erase(it) : std::next(it);
+        }
+    }
+
+    // Register the components listed in the manifest without loading the plugin.
+    // Returns false if the manifest is missing or older than the plugin.
+    bool register_lazy(const fs::path& library, const std::string& path) {
+        const auto manifest = manifest_path(library);
+        if (!fs::exists(manifest) || fs::last_write_time(manifest) < fs::last_write_time(library)) {
+            return false;
+        }
+        std::vector<std::pair<std::string, std::string>> comps;
+        try {
+            Json j;
+            std::ifstream in(manifest.string());
+            in >> j;
+            for (const auto& c : j.at("components")) {
+                comps.push_back({ c.at("key").get<std::string>(), c.at("alias").get<std::string>() });
+            }
+        }
+        catch (const std::exception& e) {
+            LM_WARN("Failed to read plugin manifest [path='{}', error='{}']", manifest.string(), e.what());
+            return false;
+        }
+        for (const auto& [key, alias] : comps) {
+            // The components overriding the registered ones must be loaded eagerly
+            if (func_map_.find(key) != func_map_.end()) {
+                return false;
+            }
+        }
+        for (const auto& [key, alias] : comps) {
+            lazy_[key] = { path, false };
+            if (!alias.empty()) {
+                lazy_[alias] = { path, true };
+            }
+        }
+        LM_INFO("Registered plugin [name='{}', components='{}']", library.filename().string(), comps.size());
+        return true;
+    }
+
+    // Load a plugin found in the plugin directory.
+    // If the plugin has an up-to-date manifest, the plugin is loaded on first use of its components.
+    // Otherwise, the plugin is loaded and the manifest is written for the subsequent runs.
+    void load_plugin_with_manifest(const fs::path& library) {
+        const auto path = (library.parent_path() / library.stem()).string();
+        if (is_static_plugin(path) || plugins_.find(plugin_path(path).string()) != plugins_.end()) {
+            load_plugin(path);
+            return;
+        }
+        if (register_lazy(library, path)) {
+            return;
+        }
+
+        // Load the plugin recording the registered components
+        std::vector<std::pair<std::string, std::string>> comps;
+        recording_ = &comps;
+        try {
+            load_plugin(path);
+        }
+        catch (...) {
+            recording_ = nullptr;
+            throw;
+        }
+        recording_ = nullptr;
+
+        // Write the manifest. Failing to write it is not an error, e.g., for read-only directories.
+        Json j;
+        j["components"] = Json::array();
+        for (const auto& [key, alias] : comps) {
+            j["components"].push_back({ {"key", key}, {"alias", alias} });
+        }
+        const auto manifest = manifest_path(library);
+        std::ofstream out(manifest.string());
+        if (!out) {
+            LM_WARN("Failed to write plugin manifest [path='{}']", manifest.string());
+            return;
+        }
+        out << j.dump(4);
+    }
+
+public:
+
     void unload_all_plugins() {
         for (auto& plugin : plugins_) {
             plugin.second->unload();
         }
         plugins_.clear();
+        lazy_.clear();
     }
 
     void foreach_registered(const std::function<void(const std::string& name)>& func) {
         for (const auto& [k, v] : func_map_) {
             func(k);
         }
+        for (const auto& [k, v] : lazy_) {
+            if (!v.alias) {
+                func(k);
+            }
+        }
     }
 
     void register_root_comp(Component* p) {
@@ -317,6 +481,33 @@ public:
             LM_THROW_EXCEPTION(Error::None, "Root locator must be '$'");
         }
         root_ = p;
+        invalidate_locator_cache();
+    }
+
+    void invalidate_locator_cache() {
+        std::unique_lock<std::mutex> lock(cache_mutex_);
+        if (!cache_.empty()) {
+            cache_.clear();
+            cache_refs_.clear();
+        }
+    }
+
+    void invalidate_locator_cache(const Component* p) {
+        std::unique_lock<std::mutex> lock(cache_mutex_);
+        if (p == root_) {
+            root_ = nullptr;
+        }
+        auto it = cache_refs_.find(p);
+        if (it == cache_refs_.end()) {
+            return;
+        }
+        for (const auto& locator : it->second) {
+            // The entry might have been overwritten by another component
+            if (auto e = cache_.find(locator); e != cache_.end() && e->second == p) {
+                cache_.erase(e);
+            }
+        }
+        cache_refs_.erase(it);
     }
 
     Component* get(const std::string& locator) {
@@ -330,35 +521,51 @@ public:
             return nullptr;
         }
 
-        // Given 'xxx.yyy.zzz', returns the pair of 'xxx' and 'yyy.zzz'.
-        const auto splitFirst = [&](const std::string& s) -> std::tuple<std::string, std::string> {
-            const auto i = s.find_first_of('.', 0);
-            if (i == std::string::npos) {
-                return { s, "" };
-            }
-            return { s.substr(0, i), s.substr(i + 1) };
-        };
-
-        // Trace down from the root
-        const auto [s0, r0] = splitFirst(locator);
-        if (s0 != "$") {
+        // Check the first element
+        if (locator.compare(0, locator.find_first_of('.'), "$") != 0) {
             LM_ERROR("Locator must start with '$' [loc='{}'].", locator);
             return nullptr;
         }
-        auto remaining = r0;
-        auto* curr = root_;
-        while (curr && !remaining.empty()) {
-            const auto [s, r] = splitFirst(remaining);
-            curr = curr->underlying(s);
-            remaining = r;
-        }
 
+        auto* curr = resolve(locator);
         if (!curr) {
             LM_ERROR("Failed to find a component with locator [loc='{}']", locator);
         }
 
         return curr;
     }
+
+private:
+    // Resolve the locator starting with '$' from the cached parent
+    Component* resolve(const std::string& locator) {
+        if (locator == "$") {
+            return root_;
+        }
+        {
+            std::unique_lock<std::mutex> lock(cache_mutex_);
+            if (auto it = cache_.find(locator); it != cache_.end()) {
+                return it->second;
+            }
+        }
+
+        // Given 'xxx.yyy.zzz', find the parent 'xxx.yyy' and query 'zzz'.
+        // The lock is not held while querying because underlying()
+        // might resolve other locators, e.g., when constructing deferred assets.
+        const auto i = locator.find_last_of('.');
+        auto* parent = resolve(locator.substr(0, i));
+        if (!parent) {
+            return nullptr;
+        }
+        auto* p = parent->underlying(locator.substr(i + 1));
+        if (p) {
+            std::unique_lock<std::mutex> lock(cache_mutex_);
+            if (auto& e = cache_[locator]; e != p) {
+                e = p;
+                cache_refs_[p].push_back(locator);
+            }
+        }
+        return p;
+    }
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -403,6 +610,20 @@ LM_PUBLIC_API Component* get(const std::string& locator) {
     return ComponentContext::instance().get(locator);
 }
 
+LM_PUBLIC_API void invalidate_locator_cache() {
+    if (!ComponentContext::alive()) {
+        return;
+    }
+    ComponentContext::instance().invalidate_locator_cache();
+}
+
+LM_PUBLIC_API void invalidate_locator_cache(const Component* p) {
+    if (!ComponentContext::alive()) {
+        return;
+    }
+    ComponentContext::instance().invalidate_locator_cache(p);
+}
+
 // ------------------------------------------------------------------------------------------------
 
 LM_NAMESPACE_END(LM_NAMESPACE::comp::detail)
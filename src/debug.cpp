@@ -118,4 +118,83 @@ LM_PUBLIC_API void print_asset_tree(bool visualize_weak_refs) {
     assets->foreach_underlying(std::bind(visitor, _1, _2, "$.assets"));
 }
 
+// ------------------------------------------------------------------------------------------------
+
+namespace {
+
+// Interface name of the component key, e.g., texture for texture::bitmap
+std::string subsystem_of(const std::string& key) {
+    const auto i = key.find("::");
+    return i == std::string::npos ? key : key.substr(0, i);
+}
+
+std::string format_bytes(size_t bytes) {
+    return fmt::format("{:.2f} MB", double(bytes) / (1024.0 * 1024.0));
+}
+
+}
+
+LM_PUBLIC_API Json memory_usage(const std::string& loc) {
+    auto* root = lm::comp::get<Component>(loc);
+    if (!root) {
+        LM_THROW_EXCEPTION(Error::InvalidArgument, "Missing component [loc='{}']", loc);
+    }
+
+    // Traverse the owned components from the root
+    std::unordered_map<std::string, size_t> subsystems;
+    using Func = std::function<Json(Component* comp)>;
+    const Func visitor = [&](Component* comp) -> Json {
+        const auto self = comp->memory_usage();
+        auto total = self;
+        auto children = Json::array();
+        comp->foreach_underlying([&](Component*& p, bool weak) {
+            if (!p || weak) {
+                return;
+            }
+            auto child = visitor(p);
+            total += child["total"].get<size_t>();
+            children.push_back(std::move(child));
+        });
+        subsystems[subsystem_of(comp->key())] += self;
+        return {
+            {"loc", comp->loc()},
+            {"key", comp->key()},
+            {"self", self},
+            {"total", total},
+            {"children", std::move(children)}
+        };
+    };
+
+    auto result = visitor(root);
+    result["subsystems"] = subsystems;
+    return result;
+}
+
+LM_PUBLIC_API void print_memory_usage(const std::string& loc) {
+    using Func = std::function<void(const Json& node, const std::string& parent_loc)>;
+    const Func visitor = [&](const Json& node, const std::string& parent_loc) {
+        const auto node_loc = node["loc"].get<std::string>();
+        auto comp_id = node_loc;
+        comp_id.erase(0, parent_loc.size());
+        LM_INFO("{} [{}] total='{}', self='{}'", comp_id, node["key"].get<std::string>(),
+            format_bytes(node["total"].get<size_t>()), format_bytes(node["self"].get<size_t>()));
+        LM_INDENT();
+        for (const auto& child : node["children"]) {
+            visitor(child, node_loc);
+        }
+    };
+
+    const auto usage = memory_usage(loc);
+    LM_INFO("Memory usage");
+    {
+        LM_INDENT();
+        visitor(usage, "");
+    }
+    LM_INFO("Memory usage by subsystem");
+    LM_INDENT();
+    for (const auto& subsystem : usage["subsystems"].items()) {
+        LM_INFO("{}: {}", subsystem.key(), format_bytes(subsystem.value().get<size_t>()));
+    }
+}
+
 LM_NAMESPACE_END(LM_NAMESPACE::debug)
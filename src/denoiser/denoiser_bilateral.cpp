@@ -0,0 +1,141 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/denoiser.h>
+#include <lm/parallel.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: denoiser::bilateral
+
+    Edge-avoiding A-Trous wavelet denoiser.
+
+    :param int iterations: Number of iterations. Default value: 5.
+    :param float sigma_color: Tolerance of the color difference. Default value: 0.5.
+    :param float sigma_normal: Tolerance of the normal difference. Default value: 0.1.
+    :param float sigma_albedo: Tolerance of the albedo difference. Default value: 0.1.
+    :param bool demodulate: Filter the color divided by the albedo. Default value: true.
+
+    This denoiser implements the cross bilateral filter guided by the feature buffers
+    with the edge-avoiding A-Trous wavelet transform [Dammertz2010]_.
+    Each iteration applies a 5x5 B3-spline kernel whose taps are spaced by :math:`2^i` pixels,
+    weighted by the differences of the colors, the normals, and the albedos.
+    The tolerance of the color difference is halved for each iteration.
+    If ``demodulate`` is true and the albedo is available,
+    the filter is applied to the color divided by the albedo
+    so that the texture details are not blurred.
+    The denoiser does not depend on external libraries
+    and is used as a fallback of ``denoiser::oidn``.
+
+    .. [Dammertz2010] H. Dammertz, D. Sewtz, J. Hanika, H. Lensch,
+                      Edge-Avoiding A-Trous Wavelet Transform for fast Global Illumination Filtering,
+                      Proc. of HPG 2010.
+\endrst
+*/
+class Denoiser_Bilateral final : public Denoiser {
+private:
+    int iterations_;
+    Float sigma_color_;
+    Float sigma_normal_;
+    Float sigma_albedo_;
+    bool demodulate_;
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(iterations_, sigma_color_, sigma_normal_, sigma_albedo_, demodulate_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        iterations_ = json::value<int>(prop, "iterations", 5);
+        sigma_color_ = json::value<Float>(prop, "sigma_color", .5_f);
+        sigma_normal_ = json::value<Float>(prop, "sigma_normal", .1_f);
+        sigma_albedo_ = json::value<Float>(prop, "sigma_albedo", .1_f);
+        demodulate_ = json::value<bool>(prop, "demodulate", true);
+    }
+
+    virtual std::vector<Vec3> denoise(int w, int h,
+        const std::vector<Vec3>& color,
+        const std::vector<Vec3>& albedo,
+        const std::vector<Vec3>& normal) const override
+    {
+        // B3-spline kernel
+        static constexpr Float Kernel[] = { 1_f/16_f, 1_f/4_f, 3_f/8_f, 1_f/4_f, 1_f/16_f };
+        const bool has_albedo = !albedo.empty();
+        const bool has_normal = !normal.empty();
+        const bool demodulate = demodulate_ && has_albedo;
+
+        // Demodulate albedo
+        const auto inv_albedo = [&](int i) -> Vec3 {
+            return 1_f / glm::max(albedo[i], Vec3(1e-3_f));
+        };
+        std::vector<Vec3> curr(color);
+        if (demodulate) {
+            parallel::foreach(w*h, [&](long long i, int) {
+                curr[i] *= inv_albedo(int(i));
+            });
+        }
+
+        // Iterate A-Trous filter
+        std::vector<Vec3> next(curr.size());
+        Float sigma_color = sigma_color_;
+        for (int it = 0; it < iterations_; it++) {
+            const int step = 1 << it;
+            const auto inv_sc2 = 1_f / (sigma_color * sigma_color);
+            const auto inv_sn2 = 1_f / (sigma_normal_ * sigma_normal_);
+            const auto inv_sa2 = 1_f / (sigma_albedo_ * sigma_albedo_);
+            parallel::foreach(h, [&](long long y_, int) {
+                const int y = int(y_);
+                for (int x = 0; x < w; x++) {
+                    const int p = y*w + x;
+                    Vec3 sum(0_f);
+                    Float sum_w = 0_f;
+                    for (int dy = -2; dy <= 2; dy++) {
+                        const int qy = y + dy*step;
+                        if (qy < 0 || qy >= h) {
+                            continue;
+                        }
+                        for (int dx = -2; dx <= 2; dx++) {
+                            const int qx = x + dx*step;
+                            if (qx < 0 || qx >= w) {
+                                continue;
+                            }
+                            const int q = qy*w + qx;
+                            auto e = math::sq(glm::length(curr[p] - curr[q])) * inv_sc2;
+                            if (has_normal) {
+                                e += math::sq(glm::length(normal[p] - normal[q])) * inv_sn2;
+                            }
+                            if (has_albedo) {
+                                e += math::sq(glm::length(albedo[p] - albedo[q])) * inv_sa2;
+                            }
+                            const auto weight = Kernel[dx+2] * Kernel[dy+2] * std::exp(-e);
+                            sum += weight * curr[q];
+                            sum_w += weight;
+                        }
+                    }
+                    next[p] = sum / sum_w;
+                }
+            });
+            curr.swap(next);
+            sigma_color *= .5_f;
+        }
+
+        // Modulate albedo
+        if (demodulate) {
+            parallel::foreach(w*h, [&](long long i, int) {
+                curr[i] /= inv_albedo(int(i));
+            });
+        }
+        return curr;
+    }
+};
+
+LM_COMP_REG_IMPL(Denoiser_Bilateral, "denoiser::bilateral");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
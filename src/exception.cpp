@@ -22,6 +22,13 @@ class ExceptionContext final {
 private:
     int start_  = 3;   // Skips first n entries of the stack trace
     int stacks_ = 0;   // Number of entries of stack trace (0: disable)
+    bool fpex_ = LM_DEBUG_MODE;     // Enables floating-point exceptions for debugging
+
+    // True if floating-point exceptions are enabled in the current thread
+    static bool& thread_fpex_enabled() {
+        thread_local bool enabled = false;
+        return enabled;
+    }
 
 public:
     static ExceptionContext& instance() {
@@ -49,6 +56,7 @@ public:
     void init(const Json& prop) {
         start_  = json::value(prop, "start", 3);
         stacks_ = json::value(prop, "stacks", 0);
+        fpex_   = json::value<bool>(prop, "fpex", LM_DEBUG_MODE);
 
         #if LM_PLATFORM_WINDOWS
         // Handle structured exception as C++ exception
@@ -91,8 +99,8 @@ public:
         // Handle denormals as zero
         _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
 
-        // Enable floating point exceptions
-        enable_fpex();
+        // Enable floating point exceptions if requested
+        init_thread();
         #endif
     }
 
@@ -107,15 +115,27 @@ public:
     void enable_fpex() {
         #if LM_PLATFORM_WINDOWS
         set_fpex_state((unsigned int)(~(_EM_INVALID | _EM_ZERODIVIDE)));
+        thread_fpex_enabled() = true;
         #endif
     }
 
     void disable_fpex() {
         #if LM_PLATFORM_WINDOWS
         set_fpex_state(_CW_DEFAULT);
+        thread_fpex_enabled() = false;
         #endif
     }
 
+    bool fpex_enabled() const {
+        return thread_fpex_enabled();
+    }
+
+    void init_thread() {
+        if (fpex_) {
+            enable_fpex();
+        }
+    }
+
     void stack_trace() const {
         if (stacks_ == 0) {
             return;
@@ -169,6 +189,14 @@ LM_PUBLIC_API void disable_fpex() {
     ExceptionContext::instance().disable_fpex();
 }
 
+LM_PUBLIC_API bool fpex_enabled() {
+    return ExceptionContext::instance().fpex_enabled();
+}
+
+LM_PUBLIC_API void init_thread() {
+    ExceptionContext::instance().init_thread();
+}
+
 LM_PUBLIC_API void stack_trace() {
     ExceptionContext::instance().stack_trace();
 }
@@ -6,9 +6,12 @@
 #include <pch.h>
 #include <lm/core.h>
 #include <lm/film.h>
+#include <lm/profiler.h>
+#include <lm/trace.h>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb/stb_image_write.h>
 #include <lm/parallel.h>
+#include <future>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -115,22 +118,104 @@ namespace image {
 
    :param int w: Width of the film.
    :param int h: Height of the film.
+   :param str splat_mode: Accumulation mode of :cpp:func:`lm::Film::splat_pixel`.
+                          ``atomic`` (default), ``thread_local``, or ``float``.
+   :param bool async_save: Write image files in a background thread. Default value: false.
+   :param list aovs: AOVs recorded by the film.
+                     Subset of ``albedo``, ``normal``, ``depth``, and ``sample_count``.
+                     Default value: empty.
 
    This component implements thread-safe bitmap film.
    The invocation of :cpp:func:`lm::Film::setPixel()` function is thread safe.
+
+   By default, :cpp:func:`lm::Film::splat_pixel` updates the shared pixel
+   with an atomic operation, which contends when many threads splat
+   to the same region, e.g., in light tracing.
+   If ``splat_mode`` is ``thread_local``, each thread accumulates the splatted values
+   into its own sparse buffer, which is allocated lazily for each square tile of the film.
+   The buffers are merged into the film on demand,
+   i.e., when the film is read, saved, accumulated, rescaled, or serialized.
+   In this mode the film must not be read concurrently with splatting,
+   which is naturally satisfied when the film is read after the parallel loop.
+   If ``splat_mode`` is ``float``, the splatted values are accumulated
+   into a working buffer of single-precision components updated with lock-free atomics,
+   which halves the memory traffic of the splats in double-precision builds.
+   The working buffer is reduced into the pixels in full precision on demand as with ``thread_local``,
+   in particular on :cpp:func:`lm::Film::publish` at the end of each pass,
+   so the error of the single-precision accumulation is bounded by the samples of a pass.
+
+   The pixels are converted to the output format in parallel.
+   ``.pfm`` output is converted and written in chunks of rows without a temporary copy of the image.
+   If ``async_save`` is true, :cpp:func:`lm::Film::save` returns after converting the pixels
+   and the conversion result is encoded and written in a background thread,
+   so that the film can be modified, e.g., by rendering the next frame, during writing.
+   In this case the return value only reports the errors found before writing.
+   The next save or the destruction of the film waits for the pending write.
+
+   The AOVs are stored in a separate buffer in single precision,
+   where the values of the enabled AOVs of a pixel are stored contiguously.
+   Scalar AOVs occupy one component.
+   The sample count is recorded whenever any AOV is enabled
+   because the other AOVs are normalized by the sample count of the pixel.
+   Unlike the color, the AOVs are not affected by :cpp:func:`lm::Film::rescale`.
+   :cpp:func:`lm::Film::save_aov` supports ``.pfm`` and ``.hdr`` output.
+
+   For progressive rendering, the film keeps a snapshot published by
+   :cpp:func:`lm::Film::publish` between passes, which can be read by
+   :cpp:func:`lm::Film::snapshot` safely during rendering.
 \endrst
 */
 class Film_Bitmap final : public Film {
+private:
+    // Size of a tile of the thread-local buffers
+    static constexpr int TileSize = 32;
+
+    // Thread-local sparse accumulation buffer
+    struct LocalBuffer {
+        std::vector<std::unique_ptr<Vec3[]>> tiles;
+    };
+
+    // Unique identifier of the film used to find the thread-local buffer
+    static unsigned long long next_id() {
+        static std::atomic<unsigned long long> id = 0;
+        return ++id;
+    }
+
 private:
     int w_;
     int h_;
     int quality_;
-    std::vector<AtomicWrapper<Vec3>> data_;
+    bool thread_local_splat_ = false;
+    bool float_splat_ = false;
+    // Logically the film is not modified by merging the thread-local buffers,
+    // so the buffers are merged also in const member functions.
+    mutable std::vector<AtomicWrapper<Vec3>> data_;
+    mutable std::vector<AtomicWrapper<float>> work_;   // Working buffer of the float splats
     std::vector<Vec3> data_temp_;  // Temporary buffer for external reference
+    const unsigned long long id_ = next_id();
+    mutable std::mutex locals_lock_;
+    mutable std::unordered_map<std::thread::id, std::unique_ptr<LocalBuffer>> locals_;
+    mutable std::mutex snapshot_lock_;
+    std::shared_ptr<const std::vector<Vec3>> snapshot_;    // Last published snapshot
+    bool async_save_ = false;       // Write images in a background thread
+    mutable std::future<bool> pending_save_;    // Pending asynchronous write
+
+    // Number of rows converted at once when streaming the image
+    static constexpr int RowChunkSize = 64;
+
+    // AOVs in the order of FilmAOV
+    static constexpr int NumAOVs = 4;
+    std::vector<int> aov_offsets_ = std::vector<int>(NumAOVs, -1);  // Offsets in a pixel. -1 if disabled
+    int aov_stride_ = 0;                            // Number of components of a pixel
+    std::vector<AtomicWrapper<float>> aov_data_;    // Sum of the AOV values
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(w_, h_, quality_, data_);
+        merge_locals();
+        ar(w_, h_, quality_, thread_local_splat_, float_splat_, data_, aov_offsets_, aov_stride_, aov_data_);
+        if (float_splat_ && work_.empty()) {
+            work_.assign(size_t(w_)*h_*3, {});
+        }
     }
 
 public:
@@ -138,7 +223,64 @@ public:
         w_ = json::value<int>(prop, "w");
         h_ = json::value<int>(prop, "h");
         quality_ = json::value<int>(prop, "quality", 90);
+        const auto splat_mode = json::value<std::string>(prop, "splat_mode", "atomic");
+        if (splat_mode == "atomic") {
+            thread_local_splat_ = false;
+        }
+        else if (splat_mode == "thread_local") {
+            thread_local_splat_ = true;
+        }
+        else if (splat_mode == "float") {
+            float_splat_ = true;
+        }
+        else {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid splat mode [splat_mode='{}']", splat_mode);
+        }
+        async_save_ = json::value<bool>(prop, "async_save", false);
         data_.assign(w_*h_, {});
+        parallel::interleave_memory(data_.data(), data_.size() * sizeof(data_[0]));
+        if (float_splat_) {
+            work_.assign(size_t(w_)*h_*3, {});
+            parallel::interleave_memory(work_.data(), work_.size() * sizeof(work_[0]));
+        }
+
+        // Layout of the AOVs
+        const auto aovs = json::value<std::vector<std::string>>(prop, "aovs", {});
+        for (const auto& name : aovs) {
+            const auto aov = aov_from_name(name);
+            if (aov_offsets_[int(aov)] >= 0) {
+                continue;
+            }
+            if (aov_stride_ == 0) {
+                // Sample count comes first and is always recorded
+                aov_offsets_[int(FilmAOV::SampleCount)] = 0;
+                aov_stride_ = 1;
+            }
+            if (aov == FilmAOV::SampleCount) {
+                continue;
+            }
+            aov_offsets_[int(aov)] = aov_stride_;
+            aov_stride_ += aov_components(aov);
+        }
+        aov_data_.assign(size_t(w_)*h_*aov_stride_, {});
+    }
+
+    ~Film_Bitmap() {
+        // The exception thrown by the pending write must not escape from the destructor
+        if (!pending_save_.valid()) {
+            return;
+        }
+        pending_save_.wait();
+        try {
+            pending_save_.get();
+        }
+        catch (const std::exception& e) {
+            LM_ERROR("Failed to save image [error='{}']", e.what());
+        }
+        catch (...) {
+            LM_ERROR("Failed to save image [error='unknown']");
+        }
     }
 
     virtual FilmSize size() const override {
@@ -150,16 +292,21 @@ public:
     }
 
     virtual void set_pixel(int x, int y, Vec3 v) override {
+        mark_dirty();
         data_[y*w_ + x].update(v);
     }
 
     virtual bool save(const std::string& outpath) const override {
+        LM_TRACE_SCOPE("film::save " + outpath);
         // Disable floating-point exception for stb_image
         exception::ScopedDisableFPEx disable_fpex_;
 
         LM_INFO("Saving image [file='{}']", outpath);
         LM_INDENT();
 
+        wait_pending_save();
+        merge_locals();
+
         // Create directory if not found
         const auto parent = fs::path(outpath).parent_path();
         if (!parent.empty() && !fs::exists(parent)) {
@@ -173,51 +320,68 @@ public:
         // Save file
         // Check extension of the output file
         const auto ext = fs::path(outpath).extension().string();
+        std::function<bool()> write;
         if (ext == ".png") {
-            const auto data = copy<unsigned char>(true);
-            if (!stbi_write_png(outpath.c_str(), w_, h_, 3, data.data(), w_*3)) {
-                return false;
-            }
+            write = [=, data = copy<unsigned char>(true)]() -> bool {
+                return stbi_write_png(outpath.c_str(), w_, h_, 3, data.data(), w_*3) != 0;
+            };
         }
         #if 0
         else if (ext == ".jpg") {
-            const auto data = copy<unsigned char>(true);
-            if (!stbi_write_jpg(outpath.c_str(), w_, h_, 3, data.data(), quality_)) {
-                return false;
-            }
+            write = [=, data = copy<unsigned char>(true)]() -> bool {
+                return stbi_write_jpg(outpath.c_str(), w_, h_, 3, data.data(), quality_) != 0;
+            };
         }
         #endif
         else if (ext == ".hdr") {
             auto data = copy<float>(true);
             image::sanityCheck(w_, h_, data);
-            if (!stbi_write_hdr(outpath.c_str(), w_, h_, 3, data.data())) {
-                return false;
-            }
+            write = [=, data = std::move(data)]() -> bool {
+                exception::ScopedDisableFPEx disable_fpex_;
+                return stbi_write_hdr(outpath.c_str(), w_, h_, 3, data.data()) != 0;
+            };
         }
         else if (ext == ".pfm") {
-            const auto data = copy<float>(false);
-            image::sanityCheck(w_, h_, data);
-            if (!image::writePfm(outpath, w_, h_, data)) {
-                return false;
+            if (!async_save_) {
+                // Stream the rows without the temporary copy of the image
+                return write_pfm_streamed(outpath);
             }
+            auto data = copy<float>(false);
+            image::sanityCheck(w_, h_, data);
+            write = [=, data = std::move(data)]() -> bool {
+                return image::writePfm(outpath, w_, h_, data);
+            };
         }
         else {
             LM_ERROR("Invalid extension [ext='{}']", ext);
             return false;
         }
 
-        return true;
+        if (async_save_) {
+            pending_save_ = std::async(std::launch::async, [write, outpath]() -> bool {
+                const bool result = write();
+                if (!result) {
+                    LM_ERROR("Failed to save image [file='{}']", outpath);
+                }
+                return result;
+            });
+            return true;
+        }
+        return write();
     }
 
     virtual FilmBuffer buffer() override {
-        data_temp_.clear();
-        for (const auto& v : data_) {
-            data_temp_.push_back(v.v_);
-        }
+        const parallel::ScopedDisableCancel disable_cancel_;
+        merge_locals();
+        data_temp_.resize(data_.size());
+        parallel::foreach(w_ * h_, [&](long long i, int) {
+            data_temp_[i] = data_[i].v_.load();
+        });
         return FilmBuffer{ w_, h_, &data_temp_[0].x };
     }
 
     virtual void accum(const Film* film_) override {
+        mark_dirty();
         const auto* film = dynamic_cast<const Film_Bitmap*>(film_);
         if (!film) {
             LM_ERROR("Could not accumuate film. Invalid film type.");
@@ -227,50 +391,343 @@ public:
             LM_ERROR("Film size is different [expected='({},{})', actual='({},{})']", w_, h_, film->w_, film->h_);
             return;
         }
+        merge_locals();
+        film->merge_locals();
         for (int i = 0; i < w_*h_; i++) {
             const auto v = film->data_[i].v_.load();
             data_[i].add(v);
         }
+        if (aov_offsets_ == film->aov_offsets_) {
+            for (size_t i = 0; i < aov_data_.size(); i++) {
+                aov_data_[i].add(film->aov_data_[i].v_.load());
+            }
+        }
+        else if (aov_stride_ > 0) {
+            LM_WARN("AOVs are not accumulated. Enabled AOVs are different.");
+        }
     }
 
     virtual void splat_pixel(int x, int y, Vec3 v) override {
-        data_[y*w_+x].add(v);
+        LM_PROFILE_SCOPE(Splat);
+        mark_dirty();
+        if (float_splat_) {
+            auto* d = &work_[3*(size_t(y)*w_+x)];
+            for (int i = 0; i < 3; i++) {
+                d[i].add(float(v[i]));
+            }
+            return;
+        }
+        if (!thread_local_splat_) {
+            data_[y*w_+x].add(v);
+            return;
+        }
+
+        // Accumulate to the tile of the thread-local buffer
+        auto& local = local_buffer();
+        const int tx = x / TileSize;
+        const int ty = y / TileSize;
+        auto& tile = local.tiles[ty * num_tiles_x() + tx];
+        if (!tile) {
+            tile.reset(new Vec3[TileSize * TileSize]);
+            std::fill_n(tile.get(), TileSize * TileSize, Vec3(0_f));
+        }
+        tile[(y - ty*TileSize) * TileSize + (x - tx*TileSize)] += v;
     }
 
     virtual void update_pixel(int x, int y, const PixelUpdateFunc& update_func) override {
+        mark_dirty();
         data_[y*w_+x].update_with_func(update_func);
     }
 
     virtual void rescale(Float s) override {
+        // The film is normalized even after the render is cancelled
+        const parallel::ScopedDisableCancel disable_cancel_;
+        mark_dirty();
+        merge_locals();
         parallel::foreach(w_ * h_, [&](long long i, int) {
             data_[i].v_ = data_[i].v_.load() * s;
         });
     }
 
     virtual void clear() override {
+        mark_dirty();
         data_.assign(w_*h_, {});
+        work_.assign(work_.size(), {});
+        aov_data_.assign(aov_data_.size(), {});
+        std::unique_lock<std::mutex> lock(locals_lock_);
+        for (auto& [_, local] : locals_) {
+            for (auto& tile : local->tiles) {
+                if (tile) {
+                    std::fill_n(tile.get(), TileSize * TileSize, Vec3(0_f));
+                }
+            }
+        }
+    }
+
+    virtual void merge_splats() override {
+        merge_locals();
+    }
+
+    virtual void publish(Float s) override {
+        merge_locals();
+        std::vector<Vec3> snapshot(w_*h_);
+        for (int i = 0; i < w_*h_; i++) {
+            snapshot[i] = data_[i].v_.load() * s;
+        }
+        // The previous snapshot is kept alive by the external references if any
+        auto shared = std::make_shared<const std::vector<Vec3>>(std::move(snapshot));
+        std::unique_lock<std::mutex> lock(snapshot_lock_);
+        snapshot_.swap(shared);
+    }
+
+    virtual std::vector<Vec3> snapshot() const override {
+        const auto shared = shared_snapshot();
+        return shared ? *shared : std::vector<Vec3>{};
+    }
+
+    virtual std::shared_ptr<const std::vector<Vec3>> shared_snapshot() const override {
+        std::unique_lock<std::mutex> lock(snapshot_lock_);
+        return snapshot_;
+    }
+
+    // Pixels, AOVs, the last snapshot, and the allocated tiles of the thread-local buffers
+    virtual size_t memory_usage() const override {
+        auto bytes = comp::bytes_of(data_, work_, data_temp_, aov_data_);
+        {
+            std::unique_lock<std::mutex> lock(snapshot_lock_);
+            if (snapshot_) {
+                bytes += comp::bytes_of(*snapshot_);
+            }
+        }
+        std::unique_lock<std::mutex> lock(locals_lock_);
+        for (const auto& [id, local] : locals_) {
+            for (const auto& tile : local->tiles) {
+                if (tile) {
+                    bytes += sizeof(Vec3) * TileSize * TileSize;
+                }
+            }
+        }
+        return bytes;
+    }
+
+    virtual bool has_aovs() const override {
+        return aov_stride_ > 0;
+    }
+
+    virtual bool has_aov(FilmAOV aov) const override {
+        return aov_offsets_[int(aov)] >= 0;
+    }
+
+    virtual void splat_aov(int x, int y, FilmAOV aov, Vec3 v) override {
+        mark_dirty();
+        const int offset = aov_offsets_[int(aov)];
+        if (offset < 0) {
+            return;
+        }
+        auto* d = &aov_data_[(size_t(y)*w_ + x)*aov_stride_ + offset];
+        for (int i = 0; i < aov_components(aov); i++) {
+            d[i].add(float(v[i]));
+        }
+    }
+
+    virtual std::vector<Vec3> aov(FilmAOV aov) const override {
+        const parallel::ScopedDisableCancel disable_cancel_;
+        const int offset = aov_offsets_[int(aov)];
+        if (offset < 0) {
+            return {};
+        }
+        const int n = aov_components(aov);
+        std::vector<Vec3> vs(size_t(w_)*h_);
+        parallel::foreach(w_*h_, [&](long long i, int) {
+            const auto* d = &aov_data_[size_t(i)*aov_stride_];
+            const auto count = Float(d[0].v_.load());
+            if (aov == FilmAOV::SampleCount) {
+                vs[i] = Vec3(count);
+                return;
+            }
+            if (count == 0_f) {
+                vs[i] = Vec3(0_f);
+                return;
+            }
+            for (int j = 0; j < 3; j++) {
+                vs[i][j] = Float(d[offset + std::min(j, n-1)].v_.load()) / count;
+            }
+        });
+        return vs;
+    }
+
+    virtual bool save_aov(FilmAOV aov, const std::string& outpath) const override {
+        const parallel::ScopedDisableCancel disable_cancel_;
+        LM_TRACE_SCOPE("film::save " + outpath);
+        LM_INFO("Saving AOV [file='{}']", outpath);
+        LM_INDENT();
+        if (!has_aov(aov)) {
+            LM_ERROR("AOV is not recorded by the film [aov='{}']", int(aov));
+            return false;
+        }
+        const auto ext = fs::path(outpath).extension().string();
+        if (ext != ".pfm" && ext != ".hdr") {
+            LM_ERROR("Invalid extension [ext='{}']", ext);
+            return false;
+        }
+        const auto vs = this->aov(aov);
+        std::vector<float> data(size_t(w_)*h_*3);
+        const bool flip = ext == ".hdr";
+        parallel::foreach(h_, [&](long long y, int) {
+            const auto yy = !flip ? y : h_-y-1;
+            for (int x = 0; x < w_; x++) {
+                for (int i = 0; i < 3; i++) {
+                    data[3*(yy*w_+x)+i] = float(vs[y*w_+x][i]);
+                }
+            }
+        });
+        if (ext == ".hdr") {
+            exception::ScopedDisableFPEx disable_fpex_;
+            return stbi_write_hdr(outpath.c_str(), w_, h_, 3, data.data()) != 0;
+        }
+        return image::writePfm(outpath, w_, h_, data);
     }
 
 private:
+    static FilmAOV aov_from_name(const std::string& name) {
+        if (name == "albedo")       return FilmAOV::Albedo;
+        if (name == "normal")       return FilmAOV::Normal;
+        if (name == "depth")        return FilmAOV::Depth;
+        if (name == "sample_count") return FilmAOV::SampleCount;
+        LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid AOV [name='{}']", name);
+    }
+
+    // Number of components of an AOV
+    static int aov_components(FilmAOV aov) {
+        return aov == FilmAOV::Albedo || aov == FilmAOV::Normal ? 3 : 1;
+    }
+
+    int num_tiles_x() const {
+        return (w_ + TileSize - 1) / TileSize;
+    }
+
+    int num_tiles_y() const {
+        return (h_ + TileSize - 1) / TileSize;
+    }
+
+    // Get thread-local buffer of the current thread
+    LocalBuffer& local_buffer() {
+        // Cache the buffer of the last used film to avoid the lock
+        struct Cache {
+            unsigned long long id = 0;
+            LocalBuffer* local = nullptr;
+        };
+        thread_local Cache cache;
+        if (cache.id != id_) {
+            std::unique_lock<std::mutex> lock(locals_lock_);
+            auto& local = locals_[std::this_thread::get_id()];
+            if (!local) {
+                local.reset(new LocalBuffer);
+                local->tiles.resize(size_t(num_tiles_x()) * num_tiles_y());
+            }
+            cache = { id_, local.get() };
+        }
+        return *cache.local;
+    }
+
+    // Merge thread-local buffers and the working buffer of the float splats into the film
+    void merge_locals() const {
+        const parallel::ScopedDisableCancel disable_cancel_;
+        if (float_splat_) {
+            parallel::foreach(w_ * h_, [&](long long i, int) {
+                auto* c = &work_[3*i];
+                auto& d = data_[i].v_;
+                const Vec3 v(c[0].v_.load(std::memory_order_relaxed), c[1].v_.load(std::memory_order_relaxed), c[2].v_.load(std::memory_order_relaxed));
+                d.store(d.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+                for (int j = 0; j < 3; j++) {
+                    c[j].v_.store(0.f, std::memory_order_relaxed);
+                }
+            });
+        }
+        std::unique_lock<std::mutex> lock(locals_lock_);
+        if (locals_.empty()) {
+            return;
+        }
+        const int ntx = num_tiles_x();
+        parallel::foreach(ntx * num_tiles_y(), [&](long long i, int) {
+            // Tiles are disjoint so the pixels are updated without atomics
+            const int tx = int(i % ntx);
+            const int ty = int(i / ntx);
+            for (auto& [_, local] : locals_) {
+                auto& tile = local->tiles[i];
+                if (!tile) {
+                    continue;
+                }
+                for (int y = ty*TileSize; y < std::min(h_, (ty+1)*TileSize); y++) {
+                    for (int x = tx*TileSize; x < std::min(w_, (tx+1)*TileSize); x++) {
+                        auto& c = tile[(y - ty*TileSize) * TileSize + (x - tx*TileSize)];
+                        auto& d = data_[y*w_+x].v_;
+                        d.store(d.load(std::memory_order_relaxed) + c, std::memory_order_relaxed);
+                        c = Vec3(0_f);
+                    }
+                }
+            }
+        });
+    }
+
+    // Convert rows [y0,y1) to the destination.
+    // If flip is true, the rows are written in the reversed order of the whole image.
     template <typename T>
-    std::vector<T> copy(bool flip) const {
-        std::vector<T> v(w_*h_*3, {});
-        for (int y = 0; y < h_; y++) {
-            const int yy = !flip ? y : h_-y-1;
+    void convert_rows(T* v, int y0, int y1, bool flip) const {
+        const parallel::ScopedDisableCancel disable_cancel_;
+        parallel::foreach(y1 - y0, [&](long long index, int) {
+            const int y = y0 + int(index);
+            const int yy = (!flip ? y : h_-y-1) - (!flip ? y0 : 0);
             for (int x = 0; x < w_; x++) {
+                const auto c = data_[y*w_+x].v_.load();
                 for (int i = 0; i < 3; i++) {
-                    const Float t = data_[y*w_+x].v_.load()[i];
+                    const Float t = c[i];
                     if constexpr (std::is_same_v<T, float>) {
-                        v[3*(yy*w_+x)+i] = T(t);
+                        v[3*(size_t(yy)*w_+x)+i] = T(t);
                     }
                     if constexpr (std::is_same_v<T, unsigned char>) {
                         const auto t2 = std::pow(t, 1_f/2.2_f);
-                        v[3*(yy*w_+x)+i] = (unsigned char)glm::clamp(int(256_f*t2), 0, 255);
+                        v[3*(size_t(yy)*w_+x)+i] = (unsigned char)glm::clamp(int(256_f*t2), 0, 255);
                     }
                 }
             }
+        });
+    }
+
+    template <typename T>
+    std::vector<T> copy(bool flip) const {
+        std::vector<T> v(size_t(w_)*h_*3, {});
+        convert_rows(v.data(), 0, h_, flip);
+        return v;
+    }
+
+    // Write .pfm file converting chunks of rows
+    bool write_pfm_streamed(const std::string& outpath) const {
+        std::ofstream os(outpath, std::ios::out | std::ios::binary);
+        if (!os) {
+            LM_ERROR("Failed to open [file='{}']", outpath);
+            return false;
+        }
+        os << fmt::format("PF\n{} {}\n-1\n", w_, h_);
+        std::vector<float> rows(size_t(w_) * RowChunkSize * 3);
+        bool invalid = false;
+        for (int y0 = 0; y0 < h_; y0 += RowChunkSize) {
+            const int y1 = std::min(h_, y0 + RowChunkSize);
+            convert_rows(rows.data(), y0, y1, false);
+            const size_t n = size_t(w_) * (y1 - y0) * 3;
+            invalid |= std::any_of(rows.begin(), rows.begin() + n, [](float t) { return !std::isfinite(t); });
+            os.write(reinterpret_cast<const char*>(rows.data()), n * sizeof(float));
+        }
+        if (invalid) {
+            LM_WARN("Found invalid pixels (NaN or Inf)");
+        }
+        return bool(os);
+    }
+
+    void wait_pending_save() const {
+        if (pending_save_.valid()) {
+            pending_save_.get();
         }
-        return std::move(v);
     }
 };
 
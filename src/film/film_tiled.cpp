@@ -0,0 +1,434 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/film.h>
+#include <lm/profiler.h>
+#include <lm/trace.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: film::tiled
+
+   Tiled film streamed to a file.
+
+   :param int w: Width of the film.
+   :param int h: Height of the film.
+   :param str path: Path to the backing ``.pfm`` file.
+   :param int tile_size: Size of a tile in pixels. Default value: 64.
+
+   This film keeps only the active tiles in memory and streams the finished tiles
+   to the backing file, so that the memory footprint is bounded by
+   the number of tiles in flight times the size of a tile, independent of the resolution.
+   A tile is allocated when a pixel of the tile is written first
+   and written to the file when all pixels of the tile are finished,
+   which is notified by :cpp:func:`lm::Film::finish_region`.
+   ``scheduler::spp::tile`` notifies the finished regions,
+   so use the same ``tile_size`` for the scheduler and the film.
+   If a pixel of a finished tile is written again, the tile is loaded back from the file.
+   A tile written while the region containing the tile is being finished
+   is flushed after the write and loaded back for the subsequent writes,
+   which is slow if it happens often,
+   so renderers splatting to arbitrary pixels, e.g., light tracing, should use ``film::bitmap``.
+
+   The backing file is a valid ``.pfm`` image that is complete after rendering.
+   :cpp:func:`lm::Film::save` only supports ``.pfm`` output and copies the backing file.
+   :cpp:func:`lm::Film::buffer` and :cpp:func:`lm::Film::accum` are not supported
+   because they require the entire image in memory.
+\endrst
+*/
+class Film_Tiled final : public Film {
+private:
+    // Tile resident in memory.
+    // The writers pin the tile by users while accessing the pixels,
+    // and the flush waits until the tile is no longer pinned.
+    struct Tile {
+        std::vector<Vec3> data;             // Pixels of the tile
+        std::mutex lock;                    // Lock for the pixels
+        std::atomic<long long> finished;    // Number of finished pixels
+        std::atomic<int> users;             // Number of the writers pinning the tile
+    };
+
+private:
+    int w_;
+    int h_;
+    int tile_size_;
+    std::string path_;                      // Path to the backing file
+    // The tiles are flushed also in const member functions,
+    // because flushing does not logically modify the film.
+    mutable std::vector<char> flushed_;     // True if the tile has been written to the file
+    mutable std::vector<std::unique_ptr<Tile>> tiles_;
+    mutable std::vector<std::atomic<Tile*>> resident_;  // Resident tiles. nullptr if not resident.
+    // Flushed tiles without pixels. A writer might still hold the pointer
+    // read from resident_ before the flush, so they are released only when
+    // no writer accesses the film, e.g., in rescale().
+    mutable std::vector<std::unique_ptr<Tile>> retired_;
+    mutable std::mutex tiles_lock_;         // Lock for allocation and flush of the tiles
+    mutable std::fstream file_;             // Backing file
+    std::streamoff header_size_ = 0;        // Size of the header of the backing file
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        flush_all();
+        ar(w_, h_, tile_size_, path_, flushed_);
+        if (!file_.is_open()) {
+            open(false);
+        }
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        w_ = json::value<int>(prop, "w");
+        h_ = json::value<int>(prop, "h");
+        path_ = json::value<std::string>(prop, "path");
+        tile_size_ = json::value<int>(prop, "tile_size", 64);
+        if (tile_size_ <= 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "tile_size must be positive [tile_size='{}']", tile_size_);
+        }
+        if (fs::path(path_).extension() != ".pfm") {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Backing file must be .pfm [path='{}']", path_);
+        }
+        flushed_.assign(num_tiles(), 0);
+        open(true);
+    }
+
+    virtual FilmSize size() const override {
+        return { w_, h_ };
+    }
+
+    virtual long long num_pixels() const override {
+        return (long long)(w_) * h_;
+    }
+
+    virtual void set_pixel(int x, int y, Vec3 v) override {
+        mark_dirty();
+        update(x, y, [&](Vec3&) { return v; });
+    }
+
+    virtual bool save(const std::string& outpath) const override {
+        LM_TRACE_SCOPE("film::save " + outpath);
+        LM_INFO("Saving image [file='{}']", outpath);
+        LM_INDENT();
+        if (fs::path(outpath).extension() != ".pfm") {
+            LM_ERROR("film::tiled only supports .pfm output [file='{}']", outpath);
+            return false;
+        }
+        flush_all();
+        std::unique_lock<std::mutex> lock(tiles_lock_);
+        file_.flush();
+        if (fs::absolute(outpath) == fs::absolute(path_)) {
+            return true;
+        }
+
+        // Create directory if not found
+        const auto parent = fs::path(outpath).parent_path();
+        if (!parent.empty() && !fs::exists(parent)) {
+            LM_INFO("Creating directory [path='{}']", parent.string());
+            if (!fs::create_directories(parent)) {
+                LM_INFO("Failed to create directory [path='{}']", parent.string());
+                return false;
+            }
+        }
+        std::error_code ec;
+        fs::copy_file(path_, outpath, fs::copy_options::overwrite_existing, ec);
+        if (ec) {
+            LM_ERROR("Failed to copy image [file='{}', error='{}']", outpath, ec.message());
+            return false;
+        }
+        return true;
+    }
+
+    virtual FilmBuffer buffer() override {
+        LM_THROW_EXCEPTION(Error::Unsupported,
+            "film::tiled does not hold the entire image in memory. Use save() instead.");
+    }
+
+    virtual void accum(const Film*) override {
+        LM_THROW_EXCEPTION(Error::Unsupported, "film::tiled does not support accumulation.");
+    }
+
+    virtual void splat_pixel(int x, int y, Vec3 v) override {
+        LM_PROFILE_SCOPE(Splat);
+        mark_dirty();
+        update(x, y, [&](Vec3& curr) { return curr + v; });
+    }
+
+    virtual void update_pixel(int x, int y, const PixelUpdateFunc& update_func) override {
+        mark_dirty();
+        update(x, y, [&](Vec3& curr) { return update_func(curr); });
+    }
+
+    virtual void rescale(Float s) override {
+        mark_dirty();
+        // Rescale tile by tile to bound the memory
+        flush_all();
+        reclaim();
+        for (int i = 0; i < num_tiles(); i++) {
+            if (!flushed_[i]) {
+                continue;
+            }
+            std::vector<Vec3> data;
+            read_tile(i, data);
+            for (auto& v : data) {
+                v *= s;
+            }
+            write_tile(i, data);
+        }
+    }
+
+    virtual void clear() override {
+        mark_dirty();
+        std::unique_lock<std::mutex> lock(tiles_lock_);
+        for (auto& tile : resident_) {
+            tile = nullptr;
+        }
+        tiles_.clear();
+        retired_.clear();
+        flushed_.assign(num_tiles(), 0);
+        lock.unlock();
+        open(true);
+    }
+
+    // Called between passes where no worker modifies the film
+    virtual void publish(Float) override {
+        reclaim();
+    }
+
+    virtual void finish_region(int x0, int y0, int x1, int y1) override {
+        // Count the finished pixels for each tile overlapping the region
+        for (int ty = y0 / tile_size_; ty <= (y1 - 1) / tile_size_; ty++) {
+            for (int tx = x0 / tile_size_; tx <= (x1 - 1) / tile_size_; tx++) {
+                const int i = ty * num_tiles_x() + tx;
+                auto* tile = acquire(i);
+                const int tx0 = std::max(x0, tx * tile_size_);
+                const int ty0 = std::max(y0, ty * tile_size_);
+                const int tx1 = std::min(x1, (tx + 1) * tile_size_);
+                const int ty1 = std::min(y1, (ty + 1) * tile_size_);
+                const long long n = (long long)(tx1 - tx0) * (ty1 - ty0);
+                const bool finished = tile->finished.fetch_add(n) + n >= tile_pixels(i);
+                // Unpin before the flush, which waits for the users of the tile
+                release(tile);
+                if (finished) {
+                    flush(i);
+                }
+            }
+        }
+    }
+
+    // Resident tiles only. The flushed tiles are in the backing file.
+    virtual size_t memory_usage() const override {
+        std::unique_lock<std::mutex> lock(tiles_lock_);
+        auto bytes = comp::bytes_of(flushed_) + resident_.size() * sizeof(std::atomic<Tile*>);
+        for (const auto& tile : tiles_) {
+            bytes += comp::bytes_of(tile->data);
+        }
+        bytes += retired_.size() * sizeof(Tile);
+        return bytes;
+    }
+
+private:
+    int num_tiles_x() const {
+        return (w_ + tile_size_ - 1) / tile_size_;
+    }
+
+    int num_tiles_y() const {
+        return (h_ + tile_size_ - 1) / tile_size_;
+    }
+
+    int num_tiles() const {
+        return num_tiles_x() * num_tiles_y();
+    }
+
+    // Pixel range of the tile
+    void tile_range(int i, int& x0, int& y0, int& x1, int& y1) const {
+        x0 = (i % num_tiles_x()) * tile_size_;
+        y0 = (i / num_tiles_x()) * tile_size_;
+        x1 = std::min(x0 + tile_size_, w_);
+        y1 = std::min(y0 + tile_size_, h_);
+    }
+
+    long long tile_pixels(int i) const {
+        int x0, y0, x1, y1;
+        tile_range(i, x0, y0, x1, y1);
+        return (long long)(x1 - x0) * (y1 - y0);
+    }
+
+    // Open the backing file. If create is true, the file is recreated with zeros.
+    void open(bool create) {
+        std::unique_lock<std::mutex> lock(tiles_lock_);
+        if (file_.is_open()) {
+            file_.close();
+        }
+        resident_ = std::vector<std::atomic<Tile*>>(num_tiles());
+        const auto header = fmt::format("PF\n{} {}\n-1\n", w_, h_);
+        header_size_ = std::streamoff(header.size());
+        if (create || !fs::exists(path_)) {
+            const auto parent = fs::path(path_).parent_path();
+            if (!parent.empty() && !fs::exists(parent)) {
+                fs::create_directories(parent);
+            }
+            std::ofstream os(path_, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!os) {
+                LM_THROW_EXCEPTION(Error::IOError, "Failed to create backing file [path='{}']", path_);
+            }
+            os.write(header.data(), header.size());
+            // Extend the file without writing the zeros explicitly
+            const auto size = header_size_ + std::streamoff(num_pixels()) * 3 * std::streamoff(sizeof(float));
+            os.seekp(size - 1);
+            os.put('\0');
+        }
+        file_.open(path_, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file_) {
+            LM_THROW_EXCEPTION(Error::IOError, "Failed to open backing file [path='{}']", path_);
+        }
+    }
+
+    // Get resident tile pinned for the caller. Loads or allocates the tile if not resident.
+    // The caller must unpin the tile with release().
+    Tile* acquire(int i) {
+        while (auto* tile = resident_[i].load(std::memory_order_acquire)) {
+            // The tile might be flushed between the load and the pin.
+            // The flush clears resident_ before waiting for the users,
+            // so the tile is valid if it is still resident after the pin.
+            tile->users.fetch_add(1);
+            if (resident_[i].load(std::memory_order_acquire) == tile) {
+                return tile;
+            }
+            release(tile);
+        }
+        std::unique_lock<std::mutex> lock(tiles_lock_);
+        if (auto* tile = resident_[i].load(std::memory_order_acquire); tile) {
+            tile->users.fetch_add(1);
+            return tile;
+        }
+        auto tile = std::make_unique<Tile>();
+        tile->finished = 0;
+        tile->users = 1;
+        if (flushed_[i]) {
+            read_tile_unlocked(i, tile->data);
+        }
+        else {
+            tile->data.assign(tile_pixels(i), Vec3(0_f));
+        }
+        auto* p = tile.get();
+        tiles_.push_back(std::move(tile));
+        resident_[i].store(p, std::memory_order_release);
+        return p;
+    }
+
+    // Unpin the tile
+    static void release(Tile* tile) {
+        tile->users.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Update a pixel
+    template <typename Func>
+    void update(int x, int y, Func&& func) {
+        const int tx = x / tile_size_;
+        const int ty = y / tile_size_;
+        auto* tile = acquire(ty * num_tiles_x() + tx);
+        const int i = (y - ty * tile_size_) * std::min(tile_size_, w_ - tx * tile_size_) + (x - tx * tile_size_);
+        {
+            std::unique_lock<std::mutex> lock(tile->lock);
+            auto& v = tile->data[i];
+            v = func(v);
+        }
+        release(tile);
+    }
+
+    // Write the tile to the file and release the memory of the pixels.
+    // The tile is removed from resident_ first so that no writer pins the tile anymore,
+    // and written after the writers pinning the tile finish the updates.
+    // The release of the tile itself is deferred to reclaim().
+    void flush(int i) const {
+        std::unique_lock<std::mutex> lock(tiles_lock_);
+        auto* tile = resident_[i].load(std::memory_order_acquire);
+        if (!tile) {
+            return;
+        }
+        resident_[i].store(nullptr, std::memory_order_release);
+        while (tile->users.load(std::memory_order_acquire) > 0) {
+            std::this_thread::yield();
+        }
+        write_tile_unlocked(i, tile->data);
+        flushed_[i] = 1;
+        std::vector<Vec3>().swap(tile->data);
+        const auto it = std::find_if(tiles_.begin(), tiles_.end(), [&](const auto& t) { return t.get() == tile; });
+        retired_.push_back(std::move(*it));
+        tiles_.erase(it);
+    }
+
+    // Release the flushed tiles. Must be called when no writer accesses the film.
+    void reclaim() const {
+        std::unique_lock<std::mutex> lock(tiles_lock_);
+        retired_.clear();
+    }
+
+    // Flush all resident tiles
+    void flush_all() const {
+        for (int i = 0; i < int(resident_.size()); i++) {
+            flush(i);
+        }
+    }
+
+    void read_tile(int i, std::vector<Vec3>& data) const {
+        std::unique_lock<std::mutex> lock(tiles_lock_);
+        read_tile_unlocked(i, data);
+    }
+
+    void write_tile(int i, const std::vector<Vec3>& data) const {
+        std::unique_lock<std::mutex> lock(tiles_lock_);
+        write_tile_unlocked(i, data);
+    }
+
+    // Read the pixels of the tile from the file
+    void read_tile_unlocked(int i, std::vector<Vec3>& data) const {
+        int x0, y0, x1, y1;
+        tile_range(i, x0, y0, x1, y1);
+        const int tw = x1 - x0;
+        data.resize(size_t(tw) * (y1 - y0));
+        std::vector<float> row(size_t(tw) * 3);
+        for (int y = y0; y < y1; y++) {
+            file_.seekg(pixel_offset(x0, y));
+            file_.read(reinterpret_cast<char*>(row.data()), row.size() * sizeof(float));
+            for (int x = 0; x < tw; x++) {
+                data[size_t(y - y0) * tw + x] = Vec3(row[3*x], row[3*x+1], row[3*x+2]);
+            }
+        }
+    }
+
+    // Write the pixels of the tile to the file
+    void write_tile_unlocked(int i, const std::vector<Vec3>& data) const {
+        int x0, y0, x1, y1;
+        tile_range(i, x0, y0, x1, y1);
+        const int tw = x1 - x0;
+        std::vector<float> row(size_t(tw) * 3);
+        for (int y = y0; y < y1; y++) {
+            for (int x = 0; x < tw; x++) {
+                const auto& v = data[size_t(y - y0) * tw + x];
+                row[3*x] = float(v.x);
+                row[3*x+1] = float(v.y);
+                row[3*x+2] = float(v.z);
+            }
+            file_.seekp(pixel_offset(x0, y));
+            file_.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+        }
+    }
+
+    // Offset of the pixel in the backing file.
+    // Rows of .pfm are stored bottom-to-top, which is the same as the film.
+    std::streamoff pixel_offset(int x, int y) const {
+        return header_size_ + (std::streamoff(y) * w_ + x) * 3 * std::streamoff(sizeof(float));
+    }
+};
+
+LM_COMP_REG_IMPL(Film_Tiled, "film::tiled");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -18,6 +18,11 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
     :param color Ke: Luminance.
     :param str mesh: Underlying mesh specified by asset name or locator.
+
+    The positions and the geometry normals of the triangles are copied from the mesh
+    into separate arrays on construction, and a triangle is selected with the alias method
+    in constant time. Sampling a position thus needs neither the binary search
+    nor the virtual call to the mesh.
 \endrst
 */
 class Light_Area final : public Light {
@@ -27,15 +32,23 @@ private:
     Float invA_;  // Inverse area of area lights
     Mesh* mesh_;  // Underlying mesh
 
+    // Triangles of the mesh in SoA layout for surface sampling
+    std::vector<Vec3> p1_, p2_, p3_;    // Vertex positions
+    std::vector<Vec3> gn_;              // Geometry normals
+
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(Ke_, dist_, invA_, mesh_);
+        ar(Ke_, dist_, invA_, mesh_, p1_, p2_, p3_, gn_);
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visit) override {
         comp::visit(visit, mesh_);
     }
 
+    virtual size_t memory_usage() const override {
+        return dist_.memory_usage() + comp::bytes_of(p1_, p2_, p3_, gn_);
+    }
+
 private:
     Float tranformed_invA(const Transform& transform) const {
         // TODO: Handle degenerated axis
@@ -47,12 +60,8 @@ private:
     PointGeometry sample_position_on_triangle_mesh(Vec2 up, Float upc, const Transform& transform) const {
         const int i = dist_.sample(upc);
         const auto s = math::safe_sqrt(up[0]);
-        const auto tri = mesh_->triangle_at(i);
-        const auto a = tri.p1.p;
-        const auto b = tri.p2.p;
-        const auto c = tri.p3.p;
-        const auto p = math::mix_barycentric(a, b, c, Vec2(1_f - s, up[1]*s));
-        const auto gn = math::geometry_normal(a, b, c);
+        const auto p = math::mix_barycentric(p1_[i], p2_[i], p3_[i], Vec2(1_f - s, up[1]*s));
+        const auto gn = gn_[i];
         const auto p_trans = Vec3(transform.M * Vec4(p, 1_f));
         const auto gn_trans = glm::normalize(transform.normal_M * gn);
         return PointGeometry::make_on_surface(p_trans, gn_trans, gn_trans);
@@ -63,14 +72,44 @@ public:
         Ke_ = json::value<Vec3>(prop, "Ke");
         mesh_ = json::comp_ref<Mesh>(prop, "mesh");
         
-        // Construct CDF for surface sampling
-        // Note we construct the CDF before transformation
-        mesh_->foreach_triangle([&](int, const Mesh::Tri& tri) {
-            const auto cr = cross(tri.p2.p - tri.p1.p, tri.p3.p - tri.p1.p);
-            dist_.add(math::safe_sqrt(glm::dot(cr, cr)) * .5_f);
+        // Construct the distribution and the triangle arrays for surface sampling
+        // Note we construct them before transformation
+        dist_.clear();
+        const int n = mesh_->num_triangles();
+        p1_.resize(n);
+        p2_.resize(n);
+        p3_.resize(n);
+        gn_.resize(n);
+        mesh_->foreach_triangle_positions([&](int face, int num_faces, const Vec3* ps) {
+            for (int i = 0; i < num_faces; i++) {
+                const auto a = ps[3*i];
+                const auto b = ps[3*i+1];
+                const auto c = ps[3*i+2];
+                const auto cr = cross(b - a, c - a);
+                dist_.add(math::safe_sqrt(glm::dot(cr, cr)) * .5_f);
+                p1_[face + i] = a;
+                p2_[face + i] = b;
+                p3_[face + i] = c;
+                gn_[face + i] = math::geometry_normal(a, b, c);
+            }
         });
         invA_ = 1_f / dist_.c.back();
         dist_.norm();
+        dist_.init_alias();
+    }
+
+    virtual Float power(const Transform& transform) const override {
+        return Pi * math::luminance(Ke_) / tranformed_invA(transform);
+    }
+
+    virtual std::optional<Bound> bound(const Transform& transform) const override {
+        Bound b;
+        mesh_->foreach_triangle_positions([&](int, int num_faces, const Vec3* ps) {
+            for (int i = 0; i < 3 * num_faces; i++) {
+                b = merge(b, Vec3(transform.M * Vec4(ps[i], 1_f)));
+            }
+        });
+        return b;
     }
 
     // --------------------------------------------------------------------------------------------
@@ -156,7 +195,8 @@ public:
         return RaySample{
             geomL,
             wo,
-            Le / pL
+            Le / pL,
+            pL
         };
     }
 
@@ -7,6 +7,7 @@
 #include <lm/core.h>
 #include <lm/light.h>
 #include <lm/texture.h>
+#include <lm/parallel.h>
 
 #define LIGHT_ENV_DEBUG_USE_CONST_TEXTURE 0
 
@@ -21,6 +22,23 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
     :param str envmap_path: Path to environment map.
     :param float rot: Rotation angle of the environment map around up vector in degrees.
                       Default value: 0.
+    :param bool alias: Sample the directions with the alias method. Default value: false.
+    :param str filter: Reconstruction filter of the environment map (``nearest``, ``bilinear``).
+                       Default value: ``nearest``.
+
+    With ``alias`` enabled, the sampling of the directions costs a constant-time table lookup
+    instead of two binary searches, which matters for high-resolution environment maps.
+
+    The texels of the environment map are materialized once as a float image
+    with :cpp:func:`lm::Texture::buffer`, from which the sampling distribution is computed in parallel
+    and the radiance is looked up directly without the virtual call to the texture.
+    If the texture provides no buffer, the light falls back to :cpp:func:`lm::Texture::eval`,
+    where the texel centers of a row are evaluated at once with :cpp:func:`lm::Texture::eval_batch`.
+
+    With ``bilinear`` filter, the radiance is interpolated from the four nearest texels
+    in the same way as ``texture::bitmap``. The sampling distribution is then computed from the
+    average of the interpolated radiance over each texel, so that the texels receiving
+    the radiance from the neighbors are also sampled.
 \endrst
 */
 class Light_Env final : public Light {
@@ -30,10 +48,17 @@ private:
     Float rot_;                         // Rotation of the environment map around (0,1,0)
     Float scale_;                       // Scale multilied to stored luminance
     Dist2 dist_;                        // For sampling directions
+    Float Le_integral_ = 0_f;           // Integral of the luminance over directions
+    TextureBuffer buf_{};               // Texels of the environment map. data is nullptr if unavailable.
+    bool bilinear_ = false;             // Bilinear filtering if true
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(sphere_bound_, envmap_, rot_, dist_);
+        ar(sphere_bound_, envmap_, rot_, scale_, dist_, Le_integral_, bilinear_);
+        if constexpr (std::is_same_v<Archive, InputArchive>) {
+            // Texture buffer refers to the memory owned by the texture
+            buf_ = envmap_->buffer();
+        }
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visitor) override {
@@ -47,6 +72,11 @@ public:
         return nullptr;
     }
 
+    // The texture buffer is owned by the texture
+    virtual size_t memory_usage() const override {
+        return dist_.memory_usage();
+    }
+
 public:
     virtual void construct(const Json& prop) override {
         #if LIGHT_ENV_DEBUG_USE_CONST_TEXTURE
@@ -61,26 +91,117 @@ public:
         #endif
         rot_ = glm::radians(json::value(prop, "rot", 0_f));
         scale_ = json::value(prop, "scale", 1_f);
+        const auto filter = json::value<std::string>(prop, "filter", "nearest");
+        if (filter != "nearest" && filter != "bilinear") {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid filter [filter='{}']", filter);
+        }
+        bilinear_ = filter == "bilinear";
         const auto [w, h] = envmap_->size();
-        std::vector<Float> ls(w * h);
-        for (int i = 0; i < w*h; i++) {
-            const int x = i % w;
-            const int y = i / w;
-            const auto v = envmap_->eval_by_pixel_coords(x, y) * scale_;
-            ls[i] = glm::compMax(v) * std::sin(Pi * (Float(i) / w + .5_f) / h);
+        buf_ = envmap_->buffer();
+
+        // Sampling distribution weighted by the Jacobian of the spherical mapping, computed per row
+        std::vector<Float> ls(size_t(w) * h);
+        std::vector<Float> row_integrals(h);
+        parallel::foreach(h, [&](long long index, int) {
+            const int y = int(index);
+            const auto st = std::sin(Pi * (y + .5_f) / h);
+            std::vector<Vec3> row(w);
+            if (buf_.data) {
+                for (int x = 0; x < w; x++) {
+                    row[x] = texel(x, y);
+                }
+            }
+            else {
+                std::vector<Vec2> ts(w);
+                for (int x = 0; x < w; x++) {
+                    ts[x] = Vec2((x + .5_f) / w, (y + .5_f) / h);
+                }
+                envmap_->eval_batch(w, ts.data(), row.data());
+            }
+            Float sum = 0_f;
+            for (int x = 0; x < w; x++) {
+                const auto v = row[x] * scale_;
+                ls[size_t(y) * w + x] = glm::compMax(v) * st;
+                sum += math::luminance(v) * st;
+            }
+            row_integrals[y] = sum;
+        });
+        Le_integral_ = 0_f;
+        for (const auto v : row_integrals) {
+            Le_integral_ += v;
+        }
+        Le_integral_ *= 2_f * Pi * Pi / (w * h);
+        if (bilinear_) {
+            filter_texel_average(ls, w, h);
         }
-        dist_.init(ls, w, h);
+        dist_.init(ls, w, h, json::value(prop, "alias", false));
+    }
+
+private:
+    // Radiance of the texel of the environment map. Requires the buffer.
+    Vec3 texel(int x, int y) const {
+        const float* p = buf_.data + (size_t(y) * buf_.w + x) * buf_.c;
+        return buf_.c <= 2 ? Vec3(p[0]) : Vec3(p[0], p[1], p[2]);
+    }
+
+    // Radiance of the bilinear lookup of the environment map. Requires the buffer.
+    // The neighbors wrap around the border as the lookup of the texture.
+    Vec3 bilinear_texel(Float u, Float v) const {
+        const auto fx = u * buf_.w - .5_f;
+        const auto fy = (v - floor(v)) * buf_.h - .5_f;
+        const auto x0f = std::floor(fx);
+        const auto y0f = std::floor(fy);
+        const auto dx = fx - x0f;
+        const auto dy = fy - y0f;
+        const int x0 = (int(x0f) + buf_.w) % buf_.w;
+        const int y0 = (int(y0f) + buf_.h) % buf_.h;
+        const int x1 = (x0 + 1) % buf_.w;
+        const int y1 = (y0 + 1) % buf_.h;
+        return (1_f - dx) * (1_f - dy) * texel(x0, y0) + dx * (1_f - dy) * texel(x1, y0)
+            + (1_f - dx) * dy * texel(x0, y1) + dx * dy * texel(x1, y1);
     }
 
+    // Replace the texel values by the averages of the bilinear interpolation over the texels.
+    // The average is the separable filter of the weights (1,6,1)/8 of the texel and its neighbors,
+    // which is positive wherever the interpolated value is positive.
+    static void filter_texel_average(std::vector<Float>& ls, int w, int h) {
+        const auto filter = [](Float a, Float b, Float c) {
+            return (a + 6_f * b + c) / 8_f;
+        };
+        std::vector<Float> tmp(ls.size());
+        parallel::foreach(h, [&](long long index, int) {
+            const auto* r = &ls[size_t(index) * w];
+            for (int x = 0; x < w; x++) {
+                tmp[size_t(index) * w + x] = filter(r[(x + w - 1) % w], r[x], r[(x + 1) % w]);
+            }
+        });
+        parallel::foreach(h, [&](long long index, int) {
+            const int y = int(index);
+            const auto* r0 = &tmp[size_t((y + h - 1) % h) * w];
+            const auto* r1 = &tmp[size_t(y) * w];
+            const auto* r2 = &tmp[size_t((y + 1) % h) * w];
+            for (int x = 0; x < w; x++) {
+                ls[size_t(y) * w + x] = filter(r0[x], r1[x], r2[x]);
+            }
+        });
+    }
+
+public:
     // --------------------------------------------------------------------------------------------
 
     virtual void set_scene_bound(const Bound& bound) {
+        mark_dirty();
         // Compute the bounding sphere of the scene.
         // Although it is inefficient, currently we just use a convervative bound of AABB.
         sphere_bound_.center = (bound.max + bound.min) * .5_f;
         sphere_bound_.radius = glm::length(bound.max - sphere_bound_.center) * 1.01_f;
     }
 
+    virtual Float power(const Transform&) const override {
+        // Power incident to the disk covering the scene from all directions
+        return Pi * math::sq(sphere_bound_.radius) * Le_integral_;
+    }
+
     // --------------------------------------------------------------------------------------------
 
     virtual std::optional<RaySample> sample_ray(const RaySampleU& us, const Transform&) const override {
@@ -152,7 +273,8 @@ public:
         return RaySample{
             geomL,
             wo,
-            C
+            C,
+            pL
         };
     }
 
@@ -198,7 +320,18 @@ public:
             return at < 0_f ? at + 2_f * Pi : at;
         }();
         const auto t = (at - rot_) * .5_f / Pi;
-        return envmap_->eval({ t - floor(t), acos(d.y) / Pi }) * scale_;
+        const auto u = t - floor(t);
+        const auto v = acos(d.y) / Pi;
+        if (!buf_.data) {
+            return envmap_->eval({ u, v }) * scale_;
+        }
+        if (bilinear_) {
+            return bilinear_texel(u, v) * scale_;
+        }
+        // Same texel as the nearest lookup of the texture
+        const int x = std::clamp(int(u * buf_.w), 0, buf_.w - 1);
+        const int y = std::clamp(int((v - floor(v)) * buf_.h), 0, buf_.h - 1);
+        return texel(x, y) * scale_;
     }
 };
 
@@ -36,12 +36,18 @@ public:
     // --------------------------------------------------------------------------------------------
 
     virtual void set_scene_bound(const Bound& bound) {
+        mark_dirty();
         // Compute the bounding sphere of the scene.
         // Although it is inefficient, currently we just use a convervative bound of AABB.
         sphere_bound_.center = (bound.max + bound.min) * .5_f;
         sphere_bound_.radius = glm::length(bound.max - sphere_bound_.center) * 1.01_f;
     }
 
+    virtual Float power(const Transform&) const override {
+        // Power incident to the disk covering the scene from all directions
+        return 4_f * Pi * Pi * math::sq(sphere_bound_.radius) * math::luminance(Le_);
+    }
+
     // --------------------------------------------------------------------------------------------
 
     virtual std::optional<RaySample> sample_ray(const RaySampleU& us, const Transform&) const override {
@@ -109,7 +115,8 @@ public:
         return RaySample{
             geomL,
             wo,
-            Le / pL
+            Le / pL,
+            pL
         };
     }
 
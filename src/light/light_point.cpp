@@ -35,6 +35,14 @@ public:
         position_ = json::value<Vec3>(prop, "position");
     }
 
+    virtual Float power(const Transform&) const override {
+        return 4_f * Pi * math::luminance(Le_);
+    }
+
+    virtual std::optional<Bound> bound(const Transform&) const override {
+        return merge(Bound(), position_);
+    }
+
     virtual std::optional<RaySample> sample_ray(const RaySampleU& us, const Transform&) const override {
         const auto d = math::sample_uniform_sphere(us.ud);
         const auto geomL = PointGeometry::make_degenerated(position_);
@@ -92,7 +100,8 @@ public:
         return RaySample{
             geomL,
             wo,
-            C
+            C,
+            pL
         };
     }
 
@@ -6,6 +6,7 @@
 #include <pch.h>
 #include <lm/logger.h>
 #include <lm/loggercontext.h>
+#include <lm/profiler.h>
 #include "ext/rang.hpp"
 
 // ------------------------------------------------------------------------------------------------
@@ -53,12 +54,32 @@ public:
             return;
         }
 
-        std::unique_lock<std::mutex> lock(mutex_);
+        // The wait for the lock is recorded to measure the contention of the logging threads
+        const auto lock = [this]() {
+            LM_PROFILE_SCOPE(LogWait);
+            return std::unique_lock<std::mutex>(mutex_);
+        }();
 
         // Elapsed time
         const auto now = std::chrono::high_resolution_clock::now();
         const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_);
 
+        write(level, filename, line, elapsed.count(), message);
+    }
+
+    void update_indentation(int n) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        apply_indentation(n);
+    }
+
+    void set_severity(int severity) override {
+        severity_ = severity;
+    }
+
+public:
+    // Format and write the message with elapsed time in milliseconds.
+    // The caller is responsible for the synchronization.
+    void write(LogLevel level, const char* filename, int line, long long elapsed, const char* message) {
         // Line and filename
         const auto line_and_filename = fmt::format("{}@{}",
             line,
@@ -74,12 +95,12 @@ public:
         std::string header;
         if (show_line_and_file_) {
             header = fmt::format("[{}|{:.3f}|{:<10}] ",
-                style.name, elapsed.count() / 1000.0,
+                style.name, elapsed / 1000.0,
                 line_and_filename.substr(0, 10));
         }
         else {
             header = fmt::format("[{}|{:.3f}] ",
-                style.name, elapsed.count() / 1000.0,
+                style.name, elapsed / 1000.0,
                 line_and_filename.substr(0, 10));
         }
 
@@ -158,8 +179,8 @@ public:
         }
     }
 
-    void update_indentation(int n) {
-        std::unique_lock<std::mutex> lock(mutex_);
+    // Update indentation. The caller is responsible for the synchronization.
+    void apply_indentation(int n) {
         indentation_ += n;
         if (indentation_ > 0) {
             indentation_string_ = std::string(2 * indentation_, '.') + " ";
@@ -169,13 +190,231 @@ public:
             indentation_string_ = "";
         }
     }
+};
 
-    void set_severity(int severity) override {
-        severity_ = severity;
+LM_COMP_REG_IMPL(LoggerContext_Default, "logger::default");
+
+// ------------------------------------------------------------------------------------------------
+
+// Asynchronous logger.
+// The messages are pushed to a bounded lock-free ring buffer (multiple producers, single consumer)
+// and a background thread formats and writes them with the default logger.
+// When the buffer is full, the messages are dropped and the number of the dropped messages
+// is reported from the background thread, unless `drop` is false,
+// in which case the caller waits until the buffer has space.
+// The pending messages are written when the logger is shutdown.
+class LoggerContext_Async : public LoggerContext {
+private:
+    static constexpr int MessageSize = 256;
+    static constexpr int FilenameSize = 32;
+
+    enum class EntryType {
+        Log,
+        Indentation,
+    };
+
+    struct Entry {
+        EntryType type;
+        LogLevel level;
+        int line;
+        int indentation;
+        long long elapsed;                  // Elapsed time in milliseconds
+        char filename[FilenameSize];        // Stem of the filename
+        char message[MessageSize];
+        std::string long_message;           // Used only if the message exceeds MessageSize
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<size_t> seq;
+        Entry entry;
+    };
+
+private:
+    LoggerContext_Default writer_;
+    #if LM_DEBUG_MODE
+    std::atomic<int> severity_{-100};
+    #else
+    std::atomic<int> severity_{0};
+    #endif
+    std::chrono::time_point<std::chrono::high_resolution_clock> start_ =
+        std::chrono::high_resolution_clock::now();
+    bool drop_;
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> tail_{0};  // Next position to push
+    alignas(64) size_t head_ = 0;               // Next position to pop, only used by the consumer
+    std::atomic<long long> dropped_{0};         // Number of dropped messages since the last report
+
+    std::atomic<bool> done_{false};
+    std::thread thread_;
+
+public:
+    virtual void construct(const Json& prop) override {
+        writer_.construct(prop);
+        drop_ = json::value<bool>(prop, "drop", true);
+
+        // Round up the capacity to the power of two
+        const auto capacity = json::value<size_t>(prop, "capacity", 8192);
+        size_t n = 2;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        mask_ = n - 1;
+        slots_ = std::make_unique<Slot[]>(n);
+        for (size_t i = 0; i < n; i++) {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        thread_ = std::thread([this] { process(); });
+    }
+
+    ~LoggerContext_Async() {
+        if (thread_.joinable()) {
+            done_.store(true, std::memory_order_release);
+            thread_.join();
+        }
+    }
+
+public:
+    virtual void log(LogLevel level, int severity, const char* filename, int line, const char* message) override {
+        if (severity_.load(std::memory_order_relaxed) > severity) {
+            return;
+        }
+        const auto now = std::chrono::high_resolution_clock::now();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_).count();
+        push(drop_, [&](Entry& e) {
+            e.type = EntryType::Log;
+            e.level = level;
+            e.line = line;
+            e.elapsed = elapsed;
+            copy_stem(e.filename, filename);
+            const auto len = strlen(message);
+            if (len < MessageSize) {
+                memcpy(e.message, message, len + 1);
+                e.long_message.clear();
+            }
+            else {
+                e.message[0] = '\0';
+                e.long_message.assign(message, len);
+            }
+        });
+    }
+
+    virtual void update_indentation(int n) override {
+        // Indentation must not be dropped, otherwise the following messages are misaligned
+        push(false, [&](Entry& e) {
+            e.type = EntryType::Indentation;
+            e.indentation = n;
+        });
+    }
+
+    virtual void set_severity(int severity) override {
+        severity_.store(severity, std::memory_order_relaxed);
+    }
+
+private:
+    // Copy stem of the path, which is the only part used in the output
+    static void copy_stem(char* dst, const char* path) {
+        const char* begin = path;
+        const char* end = nullptr;
+        for (const char* p = path; *p; p++) {
+            if (*p == '/' || *p == '\\') {
+                begin = p + 1;
+                end = nullptr;
+            }
+            else if (*p == '.') {
+                end = p;
+            }
+        }
+        if (!end) {
+            end = begin + strlen(begin);
+        }
+        const auto len = std::min<size_t>(end - begin, FilenameSize - 1);
+        memcpy(dst, begin, len);
+        dst[len] = '\0';
+    }
+
+    // Push an entry. Returns false if the entry is dropped.
+    template <typename Func>
+    bool push(bool drop, Func&& fill) {
+        auto pos = tail_.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots_[pos & mask_];
+            const auto seq = slot->seq.load(std::memory_order_acquire);
+            const auto diff = (long long)seq - (long long)pos;
+            if (diff == 0) {
+                // The slot is free. Try to acquire it.
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                // The buffer is full
+                if (drop) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                std::this_thread::yield();
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+            else {
+                // Other producer acquired the slot
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        fill(slot->entry);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pop an entry and write it. Returns false if the buffer is empty.
+    bool pop_and_write() {
+        auto& slot = slots_[head_ & mask_];
+        if (slot.seq.load(std::memory_order_acquire) != head_ + 1) {
+            return false;
+        }
+        const auto& e = slot.entry;
+        if (e.type == EntryType::Log) {
+            writer_.write(e.level, e.filename, e.line, e.elapsed,
+                e.long_message.empty() ? e.message : e.long_message.c_str());
+        }
+        else {
+            writer_.apply_indentation(e.indentation);
+        }
+        slot.seq.store(head_ + mask_ + 1, std::memory_order_release);
+        head_++;
+        return true;
+    }
+
+    // Main loop of the background thread
+    void process() {
+        while (true) {
+            // Check the flag before draining so that the messages pushed before shutdown are written
+            const bool done = done_.load(std::memory_order_acquire);
+            bool written = false;
+            while (pop_and_write()) {
+                written = true;
+            }
+            const auto dropped = dropped_.exchange(0, std::memory_order_relaxed);
+            if (dropped > 0) {
+                const auto now = std::chrono::high_resolution_clock::now();
+                const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_).count();
+                const auto message = fmt::format("{} log messages are dropped", dropped);
+                writer_.write(LogLevel::Warn, __FILE__, __LINE__, elapsed, message.c_str());
+            }
+            if (done) {
+                break;
+            }
+            if (!written) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
     }
 };
 
-LM_COMP_REG_IMPL(LoggerContext_Default, "logger::default");
+LM_COMP_REG_IMPL(LoggerContext_Async, "logger::async");
 
 // ------------------------------------------------------------------------------------------------
 
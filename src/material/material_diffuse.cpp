@@ -67,7 +67,7 @@ public:
 
     virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& us, const PointGeometry& geom, Vec3 wi, int, TransDir) const override {
         const auto[n, u, v] = geom.orthonormal_basis_twosided(wi);
-        const auto Kd = mapKd_ ? mapKd_->eval(geom.t) : Kd_;
+        const auto Kd = mapKd_ ? mapKd_->eval_filtered(geom.t, geom.footprint) : Kd_;
         const auto d = math::sample_cosine_weighted(us.ud);
         return DirectionSample{
             u*d.x + v * d.y + n * d.z,
@@ -76,7 +76,7 @@ public:
     }
 
     virtual Vec3 reflectance(const PointGeometry& geom) const override {
-        return mapKd_ ? mapKd_->eval(geom.t) : Kd_;
+        return mapKd_ ? mapKd_->eval_filtered(geom.t, geom.footprint) : Kd_;
     }
 
     virtual Float pdf_direction(const PointGeometry& geom, Vec3 wi, Vec3 wo, int, bool) const override {
@@ -87,12 +87,14 @@ public:
         if (geom.opposite(wi, wo)) {
             return {};
         }
-        return (mapKd_ ? mapKd_->eval(geom.t) : Kd_) / Pi;
+        return (mapKd_ ? mapKd_->eval_filtered(geom.t, geom.footprint) : Kd_) / Pi;
     }
 
     virtual bool is_specular_component(int) const override {
         return false;
     }
+
+    LM_MATERIAL_BATCH_IMPL()
 };
 
 LM_COMP_REG_IMPL(Material_Diffuse, "material::diffuse");
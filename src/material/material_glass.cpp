@@ -19,6 +19,8 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
     Fresnel reflection and refraction.
 
     :param float Ni: Relative index of refraction.
+    :param float dispersion: Coefficient :math:`B` of Cauchy's equation in :math:`\mu\mathrm{m}^2`.
+                             Default value: 0 (no dispersion).
 
     This component implement Fresnel reflection and refraction BSDF, which reads
 
@@ -58,6 +60,14 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
     Reflection or refraction is determined by sampling Fresnel term.
 
+    If ``dispersion`` is nonzero, the index of refraction depends on the wavelength
+    according to Cauchy's equation :math:`n(\lambda) = A + B/\lambda^2`,
+    where :math:`A` is chosen such that ``Ni`` is the index of refraction
+    at the wavelength of the sodium D line (589.3nm).
+    The wavelength-dependent index is used in the spectral mode of the renderers
+    via :cpp:func:`lm::Material::sample_direction_spectral`.
+    Otherwise ``Ni`` is used.
+
     .. [Schlick1994] C. Schlick.
                     An Inexpensive BRDF Model for Physically-based Rendering.
                     Computer Graphics Forum. 13 (3): 233. 1994.
@@ -66,6 +76,7 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 class Material_Glass final : public Material {
 private:
     Float Ni_;
+    Float dispersion_;  // Coefficient B of Cauchy's equation in um^2
 
 private:
     #if MATERIAL_GLASS_USE_COMPONENT_SAMPLING
@@ -77,7 +88,7 @@ private:
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(Ni_);
+        ar(Ni_, dispersion_);
     }
 
 private:
@@ -86,13 +97,19 @@ private:
         return trans_dir == TransDir::EL ? eta * eta : 1_f;
     }
 
+    // Index of refraction for the wavelength in nm
+    Float ior(Float lambda) const {
+        // Wavelength of sodium D line in um
+        constexpr Float LambdaD = .5893_f;
+        const auto l = lambda * 1e-3_f;
+        return Ni_ + dispersion_ * (1_f / (l * l) - 1_f / (LambdaD * LambdaD));
+    }
+
     // Fresnel term
-    Float fresnel(Vec3 wi, Vec3 wt, const PointGeometry& geom) const {
+    Float fresnel(Vec3 wi, Vec3 wt, const PointGeometry& geom, Float Ni) const {
         const bool in = glm::dot(wi, geom.n) > 0_f;
-        const auto n = in ? geom.n : -geom.n;
-        const auto eta = in ? 1_f / Ni_ : Ni_;
         const auto cos = in ? glm::dot(wi, geom.n) : glm::dot(wt, geom.n);
-        const auto r = (1_f - Ni_) / (1_f + Ni_);
+        const auto r = (1_f - Ni) / (1_f + Ni);
         const auto r2 = r * r;
         return r2 + (1_f - r2) * std::pow(1_f - cos, 5_f);
     }
@@ -103,7 +120,7 @@ private:
         const auto n = in ? geom.n : -geom.n;
         const auto eta = in ? 1_f / Ni_ : Ni_;
         const auto [wt, total] = math::refraction(wi, n, eta);
-        const auto Fr = total ? 1_f : fresnel(wi, wt, geom);
+        const auto Fr = total ? 1_f : fresnel(wi, wt, geom, Ni_);
 
         // Choose delta component according to the relashionship of wi and wo
         if (!geom.opposite(wi, wo)) {
@@ -116,56 +133,14 @@ private:
         }
     }
 
-public:
-    virtual void construct(const Json& prop) override {
-        Ni_ = json::value<Float>(prop, "Ni");
-    }
-
-    virtual ComponentSample sample_component(const ComponentSampleU& u, const PointGeometry& geom, Vec3 wi) const override {
-        #if MATERIAL_GLASS_USE_COMPONENT_SAMPLING
-        const bool in = glm::dot(wi, geom.n) > 0_f;
-        const auto n = in ? geom.n : -geom.n;
-        const auto eta = in ? 1_f / Ni_ : Ni_;
-        const auto [wt, total] = math::refraction(wi, n, eta);
-        const auto Fr = total ? 1_f : fresnel(wi, wt, geom);
-        const int comp = u.uc[0] < Fr ? Comp_Reflection : Comp_Refraction;
-        const auto pdf = comp == Comp_Reflection ? Fr : 1_f - Fr;
-        return {
-            comp,
-            1_f / pdf
-        };
-        #else
-        LM_UNUSED(u, geom, wi);
-        return { 0, 1_f };
-        #endif
-    }
-
-    virtual Float pdf_component(int comp, const PointGeometry& geom, Vec3 wi) const override {
-        #if MATERIAL_GLASS_USE_COMPONENT_SAMPLING
-        const bool in = glm::dot(wi, geom.n) > 0_f;
-        const auto n = in ? geom.n : -geom.n;
-        const auto eta = in ? 1_f / Ni_ : Ni_;
-        const auto [wt, total] = math::refraction(wi, n, eta);
-        const auto Fr = total ? 1_f : fresnel(wi, wt, geom);
-        if (comp == Comp_Reflection) {
-            return Fr;
-        }
-        else {
-            return 1_f - Fr;
-        }
-        #else
-        LM_UNUSED(comp, geom, wi);
-        return 1_f;
-        #endif
-    }
-
-    virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& u, const PointGeometry& geom, Vec3 wi, int comp, TransDir trans_dir) const override {
+    // Direction sampling given the index of refraction
+    std::optional<DirectionSample> sample_direction_ior(const DirectionSampleU& u, const PointGeometry& geom, Vec3 wi, int comp, TransDir trans_dir, Float Ni) const {
         #if MATERIAL_GLASS_USE_COMPONENT_SAMPLING
         LM_UNUSED(u);
         if (comp == Comp_Reflection) {
             // Reflection
             const auto wo = math::reflection(wi, geom.n);
-            const auto f = eval(geom, wi, wo, comp, trans_dir, false);
+            const auto f = eval_ior(geom, wi, wo, comp, trans_dir, false, Ni);
             const auto p = pdf_direction(geom, wi, wo, comp, false);
             const auto C = f / p;
             return DirectionSample{
@@ -177,10 +152,10 @@ public:
             // Refraction
             const bool in = glm::dot(wi, geom.n) > 0_f;
             const auto n = in ? geom.n : -geom.n;
-            const auto eta = in ? 1_f / Ni_ : Ni_;
+            const auto eta = in ? 1_f / Ni : Ni;
             const auto [wt, total] = math::refraction(wi, n, eta);
             const auto wo = wt;
-            const auto f = eval(geom, wi, wo, comp, trans_dir, false);
+            const auto f = eval_ior(geom, wi, wo, comp, trans_dir, false, Ni);
             const auto p = pdf_direction(geom, wi, wo, comp, false);
             const auto C = f / p;
             return DirectionSample{
@@ -192,9 +167,9 @@ public:
         LM_UNUSED(comp);
         const bool in = glm::dot(wi, geom.n) > 0_f;
         const auto n = in ? geom.n : -geom.n;
-        const auto eta = in ? 1_f / Ni_ : Ni_;
+        const auto eta = in ? 1_f / Ni : Ni;
         const auto [wt, total] = math::refraction(wi, n, eta);
-        const auto Fr = total ? 1_f : fresnel(wi, wt, geom);
+        const auto Fr = total ? 1_f : fresnel(wi, wt, geom, Ni);
         if (u.udc[0] < Fr) {
             // Reflection
             // Fr / p_sel = 1
@@ -217,66 +192,123 @@ public:
         #endif
     }
 
-    virtual Float pdf_direction(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, bool eval_delta) const override {
+    // Evaluate BSDF given the index of refraction
+    Vec3 eval_ior(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta, Float Ni) const {
         if (eval_delta) {
-            return 0_f;
+            return Vec3(0_f);
         }
 
-        #if MATERIAL_GLASS_USE_COMPONENT_SAMPLING
-        LM_UNUSED(geom, wi, wo, comp);
-        return 1_f;
-        #else
-        LM_UNUSED(comp);
         const bool in = glm::dot(wi, geom.n) > 0_f;
         const auto n = in ? geom.n : -geom.n;
-        const auto eta = in ? 1_f / Ni_ : Ni_;
+        const auto eta = in ? 1_f / Ni : Ni;
         const auto [wt, total] = math::refraction(wi, n, eta);
-        const auto Fr = total ? 1_f : fresnel(wi, wt, geom);
+        const auto Fr = total ? 1_f : fresnel(wi, wt, geom, Ni);
 
-        // Choose delta component according to the relashionship of wi and wo
+        #if MATERIAL_GLASS_USE_COMPONENT_SAMPLING
+        LM_UNUSED(wo);
+        if (comp == Comp_Reflection) {
+            return Vec3(Fr);
+        }
+        else {
+            const auto refr_corr = refr_correction(eta, trans_dir);
+            return Vec3((1_f - Fr) * refr_corr);
+        }
+        #else
+        LM_UNUSED(comp);
         if (!geom.opposite(wi, wo)) {
-            // Reflection
-            return Fr;
+            return Vec3(Fr);
         }
         else {
-            // Refraction
-            return 1_f - Fr;
+            const auto refr_corr = refr_correction(eta, trans_dir);
+            return Vec3((1_f - Fr) * refr_corr);
         }
         #endif
     }
 
-    virtual Vec3 eval(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) const override {
-        if (eval_delta) {
-            return Vec3(0_f);
-        }
+public:
+    virtual void construct(const Json& prop) override {
+        Ni_ = json::value<Float>(prop, "Ni");
+        dispersion_ = json::value<Float>(prop, "dispersion", 0_f);
+    }
 
+    virtual ComponentSample sample_component(const ComponentSampleU& u, const PointGeometry& geom, Vec3 wi) const override {
+        #if MATERIAL_GLASS_USE_COMPONENT_SAMPLING
         const bool in = glm::dot(wi, geom.n) > 0_f;
         const auto n = in ? geom.n : -geom.n;
         const auto eta = in ? 1_f / Ni_ : Ni_;
         const auto [wt, total] = math::refraction(wi, n, eta);
-        const auto Fr = total ? 1_f : fresnel(wi, wt, geom);
+        const auto Fr = total ? 1_f : fresnel(wi, wt, geom, Ni_);
+        const int comp = u.uc[0] < Fr ? Comp_Reflection : Comp_Refraction;
+        const auto pdf = comp == Comp_Reflection ? Fr : 1_f - Fr;
+        return {
+            comp,
+            1_f / pdf
+        };
+        #else
+        LM_UNUSED(u, geom, wi);
+        return { 0, 1_f };
+        #endif
+    }
 
+    virtual Float pdf_component(int comp, const PointGeometry& geom, Vec3 wi) const override {
         #if MATERIAL_GLASS_USE_COMPONENT_SAMPLING
-        LM_UNUSED(wo);
+        const bool in = glm::dot(wi, geom.n) > 0_f;
+        const auto n = in ? geom.n : -geom.n;
+        const auto eta = in ? 1_f / Ni_ : Ni_;
+        const auto [wt, total] = math::refraction(wi, n, eta);
+        const auto Fr = total ? 1_f : fresnel(wi, wt, geom, Ni_);
         if (comp == Comp_Reflection) {
-            return Vec3(Fr);
+            return Fr;
         }
         else {
-            const auto refr_corr = refr_correction(eta, trans_dir);
-            return Vec3((1_f - Fr) * refr_corr);
+            return 1_f - Fr;
         }
         #else
+        LM_UNUSED(comp, geom, wi);
+        return 1_f;
+        #endif
+    }
+
+    virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& u, const PointGeometry& geom, Vec3 wi, int comp, TransDir trans_dir) const override {
+        return sample_direction_ior(u, geom, wi, comp, trans_dir, Ni_);
+    }
+
+    virtual std::optional<DirectionSample> sample_direction_spectral(const DirectionSampleU& u, const PointGeometry& geom, Vec3 wi, int comp, TransDir trans_dir, Float lambda) const override {
+        return sample_direction_ior(u, geom, wi, comp, trans_dir, ior(lambda));
+    }
+
+    virtual Float pdf_direction(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, bool eval_delta) const override {
+        if (eval_delta) {
+            return 0_f;
+        }
+
+        #if MATERIAL_GLASS_USE_COMPONENT_SAMPLING
+        LM_UNUSED(geom, wi, wo, comp);
+        return 1_f;
+        #else
         LM_UNUSED(comp);
+        const bool in = glm::dot(wi, geom.n) > 0_f;
+        const auto n = in ? geom.n : -geom.n;
+        const auto eta = in ? 1_f / Ni_ : Ni_;
+        const auto [wt, total] = math::refraction(wi, n, eta);
+        const auto Fr = total ? 1_f : fresnel(wi, wt, geom, Ni_);
+
+        // Choose delta component according to the relashionship of wi and wo
         if (!geom.opposite(wi, wo)) {
-            return Vec3(Fr);
+            // Reflection
+            return Fr;
         }
         else {
-            const auto refr_corr = refr_correction(eta, trans_dir);
-            return Vec3((1_f - Fr) * refr_corr);
+            // Refraction
+            return 1_f - Fr;
         }
         #endif
     }
 
+    virtual Vec3 eval(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) const override {
+        return eval_ior(geom, wi, wo, comp, trans_dir, eval_delta, Ni_);
+    }
+
     virtual Vec3 reflectance(const PointGeometry&) const override {
         return Vec3(0_f);
     }
@@ -284,6 +316,12 @@ public:
     virtual bool is_specular_component(int) const override {
         return true;
     }
+
+    virtual bool is_dispersive_component(int) const override {
+        return dispersion_ != 0_f;
+    }
+
+    LM_MATERIAL_BATCH_IMPL()
 };
 
 LM_COMP_REG_IMPL(Material_Glass, "material::glass");
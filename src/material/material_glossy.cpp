@@ -111,6 +111,8 @@ public:
     virtual bool is_specular_component(int) const override {
         return false;
     }
+
+    LM_MATERIAL_BATCH_IMPL()
 };
 
 LM_COMP_REG_IMPL(Material_Glossy, "material::glossy");
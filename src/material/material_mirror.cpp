@@ -60,6 +60,8 @@ public:
     virtual bool is_specular_component(int) const override {
         return true;
     }
+
+    LM_MATERIAL_BATCH_IMPL()
 };
 
 LM_COMP_REG_IMPL(Material_Mirror, "material::mirror");
@@ -96,9 +96,31 @@ public:
         return e.weight * e.material->eval(geom, wi, wo, {}, trans_dir, eval_delta);
     }
 
+    virtual DirectionEval eval_with_pdf(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) const override {
+        const auto& e = materials_[comp];
+        const auto r = e.material->eval_with_pdf(geom, wi, wo, {}, trans_dir, eval_delta);
+        return { e.weight * r.f, r.pdf };
+    }
+
     virtual bool is_specular_component(int comp) const override {
         return materials_[comp].material->is_specular_component({});
     }
+
+    virtual bool is_dispersive_component(int comp) const override {
+        return materials_[comp].material->is_dispersive_component({});
+    }
+
+    virtual std::optional<DirectionSample> sample_direction_spectral(const DirectionSampleU& us, const PointGeometry& geom, Vec3 wi, int comp, TransDir trans_dir, Float lambda) const override {
+        const auto& e = materials_[comp];
+        const auto s = e.material->sample_direction_spectral(us, geom, wi, {}, trans_dir, lambda);
+        if (!s) {
+            return {};
+        }
+        return DirectionSample{
+            s->wo,
+            e.weight * s->weight
+        };
+    }
 };
 
 LM_COMP_REG_IMPL(Material_ConstantWeightMixture_RR, "material::constant_weight_mixture_rr");
@@ -209,13 +231,10 @@ public:
         }
 
         // Evaluate weight
-        const auto f = eval(geom, wi, s->wo, comp, trans_dir, false);
-        const auto p = pdf_direction(geom, wi, s->wo, comp, false);
-        const auto C = f / p;
-
+        const auto r = eval_with_pdf(geom, wi, s->wo, comp, trans_dir, false);
         return DirectionSample{
             s->wo,
-            C
+            r.f / r.pdf
         };
     }
 
@@ -251,6 +270,19 @@ public:
         return result;
     }
 
+    virtual DirectionEval eval_with_pdf(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) const override {
+        // Evaluate BSDF and marginal PDF in the same loop
+        const auto& group = material_groups_[comp];
+        DirectionEval result{ Vec3(0_f), 0_f };
+        for (int i = 0; i < (int)(group.entries.size()); i++) {
+            const auto& entry = group.entries[i];
+            const auto r = entry.material->eval_with_pdf(geom, wi, wo, {}, trans_dir, eval_delta);
+            result.f += entry.weight * r.f;
+            result.pdf += group.dist.pmf(i) * r.pdf;
+        }
+        return result;
+    }
+
     virtual bool is_specular_component(int comp) const override {
         // Default group : non-specular. Others: specular
         return comp != 0;
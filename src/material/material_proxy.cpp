@@ -67,6 +67,14 @@ public:
     virtual bool is_specular_component(int comp) const override {
         return ref_->is_specular_component(comp);
     }
+
+    virtual bool is_dispersive_component(int comp) const override {
+        return ref_->is_dispersive_component(comp);
+    }
+
+    virtual std::optional<DirectionSample> sample_direction_spectral(const DirectionSampleU& u, const PointGeometry& geom, Vec3 wi, int comp, TransDir trans_dir, Float lambda) const override {
+        return ref_->sample_direction_spectral(u, geom, wi, comp, trans_dir, lambda);
+    }
 };
 
 LM_COMP_REG_IMPL(Material_Proxy, "material::proxy");
@@ -21,17 +21,55 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
     :param str density: Locator to ``volume`` asset representing density of the medium.
     :param str albedo: Locator to ``volume`` asset representing albedo of the medium.
     :param str phase: Locator to ``phase`` asset.
+    :param int batch_size: Number of tentative collisions evaluated at once. Default value: 8.
+    :param int majorant_grid_res: Resolution of the majorant grid along each axis. Default value: 16.
+    :param str transmittance: Estimator of the transmittance.
+                              ``ratio`` (ratio tracking), ``residual_ratio`` (residual ratio tracking),
+                              or ``raymarch`` (unbiased ray marching). Default value: ``ratio``.
+
+    The tracking uses the piecewise constant majorants given by :cpp:class:`lm::MajorantGrid`,
+    stepping through the cells along the ray with 3D-DDA.
+    Empty cells are skipped without tentative collisions.
+    Setting ``majorant_grid_res`` to 1 uses the global maximum density as the majorant.
+
+    Delta tracking and ratio tracking pre-sample ``batch_size`` tentative collisions
+    along the ray and evaluate the density at these positions in a batch
+    with :cpp:func:`lm::Volume::eval_scalar_n`.
+    Larger batches reduce the number of the volume lookups per ray,
+    at the cost of the evaluations discarded after a real collision.
+
+    ``transmittance`` selects the estimator of the transmittance used by the shadow rays.
+    Residual ratio tracking [Novak et al. 2014] uses the average density of each cell of the majorant grid
+    as the control density. The analytic transmittance of the control density is multiplied
+    by the ratio tracking of the residual density, whose majorant is usually much smaller than the density.
+    Unbiased ray marching [Kettunen et al. 2021] evaluates the optical depth by the jittered ray marching
+    with a step per unit optical depth of the majorants, and corrects the bias of its exponential
+    with a power series truncated by Russian roulette.
+    Both estimators skip the empty cells of the majorant grid.
+    Unbiased ray marching can return negative estimates.
 \endrst
 */
 class Medium_Heterogeneous final : public Medium {
 private:
+    static constexpr int MaxBatchSize = 64;
+
     const Volume* volume_density_;  // Density volume. density := \mu_t = \mu_a + \mu_s
     const Volume* volme_albedo_;	// Albedo volume. albedo := \mu_s / \mu_t
     const Phase* phase_;            // Underlying phase function.
+    int batch_size_ = 8;            // Number of tentative collisions evaluated at once
+    MajorantGrid majorants_;        // Local majorants of the density
+
+    // Estimator of the transmittance
+    enum class TransmittanceEstimator {
+        Ratio,
+        ResidualRatio,
+        RayMarch,
+    };
+    TransmittanceEstimator transmittance_ = TransmittanceEstimator::Ratio;
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(volume_density_, volme_albedo_, phase_);
+        ar(volume_density_, volme_albedo_, phase_, batch_size_, majorants_, transmittance_);
     }
 
 public:
@@ -39,6 +77,21 @@ public:
         volume_density_ = json::comp_ref<Volume>(prop, "volume_density");
         volme_albedo_ = json::comp_ref<Volume>(prop, "volume_albedo");
         phase_ = json::comp_ref<Phase>(prop, "phase");
+        batch_size_ = glm::clamp(json::value<int>(prop, "batch_size", 8), 1, MaxBatchSize);
+        majorants_.build(volume_density_, std::max(1, json::value<int>(prop, "majorant_grid_res", 16)));
+        {
+            const auto s = json::value<std::string>(prop, "transmittance", "ratio");
+            if (s == "ratio")               transmittance_ = TransmittanceEstimator::Ratio;
+            else if (s == "residual_ratio") transmittance_ = TransmittanceEstimator::ResidualRatio;
+            else if (s == "raymarch")       transmittance_ = TransmittanceEstimator::RayMarch;
+            else {
+                LM_THROW_EXCEPTION(Error::InvalidArgument,
+                    "Invalid transmittance estimator [transmittance='{}']", s);
+            }
+        }
+        if (transmittance_ == TransmittanceEstimator::ResidualRatio) {
+            majorants_.build_controls(volume_density_, 2);
+        }
     }
 
     virtual std::optional<DistanceSample> sample_distance(Rng& rng, Ray ray, Float tmin, Float tmax) const override {
@@ -49,35 +102,48 @@ public:
         }
         
         // Sample distance by delta tracking
-        Float t = tmin;
-        const auto inv_max_density = 1_f / volume_density_->max_scalar();
-        while (true) {
-            // Sample a distance from the 'homogenized' volume
-            t -= glm::log(1_f-rng.u()) * inv_max_density;
-            if (t >= tmax) {
-                // Hit with boundary, use surface interaction
-                return {};
+        std::optional<DistanceSample> result;
+        Vec3 ps[MaxBatchSize];
+        Float densities[MaxBatchSize];
+        majorants_.traverse(ray, tmin, tmax, [&](Float t0, Float t1, Float majorant) -> bool {
+            if (majorant <= 0_f) {
+                // No collision in the empty cell
+                return true;
             }
+            Float t = t0;
+            const auto inv_majorant = 1_f / majorant;
+            while (true) {
+                // Sample tentative collisions from the 'homogenized' volume
+                const auto [n, reached] = sample_tentative_collisions(rng, ray, t, t1, inv_majorant, ps);
+
+                // Densities at the sampled points
+                volume_density_->eval_scalar_n(ps, n, densities);
+
+                // Determine scattering collision or null collision
+                // Continue tracking if null collusion is seleced
+                for (int i = 0; i < n; i++) {
+                    if (densities[i] * inv_majorant > rng.u()) {
+                        // Scattering collision
+                        const auto albedo = volme_albedo_->eval_color(ps[i]);
+                        result = DistanceSample{
+                            ps[i],
+                            albedo,     // T_{\bar{\mu}}(t) / p_{\bar{\mu}}(t) * \mu_s(t)
+                                        // = 1/\mu_t(t) * \mu_s(t) = albedo(t)
+                            true
+                        };
+                        return false;
+                    }
+                }
 
-            // Density at the sampled point
-            const auto p = ray.o + ray.d*t;
-            const auto density = volume_density_->eval_scalar(p);
-
-            // Determine scattering collision or null collision
-            // Continue tracking if null collusion is seleced
-            if (density * inv_max_density > rng.u()) {
-                // Scattering collision
-                const auto albedo = volme_albedo_->eval_color(p);
-                return DistanceSample{
-                    ray.o + ray.d*t,
-                    albedo,     // T_{\bar{\mu}}(t) / p_{\bar{\mu}}(t) * \mu_s(t)
-                                // = 1/\mu_t(t) * \mu_s(t) = albedo(t)
-                    true
-                };
+                if (reached) {
+                    // Continue to the next cell
+                    return true;
+                }
             }
-        }
+        });
 
-        LM_UNREACHABLE_RETURN();
+        // Use surface interaction if no scattering collision happened
+        return result;
     }
     
     virtual Vec3 eval_transmittance(Rng& rng, Ray ray, Float tmin, Float tmax) const override {
@@ -87,23 +153,146 @@ public:
             return Vec3(1_f);
         }
 
+        if (transmittance_ == TransmittanceEstimator::ResidualRatio) {
+            return Vec3(residual_ratio_tracking(rng, ray, tmin, tmax));
+        }
+        else if (transmittance_ == TransmittanceEstimator::RayMarch) {
+            return Vec3(unbiased_ray_marching(rng, ray, tmin, tmax));
+        }
+
         // Perform ratio tracking [Novak et al. 2014]
         Float Tr = 1_f;
-        Float t = tmin;
-        const auto inv_max_density = 1_f / volume_density_->max_scalar();
-        while (true) {
-            t -= glm::log(1_f - rng.u()) * inv_max_density;
-            if (t >= tmax) {
+        Vec3 ps[MaxBatchSize];
+        Float densities[MaxBatchSize];
+        majorants_.traverse(ray, tmin, tmax, [&](Float t0, Float t1, Float majorant) -> bool {
+            if (majorant <= 0_f) {
+                return true;
+            }
+            Float t = t0;
+            const auto inv_majorant = 1_f / majorant;
+            while (true) {
+                const auto [n, reached] = sample_tentative_collisions(rng, ray, t, t1, inv_majorant, ps);
+                volume_density_->eval_scalar_n(ps, n, densities);
+                for (int i = 0; i < n; i++) {
+                    Tr *= 1_f - densities[i] * inv_majorant;
+                }
+                if (Tr == 0_f) {
+                    return false;
+                }
+                if (reached) {
+                    return true;
+                }
+            }
+        });
+
+        return Vec3(Tr);
+    }
+
+private:
+    // Residual ratio tracking [Novak et al. 2014].
+    // In each cell, the transmittance of the control density is computed analytically
+    // and the ratio tracking estimates the transmittance of the residual density,
+    // whose majorant is the maximum deviation from the control density in the cell.
+    Float residual_ratio_tracking(Rng& rng, Ray ray, Float tmin, Float tmax) const {
+        Float Tr = 1_f;
+        Float tau_control = 0_f;
+        Vec3 ps[MaxBatchSize];
+        Float densities[MaxBatchSize];
+        majorants_.traverse_controls(ray, tmin, tmax, [&](Float t0, Float t1, Float majorant, Float control) -> bool {
+            if (majorant <= 0_f) {
+                return true;
+            }
+            tau_control += control * (t1 - t0);
+            const auto residual_majorant = std::max(majorant - control, control);
+            if (residual_majorant <= 0_f) {
+                return true;
+            }
+            Float t = t0;
+            const auto inv_majorant = 1_f / residual_majorant;
+            while (true) {
+                const auto [n, reached] = sample_tentative_collisions(rng, ray, t, t1, inv_majorant, ps);
+                volume_density_->eval_scalar_n(ps, n, densities);
+                for (int i = 0; i < n; i++) {
+                    Tr *= 1_f - (densities[i] - control) * inv_majorant;
+                }
+                if (Tr == 0_f) {
+                    return false;
+                }
+                if (reached) {
+                    return true;
+                }
+            }
+        });
+        return Tr * std::exp(-tau_control);
+    }
+
+    // Estimate the optical depth by jittered ray marching.
+    // The number of the steps in a cell is the optical depth of the majorant rounded up.
+    Float ray_marched_optical_depth(Rng& rng, Ray ray, Float tmin, Float tmax) const {
+        Float tau = 0_f;
+        Vec3 ps[MaxBatchSize];
+        Float densities[MaxBatchSize];
+        majorants_.traverse(ray, tmin, tmax, [&](Float t0, Float t1, Float majorant) -> bool {
+            if (majorant <= 0_f) {
+                return true;
+            }
+            const int steps = std::max(1, int(std::ceil(majorant * (t1 - t0))));
+            const auto dt = (t1 - t0) / Float(steps);
+            const auto offset = rng.u();
+            for (int i = 0; i < steps; i += MaxBatchSize) {
+                const int n = std::min(MaxBatchSize, steps - i);
+                for (int j = 0; j < n; j++) {
+                    ps[j] = ray.o + ray.d * (t0 + (Float(i + j) + offset) * dt);
+                }
+                volume_density_->eval_scalar_n(ps, n, densities);
+                for (int j = 0; j < n; j++) {
+                    tau += densities[j] * dt;
+                }
+            }
+            return true;
+        });
+        return tau;
+    }
+
+    // Unbiased ray marching [Kettunen et al. 2021].
+    // With a pivot optical depth tau_p from an independent ray marching,
+    // exp(-tau) = exp(-tau_p) * sum_k (tau_p - tau)^k / k!, where each factor (tau_p - tau)
+    // of the k-th term is estimated with an independent ray marching.
+    // The series is truncated by Russian roulette whose continuation probability follows
+    // the magnitude of the ratio of the consecutive terms.
+    Float unbiased_ray_marching(Rng& rng, Ray ray, Float tmin, Float tmax) const {
+        constexpr int MaxOrder = 64;
+        const auto tau_p = ray_marched_optical_depth(rng, ray, tmin, tmax);
+        Float sum = 1_f;
+        Float term = 1_f;
+        Float ratio = 1_f;
+        for (int k = 1; k <= MaxOrder; k++) {
+            const auto q = std::min(1_f, ratio);
+            if (q <= 0_f || rng.u() >= q) {
                 break;
             }
-            const auto p = ray.o + ray.d*t;
-            const auto density = volume_density_->eval_scalar(p);
-            Tr *= 1_f - density * inv_max_density;
+            const auto d = tau_p - ray_marched_optical_depth(rng, ray, tmin, tmax);
+            term *= d / (Float(k) * q);
+            sum += term;
+            ratio = std::abs(d) / Float(k + 1);
         }
+        return std::exp(-tau_p) * sum;
+    }
 
-        return Vec3(Tr);
+    // Sample up to batch_size_ tentative collisions with the given majorant, starting from t.
+    // Returns the number of the sampled positions and true if the ray reached tmax.
+    std::pair<int, bool> sample_tentative_collisions(Rng& rng, Ray ray, Float& t, Float tmax, Float inv_majorant, Vec3* ps) const {
+        for (int n = 0; n < batch_size_; n++) {
+            t -= glm::log(1_f - rng.u()) * inv_majorant;
+            if (t >= tmax) {
+                return { n, true };
+            }
+            ps[n] = ray.o + ray.d*t;
+        }
+        return { batch_size_, false };
     }
 
+public:
     virtual bool is_emitter() const override {
         return false;
     }
@@ -111,6 +300,10 @@ public:
     virtual const Phase* phase() const override {
         return phase_;
     }
+
+    virtual Bound bound() const override {
+        return volume_density_->bound();
+    }
 };
 
 LM_COMP_REG_IMPL(Medium_Heterogeneous, "medium::heterogeneous");
@@ -102,6 +102,14 @@ public:
     virtual const Phase* phase() const override {
         return phase_;
     }
+
+    virtual Bound bound() const override {
+        return bound_;
+    }
+
+    virtual std::optional<HomogeneousCoeffs> homogeneous_coeffs() const override {
+        return HomogeneousCoeffs{ density_, muS_ / density_ };
+    }
 };
 
 LM_COMP_REG_IMPL(Medium_Homogeneous, "medium::homogeneous");
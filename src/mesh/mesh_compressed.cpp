@@ -0,0 +1,217 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/mesh.h>
+#include <glm/gtc/packing.hpp>
+#include "../arrayview.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+namespace {
+
+// Encode a direction with the octahedral mapping into two 16-bit snorms.
+// The degenerated vector is encoded as +z.
+std::uint32_t encode_octahedral(Vec3 n) {
+    const auto l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0_f) {
+        return glm::packSnorm2x16(glm::vec2(0.f));
+    }
+    n /= l1;
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0_f) {
+        const auto sign = [](Float v) { return v >= 0_f ? 1.f : -1.f; };
+        e = glm::vec2(
+            float((1_f - std::abs(n.y)) * sign(n.x)),
+            float((1_f - std::abs(n.x)) * sign(n.y)));
+    }
+    return glm::packSnorm2x16(e);
+}
+
+// Decode a unit vector encoded by encode_octahedral()
+Vec3 decode_octahedral(std::uint32_t v) {
+    const auto e = glm::unpackSnorm2x16(v);
+    Vec3 n(e.x, e.y, 1_f - std::abs(e.x) - std::abs(e.y));
+    const auto t = std::max(-n.z, 0_f);
+    n.x += n.x >= 0_f ? -t : t;
+    n.y += n.y >= 0_f ? -t : t;
+    return glm::normalize(n);
+}
+
+}
+
+/*
+\rst
+.. function:: mesh::compressed
+
+    Mesh from raw data with compressed vertex attributes.
+
+    :param list ps: Vertex positions of the mesh.
+    :param list ns: Vertex normals of the mesh.
+    :param list ts: Texture coordinates for the vertices.
+    :param dist fs: Index list. Indices for each vertex element are
+                    specified by ``p``, ``t``, and ``n`` respectively.
+
+    The parameters are the same as ``mesh::raw``.
+    The normals and the texture coordinates can be omitted,
+    in which case the geometry normals and the zero texture coordinates are used.
+
+    This mesh reduces the memory footprint of the large meshes.
+    The combinations of the position, normal, and texture coordinates indices
+    are unified into the vertices referred by a single index per corner of the triangles.
+    The normals are encoded into 32 bits with the octahedral mapping,
+    and the texture coordinates are stored as half-precision floats.
+    The attributes are decoded on evaluation of the surface points.
+    The positions are not compressed, so the geometry of the mesh is the same as ``mesh::raw``.
+\endrst
+*/
+class Mesh_Compressed final : public Mesh {
+private:
+    SharedArray<Vec3> ps_;              // Positions of the vertices
+    SharedArray<std::uint32_t> ns_;     // Octahedral-encoded normals of the vertices
+    SharedArray<std::uint32_t> ts_;     // Half-precision texture coordinates of the vertices
+    SharedArray<int> fs_;               // Vertex indices of the faces
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(ps_, ns_, ts_, fs_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        const auto has = [](const Json& j, const char* name) {
+            return j.find(name) != j.end();
+        };
+        std::vector<Float> ps, ns, ts;
+        json::flatten(prop["ps"], ps);
+        if (has(prop, "ns")) {
+            json::flatten(prop["ns"], ns);
+        }
+        if (has(prop, "ts")) {
+            json::flatten(prop["ts"], ts);
+        }
+        const auto& fs = prop["fs"];
+        std::vector<int> fp, ft, fn;
+        json::flatten(fs["p"], fp);
+        if (has(fs, "t")) {
+            json::flatten(fs["t"], ft);
+        }
+        if (has(fs, "n")) {
+            json::flatten(fs["n"], fn);
+        }
+        const bool has_ts = ft.size() == fp.size() && !ts.empty();
+        const bool has_ns = fn.size() == fp.size() && !ns.empty();
+        const auto valid = [](int i, size_t size, int dim) {
+            return i >= 0 && size_t(dim) * size_t(i) + (dim - 1) < size;
+        };
+
+        // Unify the combinations of the attribute indices into vertices
+        std::unordered_multimap<int, int> vertices;     // Position index -> Vertex index
+        std::vector<int> vt, vn;                        // Attribute indices of the vertices
+        std::vector<Vec3> vps;
+        std::vector<std::uint32_t> vns, vts;
+        std::vector<int> vfs;
+        vfs.reserve(fp.size());
+        for (size_t i = 0; i < fp.size(); i++) {
+            const int p = fp[i];
+            const int t = has_ts ? ft[i] : -1;
+            const int n = has_ns ? fn[i] : -1;
+            if (!valid(p, ps.size(), 3) || (has_ts && !valid(t, ts.size(), 2)) || (has_ns && !valid(n, ns.size(), 3))) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid face index [index='{}']", i);
+            }
+
+            // Find the vertex with the same attribute indices
+            const auto [begin, end] = vertices.equal_range(p);
+            auto it = begin;
+            while (it != end && (vt[it->second] != t || vn[it->second] != n)) {
+                ++it;
+            }
+            if (it != end) {
+                vfs.push_back(it->second);
+                continue;
+            }
+
+            // Create a new vertex
+            const int v = int(vps.size());
+            vps.push_back(Vec3(ps[3*p], ps[3*p+1], ps[3*p+2]));
+            if (has_ns) {
+                vns.push_back(encode_octahedral(Vec3(ns[3*n], ns[3*n+1], ns[3*n+2])));
+            }
+            if (has_ts) {
+                vts.push_back(glm::packHalf2x16(glm::vec2(float(ts[2*t]), float(ts[2*t+1]))));
+            }
+            vt.push_back(t);
+            vn.push_back(n);
+            vertices.emplace(p, v);
+            vfs.push_back(v);
+        }
+        vps.shrink_to_fit();
+        vns.shrink_to_fit();
+        vts.shrink_to_fit();
+        ps_ = std::move(vps);
+        ns_ = std::move(vns);
+        ts_ = std::move(vts);
+        fs_ = std::move(vfs);
+    }
+
+private:
+    Point point_at(int v) const {
+        return {
+            ps_[v],
+            ns_.empty() ? Vec3() : decode_octahedral(ns_[v]),
+            ts_.empty() ? Vec2() : Vec2(glm::unpackHalf2x16(ts_[v]))
+        };
+    }
+
+public:
+    virtual void foreach_triangle(const ProcessTriangleFunc& process_triangle) const override {
+        for (int fi = 0; fi < int(fs_.size())/3; fi++) {
+            process_triangle(fi, triangle_at(fi));
+        }
+    }
+
+    virtual Tri triangle_at(int face) const override {
+        return {
+            point_at(fs_[3*face]),
+            point_at(fs_[3*face+1]),
+            point_at(fs_[3*face+2])
+        };
+    }
+
+    virtual InterpolatedPoint surface_point(int face, Vec2 uv) const override {
+        const auto v1 = fs_[3*face];
+        const auto v2 = fs_[3*face+1];
+        const auto v3 = fs_[3*face+2];
+        const auto gn = math::geometry_normal(ps_[v1], ps_[v2], ps_[v3]);
+        return {
+            math::mix_barycentric(ps_[v1], ps_[v2], ps_[v3], uv),
+            ns_.empty() ? gn : glm::normalize(math::mix_barycentric(
+                decode_octahedral(ns_[v1]), decode_octahedral(ns_[v2]), decode_octahedral(ns_[v3]), uv)),
+            gn,
+            ts_.empty() ? Vec2(0_f) : math::mix_barycentric(
+                Vec2(glm::unpackHalf2x16(ts_[v1])), Vec2(glm::unpackHalf2x16(ts_[v2])), Vec2(glm::unpackHalf2x16(ts_[v3])), uv)
+        };
+    }
+
+    virtual int num_triangles() const override {
+        return int(fs_.size()) / 3;
+    }
+
+    virtual size_t memory_usage() const override {
+        return comp::bytes_of(ps_.owned(), ns_.owned(), ts_.owned(), fs_.owned());
+    }
+
+    virtual std::optional<Buffer> buffer() const override {
+        if (fs_.empty()) {
+            return {};
+        }
+        return Buffer{ ps_.data(), int(ps_.size()), fs_.data(), 1 };
+    }
+};
+
+LM_COMP_REG_IMPL(Mesh_Compressed, "mesh::compressed");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -6,6 +6,7 @@
 #include <pch.h>
 #include <lm/core.h>
 #include <lm/mesh.h>
+#include "../arrayview.h"
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -14,6 +15,8 @@ struct MeshFaceIndex {
     int t = -1;   // Index of texture coordinates
     int n = -1;   // Index of normal
 
+    using BlobSerializable = void;
+
     template <typename Archive>
     void serialize(Archive& ar) {
         ar(p, t, n);
@@ -32,14 +35,19 @@ struct MeshFaceIndex {
     :param dist fs: Index list. Indices for each vertex element are
                     specified by ``p``, ``t``, and ``n`` respectively.
 
+    The arrays can be either flat or nested by vertices,
+    so that numpy arrays of shape :math:`(n,3)` can be given directly from Python.
+    The arrays can also be given as binary buffers (see :cpp:func:`lm::json::is_buffer`),
+    e.g., ``lm.buffer(ps)`` from Python, which avoids converting large numpy arrays to JSON.
+
 \endrst
 */
 class Mesh_Raw final : public Mesh {
 private:
-    std::vector<Vec3> ps_;           // Positions
-    std::vector<Vec3> ns_;           // Normals
-    std::vector<Vec2> ts_;           // Texture coordinates
-    std::vector<MeshFaceIndex> fs_;  // Faces
+    SharedArray<Vec3> ps_;           // Positions
+    SharedArray<Vec3> ns_;           // Normals
+    SharedArray<Vec2> ts_;           // Texture coordinates
+    SharedArray<MeshFaceIndex> fs_;  // Faces
 
 public:
     LM_SERIALIZE_IMPL(ar) {
@@ -48,23 +56,41 @@ public:
 
 public:
     virtual void construct(const Json& prop) override {
-        const auto& ps = prop["ps"];
-        for (int i = 0; i < ps.size(); i+=3) {
-            ps_.push_back(Vec3(ps[i],ps[i+1],ps[i+2]));
+        std::vector<Float> ps;
+        json::flatten(prop["ps"], ps);
+        std::vector<Vec3> vps;
+        vps.reserve(ps.size() / 3);
+        for (size_t i = 0; i + 2 < ps.size(); i+=3) {
+            vps.push_back(Vec3(ps[i],ps[i+1],ps[i+2]));
         }
-        const auto& ns = prop["ns"];
-        for (int i = 0; i < ns.size(); i+=3) {
-            ns_.push_back(Vec3(ns[i],ns[i+1],ns[i+2]));
+        std::vector<Float> ns;
+        json::flatten(prop["ns"], ns);
+        std::vector<Vec3> vns;
+        vns.reserve(ns.size() / 3);
+        for (size_t i = 0; i + 2 < ns.size(); i+=3) {
+            vns.push_back(Vec3(ns[i],ns[i+1],ns[i+2]));
         }
-        const auto& ts = prop["ts"];
-        for (int i = 0; i < ts.size(); i+=2) {
-            ts_.push_back(Vec2(ts[i],ts[i+1]));
+        std::vector<Float> ts;
+        json::flatten(prop["ts"], ts);
+        std::vector<Vec2> vts;
+        vts.reserve(ts.size() / 2);
+        for (size_t i = 0; i + 1 < ts.size(); i+=2) {
+            vts.push_back(Vec2(ts[i],ts[i+1]));
         }
         const auto& fs = prop["fs"];
-        const int fs_size = int(fs["p"].size());
-        for (int i = 0; i < fs_size; i++) {
-            fs_.push_back(MeshFaceIndex{ fs["p"][i],fs["t"][i],fs["n"][i] });
+        std::vector<int> fp, ft, fn;
+        json::flatten(fs["p"], fp);
+        json::flatten(fs["t"], ft);
+        json::flatten(fs["n"], fn);
+        std::vector<MeshFaceIndex> vfs;
+        vfs.reserve(fp.size());
+        for (size_t i = 0; i < fp.size(); i++) {
+            vfs.push_back(MeshFaceIndex{ fp[i],ft[i],fn[i] });
         }
+        ps_ = std::move(vps);
+        ns_ = std::move(vns);
+        ts_ = std::move(vts);
+        fs_ = std::move(vfs);
     }
 
     virtual void foreach_triangle(const ProcessTriangleFunc& process_triangle) const override {
@@ -99,6 +125,17 @@ public:
     virtual int num_triangles() const override {
         return int(fs_.size()) / 3;
     }
+
+    virtual size_t memory_usage() const override {
+        return comp::bytes_of(ps_.owned(), ns_.owned(), ts_.owned(), fs_.owned());
+    }
+
+    virtual std::optional<Buffer> buffer() const override {
+        if (fs_.empty()) {
+            return {};
+        }
+        return Buffer{ ps_.data(), int(ps_.size()), &fs_[0].p, int(sizeof(MeshFaceIndex) / sizeof(int)) };
+    }
 };
 
 LM_COMP_REG_IMPL(Mesh_Raw, "mesh::raw");
@@ -91,6 +91,17 @@ public:
     virtual int num_triangles() const override {
         return int(fs_.size()) / 3;
     }
+
+    virtual size_t memory_usage() const override {
+        return comp::bytes_of(geo_.ps, geo_.ns, geo_.ts, fs_);
+    }
+
+    virtual std::optional<Buffer> buffer() const override {
+        if (fs_.empty()) {
+            return {};
+        }
+        return Buffer{ geo_.ps.data(), int(geo_.ps.size()), &fs_[0].p, int(sizeof(objloader::OBJMeshFaceIndex) / sizeof(int)) };
+    }
 };
 
 LM_COMP_REG_IMPL(Mesh_WavefrontObj, "mesh::wavefrontobj");
@@ -28,6 +28,28 @@ class Mesh_WavefrontObjRef;
     Wavefront OBJ model.
 
     :param str path: Path to ``.obj`` file.
+    :param bool alpha_test: Cut out the surfaces with the alpha masks in the ray queries
+                            instead of the stochastic transparency of the materials.
+                            Default value: ``false``.
+
+    The alpha channel of the diffuse texture of a material is used as the alpha mask.
+    By default, the material passes the rays through the surface with the probability
+    of one minus the alpha value, which costs a path vertex per transparent surface.
+    With ``alpha_test``, the surfaces are cut out where the alpha value is less than the cutoff
+    of the scene (see ``scene::default``) and the rays do not stop at the cut-out parts.
+
+    :param bool dedup: Share the meshes of the groups with the same geometry.
+                       Default value: ``false``.
+    :param float dedup_tolerance: Tolerance of the positions, normals, and texture coordinates
+                                  for the groups considered the same geometry.
+                                  Default value: ``1e-4``.
+
+    With ``dedup``, the groups with the same material whose geometry is identical up to translation
+    are detected by the hash of the vertex attributes relative to the first vertex.
+    The duplicated groups refer to the mesh of the first group with the translation
+    and the model is added to the scene as the scene graph containing the instance groups,
+    so that the acceleration structures supporting instancing store the mesh once.
+    The emissive groups are not shared.
 \endrst
 */
 class Model_WavefrontObj final : public Model {
@@ -47,17 +69,21 @@ private:
         int mesh;
         int material;
         int light;
+        Vec3 offset;    // Translation applied to the mesh shared with the other groups
 
         template <typename Archive>
         void serialize(Archive& ar) {
-            ar(mesh, material, light);
+            ar(mesh, material, light, offset);
         }
     };
     std::vector<Group> groups_;
 
+    // True if a mesh is shared by multiple groups
+    bool has_instances_ = false;
+
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(geo_, groups_, assets_map_, assets_);
+        ar(geo_, groups_, has_instances_, assets_map_, assets_);
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visit) override {
@@ -71,11 +97,96 @@ public:
         return assets_[assets_map_.at(name)].get();
     }
 
+    virtual size_t memory_usage() const override {
+        return comp::bytes_of(geo_.ps, geo_.ns, geo_.ts, groups_);
+    }
+
+private:
+    // Vertex attributes referred by the face index
+    Mesh::Point point_at(const OBJMeshFaceIndex& f) const {
+        return { geo_.ps[f.p], f.n<0 ? Vec3() : geo_.ns[f.n], f.t<0 ? Vec2() : geo_.ts[f.t] };
+    }
+
+    // Hash of the geometry invariant to translation.
+    // The attributes are quantized by the tolerance, so the geometries compared equal
+    // by same_geometry() have the same hash except near the boundaries of the quantization.
+    std::uint64_t geometry_hash(const OBJMeshFace& fs, int material, Float tol) const {
+        std::uint64_t h = 14695981039346656037ull;
+        const auto add = [&](long long v) {
+            for (int i = 0; i < 8; i++) {
+                h ^= (v >> (8*i)) & 0xff;
+                h *= 1099511628211ull;
+            }
+        };
+        const auto add_vec = [&](auto v) {
+            for (int i = 0; i < v.length(); i++) {
+                add((long long)(std::floor(v[i] / tol)));
+            }
+        };
+        add(material);
+        add((long long)(fs.size()));
+        const auto p0 = geo_.ps[fs[0].p];
+        for (const auto& f : fs) {
+            const auto p = point_at(f);
+            add_vec(p.p - p0);
+            add_vec(p.n);
+            add_vec(p.t);
+        }
+        return h;
+    }
+
+    // Check if the faces have the same geometry as the mesh up to translation
+    bool same_geometry(const OBJMeshFace& fs, const Mesh& mesh, Float tol) const {
+        if (mesh.num_triangles() != int(fs.size()) / 3) {
+            return false;
+        }
+        const auto same = [&](const Mesh::Point& a, const Mesh::Point& b, Vec3 offset) {
+            return glm::compMax(glm::abs(a.p - offset - b.p)) <= tol
+                && glm::compMax(glm::abs(a.n - b.n)) <= tol
+                && glm::compMax(glm::abs(a.t - b.t)) <= tol;
+        };
+        const auto offset = geo_.ps[fs[0].p] - mesh.triangle_at(0).p1.p;
+        for (int fi = 0; fi < int(fs.size())/3; fi++) {
+            const auto tri = mesh.triangle_at(fi);
+            if (!same(point_at(fs[3*fi]), tri.p1, offset) ||
+                !same(point_at(fs[3*fi+1]), tri.p2, offset) ||
+                !same(point_at(fs[3*fi+2]), tri.p3, offset)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+
 	virtual void construct(const Json& prop) override {
         const std::string path = json::value<std::string>(prop, "path");
+        const bool dedup = json::value<bool>(prop, "dedup", false);
+        const auto dedup_tol = json::value<Float>(prop, "dedup_tolerance", 1e-4_f);
+        std::unordered_multimap<std::uint64_t, int> dedup_groups;  // Geometry hash -> group index
         const bool result = objloader::load(path, geo_,
             // Process mesh
             [&](const OBJMeshFace& fs, const MTLMatParams& m) -> bool {
+                // Share the mesh of the group with the same geometry
+                const bool shareable = dedup && !fs.empty() && glm::compMax(m.Ke) <= 0_f;
+                std::uint64_t hash = 0;
+                if (shareable) {
+                    const int material = assets_map_[m.name];
+                    hash = geometry_hash(fs, material, dedup_tol);
+                    const auto [begin, end] = dedup_groups.equal_range(hash);
+                    for (auto it = begin; it != end; ++it) {
+                        const auto& g = groups_[it->second];
+                        const auto* mesh = dynamic_cast<const Mesh*>(assets_[g.mesh].get());
+                        if (g.material != material || !same_geometry(fs, *mesh, dedup_tol)) {
+                            continue;
+                        }
+                        const auto offset = geo_.ps[fs[0].p] - mesh->triangle_at(0).p1.p;
+                        groups_.push_back({ g.mesh, material, -1, offset });
+                        has_instances_ = true;
+                        return true;
+                    }
+                }
+
                 // Create mesh
                 const std::string mesh_name = fmt::format("mesh_{}", assets_.size());
                 auto mesh = comp::create<Mesh>(
@@ -109,7 +220,10 @@ public:
                 }
 
                 // Create mesh group
-                groups_.push_back({ assets_map_[mesh_name], assets_map_[m.name], light_index });
+                if (shareable) {
+                    dedup_groups.emplace(hash, int(groups_.size()));
+                }
+                groups_.push_back({ assets_map_[mesh_name], assets_map_[m.name], light_index, Vec3(0_f) });
 
                 return true;
             },
@@ -211,7 +325,8 @@ public:
                             {"Ks", m.Ks},
                             {"ax", std::max(1e-3_f, r / as)},
                             {"ay", std::max(1e-3_f, r * as)},
-                            {"no_alpha_mask", skip_specular_mat}
+                            {"no_alpha_mask", skip_specular_mat},
+                            {"alpha_test", json::value<bool>(prop, "alpha_test", false)}
                         });
                     #endif
                 }
@@ -229,19 +344,75 @@ public:
     }
     
     virtual void create_primitives(const CreatePrimitiveFunc& createPrimitive) const override {
-        for (auto [mesh, material, light] : groups_) {
-            auto* meshp = assets_.at(mesh).get();
-            auto* materialp = assets_.at(material).get();
+        if (has_instances_) {
+            // The primitives cannot represent the translations of the shared meshes
+            LM_THROW_EXCEPTION(Error::Unsupported,
+                "Shared meshes require the scene graph. Use foreach_node() instead.");
+        }
+        for (const auto& g : groups_) {
+            auto* meshp = assets_.at(g.mesh).get();
+            auto* materialp = assets_.at(g.material).get();
             createPrimitive(
                 meshp,
                 materialp,
-                light < 0 ? nullptr : assets_.at(light).get());
+                g.light < 0 ? nullptr : assets_.at(g.light).get());
         }
     }
 
-	virtual void foreach_node(const VisitNodeFuncType&) const override {
-        LM_THROW_EXCEPTION_DEFAULT(Error::Unsupported);
+    // Index 0 is the root group. A shared mesh is placed in an instance group
+    // referred by the transform groups of the groups sharing the mesh.
+	virtual void foreach_node(const VisitNodeFuncType& visit) const override {
+        std::unordered_map<int, int> num_refs;     // Mesh index -> number of groups referring the mesh
+        for (const auto& g : groups_) {
+            num_refs[g.mesh]++;
+        }
+
+        std::vector<SceneNode> nodes;
+        nodes.push_back(SceneNode::make_group(0, false, {}));
+        std::unordered_map<int, int> instance_groups;  // Mesh index -> instance group node index
+        const auto add_primitive = [&](const Group& g) -> int {
+            const int index = int(nodes.size());
+            nodes.push_back(SceneNode::make_primitive(
+                index,
+                dynamic_cast<Mesh*>(assets_.at(g.mesh).get()),
+                dynamic_cast<Material*>(assets_.at(g.material).get()),
+                g.light < 0 ? nullptr : dynamic_cast<Light*>(assets_.at(g.light).get()),
+                nullptr,
+                nullptr));
+            return index;
+        };
+        for (const auto& g : groups_) {
+            if (num_refs[g.mesh] == 1) {
+                const int index = add_primitive(g);
+                nodes[0].group.children.push_back(index);
+                continue;
+            }
+
+            // Create the instance group for the first reference of the shared mesh
+            auto it = instance_groups.find(g.mesh);
+            if (it == instance_groups.end()) {
+                const int instance_group_index = int(nodes.size());
+                nodes.push_back(SceneNode::make_group(instance_group_index, true, {}));
+                const int index = add_primitive(g);
+                nodes[instance_group_index].group.children.push_back(index);
+                it = instance_groups.emplace(g.mesh, instance_group_index).first;
+            }
+
+            // Transform group referring the instance group
+            const int transform_group_index = int(nodes.size());
+            nodes.push_back(SceneNode::make_group(transform_group_index, false, glm::translate(g.offset)));
+            nodes[transform_group_index].group.children.push_back(it->second);
+            nodes[0].group.children.push_back(transform_group_index);
+        }
+
+        for (const auto& node : nodes) {
+            visit(node);
+        }
 	}
+
+    virtual bool has_instances() const override {
+        return has_instances_;
+    }
 };
 
 LM_COMP_REG_IMPL(Model_WavefrontObj, "model::wavefrontobj");
@@ -321,6 +492,20 @@ public:
     virtual int num_triangles() const override {
         return int(fs_.size()) / 3;
     }
+
+    // The surface geometry is owned by the model
+    virtual size_t memory_usage() const override {
+        return comp::bytes_of(fs_);
+    }
+
+    // The positions are shared with the other meshes of the model
+    virtual std::optional<Buffer> buffer() const override {
+        if (fs_.empty()) {
+            return {};
+        }
+        const auto& geo_ = model_->geo_;
+        return Buffer{ geo_.ps.data(), int(geo_.ps.size()), &fs_[0].p, int(sizeof(OBJMeshFaceIndex) / sizeof(int)) };
+    }
 };
 
 LM_COMP_REG_IMPL(Mesh_WavefrontObjRef, "mesh::wavefrontobj_ref");
@@ -341,16 +526,24 @@ private:
     Component::Ptr<Material> diffuse_;
     Component::Ptr<Material> glossy_;
     Texture* mask_tex_ = nullptr;
+    bool alpha_test_ = false;       // Alpha mask is resolved by the ray queries
+
+    // Parameters of the lobes evaluated without the underlying materials
+    Vec3 Kd_;                       // Diffuse reflectance
+    Texture* mapKd_ = nullptr;      // Texture of the diffuse reflectance
+    Vec3 Ks_;                       // Specular reflectance
+    Float ax_, ay_;                 // Roughness of the glossy lobe (anisotropic GGX)
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(diffuse_, glossy_, mask_tex_);
+        ar(diffuse_, glossy_, mask_tex_, alpha_test_, Kd_, mapKd_, Ks_, ax_, ay_);
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visit) override {
         comp::visit(visit, diffuse_);
         comp::visit(visit, glossy_);
         comp::visit(visit, mask_tex_);
+        comp::visit(visit, mapKd_);
     }
 
     virtual Component* underlying(const std::string& name) const override {
@@ -362,18 +555,101 @@ public:
     }
 
 private:
-    // Evaluate alpha value
+    // Lobes of the diffuse and glossy component
+    enum class Lobe {
+        Diffuse,
+        Glossy,
+    };
+
+    // Material flattened at a shading point.
+    // The textures are evaluated once per query and the lobes are evaluated
+    // inline without the virtual calls to the underlying materials.
+    struct Closure {
+        Vec3 Kd;        // Diffuse reflectance
+        Float alpha;    // Alpha value
+        Float w;        // Selection probability of the diffuse lobe
+    };
+
+    Closure closure(const PointGeometry& geom) const {
+        Closure c;
+        c.Kd = mapKd_ ? mapKd_->eval_filtered(geom.t, geom.footprint) : Kd_;
+        // The surface is opaque if the alpha mask is resolved by the ray queries
+        c.alpha = !mask_tex_ || alpha_test_ ? 1_f : mask_tex_->eval_alpha(geom.t);
+        const auto wd = glm::compMax(c.Kd);
+        const auto wg = glm::compMax(Ks_);
+        c.w = wd == 0_f && wg == 0_f ? 1_f : wd / (wd + wg);
+        return c;
+    }
+
+    // Alpha value without the diffuse reflectance
     Float eval_alpha(const PointGeometry& geom) const {
-        return !mask_tex_ ? 1_f : mask_tex_->eval_alpha(geom.t);
+        return !mask_tex_ || alpha_test_ ? 1_f : mask_tex_->eval_alpha(geom.t);
     }
 
-    // Get material by index
-    const Material* material_by_index(int index) const {
-        if (index == 0)
-            return diffuse_.get();
-        else if (index == 1)
-            return glossy_.get();
-        return nullptr;
+    // Normal distribution of anisotropic GGX
+    Float normal_dist(Vec3 wh, Vec3 u, Vec3 v, Vec3 n) const {
+        return 1_f / (Pi*ax_*ay_*math::sq(math::sq(glm::dot(wh, u) / ax_) +
+            math::sq(glm::dot(wh, v) / ay_) + math::sq(glm::dot(wh, n))));
+    }
+
+    // Smith's G term correspoinding to the anisotropic GGX
+    Float shadowG(Vec3 wi, Vec3 wo, Vec3 u, Vec3 v, Vec3 n) const {
+        const auto G1 = [&](Vec3 w) {
+            const auto c = glm::dot(w, n);
+            const auto s = std::max(Eps, math::safe_sqrt(1_f - c * c));
+            const auto cp = glm::dot(w, u) / s;
+            const auto cs = glm::dot(w, v) / s;
+            const auto a2 = math::sq(cp * ax_) + math::sq(cs * ay_);
+            return c == 0_f ? 0_f : 2_f / (1_f + math::safe_sqrt(1_f + a2 * math::sq(s / c)));
+        };
+        return G1(wi) * G1(wo);
+    }
+
+    // Sample a direction from the lobe
+    std::optional<Vec3> sample_lobe(Lobe lobe, const DirectionSampleU& us, const PointGeometry& geom, Vec3 wi) const {
+        const auto [n, u, v] = geom.orthonormal_basis_twosided(wi);
+        switch (lobe) {
+            case Lobe::Diffuse: {
+                const auto d = math::sample_cosine_weighted(us.ud);
+                return u*d.x + v*d.y + n*d.z;
+            }
+            case Lobe::Glossy: {
+                const auto u1 = us.ud[0] * 2_f * Pi;
+                const auto u2 = us.ud[1];
+                const auto wh = glm::normalize(
+                    math::safe_sqrt(u2/(1_f-u2))*(ax_*glm::cos(u1)*u+ay_*glm::sin(u1)*v)+n);
+                const auto wo = math::reflection(wi, wh);
+                if (geom.opposite(wi, wo)) {
+                    return {};
+                }
+                return wo;
+            }
+        }
+        return {};
+    }
+
+    // Evaluate BSDF and PDF of the diffuse and glossy component
+    DirectionEval eval_lobes(const Closure& c, const PointGeometry& geom, Vec3 wi, Vec3 wo) const {
+        if (geom.opposite(wi, wo)) {
+            return { Vec3(0_f), 0_f };
+        }
+        const auto [n, u, v] = geom.orthonormal_basis_twosided(wi);
+
+        // Diffuse lobe
+        const auto fd = c.Kd / Pi;
+        const auto pd = 1_f / Pi;
+
+        // Glossy lobe
+        const auto wh = glm::normalize(wi + wo);
+        const auto D = normal_dist(wh, u, v, n);
+        const auto Fr = Ks_+(1_f-Ks_)*std::pow(1_f-glm::dot(wo, wh),5_f);
+        const auto fg = Ks_*Fr*(D*shadowG(wi,wo,u,v,n)/(4_f*glm::dot(wi,n)*glm::dot(wo,n)));
+        const auto pg = D*glm::dot(wh,n)/(4_f*glm::dot(wo, wh)*glm::dot(wo, n));
+
+        return {
+            (fd + fg) * c.alpha,
+            c.w * pd + (1_f - c.w) * pg
+        };
     }
 
 public:
@@ -400,14 +676,23 @@ public:
                 {"ay", ay}
             });
 
+        // Flattened parameters
+        Kd_ = Kd;
+        mapKd_ = mapKd.empty() ? nullptr : comp::get<Texture>(mapKd);
+        Ks_ = Ks;
+        ax_ = ax;
+        ay_ = ay;
+
         // Alpha mask
         const bool no_alpha_mask = json::value<bool>(prop, "no_alpha_mask");
-        if (!no_alpha_mask && !mapKd.empty()) {
-            auto* texture = comp::get<Texture>(mapKd);
-            if (texture && texture->has_alpha()) {
-                mask_tex_ = texture;
-            }
+        if (!no_alpha_mask && mapKd_ && mapKd_->has_alpha()) {
+            mask_tex_ = mapKd_;
         }
+        alpha_test_ = json::value<bool>(prop, "alpha_test", false);
+    }
+
+    virtual const Texture* alpha_mask() const override {
+        return alpha_test_ ? mask_tex_ : nullptr;
     }
 
     virtual ComponentSample sample_component(const ComponentSampleU& u, const PointGeometry& geom, Vec3) const override {
@@ -424,53 +709,27 @@ public:
         return comp == 0 ? alpha : (1_f - alpha);
     }
 
-    Float diffuse_selection_prob(const PointGeometry& geom) const {
-        auto wd = glm::compMax(diffuse_->reflectance(geom));
-        auto wg = glm::compMax(glossy_->reflectance(geom));
-        if (wd == 0_f && wg == 0_f) {
-            return 1_f;
-        }
-        const auto w = wd / (wd + wg);
-        return w;
-    }
-
-    virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& us, const PointGeometry& geom, Vec3 wi, int comp, TransDir trans_dir) const override {
+    virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& us, const PointGeometry& geom, Vec3 wi, int comp, TransDir) const override {
         if (comp == 0) {
             // Diffuse or glossy
-            // Sample omponent (diffuse=0, glossy=1)
-            const int comp_in_group = [&]() {
-                const auto w = diffuse_selection_prob(geom);
-                if (us.udc[0] < w) {
-                    return 0;
-                }
-                return 1;
-            }();
-
-            // Sample direction
-            const auto* material = material_by_index(comp_in_group);
-            const auto s = material->sample_direction(us, geom, wi, {}, trans_dir);
-            if (!s) {
+            // Sample lobe and direction
+            const auto c = closure(geom);
+            const auto wo = sample_lobe(us.udc[0] < c.w ? Lobe::Diffuse : Lobe::Glossy, us, geom, wi);
+            if (!wo) {
                 return {};
             }
-            
-            // Evaluate weight
-            const auto f = eval(geom, wi, s->wo, comp, trans_dir, false);
-            const auto p = pdf_direction(geom, wi, s->wo, comp, false);
-            const auto C = f / p;
 
+            // Evaluate weight reusing the closure
+            const auto r = eval_lobes(c, geom, wi, *wo);
             return DirectionSample{
-                s->wo,
-                C
+                *wo,
+                r.f / r.pdf
             };
         }
         else {
             // Alpha mask
-            const auto wo = -wi;
-            const auto f = eval(geom, wi, wo, comp, trans_dir, false);
-            const auto p = pdf_direction(geom, wi, wo, comp, false);
-            const auto C = f / p;
             return DirectionSample{
-                wo,
+                -wi,
                 Vec3(1_f)
             };
         }
@@ -478,38 +737,42 @@ public:
 
     virtual Vec3 reflectance(const PointGeometry& geom) const override {
         // Just use diffuse component
-        return diffuse_->reflectance(geom);
+        return mapKd_ ? mapKd_->eval_filtered(geom.t, geom.footprint) : Kd_;
     }
 
     virtual Float pdf_direction(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, bool eval_delta) const override {
         if (comp == 0) {
-            Float p_marginal = 0_f;
-            const auto w = diffuse_selection_prob(geom);
-            p_marginal += w * diffuse_->pdf_direction(geom, wi, wo, {}, eval_delta);
-            p_marginal += (1_f-w) * glossy_->pdf_direction(geom, wi, wo, {}, eval_delta);
-            return p_marginal;
+            return eval_lobes(closure(geom), geom, wi, wo).pdf;
         }
         else {
             return eval_delta ? 0_f : 1_f;
         }
     }
 
-    virtual Vec3 eval(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) const override {
-        const auto alpha = eval_alpha(geom);
+    virtual Vec3 eval(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir, bool eval_delta) const override {
         if (comp == 0) {
-            Vec3 sum(0_f);
-            sum += diffuse_->eval(geom, wi, wo, {}, trans_dir, eval_delta);
-            sum += glossy_->eval(geom, wi, wo, {}, trans_dir, eval_delta);
-            return sum * alpha;
+            return eval_lobes(closure(geom), geom, wi, wo).f;
         }
         else {
-            return eval_delta ? Vec3(0_f) : Vec3(1_f - alpha);
+            return eval_delta ? Vec3(0_f) : Vec3(1_f - eval_alpha(geom));
         }
     }
 
+    virtual DirectionEval eval_with_pdf(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) const override {
+        if (comp == 0) {
+            return eval_lobes(closure(geom), geom, wi, wo);
+        }
+        return {
+            eval(geom, wi, wo, comp, trans_dir, eval_delta),
+            pdf_direction(geom, wi, wo, comp, eval_delta)
+        };
+    }
+
     virtual bool is_specular_component(int comp) const override {
         return comp != 0;
     }
+
+    LM_MATERIAL_BATCH_IMPL()
 };
 
 LM_COMP_REG_IMPL(Material_Mixture_WavefrontObj, "material::mixture_wavefrontobj");
@@ -5,6 +5,7 @@
 
 #include <pch.h>
 #include <lm/objloader.h>
+#include <lm/trace.h>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE::objloader)
 
@@ -23,6 +24,7 @@ LM_PUBLIC_API bool load(
     OBJSurfaceGeometry& geo,
     const ProcessMeshFunc& process_mesh,
     const ProcessMaterialFunc& process_material) {
+    LM_TRACE_SCOPE("objloader::load " + path);
     return Instance::get().load(path, geo, process_mesh, process_material);
 }
 
@@ -6,17 +6,72 @@
 #include <pch.h>
 #include <lm/core.h>
 #include <lm/objloader.h>
+#include <lm/parallel.h>
+#include <lm/serial.h>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE::objloader)
 
-// Wavefront OBJ/MTL file parser
+/*
+\rst
+.. function:: objloader::simple
+
+    Wavefront OBJ/MTL file parser.
+
+    :param bool cache: Write the parsed contents to a binary cache file and load them from it next time.
+                       Default value: false.
+
+    The cache file is placed next to the OBJ file with ``.lmcache`` extension.
+    The cache is discarded if the OBJ file or the MTL files are modified after the cache is created.
+\endrst
+*/
 class OBJLoaderContext_Simple : public OBJLoaderContext {
+private:
+    // Primitive: a pair of mesh and material
+    // Note that a group defined by 'g' command can contain multiple pairs,
+    // because obj file allows per-face material assignment.
+    // A primitive is created when the process encounters either 'g' or 'usemtl' command.
+    struct Primitive {
+        int material_index = 0;     // Refers to default material by default
+        std::vector<OBJMeshFaceIndex> fs;
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(material_index, fs);
+        }
+    };
+
+    // Modification stamp of a source file
+    struct FileStamp {
+        std::string path;
+        uintmax_t size;
+        long long time;
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(path, size, time);
+        }
+    };
+
+    // Identifier and version of the cache file
+    static constexpr const char* CacheMagic = "lmobjcache";
+    static constexpr int CacheVersion = 1;
+
 public:
     // Material parameters
     std::vector<MTLMatParams> ms_;
     std::unordered_map<std::string, int> msmap_;
 
+    // Use binary cache
+    bool cache_ = false;
+
+    // Paths to the loaded MTL files
+    std::vector<std::string> mtl_paths_;
+
 public:
+    virtual void construct(const Json& prop) override {
+        cache_ = json::value<bool>(prop, "cache", false);
+    }
+
     virtual bool load(
         const std::string& path,
         OBJSurfaceGeometry& geo,
@@ -25,135 +80,318 @@ public:
     {
         ms_.clear();
         msmap_.clear();
+        mtl_paths_.clear();
+
+        // Parse the file or load from the cache
+        std::vector<Primitive> primitives;
+        const auto cache_path = path + ".lmcache";
+        if (!cache_ || !load_cache(cache_path, geo, primitives)) {
+            if (!parse(path, geo, primitives)) {
+                return false;
+            }
+            if (cache_) {
+                save_cache(cache_path, path, geo, primitives);
+            }
+        }
+
+        // Create a default material if MTL file is missing
+        if (ms_.empty()) {
+            ms_.push_back({ "default", -1, Vec3(1) });
+        }
 
+        // Process parsed materials
+        for (const auto& m : ms_) {
+            if (!process_material(m)) {
+                return false;
+            }
+        }
+
+        // Process parsed primitives
+        for (const auto& primitive : primitives) {
+            if (!process_mesh(primitive.fs, ms_.at(primitive.material_index))) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    // Parses .obj file
+    bool parse(const std::string& path, OBJSurfaceGeometry& geo, std::vector<Primitive>& primitives) {
         LM_INFO("Loading OBJ file [path='{}']", fs::path(path).filename().string());
-        char l[4096], name[256];
-        std::ifstream f(path);
+        std::ifstream f(path, std::ios::in | std::ios::binary);
         if (!f) {
             LM_ERROR("Missing OBJ file [path='{}']", path);
             return false;
         }
 
-        // Primitive: a pair of mesh and material
-        // Note that a group defined by 'g' command can contain multiple pairs,
-        // because obj file allows per-face material assignment.
-        // A primitive is created when the process encounters either 'g' or 'usemtl' command.
-        struct Primitive {
-            int material_index = 0;     // Refers to default material by default
-            std::vector<OBJMeshFaceIndex> fs;
-        };
-        std::vector<Primitive> primitives;
+        // Read entire file
+        f.seekg(0, std::ios::end);
+        std::string buf(size_t(f.tellg()), '\0');
+        f.seekg(0, std::ios::beg);
+        f.read(buf.data(), buf.size());
+
+        // Split the file into chunks at line boundaries
+        const size_t chunk_size = std::max(MinChunkSize, buf.size() / (size_t(parallel::num_threads()) * 4) + 1);
+        std::vector<size_t> offsets{ 0 };
+        while (offsets.back() < buf.size()) {
+            const auto i = buf.find('\n', std::min(buf.size(), offsets.back() + chunk_size));
+            offsets.push_back(i == std::string::npos ? buf.size() : i + 1);
+        }
+        const int num_chunks = int(offsets.size()) - 1;
+
+        // Parse chunks in parallel
+        std::vector<Chunk> chunks(num_chunks);
+        parallel::foreach(num_chunks, [&](long long i, int) {
+            parse_chunk(buf.data() + offsets[i], buf.data() + offsets[i + 1], chunks[i]);
+        });
 
         // Current material index
         int curr_material_index = 0;
 
-        // Parse .obj file line by line
-        while (f.getline(l, 4096)) {
+        // Stitch the chunks in order
+        for (auto& chunk : chunks) {
+            // Resolve relative indices with the number of vertices in the previous chunks
+            for (const auto& [fi, c] : chunk.relative) {
+                auto& i = chunk.fs[fi];
+                if      (c == 0) { i.p += int(geo.ps.size()); }
+                else if (c == 1) { i.t += int(geo.ts.size()); }
+                else             { i.n += int(geo.ns.size()); }
+            }
+            geo.ps.insert(geo.ps.end(), chunk.ps.begin(), chunk.ps.end());
+            geo.ns.insert(geo.ns.end(), chunk.ns.begin(), chunk.ns.end());
+            geo.ts.insert(geo.ts.end(), chunk.ts.begin(), chunk.ts.end());
+
+            // Add faces to the current primitive until the given position
+            size_t fi = 0;
+            const auto flush = [&](size_t end) {
+                if (fi == end) {
+                    return;
+                }
+                // Create a default primitive if there's no primitive
+                if (primitives.empty()) {
+                    primitives.emplace_back();
+                }
+                auto& fs = primitives.back().fs;
+                fs.insert(fs.end(), chunk.fs.begin() + fi, chunk.fs.begin() + end);
+                fi = end;
+            };
+
+            // Process commands in the order of appearance
+            for (const auto& cmd : chunk.commands) {
+                flush(cmd.face_pos);
+
+                // ----- Parse group
+                if (cmd.type == CommandType::Group) {
+                    primitives.emplace_back();
+                    primitives.back().material_index = curr_material_index;
+                }
+
+                // ----- Parse material
+                else if (cmd.type == CommandType::UseMtl) {
+                    // Create a new primitive
+                    // If 'usemtl' is defined immediately after 'g' command, use the last primitive.
+                    if (primitives.empty() || !primitives.back().fs.empty()) {
+                        primitives.emplace_back();
+                    }
+
+                    // Set material index
+                    curr_material_index = msmap_.at(cmd.name);
+                    primitives.back().material_index = curr_material_index;
+                }
+
+                // ----- Parse material library
+                else if (cmd.type == CommandType::MtlLib) {
+                    if (!loadmtl((fs::path(path).remove_filename() / cmd.name).string())) {
+                        return false;
+                    }
+                }
+            }
+            flush(chunk.fs.size());
+
+            // Release the memory of the chunk
+            chunk = {};
+        }
+
+        return true;
+    }
+
+    // Get modification stamp of a file
+    FileStamp file_stamp(const std::string& path) const {
+        return {
+            path,
+            fs::file_size(path),
+            (long long)fs::last_write_time(path).time_since_epoch().count()
+        };
+    }
+
+    // Loads parsed contents from the cache file.
+    // Returns false if the cache is missing or outdated.
+    bool load_cache(const std::string& cache_path, OBJSurfaceGeometry& geo, std::vector<Primitive>& primitives) {
+        std::ifstream is(cache_path, std::ios::in | std::ios::binary);
+        if (!is) {
+            return false;
+        }
+        try {
+            InputArchive ar(is);
+            std::string magic;
+            int version;
+            int float_size;
+            ar(magic, version, float_size);
+            if (magic != CacheMagic || version != CacheVersion || float_size != int(sizeof(Float))) {
+                return false;
+            }
+
+            // Check if the sources are modified
+            std::vector<FileStamp> stamps;
+            ar(stamps);
+            for (const auto& stamp : stamps) {
+                std::error_code ec;
+                if (!fs::exists(stamp.path, ec)) {
+                    return false;
+                }
+                const auto curr = file_stamp(stamp.path);
+                if (curr.size != stamp.size || curr.time != stamp.time) {
+                    return false;
+                }
+            }
+
+            LM_INFO("Loading OBJ cache [path='{}']", fs::path(cache_path).filename().string());
+            ar(geo, primitives, ms_, msmap_);
+        }
+        catch (const std::exception&) {
+            LM_WARN("Failed to load OBJ cache [path='{}']", cache_path);
+            geo = {};
+            primitives.clear();
+            ms_.clear();
+            msmap_.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // Saves parsed contents to the cache file
+    void save_cache(const std::string& cache_path, const std::string& path, const OBJSurfaceGeometry& geo, const std::vector<Primitive>& primitives) {
+        std::ofstream os(cache_path, std::ios::out | std::ios::binary);
+        if (!os) {
+            LM_WARN("Failed to create OBJ cache [path='{}']", cache_path);
+            return;
+        }
+        std::vector<FileStamp> stamps{ file_stamp(path) };
+        for (const auto& mtl_path : mtl_paths_) {
+            stamps.push_back(file_stamp(mtl_path));
+        }
+        OutputArchive ar(os);
+        ar(std::string(CacheMagic), CacheVersion, int(sizeof(Float)), stamps, geo, primitives, ms_, msmap_);
+    }
+
+    // Minimum size of a chunk parsed in parallel
+    static constexpr size_t MinChunkSize = 1 << 20;
+
+    // Commands modifying primitives
+    enum class CommandType {
+        Group,
+        UseMtl,
+        MtlLib,
+    };
+    struct Command {
+        CommandType type;
+        std::string name;   // Argument of the command
+        size_t face_pos;    // Number of face indices in the chunk preceding the command
+    };
+
+    // Parsed contents of a chunk
+    struct Chunk {
+        std::vector<Vec3> ps;
+        std::vector<Vec3> ns;
+        std::vector<Vec2> ts;
+        std::vector<OBJMeshFaceIndex> fs;   // Triangulated face indices
+        std::vector<Command> commands;
+        // Face indices specified relative to the end of the chunk (index in fs, component).
+        // The indices are resolved on stitching the chunks.
+        std::vector<std::pair<size_t, int>> relative;
+    };
+
+    // Parses a chunk of .obj file line by line
+    void parse_chunk(const char* begin, const char* end, Chunk& chunk) {
+        char l[4096], name[256];
+        for (const char* p = begin; p < end;) {
+            // Copy a line
+            const char* e = std::find(p, end, '\n');
+            const size_t n = std::min(size_t(e - p), sizeof(l) - 1);
+            std::memcpy(l, p, n);
+            l[n] = '\0';
+            p = e + 1;
+
             char *t = l;
             skip_spaces(t);
 
             // ----- Parse vertex position
             if (command(t, "v", 1)) {
-                geo.ps.emplace_back(next_vec3(t += 2));
+                chunk.ps.emplace_back(next_vec3(t += 2));
             }
 
             // ----- Parse vertex normal
             else if (command(t, "vn", 2)) {
-                geo.ns.emplace_back(next_vec3(t += 3));
+                chunk.ns.emplace_back(next_vec3(t += 3));
             }
 
             // ----- Parse texture coordinates
             else if (command(t, "vt", 2)) {
-                geo.ts.emplace_back(next_vec3(t += 3));
-            } 
+                chunk.ts.emplace_back(next_vec3(t += 3));
+            }
 
             // ----- Parse group
             else if (command(t, "g", 1)) {
-                t += 1;
-                primitives.emplace_back();
-                primitives.back().material_index = curr_material_index;
+                chunk.commands.push_back({ CommandType::Group, {}, chunk.fs.size() });
             }
 
             // ----- Parse face indices
             else if (command(t, "f", 1)) {
                 t += 2;
-
-                // Create a default primitive if there's no primitive
-                if (primitives.empty()) {
-                    primitives.emplace_back();
-                }
-                
-                // Current primitive
-                auto& primitive = primitives.back();
-
-                // Parse face indices
                 OBJMeshFaceIndex is[4];
-                for (auto& i : is) {
+                bool rel[4][3] = {};
+                for (int j = 0; j < 4; j++) {
                     if (eol(t[0])) {
                         continue;
                     }
-                    i = parse_indices(geo, t);
+                    is[j] = parse_indices(chunk, t, rel[j]);
                 }
-                primitive.fs.insert(primitive.fs.end(), {is[0], is[1], is[2]});
-                if (is[3].p != -1) {
+                const auto add = [&](int j) {
+                    for (int c = 0; c < 3; c++) {
+                        if (rel[j][c]) {
+                            chunk.relative.emplace_back(chunk.fs.size(), c);
+                        }
+                    }
+                    chunk.fs.push_back(is[j]);
+                };
+                add(0); add(1); add(2);
+                if (is[3].p != -1 || rel[3][0]) {
                     // Triangulate quad
-                    primitive.fs.insert(primitive.fs.end(), {is[0], is[2], is[3]});
+                    add(0); add(2); add(3);
                 }
             }
-            
+
             // ----- Parse material
             else if (command(t, "usemtl", 6)) {
-                t += 7;
-                next_string(t, name);
-
-                // Create a new primitive
-                // If 'usemtl' is defined immediately after 'g' command, use the last primitive.
-                if (primitives.empty() || !primitives.back().fs.empty()) {
-                    primitives.emplace_back();
-                }
-
-                // Set material index
-                curr_material_index = msmap_.at(name);
-                primitives.back().material_index = curr_material_index;
+                next_string(t += 7, name);
+                chunk.commands.push_back({ CommandType::UseMtl, name, chunk.fs.size() });
             }
-            
+
             // ----- Parse material library
             else if (command(t, "mtllib", 6)) {
                 next_string(t += 7, name);
-                if (!loadmtl((fs::path(path).remove_filename() / name).string())) {
-                    return false;
-                }
+                chunk.commands.push_back({ CommandType::MtlLib, name, chunk.fs.size() });
             }
-            
+
             // ----- Ignore all other commands
             else {
                 continue;
             }
         }
-
-        // Create a default material if MTL file is missing
-        if (ms_.empty()) {
-            ms_.push_back({ "default", -1, Vec3(1) });
-        }
-
-        // Process parsed materials
-        for (const auto& m : ms_) {
-            if (!process_material(m)) {
-                return false;
-            }
-        }
-
-        // Process parsed primitives
-        for (const auto& primitive : primitives) {
-            if (!process_mesh(primitive.fs, ms_.at(primitive.material_index))) {
-                return false;
-            }
-        }
-
-        return true;
     }
 
-private:
     // Checks end of line
     bool eol(char c) { return c == '\0'; }
 
@@ -195,17 +433,18 @@ private:
     }
 
     // Parses vertex index. See specification of obj file for detail.
-    int parse_index(int i, int vn) { return i < 0 ? vn + i : i > 0 ? i - 1 : -1; }
-    OBJMeshFaceIndex parse_indices(OBJSurfaceGeometry& geo, char *&t) {
+    // Negative index is relative to the number of vertices vn parsed so far in the chunk.
+    int parse_index(int i, int vn, bool& rel) { rel = i < 0; return i < 0 ? vn + i : i > 0 ? i - 1 : -1; }
+    OBJMeshFaceIndex parse_indices(const Chunk& chunk, char *&t, bool (&rel)[3]) {
         OBJMeshFaceIndex i;
         skip_spaces(t);
-        i.p = parse_index(atoi(t), int(geo.ps.size()));
+        i.p = parse_index(atoi(t), int(chunk.ps.size()), rel[0]);
         skip_spaces_or_comments(t);
         if (eol(t[0]) || t++[0] != '/') { return i; }
-        i.t = parse_index(atoi(t), int(geo.ts.size()));
+        i.t = parse_index(atoi(t), int(chunk.ts.size()), rel[1]);
         skip_spaces_or_comments(t);
         if (eol(t[0]) || t++[0] != '/') { return i; }
-        i.n = parse_index(atoi(t), int(geo.ns.size()));
+        i.n = parse_index(atoi(t), int(chunk.ns.size()), rel[2]);
         skip_spaces_or_comments(t);
         return i;
     }
@@ -228,6 +467,7 @@ private:
             LM_ERROR("Missing MLT file [path='{}']", p);
             return false;
         }
+        mtl_paths_.push_back(p);
         char l[4096], name[256];
         while (f.getline(l, 4096)) {
             auto *t = l;
@@ -4,17 +4,616 @@
 */
 
 #include <pch.h>
+#include <lm/core.h>
 #include <lm/parallelcontext.h>
+#include "progressreporter.h"
+#if LM_PLATFORM_WINDOWS
+#include <Windows.h>
+#elif LM_PLATFORM_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE::parallel)
 
 using Instance = comp::detail::ContextInstance<ParallelContext>;
 
+// ------------------------------------------------------------------------------------------------
+
+namespace {
+
+// NUMA topology of the system.
+// We query the topology from the OS directly to avoid the dependency to libnuma.
+class NumaTopology {
+private:
+    #if LM_PLATFORM_LINUX
+    std::vector<std::vector<int>> cpus_;    // CPUs for each node
+    #elif LM_PLATFORM_WINDOWS
+    std::vector<GROUP_AFFINITY> masks_;     // Processor mask for each node
+    #endif
+
+public:
+    static NumaTopology& instance() {
+        static NumaTopology instance;
+        return instance;
+    }
+
+    NumaTopology() {
+        #if LM_PLATFORM_LINUX
+        // Parse /sys/devices/system/node/node<i>/cpulist, e.g., 0-15,32-47
+        for (int node = 0;; node++) {
+            std::ifstream in(fmt::format("/sys/devices/system/node/node{}/cpulist", node));
+            if (!in) {
+                break;
+            }
+            std::vector<int> cpus;
+            std::string range;
+            while (std::getline(in, range, ',')) {
+                int b, e;
+                const auto n = std::sscanf(range.c_str(), "%d-%d", &b, &e);
+                if (n == 1) {
+                    cpus.push_back(b);
+                }
+                else if (n == 2) {
+                    for (int i = b; i <= e; i++) {
+                        cpus.push_back(i);
+                    }
+                }
+            }
+            cpus_.push_back(std::move(cpus));
+        }
+        #elif LM_PLATFORM_WINDOWS
+        ULONG highest = 0;
+        if (GetNumaHighestNodeNumber(&highest)) {
+            for (USHORT node = 0; node <= USHORT(highest); node++) {
+                GROUP_AFFINITY mask;
+                if (!GetNumaNodeProcessorMaskEx(node, &mask)) {
+                    break;
+                }
+                masks_.push_back(mask);
+            }
+        }
+        #endif
+    }
+
+    int num_nodes() const {
+        #if LM_PLATFORM_LINUX
+        return std::max(1, int(cpus_.size()));
+        #elif LM_PLATFORM_WINDOWS
+        return std::max(1, int(masks_.size()));
+        #else
+        return 1;
+        #endif
+    }
+
+    // Pin the current thread to the CPUs of the node
+    void bind_thread(int node) const {
+        if (num_nodes() <= 1) {
+            return;
+        }
+        #if LM_PLATFORM_LINUX
+        if (cpus_[node].empty()) {
+            // Memory-only node
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus_[node]) {
+            CPU_SET(cpu, &set);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+        #elif LM_PLATFORM_WINDOWS
+        SetThreadGroupAffinity(GetCurrentThread(), &masks_[node], nullptr);
+        #else
+        LM_UNUSED(node);
+        #endif
+    }
+
+    // Interleave the pages of the memory region across the nodes
+    void interleave(void* p, size_t size) const {
+        if (num_nodes() <= 1 || size == 0) {
+            return;
+        }
+        #if LM_PLATFORM_LINUX
+        // mbind(MPOL_INTERLEAVE, MPOL_MF_MOVE), where the constants follow <numaif.h>
+        constexpr int MpolInterleave = 3;
+        constexpr unsigned MpolMfMove = 1 << 1;
+        const auto page = (uintptr_t)(sysconf(_SC_PAGESIZE));
+        const auto b = (uintptr_t)(p) & ~(page - 1);
+        const auto e = (uintptr_t)(p) + size;
+        constexpr int Bits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> nodemask((num_nodes() + Bits - 1) / Bits, 0);
+        for (int node = 0; node < num_nodes(); node++) {
+            nodemask[node / Bits] |= 1UL << (node % Bits);
+        }
+        syscall(SYS_mbind, b, e - b, MpolInterleave, nodemask.data(), (unsigned long)(nodemask.size() * Bits + 1), MpolMfMove);
+        #else
+        // Interleaving of the existing memory is not supported
+        LM_UNUSED(p, size);
+        #endif
+    }
+};
+
+// Task spawned into the pool
+struct Task {
+    TaskFunc func;      // Task function
+    TaskGroup* group;   // Group the task belongs to
+};
+
+// Lock-free work-stealing deque [Chase & Lev 2005].
+// We follow the C11 formulation by Lê et al. [2013].
+// Only the owner thread can call push() and pop(), and any thread can call steal().
+class WorkStealingDeque {
+private:
+    // Circular array of tasks
+    struct Array {
+        long long cap;
+        std::unique_ptr<std::atomic<Task*>[]> buf;
+        Array(long long cap) : cap(cap), buf(new std::atomic<Task*>[cap]) {}
+        Task* get(long long i) const { return buf[i & (cap - 1)].load(std::memory_order_relaxed); }
+        void put(long long i, Task* t) { buf[i & (cap - 1)].store(t, std::memory_order_relaxed); }
+    };
+
+    std::atomic<long long> top_ = 0;
+    std::atomic<long long> bottom_ = 0;
+    std::atomic<Array*> array_;
+    std::vector<std::unique_ptr<Array>> arrays_;    // Keeps retired arrays alive for concurrent thieves
+
+public:
+    WorkStealingDeque() {
+        arrays_.emplace_back(new Array(1024));
+        array_.store(arrays_.back().get());
+    }
+
+    void push(Task* t) {
+        const auto b = bottom_.load(std::memory_order_relaxed);
+        const auto tp = top_.load(std::memory_order_acquire);
+        auto* a = array_.load(std::memory_order_relaxed);
+        if (b - tp > a->cap - 1) {
+            // Grow the array
+            auto* na = new Array(a->cap * 2);
+            for (long long i = tp; i < b; i++) {
+                na->put(i, a->get(i));
+            }
+            arrays_.emplace_back(na);
+            array_.store(na, std::memory_order_release);
+            a = na;
+        }
+        a->put(b, t);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    Task* pop() {
+        const auto b = bottom_.load(std::memory_order_relaxed) - 1;
+        auto* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto tp = top_.load(std::memory_order_relaxed);
+        if (tp > b) {
+            // Empty
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        auto* t = a->get(b);
+        if (tp == b) {
+            // Last element. Compete with thieves.
+            if (!top_.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                t = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return t;
+    }
+
+    Task* steal() {
+        auto tp = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const auto b = bottom_.load(std::memory_order_acquire);
+        if (tp >= b) {
+            return nullptr;
+        }
+        auto* a = array_.load(std::memory_order_acquire);
+        auto* t = a->get(tp);
+        if (!top_.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            // Lost the race
+            return nullptr;
+        }
+        return t;
+    }
+};
+
+// Work-stealing task pool
+class TaskPool {
+private:
+    std::atomic<int> num_workers_ = 0;                      // Number of workers including the caller
+    std::mutex start_lock_;                                 // Lock for start() and stop()
+    std::vector<std::unique_ptr<WorkStealingDeque>> qs_;    // Per-worker deques (index 0: external threads)
+    std::mutex external_lock_;                              // Lock for the deque of external threads
+    std::vector<std::thread> threads_;                      // Background workers
+    ExecutorFunc executor_;                                 // External executor hook
+    int running_ = 0;                                       // Number of running background workers
+    std::atomic<long long> queued_ = 0;                     // Number of tasks in the deques
+    std::atomic<int> sleeping_ = 0;                         // Number of sleeping workers
+    std::atomic<bool> stop_ = false;
+    std::mutex mu_;
+    std::condition_variable cv_;
+
+    // Index of the worker of the current thread. 0 for non-worker threads.
+    static int& worker_index() {
+        thread_local int index = 0;
+        return index;
+    }
+
+public:
+    static TaskPool& instance() {
+        static TaskPool instance;
+        return instance;
+    }
+
+    ~TaskPool() {
+        stop();
+    }
+
+    void start() {
+        if (num_workers_ > 0) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(start_lock_);
+        if (num_workers_ > 0) {
+            return;
+        }
+        const int n = std::max(1, Instance::initialized()
+            ? Instance::get().num_threads()
+            : int(std::thread::hardware_concurrency()));
+        stop_ = false;
+        for (int i = 0; i < n; i++) {
+            qs_.emplace_back(new WorkStealingDeque);
+        }
+        num_workers_ = n;
+        // The external thread in wait() participates as a worker
+        for (int i = 1; i < n; i++) {
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                running_++;
+            }
+            const auto worker = [this, i]() {
+                worker_index() = i;
+                exception::init_thread();
+                if (Instance::initialized() && Instance::get().numa()) {
+                    bind_to_numa_node(i);
+                }
+                worker_loop();
+                worker_index() = 0;
+                std::unique_lock<std::mutex> lock(mu_);
+                running_--;
+                cv_.notify_all();
+            };
+            if (executor_) {
+                // Let the host application run the worker on its own thread
+                executor_(worker);
+            }
+            else {
+                threads_.emplace_back(worker);
+            }
+        }
+    }
+
+    void stop() {
+        std::unique_lock<std::mutex> start_lock(start_lock_);
+        if (num_workers_ == 0) {
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            stop_ = true;
+            cv_.notify_all();
+        }
+        for (auto& th : threads_) {
+            th.join();
+        }
+        threads_.clear();
+        {
+            // Wait for the workers running on the external executor
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait(lock, [&]() { return running_ == 0; });
+        }
+        qs_.clear();
+        num_workers_ = 0;
+    }
+
+    void set_executor(const ExecutorFunc& executor) {
+        stop();
+        std::unique_lock<std::mutex> lock(start_lock_);
+        executor_ = executor;
+    }
+
+    // Index of the worker of the current thread
+    int current_worker() const {
+        return worker_index();
+    }
+
+    void spawn(TaskGroup& group, const TaskFunc& func) {
+        TaskGroupAccess::pending(group)++;
+        auto* task = new Task{ func, &group };
+        const int wi = worker_index();
+        if (wi == 0) {
+            // Deque 0 is shared by all non-worker threads
+            std::unique_lock<std::mutex> lock(external_lock_);
+            qs_[0]->push(task);
+        }
+        else {
+            qs_[wi]->push(task);
+        }
+        queued_++;
+        if (sleeping_ > 0) {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.notify_one();
+        }
+    }
+
+    void wait(TaskGroup& group) {
+        auto& pending = TaskGroupAccess::pending(group);
+        while (pending > 0) {
+            if (!try_execute()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    // Find a task from the own deque or other deques
+    Task* find_task() {
+        const int wi = worker_index();
+        if (wi > 0) {
+            if (auto* t = qs_[wi]->pop(); t) {
+                return t;
+            }
+        }
+        else {
+            std::unique_lock<std::mutex> lock(external_lock_);
+            if (auto* t = qs_[0]->pop(); t) {
+                return t;
+            }
+        }
+        // Steal from other deques starting from a random victim
+        thread_local std::minstd_rand rng(std::random_device{}());
+        const int start = int(rng() % num_workers_);
+        for (int i = 0; i < num_workers_; i++) {
+            const int vi = (start + i) % num_workers_;
+            if (vi == wi) {
+                continue;
+            }
+            if (auto* t = qs_[vi]->steal(); t) {
+                return t;
+            }
+        }
+        return nullptr;
+    }
+
+    // Execute a task if found
+    bool try_execute() {
+        auto* t = find_task();
+        if (!t) {
+            return false;
+        }
+        queued_--;
+        try {
+            t->func();
+        }
+        catch (...) {
+            TaskGroupAccess::capture(*t->group, std::current_exception());
+        }
+        TaskGroupAccess::pending(*t->group)--;
+        delete t;
+        return true;
+    }
+
+    void worker_loop() {
+        while (!stop_) {
+            if (try_execute()) {
+                continue;
+            }
+            if (queued_ > 0) {
+                // Tasks are available but we lost the races
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mu_);
+            sleeping_++;
+            cv_.wait(lock, [&]() { return stop_ || queued_ > 0; });
+            sleeping_--;
+        }
+    }
+};
+
+}
+
+// ------------------------------------------------------------------------------------------------
+
+/*
+\rst
+.. function:: parallel::workstealing
+
+    Parallel context with the work-stealing task pool.
+
+    :param int num_threads: Number of threads.
+                            If the value is zero or negative, the number of threads
+                            is determined relative to the number of available cores.
+    :param int progress_update_interval: Interval of the progress updates in milliseconds. Default: ``100``.
+    :param int grain_size: Number of samples processed by a task.
+                           If the value is zero, the size is determined adaptively
+                           according to the number of samples and threads. Default: ``0``.
+    :param bool numa: Pin the workers to NUMA nodes in a round-robin manner
+                      and interleave large buffers across the nodes. Default: ``false``.
+
+    This context executes :cpp:func:`lm::parallel::foreach` on the same work-stealing task pool
+    used by :cpp:class:`lm::parallel::TaskGroup`, which is implemented with native threads.
+    The range of samples is recursively split into tasks and idle workers steal the tasks.
+    Since the thread calling ``foreach`` participates in the processing while waiting,
+    ``foreach`` can be nested inside ``foreach`` or inside a task,
+    e.g., to parallelize build phases inside a parallel loop, without oversubscription.
+
+    By default the pool creates ``num_threads-1`` background threads.
+    If the host application already owns a thread pool,
+    it can supply the workers with :cpp:func:`lm::parallel::set_executor`.
+    The thread calling ``foreach`` from outside of the pool is given the thread index 0.
+    The progress is counted per worker and reported by a background thread
+    at every ``progress_update_interval`` milliseconds.
+
+    If the thread budget of the calling thread (:cpp:func:`lm::parallel::set_thread_budget`)
+    is smaller than ``num_threads``, the range is not split recursively.
+    Instead, the loop spawns as many tasks as the budget, which take the chunks of samples
+    from a shared counter, so that the concurrent jobs with the budgets share the pool.
+\endrst
+*/
+class ParallelContext_WorkStealing final : public ParallelContext {
+private:
+    int num_threads_;                       // Number of threads
+    long long grain_size_;                  // Number of samples per task. 0 for adaptive.
+    bool numa_;                             // Enables NUMA-aware thread pinning
+    std::unique_ptr<ProgressReporter> reporter_;    // Reporter of the progress
+
+public:
+    virtual void construct(const Json& prop) override {
+        reporter_ = std::make_unique<ProgressReporter>(
+            json::value<long long>(prop, "progress_update_interval", 100));
+        num_threads_ = json::value(prop, "num_threads", std::thread::hardware_concurrency());
+        if (num_threads_ <= 0) {
+            num_threads_ = std::thread::hardware_concurrency() + num_threads_;
+        }
+        grain_size_ = json::value<long long>(prop, "grain_size", 0);
+        numa_ = json::value<bool>(prop, "numa", false);
+        if (grain_size_ < 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid grain size [grain_size='{}']", grain_size_);
+        }
+    }
+
+    virtual int num_threads() const override {
+        return num_threads_;
+    }
+
+    virtual bool main_thread() const override {
+        return TaskPool::instance().current_worker() == 0;
+    }
+
+    virtual bool numa() const override {
+        return numa_;
+    }
+
+    virtual void foreach(long long numSamples, const ParallelProcessFunc& processFunc, const ProgressUpdateFunc& progressUpdateFunc, CancelToken* token) const override {
+        if (numSamples <= 0) {
+            return;
+        }
+        auto& pool = TaskPool::instance();
+        pool.start();
+
+        // The loops started while the cancellation is disabled are not given the token
+        const bool cancellable = cancel_enabled();
+        if (!cancellable) {
+            token = nullptr;
+        }
+
+        // Number of threads within the budget of the calling thread
+        const int nt = std::min(thread_budget(), num_threads_);
+
+        // Determine the number of samples processed by a task
+        const long long grain = grain_size_ > 0
+            ? grain_size_
+            : std::clamp(numSamples / (nt * 16LL), 1LL, 1024LL);
+
+        std::atomic<bool> done = false;
+        const auto stop = [&]() {
+            return done || (cancellable && cancel_requested()) || (token && token->cancel_requested());
+        };
+        ProgressCounters counters(num_threads_);
+        ProgressReporter::Scope report(*reporter_, counters, progressUpdateFunc);
+        TaskGroup group;
+
+        // Process the samples in the range [s,e)
+        const auto process_samples = [&](long long s, long long e) {
+            const int thread_id = pool.current_worker();
+            for (long long i = s; i < e; i++) {
+                // Stop if cancellation is requested
+                if (stop()) {
+                    return;
+                }
+                try {
+                    processFunc(i, thread_id);
+                }
+                catch (...) {
+                    done = true;
+                    throw;
+                }
+                counters.add(thread_id);
+            }
+        };
+
+        if (nt < num_threads_) {
+            // With the thread budget, the loop runs exactly nt tasks taking the chunks from a shared counter
+            // so that at most nt threads of the pool participate in the loop.
+            const long long num_chunks = (numSamples + grain - 1) / grain;
+            std::atomic<long long> next_chunk = 0;
+            const auto process_chunks = [&]() {
+                for (;;) {
+                    // The deadline of the token is checked once per chunk
+                    if (stop() || (token && token->cancelled())) {
+                        return;
+                    }
+                    const long long chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+                    if (chunk >= num_chunks) {
+                        return;
+                    }
+                    const long long s = chunk * grain;
+                    process_samples(s, std::min(s + grain, numSamples));
+                }
+            };
+            for (int i = 0; i < nt; i++) {
+                group.run(process_chunks);
+            }
+            group.wait();
+            report.finish();
+            return;
+        }
+
+        // Recursively split the range and process the samples
+        std::function<void(long long, long long)> process_range = [&](long long s, long long e) {
+            // Skip the range without splitting if the loop is stopped.
+            // The deadline of the token is checked once per range.
+            if (stop() || (token && token->cancelled())) {
+                return;
+            }
+
+            // Spawn the right half until the range is small enough
+            while (e - s > grain) {
+                const long long m = s + (e - s) / 2;
+                group.run([&process_range, m, e]() { process_range(m, e); });
+                e = m;
+            }
+
+            process_samples(s, e);
+        };
+        group.run([&]() { process_range(0, numSamples); });
+        group.wait();
+        report.finish();
+    }
+};
+
+LM_COMP_REG_IMPL(ParallelContext_WorkStealing, "parallel::workstealing");
+
+// ------------------------------------------------------------------------------------------------
+
 LM_PUBLIC_API void init(const std::string& type, const Json& prop) {
+    // The task pool is restarted lazily with the new configuration
+    TaskPool::instance().stop();
     Instance::init("parallel::" + type, prop);
 }
 
 LM_PUBLIC_API void shutdown() {
+    TaskPool::instance().stop();
     Instance::shutdown();
 }
 
@@ -22,12 +621,101 @@ LM_PUBLIC_API int num_threads() {
     return Instance::get().num_threads();
 }
 
+namespace {
+thread_local int thread_budget_ = 0;    // Thread budget of the current thread. 0 for unlimited.
+}
+
+LM_PUBLIC_API int set_thread_budget(int n) {
+    const int prev = thread_budget_;
+    thread_budget_ = std::max(n, 0);
+    return prev;
+}
+
+LM_PUBLIC_API int thread_budget() {
+    const int n = num_threads();
+    return thread_budget_ > 0 ? std::min(thread_budget_, n) : n;
+}
+
 LM_PUBLIC_API bool main_thread() {
     return Instance::get().main_thread();
 }
 
-LM_PUBLIC_API void foreach(long long num_samples, const ParallelProcessFunc& process_func, const ProgressUpdateFunc& progress_func) {
-	Instance::get().foreach(num_samples, process_func, progress_func);
+LM_PUBLIC_API void foreach(long long num_samples, const ParallelProcessFunc& process_func, const ProgressUpdateFunc& progress_func, CancelToken* token) {
+	Instance::get().foreach(num_samples, process_func, progress_func, token);
+}
+
+namespace {
+std::atomic<bool> cancelled_ = false;       // Cancellation request
+thread_local CancelToken* cancel_token_;    // Cancel token of the current thread
+thread_local bool cancel_enabled_ = true;   // False if the cancellation is disabled for the current thread
+}
+
+LM_PUBLIC_API void cancel() {
+    cancelled_ = true;
+}
+
+LM_PUBLIC_API bool cancelled() {
+    return cancelled_ || (cancel_token_ && cancel_token_->cancelled());
+}
+
+LM_PUBLIC_API CancelToken* set_cancel_token(CancelToken* token) {
+    auto* prev = cancel_token_;
+    cancel_token_ = token;
+    return prev;
+}
+
+LM_PUBLIC_API CancelToken* cancel_token() {
+    return cancel_token_;
+}
+
+LM_PUBLIC_API bool cancel_requested() {
+    return cancelled_;
+}
+
+LM_PUBLIC_API bool set_cancel_enabled(bool enabled) {
+    const bool prev = cancel_enabled_;
+    cancel_enabled_ = enabled;
+    return prev;
+}
+
+LM_PUBLIC_API bool cancel_enabled() {
+    return cancel_enabled_;
+}
+
+LM_PUBLIC_API void reset_cancel() {
+    cancelled_ = false;
+}
+
+LM_PUBLIC_API int num_numa_nodes() {
+    return NumaTopology::instance().num_nodes();
+}
+
+LM_PUBLIC_API void bind_to_numa_node(int threadid) {
+    const auto& numa = NumaTopology::instance();
+    numa.bind_thread(threadid % numa.num_nodes());
+}
+
+LM_PUBLIC_API void interleave_memory(void* p, size_t size) {
+    if (!Instance::initialized() || !Instance::get().numa()) {
+        return;
+    }
+    NumaTopology::instance().interleave(p, size);
+}
+
+LM_PUBLIC_API void set_executor(const ExecutorFunc& executor) {
+    TaskPool::instance().set_executor(executor);
+}
+
+LM_PUBLIC_API void spawn_task(TaskGroup& group, const TaskFunc& func) {
+    auto& pool = TaskPool::instance();
+    pool.start();
+    pool.spawn(group, func);
+}
+
+LM_PUBLIC_API void wait_tasks(TaskGroup& group) {
+    auto& pool = TaskPool::instance();
+    pool.start();
+    pool.wait(group);
 }
 
 LM_NAMESPACE_END(LM_NAMESPACE::parallel)
@@ -7,25 +7,79 @@
 #include <lm/core.h>
 #include <lm/parallelcontext.h>
 #include <lm/progress.h>
+#include <lm/profiler.h>
 #include <omp.h>
-#if LM_PLATFORM_WINDOWS
-#include <Windows.h>
-#endif
+#include "progressreporter.h"
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE::parallel)
 
+/*
+\rst
+.. function:: parallel::openmp
+
+    Parallel context with OpenMP.
+
+    :param int num_threads: Number of threads.
+                            If the value is zero or negative, the number of threads
+                            is determined relative to the number of available cores.
+    :param int progress_update_interval: Interval of the progress updates in milliseconds. Default: ``100``.
+    :param int grain_size: Number of samples dispatched to a thread at once.
+                           If the value is zero, the size of a chunk is determined
+                           adaptively according to the number of samples and threads.
+                           Default: ``0``.
+    :param int chunks_per_thread: Number of chunks per thread in the adaptive mode. Default: ``16``.
+    :param int max_grain_size: Maximum number of samples per chunk in the adaptive mode.
+                               Default: ``1024``.
+    :param bool numa: Pin the threads to NUMA nodes in a round-robin manner
+                      and interleave large buffers across the nodes. Default: ``false``.
+
+    The samples are dispatched to the threads in chunks of consecutive indices.
+    Dispatching each sample one by one is costly when the work per sample is small,
+    because every sample pays the dynamic dequeue and the setup of the exception handling.
+    In the adaptive mode, every thread receives approximately ``chunks_per_thread`` chunks
+    so that the load balancing is kept with the small dispatch overhead.
+
+    The progress is counted per thread and reported by a background thread
+    at every ``progress_update_interval`` milliseconds,
+    so the loop pays no shared atomic operations for the progress reporting.
+
+    The chunks are taken from a shared counter by the threads of the team.
+    When the loop is cancelled by :cpp:func:`lm::parallel::cancel` or by the cancel token,
+    or when an iteration throws an exception, the threads stop taking the chunks
+    and the loop returns as soon as the samples being processed are finished,
+    without walking the remaining indices.
+
+    If the profiler is enabled, the time each thread waits from the end of its last chunk
+    to the end of the loop is recorded as ``parallel_wait`` stage,
+    which measures the load imbalance of the loop.
+\endrst
+*/
 class ParallelContext_OpenMP final : public ParallelContext {
 private:
-    long long progress_update_interval_;	// Number of samples per progress update
     int num_threads_;					// Number of threads
+    long long grain_size_;              // Number of samples per chunk. 0 for adaptive chunking.
+    long long chunks_per_thread_;       // Number of chunks per thread in adaptive chunking
+    long long max_grain_size_;          // Maximum number of samples per chunk in adaptive chunking
+    bool numa_;                         // Enables NUMA-aware thread pinning
+    std::unique_ptr<ProgressReporter> reporter_;  // Reporter of the progress
 
 public:
     virtual void construct(const Json& prop) override {
-        progress_update_interval_ = json::value<long long>(prop, "progress_update_interval", 100);
+        reporter_ = std::make_unique<ProgressReporter>(
+            json::value<long long>(prop, "progress_update_interval", 100));
         num_threads_ = json::value(prop, "num_threads", std::thread::hardware_concurrency());
         if (num_threads_ <= 0) {
             num_threads_ = std::thread::hardware_concurrency() + num_threads_;
         }
+        grain_size_ = json::value<long long>(prop, "grain_size", 0);
+        chunks_per_thread_ = json::value<long long>(prop, "chunks_per_thread", 16);
+        max_grain_size_ = json::value<long long>(prop, "max_grain_size", 1024);
+        numa_ = json::value<bool>(prop, "numa", false);
+        if (grain_size_ < 0 || chunks_per_thread_ <= 0 || max_grain_size_ <= 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid chunking parameters [grain_size='{}', chunks_per_thread='{}', max_grain_size='{}']",
+                grain_size_, chunks_per_thread_, max_grain_size_);
+        }
         omp_set_num_threads(num_threads_);
     }
 
@@ -37,66 +91,122 @@ public:
         return omp_get_thread_num() == 0;
     }
 
-    virtual void foreach(long long numSamples, const ParallelProcessFunc& processFunc, const ProgressUpdateFunc& progressUpdateFunc) const override {
+    virtual bool numa() const override {
+        return numa_;
+    }
+
+    virtual void foreach(long long numSamples, const ParallelProcessFunc& processFunc, const ProgressUpdateFunc& progressUpdateFunc, CancelToken* token) const override {
+        // The loops started while the cancellation is disabled are not given the token
+        const bool cancellable = cancel_enabled();
+        if (!cancellable) {
+            token = nullptr;
+        }
+
         // Captured exceptions inside the parallel loop
         std::atomic<bool> done = false;
         std::exception_ptr exp;
         std::mutex explock;
 
-        // Execute parallel loop
-        std::atomic<long long> processed = 0;
-        #pragma omp parallel for schedule(dynamic, 1)
-        for (long long i = 0; i < numSamples; i++) {
-            // Spin the loop if cancellation is requested
-            if (done) {
-                continue;
-            }
+        // Number of threads within the budget of the calling thread.
+        // The team size is given explicitly because the number of threads
+        // configured by omp_set_num_threads() is not inherited by the other threads.
+        const int nt = thread_budget();
 
-            // OpenMP prohibits to throw exception inside parallel region
-            // and to catch in the outer context.
-            // cf. p.10
-            // https://www.openmp.org/wp-content/uploads/cspec20_bars.pdf
-            // A throw executed inside a parallel region must cause execution to resume within
-            // the dynamic extent of the same structured block, and it must be caught by the
-            // same thread that threw the exception.
-            try {
-                const int thread_id = omp_get_thread_num();
-
-                #if LM_PLATFORM_WINDOWS
-                // Set process group
-                GROUP_AFFINITY mask;
-                if (GetNumaNodeProcessorMaskEx(thread_id % 2, &mask)) {
-                    SetThreadGroupAffinity(GetCurrentThread(), &mask, nullptr);
-                }
-                #endif
+        // Determine the size of a chunk
+        const long long grain = grain_size_ > 0
+            ? grain_size_
+            : std::clamp(numSamples / (nt * chunks_per_thread_), 1LL, max_grain_size_);
+        const long long numChunks = (numSamples + grain - 1) / grain;
 
-                // Dispatch user-defined process
-                processFunc(i, thread_id);
+        // Index of the next chunk to be processed
+        std::atomic<long long> next_chunk = 0;
+        const auto stop = [&]() {
+            return done || (cancellable && cancel_requested()) || (token && token->cancel_requested());
+        };
 
-                // Update processed number of samples
-                if (thread_local long long count = 0; ++count >= progress_update_interval_) {
-                    processed += count;
-                    count = 0;
+        // Execute parallel loop
+        ProgressCounters counters(nt);
+        ProgressReporter::Scope report(*reporter_, counters, progressUpdateFunc);
+        #if LM_PROFILER
+        // Time of the end of the last chunk for each thread
+        using Clock = std::chrono::steady_clock;
+        const auto loop_start = Clock::now();
+        std::vector<Clock::time_point> chunk_end(nt, loop_start);
+        #endif
+        #pragma omp parallel num_threads(nt)
+        {
+            for (;;) {
+                // Exit the loop if cancellation is requested.
+                // The deadline of the token is checked once per chunk.
+                if (stop() || (token && token->cancelled())) {
+                    break;
                 }
+                const long long chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+                if (chunk >= numChunks) {
+                    break;
+                }
+
+                // OpenMP prohibits to throw exception inside parallel region
+                // and to catch in the outer context.
+                // cf. p.10
+                // https://www.openmp.org/wp-content/uploads/cspec20_bars.pdf
+                // A throw executed inside a parallel region must cause execution to resume within
+                // the dynamic extent of the same structured block, and it must be caught by the
+                // same thread that threw the exception.
+                try {
+                    const int thread_id = omp_get_thread_num();
+
+                    // Pin the thread to a NUMA node once per thread
+                    if (thread_local bool bound = false; numa_ && !bound) {
+                        bind_to_numa_node(thread_id);
+                        bound = true;
+                    }
 
-                // Update progress
-                if (thread_id == 0) {
-                    progressUpdateFunc(processed);
+                    // Initialize the floating-point exceptions once per thread
+                    if (thread_local bool initialized = false; !initialized) {
+                        exception::init_thread();
+                        initialized = true;
+                    }
+
+                    // Dispatch user-defined process for the samples in the chunk
+                    const long long s = chunk * grain;
+                    const long long e = std::min(s + grain, numSamples);
+                    for (long long i = s; i < e; i++) {
+                        if (stop()) {
+                            break;
+                        }
+                        processFunc(i, thread_id);
+                        counters.add(thread_id);
+                    }
+                    #if LM_PROFILER
+                    chunk_end[thread_id] = Clock::now();
+                    #endif
+                }
+                catch (...) {
+                    // Capture exception
+                    // pick the last one if some of the threads throw exceptions simultaneously
+                    std::unique_lock<std::mutex> lock(explock);
+                    exp = std::current_exception();
+                    done = true;
                 }
-            }
-            catch (...) {
-                // Capture exception
-                // pick the last one if some of the threads throw exceptions simultaneously
-                std::unique_lock<std::mutex> lock(explock);
-                exp = std::current_exception();
-                done = true;
             }
         }
         
+        #if LM_PROFILER
+        // Record the wait for the other threads
+        const auto loop_end = Clock::now();
+        for (const auto& t : chunk_end) {
+            profiler::add(profiler::Stage::ParallelWait,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(loop_end - t).count());
+        }
+        #endif
+
         // Rethrow exception if available
         if (exp) {
             std::rethrow_exception(exp);
         }
+
+        report.finish();
     }
 };
 
@@ -0,0 +1,126 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include <lm/core.h>
+#include <lm/parallel.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::parallel)
+
+// Number of processed samples for each thread.
+// Each counter is only written by the owner thread and padded to the cache line,
+// so that counting a sample is a relaxed load and store without contention.
+class ProgressCounters {
+private:
+    struct alignas(64) Counter {
+        std::atomic<long long> v{0};
+    };
+    std::vector<Counter> counters_;
+
+public:
+    ProgressCounters(int num_threads) : counters_(num_threads) {}
+
+    void add(int threadid, long long n = 1) {
+        auto& v = counters_[threadid].v;
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    long long processed() const {
+        long long sum = 0;
+        for (const auto& c : counters_) {
+            sum += c.v.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+};
+
+// Background thread reporting the progress of the parallel loop at a fixed interval.
+// The reporter reads the counters of one loop at a time.
+// A loop started while another loop is being reported, e.g., a nested loop,
+// is not reported periodically and only reports the final progress.
+class ProgressReporter {
+private:
+    struct Job {
+        const ProgressCounters* counters;
+        const ProgressUpdateFunc* func;
+    };
+
+    std::chrono::milliseconds interval_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    const Job* job_ = nullptr;
+    bool stop_ = false;
+    std::thread thread_;
+
+public:
+    ProgressReporter(long long interval_ms) : interval_(interval_ms) {
+        thread_ = std::thread([this] {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_) {
+                cv_.wait_for(lock, interval_);
+                if (job_) {
+                    (*job_->func)(job_->counters->processed());
+                }
+            }
+        });
+    }
+
+    ~ProgressReporter() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    LM_DISABLE_COPY_AND_MOVE(ProgressReporter)
+
+public:
+    // Report the progress of the loop while the returned object is alive
+    class Scope {
+    private:
+        ProgressReporter& reporter_;
+        Job job_;
+        bool registered_ = false;
+
+    public:
+        Scope(ProgressReporter& reporter, const ProgressCounters& counters, const ProgressUpdateFunc& func)
+            : reporter_(reporter), job_{ &counters, &func }
+        {
+            std::unique_lock<std::mutex> lock(reporter_.mutex_);
+            if (!reporter_.job_) {
+                reporter_.job_ = &job_;
+                registered_ = true;
+            }
+        }
+
+        ~Scope() {
+            unregister();
+        }
+
+        LM_DISABLE_COPY_AND_MOVE(Scope)
+
+        // Stop the periodic reports and report the final progress
+        void finish() {
+            unregister();
+            (*job_.func)(job_.counters->processed());
+        }
+
+    private:
+        void unregister() {
+            if (!registered_) {
+                return;
+            }
+            // Wait until the reporter finishes the ongoing update
+            std::unique_lock<std::mutex> lock(reporter_.mutex_);
+            reporter_.job_ = nullptr;
+            registered_ = false;
+        }
+    };
+};
+
+LM_NAMESPACE_END(LM_NAMESPACE::parallel)
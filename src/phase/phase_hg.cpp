@@ -22,24 +22,44 @@ class Phase_HenyeyGreenstein final : public Phase {
 private:
     Float g_;   // Asymmetry parameter in [-1,1]
 
+    // Constants depending only on g precomputed for the evaluation and the inverse CDF
+    bool isotropic_;    // True if g is close to zero
+    Float a_;           // 1+g^2
+    Float b_;           // 1-g^2
+    Float inv_2g_;      // 1/(2g)
+    Float norm_;        // (1-g^2)/(4pi)
+
 public:
     LM_SERIALIZE_IMPL(ar) {
         ar(g_);
+        if constexpr (std::is_same_v<Archive, InputArchive>) {
+            precompute();
+        }
     }
 
     virtual void construct(const Json& prop) override {
         g_ = json::value<Float>(prop, "g");
+        precompute();
+    }
+
+private:
+    void precompute() {
+        isotropic_ = std::abs(g_) < Eps;
+        a_ = 1_f + g_*g_;
+        b_ = 1_f - g_*g_;
+        inv_2g_ = isotropic_ ? 0_f : 1_f / (2_f*g_);
+        norm_ = b_ / (Pi*4_f);
     }
 
 public:
     virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& us, const PointGeometry&, Vec3 wi) const override {
         const auto cosT = [&]() -> Float {
-            if (std::abs(g_) < Eps) {
+            if (isotropic_) {
                 return 1_f - 2_f*us.ud[0];
             }
             else {
-                const auto sq = (1_f-g_*g_)/(1_f-g_+2*g_*us.ud[0]);
-                return (1_f+g_*g_-sq*sq)/(2_f*g_);
+                const auto sq = b_/(1_f-g_+2_f*g_*us.ud[0]);
+                return (a_-sq*sq)*inv_2g_;
             }
         }();
         const auto sinT = math::safe_sqrt(1_f-cosT*cosT);
@@ -53,13 +73,15 @@ public:
     }
 
     virtual Float pdf_direction(const PointGeometry&, Vec3 wi, Vec3 wo) const override {
-        Float t = 1_f + g_*g_ + 2_f*g_*glm::dot(wi, wo);
-        return (1_f-g_*g_) / (t*std::sqrt(t)) / (Pi*4_f);
+        const auto t = a_ + 2_f*g_*glm::dot(wi, wo);
+        return norm_ / (t*std::sqrt(t));
     }
 
     virtual Vec3 eval(const PointGeometry& geom, Vec3 wi, Vec3 wo) const override {
         return Vec3(pdf_direction(geom, wi, wo));
     }
+
+    LM_PHASE_BATCH_IMPL()
 };
 
 LM_COMP_REG_IMPL(Phase_HenyeyGreenstein, "phase::hg");
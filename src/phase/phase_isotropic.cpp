@@ -38,6 +38,8 @@ public:
         // Normalization constant = 1/(4*pi)
         return Vec3(math::pdf_uniform_sphere());
     }
+
+    LM_PHASE_BATCH_IMPL()
 };
 
 LM_COMP_REG_IMPL(Phase_Isotropic, "phase::isotropic");
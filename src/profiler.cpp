@@ -0,0 +1,107 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/profiler.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::profiler)
+
+constexpr int NumStages = int(Stage::Count);
+
+// Statistics recorded by a thread.
+// The values are only updated by the owner thread,
+// so we can avoid the costly read-modify-write operations.
+struct ThreadStats {
+    std::atomic<long long> count[NumStages];
+    std::atomic<long long> elapsed[NumStages];
+    ThreadStats() {
+        for (int i = 0; i < NumStages; i++) {
+            count[i].store(0, std::memory_order_relaxed);
+            elapsed[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+struct Context {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadStats>> thread_stats;
+
+    static Context& instance() {
+        static Context instance;
+        return instance;
+    }
+
+    // Get the statistics of the current thread.
+    // The storage is registered on the first call from the thread and kept until the end of the process,
+    // since the aggregation can happen after the thread is terminated.
+    ThreadStats& current() {
+        thread_local ThreadStats* stats = [this]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            thread_stats.push_back(std::make_unique<ThreadStats>());
+            return thread_stats.back().get();
+        }();
+        return *stats;
+    }
+};
+
+static const char* stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::Intersect:       return "intersect";
+        case Stage::Visible:         return "visible";
+        case Stage::AccelBuild:      return "accel_build";
+        case Stage::SampleDistance:  return "sample_distance";
+        case Stage::SampleDirection: return "sample_direction";
+        case Stage::Splat:           return "splat";
+        case Stage::LogWait:         return "log_wait";
+        case Stage::ParallelWait:    return "parallel_wait";
+        case Stage::Count:           break;
+    }
+    LM_UNREACHABLE_RETURN();
+}
+
+// ------------------------------------------------------------------------------------------------
+
+LM_PUBLIC_API void add(Stage stage, long long elapsed, long long count) {
+    auto& s = Context::instance().current();
+    const int i = int(stage);
+    s.count[i].store(s.count[i].load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    s.elapsed[i].store(s.elapsed[i].load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+}
+
+LM_PUBLIC_API void reset() {
+    auto& ctx = Context::instance();
+    std::unique_lock<std::mutex> lock(ctx.mutex);
+    for (auto& s : ctx.thread_stats) {
+        for (int i = 0; i < NumStages; i++) {
+            s->count[i].store(0, std::memory_order_relaxed);
+            s->elapsed[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+LM_PUBLIC_API Json stats() {
+    auto& ctx = Context::instance();
+    std::unique_lock<std::mutex> lock(ctx.mutex);
+    Json result = Json::object();
+    for (int i = 0; i < NumStages; i++) {
+        long long count = 0;
+        long long elapsed = 0;
+        for (const auto& s : ctx.thread_stats) {
+            count += s->count[i].load(std::memory_order_relaxed);
+            elapsed += s->elapsed[i].load(std::memory_order_relaxed);
+        }
+        if (count == 0) {
+            continue;
+        }
+        result[stage_name(Stage(i))] = {
+            {"count", count},
+            {"time", Float(elapsed) * 1e-9_f}
+        };
+    }
+    return result;
+}
+
+LM_NAMESPACE_END(LM_NAMESPACE::profiler)
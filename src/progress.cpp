@@ -6,6 +6,7 @@
 #include <pch.h>
 #include <lm/progresscontext.h>
 #include <lm/logger.h>
+#include <lm/trace.h>
 
 using namespace std::chrono;
 using namespace std::literals::chrono_literals;
@@ -190,6 +191,7 @@ LM_PUBLIC_API void shutdown() {
 }
 
 LM_PUBLIC_API void start(ProgressMode mode, long long total, double totalTime) {
+    trace::begin("progress");
     Instance::get().start(mode, total, totalTime);
 }
 
@@ -203,6 +205,7 @@ LM_PUBLIC_API void update_time(Float elapsed) {
 
 LM_PUBLIC_API void end() {
     Instance::get().end();
+    trace::end();
 }
 
 LM_NAMESPACE_END(LM_NAMESPACE::progress)
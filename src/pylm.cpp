@@ -13,6 +13,68 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
 // ------------------------------------------------------------------------------------------------
 
+// Monitor of the GIL acquired by the calls into the components implemented in Python.
+// The render functions release the GIL, so the time waiting for the GIL
+// measures how much the Python callbacks serialize the render threads.
+namespace gil_monitor {
+
+std::atomic<long long> acquisitions{0};     // Number of acquisitions from the threads without the GIL
+std::atomic<long long> wait_ns{0};          // Total time to acquire the GIL in nanoseconds
+
+// Acquires the GIL and records the time to acquire it.
+// Nothing is recorded if the thread already holds the GIL.
+class ScopedAcquire {
+private:
+    std::optional<pybind11::gil_scoped_acquire> acquire_;
+
+public:
+    ScopedAcquire() {
+        if (PyGILState_Check()) {
+            return;
+        }
+        const auto start = std::chrono::high_resolution_clock::now();
+        acquire_.emplace();
+        const auto end = std::chrono::high_resolution_clock::now();
+        acquisitions++;
+        wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+};
+
+void reset() {
+    acquisitions = 0;
+    wait_ns = 0;
+}
+
+Json stats() {
+    return {
+        {"acquisitions", acquisitions.load()},
+        {"wait", double(wait_ns.load()) * 1e-9}
+    };
+}
+
+// Warn if the render threads spent a considerable time waiting for the GIL
+void report(double elapsed) {
+    const auto n = acquisitions.load();
+    if (n == 0 || elapsed <= 0) {
+        return;
+    }
+    const auto wait = double(wait_ns.load()) * 1e-9;
+    const auto ratio = wait / (elapsed * parallel::num_threads());
+    if (ratio > .1) {
+        LM_WARN("Render threads waited for GIL to call Python components "
+            "[acquisitions={}, wait='{:.3f}s', ratio='{:.1f}%']. "
+            "Consider batch callbacks such as Texture.eval_batch.", n, wait, ratio * 100);
+    }
+}
+
+}
+
+// Overrides of the virtual functions in the trampoline classes recording the GIL acquisitions
+#define PYLM_OVERLOAD(...) gil_monitor::ScopedAcquire gil_acquire_; PYBIND11_OVERLOAD(__VA_ARGS__)
+#define PYLM_OVERLOAD_PURE(...) gil_monitor::ScopedAcquire gil_acquire_; PYBIND11_OVERLOAD_PURE(__VA_ARGS__)
+
+// ------------------------------------------------------------------------------------------------
+
 // Bind common.h
 static void bind_common(pybind11::module& m) {
     // Build config
@@ -79,7 +141,8 @@ static void bind_math(pybind11::module& m) {
     pybind11::class_<Rng>(m, "Rng")
         .def(pybind11::init<>())
         .def(pybind11::init<int>())
-        .def("u", &Rng::u);
+        .def("u", &Rng::u)
+        .def("split", &Rng::split);
 
     // Helper functions
     m.def("identity", []() -> Mat4 {
@@ -134,6 +197,7 @@ static void bind_component(pybind11::module& m) {
         .def("construct", &Component::construct)
         .def("underlying", &Component::underlying, pybind11::return_value_policy::reference)
         .def("underlying_value", &Component::underlying_value, "query"_a = "")
+        .def("memory_usage", &Component::memory_usage)
         .def("save", [](Component* self) -> pybind11::bytes {
             std::ostringstream os;
             {
@@ -194,8 +258,10 @@ static void bind_user(pybind11::module& m) {
     m.def("reset", &reset);
     m.def("info", &info);
     m.def("assets", &assets, pybind11::return_value_policy::reference);
-    m.def("save_state_to_file", &save_state_to_file);
+    m.def("save_state_to_file", &save_state_to_file, "path"_a, "compression"_a = 0);
     m.def("load_state_from_file", &load_state_from_file);
+    m.def("save_checkpoint", &save_checkpoint, "path"_a, "info"_a = Json{}, "compression"_a = 0);
+    m.def("load_checkpoint", &load_checkpoint);
 
     // Expose some functions in comp namespace to lm namespace
     m.def("load", [](const std::string& name, const std::string& impl_key, const Json& prop) -> Component* {
@@ -204,6 +270,9 @@ static void bind_user(pybind11::module& m) {
     m.def("load_serialized", [](const std::string& name, const std::string& path) -> Component* {
         return assets()->load_serialized(name, path);
     }, pybind11::return_value_policy::reference);
+    m.def("load_assets", [](const Json& assets_) -> std::vector<Component*> {
+        return assets()->load_assets(assets_);
+    }, pybind11::return_value_policy::reference);
     m.def("get", [](const std::string& loc) -> Component* {
         return comp::detail::get(loc);
     }, pybind11::return_value_policy::reference);
@@ -258,6 +327,9 @@ static void bind_asset_group(pybind11::module& m) {
         .def(pybind11::init<>())
         .def("load_asset", &AssetGroup::load_asset, pybind11::return_value_policy::reference)
         .def("load_serialized", &AssetGroup::load_serialized, pybind11::return_value_policy::reference)
+        .def("revision", &AssetGroup::revision)
+        .def("replaced_since", &AssetGroup::replaced_since)
+        .def("load_assets", &AssetGroup::load_assets, pybind11::return_value_policy::reference)
         .PYLM_DEF_ASSET_LOAD_MEMBER_FUNC(Mesh, mesh)
         .PYLM_DEF_ASSET_LOAD_MEMBER_FUNC(Texture, texture)
         .PYLM_DEF_ASSET_LOAD_MEMBER_FUNC(Material, material)
@@ -336,15 +408,33 @@ static void bind_parallel(pybind11::module& m) {
     });
     sm.def("shutdown", &parallel::shutdown);
     sm.def("num_threads", &parallel::num_threads);
-    sm.def("foreach", [](long long numSamples, const parallel::ParallelProcessFunc& processFunc) {
+    sm.def("set_thread_budget", &parallel::set_thread_budget);
+    sm.def("thread_budget", &parallel::thread_budget);
+    sm.def("num_numa_nodes", &parallel::num_numa_nodes);
+    sm.def("cancel", &parallel::cancel);
+    sm.def("cancelled", &parallel::cancelled);
+    sm.def("reset_cancel", &parallel::reset_cancel);
+    pybind11::class_<parallel::CancelToken, std::shared_ptr<parallel::CancelToken>>(sm, "CancelToken")
+        .def(pybind11::init<>())
+        .def("cancel", &parallel::CancelToken::cancel)
+        .def("reset", &parallel::CancelToken::reset)
+        .def("set_deadline", &parallel::CancelToken::set_deadline)
+        .def("cancelled", &parallel::CancelToken::cancelled);
+    sm.def("set_cancel_token", [](std::shared_ptr<parallel::CancelToken> token) {
+        // Keep the token alive while it is set to the thread
+        thread_local std::shared_ptr<parallel::CancelToken> current;
+        current = token;
+        parallel::set_cancel_token(token.get());
+    }, "token"_a = nullptr);
+    sm.def("foreach", [](long long numSamples, const parallel::ParallelProcessFunc& processFunc, std::shared_ptr<parallel::CancelToken> token) {
         // Release GIL and let the C++ to create new threads
         pybind11::gil_scoped_release release;
         parallel::foreach(numSamples, [&](long long index, int threadId) {
             // Reacquire GIL when we call Python function
             pybind11::gil_scoped_acquire acquire;
             processFunc(index, threadId);
-        });
-    });
+        }, [](long long) {}, token ? token.get() : parallel::cancel_token());
+    }, "num_samples"_a, "process_func"_a, "token"_a = nullptr);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -428,6 +518,30 @@ static void bind_debug(pybind11::module& m) {
     });
     sm.def("attach_to_debugger", &debug::attach_to_debugger);
     sm.def("print_asset_tree", &debug::print_asset_tree, "visualize_weak_refs"_a = false);
+    sm.def("memory_usage", &debug::memory_usage, "loc"_a = "$.assets");
+    sm.def("print_memory_usage", &debug::print_memory_usage, "loc"_a = "$.assets");
+    sm.def("gil_stats", &gil_monitor::stats);
+    sm.def("reset_gil_stats", &gil_monitor::reset);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Bind profiler.h
+static void bind_profiler(pybind11::module& m) {
+    auto sm = m.def_submodule("profiler");
+    sm.def("reset", &profiler::reset);
+    sm.def("stats", &profiler::stats);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Bind trace.h
+static void bind_trace(pybind11::module& m) {
+    auto sm = m.def_submodule("trace");
+    sm.def("init", &trace::init, "type"_a = trace::DefaultType, "prop"_a = Json{});
+    sm.def("shutdown", &trace::shutdown);
+    sm.def("begin", &trace::begin);
+    sm.def("end", &trace::end);
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -455,6 +569,33 @@ static void bind_film(pybind11::module& m) {
             );
         });
     
+    // Film snapshot owning the copy of the pixel values
+    struct FilmSnapshot {
+        int w;
+        int h;
+        std::vector<Vec3> data;
+    };
+    pybind11::class_<FilmSnapshot>(m, "FilmSnapshot", pybind11::buffer_protocol())
+        .def_buffer([](FilmSnapshot& snapshot) -> pybind11::buffer_info {
+            return pybind11::buffer_info(
+                &snapshot.data[0].x,
+                sizeof(Float),
+                pybind11::format_descriptor<Float>::format(),
+                3,
+                { snapshot.h, snapshot.w, 3 },
+                { 3 * snapshot.w * sizeof(Float),
+                  3 * sizeof(Float),
+                  sizeof(Float) }
+            );
+        });
+
+    // Film AOV
+    pybind11::enum_<FilmAOV>(m, "FilmAOV")
+        .value("Albedo", FilmAOV::Albedo)
+        .value("Normal", FilmAOV::Normal)
+        .value("Depth", FilmAOV::Depth)
+        .value("SampleCount", FilmAOV::SampleCount);
+
     // Film
     class Film_Py final : public Film {
     public:
@@ -491,6 +632,30 @@ static void bind_film(pybind11::module& m) {
         virtual void clear() override {
             PYBIND11_OVERLOAD_PURE(void, Film, clear);
         }
+        virtual void finish_region(int x0, int y0, int x1, int y1) override {
+            PYBIND11_OVERLOAD(void, Film, finish_region, x0, y0, x1, y1);
+        }
+        virtual void publish(Float s) override {
+            PYBIND11_OVERLOAD(void, Film, publish, s);
+        }
+        virtual std::vector<Vec3> snapshot() const override {
+            PYBIND11_OVERLOAD(std::vector<Vec3>, Film, snapshot);
+        }
+        virtual bool has_aovs() const override {
+            PYBIND11_OVERLOAD(bool, Film, has_aovs);
+        }
+        virtual bool has_aov(FilmAOV aov) const override {
+            PYBIND11_OVERLOAD(bool, Film, has_aov, aov);
+        }
+        virtual void splat_aov(int x, int y, FilmAOV aov, Vec3 v) override {
+            PYBIND11_OVERLOAD(void, Film, splat_aov, x, y, aov, v);
+        }
+        virtual std::vector<Vec3> aov(FilmAOV aov) const override {
+            PYBIND11_OVERLOAD(std::vector<Vec3>, Film, aov, aov);
+        }
+        virtual bool save_aov(FilmAOV aov, const std::string& outpath) const override {
+            PYBIND11_OVERLOAD(bool, Film, save_aov, aov, outpath);
+        }
     };
     pybind11::class_<Film, Film_Py, Component, Component::Ptr<Film>>(m, "Film")
         .def(pybind11::init<>())
@@ -498,9 +663,49 @@ static void bind_film(pybind11::module& m) {
         .def("size", &Film::size)
         .def("num_pixels", &Film::num_pixels)
         .def("set_pixel", &Film::set_pixel)
-        .def("save", &Film::save)
+        .def("save", &Film::save, pybind11::call_guard<pybind11::gil_scoped_release>())
         .def("aspect", &Film::aspect)
         .def("buffer", &Film::buffer)
+        .def("accum", &Film::accum)
+        .def("rescale", &Film::rescale)
+        .def("clear", &Film::clear)
+        .def("publish", &Film::publish)
+        .def("finish_region", &Film::finish_region)
+        .def("snapshot", [](const Film& film) -> pybind11::object {
+            // Read-only view of the snapshot shared with the film
+            std::shared_ptr<const std::vector<Vec3>> data;
+            {
+                pybind11::gil_scoped_release release;
+                data = film.shared_snapshot();
+            }
+            if (!data) {
+                return pybind11::none();
+            }
+            const auto size = film.size();
+            pybind11::capsule owner(new std::shared_ptr<const std::vector<Vec3>>(data), [](void* p) {
+                delete reinterpret_cast<std::shared_ptr<const std::vector<Vec3>>*>(p);
+            });
+            pybind11::array a(
+                pybind11::dtype::of<Float>(),
+                { size.h, size.w, 3 },
+                { 3 * size.w * sizeof(Float), 3 * sizeof(Float), sizeof(Float) },
+                &(*data)[0].x,
+                owner);
+            a.attr("setflags")(pybind11::arg("write") = false);
+            return std::move(a);
+        })
+        .def("has_aovs", &Film::has_aovs)
+        .def("has_aov", &Film::has_aov)
+        .def("splat_aov", &Film::splat_aov)
+        .def("aov", [](const Film& film, FilmAOV aov) -> std::optional<FilmSnapshot> {
+            auto data = film.aov(aov);
+            if (data.empty()) {
+                return {};
+            }
+            const auto size = film.size();
+            return FilmSnapshot{ size.w, size.h, std::move(data) };
+        })
+        .def("save_aov", &Film::save_aov)
         .PYLM_DEF_COMP_BIND(Film);
 }
 
@@ -519,6 +724,7 @@ static void bind_surface(pybind11::module& m) {
         .def_readwrite("t", &PointGeometry::t)
         .def_readwrite("u", &PointGeometry::u)
         .def_readwrite("v", &PointGeometry::v)
+        .def_readwrite("footprint", &PointGeometry::footprint)
         .def_static("make_degenerated", &PointGeometry::make_degenerated)
         .def_static("make_infinite", (PointGeometry(*)(Vec3)) & PointGeometry::make_infinite)
         .def_static("make_infinite", (PointGeometry(*)(Vec3, Vec3))&PointGeometry::make_infinite)
@@ -577,6 +783,23 @@ static void bind_scenenode(pybind11::module& m) {
 // ------------------------------------------------------------------------------------------------
 
 // Bind scene.h
+
+// Convert numpy array of shape (n,4,4) to transformation matrices
+static std::vector<Mat4> transforms_from_array(const pybind11::array_t<Float, pybind11::array::c_style | pybind11::array::forcecast>& a) {
+    if (a.ndim() != 3 || a.shape(1) != 4 || a.shape(2) != 4) {
+        LM_THROW_EXCEPTION(Error::InvalidArgument, "transforms must be an array of shape (n,4,4)");
+    }
+    const int n = int(a.shape(0));
+    std::vector<Mat4> ts(n);
+    const auto* data = a.data();
+    for (int i = 0; i < n; i++) {
+        // numpy is row major, glm is column major
+        memcpy(&ts[i][0].data, data + 16*size_t(i), 16 * sizeof(Float));
+        ts[i] = glm::transpose(ts[i]);
+    }
+    return ts;
+}
+
 static void bind_scene(pybind11::module& m) {
     class Scene_Py final : public Scene {
         virtual void construct(const Json& prop) override {
@@ -642,6 +865,9 @@ static void bind_scene(pybind11::module& m) {
         virtual void build() override {
             PYBIND11_OVERLOAD_PURE(void, Scene, build);
         }
+        virtual void update() override {
+            PYBIND11_OVERLOAD(void, Scene, update);
+        }
         virtual std::optional<SceneInteraction> intersect(Ray ray, Float tmin, Float tmax) const override {
             PYBIND11_OVERLOAD_PURE(std::optional<SceneInteraction>, Scene, intersect, ray, tmin, tmax);
         }
@@ -667,6 +893,25 @@ static void bind_scene(pybind11::module& m) {
         }
     };
 
+    pybind11::enum_<SceneChange::Type>(m, "SceneChange")
+        .value("None", SceneChange::None)
+        .value("Geometry", SceneChange::Geometry)
+        .value("Transform", SceneChange::Transform)
+        .value("Light", SceneChange::Light)
+        .value("Material", SceneChange::Material)
+        .value("Camera", SceneChange::Camera)
+        .value("Medium", SceneChange::Medium)
+        .value("All", SceneChange::All);
+
+    // Future of the background build of the scene
+    pybind11::class_<std::shared_future<void>>(m, "SceneBuildFuture")
+        .def("wait", [](const std::shared_future<void>& f) {
+            f.get();
+        }, pybind11::call_guard<pybind11::gil_scoped_release>())
+        .def("done", [](const std::shared_future<void>& f) {
+            return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        });
+
     pybind11::class_<Scene, Scene_Py, Component, Component::Ptr<Scene>>(m, "Scene")
         .def(pybind11::init<>())
         //
@@ -690,12 +935,47 @@ static void bind_scene(pybind11::module& m) {
         .def("add_transformed_primitive", [](Scene& scene, Mat4 transform, pybind11::kwargs kwargs) {
             scene.add_transformed_primitive(transform, pybind11::cast<Json>(kwargs));
         })
+        // Batched versions taking numpy arrays, converted once per call
+        .def("create_group_nodes", [](Scene& scene, const pybind11::array_t<Float, pybind11::array::c_style | pybind11::array::forcecast>& transforms) {
+            const auto ts = transforms_from_array(transforms);
+            const int first = scene.create_group_nodes(int(ts.size()), ts.data());
+            pybind11::array_t<int> indices(int(ts.size()));
+            auto indices_ = indices.mutable_unchecked<1>();
+            for (int i = 0; i < int(ts.size()); i++) {
+                indices_(i) = first + i;
+            }
+            return indices;
+        }, "transforms"_a)
+        .def("add_children", [](Scene& scene, int parent, const pybind11::array_t<int, pybind11::array::c_style | pybind11::array::forcecast>& children) {
+            if (children.ndim() != 1) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument, "children must be an array of shape (n,)");
+            }
+            scene.add_children(parent, int(children.shape(0)), children.data());
+        }, "parent"_a, "children"_a)
+        .def("add_transformed_primitives", [](Scene& scene,
+                const pybind11::array_t<Float, pybind11::array::c_style | pybind11::array::forcecast>& transforms,
+                const std::vector<Json>& props,
+                const std::optional<pybind11::array_t<int, pybind11::array::c_style | pybind11::array::forcecast>>& prop_indices) {
+            const auto ts = transforms_from_array(transforms);
+            const int n = int(ts.size());
+            if (!prop_indices) {
+                // All primitives share the first property
+                const std::vector<int> zeros(n, 0);
+                scene.add_transformed_primitives(props, n, ts.data(), zeros.data());
+                return;
+            }
+            if (prop_indices->ndim() != 1 || prop_indices->shape(0) != n) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument, "prop_indices must be an array of shape ({},)", n);
+            }
+            scene.add_transformed_primitives(props, n, ts.data(), prop_indices->data());
+        }, "transforms"_a, "props"_a, "prop_indices"_a = pybind11::none())
         .def("traverse_primitive_nodes", &Scene::traverse_primitive_nodes)
         .def("visit_node", &Scene::visit_node)
         .def("node_at", &Scene::node_at, pybind11::return_value_policy::reference)
         .def("num_nodes", &Scene::num_nodes)
         .def("num_lights", &Scene::num_lights)
         .def("camera_node", &Scene::camera_node)
+        .def("set_camera_node", &Scene::set_camera_node)
         .def("medium_node", &Scene::medium_node)
         .def("env_light_node", &Scene::env_light_node)
         .def("camera", &Scene::camera, pybind11::return_value_policy::reference)
@@ -703,20 +983,31 @@ static void bind_scene(pybind11::module& m) {
         .def("require_primitive", &Scene::require_primitive)
         .def("require_camera", &Scene::require_camera)
         .def("require_light", &Scene::require_light)
-        .def("require_accel", &Scene::require_accel)
-        .def("require_renderable", &Scene::require_renderable)
+        .def("require_accel", &Scene::require_accel, pybind11::call_guard<pybind11::gil_scoped_release>())
+        .def("require_renderable", &Scene::require_renderable, pybind11::call_guard<pybind11::gil_scoped_release>())
         //
         .def("accel", &Scene::accel, pybind11::return_value_policy::reference)
         .def("set_accel", &Scene::set_accel)
-        .def("build", &Scene::build)
+        // Release the GIL so that the scene of the next frame is built
+        // while the other threads render (see lightmetrica.sequence)
+        .def("build", &Scene::build, pybind11::call_guard<pybind11::gil_scoped_release>())
+        .def("update", &Scene::update, pybind11::call_guard<pybind11::gil_scoped_release>())
+        // The background build may log from its thread, so the waits release the GIL
+        .def("build_async", &Scene::build_async)
+        .def("wait_build", &Scene::wait_build, pybind11::call_guard<pybind11::gil_scoped_release>())
+        .def("set_transform", &Scene::set_transform)
+        .def("notify_changes", &Scene::notify_changes)
+        .def("commit_changes", &Scene::commit_changes, pybind11::call_guard<pybind11::gil_scoped_release>())
         .def("intersect", &Scene::intersect, "ray"_a = Ray{}, "tmin"_a = Eps, "tmax"_a = Inf)
         .def("visible", &Scene::visible)
         //
         .def("is_light", &Scene::is_light)
         .def("is_camera", &Scene::is_camera)
         //
-        .def("sample_light_selection", &Scene::sample_light_selection)
-        .def("pdf_light_selection", &Scene::pdf_light_selection)
+        .def("sample_light_selection", pybind11::overload_cast<Float>(&Scene::sample_light_selection, pybind11::const_))
+        .def("sample_light_selection", pybind11::overload_cast<const PointGeometry&, Float>(&Scene::sample_light_selection, pybind11::const_))
+        .def("pdf_light_selection", pybind11::overload_cast<int>(&Scene::pdf_light_selection, pybind11::const_))
+        .def("pdf_light_selection", pybind11::overload_cast<const PointGeometry&, int>(&Scene::pdf_light_selection, pybind11::const_))
         .def("light_primitive_index_at", &Scene::light_primitive_index_at)
         .def("light_index_at", &Scene::light_index_at)
         .PYLM_DEF_COMP_BIND(Scene);
@@ -729,26 +1020,57 @@ static void bind_accel(pybind11::module& m) {
     pybind11::class_<Accel::Hit>(m, "Accel_Hit")
         .def_readwrite("t", &Accel::Hit::t)
         .def_readwrite("uv", &Accel::Hit::uv)
-        .def_readwrite("global_transform", &Accel::Hit::global_transform)
+        .def_readwrite("instance", &Accel::Hit::instance)
         .def_readwrite("primitive", &Accel::Hit::primitive)
         .def_readwrite("face", &Accel::Hit::face);
 
     class Accel_Py final : public Accel {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Accel, construct, prop);
+            PYLM_OVERLOAD(void, Accel, construct, prop);
         }
         virtual void build(const Scene& scene) override {
-            PYBIND11_OVERLOAD_PURE(void, Accel, build, scene);
+            PYLM_OVERLOAD_PURE(void, Accel, build, scene);
+        }
+        virtual void update(const Scene& scene) override {
+            PYLM_OVERLOAD(void, Accel, update, scene);
         }
         virtual std::optional<Hit> intersect(Ray ray, Float tmin, Float tmax) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<Hit>, Accel, intersect, ray, tmin, tmax);
+            PYLM_OVERLOAD_PURE(std::optional<Hit>, Accel, intersect, ray, tmin, tmax);
+        }
+        virtual Transform instance_transform(int instance) const override {
+            // Python implementations return the transformation matrix
+            gil_monitor::ScopedAcquire gil_acquire_;
+            const auto f = pybind11::get_overload(static_cast<const Accel*>(this), "instance_transform");
+            if (!f) {
+                pybind11::pybind11_fail("Tried to call pure virtual function \"Accel::instance_transform\"");
+            }
+            return Transform(f(instance).cast<Mat4>());
         }
     };
     pybind11::class_<Accel, Accel_Py, Component, Component::Ptr<Accel>>(m, "Accel")
         .def(pybind11::init<>())
         .def("build", &Accel::build)
+        .def("update", &Accel::update)
         .def("intersect", &Accel::intersect)
+        .def("instance_transform", [](const Accel& self, int instance) -> Mat4 {
+            return self.instance_transform(instance).M;
+        })
+        .def("count_traversal", [](const Accel& self, Ray ray, Float tmin, Float tmax) -> std::optional<Accel::TraversalCounts> {
+            Accel::TraversalCounts counts;
+            if (!self.count_traversal(ray, tmin, tmax, counts)) {
+                return {};
+            }
+            return counts;
+        })
         .PYLM_DEF_COMP_BIND(Accel);
+
+    pybind11::class_<Accel::TraversalCounts>(m, "Accel_TraversalCounts")
+        .def(pybind11::init<>())
+        .def_readwrite("nodes", &Accel::TraversalCounts::nodes)
+        .def_readwrite("triangles", &Accel::TraversalCounts::triangles);
+
+    auto sm = m.def_submodule("accel");
+    sm.def("analyze", &accel::analyze, "scene"_a, "prop"_a = Json{});
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -758,15 +1080,26 @@ static void bind_renderer(pybind11::module& m) {
     class Renderer_Py final : public Renderer {
         PYLM_SERIALIZE_IMPL(Renderer);
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Renderer, construct, prop);
+            PYLM_OVERLOAD(void, Renderer, construct, prop);
         }
         virtual Json render() const override {
-            PYBIND11_OVERLOAD_PURE(Json, Renderer, render);
+            PYLM_OVERLOAD_PURE(Json, Renderer, render);
         }
     };
     pybind11::class_<Renderer, Renderer_Py, Component, Component::Ptr<Renderer>>(m, "Renderer")
         .def(pybind11::init<>())
-        .def("render", &Renderer::render, pybind11::call_guard<pybind11::gil_scoped_release>())
+        .def("render", [](const Renderer& self) -> Json {
+            // Release the GIL during rendering and report the contention of the callbacks
+            gil_monitor::reset();
+            Json result;
+            timer::ScopedTimer st;
+            {
+                pybind11::gil_scoped_release release;
+                result = self.render();
+            }
+            gil_monitor::report(st.now());
+            return result;
+        })
         .PYLM_DEF_COMP_BIND(Renderer);
 }
 
@@ -779,23 +1112,64 @@ static void bind_texture(pybind11::module& m) {
         .def_readwrite("h", &TextureSize::h);
     class Texture_Py final : public Texture {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Texture, construct, prop);
+            PYLM_OVERLOAD(void, Texture, construct, prop);
         }
         virtual TextureSize size() const override {
-            PYBIND11_OVERLOAD_PURE(TextureSize, Texture, size);
+            PYLM_OVERLOAD_PURE(TextureSize, Texture, size);
         }
         virtual Vec3 eval(Vec2 t) const override {
-            PYBIND11_OVERLOAD_PURE(Vec3, Texture, eval, t);
+            PYLM_OVERLOAD_PURE(Vec3, Texture, eval, t);
         }
         virtual Vec3 eval_by_pixel_coords(int x, int y) const override {
-            PYBIND11_OVERLOAD_PURE(Vec3, Texture, eval_by_pixel_coords, x, y);
+            PYLM_OVERLOAD_PURE(Vec3, Texture, eval_by_pixel_coords, x, y);
+        }
+        virtual void eval_batch(int n, const Vec2* t, Vec3* out) const override {
+            // Call eval_batch(t) of the Python class once with the numpy array of shape (n,2),
+            // which returns the array of shape (n,3). Falls back to eval under a single acquisition.
+            gil_monitor::ScopedAcquire gil_acquire_;
+            const auto f = pybind11::get_overload(static_cast<const Texture*>(this), "eval_batch");
+            if (!f) {
+                for (int i = 0; i < n; i++) {
+                    out[i] = eval(t[i]);
+                }
+                return;
+            }
+            pybind11::array_t<Float> ts({ n, 2 });
+            auto ts_ = ts.mutable_unchecked<2>();
+            for (int i = 0; i < n; i++) {
+                ts_(i, 0) = t[i].x;
+                ts_(i, 1) = t[i].y;
+            }
+            const auto r = pybind11::array_t<Float, pybind11::array::c_style | pybind11::array::forcecast>(f(ts));
+            if (r.ndim() != 2 || r.shape(0) != n || r.shape(1) != 3) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument, "eval_batch must return an array of shape ({},3)", n);
+            }
+            const auto r_ = r.unchecked<2>();
+            for (int i = 0; i < n; i++) {
+                out[i] = Vec3(r_(i, 0), r_(i, 1), r_(i, 2));
+            }
         }
     };
     pybind11::class_<Texture, Texture_Py, Component, Component::Ptr<Texture>>(m, "Texture")
         .def(pybind11::init<>())
         .def("size", &Texture::size)
         .def("eval", &Texture::eval)
+        .def("eval_filtered", &Texture::eval_filtered)
         .def("eval_by_pixel_coords", &Texture::eval_by_pixel_coords)
+        .def("buffer", [](pybind11::object self) -> pybind11::object {
+            // Read-only view of the buffer owned by the texture
+            const auto buf = self.cast<Texture&>().buffer();
+            if (!buf.data) {
+                return pybind11::none();
+            }
+            pybind11::array_t<float> a(
+                { buf.h, buf.w, buf.c },
+                { buf.c * buf.w * sizeof(float), buf.c * sizeof(float), sizeof(float) },
+                buf.data,
+                self);
+            a.attr("setflags")(pybind11::arg("write") = false);
+            return std::move(a);
+        })
         .PYLM_DEF_COMP_BIND(Texture);
 }
 
@@ -821,19 +1195,19 @@ static void bind_mesh(pybind11::module& m) {
 
     class Mesh_Py final : public Mesh {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Mesh, construct, prop);
+            PYLM_OVERLOAD(void, Mesh, construct, prop);
         }
         virtual void foreach_triangle(const ProcessTriangleFunc& process_triangle) const override {
-            PYBIND11_OVERLOAD_PURE(void, Mesh, foreach_triangle, process_triangle);
+            PYLM_OVERLOAD_PURE(void, Mesh, foreach_triangle, process_triangle);
         }
         virtual Tri triangle_at(int face) const override {
-            PYBIND11_OVERLOAD_PURE(Tri, Mesh, triangle_at, face);
+            PYLM_OVERLOAD_PURE(Tri, Mesh, triangle_at, face);
         }
         virtual InterpolatedPoint surface_point(int face, Vec2 uv) const override {
-            PYBIND11_OVERLOAD_PURE(InterpolatedPoint, Mesh, surface_point, face, uv);
+            PYLM_OVERLOAD_PURE(InterpolatedPoint, Mesh, surface_point, face, uv);
         }
         virtual int num_triangles() const override {
-            PYBIND11_OVERLOAD_PURE(int, Mesh, num_triangles);
+            PYLM_OVERLOAD_PURE(int, Mesh, num_triangles);
         }
     };
     pybind11::class_<Mesh, Mesh_Py, Component, Component::Ptr<Mesh>>(m, "Mesh")
@@ -856,28 +1230,28 @@ static void bind_material(pybind11::module& m) {
 
     class Material_Py final : public Material {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Material, construct, prop);
+            PYLM_OVERLOAD(void, Material, construct, prop);
         }
         virtual ComponentSample sample_component(const ComponentSampleU& u, const PointGeometry& geom, Vec3 wi) const override {
-            PYBIND11_OVERLOAD_PURE(ComponentSample, Material, sample_component, u, geom, wi);
+            PYLM_OVERLOAD_PURE(ComponentSample, Material, sample_component, u, geom, wi);
         }
         virtual Float pdf_component(int comp, const PointGeometry& geom, Vec3 wi) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Material, pdf_component, comp, geom, wi);
+            PYLM_OVERLOAD_PURE(Float, Material, pdf_component, comp, geom, wi);
         }
         virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& u, const PointGeometry& geom, Vec3 wi, int comp, TransDir trans_dir) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<DirectionSample>, Material, sample_direction, u, geom, wi, comp, trans_dir);
+            PYLM_OVERLOAD_PURE(std::optional<DirectionSample>, Material, sample_direction, u, geom, wi, comp, trans_dir);
         }
         virtual Float pdf_direction(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, bool eval_delta) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Material, pdf_direction, geom, wi, wo, comp, eval_delta);
+            PYLM_OVERLOAD_PURE(Float, Material, pdf_direction, geom, wi, wo, comp, eval_delta);
         }
         virtual Vec3 eval(const PointGeometry& geom, Vec3 wi, Vec3 wo, int comp, TransDir trans_dir, bool eval_delta) const override {
-            PYBIND11_OVERLOAD_PURE(Vec3, Material, eval, geom, wi, wo, comp, trans_dir, eval_delta);
+            PYLM_OVERLOAD_PURE(Vec3, Material, eval, geom, wi, wo, comp, trans_dir, eval_delta);
         }
         virtual bool is_specular_component(int comp) const override {
-            PYBIND11_OVERLOAD_PURE(bool, Material, is_specular_component, comp);
+            PYLM_OVERLOAD_PURE(bool, Material, is_specular_component, comp);
         }
         virtual Vec3 reflectance(const PointGeometry& geom) const override {
-            PYBIND11_OVERLOAD_PURE(Vec3, Material, reflectance, geom);
+            PYLM_OVERLOAD_PURE(Vec3, Material, reflectance, geom);
         }
     };
     pybind11::class_<Material, Material_Py, Component, Component::Ptr<Material>>(m, "Material")
@@ -901,16 +1275,16 @@ static void bind_phase(pybind11::module& m) {
 
     class Phase_Py final : public Phase {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Phase, construct, prop);
+            PYLM_OVERLOAD(void, Phase, construct, prop);
         }
         virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& u, const PointGeometry& geom, Vec3 wi) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<DirectionSample>, Phase, sample_direction, u, geom, wi);
+            PYLM_OVERLOAD_PURE(std::optional<DirectionSample>, Phase, sample_direction, u, geom, wi);
         }
         virtual Float pdf_direction(const PointGeometry& geom, Vec3 wi, Vec3 wo) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Phase, pdf_direction, geom, wi, wo);
+            PYLM_OVERLOAD_PURE(Float, Phase, pdf_direction, geom, wi, wo);
         }
         virtual Vec3 eval(const PointGeometry& geom, Vec3 wi, Vec3 wo) const override {
-            PYBIND11_OVERLOAD_PURE(Vec3, Phase, eval, geom, wi, wo);
+            PYLM_OVERLOAD_PURE(Vec3, Phase, eval, geom, wi, wo);
         }
     };
     pybind11::class_<Phase, Phase_Py, Component, Component::Ptr<Phase>>(m, "Phase")
@@ -933,19 +1307,19 @@ static void bind_medium(pybind11::module& m) {
 
     class Medium_Py final : public Medium {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Medium, construct, prop);
+            PYLM_OVERLOAD(void, Medium, construct, prop);
         }
         virtual std::optional<DistanceSample> sample_distance(Rng& rng, Ray ray, Float tmin, Float tmax) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<DistanceSample>, Medium, sample_distance, rng, ray, tmin, tmax);
+            PYLM_OVERLOAD_PURE(std::optional<DistanceSample>, Medium, sample_distance, rng, ray, tmin, tmax);
         }
         virtual Vec3 eval_transmittance(Rng& rng, Ray ray, Float tmin, Float tmax) const override {
-            PYBIND11_OVERLOAD_PURE(Vec3, Medium, eval_transmittance, rng, ray, tmin, tmax);
+            PYLM_OVERLOAD_PURE(Vec3, Medium, eval_transmittance, rng, ray, tmin, tmax);
         }
         virtual bool is_emitter() const override {
-            PYBIND11_OVERLOAD_PURE(bool, Medium, is_emitter);
+            PYLM_OVERLOAD_PURE(bool, Medium, is_emitter);
         }
         virtual const Phase* phase() const override {
-            PYBIND11_OVERLOAD_PURE(const Phase*, Medium, phase);
+            PYLM_OVERLOAD_PURE(const Phase*, Medium, phase);
         }
     };
     pybind11::class_<Medium, Medium_Py, Component, Component::Ptr<Medium>>(m, "Medium")
@@ -961,25 +1335,25 @@ static void bind_medium(pybind11::module& m) {
 static void bind_volume(pybind11::module& m) {
     class Volume_Py final : public Volume {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Volume, construct, prop);
+            PYLM_OVERLOAD(void, Volume, construct, prop);
         }
         virtual Bound bound() const override {
-            PYBIND11_OVERLOAD_PURE(Bound, Volume, bound);
+            PYLM_OVERLOAD_PURE(Bound, Volume, bound);
         }
         virtual bool has_scalar() const override {
-            PYBIND11_OVERLOAD_PURE(bool, Volume, has_scalar);
+            PYLM_OVERLOAD_PURE(bool, Volume, has_scalar);
         }
         virtual Float max_scalar() const override {
-            PYBIND11_OVERLOAD_PURE(Float, Volume, has_scalar);
+            PYLM_OVERLOAD_PURE(Float, Volume, has_scalar);
         }
         virtual Float eval_scalar(Vec3 p) const override {
-            PYBIND11_OVERLOAD(Float, Volume, eval_scalar, p);
+            PYLM_OVERLOAD(Float, Volume, eval_scalar, p);
         }
         virtual bool has_color() const override {
-            PYBIND11_OVERLOAD_PURE(bool, Volume, has_color);
+            PYLM_OVERLOAD_PURE(bool, Volume, has_color);
         }
         virtual Vec3 eval_color(Vec3 p) const override {
-            PYBIND11_OVERLOAD(Vec3, Volume, eval_color, p);
+            PYLM_OVERLOAD(Vec3, Volume, eval_color, p);
         }
     };
     pybind11::class_<Volume, Volume_Py, Component, Component::Ptr<Volume>>(m, "Volume")
@@ -999,13 +1373,13 @@ static void bind_volume(pybind11::module& m) {
 static void bind_model(pybind11::module& m) {
     class Model_Py final : public Model {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Model, construct, prop);
+            PYLM_OVERLOAD(void, Model, construct, prop);
         }
         virtual void create_primitives(const CreatePrimitiveFunc& create_primitive) const override {
-            PYBIND11_OVERLOAD_PURE(void, Model, create_primitives, create_primitive)
+            PYLM_OVERLOAD_PURE(void, Model, create_primitives, create_primitive)
         }
         virtual void foreach_node(const VisitNodeFuncType& visit) const override {
-            PYBIND11_OVERLOAD_PURE(void, Model, foreach_node, visit);
+            PYLM_OVERLOAD_PURE(void, Model, foreach_node, visit);
         }
     };
     pybind11::class_<Model, Model_Py, Component, Component::Ptr<Model>>(m, "Model")
@@ -1037,59 +1411,59 @@ static void bind_camera(pybind11::module& m) {
 
     class Camera_Py final : public Camera {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Camera, construct, prop);
+            PYLM_OVERLOAD(void, Camera, construct, prop);
         }
         // ----------------------------------------------------------------------------------------
         virtual void set_aspect_ratio(Float aspect) override {
-            PYBIND11_OVERLOAD_PURE(void, Camera, set_aspect_ratio, aspect);
+            PYLM_OVERLOAD_PURE(void, Camera, set_aspect_ratio, aspect);
         }
         // ----------------------------------------------------------------------------------------
         virtual Mat4 view_matrix() const override {
-            PYBIND11_OVERLOAD_PURE(Mat4, Camera, view_matrix);
+            PYLM_OVERLOAD_PURE(Mat4, Camera, view_matrix);
         }
         virtual Mat4 projection_matrix() const override {
-            PYBIND11_OVERLOAD_PURE(Mat4, Camera, projection_matrix);
+            PYLM_OVERLOAD_PURE(Mat4, Camera, projection_matrix);
         }
         // ----------------------------------------------------------------------------------------
         virtual Ray primary_ray(Vec2 rp) const override {
-            PYBIND11_OVERLOAD_PURE(Ray, Camera, primary_ray, rp);
+            PYLM_OVERLOAD_PURE(Ray, Camera, primary_ray, rp);
         }
         virtual std::optional<RaySample> sample_ray(const RaySampleU& u) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<RaySample>, Camera, sample_ray, u);
+            PYLM_OVERLOAD_PURE(std::optional<RaySample>, Camera, sample_ray, u);
         }
         virtual Float pdf_ray(const PointGeometry& geom, Vec3 wo) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Camera, pdf_ray, geom, wo);
+            PYLM_OVERLOAD_PURE(Float, Camera, pdf_ray, geom, wo);
         }
         // ----------------------------------------------------------------------------------------
         virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& u, const PointGeometry& geom) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<DirectionSample>, Camera, sample_direction, u, geom);
+            PYLM_OVERLOAD_PURE(std::optional<DirectionSample>, Camera, sample_direction, u, geom);
         }
         virtual Float pdf_direction(const PointGeometry& geom, Vec3 wo) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Camera, pdf_direction, geom, wo);
+            PYLM_OVERLOAD_PURE(Float, Camera, pdf_direction, geom, wo);
         }
         // ----------------------------------------------------------------------------------------
         virtual std::optional<PositionSample> sample_position(const PositionSampleU& u) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<PositionSample>, Camera, sample_position, u);
+            PYLM_OVERLOAD_PURE(std::optional<PositionSample>, Camera, sample_position, u);
         }
         virtual Float pdf_position(const PointGeometry& geom) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Camera, pdf_position, geom);
+            PYLM_OVERLOAD_PURE(Float, Camera, pdf_position, geom);
         }
         // ----------------------------------------------------------------------------------------
         virtual std::optional<RaySample> sample_direct(const RaySampleU& u, const PointGeometry& geom) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<RaySample>, Camera, sample_direct, u, geom);
+            PYLM_OVERLOAD_PURE(std::optional<RaySample>, Camera, sample_direct, u, geom);
         }
         virtual Float pdf_direct(const PointGeometry& geom, const PointGeometry& geomE, Vec3 wo) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Camera, pdf_direct, geom, geomE, wo);
+            PYLM_OVERLOAD_PURE(Float, Camera, pdf_direct, geom, geomE, wo);
         }
         // ----------------------------------------------------------------------------------------
         virtual std::optional<Vec2> raster_position(Vec3 wo) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<Vec2>, Camera, raster_position, wo);
+            PYLM_OVERLOAD_PURE(std::optional<Vec2>, Camera, raster_position, wo);
         }
         virtual bool is_connectable(const PointGeometry& geom) const override {
-            PYBIND11_OVERLOAD_PURE(bool, Camera, is_connectable, geom);
+            PYLM_OVERLOAD_PURE(bool, Camera, is_connectable, geom);
         }
         virtual Vec3 eval(Vec3 wo) const override {
-            PYBIND11_OVERLOAD_PURE(Vec3, Camera, eval, wo);
+            PYLM_OVERLOAD_PURE(Vec3, Camera, eval, wo);
         }
     };
     pybind11::class_<Camera, Camera_Py, Component, Component::Ptr<Camera>>(m, "Camera")
@@ -1124,52 +1498,53 @@ static void bind_light(pybind11::module& m) {
         .def(pybind11::init<>())
         .def_readwrite("geom", &Light::RaySample::geom)
         .def_readwrite("wo", &Light::RaySample::wo)
-        .def_readwrite("weight", &Light::RaySample::weight);
+        .def_readwrite("weight", &Light::RaySample::weight)
+        .def_readwrite("pdf", &Light::RaySample::pdf);
 
     class Light_Py final : public Light {
         virtual void construct(const Json& prop) override {
-            PYBIND11_OVERLOAD(void, Light, construct, prop);
+            PYLM_OVERLOAD(void, Light, construct, prop);
         }
         // ----------------------------------------------------------------------------------------
         virtual std::optional<RaySample> sample_ray(const RaySampleU& u, const Transform& transform) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<RaySample>, Light, sample_ray, u, transform);
+            PYLM_OVERLOAD_PURE(std::optional<RaySample>, Light, sample_ray, u, transform);
         }
         virtual Float pdf_ray(const PointGeometry& geom, Vec3 wo, const Transform& transform, bool eval_delta) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Light, pdf_ray, geom, wo, transform, eval_delta);
+            PYLM_OVERLOAD_PURE(Float, Light, pdf_ray, geom, wo, transform, eval_delta);
         }
         // ----------------------------------------------------------------------------------------
         virtual std::optional<DirectionSample> sample_direction(const DirectionSampleU& u, const PointGeometry& geom) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<DirectionSample>, Light, sample_direction, u, geom);
+            PYLM_OVERLOAD_PURE(std::optional<DirectionSample>, Light, sample_direction, u, geom);
         }
         virtual Float pdf_direction(const PointGeometry& geom, Vec3 wo) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Light, pdf_direction, geom, wo);
+            PYLM_OVERLOAD_PURE(Float, Light, pdf_direction, geom, wo);
         }
         // ----------------------------------------------------------------------------------------
         virtual std::optional<PositionSample> sample_position(const PositionSampleU& u, const Transform& transform) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<PositionSample>, Light, sample_position, u, transform);
+            PYLM_OVERLOAD_PURE(std::optional<PositionSample>, Light, sample_position, u, transform);
         }
         virtual Float pdf_position(const PointGeometry& geom, const Transform& transform) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Light, pdf_position, geom, transform);
+            PYLM_OVERLOAD_PURE(Float, Light, pdf_position, geom, transform);
         }
         // ----------------------------------------------------------------------------------------
         virtual std::optional<RaySample> sample_direct(const RaySampleU& u, const PointGeometry& geom, const Transform& transform) const override {
-            PYBIND11_OVERLOAD_PURE(std::optional<RaySample>, Light, sample_direct, u, geom, transform);
+            PYLM_OVERLOAD_PURE(std::optional<RaySample>, Light, sample_direct, u, geom, transform);
         }
         virtual Float pdf_direct(const PointGeometry& geom, const PointGeometry& geomL, const Transform& transform, Vec3 wo, bool eval_delta) const override {
-            PYBIND11_OVERLOAD_PURE(Float, Light, pdf_direct, geom, geomL, transform, wo, eval_delta);
+            PYLM_OVERLOAD_PURE(Float, Light, pdf_direct, geom, geomL, transform, wo, eval_delta);
         }
         // ---------------------------------------------------------------------------------------
         virtual bool is_specular() const override {
-            PYBIND11_OVERLOAD_PURE(bool, Light, is_specular);
+            PYLM_OVERLOAD_PURE(bool, Light, is_specular);
         }
         virtual bool is_infinite() const override {
-            PYBIND11_OVERLOAD_PURE(bool, Light, is_infinite);
+            PYLM_OVERLOAD_PURE(bool, Light, is_infinite);
         }
         virtual bool is_connectable(const PointGeometry& geom) const override {
-            PYBIND11_OVERLOAD_PURE(bool, Light, is_connectable, geom);
+            PYLM_OVERLOAD_PURE(bool, Light, is_connectable, geom);
         }
         virtual Vec3 eval(const PointGeometry& geom, Vec3 wo, bool eval_delta) const override {
-            PYBIND11_OVERLOAD_PURE(Vec3, Light, eval, geom, wo, eval_delta);
+            PYLM_OVERLOAD_PURE(Vec3, Light, eval, geom, wo, eval_delta);
         }
     };
     pybind11::class_<Light, Light_Py, Component, Component::Ptr<Light>>(m, "Light")
@@ -1209,6 +1584,8 @@ PYBIND11_MODULE(pylm, m) {
     bind_objloader(m);
     bind_progress(m);
     bind_debug(m);
+    bind_profiler(m);
+    bind_trace(m);
     bind_film(m);
     bind_surface(m);
     bind_scenenode(m);
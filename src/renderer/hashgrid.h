@@ -0,0 +1,110 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include <lm/core.h>
+#include <lm/parallel.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+// Hash grid for the fixed-radius range query of points.
+// The grid is rebuilt in parallel without locks by counting sort of the points over the cells.
+// The storage is reused when the grid is rebuilt, e.g., for each iteration of the renderers.
+class HashGrid {
+private:
+    Float radius_ = 0_f;
+    Float cell_size_ = 1_f;
+    Vec3 origin_{};
+    std::vector<int> cell_begins_;  // Beginning of the sorted points of the cells. Size is num_cells+1
+    std::vector<int> indices_;      // Indices of the points sorted by the cells
+    std::vector<Vec3> ps_;          // Positions of the points sorted by the cells
+    std::vector<int> cells_;        // Cell of the points
+    std::vector<std::atomic<int>> counts_;
+
+private:
+    glm::tvec3<long long> cell_coord(Vec3 p) const {
+        return glm::tvec3<long long>(glm::floor((p - origin_) / cell_size_));
+    }
+
+    int cell_index(glm::tvec3<long long> c) const {
+        const auto h = (unsigned long long)(c.x * 73856093LL) ^
+                       (unsigned long long)(c.y * 19349663LL) ^
+                       (unsigned long long)(c.z * 83492791LL);
+        return int(h % (cell_begins_.size() - 1));
+    }
+
+public:
+    // Build the grid from n points given by position(i)
+    template <typename PositionFunc>
+    void build(int n, Float radius, PositionFunc&& position) {
+        radius_ = radius;
+        cell_size_ = radius * 2_f;
+        Bound b;
+        for (int i = 0; i < n; i++) {
+            b = merge(b, position(i));
+        }
+        origin_ = n == 0 ? Vec3(0_f) : b.min;
+
+        // Count the points in the cells
+        const int num_cells = std::max(1, n);
+        cell_begins_.assign(num_cells + 1, 0);
+        cells_.resize(n);
+        if (int(counts_.size()) < num_cells) {
+            counts_ = std::vector<std::atomic<int>>(num_cells);
+        }
+        for (int i = 0; i < num_cells; i++) {
+            counts_[i].store(0, std::memory_order_relaxed);
+        }
+        parallel::foreach(n, [&](long long i, int) {
+            cells_[i] = cell_index(cell_coord(position(int(i))));
+            counts_[cells_[i]].fetch_add(1, std::memory_order_relaxed);
+        });
+
+        // Prefix sum
+        for (int i = 0; i < num_cells; i++) {
+            cell_begins_[i+1] = cell_begins_[i] + counts_[i].load(std::memory_order_relaxed);
+            counts_[i].store(cell_begins_[i], std::memory_order_relaxed);
+        }
+
+        // Scatter the points to the cells
+        indices_.resize(n);
+        ps_.resize(n);
+        parallel::foreach(n, [&](long long i, int) {
+            const int j = counts_[cells_[i]].fetch_add(1, std::memory_order_relaxed);
+            indices_[j] = int(i);
+            ps_[j] = position(int(i));
+        });
+    }
+
+    // Enumerate the indices of the points within the radius from p
+    template <typename Func>
+    void query(Vec3 p, Func&& func) const {
+        if (ps_.empty()) {
+            return;
+        }
+        // Since the cell size is twice the radius, the query overlaps at most 2x2x2 cells.
+        // Cells sharing the same bucket are visited only once.
+        const auto c0 = cell_coord(p - radius_);
+        const auto c1 = cell_coord(p + radius_);
+        int visited[8];
+        int num_visited = 0;
+        for (auto z = c0.z; z <= c1.z; z++) for (auto y = c0.y; y <= c1.y; y++) for (auto x = c0.x; x <= c1.x; x++) {
+            const int cell = cell_index({ x, y, z });
+            if (std::find(visited, visited + num_visited, cell) != visited + num_visited) {
+                continue;
+            }
+            visited[num_visited++] = cell;
+            for (int i = cell_begins_[cell]; i < cell_begins_[cell+1]; i++) {
+                const auto d = ps_[i] - p;
+                if (glm::dot(d, d) <= radius_ * radius_) {
+                    func(indices_[i]);
+                }
+            }
+        }
+    }
+};
+
+LM_NAMESPACE_END(LM_NAMESPACE)
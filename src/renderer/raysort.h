@@ -0,0 +1,134 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include <lm/core.h>
+#include <lm/parallel.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+// Reorders the rays for coherent traversal of the acceleration structure.
+// The rays are binned by the octants of the directions and then by the Morton codes
+// of the origins quantized in the bound of the origins, so that the rays
+// in a chunk of the sorted rays likely visit the same parts of the structure.
+// Keys and indices are sorted together by the parallel LSD radix sort.
+class RaySorter {
+private:
+    static constexpr int MortonBits = 9;                // Number of bits per axis of the Morton code
+    static constexpr int KeyBits = 3 * MortonBits + 3;  // Number of bits of the octant and the Morton code
+    static constexpr int RadixBits = 8;                 // Number of bits sorted in a pass
+    static constexpr int Radix = 1 << RadixBits;
+    static constexpr int BlockSize = 1 << 14;           // Number of elements processed by a task
+
+    std::vector<std::uint64_t> kv_;     // Pairs of the key (upper 32 bits) and the index (lower 32 bits)
+    std::vector<std::uint64_t> tmp_;
+    std::vector<int> counts_;           // Histograms of the digits for each block
+
+public:
+    // Sort the indices in [0,n) by the rays. index_to_ray maps an index to the ray.
+    template <typename IndexToRay>
+    void sort(std::vector<int>& indices, IndexToRay&& index_to_ray) {
+        const int n = int(indices.size());
+        if (n < 2) {
+            return;
+        }
+        const int num_blocks = (n + BlockSize - 1) / BlockSize;
+
+        // Bound of the origins
+        std::vector<Bound> bs(num_blocks);
+        parallel::foreach(num_blocks, [&](long long b, int) {
+            const int s = int(b) * BlockSize;
+            const int e = std::min(n, s + BlockSize);
+            for (int j = s; j < e; j++) {
+                bs[b] = merge(bs[b], index_to_ray(indices[j]).o);
+            }
+        });
+        Bound bound;
+        for (const auto& b : bs) {
+            bound = merge(bound, b);
+        }
+        const auto ext = glm::max(bound.max - bound.min, Vec3(Eps));
+
+        // Compute the keys
+        kv_.resize(n);
+        tmp_.resize(n);
+        parallel::foreach(num_blocks, [&](long long b, int) {
+            const int s = int(b) * BlockSize;
+            const int e = std::min(n, s + BlockSize);
+            for (int j = s; j < e; j++) {
+                const auto r = index_to_ray(indices[j]);
+                const auto octant = (r.d.x < 0_f ? 1u : 0u) | (r.d.y < 0_f ? 2u : 0u) | (r.d.z < 0_f ? 4u : 0u);
+                const auto q = (r.o - bound.min) / ext;
+                const auto key = (octant << (3 * MortonBits)) | morton(q);
+                kv_[j] = (std::uint64_t(key) << 32) | std::uint32_t(indices[j]);
+            }
+        });
+
+        // Radix sort by the keys
+        counts_.resize(size_t(num_blocks) * Radix);
+        for (int shift = 0; shift < KeyBits; shift += RadixBits) {
+            const auto digit = [shift](std::uint64_t v) {
+                return int((v >> (32 + shift)) & (Radix - 1));
+            };
+
+            // Histograms of the blocks
+            parallel::foreach(num_blocks, [&](long long b, int) {
+                int* c = &counts_[size_t(b) * Radix];
+                std::fill(c, c + Radix, 0);
+                const int s = int(b) * BlockSize;
+                const int e = std::min(n, s + BlockSize);
+                for (int j = s; j < e; j++) {
+                    c[digit(kv_[j])]++;
+                }
+            });
+
+            // Offsets of the digits of the blocks, ordered by digits and then by blocks
+            int sum = 0;
+            for (int d = 0; d < Radix; d++) {
+                for (int b = 0; b < num_blocks; b++) {
+                    auto& c = counts_[size_t(b) * Radix + d];
+                    const int t = c;
+                    c = sum;
+                    sum += t;
+                }
+            }
+
+            // Scatter the elements in the stable order
+            parallel::foreach(num_blocks, [&](long long b, int) {
+                int* c = &counts_[size_t(b) * Radix];
+                const int s = int(b) * BlockSize;
+                const int e = std::min(n, s + BlockSize);
+                for (int j = s; j < e; j++) {
+                    tmp_[c[digit(kv_[j])]++] = kv_[j];
+                }
+            });
+            kv_.swap(tmp_);
+        }
+
+        for (int j = 0; j < n; j++) {
+            indices[j] = int(kv_[j] & 0xffffffffu);
+        }
+    }
+
+private:
+    // Morton code of the normalized position in [0,1]^3
+    static std::uint32_t morton(Vec3 q) {
+        constexpr auto M = 1u << MortonBits;
+        std::uint32_t code = 0;
+        std::uint32_t c[3];
+        for (int i = 0; i < 3; i++) {
+            c[i] = std::uint32_t(glm::clamp(q[i] * Float(M), 0_f, Float(M - 1)));
+        }
+        for (int k = 0; k < MortonBits; k++) {
+            for (int i = 0; i < 3; i++) {
+                code |= ((c[i] >> k) & 1u) << (3 * k + i);
+            }
+        }
+        return code;
+    }
+};
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,75 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include <lm/core.h>
+#include <lm/parallel.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+// Ray statistics of a renderer.
+// The counters are separated for each thread and padded to the cache line,
+// so that the renderers can update them without atomics or false sharing.
+class RayStats {
+public:
+    struct alignas(64) Counters {
+        long long primary = 0;      // Number of primary rays
+        long long secondary = 0;    // Number of secondary rays
+        long long shadow = 0;       // Number of shadow rays
+        long long paths = 0;        // Number of paths
+        long long verts = 0;        // Number of vertices of the paths
+
+        // Start a path from the initial vertex
+        void path() {
+            paths++;
+            verts++;
+        }
+
+        // Extend a path by a ray
+        void extension(bool is_primary, bool hit) {
+            (is_primary ? primary : secondary)++;
+            if (hit) {
+                verts++;
+            }
+        }
+    };
+
+private:
+    std::vector<Counters> counters_;
+
+public:
+    RayStats() : counters_(parallel::num_threads()) {}
+
+    // Counters for the thread
+    Counters& at(int threadid) {
+        return counters_[threadid];
+    }
+
+    // Aggregated statistics given the elapsed time in seconds
+    Json to_json(Float elapsed) const {
+        Counters t;
+        for (const auto& c : counters_) {
+            t.primary += c.primary;
+            t.secondary += c.secondary;
+            t.shadow += c.shadow;
+            t.paths += c.paths;
+            t.verts += c.verts;
+        }
+        const auto total = t.primary + t.secondary + t.shadow;
+        const auto mrays_per_sec = elapsed > 0_f ? Float(total) / elapsed * 1e-6_f : 0_f;
+        return {
+            {"primary", t.primary},
+            {"secondary", t.secondary},
+            {"shadow", t.shadow},
+            {"total", total},
+            {"avg_path_length", t.paths > 0 ? Float(t.verts) / Float(t.paths) : 0_f},
+            {"mrays_per_sec", mrays_per_sec},
+            {"mrays_per_sec_per_thread", mrays_per_sec / Float(counters_.size())}
+        };
+    }
+};
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,192 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/renderer.h>
+#include <lm/scene.h>
+#include <lm/mesh.h>
+#include <lm/film.h>
+#include <lm/scheduler.h>
+#include <lm/sampler.h>
+#include <lm/path.h>
+#include <lm/timer.h>
+#include "raystats.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: renderer::ao
+
+    Ambient occlusion renderer.
+
+    :param str scene: Locator of the scene.
+    :param str output: Locator of the film.
+    :param str scheduler: Type of the scheduler with the samples per pixel, e.g., ``sample`` or ``tile``.
+                          Default value: ``sample``.
+    :param int spp: Number of primary rays per pixel.
+    :param int ao_samples: Number of occlusion rays per primary ray. Default value: ``16``.
+    :param float distance: Maximum distance of the occlusion.
+                           Default value: 10% of the diagonal of the bound of the scene.
+    :param color bg_color: Value of the pixels where the primary ray hits nothing. Default value: ``[0,0,0]``.
+    :param str sampler: Name of the sampler (see :cpp:class:`lm::Sampler`). Default value: ``random``.
+
+    This renderer computes the fraction of the cosine-weighted directions above the surface
+    visible up to ``distance`` for each pixel, which gives a fast clay render of the scene.
+    The occlusion rays of a primary ray are traced in packets
+    by :cpp:func:`lm::Scene::occluded_n`, so the acceleration structures supporting the batched
+    queries process the rays sharing the origin together.
+    With the ``tile`` scheduler, the primary rays of neighboring pixels are traced
+    by the same thread, which improves the coherency of the memory accesses.
+    The renderer is also useful as a benchmark of the occlusion queries of the acceleration structures.
+    The result of :cpp:func:`lm::Renderer::render` contains ``processed``, ``elapsed``, and ``ray_stats``.
+\endrst
+*/
+class Renderer_AO final : public Renderer {
+private:
+    // Maximum number of the occlusion rays traced at once
+    static constexpr int PacketSize = 16;
+
+    Scene* scene_;
+    Film* film_;
+    int ao_samples_;                                    // Number of occlusion rays per primary ray
+    std::optional<Float> distance_;                     // Maximum distance of the occlusion
+    Vec3 bg_color_;                                     // Value of the background
+    Component::Ptr<scheduler::Scheduler> sched_;        // Scheduler for parallel processing
+    Component::Ptr<Sampler> sampler_;                   // Sampler of the sample numbers
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(scene_, film_, ao_samples_, distance_, bg_color_, sched_, sampler_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, scene_);
+        comp::visit(visit, film_);
+        comp::visit(visit, sched_);
+        comp::visit(visit, sampler_);
+    }
+
+    virtual Component* underlying(const std::string& name) const override {
+        if (name == "scheduler") {
+            return sched_.get();
+        }
+        if (name == "sampler") {
+            return sampler_.get();
+        }
+        return nullptr;
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        scene_ = json::comp_ref<Scene>(prop, "scene");
+        film_ = json::comp_ref<Film>(prop, "output");
+        ao_samples_ = json::value<int>(prop, "ao_samples", 16);
+        distance_ = json::value_or_none<Float>(prop, "distance");
+        bg_color_ = json::value(prop, "bg_color", Vec3(0_f));
+        if (ao_samples_ <= 0 || (distance_ && *distance_ <= 0_f)) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid parameters [ao_samples='{}', distance='{}']", ao_samples_, distance_ ? *distance_ : 0_f);
+        }
+        {
+            const auto name = json::value<std::string>(prop, "scheduler", "sample");
+            sched_ = comp::create<scheduler::Scheduler>(
+                "scheduler::spp::" + name, make_loc("scheduler"), prop);
+        }
+        {
+            const auto name = json::value<std::string>(prop, "sampler", "random");
+            sampler_ = comp::create<Sampler>("sampler::" + name, make_loc("sampler"), prop);
+        }
+    }
+
+    virtual Json render() const override {
+        scene_->require_renderable();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
+        const auto size = film_->size();
+        const auto distance = distance_ ? *distance_ : [&]() {
+            const auto b = scene_bound();
+            const auto d = b.min.x <= b.max.x ? glm::length(b.max - b.min) * .1_f : 1_f;
+            return d > 0_f ? d : 1_f;
+        }();
+        timer::ScopedTimer st;
+
+        RayStats ray_stats;
+        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
+            SampleStream smp(sampler_.get(), pixel_index, sample_index);
+            auto& stats = ray_stats.at(threadid);
+            const int x = int(pixel_index % size.w);
+            const int y = int(pixel_index / size.w);
+
+            // Primary ray
+            const auto up = smp.next<Vec2>();
+            const auto ray = path::primary_ray(scene_, {(x+up.x)/size.w, (y+up.y)/size.h});
+            const auto sp = scene_->intersect(ray);
+            stats.path();
+            stats.extension(true, bool(sp));
+            if (!sp || sp->geom.infinite) {
+                film_->splat_pixel(x, y, bg_color_);
+                return;
+            }
+
+            // Occlusion rays in packets
+            const auto [n, u, v] = sp->geom.orthonormal_basis_twosided(-ray.d);
+            Ray rays[PacketSize];
+            Float tmaxs[PacketSize];
+            bool occluded[PacketSize];
+            int visible = 0;
+            for (int i = 0; i < ao_samples_; i += PacketSize) {
+                const int m = std::min(PacketSize, ao_samples_ - i);
+                for (int j = 0; j < m; j++) {
+                    const auto d = math::sample_cosine_weighted(smp.next<Vec2>());
+                    rays[j] = { sp->geom.p, u*d.x + v*d.y + n*d.z };
+                    tmaxs[j] = distance;
+                }
+                scene_->occluded_n(m, rays, Eps, tmaxs, occluded);
+                for (int j = 0; j < m; j++) {
+                    visible += occluded[j] ? 0 : 1;
+                }
+            }
+            stats.shadow += ao_samples_;
+            film_->splat_pixel(x, y, Vec3(Float(visible) / ao_samples_));
+        }, [&](long long processed) {
+            // Publish snapshot of the film for progressive rendering
+            film_->publish(1_f / processed);
+        });
+
+        // Rescale film
+        film_->rescale(1_f / processed);
+
+        const auto elapsed = st.now();
+        return profiler::attach_stats({
+            {"processed", processed},
+            {"elapsed", elapsed},
+            {"ray_stats", ray_stats.to_json(elapsed)}
+        });
+    }
+
+private:
+    // Bound of the primitives in the scene
+    Bound scene_bound() const {
+        Bound bound;
+        scene_->traverse_primitive_nodes([&](const SceneNode& node, Mat4 global_transform) {
+            if (node.type != SceneNodeType::Primitive || !node.primitive.mesh) {
+                return;
+            }
+            node.primitive.mesh->foreach_triangle([&](int, const Mesh::Tri& tri) {
+                for (const auto* p : { &tri.p1, &tri.p2, &tri.p3 }) {
+                    bound = merge(bound, Vec3(global_transform * Vec4(p->p, 1_f)));
+                }
+            });
+        });
+        return bound;
+    }
+};
+
+LM_COMP_REG_IMPL(Renderer_AO, "renderer::ao");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -12,6 +12,8 @@
 #include <lm/bidir.h>
 #include <lm/debug.h>
 #include <lm/timer.h>
+#include "splatbuffer.h"
+#include "strategyselect.h"
 
 // Poll mutated paths
 #define BDPT_POLL_PATHS 0
@@ -43,6 +45,18 @@ public:
     int max_verts_;                                 // Maximum number of path vertices
     std::optional<unsigned int> seed_;              // Random seed
     Component::Ptr<scheduler::Scheduler> sched_;    // Scheduler for parallel processing
+    int splat_batch_;                               // Number of the splats to arbitrary pixels buffered per thread
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(scene_, film_, min_verts_, max_verts_, seed_, sched_, splat_batch_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, scene_);
+        comp::visit(visit, film_);
+        comp::visit(visit, sched_);
+    }
 
 public:
     virtual void construct(const Json& prop) override {
@@ -51,6 +65,7 @@ public:
         min_verts_ = json::value<int>(prop, "min_verts", 2);
         max_verts_ = json::value<int>(prop, "max_verts");
         seed_ = json::value_or_none<unsigned int>(prop, "seed");
+        splat_batch_ = json::value<int>(prop, "splat_batch", 256);
         const auto sched_name = json::value<std::string>(prop, "scheduler");
         sched_ = comp::create<scheduler::Scheduler>(
             "scheduler::spi::" + sched_name, make_loc("scheduler"), prop);
@@ -64,21 +79,29 @@ class Renderer_PT_Naive_Path final : public Renderer_Path_Base {
 public:
     virtual Json render() const override {
         scene_->require_renderable();
-        film_->clear();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
         timer::ScopedTimer st;
 
-        // Execute parallel process
-        const auto processed = sched_->run([&](long long, long long sample_index, int threadid) {
-            LM_KEEP_UNUSED(sample_index);
+        // Base random number generator. Each sample uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
 
-            // Per-thread random number generator
-            thread_local Rng rng(seed_ ? *seed_ + threadid : math::rng_seed());
+        // Execute parallel process
+        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
+            // Random number generator for the sample
+            auto rng = rng_base.split(pixel_index, sample_index);
 
             // Sample eye subpath
-            const auto subpathE = path::sample_subpath(rng, scene_, max_verts_, TransDir::EL);
+            thread_local Path subpathE;
+            path::sample_subpath(rng, subpathE, scene_, max_verts_, TransDir::EL);
             const int nE = (int)(subpathE.vs.size());
 
+            // Storage of the full paths reused for the strategies
+            thread_local Path fullpath;
+
             // Create full paths of all possible lengths
             for (int t = 2; t <= nE; t++) {
                 const int nv = t;
@@ -87,8 +110,7 @@ public:
                 }
 
                 // Connect the subpaths. Note that light subpath is empty.
-                const auto path = path::connect_subpaths(scene_, {}, subpathE, 0, t);
-                if (!path) {
+                if (!path::connect_subpaths(scene_, {}, subpathE, 0, t, fullpath)) {
                     continue;
                 }
 
@@ -97,19 +119,19 @@ public:
                     debug::poll({
                         {"id", "path"},
                         {"sample_index", sample_index},
-                        {"path", *path}
+                        {"path", fullpath}
                     });
                 }
                 #endif
 
                 // Evaluate contribution
-                const auto C = path->eval_sampling_weight_bidir(scene_, 0);
+                const auto C = fullpath.eval_sampling_weight_bidir(scene_, 0);
                 if (math::is_zero(C)) {
                     continue;
                 }
 
                 // Accumulate contribution
-                const auto rp = path->raster_position(scene_);
+                const auto rp = fullpath.raster_position(scene_);
                 film_->splat(rp, C);
             }
         });
@@ -117,7 +139,7 @@ public:
         // Rescale film
         film_->rescale(Float(size.w * size.h) / processed);
 
-        return { {"processed", processed}, {"elapsed", st.now()} };
+        return profiler::attach_stats({ {"processed", processed}, {"elapsed", st.now()} });
     }
 };
 
@@ -130,22 +152,33 @@ class Renderer_PT_NEE_Path final : public Renderer_Path_Base {
 public:
     virtual Json render() const override {
         scene_->require_renderable();
-        film_->clear();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
         timer::ScopedTimer st;
 
+        // Base random number generator. Each sample uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
+
         // Execute parallel process
-        const auto processed = sched_->run([&](long long, long long, int threadid) {
-            // Per-thread random number generator
-            thread_local Rng rng(seed_ ? *seed_ + threadid : math::rng_seed());
+        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int) {
+            // Random number generator for the sample
+            auto rng = rng_base.split(pixel_index, sample_index);
 
             // Sample subpaths
-            const auto subpathE = path::sample_subpath(rng, scene_, max_verts_, TransDir::EL);
-            const auto subpathL = path::sample_subpath(rng, scene_, 1, TransDir::LE);
+            thread_local Path subpathE;
+            path::sample_subpath(rng, subpathE, scene_, max_verts_, TransDir::EL);
+            thread_local Path subpathL;
+            path::sample_subpath(rng, subpathL, scene_, 1, TransDir::LE);
             const int nE = (int)(subpathE.vs.size());
             const int nL = (int)(subpathL.vs.size());
             assert(nL > 0);
 
+            // Storage of the full paths reused for the strategies
+            thread_local Path fullpath;
+
             // Create full paths
             for (int n = 2; n <= nL+nE; n++) {
                 if (n < min_verts_ || max_verts_ < n) {
@@ -173,19 +206,18 @@ public:
                 }
 
                 // Connect subpaths
-                const auto path = path::connect_subpaths(scene_, subpathL, subpathE, s, t);
-                if (!path) {
+                if (!path::connect_subpaths(scene_, subpathL, subpathE, s, t, fullpath)) {
                     continue;
                 }
 
                 // Evaluate contribution
-                const auto C = path->eval_sampling_weight_bidir(scene_, s);
+                const auto C = fullpath.eval_sampling_weight_bidir(scene_, s);
                 if (math::is_zero(C)) {
                     continue;
                 }
 
                 // Accumulate contribution
-                const auto rp = path->raster_position(scene_);
+                const auto rp = fullpath.raster_position(scene_);
                 film_->splat(rp, C);
             }
         });
@@ -193,7 +225,7 @@ public:
         // Rescale film
         film_->rescale(Float(size.w * size.h) / processed);
 
-        return { {"processed", processed}, {"elapsed", st.now()} };
+        return profiler::attach_stats({ {"processed", processed}, {"elapsed", st.now()} });
     }
 };
 
@@ -206,24 +238,34 @@ class Renderer_LT_NEE_Path final : public Renderer_Path_Base {
 public:
     virtual Json render() const override {
         scene_->require_renderable();
-        film_->clear();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
         timer::ScopedTimer st;
 
-        // Execute parallel process
-        const auto processed = sched_->run([&](long long, long long sample_index, int threadid) {
-            LM_KEEP_UNUSED(sample_index);
+        // Base random number generator. Each sample uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
 
-            // Per-thread random number generator
-            thread_local Rng rng(seed_ ? *seed_ + threadid : math::rng_seed());
+        // Execute parallel process
+        SplatBuffer splats(film_, splat_batch_);
+        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
+            // Random number generator for the sample
+            auto rng = rng_base.split(pixel_index, sample_index);
 
             // Sample subpaths
-            const auto subpathE = path::sample_subpath(rng, scene_, 1, TransDir::EL);
-            const auto subpathL = path::sample_subpath(rng, scene_, max_verts_, TransDir::LE);
+            thread_local Path subpathE;
+            path::sample_subpath(rng, subpathE, scene_, 1, TransDir::EL);
+            thread_local Path subpathL;
+            path::sample_subpath(rng, subpathL, scene_, max_verts_, TransDir::LE);
             const int nE = (int)(subpathE.vs.size());
             assert(nE > 0);
             const int nL = (int)(subpathL.vs.size());
 
+            // Storage of the full paths reused for the strategies
+            thread_local Path fullpath;
+
             // Create full paths
             for (int n = 2; n <= nL + nE; n++) {
                 if (n < min_verts_ || max_verts_ < n) {
@@ -238,8 +280,7 @@ public:
                 }
 
                 // Connect subpaths
-                const auto path = path::connect_subpaths(scene_, subpathL, subpathE, s, t);
-                if (!path) {
+                if (!path::connect_subpaths(scene_, subpathL, subpathE, s, t, fullpath)) {
                     continue;
                 }
 
@@ -248,24 +289,24 @@ public:
                     debug::poll({
                         {"id", "path"},
                         {"sample_index", sample_index},
-                        {"path", *path}
+                        {"path", fullpath}
                     });
                 }
                 #endif
 
                 #if 1
                 // Evaluate contribution
-                const auto C = path->eval_sampling_weight_bidir(scene_, s);
+                const auto C = fullpath.eval_sampling_weight_bidir(scene_, s);
                 if (math::is_zero(C)) {
                     continue;
                 }
                 #else
                 // Evaluate contribution and probability
-                const auto f = path->eval_measurement_contrb_bidir(scene_, s);
+                const auto f = fullpath.eval_measurement_contrb_bidir(scene_, s);
                 if (math::is_zero(f)) {
                     continue;
                 }
-                const auto p = path->pdf_bidir(scene_, s);
+                const auto p = fullpath.pdf_bidir(scene_, s);
                 if (p == 0_f) {
                     continue;
                 }
@@ -273,15 +314,16 @@ public:
                 #endif
 
                 // Accumulate contribution
-                const auto rp = path->raster_position(scene_);
-                film_->splat(rp, C);
+                const auto rp = fullpath.raster_position(scene_);
+                splats.splat(threadid, rp, C);
             }
         });
 
         // Rescale film
+        splats.flush_all();
         film_->rescale(Float(size.w * size.h) / processed);
 
-        return { {"processed", processed}, {"elapsed", st.now()} };
+        return profiler::attach_stats({ {"processed", processed}, {"elapsed", st.now()} });
     }
 };
 
@@ -293,9 +335,21 @@ LM_COMP_REG_IMPL(Renderer_LT_NEE_Path, "renderer::lt_nee_path");
 #define BDPT_PER_STRATEGY_FILM 0
 #define BDPT_SEPARATE_EVAL_UNWEIGHT_CONTRB 0
 
-// Bidirectional path tracing
+// Bidirectional path tracing.
+// With adaptive_strategies enabled, the strategies with negligible efficiency
+// are subsampled from the second pass (see StrategySelector),
+// so use samples_per_pass to split the samples into passes.
 class Renderer_BDPT final : public Renderer_Path_Base {
 public:
+    bool adaptive_strategies_;      // Subsample the strategies with low efficiency
+    Float strategy_threshold_;      // Relative efficiency below which the strategies are subsampled
+    Float min_strategy_prob_;       // Minimum selection probability of a strategy
+
+public:
+    LM_SERIALIZE_IMPL_WITH_PARENT(ar, Renderer_Path_Base) {
+        ar(adaptive_strategies_, strategy_threshold_, min_strategy_prob_);
+    }
+
     #if BDPT_PER_STRATEGY_FILM
     // Index: (k, s)
     // where k = 2,..,max_verts,
@@ -308,7 +362,7 @@ public:
     }
 
     virtual void construct(const Json& prop) override {
-        Renderer_Path_Base::construct(prop);
+        construct_strategies(prop);
         const auto size = film_->size();
         for (int k = 2; k <= max_verts_; k++) {
             strategy_films_.emplace_back();
@@ -324,28 +378,58 @@ public:
             }
         }
     }
+    #else
+    virtual void construct(const Json& prop) override {
+        construct_strategies(prop);
+    }
     #endif
 
+private:
+    void construct_strategies(const Json& prop) {
+        Renderer_Path_Base::construct(prop);
+        adaptive_strategies_ = json::value<bool>(prop, "adaptive_strategies", false);
+        strategy_threshold_ = json::value<Float>(prop, "strategy_threshold", .1_f);
+        min_strategy_prob_ = json::value<Float>(prop, "min_strategy_prob", .05_f);
+        if (strategy_threshold_ <= 0_f || min_strategy_prob_ <= 0_f || min_strategy_prob_ > 1_f) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid strategy selection [strategy_threshold='{}', min_strategy_prob='{}']",
+                strategy_threshold_, min_strategy_prob_);
+        }
+    }
+
 public:
     virtual Json render() const override {
         scene_->require_renderable();
-        film_->clear();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
         timer::ScopedTimer st;
 
-        // Execute parallel process
-        const auto processed = sched_->run([&](long long, long long sample_index, int threadid) {
-            LM_KEEP_UNUSED(sample_index);
+        // Base random number generator. Each sample uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
 
-            // Per-thread random number generator
-            thread_local Rng rng(seed_ ? *seed_ + threadid : math::rng_seed());
+        // Execute parallel process
+        // The splats of the light tracing strategies (t=1) are buffered
+        // because they hit arbitrary pixels.
+        SplatBuffer splats(film_, splat_batch_);
+        StrategySelector selector(adaptive_strategies_, max_verts_, strategy_threshold_, min_strategy_prob_);
+        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
+            // Random number generator for the sample
+            auto rng = rng_base.split(pixel_index, sample_index);
 
             // Sample subpaths
-            const auto subpathE = path::sample_subpath(rng, scene_, max_verts_, TransDir::EL);
-            const auto subpathL = path::sample_subpath(rng, scene_, max_verts_, TransDir::LE);
+            thread_local Path subpathE;
+            path::sample_subpath(rng, subpathE, scene_, max_verts_, TransDir::EL);
+            thread_local Path subpathL;
+            path::sample_subpath(rng, subpathL, scene_, max_verts_, TransDir::LE);
             const int nE = subpathE.num_verts();
             const int nL = subpathL.num_verts();
 
+            // Storage of the full paths reused for the strategies
+            thread_local Path fullpath;
+
             // Generate full paths
             for (int s = 0; s <= nL; s++) {
                 for (int t = 0; t <= nE; t++) {
@@ -354,19 +438,25 @@ public:
                         continue;
                     }
 
+                    // Select the strategy
+                    const auto inv_prob = selector.select(s, t, adaptive_strategies_ ? rng.u() : 0_f);
+                    if (inv_prob == 0_f) {
+                        continue;
+                    }
+
                     // Connect subpaths
-                    const auto path = path::connect_subpaths(scene_, subpathL, subpathE, s, t);
-                    if (!path) {
+                    if (!path::connect_subpaths(scene_, subpathL, subpathE, s, t, fullpath)) {
+                        selector.record(threadid, s, t, Vec3(0_f));
                         continue;
                     }
 
                     #if BDPT_SEPARATE_EVAL_UNWEIGHT_CONTRB
                     // Evaluate contribution and probability
-                    const auto f = path->eval_measurement_contrb_bidir(scene_, s);
+                    const auto f = fullpath.eval_measurement_contrb_bidir(scene_, s);
                     if (math::is_zero(f)) {
                         continue;
                     }
-                    const auto p = path->pdf_bidir(scene_, s);
+                    const auto p = fullpath.pdf_bidir(scene_, s);
                     if (p == 0_f) {
                         continue;
                     }
@@ -374,28 +464,39 @@ public:
                     const auto C_unweighted = f / p;
                     #else
                     // Unweighted contribution
-                    const auto C_unweighted = path->eval_sampling_weight_bidir(scene_, s);
+                    const auto C_unweighted = fullpath.eval_sampling_weight_bidir(scene_, s);
                     if (math::is_zero(C_unweighted)) {
+                        selector.record(threadid, s, t, Vec3(0_f));
                         continue;
                     }
                     #endif
 
                     // MIS weight
-                    const auto w = path->eval_mis_weight(scene_, s);
+                    const auto w = fullpath.eval_mis_weight(scene_, s);
+                    selector.record(threadid, s, t, w * C_unweighted);
                     
                     // Accumulate contribution
-                    const auto rp = path->raster_position(scene_);
-                    const auto C = w * C_unweighted;
-                    film_->splat(rp, C);
+                    const auto rp = fullpath.raster_position(scene_);
+                    const auto C = w * inv_prob * C_unweighted;
+                    if (t == 1) {
+                        splats.splat(threadid, rp, C);
+                    }
+                    else {
+                        film_->splat(rp, C);
+                    }
                     #if BDPT_PER_STRATEGY_FILM
                     auto& strategy_film = strategy_films_[k-2][s];
-                    strategy_film->splat(rp, C_unweighted);
+                    strategy_film->splat(rp, inv_prob * C_unweighted);
                     #endif
                 }
             }
+        }, [&](long long) {
+            // Adapt the strategies for the next pass
+            selector.update();
         });
 
         // Rescale film
+        splats.flush_all();
         const auto scale = Float(size.w * size.h) / processed;
         film_->rescale(scale);
         #if BDPT_PER_STRATEGY_FILM
@@ -406,7 +507,11 @@ public:
         }
         #endif
 
-        return { {"processed", processed}, {"elapsed", st.now()} };
+        Json result{ {"processed", processed}, {"elapsed", st.now()} };
+        if (adaptive_strategies_) {
+            result["strategy_probs"] = selector.to_json();
+        }
+        return profiler::attach_stats(result);
     }
 };
 
@@ -9,21 +9,81 @@
 #include <lm/scene.h>
 #include <lm/film.h>
 #include <lm/scheduler.h>
+#include <lm/sampler.h>
 #include <lm/path.h>
 #include <lm/timer.h>
 #include <lm/parallel.h>
 #include <lm/debug.h>
+#include <lm/trace.h>
+#include "strategyselect.h"
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
 namespace {
 
+// Compact scene interaction of a path vertex.
+// The tangent frame of PointGeometry is a function of the shading normal
+// (see PointGeometry::make_on_surface), so only the position, normals, and texture coordinates
+// are stored. The full SceneInteraction is reconstructed when the vertex is evaluated.
+struct CompactInteraction {
+    Vec3 p;                 // Position
+    Vec3 n;                 // Shading normal, or direction from the point at infinity
+    Vec3 gn;                // Geometry normal
+    Vec2 t;                 // Texture coordinates
+    Float footprint;        // Width of the ray footprint
+    int primitive;          // Primitive node index
+    std::uint8_t type;      // Scene interaction type
+    bool degenerated;       // True if the point is degenerated
+    bool infinite;          // True if the point is a point at infinity
+
+    static CompactInteraction pack(const SceneInteraction& sp) {
+        CompactInteraction c{};
+        c.p = sp.geom.p;
+        if (sp.geom.infinite) {
+            c.n = sp.geom.wo;
+        }
+        else if (!sp.geom.degenerated) {
+            c.n = sp.geom.n;
+            c.gn = sp.geom.gn;
+            c.t = sp.geom.t;
+        }
+        c.footprint = sp.geom.footprint;
+        c.primitive = sp.primitive;
+        c.type = std::uint8_t(sp.type);
+        c.degenerated = sp.geom.degenerated;
+        c.infinite = sp.geom.infinite;
+        return c;
+    }
+
+    Vec3 wo() const {
+        return n;
+    }
+
+    PointGeometry geom() const {
+        auto g = infinite ? PointGeometry::make_infinite(n, p)
+               : degenerated ? PointGeometry::make_degenerated(p)
+               : PointGeometry::make_on_surface(p, n, gn, t);
+        g.footprint = footprint;
+        return g;
+    }
+
+    SceneInteraction unpack() const {
+        SceneInteraction sp;
+        sp.type = type;
+        sp.primitive = primitive;
+        sp.geom = geom();
+        return sp;
+    }
+};
+
 // Path vertex with cache
 struct Vert {
-    SceneInteraction sp;    // Surface interaction
+    CompactInteraction sp;  // Surface interaction
     int comp;               // Component index
 
                             // Cached variables
+    bool specular;          // True if the component is specular
+    bool connectable;       // True if the vertex is a connectable endpoint
     Vec3 alpha;             // Path throughput up to this vertex
     Vec3 w_fwd;             // Outgoing direction
     Vec3 w_rev;             // Incoming direction
@@ -38,53 +98,6 @@ struct Path {
     int num_verts() const {
         return (int)(vs.size());
     }
-
-    int index(int i, TransDir trans_dir) const {
-        return trans_dir == TransDir::LE ? i : num_verts() - 1 - i;
-    }
-
-    const Vert* vertex_at(int i, TransDir trans_dir) const {
-        return (0 <= i && i < num_verts()) ? &vs[index(i, trans_dir)] : nullptr;
-    }
-
-    Vert* vertex_at(int i, TransDir trans_dir) {
-        return (0 <= i && i < num_verts()) ? &vs[index(i, trans_dir)] : nullptr;
-    }
-
-    bool is_samplable_bidir(const Scene* scene, int s) const {
-        const int n = num_verts();
-        const int t = n - s;
-        if (s == 0) {
-            // If the vertex is not degenerated and non-specular, the endpoint is samplable
-            const auto* vL = vertex_at(0, TransDir::LE);
-            return !vL->sp.geom.degenerated &&
-                   !path::is_specular_component(scene, vL->sp, vL->comp);
-        }
-        else if (t == 0) {
-            // If the vertex is not degenerated and non-specular, the endpoint is samplable
-            const auto* vE = vertex_at(0, TransDir::EL);
-            return !vE->sp.geom.degenerated &&
-                   !path::is_specular_component(scene, vE->sp, vE->comp);
-        }
-        else {
-            const auto* vL = vertex_at(s-1, TransDir::LE);
-            const auto* vE = vertex_at(t-1, TransDir::EL);
-            if (s == 1 && !path::is_connectable_endpoint(scene, vL->sp)) {
-                // Not samplebale if the endpoint is not connectable
-                return false;
-            }
-            else if (t == 1 && !path::is_connectable_endpoint(scene, vE->sp)) {
-                // Not samplebale if the endpoint is not connectable
-                return false;
-            }
-            // Not samplable if either vL or vE is specular component
-            if (path::is_specular_component(scene, vL->sp, vL->comp) ||
-                path::is_specular_component(scene, vE->sp, vE->comp)) {
-                return false;
-            }
-            return true;
-        }
-    }
 };
 
 }
@@ -98,7 +111,7 @@ template <>
 struct adl_serializer<lm::Path> {
     static void to_json(lm::Json& j, const lm::Path& path) {
         for (const auto& v : path.vs) {
-            j.push_back(v.sp.geom.p);
+            j.push_back(v.sp.p);
         }
     }
 };
@@ -114,67 +127,59 @@ Vec3 direction(const Vert* v_from, const Vert* v_to) {
     if (v_from == nullptr || v_to == nullptr) {
         return {};
     }
-    assert(!v_from->sp.geom.infinite || !v_to->sp.geom.infinite);
-    if (v_from->sp.geom.infinite) {
-        return v_from->sp.geom.wo;
+    assert(!v_from->sp.infinite || !v_to->sp.infinite);
+    if (v_from->sp.infinite) {
+        return v_from->sp.wo();
     }
-    else if (v_to->sp.geom.infinite) {
-        return -v_to->sp.geom.wo;
+    else if (v_to->sp.infinite) {
+        return -v_to->sp.wo();
     }
     else {
-        return glm::normalize(v_to->sp.geom.p - v_from->sp.geom.p);
+        return glm::normalize(v_to->sp.p - v_from->sp.p);
     }
 }
 
 // Sample subpath
-void sample_subpath(Path& path, Rng& rng, const Scene* scene, int max_verts, TransDir trans_dir) {
+void sample_subpath(Path& path, SampleStream& smp, const Scene* scene, int max_verts, TransDir trans_dir) {
     path.vs.clear();
     Vec3 throughput;
     Float pdf_fwd_next;
+    SceneInteraction sp;        // Full interaction of the current vertex
+    PointGeometry geom_prev;    // Geometry of the previous vertex
 
     // Perform random walk
     while (path.num_verts() < max_verts) {
         if (path.num_verts() == 0) {
             // Sample primary ray
-            const auto s = path::sample_primary_ray(rng, scene, trans_dir);
+            const auto s = path::sample_primary_ray(smp.next<path::RaySampleU>(), scene, trans_dir);
             if (!s) {
                 break;
             }
 
             // Add initial vertex
+            sp = s->sp;
             Vert v;
-            v.sp = s->sp;
+            v.sp = CompactInteraction::pack(sp);
             v.comp = 0;
-            v.pdf_fwd = [&]() -> Float {
-                if (path::is_connectable_endpoint(scene, s->sp)) {
-                    const auto pA = path::pdf_position(scene, s->sp);
-                    return pA;
-                }
-                else {
-                    return 1_f;
-                }
-            }();
+            v.specular = path::is_specular_component(scene, sp, v.comp);
+            v.connectable = path::is_connectable_endpoint(scene, sp);
+            v.pdf_fwd = v.connectable ? path::pdf_position(scene, sp) : 1_f;
             v.alpha = Vec3(1_f / v.pdf_fwd);
             v.w_rev = {};
             v.w_fwd = s->wo;
 
             // Update information for the next vertex
             throughput = s->weight;
-            pdf_fwd_next = [&]() -> Float {
-                if (path::is_connectable_endpoint(scene, v.sp)) {
-                    return path::pdf_direction(scene, v.sp, {}, v.w_fwd, v.comp, false);
-                }
-                else {
-                    return path::pdf_primary_ray(scene, v.sp, v.w_fwd, false);
-                }
-            }();
+            pdf_fwd_next = v.connectable
+                ? path::pdf_direction(scene, sp, {}, v.w_fwd, v.comp, false)
+                : path::pdf_primary_ray(scene, sp, v.w_fwd, false);
 
             path.vs.push_back(v);
         }
         else {
             // Sample direction
             auto& v = path.vs[path.num_verts() - 1];
-            const auto s = path::sample_direction(rng, scene, v.sp, v.w_rev, v.comp, trans_dir);
+            const auto s = path::sample_direction(smp.next<path::DirectionSampleU>(), scene, sp, v.w_rev, v.comp, trans_dir);
             if (!s) {
                 break;
             }
@@ -182,42 +187,48 @@ void sample_subpath(Path& path, Rng& rng, const Scene* scene, int max_verts, Tra
             // Update cached information
             v.w_fwd = s->wo;
             auto& v_prev = path.vs[path.num_verts() - 2];
-            v_prev.pdf_rev = v_prev.sp.geom.degenerated ? 1_f /*undefined*/ :
+            v_prev.pdf_rev = geom_prev.degenerated ? 1_f /*undefined*/ :
                 surface::convert_pdf_to_area(
-                    path::pdf_direction(scene, v.sp, v.w_fwd, v.w_rev, v.comp, false),
-                    v.sp.geom, v_prev.sp.geom);
+                    path::pdf_direction(scene, sp, v.w_fwd, v.w_rev, v.comp, false),
+                    sp.geom, geom_prev);
 
             // Update information for the next vertex
             throughput *= s->weight;
-            pdf_fwd_next = path::pdf_direction(scene, v.sp, v.w_rev, v.w_fwd, v.comp, false);
+            pdf_fwd_next = path::pdf_direction(scene, sp, v.w_rev, v.w_fwd, v.comp, false);
         }
 
         // Current vertex
-        auto& v = path.vs[path.num_verts() - 1];
+        const auto& v = path.vs[path.num_verts() - 1];
 
         // Intersection to next surface
-        const auto hit = scene->intersect({ v.sp.geom.p, v.w_fwd });
+        const auto hit = scene->intersect({ sp.geom.p, v.w_fwd });
         if (!hit) {
             break;
         }
 
         // Sample component
-        const auto s_comp = path::sample_component(rng, scene, *hit, -v.w_fwd);
+        const auto s_comp = path::sample_component(smp.next<path::ComponentSampleU>(), scene, *hit, -v.w_fwd);
         throughput *= s_comp.weight;
 
         // Create a vertex
         Vert v_next;
-        v_next.sp = *hit;
+        v_next.sp = CompactInteraction::pack(*hit);
         v_next.comp = s_comp.comp;
+        v_next.specular = path::is_specular_component(scene, *hit, s_comp.comp);
+        v_next.connectable = false;
         v_next.alpha = throughput;
         v_next.w_rev = -v.w_fwd;
-        v_next.pdf_fwd = surface::convert_pdf_to_area(pdf_fwd_next, v.sp.geom, hit->geom);
+        v_next.pdf_fwd = surface::convert_pdf_to_area(pdf_fwd_next, sp.geom, hit->geom);
         path.vs.push_back(v_next);
 
         // Termination
         if (hit->geom.infinite) {
             break;
         }
+
+        // Move to the next vertex
+        geom_prev = sp.geom;
+        sp = *hit;
     }
 }
 
@@ -235,30 +246,29 @@ std::optional<Splat> connect_and_eval_contrb(const Scene* scene, const Path& sub
     // Check if the path is samplable by the strategy (s,t)
     if (s == 0) {
         const auto& vL = subpathE.vs[t-1];
-        if (vL.sp.geom.degenerated) {
+        if (vL.sp.degenerated) {
             return {};
         }
     }
     else if (t == 0) {
         const auto& vE = subpathL.vs[s-1];
-        if (vE.sp.geom.degenerated) {
+        if (vE.sp.degenerated) {
             return {};
         }
     }
     else {
         const auto& vL = subpathL.vs[s-1];
         const auto& vE = subpathE.vs[t-1];
-        if (s == 1 && !path::is_connectable_endpoint(scene, vL.sp)) {
+        if (s == 1 && !vL.connectable) {
             return {};
         }
-        else if (t == 1 && !path::is_connectable_endpoint(scene, vE.sp)) {
+        else if (t == 1 && !vE.connectable) {
             return {};
         }
-        if (vL.sp.geom.infinite || vE.sp.geom.infinite) {
+        if (vL.sp.infinite || vE.sp.infinite) {
             return {};
         }
-        if (path::is_specular_component(scene, vL.sp, vL.comp) ||
-            path::is_specular_component(scene, vE.sp, vE.comp)) {
+        if (vL.specular || vE.specular) {
             return {};
         }
     }
@@ -267,25 +277,27 @@ std::optional<Splat> connect_and_eval_contrb(const Scene* scene, const Path& sub
     Vec3 C;
     if (s == 0) {
         const auto& vL = subpathE.vs[t-1];
-        const auto spL = vL.sp.as_type(SceneInteraction::LightEndpoint);
+        const auto spL = vL.sp.unpack().as_type(SceneInteraction::LightEndpoint);
         const auto Le = path::eval_contrb_direction(scene, spL, {}, vL.w_rev, {}, TransDir::LE, true);
         C = Le * vL.alpha;
     }
     else if (t == 0) {
         const auto& vE = subpathL.vs[s-1];
-        const auto spE = vE.sp.as_type(SceneInteraction::CameraEndpoint);
+        const auto spE = vE.sp.unpack().as_type(SceneInteraction::CameraEndpoint);
         const auto We = path::eval_contrb_direction(scene, spE, {}, vE.w_rev, {}, TransDir::EL, true);
         C = We * vE.alpha;
     }
     else {
         const auto& vL = subpathL.vs[s-1];
         const auto& vE = subpathE.vs[t-1];
-        if (!scene->visible(vL.sp, vE.sp)) {
+        const auto spL = vL.sp.unpack();
+        const auto spE = vE.sp.unpack();
+        if (!scene->visible(spL, spE)) {
             return {};
         }
-        const auto fsL = path::eval_contrb_direction(scene, vL.sp, vL.w_rev, direction(&vL, &vE), vL.comp, TransDir::LE, true);
-        const auto fsE = path::eval_contrb_direction(scene, vE.sp, vE.w_rev, direction(&vE, &vL), vE.comp, TransDir::EL, true);
-        const auto G = surface::geometry_term(vL.sp.geom, vE.sp.geom);
+        const auto fsL = path::eval_contrb_direction(scene, spL, vL.w_rev, direction(&vL, &vE), vL.comp, TransDir::LE, true);
+        const auto fsE = path::eval_contrb_direction(scene, spE, vE.w_rev, direction(&vE, &vL), vE.comp, TransDir::EL, true);
+        const auto G = surface::geometry_term(spL.geom, spE.geom);
         C = vL.alpha * fsL * G * fsE * vE.alpha;
     }
     if (math::is_zero(C)) {
@@ -311,96 +323,142 @@ std::optional<Splat> connect_and_eval_contrb(const Scene* scene, const Path& sub
     return Splat{ C, rp };
 }
 
+// PDFs and flags of the vertices of a fullpath in the LE order.
+// The MIS weight only needs to recompute the values of the vertices around the connection,
+// so the values are gathered from the subpaths into separate arrays
+// instead of copying the vertices.
+struct FullpathPdfs {
+    std::vector<Float> pdf_fwd;         // PDF p(x_i | x_{i-1},x_{i-2})
+    std::vector<Float> pdf_rev;         // PDF p(x_i | x_{i+1},x_{i+2})
+    std::vector<char> specular;         // True if the component is specular
+};
+
 // Evaluate MIS weight
 Float mis_weight_bidir(const Scene* scene, const Path& subpathE, const Path& subpathL, int s, int t) {
-    // Create full path
-    thread_local Path path;
-    path.vs.clear();
-    path.vs.insert(path.vs.end(), subpathL.vs.begin(), subpathL.vs.begin() + s);
-    path.vs.insert(path.vs.end(), subpathE.vs.rend() - t, subpathE.vs.rend());
-    auto& vL0 = path.vs.front();
-    auto& vE0 = path.vs.back();
-    vL0.sp = vL0.sp.as_type(SceneInteraction::LightEndpoint);
-    vE0.sp = vE0.sp.as_type(SceneInteraction::CameraEndpoint);
-    for (int i = s; i < s + t; i++) {
-        auto& v = path.vs[i];
-        std::swap(v.w_rev, v.w_fwd);
-        std::swap(v.pdf_fwd, v.pdf_rev);
-    }
+    // Gather the values of the full path.
+    // The directions of the camera subpath are reversed in the full path.
+    const int n = s + t;
+    thread_local FullpathPdfs fp;
+    fp.pdf_fwd.resize(n);
+    fp.pdf_rev.resize(n);
+    fp.specular.resize(n);
+    for (int i = 0; i < s; i++) {
+        const auto& v = subpathL.vs[i];
+        fp.pdf_fwd[i] = v.pdf_fwd;
+        fp.pdf_rev[i] = v.pdf_rev;
+        fp.specular[i] = v.specular;
+    }
+    for (int i = s; i < n; i++) {
+        const auto& v = subpathE.vs[n - 1 - i];
+        fp.pdf_fwd[i] = v.pdf_rev;
+        fp.pdf_rev[i] = v.pdf_fwd;
+        fp.specular[i] = v.specular;
+    }
+
+    // Reconstruct the vertices next to the connection.
+    // The endpoints of the full path are considered as the light and camera endpoints.
+    const auto* vL = s > 0 ? &subpathL.vs[s - 1] : nullptr;
+    const auto* vE = t > 0 ? &subpathE.vs[t - 1] : nullptr;
+    const auto unpack = [&](const Vert* v, int i) -> SceneInteraction {
+        const auto sp = v->sp.unpack();
+        return i == 0 ? sp.as_type(SceneInteraction::LightEndpoint)
+             : i == n - 1 ? sp.as_type(SceneInteraction::CameraEndpoint) : sp;
+    };
+    const auto spL = vL ? unpack(vL, s - 1) : SceneInteraction{};
+    const auto spE = vE ? unpack(vE, s) : SceneInteraction{};
+    if (!vL) {
+        fp.specular[0] = path::is_specular_component(scene, spE, vE->comp);
+    }
+    if (!vE) {
+        fp.specular[n - 1] = path::is_specular_component(scene, spL, vL->comp);
+    }
+    const bool degenerated0 = vL ? subpathL.vs[0].sp.degenerated : spE.geom.degenerated;
+    const bool degeneratedN = vE ? subpathE.vs[0].sp.degenerated : spL.geom.degenerated;
+    const bool connectable0 = vL ? subpathL.vs[0].connectable : path::is_connectable_endpoint(scene, spE);
+    const bool connectableN = vE ? subpathE.vs[0].connectable : path::is_connectable_endpoint(scene, spL);
 
     // Recompute cached values
-    auto* vL = path.vertex_at(s - 1, TransDir::LE);
-    auto* vE = path.vertex_at(t - 1, TransDir::EL);
-    auto* vL_prev = path.vertex_at(s - 2, TransDir::LE);
-    auto* vE_prev = path.vertex_at(t - 2, TransDir::EL);
-    if (vL) {
-        vL->w_fwd = direction(vL, vE);
-    }
-    if (vE) {
-        vE->w_rev = direction(vE, vL);
-    }
+    const auto wL_rev = vL ? vL->w_rev : Vec3();
+    const auto wL_fwd = direction(vL, vE);
+    const auto wE_rev = direction(vE, vL);
+    const auto wE_fwd = vE ? vE->w_rev : Vec3();
     if (vL) {
         if (!vE) {
-            vL->pdf_rev = path::is_connectable_endpoint(scene, vL->sp)
-                ? path::pdf_position(scene, vL->sp) : 1_f;
+            fp.pdf_rev[s - 1] = connectableN ? path::pdf_position(scene, spL) : 1_f;
         }
         else {
-            vL->pdf_rev = surface::convert_pdf_to_area(
-                path::pdf_direction(scene, vE->sp, vE->w_fwd, vE->w_rev, vE->comp, false),
-                vE->sp.geom, vL->sp.geom);
+            fp.pdf_rev[s - 1] = surface::convert_pdf_to_area(
+                path::pdf_direction(scene, spE, wE_fwd, wE_rev, vE->comp, false),
+                spE.geom, spL.geom);
         }
     }
     if (vE) {
         if (!vL) {
-            vE->pdf_fwd = path::is_connectable_endpoint(scene, vE->sp)
-                ? path::pdf_position(scene, vE->sp) : 1_f;
+            fp.pdf_fwd[s] = connectable0 ? path::pdf_position(scene, spE) : 1_f;
         }
         else {
-            vE->pdf_fwd = surface::convert_pdf_to_area(
-                path::pdf_direction(scene, vL->sp, vL->w_rev, vL->w_fwd, vL->comp, false),
-                vL->sp.geom, vE->sp.geom);
+            fp.pdf_fwd[s] = surface::convert_pdf_to_area(
+                path::pdf_direction(scene, spL, wL_rev, wL_fwd, vL->comp, false),
+                spL.geom, spE.geom);
         }
     }
-    if (vL_prev) {
-        if (!vE && !path::is_connectable_endpoint(scene, vL->sp)) {
-            vL_prev->pdf_rev = surface::convert_pdf_to_area(
-                path::pdf_primary_ray(scene, vL->sp, vL->w_rev, false),
-                vL->sp.geom, vL_prev->sp.geom);
+    if (s >= 2) {
+        const auto geomL_prev = subpathL.vs[s - 2].sp.geom();
+        if (!vE && !connectableN) {
+            fp.pdf_rev[s - 2] = surface::convert_pdf_to_area(
+                path::pdf_primary_ray(scene, spL, wL_rev, false),
+                spL.geom, geomL_prev);
         }
         else {
-            vL_prev->pdf_rev = surface::convert_pdf_to_area(
-                path::pdf_direction(scene, vL->sp, vL->w_fwd, vL->w_rev, vL->comp, false),
-                vL->sp.geom, vL_prev->sp.geom);
+            fp.pdf_rev[s - 2] = surface::convert_pdf_to_area(
+                path::pdf_direction(scene, spL, wL_fwd, wL_rev, vL->comp, false),
+                spL.geom, geomL_prev);
         }
     }
-    if (vE_prev) {
-        if (!vL && !path::is_connectable_endpoint(scene, vE->sp)) {
-            vE_prev->pdf_fwd = surface::convert_pdf_to_area(
-                path::pdf_primary_ray(scene, vE->sp, vE->w_fwd, false),
-                vE->sp.geom, vE_prev->sp.geom);
+    if (t >= 2) {
+        const auto geomE_prev = subpathE.vs[t - 2].sp.geom();
+        if (!vL && !connectable0) {
+            fp.pdf_fwd[s + 1] = surface::convert_pdf_to_area(
+                path::pdf_primary_ray(scene, spE, wE_fwd, false),
+                spE.geom, geomE_prev);
         }
         else {
-            vE_prev->pdf_fwd = surface::convert_pdf_to_area(
-                path::pdf_direction(scene, vE->sp, vE->w_rev, vE->w_fwd, vE->comp, false),
-                vE->sp.geom, vE_prev->sp.geom);
+            fp.pdf_fwd[s + 1] = surface::convert_pdf_to_area(
+                path::pdf_direction(scene, spE, wE_rev, wE_fwd, vE->comp, false),
+                spE.geom, geomE_prev);
         }
     }
 
+    // Check if the full path is samplable by the strategy (i,n-i)
+    const auto samplable = [&](int i) -> bool {
+        if (i == 0) {
+            return !degenerated0 && !fp.specular[0];
+        }
+        else if (i == n) {
+            return !degeneratedN && !fp.specular[n - 1];
+        }
+        if (i == 1 && !connectable0) {
+            return false;
+        }
+        else if (i == n - 1 && !connectableN) {
+            return false;
+        }
+        return !fp.specular[i - 1] && !fp.specular[i];
+    };
+
     // Compute MIS weight
     Float sum = 0_f;
     Float r = 1_f;
-    for (int i = s; i < s + t; i++) {
-        const auto& v = path.vs[i];
-        r *= v.pdf_fwd / v.pdf_rev;
-        if (path.is_samplable_bidir(scene, i+1)) {
+    for (int i = s; i < n; i++) {
+        r *= fp.pdf_fwd[i] / fp.pdf_rev[i];
+        if (samplable(i + 1)) {
             sum += r;
         }
     }
     r = 1_f;
     for (int i = s - 1; i >= 0; i--) {
-        const auto& v = path.vs[i];
-        r *= v.pdf_rev / v.pdf_fwd;
-        if (path.is_samplable_bidir(scene, i)) {
+        r *= fp.pdf_rev[i] / fp.pdf_fwd[i];
+        if (samplable(i)) {
             sum += r;
         }
     }
@@ -408,6 +466,32 @@ Float mis_weight_bidir(const Scene* scene, const Path& subpathE, const Path& sub
     return 1_f / inv_w;
 }
 
+// Light vertex cache.
+// The light subpaths sampled in a pass are stored contiguously in a single array
+// and shared by all camera subpaths sampled in the pass.
+struct LightVertexCache {
+    // Vertex that can be connected to a camera subpath
+    struct Entry {
+        int path;   // Index of the light subpath
+        int index;  // Index of the vertex in the subpath
+    };
+
+    std::vector<Path> paths;        // Light subpaths used as the buffer for the parallel sampling
+    std::vector<Vert> verts;        // Vertices of the light subpaths stored contiguously
+    std::vector<int> offsets;       // Offsets of the light subpaths in verts
+    std::vector<Entry> entries;     // Connectable vertices
+    int connections = 1;            // Number of connections per camera subpath
+};
+
+// Check if the light vertex can be connected to a vertex of a camera subpath.
+// This checks the conditions of connect_and_eval_contrb() depending only on the light vertex.
+bool is_connectable_light_vertex(const Vert& vL, int s) {
+    if (s == 1 && !vL.connectable) {
+        return false;
+    }
+    return !vL.sp.infinite && !vL.specular;
+}
+
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -415,15 +499,31 @@ Float mis_weight_bidir(const Scene* scene, const Path& subpathE, const Path& sub
 // Enable the output of per-strategy film
 #define BDPT_PER_STRATEGY_FILM 0
 
-// Optimized BDPT
+// Optimized BDPT.
+// With lvc_paths > 0, the renderer runs in the light vertex cache mode [Davidovic et al. 2014].
+// In each pass, lvc_paths light subpaths are sampled in parallel and their vertices are cached.
+// Each camera subpath is connected to lvc_connections vertices uniformly selected from the cache,
+// instead of the vertices of a light subpath sampled for the camera subpath.
+// Multiplying the contribution by (#cached vertices) / (lvc_paths * lvc_connections)
+// makes each connection strategy unbiased, so the MIS weights of BDPT are used as they are.
+// By default, lvc_connections is the average number of the connectable vertices per light subpath.
+// With adaptive_strategies enabled, the strategies with negligible efficiency
+// are subsampled from the second pass (see StrategySelector).
+// The light vertex cache mode does not support the adaptive selection.
 class Renderer_BDPT_Optimized final : public Renderer {
 private:
     Scene* scene_;                                  // Reference to scene asset
     Film* film_;                                    // Reference to film asset for output
     int min_verts_;                                 // Minimum number of path vertices
     int max_verts_;                                 // Maximum number of path vertices
-    std::optional<unsigned int> seed_;              // Random seed
     Component::Ptr<scheduler::Scheduler> sched_;    // Scheduler for parallel processing
+    Component::Ptr<Sampler> sampler_;               // Sampler of the random numbers
+    int lvc_paths_;                                 // Number of light subpaths per pass in the light vertex cache mode
+    int lvc_connections_;                           // Number of connections per camera subpath (0: automatic)
+    mutable LightVertexCache lvc_;                  // Light vertex cache of the current pass
+    bool adaptive_strategies_;                      // Subsample the strategies with low efficiency
+    Float strategy_threshold_;                      // Relative efficiency below which the strategies are subsampled
+    Float min_strategy_prob_;                       // Minimum selection probability of a strategy
 
     #if BDPT_PER_STRATEGY_FILM
     // Index: (k, s)
@@ -433,16 +533,49 @@ private:
     std::unordered_map<std::string, Film*> strategy_film_name_map_;
     #endif
 
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(scene_, film_, min_verts_, max_verts_, sched_, sampler_, lvc_paths_, lvc_connections_,
+            adaptive_strategies_, strategy_threshold_, min_strategy_prob_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, scene_);
+        comp::visit(visit, film_);
+        comp::visit(visit, sched_);
+        comp::visit(visit, sampler_);
+    }
+
 public:
     virtual void construct(const Json& prop) override {
         scene_ = json::comp_ref<Scene>(prop, "scene");
         film_ = json::comp_ref<Film>(prop, "output");
         min_verts_ = json::value<int>(prop, "min_verts", 2);
         max_verts_ = json::value<int>(prop, "max_verts");
-        seed_ = json::value_or_none<unsigned int>(prop, "seed");
         const auto sched_name = json::value<std::string>(prop, "scheduler");
         sched_ = comp::create<scheduler::Scheduler>(
             "scheduler::spi::" + sched_name, make_loc("scheduler"), prop);
+        const auto sampler_name = json::value<std::string>(prop, "sampler", "random");
+        sampler_ = comp::create<Sampler>(
+            "sampler::" + sampler_name, make_loc("sampler"), prop);
+        lvc_paths_ = json::value<int>(prop, "lvc_paths", 0);
+        lvc_connections_ = json::value<int>(prop, "lvc_connections", 0);
+        if (lvc_paths_ < 0 || lvc_connections_ < 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid light vertex cache configuration [lvc_paths='{}', lvc_connections='{}']",
+                lvc_paths_, lvc_connections_);
+        }
+        adaptive_strategies_ = json::value<bool>(prop, "adaptive_strategies", false);
+        strategy_threshold_ = json::value<Float>(prop, "strategy_threshold", .1_f);
+        min_strategy_prob_ = json::value<Float>(prop, "min_strategy_prob", .05_f);
+        if (strategy_threshold_ <= 0_f || min_strategy_prob_ <= 0_f || min_strategy_prob_ > 1_f) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid strategy selection [strategy_threshold='{}', min_strategy_prob='{}']",
+                strategy_threshold_, min_strategy_prob_);
+        }
+        if (adaptive_strategies_ && lvc_paths_ > 0) {
+            LM_WARN("Adaptive strategies are not supported in the light vertex cache mode");
+        }
         #if BDPT_PER_STRATEGY_FILM
         const auto size = film_->size();
         for (int k = 2; k <= max_verts_; k++) {
@@ -467,25 +600,132 @@ public:
     }
     #endif
 
+private:
+    // Sample light subpaths of the pass and store the vertices in the cache
+    void build_light_vertex_cache(long long pass) const {
+        LM_TRACE_SCOPE("renderer::bdptopt::build_light_vertex_cache");
+        auto& c = lvc_;
+        const int n = lvc_paths_;
+
+        // Sample light subpaths in parallel.
+        // The subpaths use the pixel indices not used by the camera subpaths.
+        c.paths.resize(n);
+        parallel::foreach(n, [&](long long i, int) {
+            SampleStream smp(sampler_.get(), -1 - i, pass);
+            sample_subpath(c.paths[i], smp, scene_, max_verts_, TransDir::LE);
+        });
+
+        // Store the vertices contiguously
+        c.offsets.resize(n + 1);
+        c.offsets[0] = 0;
+        for (int i = 0; i < n; i++) {
+            c.offsets[i + 1] = c.offsets[i] + c.paths[i].num_verts();
+        }
+        c.verts.resize(c.offsets[n]);
+        parallel::foreach(n, [&](long long i, int) {
+            const auto& vs = c.paths[i].vs;
+            std::copy(vs.begin(), vs.end(), c.verts.begin() + c.offsets[i]);
+        });
+
+        // Collect connectable vertices
+        c.entries.clear();
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < c.paths[i].num_verts(); j++) {
+                if (is_connectable_light_vertex(c.verts[c.offsets[i] + j], j + 1)) {
+                    c.entries.push_back({ i, j });
+                }
+            }
+        }
+        c.connections = lvc_connections_ > 0
+            ? lvc_connections_
+            : std::max(1, int(std::ceil(Float(c.entries.size()) / Float(n))));
+    }
+
+    // Render in the light vertex cache mode
+    long long render_lvc() const {
+        long long pass = 0;
+        build_light_vertex_cache(pass);
+        return sched_->run([&](long long pixel_index, long long sample_index, int) {
+            SampleStream smp(sampler_.get(), pixel_index, sample_index);
+
+            // Sample camera subpath
+            thread_local Path subpathE;
+            thread_local Path subpathL;
+            sample_subpath(subpathE, smp, scene_, max_verts_, TransDir::EL);
+            const int nE = (int)(subpathE.vs.size());
+
+            // Strategies hitting lights with the camera subpath
+            subpathL.vs.clear();
+            for (int t = std::max(2, min_verts_); t <= std::min(nE, max_verts_); t++) {
+                const auto splat = connect_and_eval_contrb(scene_, subpathE, subpathL, 0, t);
+                if (!splat) {
+                    continue;
+                }
+                const auto w = mis_weight_bidir(scene_, subpathE, subpathL, 0, t);
+                film_->splat(splat->rp, w * splat->C);
+            }
+
+            // Connections to the cached light vertices
+            const auto& c = lvc_;
+            if (c.entries.empty()) {
+                return;
+            }
+            const int num_entries = int(c.entries.size());
+            const auto scale = Float(num_entries) / (Float(lvc_paths_) * Float(c.connections));
+            for (int m = 0; m < c.connections; m++) {
+                const auto& e = c.entries[std::min(int(smp.u() * num_entries), num_entries - 1)];
+                const int s = e.index + 1;
+                const auto it = c.verts.begin() + c.offsets[e.path];
+                subpathL.vs.assign(it, it + s);
+                for (int t = 1; t <= nE; t++) {
+                    const int k = s + t;
+                    if (k < min_verts_ || max_verts_ < k) {
+                        continue;
+                    }
+                    const auto splat = connect_and_eval_contrb(scene_, subpathE, subpathL, s, t);
+                    if (!splat) {
+                        continue;
+                    }
+                    const auto w = mis_weight_bidir(scene_, subpathE, subpathL, s, t);
+                    film_->splat(splat->rp, w * scale * splat->C);
+                }
+            }
+        }, [&](long long) {
+            // Refresh the cache for the next pass
+            build_light_vertex_cache(++pass);
+        });
+    }
+
+public:
     virtual Json render() const override {
         scene_->require_renderable();
-        film_->clear();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
         timer::ScopedTimer st;
 
+        if (lvc_paths_ > 0) {
+            const auto processed = render_lvc();
+            film_->rescale(Float(size.w * size.h) / processed);
+            return profiler::attach_stats({
+                {"processed", processed},
+                {"elapsed", st.now()},
+                {"lvc_vertices", lvc_.entries.size()}
+            });
+        }
 
         // Execute parallel process
-        const auto processed = sched_->run([&](long long, long long sample_index, int threadid) {
-            LM_KEEP_UNUSED(sample_index);
-
-            // Per-thread random number generator
-            thread_local Rng rng(seed_ ? *seed_ + threadid : math::rng_seed());
+        StrategySelector selector(adaptive_strategies_, max_verts_, strategy_threshold_, min_strategy_prob_);
+        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
+            // Sample numbers of the sample
+            SampleStream smp(sampler_.get(), pixel_index, sample_index);
 
             // Sample subpaths
             thread_local Path subpathE;
             thread_local Path subpathL;
-            sample_subpath(subpathE, rng, scene_, max_verts_, TransDir::EL);
-            sample_subpath(subpathL, rng, scene_, max_verts_, TransDir::LE);
+            sample_subpath(subpathE, smp, scene_, max_verts_, TransDir::EL);
+            sample_subpath(subpathL, smp, scene_, max_verts_, TransDir::LE);
             const int nE = (int)(subpathE.vs.size());
             const int nL = (int)(subpathL.vs.size());
             
@@ -497,24 +737,35 @@ public:
                         continue;
                     }
 
+                    // Select the strategy
+                    const auto inv_prob = selector.select(s, t, adaptive_strategies_ ? smp.u() : 0_f);
+                    if (inv_prob == 0_f) {
+                        continue;
+                    }
+
                     // Connect subpaths and evaluate contribution
                     const auto splat = connect_and_eval_contrb(scene_, subpathE, subpathL, s, t);
                     if (!splat) {
+                        selector.record(threadid, s, t, Vec3(0_f));
                         continue;
                     }
 
                     // Evaluate MIS weight
                     const auto w = mis_weight_bidir(scene_, subpathE, subpathL, s, t);
-                    const auto C = w * splat->C;
+                    selector.record(threadid, s, t, w * splat->C);
+                    const auto C = w * inv_prob * splat->C;
 
                     // Accumulate contribution
                     film_->splat(splat->rp, C);
                     #if BDPT_PER_STRATEGY_FILM
                     auto& strategy_film = strategy_films_[k-2][s];
-                    strategy_film->splat(splat->rp, splat->C);
+                    strategy_film->splat(splat->rp, inv_prob * splat->C);
                     #endif
                 }
             }
+        }, [&](long long) {
+            // Adapt the strategies for the next pass
+            selector.update();
         });
 
         // Rescale film
@@ -528,7 +779,11 @@ public:
         }
         #endif
 
-        return { {"processed", processed}, {"elapsed", st.now()} };
+        Json result{ {"processed", processed}, {"elapsed", st.now()} };
+        if (adaptive_strategies_) {
+            result["strategy_probs"] = selector.to_json();
+        }
+        return profiler::attach_stats(result);
     }
 };
 
@@ -0,0 +1,121 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/renderer.h>
+#include <lm/film.h>
+#include <lm/denoiser.h>
+#include <lm/parallel.h>
+#include <lm/timer.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: renderer::denoise
+
+    Renderer denoising the output of another renderer.
+
+    :param str renderer: Name of the underlying renderer, e.g., ``pt``.
+    :param str output: Locator of the film.
+    :param str denoiser: Name of the denoiser. ``auto`` (default), ``oidn``, or ``bilateral``.
+
+    This renderer executes the underlying renderer and denoises the output film in place.
+    The other properties are passed to the underlying renderer and to the denoiser.
+    If the film records the albedo and the normal as AOVs
+    (see :cpp:enum:`lm::FilmAOV`), they are used as the feature buffers of the denoiser.
+    If ``denoiser`` is ``auto``, the renderer uses ``denoiser::oidn``
+    if the plugin is loaded, and falls back to ``denoiser::bilateral`` otherwise.
+    The result of :cpp:func:`lm::Renderer::render` is the result of the underlying renderer
+    extended with ``denoiser`` and ``denoise_elapsed``.
+\endrst
+*/
+class Renderer_Denoise final : public Renderer {
+private:
+    Film* film_;
+    Component::Ptr<Renderer> renderer_;
+    Component::Ptr<Denoiser> denoiser_;
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(film_, renderer_, denoiser_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, film_);
+        comp::visit(visit, renderer_);
+        comp::visit(visit, denoiser_);
+    }
+
+    virtual Component* underlying(const std::string& name) const override {
+        if (name == "renderer") {
+            return renderer_.get();
+        }
+        if (name == "denoiser") {
+            return denoiser_.get();
+        }
+        return nullptr;
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        film_ = json::comp_ref<Film>(prop, "output");
+        const auto renderer_name = json::value<std::string>(prop, "renderer");
+        renderer_ = comp::create<Renderer>("renderer::" + renderer_name, make_loc("renderer"), prop);
+        if (!renderer_) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Failed to create renderer [renderer='{}']", renderer_name);
+        }
+
+        // Select denoiser
+        auto denoiser_name = json::value<std::string>(prop, "denoiser", "auto");
+        if (denoiser_name == "auto") {
+            bool has_oidn = false;
+            comp::foreach_registered([&](const std::string& name) {
+                has_oidn |= name == "denoiser::oidn";
+            });
+            denoiser_name = has_oidn ? "oidn" : "bilateral";
+        }
+        denoiser_ = comp::create<Denoiser>("denoiser::" + denoiser_name, make_loc("denoiser"), prop);
+        if (!denoiser_) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Failed to create denoiser [denoiser='{}']", denoiser_name);
+        }
+    }
+
+    virtual Json render() const override {
+        // Render noisy image
+        auto result = renderer_->render();
+
+        // Denoise the film
+        LM_INFO("Denoising [denoiser='{}']", denoiser_->key());
+        LM_INDENT();
+        timer::ScopedTimer st;
+        const auto [w, h] = film_->size();
+        std::vector<Vec3> color(size_t(w)*h);
+        {
+            const auto buf = film_->buffer();
+            std::copy_n(reinterpret_cast<const Vec3*>(buf.data), color.size(), color.begin());
+        }
+        const auto albedo = film_->aov(FilmAOV::Albedo);
+        const auto normal = film_->aov(FilmAOV::Normal);
+        if (albedo.empty() || normal.empty()) {
+            LM_WARN("Film does not record albedo or normal. Features are not used for denoising.");
+        }
+        const auto denoised = denoiser_->denoise(w, h, color, albedo, normal);
+        parallel::foreach(w*h, [&](long long i, int) {
+            film_->set_pixel(int(i % w), int(i / w), denoised[i]);
+        });
+
+        result["denoiser"] = denoiser_->key();
+        result["denoise_elapsed"] = st.now();
+        return result;
+    }
+};
+
+LM_COMP_REG_IMPL(Renderer_Denoise, "renderer::denoise");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
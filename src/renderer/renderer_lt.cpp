@@ -11,6 +11,9 @@
 #include <lm/scheduler.h>
 #include <lm/path.h>
 #include <lm/timer.h>
+#include <lm/roulette.h>
+#include "raystats.h"
+#include "splatbuffer.h"
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -22,16 +25,19 @@ private:
     int max_verts_;                                 // Maximum number of path vertices
     std::optional<unsigned int> seed_;              // Random seed
     Component::Ptr<scheduler::Scheduler> sched_;    // Scheduler for parallel processing
+    Component::Ptr<Roulette> roulette_;             // Termination policy of the paths
+    int splat_batch_;                               // Number of the splats buffered per thread
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(scene_, film_, max_verts_, seed_, sched_);
+        ar(scene_, film_, max_verts_, seed_, sched_, roulette_, splat_batch_);
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visit) override {
         comp::visit(visit, scene_);
         comp::visit(visit, film_);
         comp::visit(visit, sched_);
+        comp::visit(visit, roulette_);
     }
 
 public:
@@ -40,23 +46,37 @@ public:
         film_ = json::comp_ref<Film>(prop, "output");
         max_verts_ = json::value<int>(prop, "max_verts");
         seed_ = json::value_or_none<unsigned int>(prop, "seed");
+        splat_batch_ = json::value<int>(prop, "splat_batch", 256);
 
         // Scheduler is fixed to image space scheduler
         const auto sched_name = json::value<std::string>(prop, "scheduler");
         sched_ = comp::create<scheduler::Scheduler>(
             "scheduler::spi::" + sched_name, make_loc("scheduler"), prop);
+        {
+            const auto name = json::value<std::string>(prop, "roulette", "throughput");
+            roulette_ = comp::create<Roulette>("roulette::" + name, make_loc("roulette"), prop);
+        }
     }
 
     virtual Json render() const override {
         scene_->require_renderable();
-        film_->clear();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
         timer::ScopedTimer st;
 
+        // Base random number generator. Each sample uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
+
         // Execute parallel process
-        const auto processed = sched_->run([&](long long, long long, int threadid) {
-            // Per-thread random number generator
-            thread_local Rng rng(seed_ ? *seed_ + threadid : math::rng_seed());
+        RayStats ray_stats;
+        SplatBuffer splats(film_, splat_batch_);
+        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
+            // Random number generator for the sample
+            auto rng = rng_base.split(pixel_index, sample_index);
+            auto& stats = ray_stats.at(threadid);
 
             // ------------------------------------------------------------------------------------
 
@@ -65,6 +85,8 @@ public:
 
             // Intersection to next surface
             const auto hit_primary = scene_->intersect(s_primary->ray());
+            stats.path();
+            stats.extension(true, bool(hit_primary));
             if (!hit_primary) {
                 return;
             }
@@ -97,6 +119,7 @@ public:
                     if (!sE) {
                         return;
                     }
+                    stats.shadow++;
                     if (!scene_->visible(sp, sE->sp)) {
                         return;
                     }
@@ -111,7 +134,7 @@ public:
                     const auto wo = -sE->wo;
                     const auto fs = path::eval_contrb_direction(scene_, sp, wi, wo, comp, TransDir::LE, true);
                     const auto C = throughput * fs * sE->weight;
-                    film_->splat(*rp, C);
+                    splats.splat(threadid, *rp, C);
                 }();
 
                 // --------------------------------------------------------------------------------
@@ -126,6 +149,7 @@ public:
 
                 // Intersection to next surface
                 const auto hit = scene_->intersect({ sp.geom.p, s->wo });
+                stats.extension(false, bool(hit));
                 if (!hit) {
                     break;
                 }
@@ -143,12 +167,8 @@ public:
                 }
 
                 // Russian roulette
-                if (num_verts > 5) {
-                    const auto q = glm::max(.2_f, 1_f - glm::compMax(throughput));
-                    if (rng.u() < q) {
-                        break;
-                    }
-                    throughput /= 1_f - q;
+                if (!roulette::survive(roulette_.get(), rng.u(), throughput, num_verts)) {
+                    break;
                 }
 
                 // --------------------------------------------------------------------------------
@@ -164,12 +184,21 @@ public:
                 sp = *hit;
                 comp = s_comp.comp;
             }
+        }, [&](long long processed) {
+            // Publish snapshot of the film for progressive rendering
+            film_->publish(Float(size.w * size.h) / processed);
         });
 
         // Rescale film
+        splats.flush_all();
         film_->rescale(Float(size.w * size.h) / processed);
 
-        return { {"processed", processed}, {"elapsed", st.now()} };
+        const auto elapsed = st.now();
+        return profiler::attach_stats({
+            {"processed", processed},
+            {"elapsed", elapsed},
+            {"ray_stats", ray_stats.to_json(elapsed)}
+        });
     }
 };
 
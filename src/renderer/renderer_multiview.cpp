@@ -0,0 +1,139 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/renderer.h>
+#include <lm/scene.h>
+#include <lm/camera.h>
+#include <lm/film.h>
+#include <lm/timer.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: renderer::multiview
+
+    Renderer of multiple views of a scene.
+
+    :param str renderer: Name of the underlying renderer, e.g., ``pt``.
+    :param str scene: Locator of the scene.
+    :param list views: List of the views. Each view is an object with
+                       ``camera`` (locator of the camera) and ``output`` (locator of the film).
+                       The other properties of the view override the properties of the renderer.
+
+    This renderer renders the views of the same scene, e.g., the cameras of a turntable,
+    in a single call of :cpp:func:`lm::Renderer::render`.
+    The cameras must be added to the scene as the primitives.
+    The scene is built once and shared by the views,
+    so the acceleration structure and the caches of the scene are reused across the views.
+    For each view the renderer selects the camera by :cpp:func:`lm::Scene::set_camera_node`
+    and executes the underlying renderer writing to the film of the view.
+    The other properties are passed to the underlying renderers.
+    The camera selected before the rendering is restored at the end.
+    The result of :cpp:func:`lm::Renderer::render` contains ``views``,
+    the results of the underlying renderer for each view, and ``elapsed``.
+\endrst
+*/
+class Renderer_MultiView final : public Renderer {
+private:
+    struct View {
+        Camera* camera;                     // Camera of the view
+        Component::Ptr<Renderer> renderer;  // Renderer writing to the film of the view
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(camera, renderer);
+        }
+    };
+
+    Scene* scene_;
+    std::vector<View> views_;
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(scene_, views_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, scene_);
+        for (auto& view : views_) {
+            comp::visit(visit, view.camera);
+            comp::visit(visit, view.renderer);
+        }
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        scene_ = json::comp_ref<Scene>(prop, "scene");
+        const auto renderer_name = json::value<std::string>(prop, "renderer");
+        const auto it = prop.find("views");
+        if (it == prop.end() || !it->is_array() || it->empty()) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Missing views");
+        }
+
+        // Properties of the underlying renderers
+        auto renderer_prop = prop;
+        renderer_prop.erase("views");
+        for (int i = 0; i < int(it->size()); i++) {
+            const auto& view_prop = (*it)[i];
+            auto p = renderer_prop;
+            for (const auto& [k, v] : view_prop.items()) {
+                if (k != "camera") {
+                    p[k] = v;
+                }
+            }
+            View view;
+            view.camera = json::comp_ref<Camera>(view_prop, "camera");
+            view.renderer = comp::create<Renderer>(
+                "renderer::" + renderer_name, make_loc("renderer" + std::to_string(i)), p);
+            if (!view.renderer) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument,
+                    "Failed to create renderer [renderer='{}']", renderer_name);
+            }
+            views_.push_back(std::move(view));
+        }
+    }
+
+private:
+    // Find the primitive node containing the camera
+    int camera_node_of(const Camera* camera) const {
+        for (int i = 0; i < scene_->num_nodes(); i++) {
+            const auto& node = scene_->node_at(i);
+            if (node.type == SceneNodeType::Primitive && node.primitive.camera == camera) {
+                return i;
+            }
+        }
+        LM_THROW_EXCEPTION(Error::InvalidArgument,
+            "Camera is not a primitive of the scene [camera='{}']", camera->loc());
+    }
+
+public:
+    virtual Json render() const override {
+        scene_->require_renderable();
+        timer::ScopedTimer st;
+        const int orig_camera_node = scene_->camera_node();
+
+        Json results = Json::array();
+        for (int i = 0; i < int(views_.size()); i++) {
+            const auto& view = views_[i];
+            LM_INFO("Rendering view [index='{}', camera='{}']", i, view.camera->loc());
+            LM_INDENT();
+            scene_->set_camera_node(camera_node_of(view.camera));
+            results.push_back(view.renderer->render());
+        }
+        scene_->set_camera_node(orig_camera_node);
+
+        return {
+            {"views", results},
+            {"elapsed", st.now()}
+        };
+    }
+};
+
+LM_COMP_REG_IMPL(Renderer_MultiView, "renderer::multiview");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -9,8 +9,14 @@
 #include <lm/scene.h>
 #include <lm/film.h>
 #include <lm/scheduler.h>
+#include <lm/sampler.h>
 #include <lm/path.h>
+#include <lm/mesh.h>
 #include <lm/timer.h>
+#include <lm/roulette.h>
+#include <lm/spectrum.h>
+#include "sdtree.h"
+#include "raystats.h"
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -31,20 +37,33 @@ private:
     Scene* scene_;                                      // Reference to scene asset
     Film* film_;                                        // Reference to film asset for output
     int max_verts_;                                     // Maximum number of path vertices
-    std::optional<unsigned int> seed_;                  // Random seed
     SamplingMode sampling_mode_;                        // Sampling mode
     PrimaryRaySampleMode primary_ray_sampling_mode_;    // Sampling mode of the primary ray
     Component::Ptr<scheduler::Scheduler> sched_;        // Scheduler for parallel processing
+    Component::Ptr<Sampler> sampler_;                   // Sampler of the random numbers
+    Component::Ptr<Roulette> roulette_;                 // Termination policy of the paths
+    bool guiding_;                                      // Enables path guiding
+    Float guiding_bsdf_fraction_;                       // Probability of BSDF sampling in guided vertices
+    Float guiding_spatial_threshold_;                   // Number of samples to split a spatial cell
+    Float guiding_directional_threshold_;               // Fraction of energy to split a directional cell
+    bool spectral_;                                     // Transports hero wavelengths instead of RGB
+    bool ray_cones_;                                    // Filters textures by the ray footprints
+    int primary_hit_cache_;                             // Number of sub-samples per pixel of the cached primary hits. 0 to disable.
+    int ris_candidates_;                                // Number of light candidates resampled per NEE. 1 to disable.
+    int split_;                                         // Number of splits of the path at the first scattering vertex
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(scene_, film_, max_verts_, sampling_mode_, sched_);
+        ar(scene_, film_, max_verts_, sampling_mode_, primary_ray_sampling_mode_, sched_, sampler_, roulette_,
+            guiding_, guiding_bsdf_fraction_, guiding_spatial_threshold_, guiding_directional_threshold_, spectral_, ray_cones_, primary_hit_cache_, ris_candidates_, split_);
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visit) override {
         comp::visit(visit, scene_);
         comp::visit(visit, film_);
         comp::visit(visit, sched_);
+        comp::visit(visit, sampler_);
+        comp::visit(visit, roulette_);
     }
 
 public:
@@ -52,7 +71,6 @@ public:
         scene_ = json::comp_ref<Scene>(prop, "scene");
         film_ = json::comp_ref<Film>(prop, "output");
         max_verts_ = json::value<int>(prop, "max_verts");
-        seed_ = json::value_or_none<unsigned int>(prop, "seed");
         {
             const auto s = json::value<std::string>(prop, "sampling_mode", "mis");
             if (s == "naive")    sampling_mode_ = SamplingMode::Naive;
@@ -74,27 +92,140 @@ public:
                     "scheduler::spi::" + name, make_loc("scheduler"), prop);
             }
         }
+        {
+            const auto name = json::value<std::string>(prop, "sampler", "random");
+            sampler_ = comp::create<Sampler>("sampler::" + name, make_loc("sampler"), prop);
+        }
+        {
+            const auto name = json::value<std::string>(prop, "roulette", "throughput");
+            roulette_ = comp::create<Roulette>("roulette::" + name, make_loc("roulette"), prop);
+        }
+        guiding_ = json::value<bool>(prop, "guiding", false);
+        guiding_bsdf_fraction_ = json::value<Float>(prop, "guiding_bsdf_fraction", .5_f);
+        guiding_spatial_threshold_ = json::value<Float>(prop, "guiding_spatial_threshold", 12000_f);
+        guiding_directional_threshold_ = json::value<Float>(prop, "guiding_directional_threshold", .01_f);
+        spectral_ = json::value<bool>(prop, "spectral", false);
+        ray_cones_ = json::value<bool>(prop, "ray_cones", false);
+        primary_hit_cache_ = json::value<int>(prop, "primary_hit_cache", 0);
+        if (primary_hit_cache_ < 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Number of cached sub-samples must be >= 0 [primary_hit_cache='{}']", primary_hit_cache_);
+        }
+        if (primary_hit_cache_ > 0 && (primary_ray_sampling_mode_ != PrimaryRaySampleMode::Pixel || ray_cones_)) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Primary hit cache requires pixel primary ray sampling mode without ray cones");
+        }
+        ris_candidates_ = json::value<int>(prop, "ris_candidates", 1);
+        if (ris_candidates_ < 1) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Number of RIS candidates must be >= 1 [ris_candidates='{}']", ris_candidates_);
+        }
+        split_ = json::value<int>(prop, "split", 1);
+        if (split_ < 1) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Number of splits must be >= 1 [split='{}']", split_);
+        }
     }
 
 public:
     virtual Json render() const override {
         scene_->require_renderable();
 
-        // Clear film
-        film_->clear();
+        // Clear film unless the scheduler continues an unfinished run
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
+        const auto pixel_size = Vec2(1_f / size.w, 1_f / size.h);
+        const bool aovs = film_->has_aovs();
         timer::ScopedTimer st;
 
-        // Execute parallel process
-        const auto processed = sched_->run([&](long long pixel_index, long long, int threadid) {
-            // Per-thread random number generator
-            thread_local Rng rng(seed_ ? *seed_ + threadid : math::rng_seed());
+        // Guiding distribution trained between the passes
+        SDTree sdtree;
+        bool guided_passes = false;     // True if the guiding distribution is available
+        long long num_passes = 0;
+        int num_guiding_iterations = 0;
+        if (guiding_) {
+            sdtree.init(scene_bound());
+        }
+
+        // Check if the direction at the vertex is sampled with the guiding distribution
+        const auto is_guided = [&](const SceneInteraction& sp, int comp) -> bool {
+            return guided_passes &&
+                sp.is_type(SceneInteraction::SurfaceInteraction) &&
+                !path::is_specular_component(scene_, sp, comp);
+        };
+
+        // PDF of the direction at the vertex in projected solid angle measure
+        // given the PDF of BSDF sampling p_bsdf
+        const auto mix_pdf_direction = [&](const SceneInteraction& sp, Vec3 wo, int comp, Float p_bsdf) -> Float {
+            if (!is_guided(sp, comp)) {
+                return p_bsdf;
+            }
+            const auto cos = std::abs(glm::dot(sp.geom.n, wo));
+            const auto p_guide = cos > 0_f ? sdtree.pdf(sp.geom.p, wo) / cos : 0_f;
+            return guiding_bsdf_fraction_ * p_bsdf + (1_f - guiding_bsdf_fraction_) * p_guide;
+        };
+        const auto pdf_direction = [&](const SceneInteraction& sp, Vec3 wi, Vec3 wo, int comp) -> Float {
+            return mix_pdf_direction(sp, wo, comp, path::pdf_direction(scene_, sp, wi, wo, comp, true));
+        };
+
+        // Process a sample.
+        // The process is instantiated for each configuration given by the compile-time constants
+        // so that the random walk contains no runtime checks of the modes.
+        RayStats ray_stats;
+        PrimaryHitCache primary_hits(primary_hit_cache_ > 0 ? (long long)(size.w) * size.h : 0, primary_hit_cache_);
+        const auto process = [&](auto sampling_mode, auto primary_mode, auto spectral, long long pixel_index, long long sample_index, int threadid) {
+            constexpr SamplingMode Sampling = decltype(sampling_mode)::value;
+            constexpr PrimaryRaySampleMode Primary = decltype(primary_mode)::value;
+            constexpr bool Spectral = decltype(spectral)::value;
+            LM_UNUSED(sampling_mode, primary_mode, spectral);
+
+            // Sample numbers of the sample
+            SampleStream smp(sampler_.get(), pixel_index, sample_index);
+            auto& stats = ray_stats.at(threadid);
+
+            // Sample numbers of the primary ray.
+            // With the primary hit cache, the primary rays of a pixel are restricted to
+            // the fixed sub-samples so that the first hits are reused in the later passes.
+            const bool cached_primary = Primary == PrimaryRaySampleMode::Pixel && primary_hit_cache_ > 0;
+            const long long subsample_index = cached_primary ? sample_index % primary_hit_cache_ : sample_index;
+            std::optional<SampleStream> smp_cached;
+            if (cached_primary) {
+                smp_cached.emplace(sampler_.get(), pixel_index, subsample_index);
+            }
+            auto& smp_primary = smp_cached ? *smp_cached : smp;
+
+            // Vertices of the path for training the guiding distribution
+            thread_local std::vector<GuidingVertex> guiding_verts;
+            guiding_verts.clear();
+            const auto record_contrb = [&](Vec3 C, int num_guiding_verts) {
+                for (int i = 0; i < num_guiding_verts; i++) {
+                    auto& v = guiding_verts[i];
+                    for (int k = 0; k < 3; k++) {
+                        if (v.throughput[k] > 0_f) {
+                            v.L[k] += C[k] / v.throughput[k];
+                        }
+                    }
+                }
+            };
+
+            // Record the incident radiance of the vertices from the given index and remove them
+            const auto record_guiding_verts = [&](size_t begin) {
+                for (size_t i = begin; i < guiding_verts.size(); i++) {
+                    const auto& v = guiding_verts[i];
+                    if (v.pdf > 0_f) {
+                        sdtree.record(v.p, v.wo, glm::compAdd(v.L) / 3_f / v.pdf);
+                    }
+                }
+                guiding_verts.resize(begin);
+            };
 
             // ------------------------------------------------------------------------------------
 
             // Sample window
             const auto window = [&]() -> Vec4 {
-                if (primary_ray_sampling_mode_ == PrimaryRaySampleMode::Pixel) {
+                if constexpr (Primary == PrimaryRaySampleMode::Pixel) {
                     const int x = int(pixel_index % size.w);
                     const int y = int(pixel_index / size.w);
                     const auto dx = 1_f / size.w;
@@ -108,210 +239,519 @@ public:
 
             // ------------------------------------------------------------------------------------
 
+            // Sample numbers for the position in the window.
+            // Low-discrepancy samplers stratify the first dimensions best.
+            const auto u_window = smp_primary.next<Vec2>();
+
+            // Wavelengths transported by the path in spectral mode
+            [[maybe_unused]] spectrum::Wavelengths wl{};
+            if constexpr (Spectral) {
+                wl = spectrum::Wavelengths::sample(smp.u());
+            }
+
+            // Convert the contribution of the path to RGB
+            const auto to_rgb = [&](Vec3 C) -> Vec3 {
+                if constexpr (Spectral) {
+                    return C * wl.weight();
+                }
+                else {
+                    return C;
+                }
+            };
+
+            // ------------------------------------------------------------------------------------
+
             // Sample initial vertex
-            const auto sE = path::sample_position(rng, scene_, TransDir::EL);
-            const auto sE_comp = path::sample_component(rng, scene_, sE->sp, {});
+            const auto sE = path::sample_position(smp_primary.next<path::PositionSampleU>(), scene_, TransDir::EL);
+            const auto sE_comp = path::sample_component(smp_primary.next<path::ComponentSampleU>(), scene_, sE->sp, {});
             auto sp = sE->sp;
             int comp = sE_comp.comp;
             auto throughput = sE->weight * sE_comp.weight;
+            stats.path();
 
             // ------------------------------------------------------------------------------------
 
             // Perform random walk
             Vec3 wi{};
             Vec2 raster_pos{};
-            for (int num_verts = 1; num_verts < max_verts_; num_verts++) {
-                // Sample NEE edge
-
-                // Flag indicating if the nee edge is samplable
-                const bool samplable_by_nee = [&]() {
-                    if (sampling_mode_ == SamplingMode::Naive) {
-                        // Skip if sampling mode is naive
-                        return false;
-                    }
-                    const auto is_specular = path::is_specular_component(scene_, sp, comp);
-                    if (primary_ray_sampling_mode_ == PrimaryRaySampleMode::Pixel) {
-                        // In pixel sampling mode, the nee edge is only samplable when nv>1
-                        return num_verts > 1 && !is_specular;
-                    }
-                    else {
-                        return !is_specular;
+            RayCone cone;
+
+            // Path splitting.
+            // The walk from the first scattering vertex is repeated split_ times
+            // with the throughput divided by the number of the splits,
+            // so that the cost of the primary ray and the camera vertex is amortized.
+            // The state of the path is saved at the split vertex and restored for the later splits.
+            int num_splits = 1;
+            struct SplitState {
+                SceneInteraction sp;
+                int comp;
+                Vec3 throughput;
+                Vec3 wi;
+                Vec2 raster_pos;
+                RayCone cone;
+                spectrum::Wavelengths wl;
+                size_t num_guiding_verts;
+            };
+            std::optional<SplitState> split_state;
+            for (int split_index = 0; split_index < num_splits; split_index++) {
+                if (split_index > 0) {
+                    // Record the vertices of the previous split and restore the path at the split vertex
+                    record_guiding_verts(split_state->num_guiding_verts);
+                    sp = split_state->sp;
+                    comp = split_state->comp;
+                    throughput = split_state->throughput;
+                    wi = split_state->wi;
+                    raster_pos = split_state->raster_pos;
+                    cone = split_state->cone;
+                    wl = split_state->wl;
+                }
+                for (int num_verts = split_state ? 2 : 1; num_verts < max_verts_; num_verts++) {
+                    // Split the path at the first scattering vertex
+                    if (num_verts == 2 && split_ > 1 && !split_state) {
+                        num_splits = split_;
+                        throughput /= Float(split_);
+                        split_state = SplitState{ sp, comp, throughput, wi, raster_pos, cone, wl, guiding_verts.size() };
                     }
-                }();
 
-                if (samplable_by_nee) [&]{
-                    // Sample a light
-                    const auto sL = path::sample_direct(rng, scene_, sp, TransDir::LE);
-                    if (!sL) {
-                        return;
-                    }
-                    if (!scene_->visible(sp, sL->sp)) {
-                        return;
-                    }
+                    // Sample NEE edge
 
-                    // Recompute raster position for the primary edge
-                    Vec2 rp = raster_pos;
-                    if (num_verts == 1) {
-                        const auto rp_ = path::raster_position(scene_, -sL->wo);
-                        if (!rp_) { return; }
-                        rp = *rp_;
-                    }
+                    // Flag indicating if the nee edge is samplable
+                    const bool samplable_by_nee = [&]() {
+                        if constexpr (Sampling == SamplingMode::Naive) {
+                            // Skip if sampling mode is naive
+                            return false;
+                        }
+                        else {
+                            const auto is_specular = path::is_specular_component(scene_, sp, comp);
+                            if constexpr (Primary == PrimaryRaySampleMode::Pixel) {
+                                // In pixel sampling mode, the nee edge is only samplable when nv>1
+                                return num_verts > 1 && !is_specular;
+                            }
+                            else {
+                                return !is_specular;
+                            }
+                        }
+                    }();
 
-                    // Evaluate BSDF
-                    const auto wo = -sL->wo;
-                    const auto fs = path::eval_contrb_direction(scene_, sp, wi, wo, comp, TransDir::EL, true);
-                    if (math::is_zero(fs)) {
-                        return;
-                    }
+                    if (samplable_by_nee) [&]{
+                        // Sample a light.
+                        // With resampled importance sampling (RIS), the candidates sampled by the light sampling
+                        // are streamed into a reservoir with the weights of the unshadowed contribution,
+                        // and the shadow ray is traced only for the selected candidate.
+                        // The contribution is scaled by ris_scale, which is the average weight of the candidates
+                        // divided by the weight of the selected one.
+                        Float ris_scale = 1_f;
+                        const auto sL = [&]() -> std::optional<path::RaySample> {
+                            if (ris_candidates_ == 1) {
+                                return path::sample_direct(smp.next<path::RaySampleU>(), scene_, sp, TransDir::LE);
+                            }
+                            std::optional<path::RaySample> selected;
+                            Float w_selected = 0_f;
+                            Float w_sum = 0_f;
+                            for (int i = 0; i < ris_candidates_; i++) {
+                                const auto c = path::sample_direct(smp.next<path::RaySampleU>(), scene_, sp, TransDir::LE);
+                                const auto u_sel = smp.u();
+                                if (!c) {
+                                    continue;
+                                }
+                                const auto fs_c = path::eval_contrb_direction(scene_, sp, wi, -c->wo, comp, TransDir::EL, true);
+                                const auto w = math::luminance(fs_c * c->weight);
+                                if (!(w > 0_f)) {
+                                    continue;
+                                }
+                                w_sum += w;
+                                if (u_sel * w_sum < w) {
+                                    selected = c;
+                                    w_selected = w;
+                                }
+                            }
+                            if (selected) {
+                                ris_scale = w_sum / (w_selected * ris_candidates_);
+                            }
+                            return selected;
+                        }();
+                        if (!sL) {
+                            return;
+                        }
+                        stats.shadow++;
+                        if (!scene_->visible(sp, sL->sp)) {
+                            return;
+                        }
 
-                    // Evaluate MIS weight
-                    const auto mis_w = [&]() -> Float {
-                        // Skip if sampling mode is NEE
-                        if (sampling_mode_ == SamplingMode::NEE) {
-                            return 1_f;
+                        // Recompute raster position for the primary edge
+                        Vec2 rp = raster_pos;
+                        if (num_verts == 1) {
+                            const auto rp_ = path::raster_position(scene_, sp.geom, -sL->wo);
+                            if (!rp_) { return; }
+                            rp = *rp_;
                         }
 
+                        // Check if MIS is used for the sampled light.
                         // When the light is not samplable by BSDF sampling, we will use only NEE.
                         // This includes, for instance, the light sampling for
                         // directional light, environment light, point light, etc.
-                        const bool is_specular_L = path::is_specular_component(scene_, sL->sp, {});
-                        const bool samplable_by_bsdf = !is_specular_L && !sL->sp.geom.degenerated;
-                        if (!samplable_by_bsdf) {
-                            return 1_f;
+                        const bool use_mis = [&]() -> bool {
+                            if constexpr (Sampling == SamplingMode::NEE) {
+                                return false;
+                            }
+                            else {
+                                const bool is_specular_L = path::is_specular_component(scene_, sL->sp, {});
+                                return !is_specular_L && !sL->sp.geom.degenerated;
+                            }
+                        }();
+
+                        // Evaluate BSDF.
+                        // The PDF for the MIS weight is evaluated at the same time.
+                        const auto wo = -sL->wo;
+                        const auto e = use_mis
+                            ? path::eval_contrb_pdf_direction(scene_, sp, wi, wo, comp, TransDir::EL, true)
+                            : path::DirectionEval{ path::eval_contrb_direction(scene_, sp, wi, wo, comp, TransDir::EL, true), 0_f };
+                        const auto fs = e.contrb;
+                        if (math::is_zero(fs)) {
+                            return;
                         }
 
-                        // MIS weight using balance heuristic
-                        const auto p_light = path::pdf_direct(scene_, sp, sL->sp, sL->wo, true);
-                        const auto p_bsdf = path::pdf_direction(scene_, sp, wi, wo, comp, true);
-                        return math::balance_heuristic(p_light, p_bsdf);
+                        // Evaluate MIS weight using balance heuristic.
+                        // Reuse the PDF of light sampling if available.
+                        const auto mis_w = [&]() -> Float {
+                            if (!use_mis) {
+                                return 1_f;
+                            }
+                            const auto p_light = sL->pdf > 0_f ? sL->pdf : path::pdf_direct(scene_, sp, sL->sp, sL->wo, true);
+                            const auto p_bsdf = mix_pdf_direction(sp, wo, comp, e.pdf);
+                            return math::balance_heuristic(p_light, p_bsdf);
+                        }();
+
+                        // Accumulate contribution
+                        const auto C = to_rgb(throughput * fs * sL->weight * (mis_w * ris_scale));
+                        film_->splat(rp, C);
+                        if (guiding_) {
+                            record_contrb(C, int(guiding_verts.size()));
+                        }
                     }();
 
-                    // Accumulate contribution
-                    const auto C = throughput * fs * sL->weight * mis_w;
-                    film_->splat(rp, C);
-                }();
+                    // --------------------------------------------------------------------------------
+
+                    // Sample direction.
+                    // PDF of the sampled direction is cached since it can be used multiple times.
+                    const bool guided = is_guided(sp, comp);
+                    std::optional<Float> pdf_sampled;
+                    const auto s = [&]() -> std::optional<path::DirectionSample> {
+                        if (guided) {
+                            // One-sample MIS of BSDF sampling and guided sampling
+                            const auto u_sel = smp.u();
+                            const auto u = smp.next<path::DirectionSampleU>();
+                            Vec3 wo;
+                            if (u_sel < guiding_bsdf_fraction_) {
+                                const auto s_bsdf = path::sample_direction(u, scene_, sp, wi, comp, TransDir::EL);
+                                if (!s_bsdf) {
+                                    return {};
+                                }
+                                wo = s_bsdf->wo;
+                            }
+                            else {
+                                wo = sdtree.sample(sp.geom.p, u.ud);
+                            }
+                            const auto e = path::eval_contrb_pdf_direction(scene_, sp, wi, wo, comp, TransDir::EL, false);
+                            const auto pdf = mix_pdf_direction(sp, wo, comp, e.pdf);
+                            if (pdf <= 0_f) {
+                                return {};
+                            }
+                            pdf_sampled = pdf;
+                            return path::DirectionSample{ wo, e.contrb / pdf };
+                        }
+                        else if (num_verts == 1) {
+                            const auto [x, y, w, h] = window.data.data;
+                            const auto ud = Vec2(x+w*u_window.x, y+h*u_window.y);
+                            return path::sample_direction({ ud, smp_primary.next<Vec2>() }, scene_, sp, wi, comp, TransDir::EL);
+                        }
+                        else {
+                            const auto u = smp.next<path::DirectionSampleU>();
+                            if constexpr (Spectral) {
+                                if (path::is_dispersive_component(scene_, sp, comp)) {
+                                    // Keep only the hero wavelength used to sample the direction
+                                    wl.terminate_secondary();
+                                    return path::sample_direction_spectral(u, scene_, sp, wi, comp, TransDir::EL, wl.hero());
+                                }
+                            }
+                            return path::sample_direction(u, scene_, sp, wi, comp, TransDir::EL);
+                        }
+                    }();
+                    if (!s) {
+                        break;
+                    }
+                    const auto pdf_sampled_direction = [&]() -> Float {
+                        if (!pdf_sampled) {
+                            pdf_sampled = pdf_direction(sp, wi, s->wo, comp);
+                        }
+                        return *pdf_sampled;
+                    };
 
-                // --------------------------------------------------------------------------------
+                    // --------------------------------------------------------------------------------
 
-                // Sample direction
-                const auto s = [&]() -> std::optional<path::DirectionSample> {
+                    // Compute and cache raster position
                     if (num_verts == 1) {
-                        const auto [x, y, w, h] = window.data.data;
-                        const auto ud = Vec2(x+w*rng.u(), y+h*rng.u());
-                        return path::sample_direction({ ud, rng.next<Vec2>() }, scene_, sp, wi, comp, TransDir::EL);
-                    }
-                    else {
-                        return path::sample_direction(rng, scene_, sp, wi, comp, TransDir::EL);
+                        raster_pos = *path::raster_position(scene_, sp.geom, s->wo);
+                        if (ray_cones_) {
+                            cone = path::primary_ray_cone(scene_, raster_pos, pixel_size);
+                        }
                     }
-                }();
-                if (!s) {
-                    break;
-                }
 
-                // --------------------------------------------------------------------------------
-
-                // Compute and cache raster position
-                if (num_verts == 1) {
-                    raster_pos = *path::raster_position(scene_, s->wo);
-                }
-
-                // --------------------------------------------------------------------------------
+                    // --------------------------------------------------------------------------------
+
+                    // Intersection to next surface
+                    const auto hit = ray_cones_
+                        ? scene_->intersect_cone({ sp.geom.p, s->wo }, cone)
+                        : cached_primary && num_verts == 1
+                        ? primary_hits.intersect(scene_, { sp.geom.p, s->wo }, pixel_index, subsample_index)
+                        : scene_->intersect({ sp.geom.p, s->wo });
+                    stats.extension(num_verts == 1, bool(hit));
+                    if (aovs && num_verts == 1) {
+                        path::splat_aovs(scene_, film_, raster_pos, sp.geom.p, hit ? &*hit : nullptr);
+                    }
+                    if (!hit) {
+                        break;
+                    }
 
-                // Intersection to next surface
-                const auto hit = scene_->intersect({ sp.geom.p, s->wo });
-                if (!hit) {
-                    break;
-                }
+                    // --------------------------------------------------------------------------------
 
-                // --------------------------------------------------------------------------------
+                    // Update throughput
+                    throughput *= s->weight;
 
-                // Update throughput
-                throughput *= s->weight;
+                    // Record the vertex for training the guiding distribution
+                    if (guiding_ && sp.is_type(SceneInteraction::SurfaceInteraction) && !path::is_specular_component(scene_, sp, comp)) {
+                        const auto cos = std::abs(glm::dot(sp.geom.n, s->wo));
+                        guiding_verts.push_back({ sp.geom.p, s->wo, throughput, pdf_sampled_direction() * cos, Vec3(0_f) });
+                    }
 
-                // --------------------------------------------------------------------------------
+                    // --------------------------------------------------------------------------------
 
-                // Contribution from direct hit against a light
+                    // Contribution from direct hit against a light
 
-                // Flag indicating if the light can be samplable by direct hit
-                const bool samplable_by_direct_hit = [&]() {
-                    if (sampling_mode_ == SamplingMode::NEE) {
-                        // Accumulate contribution from the direct hit only when a NEE edge is not samplable
-                        return !samplable_by_nee;
-                    }
-                    else {
-                        return true;
-                    }
-                }();
-
-                if (samplable_by_direct_hit && scene_->is_light(*hit)) [&]{
-                    // Compute contribution from the direct hit
-                    const auto spL = hit->as_type(SceneInteraction::LightEndpoint);
-                    const auto woL = -s->wo;
-                    const auto fs = path::eval_contrb_direction(scene_, spL, {}, woL, comp, TransDir::LE, true);
-                    const auto mis_w = [&]() -> Float {
-                        // Skip if sampling mode is naive
-                        if (sampling_mode_ == SamplingMode::Naive) {
-                            return 1_f;
+                    // Flag indicating if the light can be samplable by direct hit
+                    const bool samplable_by_direct_hit = [&]() {
+                        if constexpr (Sampling == SamplingMode::NEE) {
+                            // Accumulate contribution from the direct hit only when a NEE edge is not samplable
+                            return !samplable_by_nee;
                         }
-
-                        // The weight is one if the hit cannot be sampled by nee
-                        if (!samplable_by_nee) {
-                            return 1_f;
+                        else {
+                            return true;
                         }
-
-                        // MIS weight using balance heuristic
-                        const auto pdf_bsdf = path::pdf_direction(scene_, sp, wi, s->wo, comp, true);
-                        const auto pdf_light = path::pdf_direct(scene_, sp, spL, woL, true);
-                        return math::balance_heuristic(pdf_bsdf, pdf_light);
                     }();
 
-                    // Accumulate contribution
-                    const auto C = throughput * fs * mis_w;
-                    film_->splat(raster_pos, C);
-                }();
+                    if (samplable_by_direct_hit && scene_->is_light(*hit)) [&]{
+                        // Compute contribution from the direct hit
+                        const auto spL = hit->as_type(SceneInteraction::LightEndpoint);
+                        const auto woL = -s->wo;
+                        const auto fs = path::eval_contrb_direction(scene_, spL, {}, woL, comp, TransDir::LE, true);
+                        const auto mis_w = [&]() -> Float {
+                            // Skip if sampling mode is naive
+                            if constexpr (Sampling == SamplingMode::Naive) {
+                                return 1_f;
+                            }
+                            else {
+                                // The weight is one if the hit cannot be sampled by nee
+                                if (!samplable_by_nee) {
+                                    return 1_f;
+                                }
+
+                                // MIS weight using balance heuristic
+                                const auto pdf_bsdf = pdf_sampled_direction();
+                                const auto pdf_light = path::pdf_direct(scene_, sp, spL, woL, true);
+                                return math::balance_heuristic(pdf_bsdf, pdf_light);
+                            }
+                        }();
+
+                        // Accumulate contribution
+                        const auto C = to_rgb(throughput * fs * mis_w);
+                        film_->splat(raster_pos, C);
+                        if (guiding_) {
+                            record_contrb(C, int(guiding_verts.size()));
+                        }
+                    }();
                 
-                // --------------------------------------------------------------------------------
+                    // --------------------------------------------------------------------------------
 
-                // Termination on a hit with environment
-                if (hit->geom.infinite) {
-                    break;
-                }
+                    // Termination on a hit with environment
+                    if (hit->geom.infinite) {
+                        break;
+                    }
 
-                // Russian roulette
-                if (num_verts > 5) {
-                    const auto q = glm::max(.2_f, 1_f - glm::compMax(throughput));
-                    if (rng.u() < q) {
+                    // Russian roulette
+                    if (!roulette::survive(roulette_.get(), smp.u(), throughput, num_verts)) {
                         break;
                     }
-                    throughput /= 1_f - q;
-                }
 
-                // --------------------------------------------------------------------------------
+                    // --------------------------------------------------------------------------------
 
-                // Sample component
-                const auto s_comp = path::sample_component(rng, scene_, *hit, -s->wo);
-                throughput *= s_comp.weight;
+                    // Sample component
+                    const auto s_comp = path::sample_component(smp.next<path::ComponentSampleU>(), scene_, *hit, -s->wo);
+                    throughput *= s_comp.weight;
 
-                // --------------------------------------------------------------------------------
+                    // --------------------------------------------------------------------------------
 
-                // Update information
-                wi = -s->wo;
-                sp = *hit;
-                comp = s_comp.comp;
+                    // Update information.
+                    // The spread angle of the cone is kept at the scattering as if the surface is planar,
+                    // so the footprint never gets wider than the one of the specular paths.
+                    if (ray_cones_) {
+                        cone = cone.propagate(glm::distance(sp.geom.p, hit->geom.p));
+                    }
+                    wi = -s->wo;
+                    sp = *hit;
+                    comp = s_comp.comp;
+                }
             }
+
+            // Record the incident radiance of the vertices
+            record_guiding_verts(0);
+        };
+
+        // Callback function called at the end of each pass
+        const auto end_pass = [&](long long processed) {
+            // Publish snapshot of the film for progressive rendering
+            film_->publish(scale(processed));
+
+            // Refine the guiding distribution after the passes of doubling lengths
+            num_passes++;
+            if (guiding_ && (num_passes & (num_passes - 1)) == 0) {
+                sdtree.refine(
+                    guiding_spatial_threshold_ * std::sqrt(Float(num_passes)),
+                    guiding_directional_threshold_);
+                guided_passes = true;
+                num_guiding_iterations++;
+                LM_INFO("Refined guiding distribution [iteration={}, spatial_nodes={}]",
+                    num_guiding_iterations, sdtree.num_spatial_nodes());
+            }
+        };
+
+        // Execute parallel process with the process specialized for the configuration
+        const auto processed = dispatch([&](auto sampling_mode, auto primary_mode, auto spectral) {
+            return sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
+                process(sampling_mode, primary_mode, spectral, pixel_index, sample_index, threadid);
+            }, end_pass);
         });
 
         // ----------------------------------------------------------------------------------------
         
         // Rescale film
-        if (primary_ray_sampling_mode_ == PrimaryRaySampleMode::Pixel) {
-            film_->rescale(1_f / processed);
+        film_->rescale(scale(processed));
+
+        const auto elapsed = st.now();
+        return profiler::attach_stats({
+            {"processed", processed},
+            {"elapsed", elapsed},
+            {"ray_stats", ray_stats.to_json(elapsed)}
+        });
+    }
+
+private:
+    // Vertex of the path recorded for training the guiding distribution
+    struct GuidingVertex {
+        Vec3 p;             // Position
+        Vec3 wo;            // Sampled direction
+        Vec3 throughput;    // Path throughput including the sampled direction
+        Float pdf;          // PDF of the sampled direction in solid angle measure
+        Vec3 L;             // Incident radiance from the sampled direction
+    };
+
+    // Cache of the first hits of the primary rays for the fixed sub-samples of the pixels.
+    // An entry is filled by the first trace of the sub-sample and reused by the later passes.
+    // The entries keep the compact records of the hits, from which the scene interactions are reconstructed.
+    class PrimaryHitCache {
+    private:
+        static constexpr std::uint8_t Empty = 0;
+        static constexpr std::uint8_t Writing = 1;
+        static constexpr std::uint8_t Found = 2;
+        static constexpr std::uint8_t Missed = 3;
+        struct Entry {
+            Scene::Hit hit;
+            std::atomic<std::uint8_t> state;
+        };
+        std::unique_ptr<Entry[]> entries_;
+        int num_subsamples_;
+
+    public:
+        PrimaryHitCache(long long num_pixels, int num_subsamples)
+            : num_subsamples_(num_subsamples)
+        {
+            if (num_pixels > 0 && num_subsamples > 0) {
+                entries_ = std::make_unique<Entry[]>(num_pixels * num_subsamples);
+            }
         }
-        else {
-            film_->rescale(Float(size.w * size.h) / processed);
+
+        // Find the intersection of the primary ray of the sub-sample of the pixel.
+        // The ray must be the same for the sub-sample.
+        std::optional<SceneInteraction> intersect(const Scene* scene, Ray ray, long long pixel_index, long long subsample_index) {
+            auto& e = entries_[pixel_index * num_subsamples_ + subsample_index];
+            const auto state = e.state.load(std::memory_order_acquire);
+            if (state == Found) {
+                return scene->interaction(ray, e.hit);
+            }
+            if (state == Missed) {
+                return {};
+            }
+            const auto hit = scene->intersect_hit(ray);
+            auto expected = Empty;
+            if (e.state.compare_exchange_strong(expected, Writing, std::memory_order_relaxed)) {
+                if (hit) {
+                    e.hit = *hit;
+                }
+                e.state.store(hit ? Found : Missed, std::memory_order_release);
+            }
+            if (!hit) {
+                return {};
+            }
+            return scene->interaction(ray, *hit);
         }
+    };
+
+    // Bound of the primitives in the scene
+    Bound scene_bound() const {
+        Bound bound;
+        scene_->traverse_primitive_nodes([&](const SceneNode& node, Mat4 global_transform) {
+            if (node.type != SceneNodeType::Primitive || !node.primitive.mesh) {
+                return;
+            }
+            node.primitive.mesh->foreach_triangle([&](int, const Mesh::Tri& tri) {
+                for (const auto* p : { &tri.p1, &tri.p2, &tri.p3 }) {
+                    bound = merge(bound, Vec3(global_transform * Vec4(p->p, 1_f)));
+                }
+            });
+        });
+        return bound;
+    }
 
-        return { {"processed", processed}, {"elapsed", st.now()} };
+    // Call func with the configuration of the renderer as compile-time constants.
+    // func returns the number of processed samples.
+    template <typename Func>
+    long long dispatch(Func&& func) const {
+        const auto with_spectral = [&](auto sampling_mode, auto primary_mode) {
+            return spectral_
+                ? func(sampling_mode, primary_mode, std::true_type{})
+                : func(sampling_mode, primary_mode, std::false_type{});
+        };
+        const auto with_primary = [&](auto sampling_mode) {
+            using P = PrimaryRaySampleMode;
+            return primary_ray_sampling_mode_ == P::Pixel
+                ? with_spectral(sampling_mode, std::integral_constant<P, P::Pixel>{})
+                : with_spectral(sampling_mode, std::integral_constant<P, P::Image>{});
+        };
+        using S = SamplingMode;
+        switch (sampling_mode_) {
+            case S::Naive: return with_primary(std::integral_constant<S, S::Naive>{});
+            case S::NEE:   return with_primary(std::integral_constant<S, S::NEE>{});
+            case S::MIS:   return with_primary(std::integral_constant<S, S::MIS>{});
+        }
+        LM_UNREACHABLE_RETURN();
+    }
+
+    // Scale of the film given the processed samples
+    Float scale(long long processed) const {
+        if (primary_ray_sampling_mode_ == PrimaryRaySampleMode::Pixel) {
+            return 1_f / processed;
+        }
+        const auto size = film_->size();
+        return Float(size.w * size.h) / processed;
     }
 };
 
@@ -0,0 +1,625 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/renderer.h>
+#include <lm/scene.h>
+#include <lm/film.h>
+#include <lm/path.h>
+#include <lm/parallel.h>
+#include <lm/progress.h>
+#include <lm/timer.h>
+#include <lm/roulette.h>
+#include "raystats.h"
+#include "raysort.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: renderer::pt_wavefront
+
+    Wavefront path tracing.
+
+    :param str scene: Locator of the scene.
+    :param str output: Locator of the film.
+    :param int max_verts: Maximum number of path vertices.
+    :param int spp: Number of samples per pixel.
+    :param int num_paths: Number of paths processed simultaneously. Default value: 1048576.
+    :param int seed: Random seed. If not specified, the seed is chosen randomly.
+    :param str roulette: Name of the termination policy of the paths
+                         (see :cpp:class:`lm::Roulette`). Default value: ``throughput``.
+    :param str sort_rays: Order of the rays of the batched queries
+                          (``none``, ``octant``, or ``morton``). Default value: ``octant``.
+
+    This renderer computes the same estimate as ``renderer::pt``
+    with the MIS sampling mode and the pixel primary ray sampling mode,
+    but the paths are processed breadth-first [Laine2013]_.
+    The renderer keeps a pool of the path states stored in the structure-of-arrays layout
+    and executes the following stages for all the paths in the pool.
+
+    - *Extend*: Sorts the paths by the octants of the ray directions and
+      computes the next intersections with :cpp:func:`lm::Scene::intersect_n`.
+      With ``sort_rays`` set to ``morton``, the rays of the same octant are further sorted
+      by the Morton codes of the origins with a parallel radix sort, which improves the locality
+      of the traversal of the incoherent secondary rays in large scenes.
+      The shadow rays are sorted in the same way.
+    - *Shade*: Accumulates the contribution of the direct hit against the lights.
+      Then sorts the paths by the materials of the intersected points and
+      samples the components, the NEE edges, and the next directions
+      with the batched functions of the materials,
+      e.g., :cpp:func:`lm::Material::sample_direction_n`, for each chunk of the same material.
+    - *Shadow*: Tests the visibility of the NEE edges with :cpp:func:`lm::Scene::occluded_n`
+      and accumulates the contributions.
+
+    The terminated paths are removed from the pool and replaced with new paths.
+    Each batched query is issued for a chunk of coherent rays,
+    so that the acceleration structures supporting packet traversal (e.g., ``accel::embree``)
+    can make use of it.
+
+    .. [Laine2013] S. Laine, T. Karras, T. Aila, Megakernels Considered Harmful:
+                   Wavefront Path Tracing on GPUs, Proc. of HPG 2013.
+\endrst
+*/
+class Renderer_PT_Wavefront final : public Renderer {
+private:
+    // Number of rays or points processed by a batched query
+    static constexpr int ChunkSize = 256;
+
+    // Order of the rays of the batched queries
+    enum class RaySort {
+        None,       // Order of the paths
+        Octant,     // Octants of the directions
+        Morton,     // Octants of the directions and Morton codes of the origins
+    };
+
+    // Range of the sorted paths sharing the same material
+    struct MaterialChunk {
+        int begin;
+        int end;
+        const Material* material;
+    };
+
+    // Per-thread buffers for the batched material queries
+    struct MaterialBuffers {
+        std::vector<PointGeometry> geom;
+        std::vector<Vec3> wi;
+        std::vector<Vec3> wo;
+        std::vector<int> comp;
+        std::vector<int> index;
+        std::vector<Material::ComponentSampleU> uc;
+        std::vector<Material::ComponentSample> cs;
+        std::vector<Material::DirectionSampleU> ud;
+        std::vector<std::optional<Material::DirectionSample>> ds;
+        std::vector<path::RaySample> sL;
+        std::vector<Vec3> f;
+
+        void resize(int n) {
+            geom.resize(n);
+            wi.resize(n);
+            wo.resize(n);
+            comp.resize(n);
+            index.resize(n);
+            uc.resize(n);
+            cs.resize(n);
+            ud.resize(n);
+            ds.resize(n);
+            sL.resize(n);
+            f.resize(n);
+        }
+    };
+
+    // Path states in structure-of-arrays layout indexed by slots of the pool
+    struct PathStates {
+        std::vector<Rng> rng;                                   // Random number generator
+        std::vector<Ray> ray;                                   // Ray to the next vertex
+        std::vector<Vec3> throughput;                           // Path throughput
+        std::vector<Vec2> raster_pos;                           // Raster position
+        std::vector<int> num_verts;                             // Number of vertices
+        std::vector<SceneInteraction> sp;                       // Current vertex
+        std::vector<Vec3> wi;                                   // Incident direction at the current vertex
+        std::vector<int> comp;                                  // Component of the current vertex
+        std::vector<char> samplable_by_nee;                     // True if the current vertex is samplable by NEE
+        std::vector<char> alive;                                // True if the path is not terminated
+        std::vector<std::optional<SceneInteraction>> hit;       // Next vertex
+
+        // Shadow rays
+        std::vector<char> has_shadow;                           // True if the path has the shadow ray
+        std::vector<Ray> shadow_ray;                            // Shadow ray
+        std::vector<Float> shadow_tmax;                         // Upper bound of the shadow ray
+        std::vector<Vec3> shadow_contrb;                        // Contribution if the shadow ray is not occluded
+
+        void resize(int n) {
+            rng.resize(n);
+            ray.resize(n);
+            throughput.resize(n);
+            raster_pos.resize(n);
+            num_verts.resize(n);
+            sp.resize(n);
+            wi.resize(n);
+            comp.resize(n);
+            samplable_by_nee.resize(n);
+            alive.resize(n);
+            hit.resize(n);
+            has_shadow.resize(n);
+            shadow_ray.resize(n);
+            shadow_tmax.resize(n);
+            shadow_contrb.resize(n);
+        }
+    };
+
+private:
+    Scene* scene_;                          // Reference to scene asset
+    Film* film_;                            // Reference to film asset for output
+    int max_verts_;                         // Maximum number of path vertices
+    long long spp_;                         // Number of samples per pixel
+    int num_paths_;                         // Size of the pool of the paths
+    std::optional<unsigned int> seed_;      // Random seed
+    Component::Ptr<Roulette> roulette_;     // Termination policy of the paths
+    RaySort sort_rays_;                     // Order of the rays of the batched queries
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(scene_, film_, max_verts_, spp_, num_paths_, seed_, roulette_, sort_rays_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, scene_);
+        comp::visit(visit, film_);
+        comp::visit(visit, roulette_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        scene_ = json::comp_ref<Scene>(prop, "scene");
+        film_ = json::comp_ref<Film>(prop, "output");
+        max_verts_ = json::value<int>(prop, "max_verts");
+        spp_ = json::value<long long>(prop, "spp");
+        num_paths_ = json::value<int>(prop, "num_paths", 1<<20);
+        seed_ = json::value_or_none<unsigned int>(prop, "seed");
+        {
+            const auto name = json::value<std::string>(prop, "roulette", "throughput");
+            roulette_ = comp::create<Roulette>("roulette::" + name, make_loc("roulette"), prop);
+        }
+        {
+            const auto sort_rays = json::value<std::string>(prop, "sort_rays", "octant");
+            if (sort_rays == "none") {
+                sort_rays_ = RaySort::None;
+            }
+            else if (sort_rays == "octant") {
+                sort_rays_ = RaySort::Octant;
+            }
+            else if (sort_rays == "morton") {
+                sort_rays_ = RaySort::Morton;
+            }
+            else {
+                LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid ray order [sort_rays='{}']", sort_rays);
+            }
+        }
+    }
+
+    virtual Json render() const override {
+        scene_->require_renderable();
+        film_->clear();
+        const auto size = film_->size();
+        const long long num_pixels = size.w * size.h;
+        const long long total = num_pixels * spp_;
+        const bool aovs = film_->has_aovs();
+        timer::ScopedTimer st;
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
+
+        // Pool of the paths
+        const int pool_size = int(std::min<long long>(num_paths_, total));
+        PathStates ps;
+        ps.resize(pool_size);
+        std::vector<int> active;                // Slots of the alive paths
+        std::vector<int> free_slots(pool_size);
+        for (int i = 0; i < pool_size; i++) {
+            free_slots[i] = pool_size - 1 - i;
+        }
+
+        // Contiguous buffers for the batched queries
+        std::vector<Ray> rays(pool_size);
+        std::vector<std::optional<SceneInteraction>> hits(pool_size);
+        std::vector<Float> tmaxs(pool_size);
+        std::unique_ptr<bool[]> occluded(new bool[pool_size]);
+
+        std::vector<int> sorted(pool_size);
+        RaySorter ray_sorter;
+        std::vector<int> shading;
+        std::vector<MaterialChunk> chunks;
+        std::vector<int> shadows;
+
+        // Indices of the materials of the primitive nodes.
+        // The materials are identified by the instances, which can be shared by the primitives.
+        std::vector<const Material*> materials;
+        std::vector<int> material_indices(scene_->num_nodes(), -1);
+        for (int i = 0; i < scene_->num_nodes(); i++) {
+            const auto& node = scene_->node_at(i);
+            if (node.type != SceneNodeType::Primitive || !node.primitive.material) {
+                continue;
+            }
+            const auto it = std::find(materials.begin(), materials.end(), node.primitive.material);
+            material_indices[i] = int(it - materials.begin());
+            if (it == materials.end()) {
+                materials.push_back(node.primitive.material);
+            }
+        }
+
+        // Statistics are updated only by the calling thread between the stages
+        RayStats ray_stats;
+        auto& stats = ray_stats.at(0);
+
+        progress::ScopedReport progress_(total);
+        long long generated = 0;
+        long long finished = 0;
+        std::vector<Vec2> new_rps;
+        std::vector<Vec2> new_ups;
+        std::vector<Ray> new_rays;
+        while (true) {
+            // Generate new paths for the free slots.
+            // The primary rays of the new paths are generated by the camera at once.
+            const int num_new = int(std::min<long long>(free_slots.size(), total - generated));
+            new_rps.resize(num_new);
+            new_ups.resize(num_new);
+            new_rays.resize(num_new);
+            for (int i = 0; i < num_new; i++) {
+                const int slot = free_slots[free_slots.size() - 1 - i];
+                generate_path(rng_base, ps, slot, generated + i);
+                new_rps[i] = ps.raster_pos[slot];
+                new_ups[i] = ps.rng[slot].next<Vec2>();
+                stats.path();
+            }
+            path::primary_rays(scene_, num_new, new_rps.data(), new_ups.data(), new_rays.data());
+            for (int i = 0; i < num_new; i++) {
+                const int slot = free_slots.back();
+                free_slots.pop_back();
+                active.push_back(slot);
+                ps.ray[slot] = new_rays[i];
+            }
+            generated += num_new;
+            if (active.empty()) {
+                break;
+            }
+            const int n = int(active.size());
+
+            // ------------------------------------------------------------------------------------
+
+            // Extend stage
+            // Sort the paths by the rays for the coherent traversal
+            sort_rays(ray_sorter, active, sorted, [&](int slot) { return ps.ray[slot]; });
+            for (int j = 0; j < n; j++) {
+                rays[j] = ps.ray[active[j]];
+            }
+            parallel::foreach((n + ChunkSize - 1) / ChunkSize, [&](long long chunk, int) {
+                const int offset = int(chunk) * ChunkSize;
+                const int m = std::min(ChunkSize, n - offset);
+                scene_->intersect_n(m, &rays[offset], Eps, Inf, &hits[offset]);
+            });
+            for (int j = 0; j < n; j++) {
+                const int slot = active[j];
+                stats.extension(ps.num_verts[slot] == 1, bool(hits[j]));
+                ps.hit[slot] = std::move(hits[j]);
+            }
+
+            // ------------------------------------------------------------------------------------
+
+            // Shade stage
+            // Accumulate the contributions of the direct hits and terminate the paths
+            parallel::foreach(n, [&](long long j, int) {
+                shade_hit(ps, active[j], aovs);
+            });
+
+            // Sort the surviving paths by the materials of the intersected points
+            shading.clear();
+            for (int slot : active) {
+                if (ps.alive[slot]) {
+                    shading.push_back(slot);
+                }
+            }
+            const auto material_of = [&](int slot) {
+                return material_indices[ps.hit[slot]->primitive];
+            };
+            sort_by_key(shading, sorted, int(materials.size()), material_of);
+
+            // Process the paths by chunks of the same material
+            chunks.clear();
+            for (int b = 0; b < int(shading.size());) {
+                const int material_index = material_of(shading[b]);
+                int e = b + 1;
+                while (e < int(shading.size()) && e - b < ChunkSize && material_of(shading[e]) == material_index) {
+                    e++;
+                }
+                chunks.push_back({ b, e, materials[material_index] });
+                b = e;
+            }
+            parallel::foreach(chunks.size(), [&](long long c, int) {
+                const auto& chunk = chunks[c];
+                shade_material(ps, &shading[chunk.begin], chunk.end - chunk.begin, chunk.material);
+            });
+
+            // ------------------------------------------------------------------------------------
+
+            // Shadow stage
+            shadows.clear();
+            for (int slot : active) {
+                if (ps.has_shadow[slot]) {
+                    shadows.push_back(slot);
+                }
+            }
+            if (sort_rays_ == RaySort::Morton) {
+                ray_sorter.sort(shadows, [&](int slot) { return ps.shadow_ray[slot]; });
+            }
+            const int num_shadows = int(shadows.size());
+            stats.shadow += num_shadows;
+            for (int j = 0; j < num_shadows; j++) {
+                rays[j] = ps.shadow_ray[shadows[j]];
+                tmaxs[j] = ps.shadow_tmax[shadows[j]];
+            }
+            parallel::foreach((num_shadows + ChunkSize - 1) / ChunkSize, [&](long long chunk, int) {
+                const int offset = int(chunk) * ChunkSize;
+                const int m = std::min(ChunkSize, num_shadows - offset);
+                scene_->occluded_n(m, &rays[offset], Eps, &tmaxs[offset], &occluded[offset]);
+                for (int j = offset; j < offset + m; j++) {
+                    if (occluded[j]) {
+                        continue;
+                    }
+                    const int slot = shadows[j];
+                    film_->splat(ps.raster_pos[slot], ps.shadow_contrb[slot]);
+                }
+            });
+
+            // ------------------------------------------------------------------------------------
+
+            // Remove terminated paths from the pool
+            int num_alive = 0;
+            for (int slot : active) {
+                if (ps.alive[slot]) {
+                    active[num_alive++] = slot;
+                }
+                else {
+                    free_slots.push_back(slot);
+                    finished++;
+                }
+            }
+            active.resize(num_alive);
+            progress::update(finished);
+        }
+
+        // Rescale film
+        film_->rescale(1_f / spp_);
+
+        const auto elapsed = st.now();
+        return profiler::attach_stats({
+            {"processed", total},
+            {"elapsed", elapsed},
+            {"ray_stats", ray_stats.to_json(elapsed)}
+        });
+    }
+
+private:
+    // Stable counting sort of the slots by keys in [0, num_keys)
+    template <typename KeyFunc>
+    void sort_by_key(std::vector<int>& slots, std::vector<int>& tmp, int num_keys, KeyFunc&& key) const {
+        thread_local std::vector<int> counts;
+        counts.assign(num_keys + 1, 0);
+        const int n = int(slots.size());
+        for (int j = 0; j < n; j++) {
+            counts[key(slots[j]) + 1]++;
+        }
+        for (int k = 0; k < num_keys; k++) {
+            counts[k+1] += counts[k];
+        }
+        for (int j = 0; j < n; j++) {
+            tmp[counts[key(slots[j])]++] = slots[j];
+        }
+        std::copy_n(tmp.begin(), n, slots.begin());
+    }
+
+    // Sort the slots by the rays according to the configured order
+    template <typename SlotToRay>
+    void sort_rays(RaySorter& sorter, std::vector<int>& slots, std::vector<int>& tmp, SlotToRay&& slot_to_ray) const {
+        if (sort_rays_ == RaySort::Morton) {
+            sorter.sort(slots, slot_to_ray);
+        }
+        else if (sort_rays_ == RaySort::Octant) {
+            sort_by_key(slots, tmp, 8, [&](int slot) {
+                const auto d = slot_to_ray(slot).d;
+                return (d.x < 0_f ? 1 : 0) | (d.y < 0_f ? 2 : 0) | (d.z < 0_f ? 4 : 0);
+            });
+        }
+    }
+
+    // Initialize the path state from the camera.
+    // The primary ray is generated afterwards from the raster position.
+    void generate_path(const Rng& rng_base, PathStates& ps, int slot, long long path_index) const {
+        const auto size = film_->size();
+        const long long pixel_index = path_index % (size.w * size.h);
+        const long long sample_index = path_index / (size.w * size.h);
+        auto& rng = ps.rng[slot];
+        rng = rng_base.split(pixel_index, sample_index);
+        const int x = int(pixel_index % size.w);
+        const int y = int(pixel_index / size.w);
+        const auto u = rng.next<Vec2>();
+        const Vec2 rp((x + u.x) / size.w, (y + u.y) / size.h);
+        ps.throughput[slot] = Vec3(1_f);
+        ps.raster_pos[slot] = rp;
+        ps.num_verts[slot] = 1;
+        ps.comp[slot] = 0;
+        ps.samplable_by_nee[slot] = false;
+        ps.alive[slot] = true;
+        ps.has_shadow[slot] = false;
+    }
+
+    // Process the intersected vertex of the path until the scattering at the vertex
+    void shade_hit(PathStates& ps, int slot, bool aovs) const {
+        auto& rng = ps.rng[slot];
+        auto& throughput = ps.throughput[slot];
+        const auto& hit = ps.hit[slot];
+        const auto& ray = ps.ray[slot];
+        const auto raster_pos = ps.raster_pos[slot];
+        ps.has_shadow[slot] = false;
+
+        if (aovs && ps.num_verts[slot] == 1) {
+            path::splat_aovs(scene_, film_, raster_pos, ray.o, hit ? &*hit : nullptr);
+        }
+        if (!hit) {
+            ps.alive[slot] = false;
+            return;
+        }
+
+        // Contribution from direct hit against a light
+        if (scene_->is_light(*hit)) {
+            const auto& sp = ps.sp[slot];
+            const auto spL = hit->as_type(SceneInteraction::LightEndpoint);
+            const auto woL = -ray.d;
+            const auto fs = path::eval_contrb_direction(scene_, spL, {}, woL, ps.comp[slot], TransDir::LE, true);
+            const auto mis_w = [&]() -> Float {
+                // The weight is one if the hit cannot be sampled by nee
+                if (!ps.samplable_by_nee[slot]) {
+                    return 1_f;
+                }
+                const auto pdf_bsdf = path::pdf_direction(scene_, sp, ps.wi[slot], ray.d, ps.comp[slot], true);
+                const auto pdf_light = path::pdf_direct(scene_, sp, spL, woL, true);
+                return math::balance_heuristic(pdf_bsdf, pdf_light);
+            }();
+            film_->splat(raster_pos, throughput * fs * mis_w);
+        }
+
+        // Termination on a hit with environment or with a primitive without material
+        if (hit->geom.infinite || !scene_->node_at(hit->primitive).primitive.material) {
+            ps.alive[slot] = false;
+            return;
+        }
+
+        // Russian roulette
+        if (!roulette::survive(roulette_.get(), rng.u(), throughput, ps.num_verts[slot])) {
+            ps.alive[slot] = false;
+        }
+    }
+
+    // Scatter the paths intersected with the same material with the batched material queries
+    void shade_material(PathStates& ps, const int* slots, int m, const Material* material) const {
+        thread_local MaterialBuffers b;
+        b.resize(m);
+
+        // Sample components
+        for (int k = 0; k < m; k++) {
+            const int slot = slots[k];
+            b.geom[k] = ps.hit[slot]->geom;
+            b.wi[k] = -ps.ray[slot].d;
+            b.uc[k] = ps.rng[slot].next<Material::ComponentSampleU>();
+        }
+        material->sample_component_n(m, b.uc.data(), b.geom.data(), b.wi.data(), b.cs.data());
+
+        // Move to the next vertex
+        for (int k = 0; k < m; k++) {
+            const int slot = slots[k];
+            ps.throughput[slot] *= b.cs[k].weight;
+            ps.sp[slot] = *ps.hit[slot];
+            ps.wi[slot] = b.wi[k];
+            ps.comp[slot] = b.cs[k].comp;
+            ps.num_verts[slot]++;
+            if (ps.num_verts[slot] >= max_verts_) {
+                ps.alive[slot] = false;
+            }
+        }
+
+        // Sample lights for NEE edges and evaluate BSDFs for the sampled edges
+        int num_nee = 0;
+        for (int k = 0; k < m; k++) {
+            const int slot = slots[k];
+            if (!ps.alive[slot]) {
+                continue;
+            }
+            const auto& sp = ps.sp[slot];
+            const bool samplable_by_nee = !material->is_specular_component(ps.comp[slot]);
+            ps.samplable_by_nee[slot] = samplable_by_nee;
+            if (!samplable_by_nee) {
+                continue;
+            }
+            const auto sL = path::sample_direct(ps.rng[slot], scene_, sp, TransDir::LE);
+            if (!sL) {
+                continue;
+            }
+            b.index[num_nee] = k;
+            b.sL[num_nee] = *sL;
+            b.geom[num_nee] = sp.geom;
+            b.wi[num_nee] = ps.wi[slot];
+            b.wo[num_nee] = -sL->wo;
+            b.comp[num_nee] = ps.comp[slot];
+            num_nee++;
+        }
+        material->eval_n(num_nee, b.geom.data(), b.wi.data(), b.wo.data(), b.comp.data(), Material::TransDir::EL, true, b.f.data());
+
+        // Queue shadow rays
+        for (int q = 0; q < num_nee; q++) {
+            const int slot = slots[b.index[q]];
+            const auto& sp = ps.sp[slot];
+            const auto& sL = b.sL[q];
+            const auto wi = b.wi[q];
+            const auto wo = b.wo[q];
+            const int comp = b.comp[q];
+            const auto fs = b.f[q] * surface::shading_normal_correction(sp.geom, wi, wo, TransDir::EL);
+            if (math::is_zero(fs)) {
+                continue;
+            }
+            const auto mis_w = [&]() -> Float {
+                const bool is_specular_L = path::is_specular_component(scene_, sL.sp, {});
+                const bool samplable_by_bsdf = !is_specular_L && !sL.sp.geom.degenerated;
+                if (!samplable_by_bsdf) {
+                    return 1_f;
+                }
+                const auto p_light = sL.pdf > 0_f ? sL.pdf : path::pdf_direct(scene_, sp, sL.sp, sL.wo, true);
+                const auto p_bsdf = path::pdf_direction(scene_, sp, wi, wo, comp, true);
+                return math::balance_heuristic(p_light, p_bsdf);
+            }();
+
+            // See lm::Scene::visible() for the computation of the segment
+            if (sL.sp.geom.infinite) {
+                ps.shadow_ray[slot] = { sp.geom.p, -sL.sp.geom.wo };
+                ps.shadow_tmax[slot] = Inf - 1_f;
+            }
+            else {
+                ps.shadow_ray[slot] = { sp.geom.p, glm::normalize(sL.sp.geom.p - sp.geom.p) };
+                ps.shadow_tmax[slot] = glm::distance(sp.geom.p, sL.sp.geom.p) * (1_f - Eps);
+            }
+            ps.shadow_contrb[slot] = ps.throughput[slot] * fs * sL.weight * mis_w;
+            ps.has_shadow[slot] = true;
+        }
+
+        // Sample directions
+        int num_dirs = 0;
+        for (int k = 0; k < m; k++) {
+            const int slot = slots[k];
+            if (!ps.alive[slot]) {
+                continue;
+            }
+            b.index[num_dirs] = k;
+            b.geom[num_dirs] = ps.sp[slot].geom;
+            b.wi[num_dirs] = ps.wi[slot];
+            b.comp[num_dirs] = ps.comp[slot];
+            b.ud[num_dirs] = ps.rng[slot].next<Material::DirectionSampleU>();
+            num_dirs++;
+        }
+        material->sample_direction_n(num_dirs, b.ud.data(), b.geom.data(), b.wi.data(), b.comp.data(), Material::TransDir::EL, b.ds.data());
+        for (int q = 0; q < num_dirs; q++) {
+            const int slot = slots[b.index[q]];
+            const auto& s = b.ds[q];
+            if (!s) {
+                ps.alive[slot] = false;
+                continue;
+            }
+            const auto sn_corr = surface::shading_normal_correction(b.geom[q], b.wi[q], s->wo, TransDir::EL);
+            ps.throughput[slot] *= s->weight * sn_corr;
+            ps.ray[slot] = { b.geom[q].p, s->wo };
+        }
+    }
+};
+
+LM_COMP_REG_IMPL(Renderer_PT_Wavefront, "renderer::pt_wavefront");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
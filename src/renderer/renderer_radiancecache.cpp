@@ -0,0 +1,417 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/renderer.h>
+#include <lm/scene.h>
+#include <lm/film.h>
+#include <lm/path.h>
+#include <lm/parallel.h>
+#include <lm/progress.h>
+#include <lm/timer.h>
+#include <lm/roulette.h>
+#include "hashgrid.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: renderer::radiancecache
+
+    Preview renderer with a sparse radiance cache.
+
+    :param str scene: Locator of the scene.
+    :param str output: Locator of the film.
+    :param int max_verts: Maximum number of path vertices.
+    :param int num_iterations: Number of iterations. Default value: unlimited.
+    :param float render_time: Time limit of the rendering in seconds. Default value: unlimited.
+    :param float radius: Radius of the records of the cache.
+                         Default value: 1% of the diagonal of the bound of the visible points
+                         in the first iteration.
+    :param int record_samples: Number of paths traced from each record in each iteration. Default value: 4.
+    :param bool biased: Interpolates the indirect illumination from the cache. Default value: ``true``.
+    :param int seed: Random seed. If not specified, the seed is chosen randomly.
+    :param str roulette: Name of the termination policy of the paths
+                         (see :cpp:class:`lm::Roulette`). Default value: ``throughput``.
+
+    This renderer gives fast previews of the lighting of the scenes dominated by diffuse
+    interreflections, e.g., interior scenes, at the cost of bias.
+    Each iteration traces a path from each pixel through the specular surfaces
+    to the visible point at the first non-specular surface.
+    The direct illumination at the visible point is estimated by the next event estimation,
+    and the indirect illumination is interpolated from the records of the cache
+    within the radius with the similar normals.
+    The records are created at the visible points not covered by the cache,
+    at most one per cell of the size of the radius,
+    and store the outgoing indirect radiance estimated by path tracing.
+    The records are registered to a hash grid rebuilt in parallel after each iteration.
+    The estimates of all records are refined in parallel by ``record_samples`` paths in each iteration,
+    so that the noise of the preview decreases progressively.
+    The current estimate is written to the film and published as the snapshot after each iteration.
+
+    The cache assumes the outgoing radiance is independent of the direction,
+    and the details of the indirect illumination smaller than the radius are blurred.
+    ``biased`` set to ``false`` disables the interpolation
+    and the indirect illumination is estimated by path tracing for each pixel,
+    which gives the unbiased reference of the same configuration.
+    The result of :cpp:func:`lm::Renderer::render` contains ``biased``, ``records``, and ``iterations``.
+\endrst
+*/
+class Renderer_RadianceCache final : public Renderer {
+private:
+    // Record of the cache
+    struct Record {
+        SceneInteraction sp;    // Position of the record
+        Vec3 wi;                // Outgoing direction
+        int comp;               // Component at the record
+        int num_verts;          // Number of vertices of the eye path to the record
+        Vec3 sum{};             // Accumulated indirect radiance
+        long long n = 0;        // Number of accumulated paths
+    };
+
+    // Visible point of a pixel
+    struct VisiblePoint {
+        bool valid = false;
+        SceneInteraction sp;
+        Vec3 wi;
+        int comp;
+        int num_verts;
+        Vec3 beta;
+    };
+
+    // Minimum cosine between the normals of the visible point and the interpolated records
+    static constexpr Float MinNormalCos = .9_f;
+
+private:
+    Scene* scene_;                          // Reference to scene asset
+    Film* film_;                            // Reference to film asset for output
+    int max_verts_;                         // Maximum number of path vertices
+    std::optional<int> num_iterations_;     // Number of iterations
+    std::optional<Float> render_time_;      // Time limit
+    std::optional<Float> radius_;           // Radius of the records
+    int record_samples_;                    // Number of paths per record per iteration
+    bool biased_;                           // Interpolates the indirect illumination from the cache
+    std::optional<unsigned int> seed_;      // Random seed
+    Component::Ptr<Roulette> roulette_;     // Termination policy of the paths
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(scene_, film_, max_verts_, num_iterations_, render_time_, radius_, record_samples_, biased_, seed_, roulette_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, scene_);
+        comp::visit(visit, film_);
+        comp::visit(visit, roulette_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        scene_ = json::comp_ref<Scene>(prop, "scene");
+        film_ = json::comp_ref<Film>(prop, "output");
+        max_verts_ = json::value<int>(prop, "max_verts");
+        num_iterations_ = json::value_or_none<int>(prop, "num_iterations");
+        render_time_ = json::value_or_none<Float>(prop, "render_time");
+        if (!num_iterations_ && !render_time_) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Either num_iterations or render_time must be specified.");
+        }
+        radius_ = json::value_or_none<Float>(prop, "radius");
+        record_samples_ = json::value<int>(prop, "record_samples", 4);
+        if (record_samples_ <= 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Number of samples per record must be > 0 [record_samples='{}']", record_samples_);
+        }
+        biased_ = json::value<bool>(prop, "biased", true);
+        seed_ = json::value_or_none<unsigned int>(prop, "seed");
+        {
+            const auto name = json::value<std::string>(prop, "roulette", "throughput");
+            roulette_ = comp::create<Roulette>("roulette::" + name, make_loc("roulette"), prop);
+        }
+    }
+
+    virtual Json render() const override {
+        scene_->require_renderable();
+        film_->clear();
+        const auto size = film_->size();
+        const int num_pixels = size.w * size.h;
+        timer::ScopedTimer st;
+
+        // Base random number generator. Each path uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
+
+        std::vector<VisiblePoint> vps(num_pixels);
+        std::vector<Vec3> Ls(num_pixels, Vec3(0_f));    // Accumulated radiance of the pixels
+        std::vector<Record> records;
+        HashGrid grid;
+        Float radius = radius_ ? *radius_ : 0_f;
+
+        // Progress is reported by iterations or by time
+        std::optional<progress::ScopedReport> progress_ctx_;
+        std::optional<progress::ScopedTimeReport> progress_time_ctx_;
+        if (render_time_) {
+            progress_time_ctx_.emplace(*render_time_);
+        }
+        else {
+            progress_ctx_.emplace(*num_iterations_);
+        }
+
+        int it = 0;
+        while (true) {
+            if (num_iterations_ && it >= *num_iterations_) {
+                break;
+            }
+            if (render_time_ && st.now() >= *render_time_) {
+                break;
+            }
+
+            // Trace eye paths and find visible points
+            parallel::foreach(num_pixels, [&](long long i, int) {
+                auto rng = rng_base.split(i, 3*it);
+                Ls[i] += trace_eye_path(rng, int(i), vps[i]);
+            });
+
+            if (biased_) {
+                // Radius from the extent of the visible points
+                if (radius == 0_f) {
+                    Bound b;
+                    for (const auto& vp : vps) {
+                        if (vp.valid) {
+                            b = merge(b, vp.sp.geom.p);
+                        }
+                    }
+                    radius = b.min.x <= b.max.x ? glm::length(b.max - b.min) * .01_f : 1_f;
+                    if (radius == 0_f) {
+                        radius = 1_f;
+                    }
+                }
+
+                // Create the records at the visible points not covered by the cache.
+                // The candidates are thinned out to one per cell of the size of the radius.
+                std::vector<char> covered(num_pixels, 0);
+                parallel::foreach(num_pixels, [&](long long i, int) {
+                    covered[i] = !vps[i].valid || bool(interpolate(grid, records, radius, vps[i].sp));
+                });
+                const auto num_old_records = records.size();
+                std::unordered_set<long long> cells;
+                for (int i = 0; i < num_pixels; i++) {
+                    if (covered[i]) {
+                        continue;
+                    }
+                    const auto& vp = vps[i];
+                    if (!cells.insert(cell_key(vp.sp, radius)).second) {
+                        continue;
+                    }
+                    records.push_back({ vp.sp, vp.wi, vp.comp, vp.num_verts });
+                }
+
+                // Refine the records
+                parallel::foreach((long long)(records.size()), [&](long long j, int) {
+                    auto rng = rng_base.split(j, 3*it + 1);
+                    auto& r = records[j];
+                    for (int k = 0; k < record_samples_; k++) {
+                        r.sum += trace_radiance(rng, r.sp, r.wi, r.comp, r.num_verts, false);
+                    }
+                    r.n += record_samples_;
+                });
+                grid.build(int(records.size()), radius, [&](int j) {
+                    return records[j].sp.geom.p;
+                });
+                if (records.size() > num_old_records) {
+                    LM_DEBUG("Created records [new={}, total={}]", records.size() - num_old_records, records.size());
+                }
+            }
+
+            // Indirect illumination at the visible points
+            parallel::foreach(num_pixels, [&](long long i, int) {
+                const auto& vp = vps[i];
+                if (!vp.valid) {
+                    return;
+                }
+                auto rng = rng_base.split(i, 3*it + 2);
+                const auto L = biased_ ? interpolate(grid, records, radius, vp.sp) : std::nullopt;
+                Ls[i] += vp.beta * (L ? *L : trace_radiance(rng, vp.sp, vp.wi, vp.comp, vp.num_verts, false));
+            });
+
+            // Write the current estimate
+            const int num_iterations = it + 1;
+            parallel::foreach(num_pixels, [&](long long i, int) {
+                film_->set_pixel(int(i % size.w), int(i / size.w), Ls[i] / Float(num_iterations));
+            });
+            film_->publish(1_f);
+
+            it++;
+            if (render_time_) {
+                progress::update_time(st.now());
+            }
+            else {
+                progress::update(it);
+            }
+        }
+
+        return profiler::attach_stats({
+            {"processed", (long long)(it) * num_pixels},
+            {"iterations", it},
+            {"records", records.size()},
+            {"biased", biased_},
+            {"elapsed", st.now()}
+        });
+    }
+
+private:
+    // Key of the cell of the record candidates.
+    // The sign of the dominant axis of the normal separates the surfaces in the same cell.
+    long long cell_key(const SceneInteraction& sp, Float radius) const {
+        const auto c = glm::tvec3<long long>(glm::floor(sp.geom.p / radius));
+        const auto n = sp.geom.n;
+        const auto a = glm::abs(n);
+        const int axis = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+        const int side = 2 * axis + (n[axis] < 0_f ? 1 : 0);
+        return ((c.x * 73856093LL) ^ (c.y * 19349663LL) ^ (c.z * 83492791LL)) * 8 + side;
+    }
+
+    // Interpolate the indirect radiance at sp from the records.
+    // The records are weighted by the distance and the similarity of the normals.
+    std::optional<Vec3> interpolate(const HashGrid& grid, const std::vector<Record>& records, Float radius, const SceneInteraction& sp) const {
+        Vec3 sum(0_f);
+        Float weight = 0_f;
+        grid.query(sp.geom.p, [&](int j) {
+            const auto& r = records[j];
+            const auto cos = glm::dot(r.sp.geom.n, sp.geom.n);
+            if (r.n == 0 || cos < MinNormalCos) {
+                return;
+            }
+            const auto w = (1_f - glm::distance(r.sp.geom.p, sp.geom.p) / radius) * cos;
+            if (w <= 0_f) {
+                return;
+            }
+            sum += w * r.sum / Float(r.n);
+            weight += w;
+        });
+        if (weight == 0_f) {
+            return {};
+        }
+        return sum / weight;
+    }
+
+    // Trace a path in the pixel until the first non-specular surface.
+    // Returns the radiance of the direct hits to the lights and the direct illumination at the visible point.
+    Vec3 trace_eye_path(Rng& rng, int pixel_index, VisiblePoint& vp) const {
+        const auto size = film_->size();
+        vp.valid = false;
+
+        // Primary ray through a random position in the pixel
+        const int x = pixel_index % size.w;
+        const int y = pixel_index / size.w;
+        const auto u = rng.next<Vec2>();
+        auto ray = path::primary_ray(scene_, { (x + u.x) / size.w, (y + u.y) / size.h });
+        auto beta = Vec3(1_f);
+        int comp = 0;
+        Vec3 L(0_f);
+        for (int num_verts = 1; num_verts < max_verts_; num_verts++) {
+            const auto hit = scene_->intersect(ray);
+            if (!hit) {
+                break;
+            }
+
+            // Contribution from direct hit against a light
+            if (scene_->is_light(*hit)) {
+                const auto spL = hit->as_type(SceneInteraction::LightEndpoint);
+                const auto Le = path::eval_contrb_direction(scene_, spL, {}, -ray.d, comp, TransDir::LE, true);
+                L += beta * Le;
+            }
+            if (hit->geom.infinite) {
+                break;
+            }
+
+            // Record visible point at the non-specular surface
+            const auto s_comp = path::sample_component(rng, scene_, *hit, -ray.d);
+            if (!path::is_specular_component(scene_, *hit, s_comp.comp)) {
+                vp.valid = true;
+                vp.sp = *hit;
+                vp.wi = -ray.d;
+                vp.comp = s_comp.comp;
+                vp.num_verts = num_verts;
+                vp.beta = beta * s_comp.weight;
+                L += vp.beta * direct_radiance(rng, vp.sp, vp.wi, vp.comp);
+                break;
+            }
+
+            // Continue through the specular surface
+            const auto s = path::sample_direction(rng, scene_, *hit, -ray.d, s_comp.comp, TransDir::EL);
+            if (!s) {
+                break;
+            }
+            beta *= s_comp.weight * s->weight;
+            comp = s_comp.comp;
+            ray = { hit->geom.p, s->wo };
+        }
+        return L;
+    }
+
+    // Estimate the radiance leaving sp toward wi by the light reaching sp directly from the lights
+    Vec3 direct_radiance(Rng& rng, const SceneInteraction& sp, Vec3 wi, int comp) const {
+        const auto sL = path::sample_direct(rng, scene_, sp, TransDir::LE);
+        if (!sL || !scene_->visible(sp, sL->sp)) {
+            return Vec3(0_f);
+        }
+        const auto fs = path::eval_contrb_direction(scene_, sp, wi, -sL->wo, comp, TransDir::EL, true);
+        return fs * sL->weight;
+    }
+
+    // Estimate the radiance leaving sp toward wi by path tracing with the next event estimation.
+    // num_verts is the number of vertices of the path including sp.
+    // If direct is false, the direct illumination at sp is excluded.
+    Vec3 trace_radiance(Rng& rng, SceneInteraction sp, Vec3 wi, int comp, int num_verts, bool direct) const {
+        Vec3 L(0_f);
+        auto beta = Vec3(1_f);
+        for (bool first = true; num_verts < max_verts_; num_verts++, first = false) {
+            // Next event estimation. The lights hit by the specular directions are accumulated below.
+            const bool specular = path::is_specular_component(scene_, sp, comp);
+            if (!specular && (direct || !first)) {
+                L += beta * direct_radiance(rng, sp, wi, comp);
+            }
+
+            // Sample next direction
+            const auto s = path::sample_direction(rng, scene_, sp, wi, comp, TransDir::EL);
+            if (!s) {
+                break;
+            }
+            const auto hit = scene_->intersect({ sp.geom.p, s->wo });
+            if (!hit) {
+                break;
+            }
+            beta *= s->weight;
+
+            // Contribution from direct hit against a light
+            if (specular && (direct || !first) && scene_->is_light(*hit)) {
+                const auto spL = hit->as_type(SceneInteraction::LightEndpoint);
+                L += beta * path::eval_contrb_direction(scene_, spL, {}, -s->wo, comp, TransDir::LE, true);
+            }
+            if (hit->geom.infinite) {
+                break;
+            }
+
+            // Russian roulette
+            if (!roulette::survive(roulette_.get(), rng.u(), beta, num_verts)) {
+                break;
+            }
+
+            // Sample component
+            const auto s_comp = path::sample_component(rng, scene_, *hit, -s->wo);
+            beta *= s_comp.weight;
+            wi = -s->wo;
+            sp = *hit;
+            comp = s_comp.comp;
+        }
+        return L;
+    }
+};
+
+LM_COMP_REG_IMPL(Renderer_RadianceCache, "renderer::radiancecache");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -13,6 +13,7 @@
 #include <lm/scheduler.h>
 #include <lm/path.h>
 #include <lm/timer.h>
+#include "raystats.h"
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
@@ -64,14 +65,20 @@ public:
 		scene_->require_accel();
 		scene_->require_camera();
 
-        film_->clear();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
         timer::ScopedTimer st;
-        sched_->run([&](long long index, long long, int) {
+        RayStats ray_stats;
+        sched_->run([&](long long index, long long, int threadid) {
             const int x = int(index % size.w);
             const int y = int(index / size.w);
             const auto ray = path::primary_ray(scene_, {(x+.5_f)/size.w, (y+.5_f)/size.h});
             const auto sp = scene_->intersect(ray);
+            auto& stats = ray_stats.at(threadid);
+            stats.path();
+            stats.extension(true, bool(sp));
             if (!sp) {
                 film_->set_pixel(x, y, bg_color_);
                 return;
@@ -89,7 +96,11 @@ public:
             }
         });
 
-        return { {"elapsed", st.now()} };
+        const auto elapsed = st.now();
+        return profiler::attach_stats({
+            {"elapsed", elapsed},
+            {"ray_stats", ray_stats.to_json(elapsed)}
+        });
     }
 };
 
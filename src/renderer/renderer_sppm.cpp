@@ -0,0 +1,345 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/renderer.h>
+#include <lm/scene.h>
+#include <lm/film.h>
+#include <lm/path.h>
+#include <lm/parallel.h>
+#include <lm/progress.h>
+#include <lm/timer.h>
+#include <lm/roulette.h>
+#include "hashgrid.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: renderer::sppm
+
+    Stochastic progressive photon mapping.
+
+    :param str scene: Locator of the scene.
+    :param str output: Locator of the film.
+    :param int max_verts: Maximum number of vertices of the eye and photon paths.
+    :param int num_iterations: Number of iterations. Default value: unlimited.
+    :param float render_time: Time limit of the rendering in seconds. Default value: unlimited.
+    :param int num_photons: Number of photons per iteration.
+                            Default value: number of pixels of the film.
+    :param float radius: Initial radius of the density estimation.
+                         Default value: 0.2% of the diagonal of the bound of the visible points
+                         in the first iteration.
+    :param float alpha: Fraction of the photons kept in each iteration. Default value: 2/3.
+    :param int seed: Random seed. If not specified, the seed is chosen randomly.
+    :param str roulette: Name of the termination policy of the photon paths
+                         (see :cpp:class:`lm::Roulette`). Default value: ``throughput``.
+
+    This renderer implements stochastic progressive photon mapping [Hachisuka2009]_.
+    At least one of ``num_iterations`` or ``render_time`` must be specified.
+    Each iteration traces a path from each pixel through the specular surfaces
+    and records the visible point at the first non-specular surface.
+    The visible points are registered to a hash grid built in parallel without locks,
+    and the photons traced from the lights in parallel accumulate their flux
+    to the visible points within the radius of the pixels.
+    The photons are not stored, so the memory usage is bounded by the number of pixels
+    irrespective of the number of photons.
+    The radius and the accumulated flux of the pixels are updated after each iteration
+    and the current estimate is written to the film and published as the snapshot,
+    which gives progressive previews of the caustics.
+
+    .. [Hachisuka2009] T. Hachisuka, H. W. Jensen, Stochastic progressive photon mapping,
+                       ACM TOG 28(5), 2009.
+\endrst
+*/
+class Renderer_SPPM final : public Renderer {
+private:
+    // Per-pixel state
+    struct Pixel {
+        // Persistent statistics
+        Float radius = 0_f;     // Radius
+        Float n = 0_f;          // Accumulated number of photons
+        Vec3 tau{};             // Accumulated flux
+        Vec3 Ld{};              // Accumulated radiance by the direct hits to the lights
+
+        // Visible point of the current iteration
+        bool has_vp = false;
+        SceneInteraction sp;
+        Vec3 wi;
+        int comp;
+        Vec3 beta;
+
+        // Statistics of the current iteration updated by the photons
+        std::atomic<Float> phi[3];
+        std::atomic<long long> m;
+    };
+
+private:
+    Scene* scene_;                          // Reference to scene asset
+    Film* film_;                            // Reference to film asset for output
+    int max_verts_;                         // Maximum number of path vertices
+    std::optional<int> num_iterations_;     // Number of iterations
+    std::optional<Float> render_time_;      // Time limit
+    std::optional<long long> num_photons_;  // Number of photons per iteration
+    std::optional<Float> radius_;           // Initial radius
+    Float alpha_;                           // Fraction of the photons kept
+    std::optional<unsigned int> seed_;      // Random seed
+    Component::Ptr<Roulette> roulette_;     // Termination policy of the photon paths
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(scene_, film_, max_verts_, num_iterations_, render_time_, num_photons_, radius_, alpha_, seed_, roulette_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, scene_);
+        comp::visit(visit, film_);
+        comp::visit(visit, roulette_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        scene_ = json::comp_ref<Scene>(prop, "scene");
+        film_ = json::comp_ref<Film>(prop, "output");
+        max_verts_ = json::value<int>(prop, "max_verts");
+        num_iterations_ = json::value_or_none<int>(prop, "num_iterations");
+        render_time_ = json::value_or_none<Float>(prop, "render_time");
+        if (!num_iterations_ && !render_time_) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Either num_iterations or render_time must be specified.");
+        }
+        num_photons_ = json::value_or_none<long long>(prop, "num_photons");
+        radius_ = json::value_or_none<Float>(prop, "radius");
+        alpha_ = json::value<Float>(prop, "alpha", 2_f/3_f);
+        seed_ = json::value_or_none<unsigned int>(prop, "seed");
+        {
+            const auto name = json::value<std::string>(prop, "roulette", "throughput");
+            roulette_ = comp::create<Roulette>("roulette::" + name, make_loc("roulette"), prop);
+        }
+    }
+
+    virtual Json render() const override {
+        scene_->require_renderable();
+        film_->clear();
+        const auto size = film_->size();
+        const int num_pixels = size.w * size.h;
+        const long long num_photons = num_photons_ ? *num_photons_ : num_pixels;
+        timer::ScopedTimer st;
+
+        // Base random number generator. Each path uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
+
+        std::vector<Pixel> pixels(num_pixels);
+        std::vector<int> vps;   // Pixels having visible points
+        HashGrid grid;
+
+        // Progress is reported by iterations or by time
+        std::optional<progress::ScopedReport> progress_ctx_;
+        std::optional<progress::ScopedTimeReport> progress_time_ctx_;
+        if (render_time_) {
+            progress_time_ctx_.emplace(*render_time_);
+        }
+        else {
+            progress_ctx_.emplace(*num_iterations_);
+        }
+
+        int it = 0;
+        while (true) {
+            if (num_iterations_ && it >= *num_iterations_) {
+                break;
+            }
+            if (render_time_ && st.now() >= *render_time_) {
+                break;
+            }
+
+            // Trace eye paths and find visible points
+            parallel::foreach(num_pixels, [&](long long i, int) {
+                auto rng = rng_base.split(i, 2*it);
+                trace_eye_path(rng, int(i), pixels[i]);
+            });
+
+            // Pixels with visible points
+            vps.clear();
+            for (int i = 0; i < num_pixels; i++) {
+                if (pixels[i].has_vp) {
+                    vps.push_back(i);
+                }
+            }
+
+            // Initial radius from the extent of the visible points
+            if (it == 0) {
+                Float r0 = 1_f;
+                if (radius_) {
+                    r0 = *radius_;
+                }
+                else if (!vps.empty()) {
+                    Bound b;
+                    for (int i : vps) {
+                        b = merge(b, pixels[i].sp.geom.p);
+                    }
+                    r0 = glm::length(b.max - b.min) * .002_f;
+                }
+                for (auto& pixel : pixels) {
+                    pixel.radius = r0;
+                }
+            }
+
+            // Build hash grid of the visible points with the maximum radius
+            Float max_radius = 0_f;
+            for (int i : vps) {
+                max_radius = std::max(max_radius, pixels[i].radius);
+            }
+            grid.build(int(vps.size()), max_radius, [&](int j) {
+                return pixels[vps[j]].sp.geom.p;
+            });
+
+            // Trace photons
+            parallel::foreach(num_photons, [&](long long i, int) {
+                auto rng = rng_base.split(i, 2*it + 1);
+                trace_photon(rng, grid, vps, pixels);
+            });
+
+            // Update the statistics of the pixels and write the current estimate
+            const int num_iterations = it + 1;
+            parallel::foreach(num_pixels, [&](long long i, int) {
+                auto& pixel = pixels[i];
+                const auto m = pixel.m.load(std::memory_order_relaxed);
+                if (m > 0) {
+                    const auto phi = Vec3(pixel.phi[0].load(), pixel.phi[1].load(), pixel.phi[2].load());
+                    const auto n_new = pixel.n + alpha_ * Float(m);
+                    const auto r_new = pixel.radius * std::sqrt(n_new / (pixel.n + Float(m)));
+                    pixel.tau = (pixel.tau + pixel.beta * phi) * (r_new * r_new) / (pixel.radius * pixel.radius);
+                    pixel.n = n_new;
+                    pixel.radius = r_new;
+                }
+                const auto L = pixel.Ld / Float(num_iterations) +
+                    pixel.tau / (Float(num_iterations) * Float(num_photons) * Pi * pixel.radius * pixel.radius);
+                film_->set_pixel(int(i % size.w), int(i / size.w), L);
+            });
+            film_->publish(1_f);
+
+            it++;
+            if (render_time_) {
+                progress::update_time(st.now());
+            }
+            else {
+                progress::update(it);
+            }
+        }
+
+        return profiler::attach_stats({
+            {"processed", (long long)(it) * num_photons},
+            {"iterations", it},
+            {"elapsed", st.now()}
+        });
+    }
+
+private:
+    // Trace a path in the pixel until the first non-specular surface
+    void trace_eye_path(Rng& rng, int pixel_index, Pixel& pixel) const {
+        const auto size = film_->size();
+        pixel.has_vp = false;
+        pixel.m = 0;
+        for (auto& phi : pixel.phi) {
+            phi = 0_f;
+        }
+
+        // Primary ray through a random position in the pixel
+        const int x = pixel_index % size.w;
+        const int y = pixel_index / size.w;
+        const auto u = rng.next<Vec2>();
+        auto ray = path::primary_ray(scene_, { (x + u.x) / size.w, (y + u.y) / size.h });
+        auto beta = Vec3(1_f);
+        int comp = 0;
+        for (int num_verts = 1; num_verts < max_verts_; num_verts++) {
+            const auto hit = scene_->intersect(ray);
+            if (!hit) {
+                break;
+            }
+
+            // Contribution from direct hit against a light
+            if (scene_->is_light(*hit)) {
+                const auto spL = hit->as_type(SceneInteraction::LightEndpoint);
+                const auto Le = path::eval_contrb_direction(scene_, spL, {}, -ray.d, comp, TransDir::LE, true);
+                pixel.Ld += beta * Le;
+            }
+            if (hit->geom.infinite) {
+                break;
+            }
+
+            // Record visible point at the non-specular surface
+            const auto s_comp = path::sample_component(rng, scene_, *hit, -ray.d);
+            if (!path::is_specular_component(scene_, *hit, s_comp.comp)) {
+                pixel.has_vp = true;
+                pixel.sp = *hit;
+                pixel.wi = -ray.d;
+                pixel.comp = s_comp.comp;
+                pixel.beta = beta * s_comp.weight;
+                break;
+            }
+
+            // Continue through the specular surface
+            const auto s = path::sample_direction(rng, scene_, *hit, -ray.d, s_comp.comp, TransDir::EL);
+            if (!s) {
+                break;
+            }
+            beta *= s_comp.weight * s->weight;
+            comp = s_comp.comp;
+            ray = { hit->geom.p, s->wo };
+        }
+    }
+
+    // Trace a photon and accumulate the flux to the visible points
+    void trace_photon(Rng& rng, const HashGrid& grid, const std::vector<int>& vps, std::vector<Pixel>& pixels) const {
+        const auto sL = path::sample_primary_ray(rng, scene_, TransDir::LE);
+        if (!sL) {
+            return;
+        }
+        auto beta = sL->weight;
+        Ray ray{ sL->sp.geom.p, sL->wo };
+        for (int num_verts = 2; num_verts <= max_verts_; num_verts++) {
+            const auto hit = scene_->intersect(ray);
+            if (!hit || hit->geom.infinite) {
+                break;
+            }
+
+            // Accumulate the flux to the visible points
+            grid.query(hit->geom.p, [&](int j) {
+                auto& pixel = pixels[vps[j]];
+                const auto d = pixel.sp.geom.p - hit->geom.p;
+                if (glm::dot(d, d) > pixel.radius * pixel.radius) {
+                    return;
+                }
+                const auto f = path::eval_contrb_direction(scene_, pixel.sp, pixel.wi, -ray.d, pixel.comp, TransDir::EL, false);
+                const auto phi = beta * f;
+                for (int k = 0; k < 3; k++) {
+                    auto expected = pixel.phi[k].load(std::memory_order_relaxed);
+                    while (!pixel.phi[k].compare_exchange_weak(expected, expected + phi[k]));
+                }
+                pixel.m.fetch_add(1, std::memory_order_relaxed);
+            });
+
+            // Sample next direction
+            const auto s_comp = path::sample_component(rng, scene_, *hit, -ray.d);
+            const auto s = path::sample_direction(rng, scene_, *hit, -ray.d, s_comp.comp, TransDir::LE);
+            if (!s) {
+                break;
+            }
+            beta *= s_comp.weight * s->weight;
+
+            // Russian roulette
+            if (!roulette::survive(roulette_.get(), rng.u(), beta, num_verts)) {
+                break;
+            }
+            ray = { hit->geom.p, s->wo };
+        }
+    }
+};
+
+LM_COMP_REG_IMPL(Renderer_SPPM, "renderer::sppm");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,304 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/renderer.h>
+#include <lm/scene.h>
+#include <lm/film.h>
+#include <lm/bidir.h>
+#include <lm/parallel.h>
+#include <lm/progress.h>
+#include <lm/timer.h>
+#include "hashgrid.h"
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+namespace {
+
+// Vertex of a light subpath registered to the hash grid
+struct LightVertex {
+    Vec3 p;             // Position
+    int path_index;     // Index of the light subpath
+    int vert_index;     // Index of the vertex in the light subpath
+};
+
+}
+
+/*
+\rst
+.. function:: renderer::vcm
+
+    Vertex connection and merging.
+
+    :param str scene: Locator of the scene.
+    :param str output: Locator of the film.
+    :param int min_verts: Minimum number of path vertices. Default value: 2.
+    :param int max_verts: Maximum number of path vertices.
+    :param int num_iterations: Number of iterations.
+    :param int num_light_paths: Number of light subpaths per iteration.
+                                Default value: number of pixels of the film.
+    :param float radius: Initial radius of the merging.
+                         Default value: 0.2% of the diagonal of the bound of the light vertices
+                         in the first iteration.
+    :param float alpha: Reduction rate of the radius. Default value: 0.75.
+    :param int seed: Random seed. If not specified, the seed is chosen randomly.
+
+    This renderer implements vertex connection and merging [Georgiev2012]_,
+    which combines the connection strategies of bidirectional path tracing
+    and the merging strategies of progressive photon mapping with MIS.
+    The merging strategies efficiently sample the paths that cannot be sampled by the connections,
+    e.g., specular-diffuse-specular paths like caustics seen through ``material::glass``.
+    Each iteration samples the light subpaths, registers their non-specular vertices
+    to a hash grid built in parallel, and samples the same number of eye subpaths.
+    Each eye subpath is connected to a light subpath as :cpp:func:`lm::path::connect_subpaths`
+    and merged with the light vertices within the radius around its non-specular vertices.
+    The subpaths are sampled by :cpp:func:`lm::path::sample_subpath`
+    and the MIS weights are computed by the power heuristic
+    from the bidirectional path PDFs :cpp:func:`lm::Path::pdf_bidir`
+    and the corresponding PDFs of the merging strategies.
+    The radius of the :math:`i`-th iteration is reduced to :math:`r_0 i^{(\alpha-1)/2}`.
+
+    .. [Georgiev2012] I. Georgiev, J. Krivanek, T. Davidovic, P. Slusallek,
+                      Light transport simulation with vertex connection and merging,
+                      ACM TOG 31(6), 2012.
+\endrst
+*/
+class Renderer_VCM final : public Renderer {
+private:
+    Scene* scene_;                          // Reference to scene asset
+    Film* film_;                            // Reference to film asset for output
+    int min_verts_;                         // Minimum number of path vertices
+    int max_verts_;                         // Maximum number of path vertices
+    int num_iterations_;                    // Number of iterations
+    std::optional<long long> num_light_paths_;  // Number of light subpaths per iteration
+    std::optional<Float> radius_;           // Initial radius
+    Float alpha_;                           // Reduction rate of the radius
+    std::optional<unsigned int> seed_;      // Random seed
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(scene_, film_, min_verts_, max_verts_, num_iterations_, num_light_paths_, radius_, alpha_, seed_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, scene_);
+        comp::visit(visit, film_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        scene_ = json::comp_ref<Scene>(prop, "scene");
+        film_ = json::comp_ref<Film>(prop, "output");
+        min_verts_ = json::value<int>(prop, "min_verts", 2);
+        max_verts_ = json::value<int>(prop, "max_verts");
+        num_iterations_ = json::value<int>(prop, "num_iterations");
+        num_light_paths_ = json::value_or_none<long long>(prop, "num_light_paths");
+        radius_ = json::value_or_none<Float>(prop, "radius");
+        alpha_ = json::value<Float>(prop, "alpha", .75_f);
+        seed_ = json::value_or_none<unsigned int>(prop, "seed");
+    }
+
+    virtual Json render() const override {
+        scene_->require_renderable();
+        film_->clear();
+        const auto size = film_->size();
+        const long long N = num_light_paths_ ? *num_light_paths_ : film_->num_pixels();
+        timer::ScopedTimer st;
+
+        // Base random number generator. Each subpath uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
+
+        // Light subpaths of the current iteration.
+        // The storage is reused over the iterations.
+        std::vector<Path> subpathLs(N);
+        std::vector<LightVertex> light_verts;
+        HashGrid grid;
+
+        progress::ScopedReport progress_ctx_(num_iterations_ * N);
+        Float r0 = radius_ ? *radius_ : 0_f;
+        for (int it = 0; it < num_iterations_; it++) {
+            // Sample light subpaths
+            parallel::foreach(N, [&](long long j, int) {
+                auto rng = rng_base.split(j, 2*it);
+                path::sample_subpath(rng, subpathLs[j], scene_, max_verts_, TransDir::LE);
+            });
+
+            // Collect light vertices usable for merging
+            light_verts.clear();
+            for (long long j = 0; j < N; j++) {
+                const auto& subpathL = subpathLs[j];
+                for (int i = 1; i < subpathL.num_verts(); i++) {
+                    const auto& v = subpathL.vs[i];
+                    if (v.sp.geom.infinite || v.is_specular(scene_)) {
+                        continue;
+                    }
+                    light_verts.push_back({ v.sp.geom.p, int(j), i });
+                }
+            }
+
+            // Determine the initial radius from the extent of the light vertices
+            if (it == 0 && !radius_) {
+                Bound b;
+                for (const auto& v : light_verts) {
+                    b = merge(b, v.p);
+                }
+                r0 = light_verts.empty() ? 1_f : glm::length(b.max - b.min) * .002_f;
+            }
+            const auto r = r0 * std::pow(Float(it + 1), (alpha_ - 1_f) * .5_f);
+            const auto vm_factor = Pi * r * r * Float(N);
+            grid.build(int(light_verts.size()), r, [&](int i) { return light_verts[i].p; });
+
+            // Sample eye subpaths, connect and merge
+            parallel::foreach(N, [&](long long j, int) {
+                auto rng = rng_base.split(j, 2*it + 1);
+                thread_local Path subpathE;
+                path::sample_subpath(rng, subpathE, scene_, max_verts_, TransDir::EL);
+                const auto& subpathL = subpathLs[j];
+                const int nE = subpathE.num_verts();
+                const int nL = subpathL.num_verts();
+
+                // Storage of the full paths reused for the strategies
+                thread_local Path fullpath;
+
+                // Vertex connection
+                for (int s = 0; s <= nL; s++) {
+                    for (int t = 0; t <= nE; t++) {
+                        const int k = s + t;
+                        if (k < min_verts_ || max_verts_ < k) {
+                            continue;
+                        }
+                        if (!path::connect_subpaths(scene_, subpathL, subpathE, s, t, fullpath)) {
+                            continue;
+                        }
+                        const auto C = fullpath.eval_sampling_weight_bidir(scene_, s);
+                        if (math::is_zero(C)) {
+                            continue;
+                        }
+                        const auto w = mis_weight(fullpath, false, s, vm_factor);
+                        film_->splat(fullpath.raster_position(scene_), w * C);
+                    }
+                }
+
+                // Vertex merging at the non-specular vertices of the eye subpath
+                for (int t = 2; t <= nE; t++) {
+                    const auto& vE = subpathE.vs[t-1];
+                    if (vE.sp.geom.infinite || vE.is_specular(scene_)) {
+                        continue;
+                    }
+                    grid.query(vE.sp.geom.p, [&](int i) {
+                        const auto& lv = light_verts[i];
+                        const int s = lv.vert_index + 1;
+                        const int k = s + t - 1;
+                        if (k < min_verts_ || max_verts_ < k) {
+                            return;
+                        }
+                        merge_subpaths(subpathLs[lv.path_index], subpathE, s, t, fullpath);
+                        const auto C = eval_merge_sampling_weight(fullpath, s - 1) / vm_factor;
+                        if (math::is_zero(C)) {
+                            return;
+                        }
+                        const auto w = mis_weight(fullpath, true, s - 1, vm_factor);
+                        film_->splat(fullpath.raster_position(scene_), w * C);
+                    });
+                }
+            }, [&](long long processed) {
+                progress::update(it * N + processed);
+            });
+        }
+
+        // Rescale film
+        const auto processed = num_iterations_ * N;
+        film_->rescale(Float(size.w * size.h) / processed);
+
+        return profiler::attach_stats({ {"processed", processed}, {"elapsed", st.now()} });
+    }
+
+private:
+    // Compose a fullpath by merging the s-th vertex of the light subpath
+    // and the t-th vertex of the eye subpath. The merged vertex is the eye vertex.
+    void merge_subpaths(const Path& subpathL, const Path& subpathE, int s, int t, Path& path) const {
+        path.vs.clear();
+        path.vs.insert(path.vs.end(), subpathL.vs.begin(), subpathL.vs.begin() + (s - 1));
+        path.vs.insert(path.vs.end(), subpathE.vs.rend() - t, subpathE.vs.rend());
+        auto& vL = path.vs.front();
+        vL.sp = vL.sp.as_type(SceneInteraction::LightEndpoint);
+        auto& vE = path.vs.back();
+        vE.sp = vE.sp.as_type(SceneInteraction::CameraEndpoint);
+    }
+
+    // Component selection PDF of the merged vertex from the light side
+    Float pdf_merged_component(const Path& path, int m) const {
+        const auto* v = path.vertex_at(m, TransDir::LE);
+        const auto* v_prev = path.vertex_at(m-1, TransDir::LE);
+        return path::pdf_component(scene_, v->sp, path.direction(v, v_prev), v->comp);
+    }
+
+    // Sampling weight of the merging strategy at the m-th vertex from the light,
+    // excluding the normalization by the kernel and the number of light subpaths.
+    Vec3 eval_merge_sampling_weight(const Path& path, int m) const {
+        const int n = path.num_verts();
+        const auto alphaL = path.eval_subpath_sampling_weight(scene_, m + 1, TransDir::LE);
+        if (math::is_zero(alphaL)) {
+            return Vec3(0_f);
+        }
+        const auto alphaE = path.eval_subpath_sampling_weight(scene_, n - m, TransDir::EL);
+        if (math::is_zero(alphaE)) {
+            return Vec3(0_f);
+        }
+        const auto* v = path.vertex_at(m, TransDir::LE);
+        const auto* vL = path.vertex_at(m-1, TransDir::LE);
+        const auto* vE = path.vertex_at(m+1, TransDir::LE);
+        const auto fs = path::eval_contrb_direction(scene_, v->sp,
+            path.direction(v, vE), path.direction(v, vL), v->comp, TransDir::EL, true);
+
+        // The light subpath does not select the component of the merged vertex
+        return alphaL * fs * alphaE * pdf_merged_component(path, m);
+    }
+
+    // PDF of the merging strategy at the m-th vertex from the light
+    Float pdf_merge(const Path& path, int m, Float vm_factor) const {
+        const int n = path.num_verts();
+        if (m < 1 || m > n - 2) {
+            return 0_f;
+        }
+        const auto* v = path.vertex_at(m, TransDir::LE);
+        if (v->sp.geom.infinite || v->sp.geom.degenerated || v->is_specular(scene_)) {
+            return 0_f;
+        }
+        const auto p_comp = pdf_merged_component(path, m);
+        if (p_comp == 0_f) {
+            return 0_f;
+        }
+        const auto pL = path.pdf_subpath(scene_, m + 1, TransDir::LE);
+        const auto pE = path.pdf_subpath(scene_, n - m, TransDir::EL);
+        return pL * pE / p_comp * vm_factor;
+    }
+
+    // MIS weight of the strategy with the power heuristic over the connections and the merges.
+    // k is the strategy index s for the connection and the index of the merged vertex for the merge.
+    Float mis_weight(const Path& path, bool merge, int k, Float vm_factor) const {
+        const int n = path.num_verts();
+        const auto ps = merge ? pdf_merge(path, k, vm_factor) : path.pdf_bidir(scene_, k);
+        if (ps == 0_f) {
+            return 0_f;
+        }
+        Float inv_w = 0_f;
+        for (int s = 0; s <= n; s++) {
+            const auto r = path.pdf_bidir(scene_, s) / ps;
+            inv_w += r*r;
+        }
+        for (int m = 1; m <= n - 2; m++) {
+            const auto r = pdf_merge(path, m, vm_factor) / ps;
+            inv_w += r*r;
+        }
+        return 1_f / inv_w;
+    }
+};
+
+LM_COMP_REG_IMPL(Renderer_VCM, "renderer::vcm");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
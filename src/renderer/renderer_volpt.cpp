@@ -11,6 +11,9 @@
 #include <lm/scheduler.h>
 #include <lm/path.h>
 #include <lm/timer.h>
+#include <lm/roulette.h>
+#include <lm/medium.h>
+#include "raystats.h"
 
 #define VOLPT_IMAGE_SAMPLING 0
 
@@ -21,19 +24,21 @@ protected:
     Scene* scene_;
     Film* film_;
     int max_verts_;
-    Float rr_prob_;
     std::optional<unsigned int> seed_;
     Component::Ptr<scheduler::Scheduler> sched_;
+    Component::Ptr<Roulette> roulette_;
+    bool equiangular_;      // Combine equiangular sampling toward point lights (renderer::volpt only)
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(scene_, film_, max_verts_, rr_prob_, sched_);
+        ar(scene_, film_, max_verts_, sched_, roulette_, equiangular_);
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visit) override {
         comp::visit(visit, scene_);
         comp::visit(visit, film_);
         comp::visit(visit, sched_);
+        comp::visit(visit, roulette_);
     }
 
 public:
@@ -42,7 +47,7 @@ public:
         film_ = json::comp_ref<Film>(prop, "output");
         max_verts_ = json::value<int>(prop, "max_verts");
         seed_ = json::value_or_none<unsigned int>(prop, "seed");
-        rr_prob_ = json::value<Float>(prop, "rr_prob", .2_f);
+        equiangular_ = json::value<bool>(prop, "equiangular", false);
         const auto sched_name = json::value<std::string>(prop, "scheduler");
         #if VOLPT_IMAGE_SAMPLING
         sched_ = comp::create<scheduler::Scheduler>(
@@ -51,6 +56,16 @@ public:
         sched_ = comp::create<scheduler::Scheduler>(
             "scheduler::spp::" + sched_name, make_loc("scheduler"), prop);
         #endif
+
+        // rr_prob is the minimum termination probability of roulette::throughput
+        {
+            auto roulette_prop = prop;
+            if (prop.find("max_prob") == prop.end()) {
+                roulette_prop["max_prob"] = 1_f - json::value<Float>(prop, "rr_prob", .2_f);
+            }
+            const auto name = json::value<std::string>(prop, "roulette", "throughput");
+            roulette_ = comp::create<Roulette>("roulette::" + name, make_loc("roulette"), roulette_prop);
+        }
     }
 };
 
@@ -61,14 +76,21 @@ public:
     virtual Json render() const override {
 		scene_->require_renderable();
 
-        film_->clear();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
+        const bool aovs = film_->has_aovs();
         timer::ScopedTimer st;
-        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
-            LM_KEEP_UNUSED(sample_index);
 
-            // Per-thread random number generator
-            thread_local Rng rng(seed_ ? *seed_ + threadid : math::rng_seed());
+        // Base random number generator. Each sample uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
+        RayStats ray_stats;
+        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
+            // Random number generator for the sample
+            auto rng = rng_base.split(pixel_index, sample_index);
+            auto& stats = ray_stats.at(threadid);
 
             // ------------------------------------------------------------------------------------
 
@@ -94,6 +116,7 @@ public:
             auto sp = sE->sp;
             int comp = sE_comp.comp;
             auto throughput = sE->weight * sE_comp.weight;
+            stats.path();
 
             // ------------------------------------------------------------------------------------
 
@@ -120,13 +143,17 @@ public:
 
                 // Compute and cache raster position
                 if (num_verts == 1) {
-                    raster_pos = *path::raster_position(scene_, s->wo);
+                    raster_pos = *path::raster_position(scene_, sp.geom, s->wo);
                 }
 
                 // --------------------------------------------------------------------------------
 
                 // Sample next scene interaction
                 const auto sd = path::sample_distance(rng, scene_, sp, s->wo);
+                stats.extension(num_verts == 1, bool(sd));
+                if (aovs && num_verts == 1) {
+                    path::splat_aovs(scene_, film_, raster_pos, sp.geom.p, sd ? &sd->sp : nullptr);
+                }
                 if (!sd) {
                     break;
                 }
@@ -155,12 +182,8 @@ public:
                 }
 
                 // Russian roulette
-                if (num_verts > 5) {
-                    const auto q = glm::max(rr_prob_, 1_f - glm::compMax(throughput));
-                    if (rng.u() < q) {
-                        break;
-                    }
-                    throughput /= 1_f - q;
+                if (!roulette::survive(roulette_.get(), rng.u(), throughput, num_verts)) {
+                    break;
                 }
 
                 // --------------------------------------------------------------------------------
@@ -185,7 +208,12 @@ public:
         film_->rescale(1_f / processed);
         #endif
 
-        return { {"processed", processed}, {"elapsed", st.now()} };
+        const auto elapsed = st.now();
+        return profiler::attach_stats({
+            {"processed", processed},
+            {"elapsed", elapsed},
+            {"ray_stats", ray_stats.to_json(elapsed)}
+        });
     }
 };
 
@@ -193,19 +221,109 @@ LM_COMP_REG_IMPL(Renderer_VolPTNaive, "renderer::volpt_naive");
 
 // ------------------------------------------------------------------------------------------------
 
+namespace {
+
+// Ray segment inside a homogeneous medium for equiangular sampling [Kulla & Fajardo 2012].
+// Equiangular sampling samples a distance along the segment proportionally to
+// the inverse squared distance to a point light. The scattering events sampled by
+// equiangular sampling and by the distance sampling of the medium followed by NEE
+// are combined with the balance heuristic, using the analytic pdf of the distance sampling.
+struct EquiangularSegment {
+    Ray ray;                // Ray of the segment
+    PointGeometry geom;     // Geometry of the origin of the ray, used for the light selection
+    int medium;             // Medium node index
+    Float t0;               // Range of the ray inside the medium
+    Float t1;
+    Float density;          // Extinction coefficient of the medium
+    Vec3 albedo;            // Albedo of the medium
+
+    // Equiangular distribution for a light position
+    struct Params {
+        Float delta;        // Distance along the ray to the point closest to the light
+        Float D;            // Distance between the light and the ray
+        Float theta0;       // Angles of the ends of the segment seen from the light
+        Float theta1;
+    };
+
+    std::optional<Params> params(Vec3 pL) const {
+        const auto delta = glm::dot(pL - ray.o, ray.d);
+        const auto D = glm::length(ray.o + ray.d * delta - pL);
+        if (D < Eps) {
+            return {};
+        }
+        const auto theta0 = std::atan2(t0 - delta, D);
+        const auto theta1 = std::atan2(t1 - delta, D);
+        if (theta1 <= theta0) {
+            return {};
+        }
+        return Params{ delta, D, theta0, theta1 };
+    }
+
+    // Sample a distance by equiangular sampling
+    static Float sample(const Params& q, Float u) {
+        return q.delta + q.D * std::tan(glm::mix(q.theta0, q.theta1, u));
+    }
+
+    // PDF of equiangular sampling
+    static Float pdf(const Params& q, Float t) {
+        const auto x = t - q.delta;
+        return q.D / ((q.theta1 - q.theta0) * (q.D * q.D + x * x));
+    }
+
+    // PDF of the scattering event sampled by the medium
+    Float pdf_distance(Float t) const {
+        return density * std::exp(-density * (t - t0));
+    }
+};
+
+// Find the segment of a ray if the ray only overlaps with a single homogeneous medium
+std::optional<EquiangularSegment> find_equiangular_segment(const Scene* scene, const SceneInteraction& sp, Vec3 wo, Float dist) {
+    const Ray ray{ sp.geom.p, wo };
+    std::optional<EquiangularSegment> seg;
+    int count = 0;
+    scene->traverse_media(ray, 0_f, dist, [&](int index, Float t0, Float t1) -> bool {
+        if (++count > 1) {
+            seg = {};
+            return false;
+        }
+        const auto coeffs = scene->node_at(index).primitive.medium->homogeneous_coeffs();
+        if (coeffs && coeffs->density > 0_f && t0 < t1) {
+            seg = EquiangularSegment{ ray, sp.geom, index, t0, t1, coeffs->density, coeffs->albedo };
+        }
+        return true;
+    });
+    return seg;
+}
+
+// Check if the light endpoint is a point light, which is the target of equiangular sampling
+bool is_point_light(const PointGeometry& geomL) {
+    return geomL.degenerated && !geomL.infinite;
+}
+
+}
+
+// ------------------------------------------------------------------------------------------------
+
 class Renderer_VolPT final : public Renderer_VolPT_Base {
 public:
     virtual Json render() const override {
 		scene_->require_renderable();
 
-        film_->clear();
+        if (!sched_->keep_film()) {
+            film_->clear();
+        }
         const auto size = film_->size();
+        const bool aovs = film_->has_aovs();
         timer::ScopedTimer st;
-        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
-            LM_KEEP_UNUSED(sample_index);
 
-            // Per-thread random number generator
-            thread_local Rng rng(seed_ ? *seed_ + threadid : math::rng_seed());
+        // Base random number generator. Each sample uses an independent stream
+        // split from it so that the result does not depend on the number of threads.
+        const Rng rng_base(seed_ ? *seed_ : math::rng_seed());
+        RayStats ray_stats;
+        const auto processed = sched_->run([&](long long pixel_index, long long sample_index, int threadid) {
+            // Random number generator for the sample
+            auto rng = rng_base.split(pixel_index, sample_index);
+            auto& stats = ray_stats.at(threadid);
 
             // ------------------------------------------------------------------------------------
 
@@ -231,12 +349,14 @@ public:
             auto sp = sE->sp;
             int comp = sE_comp.comp;
             auto throughput = sE->weight * sE_comp.weight;
+            stats.path();
 
             // ------------------------------------------------------------------------------------
 
             // Perform random walk
             Vec3 wi{};
             Vec2 raster_pos{};
+            std::optional<EquiangularSegment> seg_prev;     // Segment where the current vertex was sampled
             for (int num_verts = 1; num_verts < max_verts_; num_verts++) {
                 // Sample a NEE edge
                 #if VOLPT_IMAGE_SAMPLING
@@ -254,12 +374,13 @@ public:
                     // Recompute raster position for the primary edge
                     Vec2 rp = raster_pos;
                     if (num_verts == 1) {
-                        const auto rp_ = path::raster_position(scene_, -sL->wo);
+                        const auto rp_ = path::raster_position(scene_, sp.geom, -sL->wo);
                         if (!rp_) { return; }
                         rp = *rp_;
                     }
 
                     // Transmittance
+                    stats.shadow++;
                     const auto Tr = path::eval_transmittance(rng, scene_, sp, sL->sp);
                     if (math::is_zero(Tr)) {
                         return;
@@ -272,8 +393,24 @@ public:
                         return;
                     }
 
+                    // MIS weight combined with equiangular sampling
+                    const auto w = [&]() -> Float {
+                        if (!seg_prev || !is_point_light(sL->sp.geom)) {
+                            return 1_f;
+                        }
+                        const auto q = seg_prev->params(sL->sp.geom.p);
+                        if (!q) {
+                            return 1_f;
+                        }
+                        const int light_index = scene_->light_index_at(sL->sp.primitive);
+                        const auto t = glm::dot(sp.geom.p - seg_prev->ray.o, seg_prev->ray.d);
+                        const auto p_d = scene_->pdf_light_selection(sp.geom, light_index) * seg_prev->pdf_distance(t);
+                        const auto p_e = scene_->pdf_light_selection(seg_prev->geom, light_index) * EquiangularSegment::pdf(*q, t);
+                        return p_d / (p_d + p_e);
+                    }();
+
                     // Evaluate and accumulate contribution
-                    const auto C = throughput * Tr * fs * sL->weight;
+                    const auto C = throughput * Tr * fs * sL->weight * w;
                     film_->splat(rp, C);
                 }();
 
@@ -298,13 +435,72 @@ public:
 
                 // Compute and cache raster position
                 if (num_verts == 1) {
-                    raster_pos = *path::raster_position(scene_, s->wo);
+                    raster_pos = *path::raster_position(scene_, sp.geom, s->wo);
                 }
 
                 // --------------------------------------------------------------------------------
 
                 // Sample next scene interaction
                 const auto sd = path::sample_distance(rng, scene_, sp, s->wo);
+                stats.extension(num_verts == 1, bool(sd));
+                if (aovs && num_verts == 1) {
+                    path::splat_aovs(scene_, film_, raster_pos, sp.geom.p, sd ? &sd->sp : nullptr);
+                }
+
+                // --------------------------------------------------------------------------------
+
+                // Sample a scattering event toward a point light by equiangular sampling.
+                // The event is connected to the light as NEE from the next vertex.
+                const auto seg = equiangular_
+                    ? find_equiangular_segment(scene_, sp, s->wo, sd ? sd->dist : Inf)
+                    : std::nullopt;
+                if (seg && num_verts + 1 < max_verts_) [&] {
+                    // Select a light from the origin of the segment
+                    const auto [light_index, p_sel] = scene_->sample_light_selection(sp.geom, rng.u());
+                    const auto light_primitive_index = scene_->light_primitive_index_at(light_index);
+                    const auto* light = scene_->node_at(light_primitive_index.index).primitive.light;
+                    const auto sP = light->sample_position({ rng.next<Vec2>(), rng.u() }, light_primitive_index.global_transform);
+                    if (!sP || !is_point_light(sP->geom)) {
+                        return;
+                    }
+                    const auto q = seg->params(sP->geom.p);
+                    if (!q) {
+                        return;
+                    }
+
+                    // Sample a distance
+                    const auto t = EquiangularSegment::sample(*q, rng.u());
+                    const auto spM = SceneInteraction::make_medium_interaction(
+                        seg->medium, PointGeometry::make_degenerated(seg->ray.o + seg->ray.d * t));
+
+                    // Connect to the light
+                    const auto sL = light->sample_direct({ rng.next<Vec2>(), rng.u(), rng.next<Vec2>() },
+                        spM.geom, light_primitive_index.global_transform);
+                    if (!sL) {
+                        return;
+                    }
+                    const auto spL = SceneInteraction::make_light_endpoint(light_primitive_index.index, sL->geom);
+                    stats.shadow++;
+                    const auto Tr = path::eval_transmittance(rng, scene_, spM, spL);
+                    if (math::is_zero(Tr)) {
+                        return;
+                    }
+                    const auto fs = path::eval_contrb_direction(scene_, spM, -seg->ray.d, -sL->wo, 0, TransDir::EL, true);
+
+                    // Transmittance to the sampled point and scattering coefficient
+                    const auto Tr_seg = std::exp(-seg->density * (t - seg->t0));
+                    const auto mu_s = seg->albedo * seg->density;
+
+                    // MIS weight and contribution
+                    const auto p_e = p_sel * EquiangularSegment::pdf(*q, t);
+                    const auto p_d = scene_->pdf_light_selection(spM.geom, light_index) * seg->pdf_distance(t);
+                    const auto w = p_e / (p_e + p_d);
+                    const auto C = throughput * s->weight * Tr_seg * mu_s * fs * Tr * sL->weight * (w / p_e);
+                    film_->splat(raster_pos, C);
+                }();
+
+                // --------------------------------------------------------------------------------
+
                 if (!sd) {
                     break;
                 }
@@ -333,12 +529,8 @@ public:
                 }
 
                 // Russian roulette
-                if (num_verts > 5) {
-                    const auto q = glm::max(rr_prob_, 1_f - glm::compMax(throughput));
-                    if (rng.u() < q) {
-                        break;
-                    }
-                    throughput /= 1_f - q;
+                if (!roulette::survive(roulette_.get(), rng.u(), throughput, num_verts)) {
+                    break;
                 }
 
                 // --------------------------------------------------------------------------------
@@ -353,6 +545,7 @@ public:
                 wi = -s->wo;
                 sp = sd->sp;
                 comp = s_comp.comp;
+                seg_prev = sp.is_type(SceneInteraction::MediumInteraction) ? seg : std::nullopt;
             }
         });
 
@@ -363,7 +556,12 @@ public:
         film_->rescale(1_f / processed);
         #endif
 
-        return { {"processed", processed}, {"elapsed", st.now()} };
+        const auto elapsed = st.now();
+        return profiler::attach_stats({
+            {"processed", processed},
+            {"elapsed", elapsed},
+            {"ray_stats", ray_stats.to_json(elapsed)}
+        });
     }
 };
 
@@ -0,0 +1,342 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include <lm/core.h>
+#include <lm/parallel.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+// Atomic floating point value which can be copied when no thread updates it
+class AtomicFloat {
+private:
+    std::atomic<Float> v_;
+
+public:
+    AtomicFloat(Float v = 0_f) : v_(v) {}
+    AtomicFloat(const AtomicFloat& o) : v_(o.load()) {}
+    AtomicFloat& operator=(const AtomicFloat& o) {
+        v_.store(o.load(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    Float load() const {
+        return v_.load(std::memory_order_relaxed);
+    }
+
+    void add(Float d) {
+        auto expected = v_.load(std::memory_order_relaxed);
+        while (!v_.compare_exchange_weak(expected, expected + d, std::memory_order_relaxed));
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// Directional quadtree of the incident radiance.
+// Directions are mapped to [0,1]^2 with the cylindrical mapping,
+// which preserves the area, i.e., the PDF in the solid angle measure is the PDF in [0,1]^2 divided by 4pi.
+// Each node stores the energy of its four quadrants. A quadrant without child is a leaf.
+class DTree {
+private:
+    static constexpr int MaxDepth = 20;
+
+    struct Node {
+        AtomicFloat sum[4];
+        int children[4] = { 0, 0, 0, 0 };  // 0 for leaf since the root is never a child
+    };
+
+    std::vector<Node> nodes_ = std::vector<Node>(1);
+    AtomicFloat weight_;                    // Number of the recorded samples
+
+private:
+    static int quadrant(Vec2& p) {
+        const int c = (p.x >= .5_f ? 1 : 0) | (p.y >= .5_f ? 2 : 0);
+        p = glm::min(p * 2_f - Vec2(c & 1, c >> 1), Vec2(1_f - Eps));
+        return c;
+    }
+
+    Float node_sum(int i) const {
+        const auto& s = nodes_[i].sum;
+        return s[0].load() + s[1].load() + s[2].load() + s[3].load();
+    }
+
+public:
+    // Map direction to [0,1]^2
+    static Vec2 dir_to_canonical(Vec3 d) {
+        const auto cos_theta = glm::clamp(d.z, -1_f, 1_f);
+        auto phi = std::atan2(d.y, d.x);
+        if (phi < 0_f) {
+            phi += 2_f * Pi;
+        }
+        return glm::clamp(Vec2((cos_theta + 1_f) * .5_f, phi / (2_f * Pi)), Vec2(0_f), Vec2(1_f - Eps));
+    }
+
+    // Map [0,1]^2 to direction
+    static Vec3 canonical_to_dir(Vec2 p) {
+        const auto cos_theta = 2_f * p.x - 1_f;
+        const auto sin_theta = math::safe_sqrt(1_f - cos_theta * cos_theta);
+        const auto phi = 2_f * Pi * p.y;
+        return { sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta };
+    }
+
+    Float weight() const {
+        return weight_.load();
+    }
+
+    int num_nodes() const {
+        return int(nodes_.size());
+    }
+
+    // Accumulate the energy of the direction. Safe to call concurrently.
+    void record(Vec3 d, Float v) {
+        weight_.add(1_f);
+        if (!(v > 0_f) || !std::isfinite(v)) {
+            return;
+        }
+        auto p = dir_to_canonical(d);
+        int i = 0;
+        while (true) {
+            const int c = quadrant(p);
+            nodes_[i].sum[c].add(v);
+            const int child = nodes_[i].children[c];
+            if (child == 0) {
+                break;
+            }
+            i = child;
+        }
+    }
+
+    // Sample a direction proportional to the energy
+    Vec3 sample(Vec2 u) const {
+        if (!(node_sum(0) > 0_f)) {
+            return canonical_to_dir(u);
+        }
+        Vec2 origin(0_f);
+        Float scale = 1_f;
+        int i = 0;
+        while (true) {
+            const auto& s = nodes_[i].sum;
+            const Float s0 = s[0].load(), s1 = s[1].load(), s2 = s[2].load(), s3 = s[3].load();
+            const Float total = s0 + s1 + s2 + s3;
+
+            // Select the half in x, then the quadrant in the half, reusing the random numbers
+            int c = 0;
+            const Float px = (s1 + s3) / total;
+            if (u.x < 1_f - px) {
+                u.x /= 1_f - px;
+                const Float py = s2 / (s0 + s2);
+                if (u.y < 1_f - py) { u.y /= 1_f - py; }
+                else                { u.y = (u.y - (1_f - py)) / py; c = 2; }
+            }
+            else {
+                u.x = (u.x - (1_f - px)) / px;
+                const Float py = s3 / (s1 + s3);
+                c = 1;
+                if (u.y < 1_f - py) { u.y /= 1_f - py; }
+                else                { u.y = (u.y - (1_f - py)) / py; c = 3; }
+            }
+            u = glm::clamp(u, Vec2(0_f), Vec2(1_f - Eps));
+
+            scale *= .5_f;
+            origin += scale * Vec2(c & 1, c >> 1);
+            const int child = nodes_[i].children[c];
+            if (child == 0) {
+                return canonical_to_dir(origin + scale * u);
+            }
+            i = child;
+        }
+    }
+
+    // Evaluate PDF in solid angle measure
+    Float pdf(Vec3 d) const {
+        const Float root_sum = node_sum(0);
+        if (!(root_sum > 0_f)) {
+            return 1_f / (4_f * Pi);
+        }
+        auto p = dir_to_canonical(d);
+        Float result = 1_f;
+        Float total = root_sum;
+        int i = 0;
+        while (true) {
+            const int c = quadrant(p);
+            const Float sc = nodes_[i].sum[c].load();
+            if (sc <= 0_f) {
+                return 0_f;
+            }
+            result *= 4_f * sc / total;
+            const int child = nodes_[i].children[c];
+            if (child == 0) {
+                break;
+            }
+            total = node_sum(child);
+            i = child;
+        }
+        return result / (4_f * Pi);
+    }
+
+    // Rebuild the structure by subdividing the quadrants whose fraction of the energy
+    // exceeds the threshold, and reset the recorded energy.
+    void refine(Float threshold) {
+        const Float total = node_sum(0);
+        struct Entry {
+            int new_index;      // Index of the new node
+            int old_index;      // Index of the corresponding old node. -1 if not exists
+            Float energy;       // Energy of the node
+            int depth;
+        };
+        std::vector<Node> nodes(1);
+        std::vector<Entry> stack{ { 0, 0, total, 1 } };
+        while (!stack.empty()) {
+            const auto e = stack.back();
+            stack.pop_back();
+            for (int c = 0; c < 4; c++) {
+                // Energy of the quadrant. We assume uniform distribution inside the old leaves.
+                const Float ec = e.old_index >= 0 ? nodes_[e.old_index].sum[c].load() : e.energy * .25_f;
+                if (!(total > 0_f) || ec / total <= threshold || e.depth >= MaxDepth) {
+                    continue;
+                }
+                const int old_child = e.old_index >= 0 && nodes_[e.old_index].children[c] != 0
+                    ? nodes_[e.old_index].children[c] : -1;
+                nodes.emplace_back();
+                const int new_child = int(nodes.size()) - 1;
+                nodes[e.new_index].children[c] = new_child;
+                stack.push_back({ new_child, old_child, ec, e.depth + 1 });
+            }
+        }
+        nodes_ = std::move(nodes);
+        weight_ = 0_f;
+    }
+
+    // Halve the weight, used when the spatial cell is split
+    void halve_weight() {
+        weight_ = weight_.load() * .5_f;
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// Spatio-directional tree (SD-tree) of the incident radiance [Muller2017].
+// The spatial binary tree splits the bound of the scene alternating the axes,
+// and each leaf holds two directional quadtrees:
+// one for sampling, which is fixed during a training iteration,
+// and one being built from the samples of the current iteration.
+// The samples of the iteration are recorded concurrently without locks,
+// and the tree is refined between the iterations.
+class SDTree {
+private:
+    static constexpr int MaxDepth = 60;
+
+    struct Node {
+        int axis = 0;
+        int children[2] = { 0, 0 };     // 0 for leaf since the root is never a child
+        int dtree = -1;                 // Index of the directional trees for leaf
+    };
+
+    struct DTrees {
+        DTree sampling;
+        DTree building;
+    };
+
+    Vec3 origin_{};
+    Float size_ = 1_f;
+    std::vector<Node> nodes_;
+    std::vector<DTrees> dtrees_;
+
+private:
+    // Find the leaf containing the point
+    int leaf(Vec3 p) const {
+        p = glm::clamp((p - origin_) / size_, Vec3(0_f), Vec3(1_f - Eps));
+        int i = 0;
+        while (nodes_[i].children[0] != 0) {
+            const int axis = nodes_[i].axis;
+            const int c = p[axis] < .5_f ? 0 : 1;
+            p[axis] = glm::min(p[axis] * 2_f - Float(c), 1_f - Eps);
+            i = nodes_[i].children[c];
+        }
+        return nodes_[i].dtree;
+    }
+
+public:
+    // Initialize the tree with a single leaf covering the bound
+    void init(const Bound& bound) {
+        // Use a cube so that the cells are not elongated after alternating splits
+        const auto extent = bound.max - bound.min;
+        size_ = glm::max(glm::compMax(extent), Eps);
+        origin_ = bound.min;
+        nodes_.assign(1, {});
+        nodes_[0].dtree = 0;
+        dtrees_.assign(1, {});
+    }
+
+    int num_spatial_nodes() const {
+        return int(nodes_.size());
+    }
+
+    // Record the energy of the incident direction at the point. Safe to call concurrently.
+    void record(Vec3 p, Vec3 d, Float v) {
+        dtrees_[leaf(p)].building.record(d, v);
+    }
+
+    // Sample an incident direction at the point
+    Vec3 sample(Vec3 p, Vec2 u) const {
+        return dtrees_[leaf(p)].sampling.sample(u);
+    }
+
+    // Evaluate the PDF of the incident direction at the point in solid angle measure
+    Float pdf(Vec3 p, Vec3 d) const {
+        return dtrees_[leaf(p)].sampling.pdf(d);
+    }
+
+    // Refine the tree at the end of the iteration.
+    // The leaves with more samples than spatial_threshold are split,
+    // and the recorded distributions become the distributions for sampling.
+    void refine(Float spatial_threshold, Float directional_threshold) {
+        // Split the spatial cells
+        struct Entry { int index; int depth; };
+        std::vector<Entry> stack{ { 0, 1 } };
+        while (!stack.empty()) {
+            const auto e = stack.back();
+            stack.pop_back();
+            if (nodes_[e.index].children[0] != 0) {
+                stack.push_back({ nodes_[e.index].children[0], e.depth + 1 });
+                stack.push_back({ nodes_[e.index].children[1], e.depth + 1 });
+                continue;
+            }
+            const int d = nodes_[e.index].dtree;
+            if (dtrees_[d].building.weight() <= spatial_threshold || e.depth >= MaxDepth) {
+                continue;
+            }
+
+            // Children inherit the distribution with the half of the samples
+            dtrees_[d].building.halve_weight();
+            const int axis = nodes_[e.index].axis;
+            auto copied = dtrees_[d];
+            dtrees_.push_back(std::move(copied));
+            const int d1 = int(dtrees_.size()) - 1;
+            for (int c = 0; c < 2; c++) {
+                Node child;
+                child.axis = (axis + 1) % 3;
+                child.dtree = c == 0 ? d : d1;
+                nodes_.push_back(child);
+                nodes_[e.index].children[c] = int(nodes_.size()) - 1;
+            }
+            nodes_[e.index].dtree = -1;
+
+            // Visit the children again since they can still contain too many samples
+            stack.push_back({ nodes_[e.index].children[0], e.depth + 1 });
+            stack.push_back({ nodes_[e.index].children[1], e.depth + 1 });
+        }
+
+        // Update the directional trees
+        parallel::foreach(dtrees_.size(), [&](long long i, int) {
+            auto& t = dtrees_[i];
+            t.sampling = t.building;
+            t.building.refine(directional_threshold);
+        });
+    }
+};
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,105 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include <lm/core.h>
+#include <lm/film.h>
+#include <lm/parallel.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+// Per-thread buffer of the splats to arbitrary pixels of a film.
+// The splats of light tracing strategies hit random pixels,
+// so splatting them directly causes scattered atomic updates of the film.
+// The buffer collects the splats of each thread in a small batch,
+// sorts the batch by the tile of the film, merges the splats to the same pixel,
+// and flushes them into the film in that order.
+// A batch size of 0 disables the buffering.
+class SplatBuffer {
+private:
+    // Size of the square tile used for the ordering of the splats
+    static constexpr int TileBits = 5;
+    static constexpr int TileSize = 1 << TileBits;
+
+    struct Splat {
+        long long key;  // Index of the tile and the pixel in the tile
+        int x;
+        int y;
+        Vec3 v;
+    };
+
+    struct alignas(64) Batch {
+        std::vector<Splat> splats;
+    };
+
+private:
+    Film* film_;
+    int batch_size_;
+    int num_tiles_x_;
+    std::vector<Batch> batches_;
+
+public:
+    SplatBuffer(Film* film, int batch_size)
+        : film_(film)
+        , batch_size_(batch_size)
+        , num_tiles_x_((film->size().w + TileSize - 1) / TileSize)
+        , batches_(batch_size > 0 ? parallel::num_threads() : 0)
+    {
+        for (auto& batch : batches_) {
+            batch.splats.reserve(batch_size_);
+        }
+    }
+
+    ~SplatBuffer() {
+        flush_all();
+    }
+
+    // Splat the color to the raster position from the thread
+    void splat(int threadid, Vec2 rp, Vec3 v) {
+        if (batch_size_ <= 0) {
+            film_->splat(rp, v);
+            return;
+        }
+        const auto p = film_->raster_to_pixel(rp);
+        const long long tile = (long long)(p.y >> TileBits) * num_tiles_x_ + (p.x >> TileBits);
+        const int local = ((p.y & (TileSize-1)) << TileBits) | (p.x & (TileSize-1));
+        auto& splats = batches_[threadid].splats;
+        splats.push_back({ (tile << (2*TileBits)) | local, p.x, p.y, v });
+        if (int(splats.size()) >= batch_size_) {
+            flush(threadid);
+        }
+    }
+
+    // Flush the batch of the thread.
+    // This function must be called from the thread owning the batch.
+    void flush(int threadid) {
+        auto& splats = batches_[threadid].splats;
+        std::sort(splats.begin(), splats.end(), [](const Splat& a, const Splat& b) {
+            return a.key < b.key;
+        });
+        for (size_t i = 0; i < splats.size();) {
+            // Merge the splats to the same pixel
+            Vec3 v = splats[i].v;
+            size_t j = i + 1;
+            for (; j < splats.size() && splats[j].key == splats[i].key; j++) {
+                v += splats[j].v;
+            }
+            film_->splat_pixel(splats[i].x, splats[i].y, v);
+            i = j;
+        }
+        splats.clear();
+    }
+
+    // Flush the batches of all threads.
+    // This function must not be called concurrently with splat().
+    void flush_all() {
+        for (int i = 0; i < int(batches_.size()); i++) {
+            flush(i);
+        }
+    }
+};
+
+LM_NAMESPACE_END(LM_NAMESPACE)
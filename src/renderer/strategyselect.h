@@ -0,0 +1,136 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#pragma once
+
+#include <lm/core.h>
+#include <lm/parallel.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+// Adaptive selection of the strategies of bidirectional renderers.
+// The selector records the second moment of the MIS-weighted contribution of each strategy (s,t)
+// and estimates the efficiency of the strategy as sqrt(second moment / cost),
+// where the cost is the number of rays traced by the evaluation (1 plus 1 for the connection ray).
+// At the end of each pass, the strategies whose efficiency is below threshold times
+// the most efficient strategy of the same path length are evaluated with the probability
+// proportional to the efficiency, clamped to [min_prob, 1].
+// The contribution of a selected strategy is divided by the probability (Russian roulette),
+// so the estimate stays unbiased with the MIS weights evaluated for all strategies.
+// The statistics are separated for each thread so that the renderers update them without atomics.
+class StrategySelector {
+private:
+    // Minimum number of evaluations of a strategy to adapt the probability
+    static constexpr long long MinEvals = 16;
+
+    struct alignas(64) Stats {
+        std::vector<double> m2;         // Sum of the squared luminance of the contributions
+        std::vector<long long> evals;   // Number of evaluations
+    };
+
+private:
+    bool enabled_;
+    int n_;                     // Number of the indices per subpath (max_verts + 1)
+    Float threshold_;
+    Float min_prob_;
+    std::vector<Stats> stats_;
+    std::vector<Float> probs_;  // Selection probabilities indexed by s*n+t
+
+public:
+    StrategySelector(bool enabled, int max_verts, Float threshold, Float min_prob)
+        : enabled_(enabled)
+        , n_(max_verts + 1)
+        , threshold_(threshold)
+        , min_prob_(min_prob)
+        , stats_(enabled ? parallel::num_threads() : 0)
+        , probs_(size_t(n_) * n_, 1_f)
+    {
+        for (auto& st : stats_) {
+            st.m2.assign(probs_.size(), 0);
+            st.evals.assign(probs_.size(), 0);
+        }
+    }
+
+    // Select if the strategy (s,t) is evaluated with a uniform random number u.
+    // Returns the inverse of the selection probability, or 0 if the strategy is skipped.
+    Float select(int s, int t, Float u) const {
+        if (!enabled_) {
+            return 1_f;
+        }
+        const auto q = probs_[index(s, t)];
+        return q >= 1_f ? 1_f : u < q ? 1_f / q : 0_f;
+    }
+
+    // Record the MIS-weighted contribution of a selected strategy.
+    // The contribution must not include the inverse of the selection probability.
+    void record(int threadid, int s, int t, Vec3 C) {
+        if (!enabled_) {
+            return;
+        }
+        auto& st = stats_[threadid];
+        const auto l = double(math::luminance(C));
+        st.m2[index(s, t)] += l * l;
+        st.evals[index(s, t)]++;
+    }
+
+    // Update the selection probabilities from the recorded statistics.
+    // This function must not be called concurrently with record().
+    void update() {
+        if (!enabled_) {
+            return;
+        }
+        std::vector<double> eff(probs_.size(), -1);
+        for (int s = 0; s < n_; s++) {
+            for (int t = 0; s + t < n_; t++) {
+                const int i = index(s, t);
+                double m2 = 0;
+                long long evals = 0;
+                for (const auto& st : stats_) {
+                    m2 += st.m2[i];
+                    evals += st.evals[i];
+                }
+                if (evals >= MinEvals) {
+                    const double cost = s > 0 && t > 0 ? 2 : 1;
+                    eff[i] = std::sqrt(m2 / double(evals) / cost);
+                }
+            }
+        }
+        for (int k = 0; k < n_; k++) {
+            double max_eff = 0;
+            for (int s = 0; s <= k; s++) {
+                max_eff = std::max(max_eff, eff[index(s, k - s)]);
+            }
+            for (int s = 0; s <= k; s++) {
+                const auto e = eff[index(s, k - s)];
+                if (e < 0 || max_eff <= 0) {
+                    continue;
+                }
+                const auto q = Float(e / (double(threshold_) * max_eff));
+                probs_[index(s, k - s)] = glm::clamp(q, min_prob_, 1_f);
+            }
+        }
+    }
+
+    // Selection probabilities of the strategies below 1 for the statistics of the renderer
+    Json to_json() const {
+        Json j = Json::object();
+        for (int s = 0; s < n_; s++) {
+            for (int t = 0; s + t < n_; t++) {
+                const auto q = probs_[index(s, t)];
+                if (q < 1_f) {
+                    j[fmt::format("{}_{}", s, t)] = q;
+                }
+            }
+        }
+        return j;
+    }
+
+private:
+    int index(int s, int t) const {
+        return s * n_ + t;
+    }
+};
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,30 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/roulette.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: roulette::none
+
+    No Russian roulette.
+
+    The paths are terminated only by the maximum number of vertices of the renderers.
+\endrst
+*/
+class Roulette_None final : public Roulette {
+public:
+    virtual Float continuation(Vec3, int) const override {
+        return 1_f;
+    }
+};
+
+LM_COMP_REG_IMPL(Roulette_None, "roulette::none");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
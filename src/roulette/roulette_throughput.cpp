@@ -0,0 +1,57 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/roulette.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: roulette::throughput
+
+    Russian roulette based on the throughput of the path.
+
+    :param int min_verts: Number of vertices before the roulette is applied. Default value: 5.
+    :param float max_prob: Maximum survival probability. Default value: 0.8.
+    :param float min_prob: Minimum survival probability. Default value: 0.
+
+    The path survives with the probability of the maximum component of its throughput
+    clamped by ``[min_prob, max_prob]``.
+    The paths carrying little energy are terminated early.
+    The default values reproduce the roulette used by the renderers before the policy was configurable.
+    Setting ``max_prob`` to 1 keeps the paths with large throughput without termination.
+\endrst
+*/
+class Roulette_Throughput final : public Roulette {
+private:
+    int min_verts_;
+    Float max_prob_;
+    Float min_prob_;
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(min_verts_, max_prob_, min_prob_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        min_verts_ = json::value<int>(prop, "min_verts", 5);
+        max_prob_ = json::value<Float>(prop, "max_prob", .8_f);
+        min_prob_ = json::value<Float>(prop, "min_prob", 0_f);
+    }
+
+    virtual Float continuation(Vec3 throughput, int num_verts) const override {
+        if (num_verts <= min_verts_) {
+            return 1_f;
+        }
+        return glm::clamp(glm::compMax(throughput), min_prob_, max_prob_);
+    }
+};
+
+LM_COMP_REG_IMPL(Roulette_Throughput, "roulette::throughput");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
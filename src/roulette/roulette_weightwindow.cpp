@@ -0,0 +1,84 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/roulette.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: roulette::weight_window
+
+    Russian roulette and splitting with a weight window.
+
+    :param int min_verts: Number of vertices before the policy is applied. Default value: 1.
+    :param float reference: Expected contribution of the paths, e.g., the average pixel value.
+                            Default value: 1.
+    :param float lower: Lower bound of the window relative to the reference. Default value: 0.5.
+    :param float upper: Upper bound of the window relative to the reference. Default value: 2.
+    :param int max_splits: Maximum number of splits. Default value: 5.
+
+    The policy keeps the throughput of the paths within the window
+    ``[lower*reference, upper*reference]`` measured by the average of the components.
+    The paths below the window are terminated by Russian roulette
+    so that the survivors have the throughput at the center of the window,
+    and the paths above the window are split so that the split paths
+    have the throughput at the center of the window [Vorba2016]_.
+    Compared to ``roulette::throughput``, the paths are terminated depending on
+    how much they can contribute to the image rather than their absolute throughput,
+    which improves the efficiency when the reference is close to the pixel values.
+    Renderers not supporting splitting apply only the Russian roulette.
+
+    .. [Vorba2016] J. Vorba, J. Křivánek, Adjoint-Driven Russian Roulette and Splitting
+                   in Light Transport Simulation, ACM TOG 35(4), 2016.
+\endrst
+*/
+class Roulette_WeightWindow final : public Roulette {
+private:
+    int min_verts_;
+    Float reference_;
+    Float lower_;
+    Float upper_;
+    int max_splits_;
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(min_verts_, reference_, lower_, upper_, max_splits_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        min_verts_ = json::value<int>(prop, "min_verts", 1);
+        reference_ = json::value<Float>(prop, "reference", 1_f);
+        lower_ = json::value<Float>(prop, "lower", .5_f);
+        upper_ = json::value<Float>(prop, "upper", 2_f);
+        max_splits_ = json::value<int>(prop, "max_splits", 5);
+        if (!(reference_ > 0_f) || !(lower_ > 0_f) || lower_ > upper_) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid weight window [reference='{}', lower='{}', upper='{}']", reference_, lower_, upper_);
+        }
+    }
+
+    virtual Float continuation(Vec3 throughput, int num_verts) const override {
+        if (num_verts <= min_verts_) {
+            return 1_f;
+        }
+        const auto w = glm::compAdd(throughput) / 3_f;
+        const auto center = reference_ * (lower_ + upper_) * .5_f;
+        if (w < lower_ * reference_) {
+            return w / center;
+        }
+        if (w > upper_ * reference_) {
+            return glm::min(w / center, Float(max_splits_));
+        }
+        return 1_f;
+    }
+};
+
+LM_COMP_REG_IMPL(Roulette_WeightWindow, "roulette::weight_window");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,83 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/sampler.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: sampler::halton
+
+    Randomized Halton sampler.
+
+    :param int seed: Random seed. If not specified, the seed is chosen randomly.
+
+    This sampler generates the Halton sequence indexed by the sample index,
+    where the dimension :math:`d` uses the radical inverse in the :math:`d`-th prime base.
+    Each pixel and dimension is randomized by Cranley-Patterson rotation
+    so that the pixels are not correlated.
+    Since the quality of the Halton sequence degrades in the large prime bases,
+    the dimensions above the table of the primes fall back to independent random numbers.
+\endrst
+*/
+class Sampler_Halton final : public Sampler {
+private:
+    // Prime bases of the dimensions
+    static constexpr int Primes[] = {
+        2,   3,   5,   7,   11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,  53,
+        59,  61,  67,  71,  73,  79,  83,  89,  97,  101, 103, 107, 109, 113, 127, 131,
+    };
+    static constexpr int NumDims = int(sizeof(Primes) / sizeof(Primes[0]));
+
+    unsigned int seed_ = 0;
+
+private:
+    // Radical inverse of the index in the given base
+    static Float radical_inverse(int base, unsigned long long index) {
+        const Float inv_base = 1_f / base;
+        unsigned long long reversed = 0;
+        Float inv_base_n = 1_f;
+        while (index > 0) {
+            const auto next = index / base;
+            const auto digit = index - next * base;
+            reversed = reversed * base + digit;
+            inv_base_n *= inv_base;
+            index = next;
+        }
+        return Float(reversed) * inv_base_n;
+    }
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(seed_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        const auto seed = json::value_or_none<unsigned int>(prop, "seed");
+        seed_ = seed ? *seed : math::rng_seed();
+    }
+
+    virtual Float u(long long pixel_index, long long sample_index, int dim) const override {
+        const auto h = sampler::hash(seed_, pixel_index, dim, 0);
+        if (dim >= NumDims) {
+            return sampler::to_unit(sampler::hash(h, sample_index, 0, 0));
+        }
+
+        // Cranley-Patterson rotation of the radical inverse
+        auto x = radical_inverse(Primes[dim], sample_index) + sampler::to_unit(h);
+        if (x >= 1_f) {
+            x -= 1_f;
+        }
+        return glm::min(x, std::nextafter(1_f, 0_f));
+    }
+};
+
+LM_COMP_REG_IMPL(Sampler_Halton, "sampler::halton");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
@@ -0,0 +1,46 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/sampler.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: sampler::random
+
+    Independent random sampler.
+
+    :param int seed: Random seed. If not specified, the seed is chosen randomly.
+
+    This sampler generates independent uniform random numbers
+    by hashing the pixel index, the sample index, and the dimension.
+\endrst
+*/
+class Sampler_Random final : public Sampler {
+private:
+    unsigned int seed_ = 0;
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(seed_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        const auto seed = json::value_or_none<unsigned int>(prop, "seed");
+        seed_ = seed ? *seed : math::rng_seed();
+    }
+
+    virtual Float u(long long pixel_index, long long sample_index, int dim) const override {
+        return sampler::to_unit(sampler::hash(seed_, pixel_index, sample_index, dim));
+    }
+};
+
+LM_COMP_REG_IMPL(Sampler_Random, "sampler::random");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
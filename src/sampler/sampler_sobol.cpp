@@ -0,0 +1,142 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/core.h>
+#include <lm/sampler.h>
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE)
+
+/*
+\rst
+.. function:: sampler::sobol
+
+    Owen-scrambled Sobol sampler.
+
+    :param int seed: Random seed. If not specified, the seed is chosen randomly.
+
+    This sampler implements the shuffled and Owen-scrambled Sobol sequence
+    with the hash-based nested uniform scrambling [Burley 2020].
+    The dimensions are grouped by four and each group is generated from
+    the four-dimensional Sobol sequence with the scrambling seeded by the
+    pixel index and the index of the group.
+    The scrambling of the sample index (shuffling) decorrelates the groups,
+    and the points of each pixel are still well stratified
+    when the number of samples is a power of two.
+\endrst
+*/
+class Sampler_Sobol final : public Sampler {
+private:
+    // Number of dimensions of the underlying Sobol sequence
+    static constexpr int NumDims = 4;
+
+    // Direction numbers of the Sobol sequence
+    using Directions = std::array<std::array<uint32_t, 32>, NumDims>;
+
+    unsigned int seed_ = 0;
+
+private:
+    // Generate direction numbers from the primitive polynomials [Joe and Kuo 2008]
+    static Directions make_directions() {
+        struct Param {
+            int s;              // Degree of the primitive polynomial
+            int a;              // Coefficients of the primitive polynomial
+            uint32_t m[3];      // Initial direction numbers
+        };
+        static const Param params[NumDims - 1] = {
+            { 1, 0, { 1 } },
+            { 2, 1, { 1, 3 } },
+            { 3, 1, { 1, 3, 1 } },
+        };
+        Directions dirs;
+
+        // The first dimension is the van der Corput sequence
+        for (int i = 0; i < 32; i++) {
+            dirs[0][i] = 1u << (31 - i);
+        }
+
+        for (int d = 1; d < NumDims; d++) {
+            const auto& p = params[d - 1];
+            auto& v = dirs[d];
+            for (int i = 0; i < 32; i++) {
+                if (i < p.s) {
+                    v[i] = p.m[i] << (31 - i);
+                    continue;
+                }
+                v[i] = v[i - p.s] ^ (v[i - p.s] >> p.s);
+                for (int k = 1; k < p.s; k++) {
+                    if ((p.a >> (p.s - 1 - k)) & 1) {
+                        v[i] ^= v[i - k];
+                    }
+                }
+            }
+        }
+
+        return dirs;
+    }
+
+    static uint32_t reverse_bits(uint32_t x) {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Hash function approximating Owen scrambling on bit-reversed integers [Laine and Karras 2011]
+    static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(seed_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        const auto seed = json::value_or_none<unsigned int>(prop, "seed");
+        seed_ = seed ? *seed : math::rng_seed();
+    }
+
+    virtual Float u(long long pixel_index, long long sample_index, int dim) const override {
+        static const auto dirs = make_directions();
+
+        // Seed of the group of dimensions
+        const auto h = sampler::hash(seed_, pixel_index, dim / NumDims, 0);
+        const auto seed_shuffle = (uint32_t)(h);
+        const auto seed_scramble = (uint32_t)(h >> 32);
+
+        // Shuffled sample index
+        const auto index = nested_uniform_scramble((uint32_t)(sample_index), seed_shuffle);
+
+        // Sobol sequence
+        const auto& v = dirs[dim % NumDims];
+        uint32_t x = 0;
+        for (int i = 0; i < 32; i++) {
+            if (index & (1u << i)) {
+                x ^= v[i];
+            }
+        }
+
+        // Owen scrambling. Each dimension uses different seed.
+        x = nested_uniform_scramble(x, seed_scramble + (uint32_t)(dim % NumDims) * 0x9e3779b9u);
+
+        return sampler::to_unit((uint64_t)(x) << 32);
+    }
+};
+
+LM_COMP_REG_IMPL(Sampler_Sobol, "sampler::sobol");
+
+LM_NAMESPACE_END(LM_NAMESPACE)
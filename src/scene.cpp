@@ -7,29 +7,194 @@
 #include <lm/core.h>
 #include <lm/scene.h>
 #include <lm/accel.h>
+#include <lm/assetgroup.h>
 #include <lm/mesh.h>
 #include <lm/camera.h>
 #include <lm/material.h>
+#include <lm/texture.h>
 #include <lm/light.h>
 #include <lm/model.h>
 #include <lm/medium.h>
 #include <lm/phase.h>
+#include <lm/volume.h>
+#include <lm/profiler.h>
+#include <lm/trace.h>
+#include <lm/parallel.h>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
+namespace {
+
+// 64-bit FNV-1a hash for the cache key of the acceleration structure
+class Hash {
+private:
+    std::uint64_t h_ = 14695981039346656037ull;
+
+public:
+    template <typename T>
+    void add(const T& v) {
+        static_assert(std::is_trivially_copyable_v<T>, "Hashed type must be trivially copyable");
+        const auto* p = reinterpret_cast<const unsigned char*>(&v);
+        for (size_t i = 0; i < sizeof(T); i++) {
+            h_ ^= p[i];
+            h_ *= 1099511628211ull;
+        }
+    }
+    void add(const std::string& s) {
+        for (char c : s) {
+            add(c);
+        }
+    }
+    std::uint64_t value() const {
+        return h_;
+    }
+};
+
+}
+
+/*
+\rst
+.. function:: scene::default
+
+    Default scene.
+
+    :param str accel: Locator to the acceleration structure.
+    :param str accel_cache_dir: Directory for the cache of the acceleration structure.
+                                The cache is disabled if not specified.
+    :param str light_selection: Strategy to select a light for the light sampling.
+                                ``uniform`` (default), ``power``, or ``bvh``.
+    :param float alpha_cutoff: Alpha value below which the surfaces with alpha masks are cut out.
+                               Default value: 0.5.
+    :param int build_threads: Number of threads used by the background build (:cpp:func:`lm::Scene::build_async`).
+                              Default value: 0, which uses all threads.
+
+    With ``uniform``, all lights are selected with the same probability.
+    With ``power``, the lights are selected proportional to the power.
+    With ``bvh``, the direct endpoint sampling traverses a light BVH from the shading point,
+    where each node is selected proportional to the power divided by the squared distance
+    to the node [Conty Estevez and Kulla 2018].
+    The infinite lights are selected with the probability proportional to the number of lights,
+    counting the lights in the BVH as one.
+    The other light sampling operations of ``bvh`` fall back to ``power``.
+
+    The primitives whose materials have alpha masks (:cpp:func:`lm::Material::alpha_mask`)
+    are cut out where the alpha value is less than ``alpha_cutoff``.
+    The ray queries ignore the intersections with the cut-out parts,
+    so that the renderers do not need to continue the paths through them.
+    The texture coordinates of the masked triangles are cached in the scene.
+    The alpha test is resolved inside the traversal of the acceleration structure
+    if supported (:cpp:func:`lm::Accel::set_alpha_test`).
+    Otherwise the scene repeats the queries from the rejected intersections.
+
+    With :cpp:func:`lm::Scene::build_async`, the scene is built on a background thread
+    with the thread budget of ``build_threads`` (see :cpp:func:`lm::parallel::set_thread_budget`),
+    so that the caller can load the other assets with the remaining threads.
+\endrst
+*/
 class Scene_ final : public Scene {
 private:
+    // Strategy of light selection
+    enum class LightSelection {
+        Uniform,
+        Power,
+        BVH,
+    };
+
+    // Node of light BVH
+    struct LightBVHNode {
+        Bound bound;        // Bound of the lights in the node
+        Float power;        // Sum of the power of the lights in the node
+        int parent;         // Parent node index. -1 for the root node.
+        bool leaf;          // True if the node is leaf
+        int index;          // Light index if leaf, otherwise the index of the second child.
+                            // The first child is always next to the node.
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(bound, power, parent, leaf, index);
+        }
+    };
+
+    // Node of medium BVH
+    struct MediumBVHNode {
+        Bound bound;        // Bound of the media in the node
+        bool leaf;          // True if the node is leaf
+        int index;          // Medium node index if leaf, otherwise the index of the second child.
+                            // The first child is always next to the node.
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(bound, leaf, index);
+        }
+    };
+
     Accel* accel_;                                   // Acceleration structure
     std::vector<SceneNode> nodes_;                   // Scene nodes (index 0: root node)
     std::optional<int> camera_;                      // Camera index
     std::vector<LightPrimitiveIndex> lights_;        // Primitive node indices of lights and global transforms
     std::unordered_map<int, int> light_indices_map_; // Map from node indices to light indices.
     std::optional<int> env_light_;                   // Environment light index
-    std::optional<int> medium_;                      // Medium index
+    std::optional<int> medium_;                      // Medium index of the first medium
+    std::vector<int> media_;                         // Medium indices
+    std::vector<MediumBVHNode> medium_bvh_nodes_;    // Nodes of medium BVH
+    std::vector<int> unbounded_media_;               // Medium indices of the media not in medium BVH
+    std::string accel_cache_dir_;                    // Directory for the cache of acceleration structure
+    LightSelection light_selection_ = LightSelection::Uniform;  // Strategy of light selection
+    Dist light_dist_;                                // Distribution of lights proportional to the power
+    std::vector<LightBVHNode> light_bvh_nodes_;      // Nodes of light BVH
+    std::vector<int> light_bvh_leaves_;              // Map from light indices to leaf nodes. -1 for unbounded lights.
+    std::vector<int> unbounded_lights_;              // Light indices of the lights not in light BVH
+    std::optional<Bound> bound_;                     // Scene bound set to the lights
+    int build_threads_ = 0;                          // Thread budget of the background build. 0 to use all threads.
+    mutable std::shared_future<void> build_future_;  // Build running in background
+
+    // Changes of the scene since the last build.
+    // The replacements of the assets are tracked by the revision of the asset group of the scene.
+    int pending_changes_ = SceneChange::All;
+    int assets_revision_ = 0;
+
+    // Nodes traversed from the root in depth-first order with the global transforms.
+    // The traversal is cached until the scene graph is modified,
+    // so that the scene and the acceleration structures share the same flattened nodes.
+    struct FlattenedNode {
+        int index;
+        Mat4 global_transform;
+    };
+    mutable std::mutex flattened_mutex_;
+    mutable std::vector<FlattenedNode> flattened_nodes_;
+    mutable bool flattened_valid_ = false;
+
+    // Alpha masks of the primitives.
+    // The masks are collected lazily on the first query after the structure is built or loaded,
+    // because the weak references to the materials are not resolved during deserialization.
+    struct AlphaMask {
+        const Texture* texture;     // Alpha mask texture
+        std::vector<Vec2> ts;       // Texture coordinates of the vertices of the triangles
+    };
+    Float alpha_cutoff_ = .5_f;                         // Alpha value below which the surfaces are cut out
+    mutable std::mutex alpha_mutex_;
+    mutable std::atomic<bool> alpha_valid_ = false;     // True if the alpha masks are collected
+    mutable bool alpha_fallback_ = false;               // Resolve the alpha test by repeating the queries
+    mutable std::vector<int> alpha_mask_indices_;       // Map from node indices to alpha masks. -1 if not masked.
+    mutable std::vector<AlphaMask> alpha_masks_;        // Alpha masks
+
+public:
+    virtual ~Scene_() {
+        // The background build must not outlive the scene
+        try {
+            wait_build();
+        }
+        catch (...) {}
+    }
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(accel_, nodes_, camera_, lights_, light_indices_map_, env_light_);
+        wait_build();
+        invalidate_flattened_nodes();
+        ar(accel_, nodes_, camera_, lights_, light_indices_map_, env_light_,
+            light_selection_, light_dist_, light_bvh_nodes_, light_bvh_leaves_, unbounded_lights_, alpha_cutoff_,
+            medium_, media_, medium_bvh_nodes_, unbounded_media_);
+        alpha_valid_ = false;
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visit) override {
@@ -44,23 +209,95 @@ public:
         }
     }
 
+    virtual size_t memory_usage() const override {
+        std::unique_lock<std::mutex> lock(flattened_mutex_);
+        return comp::bytes_of(nodes_, lights_, light_bvh_nodes_, light_bvh_leaves_, unbounded_lights_, flattened_nodes_,
+                media_, medium_bvh_nodes_, unbounded_media_)
+            + light_dist_.memory_usage();
+    }
+
 public:
     virtual void construct(const Json& prop) override {
         accel_ = json::comp_ref_or_nullptr<Accel>(prop, "accel");
+        accel_cache_dir_ = json::value<std::string>(prop, "accel_cache_dir", "");
+        {
+            const auto s = json::value<std::string>(prop, "light_selection", "uniform");
+            if (s == "uniform")    light_selection_ = LightSelection::Uniform;
+            else if (s == "power") light_selection_ = LightSelection::Power;
+            else if (s == "bvh")   light_selection_ = LightSelection::BVH;
+            else {
+                LM_THROW_EXCEPTION(Error::InvalidArgument,
+                    "Invalid light selection strategy [light_selection='{}']", s);
+            }
+        }
+        alpha_cutoff_ = json::value<Float>(prop, "alpha_cutoff", .5_f);
+        build_threads_ = json::value<int>(prop, "build_threads", 0);
         reset();
     }
 
 public:
     virtual void reset() override {
+        wait_build();
         nodes_.clear();
         camera_ = {};
         lights_.clear();
         light_indices_map_.clear();
         env_light_ = {};
         medium_ = {};
+        media_.clear();
+        medium_bvh_nodes_.clear();
+        unbounded_media_.clear();
+        light_dist_.clear();
+        light_bvh_nodes_.clear();
+        light_bvh_leaves_.clear();
+        unbounded_lights_.clear();
         nodes_.push_back(SceneNode::make_group(0, false, {}));
+        invalidate_flattened_nodes();
+        pending_changes_ |= SceneChange::Geometry;
+        mark_dirty();
+        alpha_valid_ = false;
+    }
+
+private:
+    void invalidate_flattened_nodes() {
+        std::unique_lock<std::mutex> lock(flattened_mutex_);
+        flattened_valid_ = false;
+        flattened_nodes_.clear();
+    }
+
+    // Traverse the scene graph and flatten the nodes if the cache is invalid
+    const std::vector<FlattenedNode>& flattened_nodes() const {
+        std::unique_lock<std::mutex> lock(flattened_mutex_);
+        if (flattened_valid_) {
+            return flattened_nodes_;
+        }
+        LM_TRACE_SCOPE("scene::flatten");
+        flattened_nodes_.clear();
+        // Explicit stack to support deep hierarchies.
+        // The children are pushed in reverse to keep the order of the recursive traversal.
+        std::vector<FlattenedNode> stack{ { 0, Mat4(1_f) } };
+        while (!stack.empty()) {
+            const auto curr = stack.back();
+            stack.pop_back();
+            flattened_nodes_.push_back(curr);
+            const auto& node = nodes_.at(curr.index);
+            if (node.type != SceneNodeType::Group) {
+                continue;
+            }
+            const auto M = node.group.local_transform
+                ? curr.global_transform * *node.group.local_transform
+                : curr.global_transform;
+            const auto& children = node.group.children;
+            for (auto it = children.rbegin(); it != children.rend(); ++it) {
+                stack.push_back({ *it, M });
+            }
+        }
+        flattened_valid_ = true;
+        return flattened_nodes_;
     }
 
+public:
+
     // --------------------------------------------------------------------------------------------
 
     #pragma region Scene graph manipulation and access
@@ -69,7 +306,18 @@ public:
         return 0;
     }
 
-    virtual int create_primitive_node(const Json& prop) override {
+private:
+    // Assets referenced by a primitive node
+    struct PrimitiveAssets {
+        Mesh* mesh;
+        Material* material;
+        Light* light;
+        Camera* camera;
+        Medium* medium;
+    };
+
+    // Resolve and validate the assets of a primitive node given by the property
+    PrimitiveAssets primitive_assets(const Json& prop) const {
         // Find an asset by property name
         const auto get_asset_ref_by = [&](const std::string& propName) -> Component * {
             const auto it = prop.find(propName);
@@ -79,9 +327,6 @@ public:
             return comp::get<Component>(it.value().get<std::string>());
         };
 
-        // Node index
-        const int index = int(nodes_.size());
-
         // Get asset references
         auto* mesh = dynamic_cast<Mesh*>(get_asset_ref_by("mesh"));
         auto* material = dynamic_cast<Material*>(get_asset_ref_by("material"));
@@ -102,13 +347,21 @@ public:
             LM_THROW_EXCEPTION(Error::InvalidArgument, "You must specify both mesh and material.");
         }
 
+        return { mesh, material, light, camera, medium };
+    }
+
+    // Create a primitive node with the resolved assets
+    int push_primitive_node(const PrimitiveAssets& a) {
+        // Node index
+        const int index = int(nodes_.size());
+
         // Camera
-        if (camera) {
+        if (a.camera) {
             camera_ = index;
         }
 
         // Envlight
-        if (light && light->is_env()) {
+        if (a.light && a.light->is_env()) {
             if (env_light_) {
                 LM_THROW_EXCEPTION(Error::InvalidArgument, "Environment light is already registered. "
                     "You can register only one environment light in the scene.");
@@ -116,27 +369,44 @@ public:
             env_light_ = index;
         }
 
-        // Medium
-        if (medium) {
-            // For now, consider the medium as global asset.
-            medium_ = index;
+        // Medium.
+        // The media are defined in world space irrespective of the transformation of the node.
+        if (a.medium) {
+            if (!medium_) {
+                medium_ = index;
+            }
+            media_.push_back(index);
         }
 
         // Create primitive node
-        nodes_.push_back(SceneNode::make_primitive(index, mesh, material, light, camera, medium));
+        nodes_.push_back(SceneNode::make_primitive(index, a.mesh, a.material, a.light, a.camera, a.medium));
+        return index;
+    }
 
+public:
+    virtual int create_primitive_node(const Json& prop) override {
+        const int index = push_primitive_node(primitive_assets(prop));
+        invalidate_flattened_nodes();
+        pending_changes_ |= SceneChange::Geometry;
+        mark_dirty();
         return index;
     }
 
     virtual int create_group_node(Mat4 transform) override {
         const int index = int(nodes_.size());
         nodes_.push_back(SceneNode::make_group(index, false, transform));
+        invalidate_flattened_nodes();
+        pending_changes_ |= SceneChange::Geometry;
+        mark_dirty();
         return index;
     }
 
     virtual int create_instance_group_node() override {
         const int index = int(nodes_.size());
         nodes_.push_back(SceneNode::make_group(index, true, {}));
+        invalidate_flattened_nodes();
+        pending_changes_ |= SceneChange::Geometry;
+        mark_dirty();
         return index;
     }
 
@@ -153,6 +423,78 @@ public:
         }
 
         node.group.children.push_back(child);
+        invalidate_flattened_nodes();
+        pending_changes_ |= SceneChange::Geometry;
+        mark_dirty();
+    }
+
+    virtual int create_group_nodes(int n, const Mat4* transforms) override {
+        if (n <= 0) {
+            return -1;
+        }
+        const int first = int(nodes_.size());
+        nodes_.reserve(nodes_.size() + n);
+        for (int i = 0; i < n; i++) {
+            nodes_.push_back(SceneNode::make_group(first + i, false, transforms[i]));
+        }
+        invalidate_flattened_nodes();
+        pending_changes_ |= SceneChange::Geometry;
+        mark_dirty();
+        return first;
+    }
+
+    virtual void add_children(int parent, int n, const int* children) override {
+        if (parent < 0 || parent >= int(nodes_.size())) {
+            LM_ERROR("Missing parent index [index='{}'", parent);
+            return;
+        }
+
+        auto& node = nodes_.at(parent);
+        if (node.type != SceneNodeType::Group) {
+            LM_ERROR("Adding child to non-group node [parent='{}']", parent);
+            return;
+        }
+
+        node.group.children.insert(node.group.children.end(), children, children + n);
+        invalidate_flattened_nodes();
+        pending_changes_ |= SceneChange::Geometry;
+        mark_dirty();
+    }
+
+    virtual void add_transformed_primitives(const std::vector<Json>& props, int n, const Mat4* transforms, const int* prop_indices) override {
+        LM_TRACE_SCOPE("scene::add_transformed_primitives");
+        for (int i = 0; i < n; i++) {
+            if (prop_indices[i] < 0 || prop_indices[i] >= int(props.size())) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument,
+                    "Invalid property index [index='{}', num_props='{}']", prop_indices[i], props.size());
+            }
+        }
+
+        // Resolve the assets of each property once.
+        // The properties with a model are expanded by add_child_from_model for each primitive.
+        std::vector<std::optional<PrimitiveAssets>> assets(props.size());
+        for (size_t j = 0; j < props.size(); j++) {
+            if (props[j].find("model") == props[j].end()) {
+                assets[j] = primitive_assets(props[j]);
+            }
+        }
+
+        nodes_.reserve(nodes_.size() + 2*size_t(n));
+        std::vector<int> groups(n);
+        for (int i = 0; i < n; i++) {
+            const int t = int(nodes_.size());
+            nodes_.push_back(SceneNode::make_group(t, false, transforms[i]));
+            const auto& a = assets[prop_indices[i]];
+            if (a) {
+                const int p = push_primitive_node(*a);
+                nodes_.at(t).group.children.push_back(p);
+            }
+            else {
+                add_child_from_model(t, props[prop_indices[i]]["model"]);
+            }
+            groups[i] = t;
+        }
+        add_children(root_node(), n, groups.data());
     }
 
     virtual void add_child_from_model(int parent, const std::string& modelLoc) override {
@@ -166,6 +508,12 @@ public:
             return;
         }
 
+        // Copy the scene graph if the meshes are shared by the instances
+        if (model->has_instances()) {
+            add_child(parent, create_group_from_model(modelLoc));
+            return;
+        }
+
         model->create_primitives([&](Component* mesh, Component* material, Component* light) {
             const int index = int(nodes_.size());
             nodes_.push_back(SceneNode::make_primitive(
@@ -209,24 +557,18 @@ public:
                 }
             }
         });
+        invalidate_flattened_nodes();
+        pending_changes_ |= SceneChange::Geometry;
+        mark_dirty();
 
         return offset;
     }
 
     virtual void traverse_primitive_nodes(const NodeTraverseFunc& traverseFunc) const override {
-        std::function<void(int, Mat4)> visit = [&](int index, Mat4 global_transform) {
-            const auto& node = nodes_.at(index);
-            traverseFunc(node, global_transform);
-            if (node.type == SceneNodeType::Group) {
-                const auto M = node.group.local_transform
-                    ? global_transform * *node.group.local_transform
-                    : global_transform;
-                for (int child : node.group.children) {
-                    visit(child, M);
-                }
-            }
-        };
-        visit(0, Mat4(1_f));
+        // The scene graph must not be modified inside the callback
+        for (const auto& n : flattened_nodes()) {
+            traverseFunc(nodes_[n.index], n.global_transform);
+        }
     }
 
     virtual void visit_node(int node_index, const VisitNodeFunc& visit) const override {
@@ -249,6 +591,15 @@ public:
         return camera_ ? *camera_ : -1;
     }
 
+    virtual void set_camera_node(int node_index) override {
+        if (node_index < 0 || node_index >= int(nodes_.size())
+            || nodes_[node_index].type != SceneNodeType::Primitive || !nodes_[node_index].primitive.camera) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid camera node [index='{}']", node_index);
+        }
+        camera_ = node_index;
+        mark_dirty();
+    }
+
     virtual int medium_node() const override {
         return medium_ ? *medium_ : -1;
     }
@@ -257,6 +608,57 @@ public:
         return (int)(lights_.size());
     }
 
+    virtual void traverse_media(Ray ray, Float tmin, Float tmax, const MediumFunc& func) const override {
+        // Collect the media overlapping the ray segment
+        struct Overlap {
+            int index;
+            Float t0;
+            Float t1;
+        };
+        thread_local std::vector<Overlap> overlaps;
+        overlaps.clear();
+        const auto add_overlap = [&](int index, const Bound& bound) {
+            Float t0 = tmin;
+            Float t1 = tmax;
+            if (bound.isect_range(ray, t0, t1)) {
+                overlaps.push_back({ index, t0, t1 });
+            }
+        };
+        for (int index : unbounded_media_) {
+            add_overlap(index, nodes_[index].primitive.medium->bound());
+        }
+        if (!medium_bvh_nodes_.empty()) {
+            int stack[64];
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const int index = stack[--top];
+                const auto& node = medium_bvh_nodes_[index];
+                if (node.leaf) {
+                    add_overlap(node.index, node.bound);
+                    continue;
+                }
+                Float t0 = tmin;
+                Float t1 = tmax;
+                if (!node.bound.isect_range(ray, t0, t1)) {
+                    continue;
+                }
+                stack[top++] = index + 1;
+                stack[top++] = node.index;
+            }
+        }
+
+        // Visit the media in the order of the distances to the bounds
+        std::sort(overlaps.begin(), overlaps.end(), [](const Overlap& o1, const Overlap& o2) {
+            return o1.t0 < o2.t0;
+        });
+        for (const auto& o : overlaps) {
+            if (!func(o.index, o.t0, o.t1)) {
+                break;
+            }
+        }
+    }
+
     #pragma endregion
 
     // --------------------------------------------------------------------------------------------
@@ -269,9 +671,221 @@ public:
 
     virtual void set_accel(const std::string& accel_loc) override {
         accel_ = comp::get<Accel>(accel_loc);
+        alpha_valid_ = false;
+        mark_dirty();
     }
 
     virtual void build() override {
+        wait_build();
+        build_stages();
+    }
+
+    virtual std::shared_future<void> build_async() override {
+        wait_build();
+        const int threads = build_threads_;
+        build_future_ = std::async(std::launch::async, [this, threads]() {
+            // The build runs with the reserved threads while the caller continues to load the assets
+            parallel::ScopedThreadBudget budget(threads > 0 ? threads : parallel::num_threads());
+            build_stages();
+        }).share();
+        return build_future_;
+    }
+
+    virtual void wait_build() const override {
+        if (!build_future_.valid()) {
+            return;
+        }
+        // Clear the future before waiting so that the exception is rethrown only once
+        const auto f = std::move(build_future_);
+        build_future_ = {};
+        f.get();
+    }
+
+private:
+    // Build stages of the scene
+    void build_stages() {
+        alpha_valid_ = false;
+        take_changes();
+        update_lights_and_bound();
+        build_medium_bvh();
+
+        // Build acceleration structure.
+        // The hash of the geometries is computed only if the cache is enabled.
+        const auto cache_path = accel_cache_dir_.empty()
+            ? std::string()
+            : (fs::path(accel_cache_dir_) / fmt::format("{:016x}.accel", geometry_hash())).string();
+        if (!cache_path.empty() && fs::exists(cache_path)) {
+            LM_INFO("Loading acceleration structure from cache [name='{}', path='{}']", accel_->name(), cache_path);
+            LM_INDENT();
+            if (accel_->load_cache(cache_path)) {
+                return;
+            }
+            LM_INFO("Cache is not compatible. Rebuilding.");
+        }
+        {
+            LM_INFO("Building acceleration structure [name='{}']", accel_->name());
+            LM_INDENT();
+            LM_PROFILE_SCOPE(AccelBuild);
+            LM_TRACE_SCOPE("accel::build");
+            accel_->build(*this);
+        }
+        if (!cache_path.empty()) {
+            if (!fs::exists(accel_cache_dir_)) {
+                fs::create_directories(accel_cache_dir_);
+            }
+            if (accel_->save_cache(cache_path)) {
+                LM_INFO("Saved acceleration structure to cache [path='{}']", cache_path);
+            }
+        }
+    }
+
+public:
+    virtual void update() override {
+        wait_build();
+        alpha_valid_ = false;
+        if (take_changes() & SceneChange::Geometry) {
+            // Geometries can not be updated by the acceleration structure
+            pending_changes_ |= SceneChange::Geometry;
+        }
+        update_lights_and_bound();
+        build_medium_bvh();
+
+        // Update acceleration structure
+        LM_INFO("Updating acceleration structure [name='{}']", accel_->name());
+        LM_INDENT();
+        accel_->update(*this);
+    }
+
+    virtual void set_transform(int node_index, Mat4 transform) override {
+        if (node_index < 0 || node_index >= int(nodes_.size()) || nodes_[node_index].type != SceneNodeType::Group) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid group node [index='{}']", node_index);
+        }
+        nodes_[node_index].group.local_transform = transform;
+        invalidate_flattened_nodes();
+        pending_changes_ |= SceneChange::Transform;
+        mark_dirty();
+    }
+
+    virtual void notify_changes(int changes) override {
+        pending_changes_ |= changes;
+        // The modified assets are not known, so all the assets are written to the next checkpoint
+        if (auto* group = asset_group(); group) {
+            group->mark_dirty();
+        }
+        mark_dirty();
+    }
+
+    virtual void commit_changes() override {
+        wait_build();
+        const int changes = pending_changes_ | replaced_asset_changes();
+        if (changes & SceneChange::Geometry) {
+            build();
+            return;
+        }
+        if (changes & SceneChange::Transform) {
+            update();
+            return;
+        }
+        take_changes();
+        if (changes & SceneChange::Material) {
+            // Alpha masks are collected again on the next query
+            alpha_valid_ = false;
+        }
+        if (changes & SceneChange::Light) {
+            LM_INFO("Rebuilding light selection");
+            if (!bound_) {
+                update_lights_and_bound();
+            }
+            else {
+                for (auto& l : lights_) {
+                    nodes_.at(l.index).primitive.light->set_scene_bound(*bound_);
+                }
+                build_light_selection();
+            }
+        }
+        if (changes & SceneChange::Medium) {
+            build_medium_bvh();
+        }
+        // Cameras are evaluated on rendering, so nothing is rebuilt for the changes of the camera
+    }
+
+private:
+    // Asset group containing the scene
+    AssetGroup* asset_group() const {
+        const auto& l = loc();
+        const auto i = l.rfind('.');
+        return i == std::string::npos ? nullptr : comp::get<AssetGroup>(l.substr(0, i));
+    }
+
+    // Classify the assets replaced since the last build
+    int replaced_asset_changes() const {
+        const auto* group = asset_group();
+        if (!group) {
+            return SceneChange::None;
+        }
+        int changes = SceneChange::None;
+        for (const auto& asset_loc : group->replaced_since(assets_revision_)) {
+            auto* asset = comp::get<Component>(asset_loc);
+            if (dynamic_cast<Mesh*>(asset) || dynamic_cast<Model*>(asset) || dynamic_cast<Accel*>(asset)) {
+                changes |= SceneChange::Geometry;
+            }
+            else if (dynamic_cast<Material*>(asset)) {
+                changes |= SceneChange::Material;
+            }
+            else if (dynamic_cast<Texture*>(asset)) {
+                // Textures are referred by both materials and environment lights
+                changes |= SceneChange::Material | SceneChange::Light;
+            }
+            else if (dynamic_cast<Light*>(asset)) {
+                changes |= SceneChange::Light;
+            }
+            else if (dynamic_cast<Camera*>(asset)) {
+                changes |= SceneChange::Camera;
+            }
+            else if (dynamic_cast<Medium*>(asset) || dynamic_cast<Phase*>(asset) || dynamic_cast<Volume*>(asset)) {
+                changes |= SceneChange::Medium;
+            }
+        }
+        return changes;
+    }
+
+    // Clear the changes of the scene and track the further replacements of the assets
+    int take_changes() {
+        // The built structures are a part of the state
+        mark_dirty();
+        const int changes = pending_changes_ | replaced_asset_changes();
+        pending_changes_ = SceneChange::None;
+        if (const auto* group = asset_group(); group) {
+            assets_revision_ = group->revision();
+        }
+        return changes;
+    }
+
+    // Hash of the transformed geometries and the settings of the acceleration structure
+    // used as the cache key of the acceleration structure
+    std::uint64_t geometry_hash() const {
+        Hash hash;
+        hash.add(accel_->key());
+        hash.add(accel_->cache_settings());
+        traverse_primitive_nodes([&](const SceneNode& node, Mat4 global_transform) {
+            if (node.type != SceneNodeType::Primitive || !node.primitive.mesh) {
+                return;
+            }
+            hash.add(node.index);
+            node.primitive.mesh->foreach_triangle_positions([&](int face, int num_faces, const Vec3* ps) {
+                for (int i = 0; i < num_faces; i++) {
+                    hash.add(face + i);
+                    for (int j = 0; j < 3; j++) {
+                        hash.add(global_transform * Vec4(ps[3*i+j], 1_f));
+                    }
+                }
+            });
+        });
+        return hash.value();
+    }
+
+    // Update light indices and the scene bound set to the lights
+    void update_lights_and_bound() {
         // Update light indices
         // We keep the global transformation of the light primitive as well as the references.
         // We need to recompute the indices when an update of the scene happens,
@@ -294,30 +908,311 @@ public:
             if (!node.primitive.mesh) {
                 return;
             }
-            node.primitive.mesh->foreach_triangle([&](int, const Mesh::Tri& tri) {
-                const auto p1 = global_transform * Vec4(tri.p1.p, 1_f);
-                const auto p2 = global_transform * Vec4(tri.p2.p, 1_f);
-                const auto p3 = global_transform * Vec4(tri.p3.p, 1_f);
-                bound = merge(bound, p1);
-                bound = merge(bound, p2);
-                bound = merge(bound, p3);
+            node.primitive.mesh->foreach_triangle_positions([&](int, int num_faces, const Vec3* ps) {
+                for (int i = 0; i < 3*num_faces; i++) {
+                    bound = merge(bound, global_transform * Vec4(ps[i], 1_f));
+                }
             });
         });
         
         // Set scene bound to the lights
+        bound_ = bound;
         for (auto& l : lights_) {
             auto* light = nodes_.at(l.index).primitive.light;
             light->set_scene_bound(bound);
         }
 
-        // Build acceleration structure
-        LM_INFO("Building acceleration structure [name='{}']", accel_->name());
-        LM_INDENT();
-        accel_->build(*this);
+        // Build the structures for light selection
+        build_light_selection();
+    }
+
+    // Build the distribution and BVH of the lights for light selection
+    void build_light_selection() {
+        light_dist_.clear();
+        light_bvh_nodes_.clear();
+        light_bvh_leaves_.clear();
+        unbounded_lights_.clear();
+        if (light_selection_ == LightSelection::Uniform || lights_.empty()) {
+            return;
+        }
+
+        // Power and bound of the lights
+        const int n = int(lights_.size());
+        std::vector<Float> powers(n);
+        std::vector<std::optional<Bound>> bounds(n);
+        for (int i = 0; i < n; i++) {
+            const auto& l = lights_[i];
+            const auto* light = nodes_.at(l.index).primitive.light;
+            powers[i] = std::max(0_f, light->power(l.global_transform));
+            bounds[i] = light->bound(l.global_transform);
+        }
+
+        // Distribution proportional to the power.
+        // Fall back to uniform distribution if no light has the power.
+        const bool has_power = std::any_of(powers.begin(), powers.end(), [](Float p) { return p > 0_f; });
+        for (int i = 0; i < n; i++) {
+            light_dist_.add(has_power ? powers[i] : 1_f);
+        }
+        light_dist_.norm();
+        if (light_selection_ != LightSelection::BVH) {
+            return;
+        }
+
+        // Separate the lights without bound
+        std::vector<int> indices;
+        for (int i = 0; i < n; i++) {
+            if (bounds[i]) {
+                indices.push_back(i);
+            }
+            else {
+                unbounded_lights_.push_back(i);
+            }
+        }
+        light_bvh_leaves_.assign(n, -1);
+        if (indices.empty()) {
+            return;
+        }
+
+        // Build light BVH by splitting the lights at the median of the centroids
+        // along the longest axis of the centroid bound
+        const std::function<int(int, int, int)> build = [&](int parent, int begin, int end) -> int {
+            const int index = int(light_bvh_nodes_.size());
+            light_bvh_nodes_.emplace_back();
+            if (end - begin == 1) {
+                const int li = indices[begin];
+                light_bvh_nodes_[index] = { *bounds[li], has_power ? powers[li] : 1_f, parent, true, li };
+                light_bvh_leaves_[li] = index;
+                return index;
+            }
+            Bound centroid_bound;
+            for (int i = begin; i < end; i++) {
+                centroid_bound = merge(centroid_bound, bounds[indices[i]]->center());
+            }
+            const auto extent = centroid_bound.max - centroid_bound.min;
+            const int axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+            const int mid = (begin + end) / 2;
+            std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end, [&](int i1, int i2) {
+                return bounds[i1]->center()[axis] < bounds[i2]->center()[axis];
+            });
+            const int c1 = build(index, begin, mid);
+            const int c2 = build(index, mid, end);
+            const auto& n1 = light_bvh_nodes_[c1];
+            const auto& n2 = light_bvh_nodes_[c2];
+            light_bvh_nodes_[index] = { merge(n1.bound, n2.bound), n1.power + n2.power, parent, false, c2 };
+            return index;
+        };
+        build(-1, 0, int(indices.size()));
+    }
+
+    // Build BVH of the media for the traversal of the media along rays
+    void build_medium_bvh() {
+        medium_bvh_nodes_.clear();
+        unbounded_media_.clear();
+
+        // Separate the media without finite bound
+        std::vector<int> indices;
+        for (int index : media_) {
+            const auto b = nodes_.at(index).primitive.medium->bound();
+            if (glm::all(glm::lessThan(glm::abs(b.min), Vec3(Inf))) && glm::all(glm::lessThan(glm::abs(b.max), Vec3(Inf)))) {
+                indices.push_back(index);
+            }
+            else {
+                unbounded_media_.push_back(index);
+            }
+        }
+        if (indices.empty()) {
+            return;
+        }
+
+        // Build medium BVH by splitting the media at the median of the centroids
+        // along the longest axis of the centroid bound, as the light BVH
+        std::vector<Bound> bounds(nodes_.size());
+        for (int index : indices) {
+            bounds[index] = nodes_[index].primitive.medium->bound();
+        }
+        const std::function<int(int, int)> build = [&](int begin, int end) -> int {
+            const int index = int(medium_bvh_nodes_.size());
+            medium_bvh_nodes_.emplace_back();
+            if (end - begin == 1) {
+                medium_bvh_nodes_[index] = { bounds[indices[begin]], true, indices[begin] };
+                return index;
+            }
+            Bound centroid_bound;
+            for (int i = begin; i < end; i++) {
+                centroid_bound = merge(centroid_bound, bounds[indices[i]].center());
+            }
+            const auto extent = centroid_bound.max - centroid_bound.min;
+            const int axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+            const int mid = (begin + end) / 2;
+            std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end, [&](int i1, int i2) {
+                return bounds[i1].center()[axis] < bounds[i2].center()[axis];
+            });
+            const int c1 = build(begin, mid);
+            const int c2 = build(mid, end);
+            medium_bvh_nodes_[index] = { merge(medium_bvh_nodes_[c1].bound, medium_bvh_nodes_[c2].bound), false, c2 };
+            return index;
+        };
+        build(0, int(indices.size()));
     }
 
+public:
     virtual std::optional<SceneInteraction> intersect(Ray ray, Float tmin, Float tmax) const override {
-        const auto hit = accel_->intersect(ray, tmin, tmax);
+        LM_PROFILE_SCOPE(Intersect);
+        return make_interaction(ray, tmax, intersect_accel(ray, math::robust_tmin(ray.o, tmin), tmax));
+    }
+
+    virtual std::optional<Hit> intersect_hit(Ray ray, Float tmin, Float tmax) const override {
+        LM_PROFILE_SCOPE(Intersect);
+        return make_hit(tmax, intersect_accel(ray, math::robust_tmin(ray.o, tmin), tmax));
+    }
+
+    virtual std::optional<SceneInteraction> intersect_cone(Ray ray, RayCone cone, Float tmin, Float tmax) const override {
+        LM_PROFILE_SCOPE(Intersect);
+        const auto hit = intersect_accel(ray, math::robust_tmin(ray.o, tmin), tmax);
+        auto sp = make_interaction(ray, tmax, hit);
+        if (!sp || sp->geom.infinite) {
+            return sp;
+        }
+
+        // Projected width of the cone on the surface
+        const auto cos = std::max(std::abs(glm::dot(sp->geom.gn, ray.d)), 1e-2_f);
+        const auto width = cone.width_at(hit->t) / cos;
+
+        // Convert to texture space with the ratio of the areas of the triangle
+        const auto tri = nodes_.at(hit->primitive).primitive.mesh->triangle_at(hit->face);
+        const auto M = Mat3(accel_->instance_transform(hit->instance).M);
+        const auto pa = glm::length(glm::cross(M * (tri.p2.p - tri.p1.p), M * (tri.p3.p - tri.p1.p)));
+        const auto te1 = tri.p2.t - tri.p1.t;
+        const auto te2 = tri.p3.t - tri.p1.t;
+        const auto ta = std::abs(te1.x * te2.y - te1.y * te2.x);
+        if (pa > 0_f) {
+            sp->geom.footprint = width * std::sqrt(ta / pa);
+        }
+        return sp;
+    }
+
+    virtual void intersect_n(int n, const Ray* rays, Float tmin, Float tmax, std::optional<SceneInteraction>* sps) const override {
+        LM_PROFILE_SCOPE(Intersect, n);
+        thread_local std::vector<std::optional<Accel::Hit>> hits;
+        hits.resize(n);
+        for (int i = 0; i < n; i++) {
+            tmin = math::robust_tmin(rays[i].o, tmin);
+        }
+        const bool fallback = alpha_test_fallback();
+        accel_->intersect_n(n, rays, tmin, tmax, hits.data());
+        for (int i = 0; i < n; i++) {
+            if (fallback && hits[i] && !alpha_test(hits[i]->primitive, hits[i]->face, hits[i]->uv)) {
+                hits[i] = intersect_accel(rays[i], next_tmin(hits[i]->t), tmax);
+            }
+            sps[i] = make_interaction(rays[i], tmax, hits[i]);
+        }
+    }
+
+    virtual bool occluded(Ray ray, Float tmin, Float tmax) const override {
+        LM_PROFILE_SCOPE(Visible);
+        tmin = math::robust_tmin(ray.o, tmin);
+        if (alpha_test_fallback()) {
+            return intersect_accel(ray, tmin, tmax).has_value();
+        }
+        return accel_->occluded(ray, tmin, tmax);
+    }
+
+    virtual void occluded_n(int n, const Ray* rays, Float tmin, const Float* tmax, bool* occluded) const override {
+        LM_PROFILE_SCOPE(Visible, n);
+        for (int i = 0; i < n; i++) {
+            tmin = math::robust_tmin(rays[i].o, tmin);
+        }
+        if (alpha_test_fallback()) {
+            for (int i = 0; i < n; i++) {
+                occluded[i] = intersect_accel(rays[i], tmin, tmax[i]).has_value();
+            }
+            return;
+        }
+        accel_->occluded_n(n, rays, tmin, tmax, occluded);
+    }
+
+private:
+    // Collect the alpha masks if not collected and set the alpha test to the acceleration structure.
+    // Returns true if the scene resolves the alpha test.
+    bool alpha_test_fallback() const {
+        if (alpha_valid_.load(std::memory_order_acquire)) {
+            return alpha_fallback_;
+        }
+        std::unique_lock<std::mutex> lock(alpha_mutex_);
+        if (alpha_valid_.load(std::memory_order_relaxed)) {
+            return alpha_fallback_;
+        }
+        alpha_mask_indices_.assign(nodes_.size(), -1);
+        alpha_masks_.clear();
+        std::vector<bool> masked(nodes_.size(), false);
+        for (const auto& node : nodes_) {
+            if (node.type != SceneNodeType::Primitive || !node.primitive.mesh || !node.primitive.material) {
+                continue;
+            }
+            const auto* texture = node.primitive.material->alpha_mask();
+            if (!texture) {
+                continue;
+            }
+            // Cache texture coordinates of the triangles to avoid the interpolation of the mesh
+            const auto* mesh = node.primitive.mesh;
+            AlphaMask mask{ texture, std::vector<Vec2>(3 * size_t(mesh->num_triangles())) };
+            for (int face = 0; face < mesh->num_triangles(); face++) {
+                const auto tri = mesh->triangle_at(face);
+                mask.ts[3*face] = tri.p1.t;
+                mask.ts[3*face+1] = tri.p2.t;
+                mask.ts[3*face+2] = tri.p3.t;
+            }
+            alpha_mask_indices_[node.index] = int(alpha_masks_.size());
+            alpha_masks_.push_back(std::move(mask));
+            masked[node.index] = true;
+        }
+        if (alpha_masks_.empty()) {
+            masked.clear();
+        }
+        const bool supported = accel_->set_alpha_test(masked, [this](int primitive, int face, Vec2 uv) {
+            return alpha_test(primitive, face, uv);
+        });
+        alpha_fallback_ = !alpha_masks_.empty() && !supported;
+        if (!alpha_masks_.empty()) {
+            LM_INFO("Alpha masks [primitives={}, resolved_by='{}']",
+                alpha_masks_.size(), supported ? accel_->key() : "scene");
+        }
+        alpha_valid_.store(true, std::memory_order_release);
+        return alpha_fallback_;
+    }
+
+    // Test the intersection against the alpha mask of the primitive
+    bool alpha_test(int primitive, int face, Vec2 uv) const {
+        const int i = alpha_mask_indices_[primitive];
+        if (i < 0) {
+            return true;
+        }
+        const auto& mask = alpha_masks_[i];
+        const auto* ts = &mask.ts[3*size_t(face)];
+        return mask.texture->eval_alpha(math::mix_barycentric(ts[0], ts[1], ts[2], uv)) >= alpha_cutoff_;
+    }
+
+    // Lower bound of the ray to continue the query from the rejected intersection
+    static Float next_tmin(Float t) {
+        return t * (1_f + Eps);
+    }
+
+    // Closest intersection of the acceleration structure, repeating the query
+    // from the intersections rejected by the alpha test if the scene resolves it
+    std::optional<Accel::Hit> intersect_accel(Ray ray, Float tmin, Float tmax) const {
+        const bool fallback = alpha_test_fallback();
+        auto hit = accel_->intersect(ray, tmin, tmax);
+        if (!fallback) {
+            return hit;
+        }
+        while (hit && !alpha_test(hit->primitive, hit->face, hit->uv)) {
+            hit = accel_->intersect(ray, next_tmin(hit->t), tmax);
+        }
+        return hit;
+    }
+
+    // Create hit record from the hit information of the acceleration structure
+    std::optional<Hit> make_hit(Float tmax, const std::optional<Accel::Hit>& hit) const {
         if (!hit) {
             // Use environment light when tmax = Inf
             if (tmax < Inf) {
@@ -326,28 +1221,25 @@ public:
             if (!env_light_) {
                 return {};
             }
-            return SceneInteraction::make_light_endpoint(
-                *env_light_,
-                PointGeometry::make_infinite(-ray.d));
+            return Hit{ Inf, {}, -1, *env_light_, -1 };
         }
-        const auto[t, uv, global_transform, primitiveIndex, face_index] = *hit;
-        const auto& primitive = nodes_.at(primitiveIndex).primitive;
-        const auto p = primitive.mesh->surface_point(face_index, uv);
-        return SceneInteraction::make_surface_interaction(
-            primitiveIndex,
-            PointGeometry::make_on_surface(
-                global_transform.M * Vec4(p.p, 1_f),
-                glm::normalize(global_transform.normal_M * p.n),
-                glm::normalize(global_transform.normal_M * p.gn),
-                p.t
-            )
-        );
+        return Hit{ hit->t, hit->uv, hit->instance, hit->primitive, hit->face };
+    }
+
+    // Create scene interaction from the hit information of the acceleration structure
+    std::optional<SceneInteraction> make_interaction(Ray ray, Float tmax, const std::optional<Accel::Hit>& hit) const {
+        const auto h = make_hit(tmax, hit);
+        if (!h) {
+            return {};
+        }
+        return interaction(ray, *h);
     }
 
     #pragma endregion
 
     // --------------------------------------------------------------------------------------------
 
+public:
     #pragma region Primitive type checking
 
     virtual bool is_light(const SceneInteraction& sp) const override {
@@ -372,6 +1264,13 @@ public:
     #pragma region Light sampling
 
     virtual LightSelectionSample sample_light_selection(Float u) const override {
+        if (light_selection_ != LightSelection::Uniform) {
+            const int i = light_dist_.sample(u);
+            return LightSelectionSample{
+                i,
+                light_dist_.pmf(i)
+            };
+        }
         const int n = int(lights_.size());
         const int i = glm::clamp(int(u * n), 0, n - 1);
         const auto pL = 1_f / n;
@@ -381,11 +1280,80 @@ public:
         };
     }
 
-    virtual Float pdf_light_selection(int) const override {
+    virtual Float pdf_light_selection(int light_index) const override {
+        if (light_selection_ != LightSelection::Uniform) {
+            return light_dist_.pmf(light_index);
+        }
         const int n = int(lights_.size());
         return 1_f / n;
     };
 
+    virtual LightSelectionSample sample_light_selection(const PointGeometry& geom, Float u) const override {
+        if (light_selection_ != LightSelection::BVH || geom.infinite) {
+            return sample_light_selection(u);
+        }
+
+        // Select unbounded lights
+        const auto p_unbounded = prob_unbounded_lights();
+        if (u < p_unbounded) {
+            const int n = int(unbounded_lights_.size());
+            const int i = glm::clamp(int(u / p_unbounded * n), 0, n - 1);
+            return LightSelectionSample{
+                unbounded_lights_[i],
+                p_unbounded / n
+            };
+        }
+
+        // Traverse light BVH
+        u = std::min((u - p_unbounded) / (1_f - p_unbounded), std::nextafter(1_f, 0_f));
+        Float p_sel = 1_f - p_unbounded;
+        int index = 0;
+        while (!light_bvh_nodes_[index].leaf) {
+            const int c1 = index + 1;
+            const int c2 = light_bvh_nodes_[index].index;
+            const auto p1 = prob_first_child(geom, c1, c2);
+            if (u < p1) {
+                u = u / p1;
+                p_sel *= p1;
+                index = c1;
+            }
+            else {
+                u = (u - p1) / (1_f - p1);
+                p_sel *= 1_f - p1;
+                index = c2;
+            }
+        }
+        return LightSelectionSample{
+            light_bvh_nodes_[index].index,
+            p_sel
+        };
+    }
+
+    virtual Float pdf_light_selection(const PointGeometry& geom, int light_index) const override {
+        if (light_selection_ != LightSelection::BVH || geom.infinite) {
+            return pdf_light_selection(light_index);
+        }
+
+        // Unbounded lights
+        const auto p_unbounded = prob_unbounded_lights();
+        int index = light_bvh_leaves_.at(light_index);
+        if (index < 0) {
+            return p_unbounded / int(unbounded_lights_.size());
+        }
+
+        // Trace back light BVH from the leaf
+        Float p_sel = 1_f - p_unbounded;
+        while (light_bvh_nodes_[index].parent >= 0) {
+            const int parent = light_bvh_nodes_[index].parent;
+            const int c1 = parent + 1;
+            const int c2 = light_bvh_nodes_[parent].index;
+            const auto p1 = prob_first_child(geom, c1, c2);
+            p_sel *= index == c1 ? p1 : 1_f - p1;
+            index = parent;
+        }
+        return p_sel;
+    }
+
     virtual LightPrimitiveIndex light_primitive_index_at(int light_index) const override {
         return lights_.at(light_index);
     }
@@ -394,6 +1362,29 @@ public:
         return light_indices_map_.at(node_index);
     }
 
+private:
+    // Probability to select unbounded lights, treating the lights in light BVH as a single light
+    Float prob_unbounded_lights() const {
+        const int n = int(unbounded_lights_.size());
+        return light_bvh_nodes_.empty() ? 1_f : Float(n) / (n + 1);
+    }
+
+    // Importance of light BVH node seen from the shading point
+    Float light_bvh_importance(const PointGeometry& geom, int index) const {
+        const auto& node = light_bvh_nodes_[index];
+        const auto d = geom.p - node.bound.center();
+        const auto r = (node.bound.max - node.bound.min) * .5_f;
+        return node.power / std::max(glm::dot(d, d), std::max(glm::dot(r, r), Eps));
+    }
+
+    // Probability to select the first child in light BVH traversal
+    Float prob_first_child(const PointGeometry& geom, int c1, int c2) const {
+        const auto i1 = light_bvh_importance(geom, c1);
+        const auto i2 = light_bvh_importance(geom, c2);
+        return i1 + i2 == 0_f ? .5_f : i1 / (i1 + i2);
+    }
+
+public:
     #pragma endregion
 };
 
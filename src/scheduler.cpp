@@ -4,105 +4,924 @@
 */
 
 #include <pch.h>
+#include <lm/core.h>
 #include <lm/scheduler.h>
 #include <lm/json.h>
 #include <lm/parallel.h>
 #include <lm/progress.h>
 #include <lm/serial.h>
 #include <lm/film.h>
+#include <lm/trace.h>
+#include <lm/user.h>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE::scheduler)
 
-// Sample-based SPPScheduler
-class Scheduler_SPP_Sample : public Scheduler {
+namespace {
+
+// Cancel token of a scheduler run.
+// The parallel loops of the run use the token, so that stopping the run, e.g., at the deadline,
+// does not cancel the loops of the other jobs running concurrently in the process.
+// The token is chained to the token of the calling thread, and the loops also check
+// the process-wide request by parallel::cancel(), so the requests from outside stop the run.
+// These requests are left for the requester to clear.
+// The loops fixing up the film after the run, e.g., Film::rescale(), disable the cancellation.
+class ScopedRunCancel {
+private:
+    parallel::CancelToken token_;
+    parallel::CancelToken* prev_;
+
+public:
+    ScopedRunCancel()
+        : token_(parallel::cancel_token())
+        , prev_(parallel::set_cancel_token(&token_))
+    {}
+
+    ~ScopedRunCancel() {
+        parallel::set_cancel_token(prev_);
+    }
+
+    LM_DISABLE_COPY_AND_MOVE(ScopedRunCancel)
+
+    // Stop the parallel loops of the run
+    void cancel() {
+        token_.cancel();
+    }
+
+    // Check if the run is cancelled
+    bool cancelled() {
+        return parallel::cancel_requested() || token_.cancelled();
+    }
+};
+
+// Deadline of time-based schedulers
+class Deadline {
+private:
+    using Clock = std::chrono::high_resolution_clock;
+    Clock::time_point start_;
+    double limit_;
+    mutable std::atomic<bool> reached_ = false;
+
+public:
+    Deadline(double limit)
+        : start_(Clock::now()), limit_(limit) {}
+
+    // Elapsed time in seconds
+    double elapsed() const {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(Clock::now() - start_).count() / 1000.0;
+    }
+
+    // Check if the deadline is reached
+    bool reached() const {
+        if (reached_) {
+            return true;
+        }
+        if (elapsed() > limit_) {
+            reached_ = true;
+        }
+        return reached_;
+    }
+
+    // Check the deadline once in a while to reduce the overhead of the clock.
+    // The function is intended to be called for each sample in the parallel loop.
+    bool reached_sampled() const {
+        constexpr int Interval = 64;
+        if (thread_local int count = 0; ++count >= Interval) {
+            count = 0;
+            return reached();
+        }
+        return reached_;
+    }
+};
+
+// Pixels rendered by the SPP schedulers.
+// The region is restricted by the crop window (region) in pixels [x0,y0,x1,y1)
+// and the pixel mask (mask), which is a film of the same size
+// whose pixels with positive values are rendered.
+// With merge (default), the pixels outside of the region keep the values of the film.
+// The renderers keep the film for the run (Scheduler::keep_film()) and normalize it by the spp,
+// so the scheduler clears the pixels in the region before the run
+// and scales the pixels outside of the region by the spp after the run.
+class RenderRegion {
+private:
+    std::optional<std::array<int, 4>> window_;  // Crop window
+    Film* mask_ = nullptr;                      // Pixel mask
+    bool merge_ = true;                         // Merge the rendered pixels into the film
+
+public:
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(window_, mask_, merge_);
+    }
+
+    void foreach_underlying(const Component::ComponentVisitor& visit) {
+        comp::visit(visit, mask_);
+    }
+
+    void construct(const Json& prop) {
+        if (const auto it = prop.find("region"); it != prop.end()) {
+            window_ = it->get<std::array<int, 4>>();
+            const auto [x0, y0, x1, y1] = *window_;
+            if (x0 < 0 || y0 < 0 || x1 <= x0 || y1 <= y0) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument,
+                    "Invalid render region [region='{}']", it->dump());
+            }
+        }
+        mask_ = json::comp_ref_or_nullptr<Film>(prop, "mask");
+        merge_ = json::value<bool>(prop, "merge", true);
+    }
+
+    // True if the pixels are restricted
+    bool restricted() const {
+        return window_ || mask_;
+    }
+
+    // True if the film is kept for the run
+    bool keep_film() const {
+        return restricted() && merge_;
+    }
+
+    // Indices of the rendered pixels in the scanline order
+    std::vector<long long> pixels(const Film* film) const {
+        const auto size = film->size();
+        std::vector<long long> ps;
+        if (!restricted()) {
+            ps.resize(film->num_pixels());
+            std::iota(ps.begin(), ps.end(), 0);
+            return ps;
+        }
+        const auto [x0, y0, x1, y1] = window_ ? *window_ : std::array<int, 4>{ 0, 0, size.w, size.h };
+        std::optional<FilmBuffer> mask;
+        if (mask_) {
+            const auto mask_size = mask_->size();
+            if (mask_size.w != size.w || mask_size.h != size.h) {
+                LM_THROW_EXCEPTION(Error::InvalidArgument,
+                    "Pixel mask must have the same size as the film [mask='{}x{}', film='{}x{}']",
+                    mask_size.w, mask_size.h, size.w, size.h);
+            }
+            mask = mask_->buffer();
+        }
+        for (int y = y0; y < std::min(y1, size.h); y++) {
+            for (int x = x0; x < std::min(x1, size.w); x++) {
+                const long long i = (long long)(y) * size.w + x;
+                if (mask && std::max({ mask->data[3*i], mask->data[3*i+1], mask->data[3*i+2] }) <= 0_f) {
+                    continue;
+                }
+                ps.push_back(i);
+            }
+        }
+        return ps;
+    }
+
+    // Clear the rendered pixels before the run
+    void begin(Film* film, const std::vector<long long>& ps) const {
+        if (!keep_film()) {
+            return;
+        }
+        const parallel::ScopedDisableCancel disable_cancel_;
+        const auto w = film->size().w;
+        parallel::foreach((long long)(ps.size()), [&](long long index, int) {
+            film->set_pixel(int(ps[index] % w), int(ps[index] / w), Vec3(0_f));
+        });
+    }
+
+    // Scale the pixels outside of the region by spp after the run, so that
+    // the normalization of the film by the renderer restores the original values
+    void end(Film* film, const std::vector<long long>& ps, long long spp) const {
+        if (!keep_film() || spp == 0) {
+            return;
+        }
+        const auto size = film->size();
+        std::vector<bool> rendered(film->num_pixels(), false);
+        for (const auto i : ps) {
+            rendered[i] = true;
+        }
+        const auto s = Float(spp);
+        const parallel::ScopedDisableCancel disable_cancel_;
+        parallel::foreach(film->num_pixels(), [&](long long index, int) {
+            if (rendered[index]) {
+                return;
+            }
+            film->update_pixel(int(index % size.w), int(index / size.w), [s](Vec3 v) { return v * s; });
+        });
+    }
+};
+
+// Rescale the pixels rendered with different numbers of samples after the run,
+// so that the renderer can normalize the film uniformly by the returned spp.
+// counts[i] is the number of samples dispatched for pixels[i].
+// If the renderer splats the samples only to their own pixels,
+// each pixel is rescaled according to its number of samples.
+// Otherwise a pixel receives the contributions of the samples of the other pixels,
+// so the rendered pixels are rescaled uniformly by the average number of samples.
+// Returns the maximum number of samples of the pixels.
+long long rescale_by_samples(Film* film, const std::vector<long long>& pixels, const std::vector<long long>& counts, bool nonlocal_splats) {
+    const auto spp = counts.empty() ? 0 : *std::max_element(counts.begin(), counts.end());
+    if (spp == 0) {
+        return 0;
+    }
+    if (std::all_of(counts.begin(), counts.end(), [&](long long n) { return n == spp; })) {
+        return spp;
+    }
+
+    // The deferred splats, e.g., thread-local buffers, must be merged before update_pixel().
+    // The pixels are rescaled even after the run is cancelled.
+    const parallel::ScopedDisableCancel disable_cancel_;
+    film->merge_splats();
+    const auto size = film->size();
+    const auto rescale_pixel = [&](long long pixel, Float s) {
+        film->update_pixel(int(pixel % size.w), int(pixel / size.w), [s](Vec3 v) { return v * s; });
+    };
+
+    if (nonlocal_splats) {
+        const auto total = std::accumulate(counts.begin(), counts.end(), 0ll);
+        const auto s = Float(spp) * Float(counts.size()) / Float(total);
+        parallel::foreach((long long)(pixels.size()), [&](long long index, int) {
+            rescale_pixel(pixels[index], s);
+        });
+        return spp;
+    }
+
+    std::atomic<long long> empty = 0;
+    parallel::foreach((long long)(pixels.size()), [&](long long index, int) {
+        const auto n = counts[index];
+        if (n == 0) {
+            empty++;
+            return;
+        }
+        if (n < spp) {
+            rescale_pixel(pixels[index], Float(spp) / n);
+        }
+    });
+    if (empty > 0) {
+        LM_WARN("Pixels without samples are left black [pixels={}]", empty.load());
+    }
+    return spp;
+}
+
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Range of the sample indices [begin, end) processed by a run.
+// The range splits a job into disjoint slices rendered independently, e.g., on multiple nodes.
+// Since the renderers seed the random numbers from the global sample indices,
+// a slice gives the same samples as the corresponding part of the full run.
+// The run of a slice returns the total number of samples of the job,
+// so that the films normalized by the renderers add up to the result of the full run
+// with Film::accum().
+class SampleRange {
+private:
+    long long begin_ = 0;
+    long long end_ = 0;
+
+public:
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(begin_, end_);
+    }
+
+    // Construct from sample_begin and sample_end given the total number of samples
+    void construct(const Json& prop, long long total) {
+        begin_ = json::value<long long>(prop, "sample_begin", 0);
+        end_ = json::value<long long>(prop, "sample_end", total);
+        if (begin_ < 0 || end_ < begin_ || total < end_) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid sample range [sample_begin='{}', sample_end='{}', total='{}']",
+                begin_, end_, total);
+        }
+    }
+
+    long long begin() const {
+        return begin_;
+    }
+
+    long long size() const {
+        return end_ - begin_;
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// Base class of the schedulers processing the samples in multiple passes.
+// The scheduler records the progress at the end of each pass and saves it with the state,
+// so that a run restored from a checkpoint continues from the last finished pass.
+// The continued passes use the same sample indices as the uninterrupted run,
+// thus with the counter-based random numbers of the renderers the result is the same
+// as the uninterrupted run up to the order of the accumulation to the film.
+// Optionally, the scheduler writes the checkpoints at the end of the passes,
+// compressed with the level of checkpoint_compression if it is positive.
+class Scheduler_Progressive : public Scheduler {
+protected:
+    // Progress of an unfinished run
+    struct Progress {
+        long long processed = 0;    // Processed spp or samples of the finished passes
+        double elapsed = 0;         // Elapsed time of the finished passes in seconds
+    };
+
+private:
+    using Clock = std::chrono::high_resolution_clock;
+    std::string checkpoint_;            // Path of the checkpoint. Empty if disabled.
+    double checkpoint_interval_;        // Minimum interval between the checkpoints in seconds
+    int checkpoint_compression_;        // Compression level of the checkpoints. 0 if disabled.
+    mutable Progress progress_;
+    mutable Clock::time_point start_;   // Start time of the run
+    mutable double start_elapsed_;      // Elapsed time of the resumed passes
+    mutable double last_checkpoint_;    // Elapsed time at the last checkpoint
+
+public:
+    LM_SERIALIZE_IMPL(ar) {
+        ar(checkpoint_, checkpoint_interval_, checkpoint_compression_, progress_.processed, progress_.elapsed);
+    }
+
+    virtual void construct(const Json& prop) override {
+        checkpoint_ = json::value<std::string>(prop, "checkpoint", "");
+        checkpoint_interval_ = json::value<Float>(prop, "checkpoint_interval", 0_f);
+        checkpoint_compression_ = json::value<int>(prop, "checkpoint_compression", 0);
+    }
+
+    virtual bool resuming() const override {
+        return progress_.processed > 0;
+    }
+
+protected:
+    // Start the run and get the progress to continue from
+    Progress begin_run() const {
+        start_ = Clock::now();
+        start_elapsed_ = progress_.elapsed;
+        last_checkpoint_ = progress_.elapsed;
+        if (resuming()) {
+            LM_INFO("Resuming unfinished run [processed={}, elapsed={:.2f}s]",
+                progress_.processed, progress_.elapsed);
+        }
+        return progress_;
+    }
+
+    // Elapsed time in seconds including the resumed passes
+    double elapsed() const {
+        using namespace std::chrono;
+        return start_elapsed_ + duration_cast<milliseconds>(Clock::now() - start_).count() / 1000.0;
+    }
+
+    // Record the progress at the end of a pass and write the checkpoint if requested.
+    // No worker touches the film here so the checkpoint is consistent.
+    void end_pass(long long processed) const {
+        progress_ = { processed, elapsed() };
+        mark_dirty();
+        if (checkpoint_.empty() || progress_.elapsed - last_checkpoint_ < checkpoint_interval_) {
+            return;
+        }
+        LM_TRACE_SCOPE("scheduler::checkpoint");
+        last_checkpoint_ = progress_.elapsed;
+        save_checkpoint(checkpoint_, {
+            {"processed", progress_.processed},
+            {"elapsed", progress_.elapsed}
+        }, checkpoint_compression_);
+    }
+
+    // Clear the progress when the run finishes.
+    // The progress of the finished passes is kept if the run is cancelled.
+    void end_run(bool cancelled = false) const {
+        if (cancelled) {
+            return;
+        }
+        progress_ = {};
+        mark_dirty();
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// Sample-based SPPScheduler.
+// The samples are processed in passes of spp_per_pass samples per pixel.
+// By default all samples are processed in a single pass.
+// sample_begin and sample_end restrict the run to the range of the sample indices per pixel
+// (see SampleRange).
+class Scheduler_SPP_Sample : public Scheduler_Progressive {
+private:
+    long long spp_;
+    long long spp_per_pass_;
+    Film* film_;
+    RenderRegion region_;
+    SampleRange range_;
+
+public:
+    LM_SERIALIZE_IMPL_WITH_PARENT(ar, Scheduler_Progressive) {
+        ar(spp_, spp_per_pass_, film_, region_, range_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, film_);
+        region_.foreach_underlying(visit);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        Scheduler_Progressive::construct(prop);
+        spp_ = json::value<long long>(prop, "spp");
+        spp_per_pass_ = json::value<long long>(prop, "spp_per_pass", spp_);
+        film_ = json::comp_ref<Film>(prop, "output");
+        region_.construct(prop);
+        range_.construct(prop, spp_);
+        if (spp_per_pass_ <= 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "spp_per_pass must be positive [spp_per_pass='{}']", spp_per_pass_);
+        }
+    }
+
+    virtual long long run(const ProcessFunc& process) const override {
+        return run(process, [](long long) {});
+    }
+
+    virtual bool keep_film() const override {
+        return resuming() || region_.keep_film();
+    }
+
+    virtual long long run(const ProcessFunc& process, const PassFunc& pass_func) const override {
+        const auto pixels = region_.pixels(film_);
+        const auto numPixels = (long long)(pixels.size());
+        const auto range_spp = range_.size();
+        progress::ScopedReport progress_ctx_(numPixels * range_spp);
+        ScopedRunCancel cancel_ctx_;
+
+        long long spp = begin_run().processed;
+        if (spp == 0) {
+            region_.begin(film_, pixels);
+        }
+        bool cancelled = false;
+        while (spp < range_spp) {
+            LM_TRACE_SCOPE("scheduler::pass");
+            // Parallel loop for each pixel
+            const auto n = std::min(spp_per_pass_, range_spp - spp);
+            const auto sample_offset = range_.begin() + spp;
+            parallel::foreach(numPixels * n, [&](long long index, int threadid) {
+                process(pixels[index / n], sample_offset + index % n, threadid);
+            }, [&](long long processed) {
+                progress::update(numPixels * spp + processed);
+            });
+            if (cancel_ctx_.cancelled()) {
+                cancelled = true;
+                break;
+            }
+            spp += n;
+            end_pass(spp);
+            pass_func(spp);
+        }
+        end_run(cancelled);
+
+        // The cancelled run is normalized by the samples of the finished passes
+        const auto processed = cancelled ? spp : spp_;
+        if (processed == 0) {
+            return 0;
+        }
+        region_.end(film_, pixels, processed);
+
+        return processed;
+    }
+};
+
+LM_COMP_REG_IMPL(Scheduler_SPP_Sample, "scheduler::spp::sample");
+
+// ------------------------------------------------------------------------------------------------
+
+namespace {
+
+// Decode index on Morton curve
+void morton_d2xy(long long d, int& x, int& y) {
+    const auto compact = [](long long v) -> int {
+        v &= 0x5555555555555555LL;
+        v = (v | (v >> 1))  & 0x3333333333333333LL;
+        v = (v | (v >> 2))  & 0x0f0f0f0f0f0f0f0fLL;
+        v = (v | (v >> 4))  & 0x00ff00ff00ff00ffLL;
+        v = (v | (v >> 8))  & 0x0000ffff0000ffffLL;
+        v = (v | (v >> 16)) & 0x00000000ffffffffLL;
+        return int(v);
+    };
+    x = compact(d);
+    y = compact(d >> 1);
+}
+
+// Decode index on Hilbert curve of size n x n (n is power of two)
+void hilbert_d2xy(long long n, long long d, int& x, int& y) {
+    long long rx, ry, t = d;
+    long long tx = 0, ty = 0;
+    for (long long s = 1; s < n; s *= 2) {
+        rx = 1 & (t / 2);
+        ry = 1 & (t ^ rx);
+        if (ry == 0) {
+            if (rx == 1) {
+                tx = s - 1 - tx;
+                ty = s - 1 - ty;
+            }
+            std::swap(tx, ty);
+        }
+        tx += s * rx;
+        ty += s * ry;
+        t /= 4;
+    }
+    x = int(tx);
+    y = int(ty);
+}
+
+}
+
+// Tile-based SPPScheduler.
+// A tile is processed by a single thread with all samples,
+// which improves the coherency of the primary rays.
+// The film is notified when a tile is finished, so that a tiled film
+// only needs to keep the tiles being processed in memory.
+class Scheduler_SPP_Tile : public Scheduler {
 private:
     long long spp_;
+    int tile_size_;
+    std::string order_;
     Film* film_;
+    RenderRegion region_;
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(spp_, film_);
+        ar(spp_, tile_size_, order_, film_, region_);
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visit) override {
         comp::visit(visit, film_);
+        region_.foreach_underlying(visit);
     }
 
 public:
     virtual void construct(const Json& prop) override {
         spp_ = json::value<long long>(prop, "spp");
+        tile_size_ = json::value<int>(prop, "tile_size", 16);
+        order_ = json::value<std::string>(prop, "order", "scanline");
         film_ = json::comp_ref<Film>(prop, "output");
+        region_.construct(prop);
+        if (tile_size_ <= 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "tile_size must be positive [tile_size='{}']", tile_size_);
+        }
+        if (order_ != "scanline" && order_ != "morton" && order_ != "hilbert") {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid tile order [order='{}']", order_);
+        }
+    }
+
+    virtual bool keep_film() const override {
+        return region_.keep_film();
     }
 
     virtual long long run(const ProcessFunc& process) const override {
-        const auto numPixels = film_->num_pixels();
-        progress::ScopedReport progress_ctx_(numPixels * spp_);
-        
-        // Parallel loop for each pixel
-        parallel::foreach(numPixels * spp_, [&](long long index, int threadid) {
-            process(index / spp_, index % spp_, threadid);
-        }, [&](long long processed) {
+        const auto size = film_->size();
+        const auto pixels = region_.pixels(film_);
+        progress::ScopedReport progress_ctx_((long long)(pixels.size()) * spp_);
+        ScopedRunCancel cancel_ctx_;
+        region_.begin(film_, pixels);
+
+        // Pixels to be rendered
+        std::vector<char> rendered(film_->num_pixels(), !region_.restricted());
+        if (region_.restricted()) {
+            for (const auto i : pixels) {
+                rendered[i] = 1;
+            }
+        }
+
+        // Tiles in the processing order.
+        // The tiles without the rendered pixels are skipped.
+        auto tiles = tile_order(
+            (size.w + tile_size_ - 1) / tile_size_,
+            (size.h + tile_size_ - 1) / tile_size_);
+        if (region_.restricted()) {
+            std::vector<char> active_tiles(tiles.size(), 0);
+            const int nx = (size.w + tile_size_ - 1) / tile_size_;
+            for (const auto i : pixels) {
+                const int x = int(i % size.w) / tile_size_;
+                const int y = int(i / size.w) / tile_size_;
+                active_tiles[size_t(y) * nx + x] = 1;
+            }
+            tiles.erase(std::remove_if(tiles.begin(), tiles.end(), [&](const std::pair<int, int>& t) {
+                return !active_tiles[size_t(t.second) * nx + t.first];
+            }), tiles.end());
+        }
+
+        // Parallel loop for each tile
+        LM_TRACE_SCOPE("scheduler::pass");
+        std::atomic<long long> processed = 0;
+        parallel::foreach((long long)(tiles.size()), [&](long long index, int threadid) {
+            const auto [tx, ty] = tiles[index];
+            const int x0 = tx * tile_size_;
+            const int y0 = ty * tile_size_;
+            const int x1 = std::min(x0 + tile_size_, size.w);
+            const int y1 = std::min(y0 + tile_size_, size.h);
+            long long num_rendered = 0;
+            for (long long s = 0; s < spp_; s++) {
+                for (int y = y0; y < y1; y++) {
+                    for (int x = x0; x < x1; x++) {
+                        const auto i = (long long)(y) * size.w + x;
+                        if (!rendered[i]) {
+                            continue;
+                        }
+                        process(i, s, threadid);
+                        num_rendered++;
+                    }
+                }
+            }
+            processed += num_rendered;
+            film_->finish_region(x0, y0, x1, y1);
+        }, [&](long long) {
             progress::update(processed);
         });
+        region_.end(film_, pixels, spp_);
 
         return spp_;
     }
+
+private:
+    // Compute the order of tiles
+    std::vector<std::pair<int, int>> tile_order(int nx, int ny) const {
+        std::vector<std::pair<int, int>> tiles;
+        tiles.reserve(size_t(nx) * ny);
+        if (order_ == "scanline") {
+            for (int y = 0; y < ny; y++) {
+                for (int x = 0; x < nx; x++) {
+                    tiles.push_back({ x, y });
+                }
+            }
+            return tiles;
+        }
+
+        // Space-filling curves are defined on the power-of-two square grid
+        // covering the tiles. Indices outside of the tiles are skipped.
+        long long n = 1;
+        while (n < nx || n < ny) {
+            n *= 2;
+        }
+        for (long long d = 0; d < n * n; d++) {
+            int x, y;
+            if (order_ == "morton") {
+                morton_d2xy(d, x, y);
+            }
+            else {
+                hilbert_d2xy(n, d, x, y);
+            }
+            if (x < nx && y < ny) {
+                tiles.push_back({ x, y });
+            }
+        }
+        return tiles;
+    }
 };
 
-LM_COMP_REG_IMPL(Scheduler_SPP_Sample, "scheduler::spp::sample");
+LM_COMP_REG_IMPL(Scheduler_SPP_Tile, "scheduler::spp::tile");
 
 // ------------------------------------------------------------------------------------------------
 
-// Time-based SPPScheduler
-class Scheduler_SPP_Time : public Scheduler {
+// Adaptive SPPScheduler.
+// The scheduler tracks per-pixel running variance of the samples
+// and dispatches additional passes only to the pixels with large error.
+// We assume each sample contributes only to its own pixel of the film,
+// which is the case for the renderers with pixel-space sampling.
+// The variance is estimated from the difference of the film between passes
+// where each pixel receives one sample per pass.
+// Before returning, the scheduler rescales the pixels according to
+// the number of samples of each pixel, so that the renderers can
+// normalize the film uniformly with the returned spp.
+// If nonlocal_splats is true, i.e., the renderer splats the samples to the other pixels,
+// the pixels are rescaled uniformly by the average number of samples instead.
+class Scheduler_SPP_Adaptive : public Scheduler {
 private:
-    double render_time_;
+    long long min_spp_;     // Number of uniform passes before adaptation
+    long long max_spp_;     // Maximum number of samples per pixel
+    Float threshold_;       // Threshold of relative error
+    double render_time_;    // Time limit. 0 for no limit.
+    bool nonlocal_splats_;  // True if the samples are splatted to the other pixels
     Film* film_;
+    RenderRegion region_;
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(render_time_, film_);
+        ar(min_spp_, max_spp_, threshold_, render_time_, nonlocal_splats_, film_, region_);
+    }
+
+    virtual void foreach_underlying(const ComponentVisitor& visit) override {
+        comp::visit(visit, film_);
+        region_.foreach_underlying(visit);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        min_spp_ = json::value<long long>(prop, "min_spp", 16);
+        max_spp_ = json::value<long long>(prop, "max_spp", 1024);
+        threshold_ = json::value<Float>(prop, "threshold", 0.01_f);
+        render_time_ = json::value<Float>(prop, "render_time", 0_f);
+        nonlocal_splats_ = json::value<bool>(prop, "nonlocal_splats", false);
+        film_ = json::comp_ref<Film>(prop, "output");
+        region_.construct(prop);
+        if (min_spp_ < 2 || max_spp_ < min_spp_) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "Invalid sample counts [min_spp='{}', max_spp='{}']", min_spp_, max_spp_);
+        }
+    }
+
+    virtual long long run(const ProcessFunc& process) const override {
+        return run(process, [](long long) {});
+    }
+
+    virtual bool keep_film() const override {
+        return region_.keep_film();
+    }
+
+    virtual long long run(const ProcessFunc& process, const PassFunc& pass_func) const override {
+        const auto numPixels = film_->num_pixels();
+        const auto pixels = region_.pixels(film_);
+        progress::ScopedReport progress_ctx_((long long)(pixels.size()) * max_spp_);
+        ScopedRunCancel cancel_ctx_;
+        const auto start = std::chrono::high_resolution_clock::now();
+        region_.begin(film_, pixels);
+
+        // Per-pixel statistics of the luminance of the samples (Welford's algorithm)
+        struct Stat {
+            long long n = 0;    // Number of samples
+            Float prev = 0_f;   // Accumulated luminance in the film at the last pass
+            Float mean = 0_f;   // Running mean
+            Float m2 = 0_f;     // Running sum of squared differences
+        };
+        std::vector<Stat> stats(numPixels);
+
+        // Active pixels
+        auto active = pixels;
+
+        long long processed = 0;
+        while (!active.empty()) {
+            LM_TRACE_SCOPE("scheduler::pass");
+            // Dispatch one sample for each active pixel
+            parallel::foreach((long long)(active.size()), [&](long long index, int threadid) {
+                const auto pixel = active[index];
+                process(pixel, stats[pixel].n, threadid);
+            }, [&](long long done) {
+                progress::update(processed + done);
+            });
+            processed += (long long)(active.size());
+            if (cancel_ctx_.cancelled()) {
+                // Discard the interrupted pass from the sample counts.
+                // The partial contributions remain in the film.
+                break;
+            }
+
+            // Update statistics from the contributions of the pass
+            const auto buf = film_->buffer();
+            for (const auto pixel : active) {
+                auto& st = stats[pixel];
+                const Vec3 v(buf.data[3*pixel], buf.data[3*pixel+1], buf.data[3*pixel+2]);
+                const auto l = glm::dot(v, Vec3(.2126_f, .7152_f, .0722_f));
+                const auto x = l - st.prev;
+                st.prev = l;
+                st.n++;
+                const auto d = x - st.mean;
+                st.mean += d / st.n;
+                st.m2 += d * (x - st.mean);
+            }
+
+            // Remove converged pixels
+            active.erase(std::remove_if(active.begin(), active.end(), [&](long long pixel) {
+                const auto& st = stats[pixel];
+                if (st.n >= max_spp_) {
+                    return true;
+                }
+                if (st.n < min_spp_) {
+                    return false;
+                }
+                // Relative standard error of the mean
+                const auto var = st.m2 / (st.n - 1);
+                const auto err = std::sqrt(var / st.n) / (std::abs(st.mean) + Eps);
+                return err < threshold_;
+            }), active.end());
+
+            // Check time limit
+            if (render_time_ > 0) {
+                using namespace std::chrono;
+                const auto elapsed = duration_cast<milliseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+                if (elapsed > render_time_) {
+                    break;
+                }
+            }
+        }
+
+        // Rescale the pixels so that the film can be normalized by the maximum spp
+        std::vector<long long> counts(pixels.size());
+        for (size_t i = 0; i < pixels.size(); i++) {
+            counts[i] = stats[pixels[i]].n;
+        }
+        const auto spp = rescale_by_samples(film_, pixels, counts, nonlocal_splats_);
+        if (spp == 0) {
+            return 0;
+        }
+        region_.end(film_, pixels, spp);
+        LM_INFO("Adaptive sampling finished [samples={}, max_spp={}, average_spp={:.2f}]",
+            processed, spp, Float(processed) / std::max<size_t>(pixels.size(), 1));
+
+        pass_func(spp);
+        return spp;
+    }
+};
+
+LM_COMP_REG_IMPL(Scheduler_SPP_Adaptive, "scheduler::spp::adaptive");
+
+// ------------------------------------------------------------------------------------------------
+
+// Time-based SPPScheduler.
+// The first pass is always completed so that every pixel receives a sample.
+// The pass interrupted by the deadline gives the pixels different numbers of samples,
+// which are rescaled in the same way as scheduler::spp::adaptive.
+class Scheduler_SPP_Time : public Scheduler_Progressive {
+private:
+    double render_time_;
+    bool nonlocal_splats_;  // True if the samples are splatted to the other pixels
+    Film* film_;
+    RenderRegion region_;
+
+public:
+    LM_SERIALIZE_IMPL_WITH_PARENT(ar, Scheduler_Progressive) {
+        ar(render_time_, nonlocal_splats_, film_, region_);
     }
 
     virtual void foreach_underlying(const ComponentVisitor& visit) override {
         comp::visit(visit, film_);
+        region_.foreach_underlying(visit);
     }
 
 public:
     virtual void construct(const Json& prop) override {
+        Scheduler_Progressive::construct(prop);
         render_time_ = json::value<Float>(prop, "render_time");
+        nonlocal_splats_ = json::value<bool>(prop, "nonlocal_splats", false);
         film_ = json::comp_ref<Film>(prop, "output");
+        region_.construct(prop);
+    }
+
+    virtual bool keep_film() const override {
+        return resuming() || region_.keep_film();
     }
     
     virtual long long run(const ProcessFunc& process) const override {
-        const auto numPixels = film_->num_pixels();
+        return run(process, [](long long) {});
+    }
+
+    virtual long long run(const ProcessFunc& process, const PassFunc& pass_func) const override {
+        const auto pixels = region_.pixels(film_);
+        const auto numPixels = (long long)(pixels.size());
         progress::ScopedTimeReport progress_ctx_(render_time_);
-        
-        const auto start = std::chrono::high_resolution_clock::now();
-        long long spp = 0;
+        ScopedRunCancel cancel_ctx_;
+        const auto resumed = begin_run();
+        const Deadline deadline(render_time_ - resumed.elapsed);
+        if (resumed.processed == 0) {
+            region_.begin(film_, pixels);
+        }
+
+        // Number of samples processed for each rendered pixel.
+        // The last pass might be interrupted by the deadline,
+        // so the pixels can have different number of samples.
+        std::vector<long long> counts(numPixels, resumed.processed);
+
+        long long spp = resumed.processed;
         while (true) {
+            LM_TRACE_SCOPE("scheduler::pass");
             // Parallel loop for each pixel
             parallel::foreach(numPixels, [&](long long index, int threadid) {
-                process(index, spp, threadid);
+                // Check the deadline inside the pass and stop dispatching.
+                // The first pass is not interrupted so that no pixel is left without samples.
+                if (spp > 0 && deadline.reached_sampled()) {
+                    cancel_ctx_.cancel();
+                    return;
+                }
+                process(pixels[index], spp, threadid);
+                counts[index]++;
             }, [&](long long) {
-                using namespace std::chrono;
-                const auto now = high_resolution_clock::now();
-                const auto elapsed = duration_cast<milliseconds>(now - start).count() / 1000.0;
-                progress::update_time(elapsed);
+                progress::update_time(elapsed());
             });
 
+            // Stop if the pass is interrupted by the deadline or cancellation
+            if (cancel_ctx_.cancelled()) {
+                break;
+            }
+
             // Update processed spp
             spp++;
+            end_pass(spp);
+            pass_func(spp);
 
             // Check termination
-            const auto curr = std::chrono::high_resolution_clock::now();
-            const double elapsed = (double)(std::chrono::duration_cast<std::chrono::milliseconds>(curr - start).count()) / 1000.0;
-            if (elapsed > render_time_) {
+            if (deadline.reached()) {
                 break;
             }
         }
 
-        return spp;
+        end_run();
+
+        // Weight the pixels of the interrupted pass
+        // so that the film can be normalized by the maximum spp
+        const auto max_spp = counts.empty() ? spp : rescale_by_samples(film_, pixels, counts, nonlocal_splats_);
+        region_.end(film_, pixels, max_spp);
+
+        return max_spp;
     }
 };
 
@@ -110,30 +929,65 @@ LM_COMP_REG_IMPL(Scheduler_SPP_Time, "scheduler::spp::time");
 
 // ------------------------------------------------------------------------------------------------
 
-// Sample-based SPIScheduler
-class Scheduler_SPI_Sample : public Scheduler {
+// Sample-based SPIScheduler.
+// The samples are processed in passes of samples_per_pass samples.
+// By default all samples are processed in a single pass.
+// sample_begin and sample_end restrict the run to the range of the sample indices
+// (see SampleRange).
+class Scheduler_SPI_Sample : public Scheduler_Progressive {
 private:
     long long num_samples_;
+    long long samples_per_pass_;
+    SampleRange range_;
 
 public:
-    LM_SERIALIZE_IMPL(ar) {
-        ar(num_samples_);
+    LM_SERIALIZE_IMPL_WITH_PARENT(ar, Scheduler_Progressive) {
+        ar(num_samples_, samples_per_pass_, range_);
     }
   
 public:
     virtual void construct(const Json& prop) override {
+        Scheduler_Progressive::construct(prop);
         num_samples_ = json::value<long long>(prop, "num_samples");
+        samples_per_pass_ = json::value<long long>(prop, "samples_per_pass", num_samples_);
+        range_.construct(prop, num_samples_);
+        if (samples_per_pass_ <= 0) {
+            LM_THROW_EXCEPTION(Error::InvalidArgument,
+                "samples_per_pass must be positive [samples_per_pass='{}']", samples_per_pass_);
+        }
     }
 
     virtual long long run(const ProcessFunc& process) const override {
-        progress::ScopedReport progress_ctx_(num_samples_);
-        parallel::foreach(num_samples_, [&](long long index, int threadid) {
-            process(0, index, threadid);
-        }, [&](long long processed) {
-            progress::update(processed);
-        });
+        return run(process, [](long long) {});
+    }
 
-        return num_samples_;
+    virtual long long run(const ProcessFunc& process, const PassFunc& pass_func) const override {
+        const auto range_samples = range_.size();
+        progress::ScopedReport progress_ctx_(range_samples);
+        ScopedRunCancel cancel_ctx_;
+
+        long long processed = begin_run().processed;
+        bool cancelled = false;
+        while (processed < range_samples) {
+            LM_TRACE_SCOPE("scheduler::pass");
+            const auto n = std::min(samples_per_pass_, range_samples - processed);
+            const auto sample_offset = range_.begin() + processed;
+            parallel::foreach(n, [&](long long index, int threadid) {
+                process(0, sample_offset + index, threadid);
+            }, [&](long long done) {
+                progress::update(processed + done);
+            });
+            if (cancel_ctx_.cancelled()) {
+                cancelled = true;
+                break;
+            }
+            processed += n;
+            end_pass(processed);
+            pass_func(processed);
+        }
+        end_run(cancelled);
+
+        return cancelled ? processed : num_samples_;
     }
 };
 
@@ -142,47 +996,78 @@ LM_COMP_REG_IMPL(Scheduler_SPI_Sample, "scheduler::spi::sample");
 // ------------------------------------------------------------------------------------------------
 
 // Time-based SPIScheduler
-class Scheduler_SPI_Time : public Scheduler {
+class Scheduler_SPI_Time : public Scheduler_Progressive {
 private:
     double render_time_;
     long long samples_per_iter_;
 
 public:
-    LM_SERIALIZE_IMPL(ar) {
+    LM_SERIALIZE_IMPL_WITH_PARENT(ar, Scheduler_Progressive) {
         ar(render_time_, samples_per_iter_);
     }
 
 public:
     virtual void construct(const Json& prop) override {
+        Scheduler_Progressive::construct(prop);
         render_time_ = json::value<Float>(prop, "render_time");
         samples_per_iter_ = json::value<long long>(prop, "samples_per_iter", 100000);
     }
 
     virtual long long run(const ProcessFunc& process) const override {
+        return run(process, [](long long) {});
+    }
+
+    virtual long long run(const ProcessFunc& process, const PassFunc& pass_func) const override {
         progress::ScopedTimeReport progress_ctx_(render_time_);
-        const auto start = std::chrono::high_resolution_clock::now();
-        long long processed = 0;
+        ScopedRunCancel cancel_ctx_;
+        const auto resumed = begin_run();
+        const Deadline deadline(render_time_ - resumed.elapsed);
+
+        // Per-thread number of processed samples in the current pass.
+        // Padded to avoid false sharing.
+        struct alignas(64) Count { long long v = 0; };
+        std::vector<Count> counts(parallel::num_threads());
+
+        long long processed = resumed.processed;
         while (true) {
+            LM_TRACE_SCOPE("scheduler::pass");
             // Parallel loop
+            for (auto& c : counts) {
+                c.v = 0;
+            }
             parallel::foreach(samples_per_iter_, [&](long long index, int threadid) {
+                // Check the deadline inside the pass and stop dispatching
+                if (deadline.reached_sampled()) {
+                    cancel_ctx_.cancel();
+                    return;
+                }
                 process(0, processed + index, threadid);
+                counts[threadid].v++;
             }, [&](long long) {
-                using namespace std::chrono;
-                const auto now = high_resolution_clock::now();
-                const auto elapsed = duration_cast<milliseconds>(now - start).count() / 1000.0;
-                progress::update_time(elapsed);
+                progress::update_time(elapsed());
             });
 
+            // Stop if the pass is interrupted by the deadline or cancellation.
+            // Only the samples actually processed in the pass are counted.
+            if (cancel_ctx_.cancelled()) {
+                for (const auto& c : counts) {
+                    processed += c.v;
+                }
+                break;
+            }
+
             // Update processed samples
             processed += samples_per_iter_;
+            end_pass(processed);
+            pass_func(processed);
 
             // Check termination
-            const auto curr = std::chrono::high_resolution_clock::now();
-            const double elapsed = (double)(std::chrono::duration_cast<std::chrono::milliseconds>(curr - start).count()) / 1000.0;
-            if (elapsed > render_time_) {
+            if (deadline.reached()) {
                 break;
             }
         }
+        end_run();
+
         return processed;
     }
 };
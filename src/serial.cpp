@@ -3,4 +3,349 @@
     Distributed under MIT license. See LICENSE file for details.
 */
 
-#include <pch.h>
\ No newline at end of file
+#include <pch.h>
+#include <lm/serial.h>
+#include <lm/parallel.h>
+#include "mappedfile.h"
+#if LM_USE_ZSTD
+#include <zstd.h>
+#endif
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::serial::detail)
+
+namespace {
+
+// Header of the snapshot file.
+// The blob region starts at SnapshotAlignment so that the blobs keep their alignment
+// in the memory-mapped file, followed by the serialized stream.
+// Version 2 adds the flag of the native stream. The flag is zero in version 1.
+constexpr char SnapshotMagic[8] = { 'L', 'M', 'S', 'N', 'A', 'P', 'S', 'T' };
+constexpr std::uint32_t SnapshotVersion = 2;
+constexpr std::uint64_t SnapshotAlignment = 4096;
+struct SnapshotHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t float_size;       // sizeof(Float)
+    std::uint64_t blobs_offset;
+    std::uint64_t blobs_size;
+    std::uint64_t stream_offset;
+    std::uint64_t stream_size;
+    std::uint32_t native;           // 1 if the stream is written in the native mode
+    std::uint32_t reserved;
+};
+static_assert(sizeof(SnapshotHeader) <= SnapshotAlignment, "Invalid size of SnapshotHeader");
+
+// Header of the compressed file.
+// The content is split into the chunks of ChunkSize bytes compressed independently,
+// so that the chunks are compressed and decompressed in parallel.
+// The chunks are followed by the index of the offsets and the sizes of the compressed chunks,
+// with which a range of the content is read by decompressing only the chunks covering it.
+constexpr char CompressedMagic[8] = { 'L', 'M', 'Z', 'C', 'H', 'U', 'N', 'K' };
+constexpr std::uint32_t CompressedVersion = 1;
+constexpr std::uint64_t ChunkSize = 4 << 20;
+struct CompressedHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t chunk_size;
+    std::uint64_t content_size;
+    std::uint64_t num_chunks;
+    std::uint64_t index_offset;
+};
+struct ChunkEntry {
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+#if !LM_USE_ZSTD
+[[noreturn]] void throw_no_compression() {
+    LM_THROW_EXCEPTION(Error::Unsupported, "Compression requires the build with LM_USE_ZSTD");
+}
+#endif
+
+// Interpret the memory region as a snapshot. Returns nullopt if the region is not a snapshot.
+std::optional<Snapshot> parse_snapshot(const std::string& path, const char* data, std::uint64_t size, std::shared_ptr<const void> owner) {
+    if (size < sizeof(SnapshotHeader)) {
+        return {};
+    }
+    SnapshotHeader h;
+    std::memcpy(&h, data, sizeof(SnapshotHeader));
+    if (!std::equal(std::begin(SnapshotMagic), std::end(SnapshotMagic), h.magic)) {
+        return {};
+    }
+    if (h.version < 1 || h.version > SnapshotVersion || h.float_size != sizeof(Float)) {
+        LM_THROW_EXCEPTION(Error::IOError,
+            "Incompatible snapshot [path='{}', version='{}', float_size='{}']", path, h.version, h.float_size);
+    }
+    if (h.blobs_offset % OutputArchive::BlobAlignment != 0
+        || h.blobs_offset > size || h.blobs_size > size - h.blobs_offset
+        || h.stream_offset > size || h.stream_size > size - h.stream_offset) {
+        LM_THROW_EXCEPTION(Error::IOError, "Broken snapshot [path='{}']", path);
+    }
+    return Snapshot{
+        data + h.stream_offset, h.stream_size,
+        data + h.blobs_offset, h.blobs_size,
+        h.native != 0,
+        std::move(owner)
+    };
+}
+
+}
+
+LM_PUBLIC_API void save_compressed(const std::string& path, const std::string& content, int level) {
+    #if LM_USE_ZSTD
+    // Compress the chunks in parallel
+    const std::uint64_t size = content.size();
+    const std::uint64_t num_chunks = (size + ChunkSize - 1) / ChunkSize;
+    std::vector<std::vector<char>> chunks(num_chunks);
+    parallel::foreach((long long)(num_chunks), [&](long long i, int) {
+        const auto begin = std::uint64_t(i) * ChunkSize;
+        const auto n = std::min(ChunkSize, size - begin);
+        auto& chunk = chunks[i];
+        chunk.resize(ZSTD_compressBound(n));
+        const auto compressed = ZSTD_compress(chunk.data(), chunk.size(), content.data() + begin, n, level);
+        if (ZSTD_isError(compressed)) {
+            LM_THROW_EXCEPTION(Error::IOError, "Failed to compress [path='{}', error='{}']",
+                path, ZSTD_getErrorName(compressed));
+        }
+        chunk.resize(compressed);
+    });
+
+    // Write the header, the chunks, and the index
+    CompressedHeader h{};
+    std::copy(std::begin(CompressedMagic), std::end(CompressedMagic), h.magic);
+    h.version = CompressedVersion;
+    h.chunk_size = ChunkSize;
+    h.content_size = size;
+    h.num_chunks = num_chunks;
+    std::vector<ChunkEntry> index(num_chunks);
+    std::uint64_t offset = sizeof(CompressedHeader);
+    for (std::uint64_t i = 0; i < num_chunks; i++) {
+        index[i] = { offset, chunks[i].size() };
+        offset += chunks[i].size();
+    }
+    h.index_offset = offset;
+    std::ofstream os(path, std::ios::out | std::ios::binary);
+    if (!os) {
+        LM_THROW_EXCEPTION(Error::IOError, "Failed to open file [path='{}']", path);
+    }
+    os.write(reinterpret_cast<const char*>(&h), sizeof(CompressedHeader));
+    for (const auto& chunk : chunks) {
+        os.write(chunk.data(), std::streamsize(chunk.size()));
+    }
+    os.write(reinterpret_cast<const char*>(index.data()), std::streamsize(index.size() * sizeof(ChunkEntry)));
+    os.flush();
+    if (!os) {
+        LM_THROW_EXCEPTION(Error::IOError, "Failed to write file [path='{}']", path);
+    }
+    LM_INFO("Saved compressed file [path='{}', size='{:.2f}MB', compressed='{:.2f}MB', chunks={}]",
+        path, double(size) / 1024.0 / 1024.0, double(offset) / 1024.0 / 1024.0, num_chunks);
+    #else
+    LM_UNUSED(path, content, level);
+    throw_no_compression();
+    #endif
+}
+
+LM_PUBLIC_API std::optional<Content> load_compressed(const std::string& path) {
+    MappedFile mapped;
+    if (!mapped.open(path) || mapped.size() < sizeof(CompressedHeader)) {
+        return {};
+    }
+    CompressedHeader h;
+    std::memcpy(&h, mapped.data(), sizeof(CompressedHeader));
+    if (!std::equal(std::begin(CompressedMagic), std::end(CompressedMagic), h.magic)) {
+        return {};
+    }
+    #if LM_USE_ZSTD
+    const auto size = std::uint64_t(mapped.size());
+    if (h.version != CompressedVersion || h.chunk_size == 0
+        || h.num_chunks != (h.content_size + h.chunk_size - 1) / h.chunk_size
+        || h.index_offset > size || h.num_chunks > (size - h.index_offset) / sizeof(ChunkEntry)) {
+        LM_THROW_EXCEPTION(Error::IOError, "Broken compressed file [path='{}']", path);
+    }
+    std::vector<ChunkEntry> index(h.num_chunks);
+    std::memcpy(index.data(), mapped.data() + h.index_offset, index.size() * sizeof(ChunkEntry));
+
+    // Decompress the chunks in parallel.
+    // The content is aligned to the page boundary so that the snapshot keeps the alignment of the blobs.
+    auto storage = std::make_shared<std::vector<char>>(h.content_size + SnapshotAlignment);
+    const auto address = reinterpret_cast<std::uintptr_t>(storage->data());
+    char* data = storage->data() + (SnapshotAlignment - address % SnapshotAlignment) % SnapshotAlignment;
+    parallel::foreach((long long)(h.num_chunks), [&](long long i, int) {
+        const auto& e = index[i];
+        const auto begin = std::uint64_t(i) * h.chunk_size;
+        const auto n = std::min(h.chunk_size, h.content_size - begin);
+        if (e.offset > size || e.size > size - e.offset) {
+            LM_THROW_EXCEPTION(Error::IOError, "Broken compressed file [path='{}']", path);
+        }
+        const auto decompressed = ZSTD_decompress(data + begin, n, mapped.data() + e.offset, e.size);
+        if (ZSTD_isError(decompressed) || decompressed != n) {
+            LM_THROW_EXCEPTION(Error::IOError, "Failed to decompress [path='{}', chunk={}]", path, i);
+        }
+    });
+    return Content{ data, h.content_size, std::move(storage) };
+    #else
+    throw_no_compression();
+    #endif
+}
+
+LM_PUBLIC_API bool compression_supported() {
+    #if LM_USE_ZSTD
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+LM_PUBLIC_API void begin_snapshot(std::ostream& os) {
+    // Reserve the region for the header, which is written at the end
+    static const char zeros[SnapshotAlignment] = {};
+    os.write(zeros, SnapshotAlignment);
+}
+
+LM_PUBLIC_API void end_snapshot(std::ostream& os, const std::string& stream, std::uint64_t blobs_size) {
+    SnapshotHeader h{};
+    std::copy(std::begin(SnapshotMagic), std::end(SnapshotMagic), h.magic);
+    h.version = SnapshotVersion;
+    h.float_size = sizeof(Float);
+    h.blobs_offset = SnapshotAlignment;
+    h.blobs_size = blobs_size;
+    h.stream_offset = SnapshotAlignment + blobs_size;
+    h.stream_size = stream.size();
+    h.native = 1;
+    os.write(stream.data(), std::streamsize(stream.size()));
+    os.seekp(0);
+    os.write(reinterpret_cast<const char*>(&h), sizeof(SnapshotHeader));
+    os.flush();
+    if (!os) {
+        LM_THROW_EXCEPTION(Error::IOError, "Failed to write snapshot");
+    }
+}
+
+LM_PUBLIC_API std::optional<Snapshot> map_snapshot(const std::string& path) {
+    // The compressed snapshot is decompressed to the memory
+    if (auto content = load_compressed(path); content) {
+        return parse_snapshot(path, content->data, content->size, std::move(content->owner));
+    }
+    auto mapped = std::make_shared<MappedFile>();
+    if (!mapped->open(path)) {
+        return {};
+    }
+    const auto* data = mapped->data();
+    const auto size = std::uint64_t(mapped->size());
+    return parse_snapshot(path, data, size, std::move(mapped));
+}
+
+LM_NAMESPACE_END(LM_NAMESPACE::serial::detail)
+
+// ------------------------------------------------------------------------------------------------
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::serial)
+
+namespace {
+
+constexpr const char* CheckpointMagic = "LMCKPT";
+constexpr std::uint32_t CheckpointVersion = 2;
+
+// Visit the component and its descendants except for the weak references.
+// The children are not visited if the function returns false.
+void visit_subtree(Component* root, const std::function<bool(Component* comp)>& func) {
+    if (!func(root)) {
+        return;
+    }
+    const Component::ComponentVisitor visitor = [&](Component*& comp, bool weak) {
+        if (!comp || weak) {
+            return;
+        }
+        if (func(comp)) {
+            comp->foreach_underlying(visitor);
+        }
+    };
+    root->foreach_underlying(visitor);
+}
+
+}
+
+LM_PUBLIC_API void detail::clear_dirty(Component* root) {
+    visit_subtree(root, [](Component* comp) {
+        comp->clear_dirty();
+        return true;
+    });
+}
+
+LM_PUBLIC_API void save_checkpoint(std::ostream& stream, Component* root, const Json& info) {
+    // Collect the modified components
+    const auto& root_loc = root->loc();
+    std::vector<Component*> comps;
+    visit_subtree(root, [&](Component* comp) {
+        if (!comp->dirty()) {
+            return true;
+        }
+        if (comp->loc().rfind(root_loc, 0) != 0) {
+            LM_THROW_EXCEPTION(Error::Unsupported,
+                "Component outside of the hierarchy can not be checkpointed [key='{}']", comp->key());
+        }
+        comps.push_back(comp);
+        return false;
+    });
+
+    // Write the components with the locators relative to the root
+    // The components are written in the native mode
+    // because the checkpoint is applied only to the snapshot of the same platform.
+    OutputArchive ar(stream, root_loc);
+    const std::string magic = CheckpointMagic;
+    const std::uint8_t native = 1;
+    ar(magic, CheckpointVersion, native);
+    ar.set_native(native != 0);
+    ar(info.dump(), std::uint64_t(comps.size()));
+    for (auto* comp : comps) {
+        const auto relative_loc = comp->loc().substr(root_loc.size());
+        ar(comp->key(), relative_loc);
+        comp->save(ar);
+    }
+    for (auto* comp : comps) {
+        detail::clear_dirty(comp);
+    }
+    LM_INFO("Saved checkpoint [components='{}']", comps.size());
+}
+
+LM_PUBLIC_API Json load_checkpoint(std::istream& stream, Component* root) {
+    InputArchive ar(stream, root->loc());
+    std::string magic;
+    std::uint32_t version;
+    std::string info;
+    std::uint64_t n;
+    ar(magic, version);
+    if (magic != CheckpointMagic || version < 1 || version > CheckpointVersion) {
+        LM_THROW_EXCEPTION(Error::IOError,
+            "Invalid checkpoint [magic='{}', version='{}']", magic, version);
+    }
+    if (version >= 2) {
+        std::uint8_t native;
+        ar(native);
+        ar.set_native(native != 0);
+    }
+    ar(info, n);
+    for (std::uint64_t i = 0; i < n; i++) {
+        std::string key;
+        std::string relative_loc;
+        ar(key, relative_loc);
+        auto* comp = comp::get<Component>(root->loc() + relative_loc);
+        if (!comp || comp->key() != key) {
+            LM_THROW_EXCEPTION(Error::IOError,
+                "Checkpoint does not match the state [loc='{}', key='{}']", root->loc() + relative_loc, key);
+        }
+        comp->load(ar);
+        detail::clear_dirty(comp);
+    }
+
+    // Recover all weak references (if any)
+    ar.foreach_weakptr([](std::uintptr_t address, const std::string& loc) {
+        Component** weakptr = (Component**)address;
+        *weakptr = lm::comp::get<Component>(loc);
+    });
+
+    return Json::parse(info);
+}
+
+LM_NAMESPACE_END(LM_NAMESPACE::serial)
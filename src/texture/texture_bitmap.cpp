@@ -11,14 +11,176 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 #pragma warning(pop)
+#include <glm/gtc/packing.hpp>
+#include <list>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
+using Vec2i = glm::tvec2<int>;
+
 std::string sanitize_directory_separator(std::string p) {
     std::replace(p.begin(), p.end(), '\\', '/');
     return p;
 }
 
+// Cache of the tiles of the bitmap textures shared in an asset group.
+// The tiles are evicted in the order of least recently used
+// when the total size of the tiles exceeds the budget.
+// The tiles are distributed to the shards each with a mutex and a part of the budget
+// so that the render threads accessing different tiles do not contend for a single lock.
+// The recently accessed tiles are also kept in a small per-thread table,
+// where the lookups of the same tiles are resolved without locking.
+class TextureCache {
+public:
+    // Texels of a tile. The data is alive while referenced even if evicted.
+    using Data = std::shared_ptr<const std::vector<uint8_t>>;
+
+private:
+    static constexpr int NumShards = 16;
+    static constexpr int NumThreadTiles = 8;
+
+    struct Tile {
+        Data data;                              // Texels of the tile
+        std::list<uint64_t>::iterator lru;      // Position in the LRU list
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        size_t used = 0;                          // Total size of the resident tiles in bytes
+        std::unordered_map<uint64_t, Tile> tiles; // Resident tiles
+        std::list<uint64_t> lru;                  // Tile keys ordered from the most recently used
+    };
+
+    // Entry of the per-thread table of the recently accessed tiles
+    struct ThreadTile {
+        uint64_t cache = 0;     // Identifier of the cache, 0 for empty entry
+        uint64_t key = 0;
+        Data data;
+    };
+
+    uint64_t uid_;                              // Unique identifier of the cache
+    size_t shard_budget_;                       // Budget of a shard in bytes
+    std::atomic<int> num_textures_ = 0;         // Number of registered textures
+    std::array<Shard, NumShards> shards_;
+
+public:
+    TextureCache(size_t budget)
+        : shard_budget_(budget / NumShards)
+    {
+        static std::atomic<uint64_t> counter = 1;
+        uid_ = counter++;
+    }
+
+    // Get the cache shared in the given asset group.
+    // The budget is given by the first texture of the group.
+    static std::shared_ptr<TextureCache> get(const std::string& group, size_t budget) {
+        static std::mutex mutex;
+        static std::unordered_map<std::string, std::weak_ptr<TextureCache>> caches;
+        std::unique_lock<std::mutex> lock(mutex);
+        auto cache = caches[group].lock();
+        if (!cache) {
+            cache = std::make_shared<TextureCache>(budget);
+            caches[group] = cache;
+        }
+        return cache;
+    }
+
+    // Issue an identifier of a texture.
+    // The identifiers are not reused so that the keys of a removed texture never match.
+    int register_texture() {
+        return num_textures_++;
+    }
+
+    static uint64_t key(int texture_id, int tile_index) {
+        return (uint64_t(texture_id) << 32) | uint64_t(uint32_t(tile_index));
+    }
+
+private:
+    static uint64_t hash(uint64_t k) {
+        return k * 0x9e3779b97f4a7c15ull;
+    }
+
+    Shard& shard(uint64_t k) {
+        return shards_[hash(k) >> 60];
+    }
+
+    ThreadTile& thread_tile(uint64_t k) {
+        static thread_local std::array<ThreadTile, NumThreadTiles> tiles;
+        return tiles[(hash(k) >> 32) % NumThreadTiles];
+    }
+
+public:
+    // Get the data of the tile if the tile is resident, otherwise nullptr
+    Data find(uint64_t k) {
+        auto& t = thread_tile(k);
+        if (t.cache == uid_ && t.key == k) {
+            return t.data;
+        }
+        auto& s = shard(k);
+        std::unique_lock<std::mutex> lock(s.mutex);
+        auto it = s.tiles.find(k);
+        if (it == s.tiles.end()) {
+            return nullptr;
+        }
+        s.lru.splice(s.lru.begin(), s.lru, it->second.lru);
+        t = { uid_, k, it->second.data };
+        return it->second.data;
+    }
+
+    // Insert a tile evicting the least recently used tiles of the shard if necessary.
+    // Returns the resident data of the tile.
+    Data insert(uint64_t k, std::vector<uint8_t>&& data) {
+        auto& s = shard(k);
+        std::unique_lock<std::mutex> lock(s.mutex);
+        if (auto it = s.tiles.find(k); it != s.tiles.end()) {
+            return it->second.data;
+        }
+        auto d = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+        s.used += d->size();
+        s.lru.push_front(k);
+        s.tiles[k] = Tile{ d, s.lru.begin() };
+        // Keep at least the inserted tile
+        while (s.used > shard_budget_ && s.lru.size() > 1) {
+            auto it = s.tiles.find(s.lru.back());
+            s.used -= it->second.data->size();
+            s.tiles.erase(it);
+            s.lru.pop_back();
+        }
+        return d;
+    }
+
+    // Total size of the resident tiles of a texture in bytes
+    size_t resident_bytes(int texture_id) {
+        size_t bytes = 0;
+        for (auto& s : shards_) {
+            std::unique_lock<std::mutex> lock(s.mutex);
+            for (const auto& [k, tile] : s.tiles) {
+                if (int(k >> 32) == texture_id) {
+                    bytes += tile.data->size();
+                }
+            }
+        }
+        return bytes;
+    }
+
+    // Remove all tiles of a texture
+    void remove_texture(int texture_id) {
+        for (auto& s : shards_) {
+            std::unique_lock<std::mutex> lock(s.mutex);
+            for (auto it = s.lru.begin(); it != s.lru.end();) {
+                if (int(*it >> 32) != texture_id) {
+                    ++it;
+                    continue;
+                }
+                auto tile = s.tiles.find(*it);
+                s.used -= tile->second.data->size();
+                s.tiles.erase(tile);
+                it = s.lru.erase(it);
+            }
+        }
+    }
+};
+
 /*
 \rst
 .. function:: texture::bitmap
@@ -27,18 +189,415 @@ std::string sanitize_directory_separator(std::string p) {
 
     :param str path: Path to texture.
     :param bool flip: Flip loaded texture if true.
+    :param str format: Storage format of the texels (``auto``, ``float``, ``half``, ``byte``). Default value: ``auto``.
+    :param int cache_budget: Memory budget of the texture cache in MB. Default value: 1024.
+    :param bool mipmap: Store the mip levels for the filtered lookups. Default value: ``true``.
+    :param str filter: Reconstruction filter of the lookups (``nearest``, ``bilinear``). Default value: ``nearest``.
+
+    The image is loaded lazily on the first lookup and stored
+    in the texture cache in tiles of :math:`64\times 64` texels.
+    The cache is shared by the bitmap textures in the same asset group
+    and evicts the least recently used tiles when the total size exceeds the budget.
+    The budget is given by the first texture of the group.
+    Since the image file cannot be decoded partially, the image is decoded once
+    and the tiles are written to a temporary file in the storage format.
+    An evicted tile is read back from the temporary file when it is accessed again,
+    so that a miss costs the read of a single tile instead of decoding the image.
+    If the temporary file is not available, the image is decoded again on a miss.
+
+    ``auto`` format stores LDR images in 8 bits per channel and HDR images in float.
+    The 8-bit texels are converted to linear values on lookup
+    with the same conversion as the one used by ``stbi_loadf``.
+    ``byte`` format is only available for LDR images
+    and ``half`` format is used for HDR images instead.
+
+    If ``mipmap`` is enabled, the mip levels are generated by the box filter when the image is loaded
+    and stored in the cache in the same tiles as the image.
+    :cpp:func:`lm::Texture::eval_filtered` looks up the level whose texel size is closest to the footprint,
+    so that the distant surfaces only touch the tiles of the lower-resolution levels.
+
+    With ``bilinear`` filter, the color is interpolated from the four nearest texel centers,
+    where the texture coordinates repeat outside of :math:`[0,1]^2`.
+    The alpha component is not interpolated.
+
+    :cpp:func:`lm::Texture::eval_batch` computes the texel coordinates of the batch in advance
+    and reads consecutive texels in the same tile with a single access to the texture cache,
+    so that, e.g., the lookups along a row of the image access the cache once per tile.
 \endrst
 */
 class Texture_Bitmap final : public Texture {
 private:
+    // Number of texels along each axis of a tile
+    static constexpr int TileSize = 64;
+
+    // Storage format of the texels
+    enum class Format {
+        Float,
+        Half,
+        Byte,
+    };
+
+    // Mip level
+    struct Level {
+        int w;          // Width of the level
+        int h;          // Height of the level
+        int tw;         // Number of tiles along x axis
+        int th;         // Number of tiles along y axis
+        int offset;     // Index of the first tile of the level
+    };
+
+    std::string path_;      // Path to the image
+    bool flip_ = true;      // Flip the image vertically if true
+    Format format_ = Format::Float;
+    size_t budget_ = 0;     // Budget of the cache in bytes
+    bool mipmap_ = true;    // Store the mip levels if true
+    bool bilinear_ = false; // Bilinear filtering if true
     int w_;     // Width of the image
     int h_;     // Height of the image
     int c_;     // Number of components
-    std::vector<float> data_;
+    std::vector<Level> levels_;     // Mip levels. The first level is the image.
+    int num_tiles_;                 // Total number of tiles of the levels
+
+    std::shared_ptr<TextureCache> cache_;   // Shared texture cache
+    int id_;                                // Identifier of the texture in the cache
+    std::mutex load_mutex_;                 // Mutex to load the tiles
+    std::string tiles_path_;                // Path to the temporary file of the tiles
+    std::fstream tiles_file_;               // Temporary file of the tiles
+    bool tiles_file_failed_ = false;        // True if the temporary file is not available
+    std::vector<float> buffer_;             // Entire image as float array, only if requested
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(w_, h_, c_, data_);
+        ar(path_, flip_, format_, budget_, mipmap_, bilinear_, w_, h_, c_);
+        init_levels();
+        if (!cache_) {
+            attach_cache();
+        }
+    }
+
+    ~Texture_Bitmap() {
+        if (cache_) {
+            cache_->remove_texture(id_);
+        }
+        if (tiles_file_.is_open()) {
+            tiles_file_.close();
+            std::error_code ec;
+            fs::remove(tiles_path_, ec);
+        }
+    }
+
+private:
+    void attach_cache() {
+        cache_ = TextureCache::get(parent_loc(), budget_);
+        id_ = cache_->register_texture();
+    }
+
+    // Compute the sizes of the mip levels
+    void init_levels() {
+        levels_.clear();
+        num_tiles_ = 0;
+        int w = w_;
+        int h = h_;
+        while (true) {
+            const int tw = (w + TileSize - 1) / TileSize;
+            const int th = (h + TileSize - 1) / TileSize;
+            levels_.push_back({ w, h, tw, th, num_tiles_ });
+            num_tiles_ += tw * th;
+            if (!mipmap_ || (w == 1 && h == 1)) {
+                break;
+            }
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+    }
+
+    // Find the mip level containing the tile
+    int level_of_tile(int tile_index) const {
+        int l = 0;
+        while (l + 1 < int(levels_.size()) && levels_[l + 1].offset <= tile_index) {
+            l++;
+        }
+        return l;
+    }
+
+    int texel_bytes() const {
+        return format_ == Format::Float ? sizeof(float) : format_ == Format::Half ? sizeof(uint16_t) : sizeof(uint8_t);
+    }
+
+    // Size of a tile in bytes
+    size_t tile_bytes() const {
+        return size_t(TileSize) * TileSize * c_ * texel_bytes();
+    }
+
+    // Get the data of the tile, loading the tile if it is not resident
+    TextureCache::Data get_tile(int tile_index) const {
+        if (auto data = cache_->find(TextureCache::key(id_, tile_index))) {
+            return data;
+        }
+        return const_cast<Texture_Bitmap*>(this)->load(tile_index);
+    }
+
+    // Load a tile and insert it to the cache.
+    // The tile is read from the temporary file of the tiles if available.
+    // Otherwise the image is decoded and the tiles are written to the temporary file.
+    TextureCache::Data load(int requested_tile) {
+        std::unique_lock<std::mutex> lock(load_mutex_);
+        const auto k = TextureCache::key(id_, requested_tile);
+        if (auto data = cache_->find(k)) {
+            // Loaded by another thread
+            return data;
+        }
+        const auto bytes = tile_bytes();
+        if (tiles_file_.is_open()) {
+            std::vector<uint8_t> data(bytes);
+            tiles_file_.seekg(std::streamoff(requested_tile) * std::streamoff(bytes));
+            tiles_file_.read((char*)data.data(), std::streamsize(bytes));
+            if (!tiles_file_) {
+                LM_THROW_EXCEPTION(Error::IOError, "Failed to read tile [path='{}', tile={}]", tiles_path_, requested_tile);
+            }
+            return cache_->insert(k, std::move(data));
+        }
+        if (!tiles_file_failed_) {
+            const auto name = fmt::format("lm_texture_{:x}_{:x}.tiles",
+                reinterpret_cast<std::uintptr_t>(this), std::chrono::steady_clock::now().time_since_epoch().count());
+            tiles_path_ = (fs::temp_directory_path() / name).string();
+            tiles_file_.open(tiles_path_, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!tiles_file_.is_open()) {
+                LM_WARN("Failed to create temporary file of the tiles. "
+                        "The image is decoded on each miss of the cache [path='{}']", tiles_path_);
+                tiles_file_failed_ = true;
+            }
+        }
+        std::vector<uint8_t> requested;
+        decode_image([&](int tile_index, std::vector<uint8_t>&& data) {
+            if (tiles_file_.is_open()) {
+                tiles_file_.write((const char*)data.data(), std::streamsize(data.size()));
+            }
+            if (tile_index == requested_tile) {
+                requested = std::move(data);
+            }
+        });
+        if (tiles_file_.is_open() && !tiles_file_.flush()) {
+            LM_WARN("Failed to write temporary file of the tiles [path='{}']", tiles_path_);
+            tiles_file_.close();
+            std::error_code ec;
+            fs::remove(tiles_path_, ec);
+            tiles_file_failed_ = true;
+        }
+        return cache_->insert(k, std::move(requested));
+    }
+
+    // Decode the image and call emit for each tile in order of the tile index
+    template <typename Emit>
+    void decode_image(Emit&& emit) const {
+        int w, h, c;
+        void* data = format_ == Format::Byte
+            ? (void*)stbi_load(path_.c_str(), &w, &h, &c, 0)
+            : (void*)stbi_loadf(path_.c_str(), &w, &h, &c, 0);
+        if (data == nullptr) {
+            LM_ERROR("Failed to load image: {} [path='{}']", stbi_failure_reason(), path_);
+            LM_THROW_EXCEPTION_DEFAULT(Error::IOError);
+        }
+        if (w != w_ || h != h_ || c != c_) {
+            stbi_image_free(data);
+            LM_THROW_EXCEPTION(Error::IOError, "Image has been modified after loaded [path='{}']", path_);
+        }
+
+        // Generate the mip levels in linear values with the box filter.
+        // The first level is stored from the image as it is.
+        std::vector<std::vector<float>> mips(levels_.size());
+        const auto texel = [&](int l, int x, int y, int k) -> float {
+            if (l > 0) {
+                return mips[l][(size_t(y) * levels_[l].w + x) * c_ + k];
+            }
+            // Texture coordinates are bottom-up if flipped
+            const size_t si = (size_t(flip_ ? h_ - 1 - y : y) * w_ + x) * c_ + k;
+            if (format_ == Format::Byte) {
+                return float(decode((const uint8_t*)data, int(si), is_alpha(k)));
+            }
+            return ((const float*)data)[si];
+        };
+        for (int l = 1; l < int(levels_.size()); l++) {
+            const auto& prev = levels_[l - 1];
+            const auto& curr = levels_[l];
+            mips[l].resize(size_t(curr.w) * curr.h * c_);
+            for (int y = 0; y < curr.h; y++) {
+                const int y0 = std::min(2 * y, prev.h - 1);
+                const int y1 = std::min(2 * y + 1, prev.h - 1);
+                for (int x = 0; x < curr.w; x++) {
+                    const int x0 = std::min(2 * x, prev.w - 1);
+                    const int x1 = std::min(2 * x + 1, prev.w - 1);
+                    for (int k = 0; k < c_; k++) {
+                        mips[l][(size_t(y) * curr.w + x) * c_ + k] = .25f * (
+                            texel(l - 1, x0, y0, k) + texel(l - 1, x1, y0, k) +
+                            texel(l - 1, x0, y1, k) + texel(l - 1, x1, y1, k));
+                    }
+                }
+            }
+        }
+
+        // Split into tiles
+        const int bytes = texel_bytes();
+        for (int tile_index = 0; tile_index < num_tiles_; tile_index++) {
+            const int l = level_of_tile(tile_index);
+            const auto& level = levels_[l];
+            const int tx = (tile_index - level.offset) % level.tw;
+            const int ty = (tile_index - level.offset) / level.tw;
+            std::vector<uint8_t> tile(tile_bytes(), 0);
+            for (int y = ty * TileSize; y < std::min(level.h, (ty + 1) * TileSize); y++) {
+                const int sy = flip_ ? h_ - 1 - y : y;
+                for (int x = tx * TileSize; x < std::min(level.w, (tx + 1) * TileSize); x++) {
+                    const size_t si = (size_t(sy) * w_ + x) * c_;
+                    const size_t di = (size_t(y % TileSize) * TileSize + (x % TileSize)) * c_;
+                    for (int k = 0; k < c_; k++) {
+                        if (l > 0) {
+                            encode(tile.data(), int(di + k), texel(l, x, y, k), is_alpha(k));
+                        }
+                        else if (format_ == Format::Byte) {
+                            tile[di + k] = ((const uint8_t*)data)[si + k];
+                        }
+                        else if (format_ == Format::Half) {
+                            const auto v = glm::packHalf1x16(((const float*)data)[si + k]);
+                            std::memcpy(&tile[(di + k) * bytes], &v, bytes);
+                        }
+                        else {
+                            std::memcpy(&tile[(di + k) * bytes], &((const float*)data)[si + k], bytes);
+                        }
+                    }
+                }
+            }
+            emit(tile_index, std::move(tile));
+        }
+        stbi_image_free(data);
+    }
+
+    // True if the component is alpha
+    bool is_alpha(int k) const {
+        return c_ % 2 == 0 && k == c_ - 1;
+    }
+
+    // Encode a linear texel component. Inverse of decode().
+    void encode(uint8_t* data, int i, float v, bool alpha) const {
+        if (format_ == Format::Byte) {
+            const auto e = alpha ? v : std::pow(std::max(v, 0.f), 1.f / 2.2f);
+            data[i] = uint8_t(std::clamp(int(e * 255.f + .5f), 0, 255));
+        }
+        else if (format_ == Format::Half) {
+            const auto h = glm::packHalf1x16(v);
+            std::memcpy(data + i * sizeof(uint16_t), &h, sizeof(uint16_t));
+        }
+        else {
+            std::memcpy(data + i * sizeof(float), &v, sizeof(float));
+        }
+    }
+
+    // Decode a texel component
+    Float decode(const uint8_t* data, int i, bool alpha) const {
+        if (format_ == Format::Byte) {
+            // Same conversion as stbi_loadf.
+            // Color components are converted with gamma 2.2 and alpha linearly.
+            static const auto table = [] {
+                std::array<Float, 256> t;
+                for (int j = 0; j < 256; j++) {
+                    t[j] = std::pow(Float(j) / 255_f, 2.2_f);
+                }
+                return t;
+            }();
+            return alpha ? Float(data[i]) / 255_f : table[data[i]];
+        }
+        if (format_ == Format::Half) {
+            uint16_t v;
+            std::memcpy(&v, data + i * sizeof(uint16_t), sizeof(uint16_t));
+            return Float(glm::unpackHalf1x16(v));
+        }
+        float v;
+        std::memcpy(&v, data + i * sizeof(float), sizeof(float));
+        return Float(v);
+    }
+
+    // Decode a texel of a tile. Returns (r,g,b,a).
+    Vec4 texel_value(const uint8_t* data, int i) const {
+        Vec4 v(0_f);
+        for (int j = 0; j < std::min(c_, 4); j++) {
+            v[j] = decode(data, i + j, is_alpha(j));
+        }
+        if (c_ <= 2) {
+            // Gray scale image with optional alpha
+            return Vec4(v.x, v.x, v.x, c_ == 2 ? v.y : 0_f);
+        }
+        return v;
+    }
+
+    // Index of the tile containing the texel
+    int tile_of_texel(int l, int x, int y) const {
+        const auto& level = levels_[l];
+        return level.offset + (y / TileSize) * level.tw + (x / TileSize);
+    }
+
+    // Index of the first component of the texel in the tile
+    int index_in_tile(int x, int y) const {
+        return ((y % TileSize) * TileSize + (x % TileSize)) * c_;
+    }
+
+    // Fetch a texel of the mip level. Returns (r,g,b,a).
+    Vec4 fetch(int l, int x, int y) const {
+        const int tile_index = tile_of_texel(l, x, y);
+        const int i = index_in_tile(x, y);
+        return texel_value(get_tile(tile_index)->data(), i);
+    }
+
+    // Texel of bilinear filtering
+    struct Tap {
+        int x;
+        int y;
+        Float w;
+    };
+
+    // Compute the texels and weights of the lookup of the mip level.
+    // Returns the number of the texels.
+    int taps(Vec2 t, int l, Tap* out) const {
+        if (!bilinear_) {
+            const auto p = pixel_coords(t, l);
+            out[0] = { p.x, p.y, 1_f };
+            return 1;
+        }
+        const auto& level = levels_[l];
+        const auto fx = (t.x - floor(t.x)) * level.w - .5_f;
+        const auto fy = (t.y - floor(t.y)) * level.h - .5_f;
+        const auto x0f = std::floor(fx);
+        const auto y0f = std::floor(fy);
+        const auto dx = fx - x0f;
+        const auto dy = fy - y0f;
+        // Wrap the neighbors around the border
+        const int x0 = (int(x0f) + level.w) % level.w;
+        const int y0 = (int(y0f) + level.h) % level.h;
+        const int x1 = (x0 + 1) % level.w;
+        const int y1 = (y0 + 1) % level.h;
+        out[0] = { x0, y0, (1_f - dx) * (1_f - dy) };
+        out[1] = { x1, y0, dx * (1_f - dy) };
+        out[2] = { x0, y1, (1_f - dx) * dy };
+        out[3] = { x1, y1, dx * dy };
+        return 4;
+    }
+
+    // Color of the lookup of the mip level
+    Vec3 lookup(Vec2 t, int l) const {
+        Tap ts[4];
+        const int m = taps(t, l, ts);
+        Vec3 c(0_f);
+        for (int j = 0; j < m; j++) {
+            c += ts[j].w * Vec3(fetch(l, ts[j].x, ts[j].y));
+        }
+        return c;
+    }
+
+    Vec2i pixel_coords(Vec2 t, int l = 0) const {
+        const auto& level = levels_[l];
+        const auto u = t.x - floor(t.x);
+        const auto v = t.y - floor(t.y);
+        const int x = std::clamp(int(u * level.w), 0, level.w - 1);
+        const int y = std::clamp(int(v * level.h), 0, level.h - 1);
+        return { x, y };
     }
 
 public:
@@ -48,52 +607,144 @@ public:
 
     virtual void construct(const Json& prop) override {
         // Image path
-        const std::string path = sanitize_directory_separator(json::value<std::string>(prop, "path"));
-        LM_INFO("Loading texture [path='{}']", fs::path(path).filename().string());
-
-        // Load as HDR image
-        // LDR image is internally converted to HDR
-        const bool flip = json::value<bool>(prop, "flip", true);
-        stbi_set_flip_vertically_on_load(flip);
-        float* data = stbi_loadf(path.c_str(), &w_, &h_, &c_, 0);
-        if (data == nullptr) {
-            LM_ERROR("Failed to load image: {} [path='{}']", stbi_failure_reason(), path);
+        path_ = sanitize_directory_separator(json::value<std::string>(prop, "path"));
+        LM_INFO("Loading texture [path='{}']", fs::path(path_).filename().string());
+        flip_ = json::value<bool>(prop, "flip", true);
+        stbi_set_flip_vertically_on_load(false);
+
+        // Read image information. The texels are loaded lazily.
+        if (!stbi_info(path_.c_str(), &w_, &h_, &c_)) {
+            LM_ERROR("Failed to load image: {} [path='{}']", stbi_failure_reason(), path_);
             LM_THROW_EXCEPTION_DEFAULT(Error::IOError);
         }
-        // Allocate and copy the data
-        data_.assign(data, data + (w_*h_*c_));
-        stbi_image_free(data);
+        mipmap_ = json::value<bool>(prop, "mipmap", true);
+        init_levels();
+
+        // Reconstruction filter
+        const auto filter = json::value<std::string>(prop, "filter", "nearest");
+        if (filter != "nearest" && filter != "bilinear") {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid filter [filter='{}']", filter);
+        }
+        bilinear_ = filter == "bilinear";
+
+        // Storage format
+        // LDR image is internally converted to HDR unless stored in bytes
+        const auto format = json::value<std::string>(prop, "format", "auto");
+        if (format == "auto") {
+            format_ = stbi_is_hdr(path_.c_str()) ? Format::Float : Format::Byte;
+        }
+        else if (format == "float") {
+            format_ = Format::Float;
+        }
+        else if (format == "half") {
+            format_ = Format::Half;
+        }
+        else if (format == "byte") {
+            format_ = Format::Byte;
+            if (stbi_is_hdr(path_.c_str())) {
+                LM_WARN("HDR image cannot be stored in bytes. Using half instead [path='{}']", path_);
+                format_ = Format::Half;
+            }
+        }
+        else {
+            LM_THROW_EXCEPTION(Error::InvalidArgument, "Invalid storage format [format='{}']", format);
+        }
+
+        // Texture cache
+        budget_ = size_t(json::value<int>(prop, "cache_budget", 1024)) * 1024 * 1024;
+        attach_cache();
     }
 
     virtual Vec3 eval(Vec2 t) const override {
-        const auto u = t.x - floor(t.x);
-        const auto v = t.y - floor(t.y);
-        const int x = std::clamp(int(u * w_), 0, w_ - 1);
-        const int y = std::clamp(int(v * h_), 0, h_ - 1);
-        const int i = w_ * y + x;
-        return Vec3(data_[c_*i], data_[c_*i+1], data_[c_*i+2]);
+        return lookup(t, 0);
+    }
+
+    virtual void eval_batch(int n, const Vec2* t, Vec3* out) const override {
+        // Texels of the lookups with the tiles and weights
+        struct Texel {
+            int tile;   // Index of the tile
+            int i;      // Index of the texel in the tile
+            int out;    // Index of the lookup
+            Float w;    // Weight
+        };
+        thread_local std::vector<Texel> texels;
+        texels.clear();
+        for (int j = 0; j < n; j++) {
+            Tap ts[4];
+            const int m = taps(t[j], 0, ts);
+            for (int k = 0; k < m; k++) {
+                texels.push_back({ tile_of_texel(0, ts[k].x, ts[k].y), index_in_tile(ts[k].x, ts[k].y), j, ts[k].w });
+            }
+            out[j] = Vec3(0_f);
+        }
+
+        // Accumulate the texels. A run of consecutive texels in the same tile
+        // is read with a single access to the cache.
+        for (size_t begin = 0; begin < texels.size();) {
+            const int tile_index = texels[begin].tile;
+            size_t end = begin + 1;
+            while (end < texels.size() && texels[end].tile == tile_index) {
+                end++;
+            }
+            const auto data = get_tile(tile_index);
+            for (size_t j = begin; j < end; j++) {
+                const auto& texel = texels[j];
+                out[texel.out] += texel.w * Vec3(texel_value(data->data(), texel.i));
+            }
+            begin = end;
+        }
+    }
+
+    virtual Vec3 eval_filtered(Vec2 t, Float footprint) const override {
+        if (footprint <= 0_f || levels_.size() == 1) {
+            return eval(t);
+        }
+        // Select the level whose texel size is closest to the footprint
+        const auto lod = std::log2(footprint * Float(std::max(w_, h_)));
+        const int l = std::clamp(int(std::floor(lod + .5_f)), 0, int(levels_.size()) - 1);
+        return lookup(t, l);
     }
 
     virtual Vec3 eval_by_pixel_coords(int x, int y) const override {
-        const int i = w_*y + x;
-        return Vec3(data_[c_*i], data_[c_*i+1], data_[c_*i+2]);
+        return Vec3(fetch(0, x, y));
     }
 
     virtual Float eval_alpha(Vec2 t) const override {
-        const auto u = t.x - floor(t.x);
-        const auto v = t.y - floor(t.y);
-        const int x = std::clamp(int(u * w_), 0, w_ - 1);
-        const int y = std::clamp(int(v * h_), 0, h_ - 1);
-        const int i = w_ * y + x;
-        return data_[c_*i+3];
+        const auto p = pixel_coords(t);
+        return fetch(0, p.x, p.y).w;
     }
 
     virtual bool has_alpha() const override {
-        return c_ == 4;
+        return c_ == 2 || c_ == 4;
     }
 
+    // Materialize the entire image as the float array
     virtual TextureBuffer buffer() override {
-        return { w_, h_, c_, data_.data() };
+        if (buffer_.empty()) {
+            // Copy tile by tile to access the cache once per tile
+            buffer_.resize(size_t(w_) * h_ * c_);
+            const auto& level = levels_[0];
+            for (int tile_index = 0; tile_index < level.tw * level.th; tile_index++) {
+                const int tx = tile_index % level.tw;
+                const int ty = tile_index / level.tw;
+                const auto data = get_tile(tile_index);
+                for (int y = ty * TileSize; y < std::min(h_, (ty + 1) * TileSize); y++) {
+                    for (int x = tx * TileSize; x < std::min(w_, (tx + 1) * TileSize); x++) {
+                        const int i = ((y % TileSize) * TileSize + (x % TileSize)) * c_;
+                        for (int k = 0; k < c_; k++) {
+                            buffer_[(size_t(y) * w_ + x) * c_ + k] = float(decode(data->data(), i + k, is_alpha(k)));
+                        }
+                    }
+                }
+            }
+        }
+        return { w_, h_, c_, buffer_.data() };
+    }
+
+    // Resident tiles in the shared cache and the materialized buffer
+    virtual size_t memory_usage() const override {
+        const auto tiles = cache_ ? cache_->resident_bytes(id_) : 0;
+        return tiles + comp::bytes_of(levels_, buffer_);
     }
 };
 
@@ -43,6 +43,10 @@ public:
 		return color_;
 	}
 
+	virtual void eval_batch(int n, const Vec2*, Vec3* out) const override {
+		std::fill_n(out, n, color_);
+	}
+
 	virtual Vec3 eval_by_pixel_coords(int, int) const override {
 		return color_;
 	}
@@ -0,0 +1,165 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include <lm/tracecontext.h>
+#include <lm/logger.h>
+#include <lm/json.h>
+
+using namespace std::chrono;
+
+// ------------------------------------------------------------------------------------------------
+
+LM_NAMESPACE_BEGIN(LM_NAMESPACE::trace)
+
+// Tracing backend writing the events in Chrome trace format.
+// The file can be opened with chrome://tracing or Perfetto UI.
+// Each thread records the events to its own buffer without locks.
+// The lock is only used when a thread records an event for the first time.
+class TraceContext_Chrome final : public TraceContext {
+private:
+    struct Event {
+        std::string name;
+        double ts;      // Start time in microseconds
+        double dur;     // Duration in microseconds
+    };
+
+    struct ThreadBuffer {
+        int tid;
+        std::vector<Event> events;
+        std::vector<int> stack;     // Indices of the unfinished events
+    };
+
+    // Cache of the buffer of the current thread
+    struct ThreadCache {
+        long long generation = -1;
+        ThreadBuffer* buffer = nullptr;
+    };
+
+    static std::atomic<long long>& next_generation() {
+        static std::atomic<long long> generation{ 0 };
+        return generation;
+    }
+
+    std::string output_;
+    long long generation_;      // Identifies the context instance in the thread-local cache
+    time_point<steady_clock> start_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+
+private:
+    ThreadBuffer& buffer() {
+        thread_local ThreadCache cache;
+        if (cache.generation != generation_) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            buffers_.push_back(std::make_unique<ThreadBuffer>());
+            buffers_.back()->tid = int(buffers_.size()) - 1;
+            cache.buffer = buffers_.back().get();
+            cache.generation = generation_;
+        }
+        return *cache.buffer;
+    }
+
+    double now() const {
+        return duration<double, std::micro>(steady_clock::now() - start_).count();
+    }
+
+public:
+    TraceContext_Chrome()
+        : generation_(next_generation()++)
+        , start_(steady_clock::now())
+    {}
+
+    ~TraceContext_Chrome() {
+        // Write the events recorded so far.
+        // The unfinished events are closed at the time of shutdown.
+        const auto t = now();
+        Json events = Json::array();
+        for (const auto& b : buffers_) {
+            events.push_back({
+                {"name", "thread_name"},
+                {"ph", "M"},
+                {"pid", 0},
+                {"tid", b->tid},
+                {"args", {{"name", fmt::format("thread {}", b->tid)}}}
+            });
+            for (int i = 0; i < int(b->events.size()); i++) {
+                const auto& e = b->events[i];
+                const bool unfinished = std::find(b->stack.begin(), b->stack.end(), i) != b->stack.end();
+                events.push_back({
+                    {"name", e.name},
+                    {"cat", "lm"},
+                    {"ph", "X"},
+                    {"ts", e.ts},
+                    {"dur", unfinished ? t - e.ts : e.dur},
+                    {"pid", 0},
+                    {"tid", b->tid}
+                });
+            }
+        }
+        std::ofstream out(output_);
+        if (!out) {
+            LM_ERROR("Failed to write trace [path='{}']", output_);
+            return;
+        }
+        out << Json{ {"traceEvents", events}, {"displayTimeUnit", "ms"} }.dump();
+        LM_INFO("Saved trace [path='{}']", output_);
+    }
+
+public:
+    virtual void construct(const Json& prop) override {
+        output_ = json::value<std::string>(prop, "output", "trace.json");
+    }
+
+    virtual void begin(const std::string& name) override {
+        auto& b = buffer();
+        b.stack.push_back(int(b.events.size()));
+        b.events.push_back({ name, now(), 0 });
+    }
+
+    virtual void end() override {
+        auto& b = buffer();
+        if (b.stack.empty()) {
+            return;
+        }
+        auto& e = b.events[b.stack.back()];
+        b.stack.pop_back();
+        e.dur = now() - e.ts;
+    }
+};
+
+LM_COMP_REG_IMPL(TraceContext_Chrome, "trace::chrome");
+
+// ------------------------------------------------------------------------------------------------
+
+using Instance = comp::detail::ContextInstance<TraceContext>;
+
+LM_PUBLIC_API void init(const std::string& type, const Json& prop) {
+    Instance::init("trace::" + type, prop);
+}
+
+LM_PUBLIC_API void shutdown() {
+    Instance::shutdown();
+}
+
+LM_PUBLIC_API bool enabled() {
+    return Instance::initialized();
+}
+
+LM_PUBLIC_API void begin(const std::string& name) {
+    if (!enabled()) {
+        return;
+    }
+    Instance::get().begin(name);
+}
+
+LM_PUBLIC_API void end() {
+    if (!enabled()) {
+        return;
+    }
+    Instance::get().end();
+}
+
+LM_NAMESPACE_END(LM_NAMESPACE::trace)
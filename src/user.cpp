@@ -12,6 +12,7 @@
 #include <lm/parallel.h>
 #include <lm/progress.h>
 #include <lm/objloader.h>
+#include <lm/trace.h>
 #include <lm/assetgroup.h>
 
 LM_NAMESPACE_BEGIN(LM_NAMESPACE)
@@ -24,6 +25,7 @@ class UserContext : public Component {
 private:
 	bool initialized_ = false;      // True if initialized
 	Ptr<AssetGroup> root_assets_;   // Root asset group.
+    bool lazy_assets_ = false;      // True to defer the construction of the assets
 
 public:
     UserContext() {
@@ -51,7 +53,8 @@ private:
 	}
 
 public:
-    void init(const Json&) {
+    void init(const Json& prop) {
+        lazy_assets_ = json::value<bool>(prop, "lazy_assets", false);
         exception::init();
         log::init();
         parallel::init();
@@ -63,6 +66,7 @@ public:
 
     void shutdown() {
 		check_initialized();
+        trace::shutdown();
         objloader::shutdown();
         progress::shutdown();
         parallel::shutdown();
@@ -98,17 +102,49 @@ public:
 
     void reset() {
         // Initialize asset
-        root_assets_ = comp::create<AssetGroup>("asset_group::default", make_loc("assets"));
+        root_assets_ = comp::create<AssetGroup>("asset_group::default", make_loc("assets"), {
+            {"lazy", lazy_assets_}
+        });
     }
 
-    void save_state_to_file(const std::string& path) {
-        std::ofstream os(path, std::ios::out | std::ios::binary);
-        serial::save_comp(os, root_assets_, root_assets_->loc());
+    void save_state_to_file(const std::string& path, int compression) {
+        serial::save_snapshot(path, root_assets_, root_assets_->loc(), compression);
     }
 
     void load_state_from_file(const std::string& path) {
+        serial::load_snapshot(path, root_assets_, root_assets_->loc());
+    }
+
+    void save_checkpoint(const std::string& path, const Json& info, int compression) {
+        // Write to a temporary file and rename it
+        // so that the previous checkpoint is kept if the process is killed while writing
+        const auto temp_path = path + ".tmp";
+        if (compression > 0) {
+            std::ostringstream os;
+            serial::save_checkpoint(os, root_assets_.get(), info);
+            serial::detail::save_compressed(temp_path, os.str(), compression);
+        }
+        else {
+            std::ofstream os(temp_path, std::ios::out | std::ios::binary);
+            if (!os) {
+                LM_THROW_EXCEPTION(Error::IOError, "Failed to open checkpoint [path='{}']", temp_path);
+            }
+            serial::save_checkpoint(os, root_assets_.get(), info);
+        }
+        fs::rename(temp_path, path);
+    }
+
+    Json load_checkpoint(const std::string& path) {
+        if (const auto content = serial::detail::load_compressed(path); content) {
+            serial::detail::MemoryStreamBuf buf(content->data, content->size);
+            std::istream is(&buf);
+            return serial::load_checkpoint(is, root_assets_.get());
+        }
         std::ifstream is(path, std::ios::in | std::ios::binary);
-        serial::load_comp(is, root_assets_, root_assets_->loc());
+        if (!is) {
+            LM_THROW_EXCEPTION(Error::IOError, "Failed to open checkpoint [path='{}']", path);
+        }
+        return serial::load_checkpoint(is, root_assets_.get());
     }
 };
 
@@ -134,12 +170,20 @@ LM_PUBLIC_API AssetGroup* assets() {
     return UserContext::instance().assets();
 }
 
-LM_PUBLIC_API void save_state_to_file(const std::string& path) {
-    UserContext::instance().save_state_to_file(path);
+LM_PUBLIC_API void save_state_to_file(const std::string& path, int compression) {
+    UserContext::instance().save_state_to_file(path, compression);
 }
 
 LM_PUBLIC_API void load_state_from_file(const std::string& path) {
     UserContext::instance().load_state_from_file(path);
 }
 
+LM_PUBLIC_API void save_checkpoint(const std::string& path, const Json& info, int compression) {
+    UserContext::instance().save_checkpoint(path, info, compression);
+}
+
+LM_PUBLIC_API Json load_checkpoint(const std::string& path) {
+    return UserContext::instance().load_checkpoint(path);
+}
+
 LM_NAMESPACE_END(LM_NAMESPACE)
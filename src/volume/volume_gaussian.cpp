@@ -74,6 +74,11 @@ public:
         return *scalar_;
     }
 
+    virtual Float max_scalar_in(const Bound& b) const override {
+        // The gaussian is maximized at the closest point in the region to the center
+        return eval_scalar(glm::clamp(pos_, b.min, b.max));
+    }
+
     // Compute 3D gaussian value
     virtual Float eval_scalar(Vec3 p) const override {
         return [&](const Vec3 p, const Float max_v, const Vec3 &s)->Float{
@@ -17,19 +17,118 @@ LM_NAMESPACE_BEGIN(LM_NAMESPACE)
 
     :param volumes_alb: Array of references to volume albedos
     :param volumes_den: Array of references to volume densities
+
+    The lookups only visit the volumes whose bounds contain the point,
+    which are found with a BVH over the bounds of the volumes.
 \endrst
 */
 class Volume_Multi : public Volume {
 private:
+    // BVH node
+    struct Node {
+        Bound bound;        // Bound of the node
+        bool leaf;          // True if the node is leaf
+        int s, e;           // Range of volume indices if leaf (in indices_)
+        int c1, c2;         // Indices of child nodes if not leaf
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(bound, leaf, s, e, c1, c2);
+        }
+    };
+
+    // Maximum number of volumes in a leaf node
+    static constexpr int MaxLeafSize = 2;
+
     Bound bound_;           // Boundary including all volumes
     std::vector<Volume*> volumes_den_;
     std::vector<Volume*> volumes_alb_;
     unsigned int size_;     // Size of volume arrays
     Float max_scalar_ = 0;  // Sum of maxScalar() of all Volumes in volumes_den_
+    std::vector<Bound> bounds_;     // Bounds of the volumes
+    std::vector<Node> nodes_;       // BVH nodes. The first node is the root.
+    std::vector<int> indices_;      // Volume indices referenced from the leaf nodes
 
 public:
     LM_SERIALIZE_IMPL(ar) {
-        ar(bound_, max_scalar_, size_, volumes_den_, volumes_alb_);
+        ar(bound_, max_scalar_, size_, volumes_den_, volumes_alb_, bounds_, nodes_, indices_);
+    }
+
+private:
+    // Build BVH over the bounds of the volumes
+    void build_bvh() {
+        nodes_.clear();
+        indices_.resize(size_);
+        for (unsigned int i = 0; i < size_; i++) {
+            indices_[i] = int(i);
+        }
+        const std::function<int(int, int)> build = [&](int s, int e) -> int {
+            const int index = int(nodes_.size());
+            nodes_.emplace_back();
+            Bound b;
+            Bound cb;
+            for (int i = s; i < e; i++) {
+                b = merge(b, bounds_[indices_[i]]);
+                cb = merge(cb, bounds_[indices_[i]].center());
+            }
+            if (e - s <= MaxLeafSize) {
+                nodes_[index] = { b, true, s, e, -1, -1 };
+                return index;
+            }
+
+            // Split at the median of the centers along the longest axis
+            const auto d = cb.max - cb.min;
+            const int axis = d.x > d.y && d.x > d.z ? 0 : d.y > d.z ? 1 : 2;
+            const int mid = (s + e) / 2;
+            std::nth_element(indices_.begin() + s, indices_.begin() + mid, indices_.begin() + e, [&](int i1, int i2) {
+                return bounds_[i1].center()[axis] < bounds_[i2].center()[axis];
+            });
+            const int c1 = build(s, mid);
+            const int c2 = build(mid, e);
+            nodes_[index] = { b, false, -1, -1, c1, c2 };
+            return index;
+        };
+        build(0, int(size_));
+    }
+
+    // Call func for each volume whose bound overlaps the given bound
+    template <typename Func>
+    void traverse_overlapping(const Bound& b, Func&& func) const {
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const auto& node = nodes_[stack[--top]];
+            if (!overlaps(b, node.bound)) {
+                continue;
+            }
+            if (node.leaf) {
+                for (int i = node.s; i < node.e; i++) {
+                    const int vi = indices_[i];
+                    if (overlaps(b, bounds_[vi])) {
+                        func(vi);
+                    }
+                }
+                continue;
+            }
+            stack[top++] = node.c1;
+            stack[top++] = node.c2;
+        }
+    }
+
+    // Call func for each volume whose bound contains the point
+    template <typename Func>
+    void traverse_containing(Vec3 p, Func&& func) const {
+        Bound b;
+        b.min = p;
+        b.max = p;
+        traverse_overlapping(b, std::forward<Func>(func));
+    }
+
+    static bool overlaps(const Bound& b1, const Bound& b2) {
+        return b1.min.x <= b2.max.x && b2.min.x <= b1.max.x &&
+               b1.min.y <= b2.max.y && b2.min.y <= b1.max.y &&
+               b1.min.z <= b2.max.z && b2.min.z <= b1.max.z;
     }
 
 public:
@@ -59,6 +158,7 @@ public:
         Vec3 max = Vec3(-Inf);
         for(auto* v : volumes_den_) {
             const Bound b = v->bound();
+            bounds_.push_back(b);
 
             min.x = std::min(min.x,b.min.x);
             min.y = std::min(min.y,b.min.y);
@@ -72,11 +172,17 @@ public:
         }
         bound_.min = min;
         bound_.max = max;
+        build_bvh();
 
         LM_DEBUG("min bound: {}, {}, {}", bound_.min.x, bound_.min.y, bound_.min.z);
         LM_DEBUG("max bound: {}, {}, {}", bound_.max.x, bound_.max.y, bound_.max.z);
     }
 
+    // The volumes are weak references
+    virtual size_t memory_usage() const override {
+        return comp::bytes_of(volumes_den_, volumes_alb_, bounds_, nodes_, indices_);
+    }
+
     virtual Bound bound() const override {
         return bound_;
     }
@@ -90,25 +196,77 @@ public:
         return max_scalar_;
     }
 
-    bool is_in_bound(const Vec3& p, const Bound& b) const {
-        auto is_between=[](Float a, Float low, Float high)->bool{
-            return (low <= a && high >= a);
-        };
-
-        return is_between(p.x, b.min.x, b.max.x) &&
-               is_between(p.y, b.min.y, b.max.y) &&
-               is_between(p.z, b.min.z, b.max.z);
+    // Sum of the local majorants of the volumes overlapping the region
+    virtual Float max_scalar_in(const Bound& b) const override {
+        Float sum = 0_f;
+        traverse_overlapping(b, [&](int i) {
+            Bound overlap;
+            overlap.min = glm::max(b.min, bounds_[i].min);
+            overlap.max = glm::min(b.max, bounds_[i].max);
+            sum += volumes_den_[i]->max_scalar_in(overlap);
+        });
+        return sum;
     }
-    
-    // Computes the sum over all Volumes of eval_scalar
+
+    // Computes the sum over the Volumes containing p of eval_scalar
     virtual Float eval_scalar(Vec3 p) const override {
         Float sum = 0._f;
-        for( auto* v : volumes_den_ ) {
-            if (!is_in_bound(p, v->bound()))
-                continue;
-            sum += v->eval_scalar(p);
+        traverse_containing(p, [&](int i) {
+            sum += volumes_den_[i]->eval_scalar(p);
+        });
+        return sum;
+    }
+
+    virtual void eval_scalar_n(const Vec3* ps, int n, Float* out) const override {
+        std::fill(out, out + n, 0_f);
+
+        // Per-thread scratch buffers reused across the calls.
+        // A volume can be another volume::multi, so the buffers are kept per nesting level.
+        struct Scratch {
+            std::vector<std::pair<int, int>> refs;  // Pairs of (volume index, position index)
+            std::vector<Vec3> ps_in;
+            std::vector<Float> values;
+        };
+        thread_local std::vector<std::unique_ptr<Scratch>> scratches;
+        thread_local size_t level = 0;
+        if (level == scratches.size()) {
+            scratches.push_back(std::make_unique<Scratch>());
+        }
+        auto& scratch = *scratches[level];
+        struct ScopedLevel {
+            size_t& l;
+            ScopedLevel(size_t& l_) : l(l_) { l++; }
+            ~ScopedLevel() { l--; }
+        } scoped_level(level);
+
+        // Bucket the positions by the volumes containing them
+        auto& refs = scratch.refs;
+        refs.clear();
+        for (int i = 0; i < n; i++) {
+            traverse_containing(ps[i], [&](int vi) {
+                refs.emplace_back(vi, i);
+            });
+        }
+        std::sort(refs.begin(), refs.end());
+
+        // Evaluate in a batch per volume and scatter
+        auto& ps_in = scratch.ps_in;
+        auto& values = scratch.values;
+        for (size_t begin = 0; begin < refs.size();) {
+            const int vi = refs[begin].first;
+            size_t end = begin;
+            ps_in.clear();
+            while (end < refs.size() && refs[end].first == vi) {
+                ps_in.push_back(ps[refs[end].second]);
+                end++;
+            }
+            values.resize(ps_in.size());
+            volumes_den_[vi]->eval_scalar_n(ps_in.data(), int(ps_in.size()), values.data());
+            for (size_t i = begin; i < end; i++) {
+                out[refs[i].second] += values[i - begin];
+            }
+            begin = end;
         }
-       return sum;
     }
 
     // This Volume requires to have color and scalar
@@ -121,15 +279,14 @@ public:
         Float sum = 0;
         Vec3 resulting_color(0._f);
         
-        for( unsigned int i = 0; i < size_; i++ ) {
-            if (!is_in_bound(p, volumes_den_[i]->bound()))
-                continue;
-
+        traverse_containing(p, [&](int i) {
             //accumulate separately scalar and scalar times color
             Float sc = volumes_den_[i]->eval_scalar(p);
+            if (sc == 0_f)
+                return;
             resulting_color += sc * volumes_alb_[i]->eval_color(p);
             sum += sc;
-        }
+        });
         //perform the scalar ratio
         return resulting_color/sum;
     }
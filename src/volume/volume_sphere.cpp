@@ -71,6 +71,12 @@ public:
         return *scalar_;
     }
 
+    virtual Float max_scalar_in(const Bound& b) const override {
+        // Check if the closest point in the region is inside the sphere
+        const auto p = glm::clamp(pos_, b.min, b.max);
+        return glm::length(p - pos_) <= radius_ ? *scalar_ : 0_f;
+    }
+
     bool inSphere(const Vec3 &p, const Float r) const {
         return (glm::length(p) < r) ? true : false;
     }
@@ -206,6 +206,24 @@ TEST_CASE("Component query") {
         CHECK(p2);
         CHECK(p2->name() == "p2");
     }
+
+    SUBCASE("get after destruction") {
+        // Resolve the locators to cache them
+        auto* p1 = dynamic_cast<H_P1_*>(lm::comp::get<H>("$.p1"));
+        REQUIRE(p1);
+        REQUIRE(lm::comp::get<H>("$.p1.p2"));
+
+        // Destroying p2 must not leave the dangling entry in the cache
+        p1->p2.reset();
+        CHECK(lm::comp::get<H>("$.p1.p2") == nullptr);
+        CHECK(lm::comp::get<H>("$.p1") == p1);
+
+        // The new instance is resolved with the same locator
+        p1->p2 = lm::comp::create<H>("test::comp::h_p2_", p1->make_loc("p2"), {});
+        const auto* p2 = lm::comp::get<H>("$.p1.p2");
+        CHECK(p2 == p1->p2.get());
+        CHECK(p2->name() == "p2");
+    }
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -38,7 +38,7 @@ TEST_CASE("Exception") {
                 LM_UNUSED(t);
             };
             SUBCASE("Enabled") {
-                lm::exception::ScopedInit ex_;
+                lm::exception::ScopedInit ex_({{"fpex", true}});
                 CHECK(Check(f, "EXCEPTION_FLT_INVALID_OPERATION"));
             }
             SUBCASE("Disabled") {
@@ -53,7 +53,7 @@ TEST_CASE("Exception") {
                 LM_UNUSED(t);
             };
             SUBCASE("Enabled") {
-                lm::exception::ScopedInit ex_;
+                lm::exception::ScopedInit ex_({{"fpex", true}});
                 CHECK(Check(f, "EXCEPTION_FLT_INVALID_OPERATION"));
             }
             SUBCASE("Disabled") {
@@ -68,7 +68,7 @@ TEST_CASE("Exception") {
                 LM_UNUSED(t);
             };
             SUBCASE("Enabled") {
-                lm::exception::ScopedInit ex_;
+                lm::exception::ScopedInit ex_({{"fpex", true}});
                 CHECK(Check(f, "EXCEPTION_FLT_DIVIDE_BY_ZERO"));
             }
             SUBCASE("Disabled") {
@@ -82,7 +82,7 @@ TEST_CASE("Exception") {
                 LM_UNUSED(t);
             };
             SUBCASE("Enabled") {
-                lm::exception::ScopedInit ex_;
+                lm::exception::ScopedInit ex_({{"fpex", true}});
                 CHECK(Check(f, "EXCEPTION_FLT_INVALID_OPERATION"));
             }
             SUBCASE("Disabled") {
@@ -101,7 +101,7 @@ TEST_CASE("Exception") {
                 LM_UNUSED(t);
             };
             SUBCASE("Enabled") {
-                lm::exception::ScopedInit ex_;
+                lm::exception::ScopedInit ex_({{"fpex", true}});
                 CHECK(Check(f) == "EXCEPTION_FLT_INVALID_OPERATION");
             }
             SUBCASE("Disabled") {
@@ -153,7 +153,7 @@ TEST_CASE("Exception") {
             const volatile double t = 0 / z;
             LM_UNUSED(t);
         };
-        lm::exception::ScopedInit ex_;
+        lm::exception::ScopedInit ex_({{"fpex", true}});
         CHECK(Check(f, "EXCEPTION_FLT_INVALID_OPERATION"));
         {
             lm::exception::ScopedDisableFPEx disabled_;
@@ -0,0 +1,181 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include "test_common.h"
+#include <lm/math.h>
+
+LM_NAMESPACE_BEGIN(LM_TEST_NAMESPACE)
+
+using namespace lm::literals;
+
+namespace {
+
+// Generate a sequence of random numbers
+std::vector<lm::Float> generate(lm::Rng& rng, int n) {
+    std::vector<lm::Float> us(n);
+    for (auto& u : us) {
+        u = rng.u();
+    }
+    return us;
+}
+
+}
+
+TEST_CASE("Rng") {
+    SUBCASE("Range") {
+        lm::Rng rng(42);
+        for (int i = 0; i < 10000; i++) {
+            const auto u = rng.u();
+            CHECK(u >= 0_f);
+            CHECK(u < 1_f);
+        }
+    }
+
+    SUBCASE("Reproducible with the same seed") {
+        lm::Rng rng1(42);
+        lm::Rng rng2(42);
+        CHECK(generate(rng1, 100) == generate(rng2, 100));
+    }
+
+    SUBCASE("Split is reproducible") {
+        const lm::Rng rng(42);
+        auto s1 = rng.split(3, 7);
+        auto s2 = rng.split(3, 7);
+        CHECK(generate(s1, 100) == generate(s2, 100));
+    }
+
+    SUBCASE("Split streams are distinct") {
+        // The streams split with different keys must not share the sequences,
+        // including the streams whose keys only differ by the order.
+        const lm::Rng rng(42);
+        const std::vector<std::pair<long long, long long>> keys{
+            {0,0}, {0,1}, {1,0}, {1,1}, {3,7}, {7,3}, {100000,0}
+        };
+        std::vector<std::vector<lm::Float>> seqs;
+        for (const auto& [a, b] : keys) {
+            auto s = rng.split(a, b);
+            seqs.push_back(generate(s, 100));
+        }
+        for (size_t i = 0; i < seqs.size(); i++) {
+            for (size_t j = i + 1; j < seqs.size(); j++) {
+                CHECK(seqs[i] != seqs[j]);
+            }
+        }
+    }
+
+    SUBCASE("Split depends on the parent") {
+        const lm::Rng rng1(1);
+        const lm::Rng rng2(2);
+        auto s1 = rng1.split(3, 7);
+        auto s2 = rng2.split(3, 7);
+        CHECK(generate(s1, 100) != generate(s2, 100));
+    }
+
+    SUBCASE("Split does not advance the parent") {
+        lm::Rng rng1(42);
+        lm::Rng rng2(42);
+        [[maybe_unused]] const auto s = rng1.split(3, 7);
+        CHECK(generate(rng1, 100) == generate(rng2, 100));
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+
+TEST_CASE("Dist") {
+    // Includes zero-weighted bins and a dominant bin.
+    // The frequencies are compared with the tolerance of about 4 standard deviations.
+    const std::vector<lm::Float> weights{ 1_f, 0_f, 3_f, 0.5_f, 10_f, 0_f, 2_f, 0.25_f };
+    const int n = int(weights.size());
+    constexpr int M = 200000;
+
+    lm::Dist dist;
+    for (auto w : weights) {
+        dist.add(w);
+    }
+    dist.norm();
+    lm::Dist dist_alias = dist;
+    dist_alias.init_alias();
+
+    SUBCASE("Alias table keeps the pmf") {
+        for (int i = 0; i < n; i++) {
+            CHECK(dist_alias.pmf(i) == dist.pmf(i));
+        }
+    }
+
+    SUBCASE("Sampling frequency matches the pmf") {
+        for (const auto* d : { &dist, &dist_alias }) {
+            lm::Rng rng(42);
+            std::vector<int> count(n, 0);
+            for (int k = 0; k < M; k++) {
+                const int i = d->sample(rng.u());
+                REQUIRE(i >= 0);
+                REQUIRE(i < n);
+                count[i]++;
+            }
+            for (int i = 0; i < n; i++) {
+                CAPTURE(i);
+                if (weights[i] == 0_f) {
+                    CHECK(count[i] == 0);
+                }
+                CHECK(std::abs(lm::Float(count[i]) / M - d->pmf(i)) < 0.005_f);
+            }
+        }
+    }
+}
+
+TEST_CASE("Dist2") {
+    constexpr int W = 4;
+    constexpr int H = 3;
+    const std::vector<lm::Float> weights{
+        1_f, 2_f, 0_f, 4_f,
+        0_f, 0.25_f, 0_f, 0_f,
+        3_f, 0.5_f, 8_f, 1_f,
+    };
+    constexpr int M = 200000;
+
+    lm::Dist2 dist;
+    dist.init(weights, W, H);
+    lm::Dist2 dist_alias;
+    dist_alias.init(weights, W, H, true);
+
+    SUBCASE("Alias table keeps the pdf") {
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                const auto u = (x + 0.5_f) / W;
+                const auto v = (y + 0.5_f) / H;
+                CHECK(dist_alias.pdf(u, v) == doctest::Approx(dist.pdf(u, v)));
+            }
+        }
+    }
+
+    SUBCASE("Sampling frequency matches the pdf") {
+        for (const auto* d : { &dist, &dist_alias }) {
+            lm::Rng rng(42);
+            std::vector<int> count(W * H, 0);
+            for (int k = 0; k < M; k++) {
+                const auto p = d->sample(lm::Vec4(rng.u(), rng.u(), rng.u(), rng.u()));
+                REQUIRE(p.x >= 0_f);
+                REQUIRE(p.x <= 1_f);
+                REQUIRE(p.y >= 0_f);
+                REQUIRE(p.y <= 1_f);
+                const int x = std::min(int(p.x * W), W - 1);
+                const int y = std::min(int(p.y * H), H - 1);
+                count[y * W + x]++;
+            }
+            for (int y = 0; y < H; y++) {
+                for (int x = 0; x < W; x++) {
+                    CAPTURE(x);
+                    CAPTURE(y);
+                    // The pdf is defined in [0,1]^2, thus the probability of a cell is pdf/(W*H)
+                    const auto pdf = d->pdf((x + 0.5_f) / W, (y + 0.5_f) / H);
+                    CHECK(std::abs(lm::Float(count[y * W + x]) / M - pdf / (W * H)) < 0.005_f);
+                }
+            }
+        }
+    }
+}
+
+LM_NAMESPACE_END(LM_TEST_NAMESPACE)
@@ -0,0 +1,119 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include "test_common.h"
+#include <lm/parallel.h>
+
+LM_NAMESPACE_BEGIN(LM_TEST_NAMESPACE)
+
+TEST_CASE("TaskGroup") {
+    lm::log::ScopedInit log_;
+
+    SUBCASE("Recursive spawn") {
+        // Count leaves of a binary recursion over [0,N)
+        constexpr int N = 100000;
+        std::vector<int> visited(N, 0);
+        lm::parallel::TaskGroup g;
+        std::function<void(int, int)> f = [&](int s, int e) {
+            if (e - s < 16) {
+                for (int i = s; i < e; i++) {
+                    visited[i]++;
+                }
+                return;
+            }
+            const int m = (s + e) / 2;
+            g.run([&f, s, m]() { f(s, m); });
+            f(m, e);
+        };
+        g.run([&]() { f(0, N); });
+        g.wait();
+        CHECK(std::all_of(visited.begin(), visited.end(), [](int v) { return v == 1; }));
+    }
+
+    SUBCASE("Nested groups") {
+        std::atomic<int> count = 0;
+        lm::parallel::TaskGroup g;
+        for (int i = 0; i < 16; i++) {
+            g.run([&]() {
+                lm::parallel::TaskGroup g2;
+                for (int j = 0; j < 16; j++) {
+                    g2.run([&]() { count++; });
+                }
+                g2.wait();
+            });
+        }
+        g.wait();
+        CHECK(count == 256);
+    }
+
+    SUBCASE("Exception") {
+        lm::parallel::TaskGroup g;
+        for (int i = 0; i < 100; i++) {
+            g.run([i]() {
+                if (i == 50) {
+                    throw std::runtime_error("error");
+                }
+            });
+        }
+        CHECK_THROWS_AS(g.wait(), std::runtime_error);
+    }
+}
+
+TEST_CASE("WorkStealing") {
+    lm::log::ScopedInit log_;
+    lm::parallel::init("workstealing", {{"num_threads", 4}});
+
+    SUBCASE("Foreach") {
+        constexpr long long N = 100000;
+        std::vector<int> visited(N, 0);
+        lm::parallel::foreach(N, [&](long long i, int threadid) {
+            CHECK(threadid >= 0);
+            CHECK(threadid < 4);
+            visited[i]++;
+        });
+        CHECK(std::all_of(visited.begin(), visited.end(), [](int v) { return v == 1; }));
+    }
+
+    SUBCASE("Nested foreach") {
+        std::atomic<long long> count = 0;
+        lm::parallel::foreach(64, [&](long long, int) {
+            lm::parallel::foreach(1000, [&](long long, int) { count++; });
+        });
+        CHECK(count == 64000);
+    }
+
+    SUBCASE("Exception") {
+        CHECK_THROWS_AS(lm::parallel::foreach(10000, [](long long i, int) {
+            if (i == 5000) {
+                throw std::runtime_error("error");
+            }
+        }), std::runtime_error);
+    }
+
+    SUBCASE("External executor") {
+        std::vector<std::thread> threads;
+        std::atomic<int> num_workers = 0;
+        lm::parallel::set_executor([&](const lm::parallel::TaskFunc& worker) {
+            threads.emplace_back([&num_workers, worker]() {
+                num_workers++;
+                worker();
+            });
+        });
+        std::atomic<long long> count = 0;
+        lm::parallel::foreach(10000, [&](long long, int) { count++; });
+        CHECK(count == 10000);
+        lm::parallel::set_executor(nullptr);
+        for (auto& th : threads) {
+            th.join();
+        }
+        CHECK(threads.size() == 3);
+        CHECK(num_workers == 3);
+    }
+
+    lm::parallel::shutdown();
+}
+
+LM_NAMESPACE_END(LM_TEST_NAMESPACE)
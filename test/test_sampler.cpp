@@ -0,0 +1,92 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include "test_common.h"
+#include <lm/sampler.h>
+
+LM_NAMESPACE_BEGIN(LM_TEST_NAMESPACE)
+
+using namespace lm::literals;
+
+namespace {
+
+// Call the function for each registered sampler
+void foreach_sampler(const std::function<void(const std::string& key, lm::Sampler* sampler)>& func) {
+    for (const std::string key : { "sampler::random", "sampler::halton", "sampler::sobol" }) {
+        CAPTURE(key);
+        const auto sampler = lm::comp::create<lm::Sampler>(key, "", { {"seed", 42} });
+        REQUIRE(sampler);
+        func(key, sampler.get());
+    }
+}
+
+}
+
+TEST_CASE("Sampler") {
+    lm::log::ScopedInit log_;
+
+    SUBCASE("Range") {
+        foreach_sampler([](const std::string&, lm::Sampler* sampler) {
+            for (int dim = 0; dim < 64; dim++) {
+                for (int i = 0; i < 256; i++) {
+                    const auto u = sampler->u(7, i, dim);
+                    CHECK(u >= 0_f);
+                    CHECK(u < 1_f);
+                }
+            }
+        });
+    }
+
+    SUBCASE("Reproducible with the same seed") {
+        foreach_sampler([](const std::string& key, lm::Sampler* sampler) {
+            const auto other = lm::comp::create<lm::Sampler>(key, "", { {"seed", 42} });
+            for (int dim = 0; dim < 8; dim++) {
+                for (int i = 0; i < 16; i++) {
+                    CHECK(sampler->u(7, i, dim) == other->u(7, i, dim));
+                }
+            }
+        });
+    }
+
+    SUBCASE("Pixels are decorrelated") {
+        foreach_sampler([](const std::string&, lm::Sampler* sampler) {
+            int same = 0;
+            for (int i = 0; i < 16; i++) {
+                same += sampler->u(0, i, 0) == sampler->u(1, i, 0) ? 1 : 0;
+            }
+            CHECK(same < 16);
+        });
+    }
+
+    SUBCASE("Stream consumes the dimensions") {
+        foreach_sampler([](const std::string&, lm::Sampler* sampler) {
+            lm::SampleStream stream(sampler, 7, 3);
+            for (int dim = 0; dim < 8; dim++) {
+                CHECK(stream.u() == sampler->u(7, 3, dim));
+            }
+        });
+    }
+}
+
+TEST_CASE("Sampler (sobol)") {
+    lm::log::ScopedInit log_;
+    const auto sampler = lm::comp::create<lm::Sampler>("sampler::sobol", "", { {"seed", 42} });
+
+    SUBCASE("Stratified in each dimension") {
+        // The first 2^k samples of a pixel fall into distinct intervals of size 2^-k
+        constexpr int N = 64;
+        for (int dim = 0; dim < 8; dim++) {
+            CAPTURE(dim);
+            std::vector<int> count(N, 0);
+            for (int i = 0; i < N; i++) {
+                count[std::min(int(sampler->u(7, i, dim) * N), N - 1)]++;
+            }
+            CHECK(std::all_of(count.begin(), count.end(), [](int c) { return c == 1; }));
+        }
+    }
+}
+
+LM_NAMESPACE_END(LM_TEST_NAMESPACE)
@@ -0,0 +1,98 @@
+/*
+    Lightmetrica - Copyright (c) 2019 Hisanari Otsu
+    Distributed under MIT license. See LICENSE file for details.
+*/
+
+#include <pch.h>
+#include "test_common.h"
+#include <lm/assetgroup.h>
+#include <lm/scene.h>
+#include <lm/surface.h>
+
+LM_NAMESPACE_BEGIN(LM_TEST_NAMESPACE)
+
+using namespace lm::literals;
+
+TEST_CASE("Light selection (bvh)") {
+    lm::log::ScopedInit log_;
+
+    auto assets = lm::comp::create<lm::AssetGroup>("asset_group::default", "$");
+    REQUIRE(assets);
+    lm::comp::detail::register_root_comp(assets.get());
+
+    // Point lights with different positions and intensities, and an unbounded light
+    assets->load_asset("accel", "accel::sahbvh", {});
+    auto* scene = dynamic_cast<lm::Scene*>(assets->load_asset("scene", "scene::default", {
+        {"accel", "$.accel"},
+        {"light_selection", "bvh"}
+    }));
+    REQUIRE(scene);
+    const std::vector<std::pair<lm::Vec3, lm::Float>> points{
+        { lm::Vec3(0,0,0), 1_f },
+        { lm::Vec3(1,0,0), 2_f },
+        { lm::Vec3(5,1,0), 0.5_f },
+        { lm::Vec3(-3,2,1), 4_f },
+        { lm::Vec3(0,-4,2), 1_f },
+        { lm::Vec3(10,10,10), 8_f },
+    };
+    for (int i = 0; i < int(points.size()); i++) {
+        const auto name = fmt::format("light{}", i);
+        assets->load_asset(name, "light::point", {
+            {"Le", lm::Vec3(points[i].second)},
+            {"position", points[i].first}
+        });
+        const int node = scene->create_primitive_node({ {"light", "$." + name} });
+        scene->add_child(scene->root_node(), node);
+    }
+    assets->load_asset("light_env", "light::envconst", { {"Le", lm::Vec3(1)} });
+    scene->add_child(scene->root_node(), scene->create_primitive_node({ {"light", "$.light_env"} }));
+    scene->build();
+    const int n = scene->num_lights();
+    REQUIRE(n == int(points.size()) + 1);
+
+    // Shading points inside and outside of the lights
+    std::vector<lm::PointGeometry> geoms;
+    for (const auto& p : { lm::Vec3(0.1_f,0.2_f,0.3_f), lm::Vec3(4,1,0), lm::Vec3(-20,5,3) }) {
+        geoms.push_back(lm::PointGeometry::make_degenerated(p));
+    }
+
+    SUBCASE("pdf is normalized") {
+        for (const auto& geom : geoms) {
+            lm::Float sum = 0_f;
+            for (int i = 0; i < n; i++) {
+                sum += scene->pdf_light_selection(geom, i);
+            }
+            CHECK(sum == doctest::Approx(1));
+        }
+    }
+
+    SUBCASE("Selection probability matches pdf_light_selection") {
+        for (const auto& geom : geoms) {
+            lm::Rng rng(42);
+            for (int k = 0; k < 1000; k++) {
+                const auto s = scene->sample_light_selection(geom, rng.u());
+                REQUIRE(s.light_index >= 0);
+                REQUIRE(s.light_index < n);
+                CHECK(s.p_sel == doctest::Approx(scene->pdf_light_selection(geom, s.light_index)));
+            }
+        }
+    }
+
+    SUBCASE("Sampling frequency matches pdf_light_selection") {
+        // The frequencies are compared with the tolerance of about 4 standard deviations
+        constexpr int M = 200000;
+        for (const auto& geom : geoms) {
+            lm::Rng rng(42);
+            std::vector<int> count(n, 0);
+            for (int k = 0; k < M; k++) {
+                count[scene->sample_light_selection(geom, rng.u()).light_index]++;
+            }
+            for (int i = 0; i < n; i++) {
+                CAPTURE(i);
+                CHECK(std::abs(lm::Float(count[i]) / M - scene->pdf_light_selection(geom, i)) < 0.005_f);
+            }
+        }
+    }
+}
+
+LM_NAMESPACE_END(LM_TEST_NAMESPACE)
@@ -234,6 +234,29 @@ struct TestSerial_Root final : public lm::Component {
     }
 };
 
+// Component with the arrays stored in and out of the blobs of a snapshot
+struct TestSerial_Arrays final : public lm::Component {
+    std::vector<lm::Vec3> large;    // Larger than the blob threshold
+    std::vector<int> small;         // Smaller than the blob threshold
+    std::string name;
+
+    virtual void construct(const lm::Json& prop) override {
+        const int n = prop["n"];
+        large.resize(n);
+        for (int i = 0; i < n; i++) {
+            large[i] = lm::Vec3(lm::Float(i), lm::Float(i) * lm::Float(.5), -lm::Float(i));
+        }
+        small = { 1, 2, 3, 4, 5 };
+        name = prop["name"];
+    }
+
+    LM_SERIALIZE_IMPL(ar) {
+        ar(large, small, name);
+    }
+};
+
+LM_COMP_REG_IMPL(TestSerial_Arrays, "testserial_arrays");
+
 // ------------------------------------------------------------------------------------------------
 
 TEST_CASE("Serialization") {
@@ -436,4 +459,99 @@ TEST_CASE("Serialization") {
     }
 }
 
+// ------------------------------------------------------------------------------------------------
+
+namespace {
+
+// Check the loaded arrays are same as the original ones
+void check_arrays(const lm::Component* orig, const lm::Component* loaded) {
+    const auto* a = dynamic_cast<const TestSerial_Arrays*>(orig);
+    const auto* b = dynamic_cast<const TestSerial_Arrays*>(loaded);
+    REQUIRE(a);
+    REQUIRE(b);
+    CHECK(a->large == b->large);
+    CHECK(a->small == b->small);
+    CHECK(a->name == b->name);
+}
+
+}
+
+TEST_CASE("Snapshot") {
+    lm::log::ScopedInit init;
+
+    const std::string path = "test_snapshot.lms";
+    const int n = int(lm::OutputArchive::BlobThreshold / sizeof(lm::Vec3)) + 100;
+    auto orig = lm::comp::create<lm::Component>("testserial_arrays", "", {
+        {"n", n},
+        {"name", "arrays"}
+    });
+    REQUIRE(orig);
+
+    SUBCASE("Round trip") {
+        lm::serial::save_snapshot(path, orig, orig->loc());
+
+        // The large array is stored in the blob region
+        const auto snapshot = lm::serial::detail::map_snapshot(path);
+        REQUIRE(snapshot);
+        CHECK(snapshot->native);
+        CHECK(snapshot->blobs_size >= n * sizeof(lm::Vec3));
+
+        lm::Component::Ptr<lm::Component> loaded;
+        lm::serial::load_snapshot(path, loaded, orig->loc());
+        check_arrays(orig.get(), loaded.get());
+    }
+
+    SUBCASE("Fallback to the stream") {
+        // The file written by save_comp is not a snapshot
+        {
+            std::ofstream os(path, std::ios::out | std::ios::binary);
+            lm::serial::save_comp(os, orig, orig->loc());
+        }
+        CHECK(!lm::serial::detail::map_snapshot(path));
+
+        lm::Component::Ptr<lm::Component> loaded;
+        lm::serial::load_snapshot(path, loaded, orig->loc());
+        check_arrays(orig.get(), loaded.get());
+    }
+
+    #if LM_USE_ZSTD
+    SUBCASE("Round trip (compressed)") {
+        lm::serial::save_snapshot(path, orig, orig->loc(), 3);
+
+        // The compressed snapshot is decompressed on mapping
+        const auto snapshot = lm::serial::detail::map_snapshot(path);
+        REQUIRE(snapshot);
+        CHECK(snapshot->native);
+        CHECK(snapshot->blobs_size >= n * sizeof(lm::Vec3));
+
+        lm::Component::Ptr<lm::Component> loaded;
+        lm::serial::load_snapshot(path, loaded, orig->loc());
+        check_arrays(orig.get(), loaded.get());
+    }
+    #else
+    SUBCASE("Compression requires zstd") {
+        CHECK_THROWS(lm::serial::save_snapshot(path, orig, orig->loc(), 3));
+    }
+    #endif
+
+    SUBCASE("Native archive") {
+        // Without the blobs, the arrays are written to the stream as single blocks
+        std::stringstream ss;
+        {
+            lm::OutputArchive ar(ss, orig->loc());
+            ar.set_native(true);
+            cereal::save_owned(ar, orig.get());
+        }
+        lm::Component::Ptr<lm::Component> loaded;
+        {
+            lm::InputArchive ar(ss, orig->loc());
+            ar.set_native(true);
+            lm::serial::detail::load_comp(ar, loaded);
+        }
+        check_arrays(orig.get(), loaded.get());
+    }
+
+    std::remove(path.c_str());
+}
+
 LM_NAMESPACE_END(LM_TEST_NAMESPACE)